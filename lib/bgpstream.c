@@ -32,6 +32,7 @@
 #include "bgpstream_int.h"
 #include "bgpstream_di_mgr.h"
 #include "bgpstream_log.h"
+#include "bs_transport_cache.h"
 #include "utils.h"
 #include <assert.h>
 #include <stdio.h>
@@ -49,6 +50,26 @@ struct bgpstream {
   int started;
 };
 
+/* State of bgpstream_run */
+typedef struct run_state {
+
+  /* user's elem callback and pointer */
+  bgpstream_record_elem_cb_t *elem_cb;
+  void *user;
+
+  /* value returned by the callback that stopped the stream (0 if none) */
+  int stop;
+
+} run_state_t;
+
+/* pass each elem on to the user's callback, remembering if it stops */
+static int run_elem_cb(bgpstream_record_t *record, bgpstream_elem_t *elem,
+                       void *user)
+{
+  run_state_t *state = (run_state_t *)user;
+  return (state->stop = state->elem_cb(record, elem, state->user));
+}
+
 /* ========== INTERNAL METHODS (see bgpstream_int.h) ========== */
 
 /* ========== PUBLIC METHODS (see bgpstream_int.h) ========== */
@@ -202,6 +223,12 @@ void bgpstream_set_live_mode(bgpstream_t *bs)
   bgpstream_di_mgr_set_blocking(bs->di_mgr);
 }
 
+void bgpstream_set_record_retain_mode(bgpstream_t *bs)
+{
+  assert(!bs->started);
+  bgpstream_di_mgr_set_record_retain(bs->di_mgr);
+}
+
 /* turn on the bgpstream interface, i.e.:
  * it makes the interface ready
  * for a new get next call
@@ -233,6 +260,42 @@ int bgpstream_get_next_record(bgpstream_t *bs, bgpstream_record_t **record)
   return bgpstream_di_mgr_get_next_record(bs->di_mgr, record);
 }
 
+void bgpstream_get_cache_stats(bgpstream_cache_stats_t *stats)
+{
+  bs_transport_cache_get_stats(&stats->hits, &stats->misses,
+                               &stats->evictions);
+}
+
+int bgpstream_run(bgpstream_t *bs, bgpstream_record_cb_t *record_cb,
+                  bgpstream_record_elem_cb_t *elem_cb, void *user)
+{
+  run_state_t state = {elem_cb, user, 0};
+  bgpstream_record_t *record;
+  int rc;
+
+  assert(bs->started);
+
+  while ((rc = bgpstream_di_mgr_get_next_record(bs->di_mgr, &record)) > 0) {
+    if (record_cb != NULL && (state.stop = record_cb(record, user)) != 0) {
+      break;
+    }
+    if (elem_cb != NULL) {
+      rc = bgpstream_record_foreach_elem(record, run_elem_cb, &state);
+      if (state.stop != 0) {
+        break;
+      }
+      if (rc < 0) {
+        return -1;
+      }
+    }
+  }
+
+  if (rc < 0 || state.stop < 0) {
+    return -1;
+  }
+  return state.stop;
+}
+
 /* destroy a bgpstream interface instance */
 void bgpstream_destroy(bgpstream_t *bs)
 {
@@ -32,202 +32,181 @@
 #include "bgpstream_elem_int.h"
 #include "bgpstream_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_fmt.h"
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
 
-#define B_REMAIN (len > written ? len - written : 0) /* unsigned */
-#define B_FULL (written >= len)
-#define ADD_PIPE                                                               \
-  do {                                                                         \
-    if (len > written + 1) {                                                   \
-      buf_p[0] = '|';                                                          \
-      buf_p[1] = '\0';                                                         \
-    }                                                                          \
-    buf_p++;                                                                   \
-    written++;                                                                 \
-  } while (0)
-
-#define SEEK_STR_END                                                           \
-  do {                                                                         \
-    while (*buf_p != '\0') {                                                   \
-      written++;                                                               \
-      buf_p++;                                                                 \
-    }                                                                          \
-  } while (0)
-
-char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
-                                             const bgpstream_record_t *record,
-                                             const bgpstream_elem_t *elem)
+/* upper bound on the length of a bgpdump line, excluding the AS path and the
+   communities */
+#define BGPDUMP_FMT_FIXED_MAX_LEN                                              \
+  (12 + BGPSTREAM_FMT_UINT32_MAX_LEN + 1 + 6 +                                 \
+   (BGPSTREAM_FMT_ADDR_MAX_LEN + 1) + (BGPSTREAM_FMT_UINT32_MAX_LEN + 1) +      \
+   (BGPSTREAM_FMT_PFX_MAX_LEN + 1) + 1 + 11 + (BGPSTREAM_FMT_ADDR_MAX_LEN + 1) + \
+   (BGPSTREAM_FMT_UINT32_MAX_LEN + 1) * 2 + 1 + 4 +                            \
+   (BGPSTREAM_FMT_UINT32_MAX_LEN + 1 + BGPSTREAM_FMT_ADDR_MAX_LEN + 1))
+
+static char *bgpdump_fmt(char *p, const bgpstream_record_t *record,
+                         const bgpstream_elem_t *elem)
 {
-  assert(record);
-  assert(elem);
-
-  size_t written = 0; /* < how many bytes we wanted to write */
-  ssize_t c = 0;      /* < how many chars were written */
-  char *buf_p = buf;
-
   /* Record type */
   switch (elem->type) {
   case BGPSTREAM_ELEM_TYPE_RIB:
-    c = snprintf(buf_p, B_REMAIN, "TABLE_DUMP2|%" PRIu32, record->time_sec);
+    p = bgpstream_fmt_str(p, "TABLE_DUMP2|");
+    p = bgpstream_fmt_uint32(p, record->time_sec);
     break;
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
-    c = snprintf(buf_p, B_REMAIN, "BGP4MP|%" PRIu32, record->time_sec);
+    p = bgpstream_fmt_str(p, "BGP4MP|");
+    p = bgpstream_fmt_uint32(p, record->time_sec);
     break;
   default:
-    c = 0;
     break;
   }
-  written += c;
-  buf_p += c;
-  ADD_PIPE;
+  *p++ = '|';
 
   switch (elem->type) {
   case BGPSTREAM_ELEM_TYPE_RIB:
-    c = snprintf(buf_p, B_REMAIN, "B");
+    *p++ = 'B';
     break;
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
-    c = snprintf(buf_p, B_REMAIN, "A");
+    *p++ = 'A';
     break;
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
-    c = snprintf(buf_p, B_REMAIN, "W");
+    *p++ = 'W';
     break;
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
-    c = snprintf(buf_p, B_REMAIN, "STATE");
+    p = bgpstream_fmt_str(p, "STATE");
     break;
   default:
-    c = 0;
     break;
   }
-
-  written += c;
-  buf_p += c;
-  ADD_PIPE;
+  *p++ = '|';
 
   /* PEER IP */
-  if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->peer_ip) == NULL) {
+  if ((p = bgpstream_fmt_addr(p, &elem->peer_ip)) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed peer address");
     return NULL;
   }
-  SEEK_STR_END;
-  ADD_PIPE;
+  *p++ = '|';
 
   /* PEER ASN */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->peer_asn);
-  written += c;
-  buf_p += c;
-  ADD_PIPE;
+  p = bgpstream_fmt_uint32(p, elem->peer_asn);
+  *p++ = '|';
 
   switch (elem->type) {
   case BGPSTREAM_ELEM_TYPE_RIB:
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
     /* PREFIX */
-    if (bgpstream_pfx_snprintf(buf_p, B_REMAIN, &(elem->prefix)) == NULL) {
+    if ((p = bgpstream_fmt_pfx(p, &elem->prefix)) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix");
       return NULL;
     }
-    SEEK_STR_END;
-    ADD_PIPE;
+    *p++ = '|';
 
     /* AS PATH */
-    c = bgpstream_as_path_snprintf(buf_p, B_REMAIN, elem->as_path);
-    written += c;
-    buf_p += c;
-
-    ADD_PIPE;
+    p = bgpstream_fmt_as_path(p, elem->as_path);
+    *p++ = '|';
 
     /* SOURCE (IGP) */
     switch (elem->origin) {
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_IGP:
-      c = snprintf(buf_p, B_REMAIN, "IGP");
+      p = bgpstream_fmt_str(p, "IGP");
       break;
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_EGP:
-      c = snprintf(buf_p, B_REMAIN, "EGP");
+      p = bgpstream_fmt_str(p, "EGP");
       break;
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_INCOMPLETE:
-      c = snprintf(buf_p, B_REMAIN, "INCOMPLETE");
+      p = bgpstream_fmt_str(p, "INCOMPLETE");
       break;
     default:
-      c = 0;
       break;
     }
-    written += c;
-    buf_p += c;
-    ADD_PIPE;
+    *p++ = '|';
 
     /* NEXT HOP */
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->nexthop) == NULL) {
+    if ((p = bgpstream_fmt_addr(p, &elem->nexthop)) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed next_hop IP address");
       return NULL;
     }
-    SEEK_STR_END;
-    ADD_PIPE;
+    *p++ = '|';
 
     /* LOCAL_PREF */
-    c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->local_pref);
-    written += c;
-    buf_p += c;
-    ADD_PIPE;
+    p = bgpstream_fmt_uint32(p, elem->local_pref);
+    *p++ = '|';
 
     /* MED */
-    c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->med);
-    written += c;
-    buf_p += c;
-    ADD_PIPE;
+    p = bgpstream_fmt_uint32(p, elem->med);
+    *p++ = '|';
 
     /* COMMUNITIES */
-    c = bgpstream_community_set_snprintf(buf_p, B_REMAIN, elem->communities);
-    written += c;
-    buf_p += c;
-
-    ADD_PIPE;
+    p = bgpstream_fmt_community_set(p, elem->communities);
+    *p++ = '|';
 
     /* AGGREGATE AG/NAG */
     if (elem->atomic_aggregate == 1) {
-      c = snprintf(buf_p, B_REMAIN, "AG");
+      p = bgpstream_fmt_str(p, "AG");
     } else {
-      c = snprintf(buf_p, B_REMAIN, "NAG");
+      p = bgpstream_fmt_str(p, "NAG");
     }
-    written += c;
-    buf_p += c;
-    ADD_PIPE;
+    *p++ = '|';
 
     /* AGGREGATOR AS AND IP */
     if (elem->aggregator.has_aggregator > 0) {
-      c = snprintf(buf_p, B_REMAIN, "%" PRIu32 " ",
-                   elem->aggregator.aggregator_asn);
-      written += c;
-      buf_p += c;
-      if (bgpstream_addr_ntop(buf_p, B_REMAIN,
-                              &elem->aggregator.aggregator_addr) == NULL) {
+      p = bgpstream_fmt_uint32(p, elem->aggregator.aggregator_asn);
+      *p++ = ' ';
+      if ((p = bgpstream_fmt_addr(p, &elem->aggregator.aggregator_addr)) ==
+          NULL) {
         bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed aggregator IP address");
         return NULL;
       }
-      SEEK_STR_END;
     }
-
-    ADD_PIPE;
-
+    *p++ = '|';
     break;
+
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
     /* PREFIX */
-    if (bgpstream_pfx_snprintf(buf_p, B_REMAIN, &(elem->prefix)) == NULL) {
+    if ((p = bgpstream_fmt_pfx(p, &elem->prefix)) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix");
       return NULL;
     }
-    SEEK_STR_END;
     break;
+
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
-    c = snprintf(buf_p, B_REMAIN, "%u|%u", elem->old_state, elem->new_state);
-    written += c;
-    buf_p += c;
+    p = bgpstream_fmt_uint32(p, elem->old_state);
+    *p++ = '|';
+    p = bgpstream_fmt_uint32(p, elem->new_state);
     break;
+
   default:
     break;
   }
 
-  return B_FULL ? NULL : buf;
+  return p;
+}
+
+char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
+                                             const bgpstream_record_t *record,
+                                             const bgpstream_elem_t *elem)
+{
+  assert(record);
+  assert(elem);
+
+  bgpstream_fmt_buf_t fb;
+  size_t written; /* < how many bytes we wanted to write */
+  char *p;
+
+  if ((p = bgpstream_fmt_buf_start(
+         &fb, buf, len,
+         BGPDUMP_FMT_FIXED_MAX_LEN +
+           bgpstream_fmt_as_path_max_len(elem->as_path) +
+           bgpstream_fmt_community_set_max_len(elem->communities))) == NULL) {
+    return NULL;
+  }
+
+  p = bgpdump_fmt(p, record, elem);
+  written = bgpstream_fmt_buf_finish(&fb, p);
+
+  return (p == NULL || written >= len) ? NULL : buf;
 }
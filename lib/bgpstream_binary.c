@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_binary.h"
+#include "bgpstream_codec.h"
+#include "bgpstream_log.h"
+#include "khash.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Amount of encoded data to buffer before it is output */
+#define OUT_BUF_FLUSH_LEN (1024 * 1024)
+
+/** Upper bound on the encoded length of a record message, excluding its
+ * elems */
+#define RECORD_MAX_LEN                                                         \
+  (1 + CODEC_VARINT_PATCH_LEN + CODEC_VARINT_MAX_LEN * 5 + 3 +                 \
+   CODEC_ADDR_MAX_LEN + CODEC_VARINT_PATCH_LEN)
+
+/** Upper bound on the encoded length of an elem, excluding its AS path and
+ * communities */
+#define ELEM_MAX_LEN                                                           \
+  (1 + CODEC_VARINT_MAX_LEN * 5 + CODEC_PFX_MAX_LEN + CODEC_ADDR_MAX_LEN + 2)
+
+KHASH_INIT(strid, char *, uint32_t, 1, kh_str_hash_func, kh_str_hash_equal)
+
+struct bgpstream_binary_writer {
+
+  /* callback used to output encoded data */
+  bgpstream_binary_write_cb_t *cb;
+  void *user;
+
+  /* encoded data that has not been output yet */
+  codec_buf_t out;
+
+  /* dictionary entries that must be output before the current record */
+  codec_buf_t defs;
+
+  /* string dictionary (the empty string has ID 0) */
+  khash_t(strid) *strs;
+  uint32_t strs_cnt;
+
+  /* peer dictionary */
+  bgpstream_peer_sig_map_t *peers;
+  bgpstream_peer_sig_map_cache_t peer_cache;
+  int peers_cnt;
+
+  /* time of the previously encoded record */
+  uint32_t last_time_sec;
+};
+
+static int get_str_id(bgpstream_binary_writer_t *writer, const char *str,
+                      uint32_t *id)
+{
+  khiter_t k;
+  int khret;
+  char *cpy;
+  size_t len;
+  size_t len_off;
+
+  if (*str == '\0') {
+    *id = 0;
+    return 0;
+  }
+  if ((k = kh_get(strid, writer->strs, (char *)str)) != kh_end(writer->strs)) {
+    *id = kh_val(writer->strs, k);
+    return 0;
+  }
+
+  len = strlen(str);
+  if ((cpy = strdup(str)) == NULL ||
+      codec_reserve(&writer->defs, 1 + CODEC_VARINT_PATCH_LEN +
+                                     CODEC_VARINT_MAX_LEN + len) != 0) {
+    free(cpy);
+    return -1;
+  }
+  k = kh_put(strid, writer->strs, cpy, &khret);
+  if (khret < 0) {
+    free(cpy);
+    return -1;
+  }
+  *id = kh_val(writer->strs, k) = ++writer->strs_cnt;
+
+  codec_put_u8(&writer->defs, BGPSTREAM_BINARY_MSG_STR);
+  len_off = codec_skip_varint(&writer->defs);
+  codec_put_varint(&writer->defs, *id);
+  codec_put_bytes(&writer->defs, str, len);
+  codec_patch_varint(&writer->defs, len_off,
+               writer->defs.len - len_off - CODEC_VARINT_PATCH_LEN);
+  return 0;
+}
+
+static int get_peer_id(bgpstream_binary_writer_t *writer,
+                       bgpstream_record_t *record, bgpstream_elem_t *elem,
+                       bgpstream_peer_id_t *id)
+{
+  size_t len_off;
+
+  if ((*id = bgpstream_peer_sig_map_get_id_cached(
+         writer->peers, &writer->peer_cache, record->collector_name,
+         &elem->peer_ip, elem->peer_asn)) == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not get peer ID");
+    return -1;
+  }
+  // peer IDs are allocated sequentially, so a new peer has the next ID
+  if (*id <= writer->peers_cnt) {
+    return 0;
+  }
+
+  if (codec_reserve(&writer->defs, 1 + CODEC_VARINT_PATCH_LEN +
+                                     CODEC_VARINT_MAX_LEN * 2 +
+                                     CODEC_ADDR_MAX_LEN) != 0) {
+    return -1;
+  }
+  codec_put_u8(&writer->defs, BGPSTREAM_BINARY_MSG_PEER);
+  len_off = codec_skip_varint(&writer->defs);
+  codec_put_varint(&writer->defs, *id);
+  codec_put_varint(&writer->defs, elem->peer_asn);
+  codec_put_addr(&writer->defs, &elem->peer_ip);
+  codec_patch_varint(&writer->defs, len_off,
+               writer->defs.len - len_off - CODEC_VARINT_PATCH_LEN);
+  writer->peers_cnt = *id;
+  return 0;
+}
+
+static int add_elem(bgpstream_binary_writer_t *writer,
+                    bgpstream_record_t *record, bgpstream_elem_t *elem)
+{
+  codec_buf_t *b = &writer->out;
+  bgpstream_peer_id_t peer_id;
+  bgpstream_peer_sig_t *sig;
+  const bgpstream_community_t *comm;
+  uint8_t *path_data = NULL;
+  uint16_t path_len = 0;
+  int comms_cnt = 0;
+  int i;
+
+  if (get_peer_id(writer, record, elem, &peer_id) != 0) {
+    return -1;
+  }
+
+  if (elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+      elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) {
+    path_len = bgpstream_as_path_get_data(elem->as_path, &path_data);
+    comms_cnt = bgpstream_community_set_size(elem->communities);
+  }
+  if (codec_reserve(b, ELEM_MAX_LEN + CODEC_VARINT_MAX_LEN * 2 + path_len +
+                         comms_cnt * 4) != 0) {
+    return -1;
+  }
+
+  codec_put_u8(b, elem->type);
+  sig = bgpstream_peer_sig_map_get_sig(writer->peers, peer_id);
+  if (sig->peer_asnumber == elem->peer_asn) {
+    codec_put_varint(b, (uint64_t)peer_id << 1);
+  } else {
+    codec_put_varint(b, ((uint64_t)peer_id << 1) | 1);
+    codec_put_varint(b, elem->peer_asn);
+  }
+  codec_put_zigzag(b, (int64_t)elem->orig_time_sec - record->time_sec);
+  codec_put_varint(b, elem->orig_time_usec);
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    codec_put_pfx(b, &elem->prefix);
+    codec_put_addr(b, &elem->nexthop);
+    codec_put_varint(b, path_len);
+    codec_put_bytes(b, path_data, path_len);
+    // communities are stored as a raw COMMUNITIES attribute
+    codec_put_varint(b, comms_cnt);
+    for (i = 0; i < comms_cnt; i++) {
+      comm = bgpstream_community_set_get(elem->communities, i);
+      codec_put_u8(b, comm->asn >> 8);
+      codec_put_u8(b, comm->asn & 0xff);
+      codec_put_u8(b, comm->value >> 8);
+      codec_put_u8(b, comm->value & 0xff);
+    }
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    codec_put_pfx(b, &elem->prefix);
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    codec_put_u8(b, elem->old_state);
+    codec_put_u8(b, elem->new_state);
+    break;
+
+  default:
+    break;
+  }
+
+  return 0;
+}
+
+/* ==================== PUBLIC FUNCTIONS ==================== */
+
+bgpstream_binary_writer_t *
+bgpstream_binary_writer_create(bgpstream_binary_write_cb_t *cb, void *user)
+{
+  bgpstream_binary_writer_t *writer;
+
+  if ((writer = malloc_zero(sizeof(bgpstream_binary_writer_t))) == NULL) {
+    return NULL;
+  }
+  writer->cb = cb;
+  writer->user = user;
+
+  if ((writer->strs = kh_init(strid)) == NULL ||
+      (writer->peers = bgpstream_peer_sig_map_create()) == NULL ||
+      codec_reserve(&writer->out, BGPSTREAM_BINARY_HEADER_LEN) != 0) {
+    goto err;
+  }
+
+  codec_put_bytes(&writer->out, BGPSTREAM_BINARY_MAGIC,
+                  sizeof(BGPSTREAM_BINARY_MAGIC) - 1);
+  codec_put_u8(&writer->out, BGPSTREAM_BINARY_VERSION);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  codec_put_u8(&writer->out, BGPSTREAM_BINARY_FLAG_BIG_ENDIAN);
+#else
+  codec_put_u8(&writer->out, 0);
+#endif
+  codec_put_u8(&writer->out, 0);
+
+  return writer;
+
+err:
+  bgpstream_binary_writer_destroy(writer);
+  return NULL;
+}
+
+void bgpstream_binary_writer_destroy(bgpstream_binary_writer_t *writer)
+{
+  khiter_t k;
+
+  if (writer == NULL) {
+    return;
+  }
+
+  if (writer->strs != NULL) {
+    for (k = kh_begin(writer->strs); k != kh_end(writer->strs); ++k) {
+      if (kh_exist(writer->strs, k)) {
+        free(kh_key(writer->strs, k));
+      }
+    }
+    kh_destroy(strid, writer->strs);
+  }
+  bgpstream_peer_sig_map_destroy(writer->peers);
+  free(writer->out.data);
+  free(writer->defs.data);
+
+  free(writer);
+}
+
+int bgpstream_binary_writer_add_record(bgpstream_binary_writer_t *writer,
+                                       bgpstream_record_t *record)
+{
+  codec_buf_t *b = &writer->out;
+  size_t start = b->len;
+  size_t len_off, cnt_off;
+  uint32_t project_id, collector_id, router_id;
+  bgpstream_elem_t *elem;
+  uint64_t elems_cnt = 0;
+  int rc;
+
+  if (get_str_id(writer, record->project_name, &project_id) != 0 ||
+      get_str_id(writer, record->collector_name, &collector_id) != 0 ||
+      get_str_id(writer, record->router_name, &router_id) != 0 ||
+      codec_reserve(b, RECORD_MAX_LEN) != 0) {
+    goto err;
+  }
+
+  codec_put_u8(b, BGPSTREAM_BINARY_MSG_RECORD);
+  len_off = codec_skip_varint(b);
+  codec_put_zigzag(b, (int64_t)record->time_sec - writer->last_time_sec);
+  codec_put_varint(b, record->time_usec);
+  codec_put_u8(b, record->type);
+  codec_put_u8(b, record->status);
+  codec_put_u8(b, record->dump_pos);
+  codec_put_varint(b, project_id);
+  codec_put_varint(b, collector_id);
+  codec_put_varint(b, router_id);
+  codec_put_addr(b, &record->router_ip);
+  codec_put_zigzag(b, (int64_t)record->dump_time_sec - record->time_sec);
+  cnt_off = codec_skip_varint(b);
+
+  while ((rc = bgpstream_record_get_next_elem(record, &elem)) > 0) {
+    if (add_elem(writer, record, elem) != 0) {
+      goto err;
+    }
+    elems_cnt++;
+  }
+  if (rc != 0) {
+    goto err;
+  }
+
+  codec_patch_varint(b, cnt_off, elems_cnt);
+  codec_patch_varint(b, len_off, b->len - len_off - CODEC_VARINT_PATCH_LEN);
+
+  // dictionary entries must come before the record that uses them. this only
+  // happens when new strings or peers are seen, so the copy is rare.
+  if (writer->defs.len > 0) {
+    if (codec_reserve(b, writer->defs.len) != 0) {
+      goto err;
+    }
+    memmove(b->data + start + writer->defs.len, b->data + start,
+            b->len - start);
+    memcpy(b->data + start, writer->defs.data, writer->defs.len);
+    b->len += writer->defs.len;
+    writer->defs.len = 0;
+  }
+
+  writer->last_time_sec = record->time_sec;
+
+  if (b->len >= OUT_BUF_FLUSH_LEN) {
+    return bgpstream_binary_writer_flush(writer);
+  }
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not encode record");
+  // drop the partial record, but keep any new dictionary entries for the
+  // next record
+  b->len = start;
+  return -1;
+}
+
+int bgpstream_binary_writer_flush(bgpstream_binary_writer_t *writer)
+{
+  if (writer->out.len == 0) {
+    return 0;
+  }
+  if (writer->cb(writer->out.data, writer->out.len, writer->user) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not write binary elem stream");
+    return -1;
+  }
+  writer->out.len = 0;
+  return 0;
+}
+
+int bgpstream_binary_writer_sync(bgpstream_binary_writer_t *writer)
+{
+  khiter_t k;
+
+  if (codec_reserve(&writer->out, 2) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add sync point");
+    return -1;
+  }
+  codec_put_u8(&writer->out, BGPSTREAM_BINARY_MSG_SYNC);
+  codec_put_varint(&writer->out, 0);
+
+  // forget everything the reader may not have seen
+  for (k = kh_begin(writer->strs); k != kh_end(writer->strs); ++k) {
+    if (kh_exist(writer->strs, k)) {
+      free(kh_key(writer->strs, k));
+    }
+  }
+  kh_clear(strid, writer->strs);
+  writer->strs_cnt = 0;
+  bgpstream_peer_sig_map_clear(writer->peers);
+  writer->peers_cnt = 0;
+  writer->defs.len = 0;
+  writer->last_time_sec = 0;
+  return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_BINARY_H
+#define __BGPSTREAM_BINARY_H
+
+#include "bgpstream_record.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the bgpstream
+ * binary elem stream writer.
+ *
+ * The binary elem stream is a compact encoding of (filtered) records and their
+ * elems, which can be read back by BGPStream using the "binary" resource
+ * format (e.g., with the singlefile data interface). It is much cheaper to
+ * produce and to consume than the ASCII output of bgpreader.
+ *
+ * A stream starts with an 8 byte header: the magic string "BSBIN", the format
+ * version, a flags byte and a reserved (zero) byte. It is followed by
+ * messages, each made of a type byte, a varint payload length and the
+ * payload. Varints are unsigned LEB128, and signed values are zigzag-encoded.
+ *
+ * - STR messages define a string: varint ID, then the string bytes. ID 0 is
+ *   the empty string.
+ * - PEER messages define a peer: varint ID, varint ASN, address.
+ * - RECORD messages hold a record: zigzag time delta (from the previous
+ *   record), varint usec, type, status and dump position bytes, varint
+ *   project, collector and router string IDs, router address, zigzag dump
+ *   time delta (from the record time), varint elem count, then the elems.
+ * - SYNC messages (empty) mark a point where a reader can start: the
+ *   dictionaries are emptied (IDs are reassigned from 1), and the time delta
+ *   of the next record is from 0.
+ *
+ * Each elem is a type byte, a varint peer reference, zigzag orig time delta
+ * (from the record time) and varint orig usec, followed by (depending on the
+ * type) the prefix, next-hop address, AS path and communities, or the old and
+ * new peer states. Addresses are a version byte (0, 4 or 6) and the address bytes,
+ * prefixes are a version byte, mask length and the significant address bytes.
+ * AS paths are a varint length and the raw BGPStream AS path segment bytes (in
+ * the byte order given by the header flags), and communities are a varint
+ * count and the raw COMMUNITIES attribute bytes. The peer reference is the
+ * peer ID shifted left by one; if the low bit is set, a varint ASN follows
+ * that overrides the one in the PEER message (peers are identified by
+ * collector and address only).
+ *
+ */
+
+/**
+ * @name Public Constants
+ *
+ * @{ */
+
+/** Magic string at the start of a binary elem stream */
+#define BGPSTREAM_BINARY_MAGIC "BSBIN"
+
+/** Version of the binary elem stream format */
+#define BGPSTREAM_BINARY_VERSION 1
+
+/** Length of the binary elem stream header */
+#define BGPSTREAM_BINARY_HEADER_LEN 8
+
+/** Header flag set if AS path segments are stored big-endian */
+#define BGPSTREAM_BINARY_FLAG_BIG_ENDIAN 0x01
+
+/** @} */
+
+/**
+ * @name Public Enums
+ *
+ * @{ */
+
+/** Binary elem stream message types */
+typedef enum {
+
+  /** String dictionary entry */
+  BGPSTREAM_BINARY_MSG_STR = 1,
+
+  /** Peer dictionary entry */
+  BGPSTREAM_BINARY_MSG_PEER = 2,
+
+  /** Record, along with its elems */
+  BGPSTREAM_BINARY_MSG_RECORD = 3,
+
+  /** Sync point */
+  BGPSTREAM_BINARY_MSG_SYNC = 4,
+
+} bgpstream_binary_msg_type_t;
+
+/** @} */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing a binary elem stream writer instance */
+typedef struct bgpstream_binary_writer bgpstream_binary_writer_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** Callback used by a writer to output encoded data
+ *
+ * @param buf           pointer to the encoded data
+ * @param len           number of bytes of encoded data
+ * @param user          user pointer given to bgpstream_binary_writer_create
+ * @return 0 if all of the data was written, -1 otherwise
+ */
+typedef int(bgpstream_binary_write_cb_t)(const uint8_t *buf, size_t len,
+                                         void *user);
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new binary elem stream writer
+ *
+ * @param cb            callback to use to output encoded data
+ * @param user          user pointer to pass to the callback
+ * @return pointer to a new writer if successful, NULL otherwise
+ *
+ * Encoded data is buffered, and passed to the callback in large blocks. The
+ * stream header is output along with the first block.
+ */
+bgpstream_binary_writer_t *
+bgpstream_binary_writer_create(bgpstream_binary_write_cb_t *cb, void *user);
+
+/** Destroy the given writer
+ *
+ * @param writer        pointer to the writer to destroy
+ *
+ * Buffered data is discarded, so bgpstream_binary_writer_flush should be
+ * called first.
+ */
+void bgpstream_binary_writer_destroy(bgpstream_binary_writer_t *writer);
+
+/** Encode the given record, along with all of its elems
+ *
+ * @param writer        pointer to the writer
+ * @param record        pointer to the record to encode
+ * @return 0 if the record was encoded successfully, -1 otherwise
+ *
+ * The elems are extracted using bgpstream_record_get_next_elem, so only the
+ * elems that match the stream filters (and that have not already been
+ * extracted) are encoded.
+ */
+int bgpstream_binary_writer_add_record(bgpstream_binary_writer_t *writer,
+                                       bgpstream_record_t *record);
+
+/** Output all the data buffered by the given writer
+ *
+ * @param writer        pointer to the writer
+ * @return 0 if the data was written successfully, -1 otherwise
+ */
+int bgpstream_binary_writer_flush(bgpstream_binary_writer_t *writer);
+
+/** Add a sync point to the stream
+ *
+ * @param writer        pointer to the writer
+ * @return 0 if the sync point was added successfully, -1 otherwise
+ *
+ * The data that follows a sync point does not depend on the data before it,
+ * so a reader can start reading the stream there (after the stream header).
+ * The sync point is buffered like a record, so the caller should flush the
+ * writer first to learn where in the output it starts.
+ */
+int bgpstream_binary_writer_sync(bgpstream_binary_writer_t *writer);
+
+/** @} */
+
+#endif /* __BGPSTREAM_BINARY_H */
@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_CODEC_H
+#define __BGPSTREAM_CODEC_H
+
+#include "bgpstream_transport.h"
+#include "bgpstream_utils_addr.h"
+#include "bgpstream_utils_as_path.h"
+#include "bgpstream_utils_pfx.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the private encoding and decoding helpers
+ * shared by the BGPStream file formats (the binary elem stream and the
+ * columnar elem archive).
+ *
+ * Varints are unsigned LEB128, and signed values are zigzag-encoded.
+ * Addresses are a version byte (0, 4 or 6) and the address bytes, and
+ * prefixes are a version byte, the mask length and the significant address
+ * bytes.
+ *
+ * The codec_put_* functions do not check the capacity of the buffer; the
+ * caller must codec_reserve enough space first (using the *_MAX_LEN
+ * constants). The codec_get_* functions are bounds-checked, and return -1 if
+ * the input is truncated or invalid.
+ *
+ */
+
+/**
+ * @name Private Constants
+ *
+ * @{ */
+
+/** Number of bytes used for varints that are patched once their value is
+ * known (a padded LEB128 encoding, which is valid for values < 2^35) */
+#define CODEC_VARINT_PATCH_LEN 5
+
+/** Upper bound on the encoded length of a varint */
+#define CODEC_VARINT_MAX_LEN 10
+
+/** Upper bound on the encoded length of an address */
+#define CODEC_ADDR_MAX_LEN (1 + 16)
+
+/** Upper bound on the encoded length of a prefix */
+#define CODEC_PFX_MAX_LEN (2 + 16)
+
+/** @} */
+
+/**
+ * @name Private Data Structures
+ *
+ * @{ */
+
+/** Growable output buffer */
+typedef struct codec_buf {
+
+  /** Encoded data */
+  uint8_t *data;
+
+  /** Number of bytes in use */
+  size_t len;
+
+  /** Number of bytes allocated */
+  size_t alloc_len;
+
+} codec_buf_t;
+
+/** Bounds-checked reader over encoded data */
+typedef struct codec_cursor {
+
+  /** Next byte to decode */
+  uint8_t *p;
+
+  /** End of the data */
+  uint8_t *end;
+
+} codec_cursor_t;
+
+/** @} */
+
+/**
+ * @name Encoding Functions
+ *
+ * @{ */
+
+/** Make sure there is room for len more bytes in the buffer */
+static inline int codec_reserve(codec_buf_t *b, size_t len)
+{
+  size_t new_len = (b->alloc_len == 0) ? 4096 : b->alloc_len;
+  uint8_t *tmp;
+
+  if (b->len + len <= b->alloc_len) {
+    return 0;
+  }
+  while (new_len < b->len + len) {
+    new_len *= 2;
+  }
+  if ((tmp = realloc(b->data, new_len)) == NULL) {
+    return -1;
+  }
+  b->data = tmp;
+  b->alloc_len = new_len;
+  return 0;
+}
+
+static inline void codec_put_u8(codec_buf_t *b, uint8_t v)
+{
+  b->data[b->len++] = v;
+}
+
+static inline void codec_put_bytes(codec_buf_t *b, const void *data,
+                                   size_t len)
+{
+  if (len == 0) {
+    return;
+  }
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+}
+
+static inline void codec_put_varint(codec_buf_t *b, uint64_t v)
+{
+  while (v >= 0x80) {
+    b->data[b->len++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  b->data[b->len++] = (uint8_t)v;
+}
+
+static inline void codec_put_zigzag(codec_buf_t *b, int64_t v)
+{
+  codec_put_varint(b, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+/** Get the encoded length of a varint */
+static inline size_t codec_varint_len(uint64_t v)
+{
+  size_t len = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    len++;
+  }
+  return len;
+}
+
+/** Leave space for a varint that will be written by codec_patch_varint, and
+ * return its offset */
+static inline size_t codec_skip_varint(codec_buf_t *b)
+{
+  size_t off = b->len;
+  b->len += CODEC_VARINT_PATCH_LEN;
+  return off;
+}
+
+static inline void codec_patch_varint(codec_buf_t *b, size_t off, uint64_t v)
+{
+  int i;
+  for (i = 0; i < CODEC_VARINT_PATCH_LEN - 1; i++) {
+    b->data[off + i] = (uint8_t)(v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  b->data[off + i] = (uint8_t)v;
+}
+
+static inline void codec_put_version(codec_buf_t *b,
+                                     bgpstream_addr_version_t version)
+{
+  switch (version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    codec_put_u8(b, 4);
+    break;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    codec_put_u8(b, 6);
+    break;
+  default:
+    codec_put_u8(b, 0);
+    break;
+  }
+}
+
+static inline void codec_put_addr(codec_buf_t *b,
+                                  const bgpstream_ip_addr_t *addr)
+{
+  codec_put_version(b, addr->version);
+  switch (addr->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    codec_put_bytes(b, &addr->bs_ipv4.addr, sizeof(addr->bs_ipv4.addr));
+    break;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    codec_put_bytes(b, &addr->bs_ipv6.addr, sizeof(addr->bs_ipv6.addr));
+    break;
+  default:
+    break;
+  }
+}
+
+static inline void codec_put_pfx(codec_buf_t *b, const bgpstream_pfx_t *pfx)
+{
+  codec_put_version(b, pfx->address.version);
+  if (pfx->address.version != BGPSTREAM_ADDR_VERSION_IPV4 &&
+      pfx->address.version != BGPSTREAM_ADDR_VERSION_IPV6) {
+    return;
+  }
+  codec_put_u8(b, pfx->mask_len);
+  codec_put_bytes(b, pfx->address.addr, (pfx->mask_len + 7) / 8);
+}
+
+/** @} */
+
+/**
+ * @name Decoding Functions
+ *
+ * @{ */
+
+static inline int codec_get_u8(codec_cursor_t *c, uint8_t *v)
+{
+  if (c->p >= c->end) {
+    return -1;
+  }
+  *v = *c->p++;
+  return 0;
+}
+
+static inline int codec_get_varint(codec_cursor_t *c, uint64_t *v)
+{
+  int shift;
+
+  *v = 0;
+  for (shift = 0; shift < 64 && c->p < c->end; shift += 7) {
+    *v |= (uint64_t)(*c->p & 0x7f) << shift;
+    if ((*c->p++ & 0x80) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static inline int codec_get_varint32(codec_cursor_t *c, uint32_t *v)
+{
+  uint64_t tmp;
+  if (codec_get_varint(c, &tmp) != 0 || tmp > UINT32_MAX) {
+    return -1;
+  }
+  *v = (uint32_t)tmp;
+  return 0;
+}
+
+/** Decode a zigzag-encoded delta and add it to base */
+static inline int codec_get_delta32(codec_cursor_t *c, uint32_t base,
+                                    uint32_t *v)
+{
+  uint64_t tmp;
+  if (codec_get_varint(c, &tmp) != 0) {
+    return -1;
+  }
+  *v = (uint32_t)((int64_t)base + (int64_t)((tmp >> 1) ^ -(tmp & 1)));
+  return 0;
+}
+
+static inline int codec_get_bytes(codec_cursor_t *c, void *buf, size_t len)
+{
+  if ((size_t)(c->end - c->p) < len) {
+    return -1;
+  }
+  memcpy(buf, c->p, len);
+  c->p += len;
+  return 0;
+}
+
+static inline int codec_get_version(codec_cursor_t *c,
+                                    bgpstream_addr_version_t *version)
+{
+  uint8_t v;
+  if (codec_get_u8(c, &v) != 0) {
+    return -1;
+  }
+  switch (v) {
+  case 0:
+    *version = BGPSTREAM_ADDR_VERSION_UNKNOWN;
+    return 0;
+  case 4:
+    *version = BGPSTREAM_ADDR_VERSION_IPV4;
+    return 0;
+  case 6:
+    *version = BGPSTREAM_ADDR_VERSION_IPV6;
+    return 0;
+  }
+  return -1;
+}
+
+static inline int codec_get_addr(codec_cursor_t *c, bgpstream_ip_addr_t *addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  if (codec_get_version(c, &addr->version) != 0) {
+    return -1;
+  }
+  switch (addr->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    return codec_get_bytes(c, &addr->bs_ipv4.addr,
+                           sizeof(addr->bs_ipv4.addr));
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    return codec_get_bytes(c, &addr->bs_ipv6.addr,
+                           sizeof(addr->bs_ipv6.addr));
+  default:
+    return 0;
+  }
+}
+
+static inline int codec_get_pfx(codec_cursor_t *c, bgpstream_pfx_t *pfx)
+{
+  memset(pfx, 0, sizeof(*pfx));
+  if (codec_get_version(c, &pfx->address.version) != 0) {
+    return -1;
+  }
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    return 0;
+  }
+  if (codec_get_u8(c, &pfx->mask_len) != 0 ||
+      pfx->mask_len >
+        (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4 ? 32 : 128)) {
+    return -1;
+  }
+  return codec_get_bytes(c, pfx->address.addr, (pfx->mask_len + 7) / 8);
+}
+
+/** Move past len bytes */
+static inline int codec_pass_bytes(codec_cursor_t *c, uint64_t len)
+{
+  if ((uint64_t)(c->end - c->p) < len) {
+    return -1;
+  }
+  c->p += len;
+  return 0;
+}
+
+/** Move past cnt varints without decoding them */
+static inline int codec_pass_varints(codec_cursor_t *c, uint64_t cnt)
+{
+  for (; cnt > 0; cnt--) {
+    // a varint ends with the first byte that has no continuation bit
+    while (c->p < c->end && (*c->p & 0x80) != 0) {
+      c->p++;
+    }
+    if (c->p >= c->end) {
+      return -1;
+    }
+    c->p++;
+  }
+  return 0;
+}
+
+/** Move past an address without decoding it */
+static inline int codec_pass_addr(codec_cursor_t *c)
+{
+  bgpstream_addr_version_t version;
+
+  if (codec_get_version(c, &version) != 0) {
+    return -1;
+  }
+  switch (version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    return codec_pass_bytes(c, sizeof(struct in_addr));
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    return codec_pass_bytes(c, sizeof(struct in6_addr));
+  default:
+    return 0;
+  }
+}
+
+/** Move past a prefix without decoding it */
+static inline int codec_pass_pfx(codec_cursor_t *c)
+{
+  bgpstream_addr_version_t version;
+  uint8_t mask_len;
+
+  if (codec_get_version(c, &version) != 0) {
+    return -1;
+  }
+  if (version == BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    return 0;
+  }
+  if (codec_get_u8(c, &mask_len) != 0 ||
+      mask_len > (version == BGPSTREAM_ADDR_VERSION_IPV4 ? 32 : 128)) {
+    return -1;
+  }
+  return codec_pass_bytes(c, (mask_len + 7) / 8);
+}
+
+/** Read exactly len bytes from the transport
+ *
+ * @return len if successful, 0 on EOF before any byte was read, or -1 on
+ * error (including EOF part way through)
+ */
+static inline int64_t codec_read_full(bgpstream_transport_t *transport,
+                                      void *buf, size_t len)
+{
+  size_t done = 0;
+  int64_t rc;
+
+  while (done < len) {
+    if ((rc = bgpstream_transport_read(transport, (uint8_t *)buf + done,
+                                       len - done)) < 0) {
+      return -1;
+    }
+    if (rc == 0) {
+      return (done == 0) ? 0 : -1;
+    }
+    done += rc;
+  }
+  return len;
+}
+
+/** Read a varint directly from the transport
+ *
+ * @return 1 if a varint was read, 0 on EOF before any byte was read, or -1 on
+ * error
+ */
+static inline int codec_read_varint(bgpstream_transport_t *transport,
+                                    uint64_t *v)
+{
+  uint8_t b;
+  int shift;
+  int64_t rc;
+
+  *v = 0;
+  for (shift = 0; shift < 64; shift += 7) {
+    if ((rc = codec_read_full(transport, &b, 1)) != 1) {
+      return (rc == 0 && shift == 0) ? 0 : -1;
+    }
+    *v |= (uint64_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      return 1;
+    }
+  }
+  return -1;
+}
+
+/** @} */
+
+#endif /* __BGPSTREAM_CODEC_H */
@@ -0,0 +1,935 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "bgpstream_codec.h"
+#include "bgpstream_columnar_int.h"
+#include "bgpstream_log.h"
+#include "khash.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+
+/** Maximum number of elems in a row group (a row group is buffered in memory
+ * until it is complete) */
+#define ROWGROUP_MAX_ELEMS (1024 * 1024)
+
+/** Upper bound on the encoded length of the elem columns of a single elem,
+ * excluding its communities */
+#define ELEM_COLS_MAX_LEN                                                      \
+  (CODEC_VARINT_MAX_LEN * 6 + CODEC_PFX_MAX_LEN + CODEC_ADDR_MAX_LEN + 2)
+
+/** Number of blocks in a row group: the record columns, the AS path
+ * dictionary and the elem columns (in the order in which they are stored) */
+#define BLOCKS_CNT (COLUMNAR_REC_COL_CNT + 1 + COLUMNAR_ELEM_COL_CNT)
+
+/** zstd compression level (a fast one, as for the local cache) */
+#define ZSTD_LEVEL 3
+
+/* dictionary key of a peer */
+typedef struct peer_key {
+  bgpstream_ip_addr_t ip;
+  uint32_t asn;
+} peer_key_t;
+
+/* dictionary entry of a source (the origin of a record) */
+typedef struct source {
+  char project[BGPSTREAM_UTILS_STR_NAME_LEN];
+  char collector[BGPSTREAM_UTILS_STR_NAME_LEN];
+  char router[BGPSTREAM_UTILS_STR_NAME_LEN];
+  bgpstream_ip_addr_t router_ip;
+} source_t;
+
+static khint32_t peer_key_hash(peer_key_t key)
+{
+  return (khint32_t)(bgpstream_addr_hash(&key.ip) ^ key.asn);
+}
+
+static int peer_key_equal(peer_key_t a, peer_key_t b)
+{
+  return a.asn == b.asn && bgpstream_addr_equal(&a.ip, &b.ip);
+}
+
+KHASH_INIT(peerid, peer_key_t, uint32_t, 1, peer_key_hash, peer_key_equal)
+KHASH_INIT(pathid, bgpstream_as_path_t *, uint32_t, 1, bgpstream_as_path_hash,
+           bgpstream_as_path_equal)
+
+/* column lengths and counters, used to undo a partially added record */
+typedef struct undo {
+  size_t rec_cols[COLUMNAR_REC_COL_CNT];
+  size_t elem_cols[COLUMNAR_ELEM_COL_CNT];
+  uint64_t elems_cnt;
+  uint8_t run_type;
+  uint64_t run_len;
+} undo_t;
+
+struct bgpstream_columnar_writer {
+
+  /* callback used to output encoded data */
+  bgpstream_columnar_write_cb_t *cb;
+  void *user;
+
+  /* length of the row group time window */
+  uint32_t window;
+
+  /* codec used to compress the blocks of a row group */
+  bgpstream_columnar_codec_t codec;
+
+#ifdef HAVE_LIBZSTD
+  ZSTD_CCtx *zstd;
+#endif
+
+  /* compressed blocks of the row group that is being output */
+  codec_buf_t zblocks[BLOCKS_CNT];
+
+  /* has the archive header been output? */
+  int header_written;
+
+  /* encoded row group that is being output */
+  codec_buf_t out;
+
+  /* ---------- current row group ---------- */
+
+  /* window of the row group (record time / window) */
+  uint32_t rg_window;
+
+  uint32_t recs_cnt;
+  uint64_t elems_cnt;
+
+  /* statistics */
+  uint32_t min_time;
+  uint32_t max_time;
+  uint8_t rec_types;
+  uint8_t elem_types;
+  uint8_t versions;
+  uint8_t v4_first[4];
+  uint8_t v4_last[4];
+  uint8_t v6_first[16];
+  uint8_t v6_last[16];
+  bgpstream_id_set_t *origins;
+
+  /* time of the previous record (the time column holds deltas, the first
+     one being relative to 0) */
+  uint32_t last_time;
+
+  /* source dictionary */
+  source_t *sources;
+  int sources_cnt;
+  uint32_t sources_alloc_cnt;
+  int last_source;
+
+  /* peer dictionary */
+  khash_t(peerid) *peer_ids;
+  peer_key_t *peers;
+  uint32_t peers_cnt;
+  uint32_t peers_alloc_cnt;
+
+  /* AS path dictionary (the paths are owned by the dictionary) */
+  khash_t(pathid) *path_ids;
+  bgpstream_as_path_t **paths;
+  uint32_t paths_cnt;
+  uint32_t paths_alloc_cnt;
+
+  /* columns */
+  codec_buf_t rec_cols[COLUMNAR_REC_COL_CNT];
+  codec_buf_t elem_cols[COLUMNAR_ELEM_COL_CNT];
+
+  /* current run of the (run-length encoded) elem type column */
+  uint8_t run_type;
+  uint64_t run_len;
+
+  /* scratch buffers for the statistics and the AS path dictionary */
+  codec_buf_t stats;
+  codec_buf_t path_dict;
+};
+
+/* grow an array of entries so that it can hold at least cnt entries */
+static int grow_array(void **arr, uint32_t *alloc_cnt, uint32_t cnt,
+                      size_t entry_size)
+{
+  uint32_t new_cnt = (*alloc_cnt == 0) ? 64 : *alloc_cnt;
+  void *tmp;
+
+  if (cnt <= *alloc_cnt) {
+    return 0;
+  }
+  while (new_cnt < cnt) {
+    new_cnt *= 2;
+  }
+  if ((tmp = realloc(*arr, entry_size * new_cnt)) == NULL) {
+    return -1;
+  }
+  *arr = tmp;
+  *alloc_cnt = new_cnt;
+  return 0;
+}
+
+static int source_matches(source_t *src, bgpstream_record_t *record)
+{
+  return strcmp(src->collector, record->collector_name) == 0 &&
+         strcmp(src->project, record->project_name) == 0 &&
+         strcmp(src->router, record->router_name) == 0 &&
+         bgpstream_addr_equal(&src->router_ip, &record->router_ip);
+}
+
+static int get_source_id(bgpstream_columnar_writer_t *writer,
+                         bgpstream_record_t *record, uint32_t *id)
+{
+  source_t *src;
+  int i;
+
+  // records almost always come from the same source as the previous one
+  if (writer->last_source < writer->sources_cnt &&
+      source_matches(&writer->sources[writer->last_source], record)) {
+    *id = writer->last_source;
+    return 0;
+  }
+  for (i = 0; i < writer->sources_cnt; i++) {
+    if (source_matches(&writer->sources[i], record)) {
+      goto found;
+    }
+  }
+
+  if (grow_array((void **)&writer->sources, &writer->sources_alloc_cnt,
+                 writer->sources_cnt + 1, sizeof(source_t)) != 0) {
+    return -1;
+  }
+  i = writer->sources_cnt++;
+  src = &writer->sources[i];
+  memcpy(src->project, record->project_name, sizeof(src->project));
+  memcpy(src->collector, record->collector_name, sizeof(src->collector));
+  memcpy(src->router, record->router_name, sizeof(src->router));
+  src->router_ip = record->router_ip;
+
+found:
+  writer->last_source = i;
+  *id = i;
+  return 0;
+}
+
+static int get_peer_id(bgpstream_columnar_writer_t *writer,
+                       bgpstream_elem_t *elem, uint32_t *id)
+{
+  peer_key_t key;
+  khiter_t k;
+  int khret;
+
+  memset(&key, 0, sizeof(key));
+  bgpstream_addr_copy(&key.ip, &elem->peer_ip);
+  key.asn = elem->peer_asn;
+
+  if ((k = kh_get(peerid, writer->peer_ids, key)) != kh_end(writer->peer_ids)) {
+    *id = kh_val(writer->peer_ids, k);
+    return 0;
+  }
+  if (grow_array((void **)&writer->peers, &writer->peers_alloc_cnt,
+                 writer->peers_cnt + 1, sizeof(peer_key_t)) != 0) {
+    return -1;
+  }
+  k = kh_put(peerid, writer->peer_ids, key, &khret);
+  if (khret < 0) {
+    return -1;
+  }
+  *id = kh_val(writer->peer_ids, k) = writer->peers_cnt;
+  writer->peers[writer->peers_cnt++] = key;
+  return 0;
+}
+
+static int get_path_id(bgpstream_columnar_writer_t *writer,
+                       bgpstream_elem_t *elem, uint32_t *id)
+{
+  bgpstream_as_path_t *cpy;
+  khiter_t k;
+  int khret;
+
+  if ((k = kh_get(pathid, writer->path_ids, elem->as_path)) !=
+      kh_end(writer->path_ids)) {
+    *id = kh_val(writer->path_ids, k);
+    return 0;
+  }
+  if (grow_array((void **)&writer->paths, &writer->paths_alloc_cnt,
+                 writer->paths_cnt + 1, sizeof(bgpstream_as_path_t *)) != 0 ||
+      (cpy = bgpstream_as_path_create()) == NULL) {
+    return -1;
+  }
+  if (bgpstream_as_path_copy(cpy, elem->as_path) != 0) {
+    bgpstream_as_path_destroy(cpy);
+    return -1;
+  }
+  k = kh_put(pathid, writer->path_ids, cpy, &khret);
+  if (khret < 0) {
+    bgpstream_as_path_destroy(cpy);
+    return -1;
+  }
+  *id = kh_val(writer->path_ids, k) = writer->paths_cnt;
+  writer->paths[writer->paths_cnt++] = cpy;
+  return 0;
+}
+
+static void update_pfx_stats(bgpstream_columnar_writer_t *writer,
+                             const bgpstream_pfx_t *pfx)
+{
+  uint8_t first[16], last[16];
+  uint8_t *min, *max;
+  uint8_t bit;
+  int len;
+
+  if ((len = columnar_pfx_range(pfx, first, last)) == 0) {
+    return;
+  }
+  if (len == 4) {
+    bit = COLUMNAR_VERSION_IPV4;
+    min = writer->v4_first;
+    max = writer->v4_last;
+  } else {
+    bit = COLUMNAR_VERSION_IPV6;
+    min = writer->v6_first;
+    max = writer->v6_last;
+  }
+  if ((writer->versions & bit) == 0) {
+    writer->versions |= bit;
+    memcpy(min, first, len);
+    memcpy(max, last, len);
+    return;
+  }
+  if (memcmp(first, min, len) < 0) {
+    memcpy(min, first, len);
+  }
+  if (memcmp(last, max, len) > 0) {
+    memcpy(max, last, len);
+  }
+}
+
+static void flush_type_run(bgpstream_columnar_writer_t *writer)
+{
+  codec_buf_t *b = &writer->elem_cols[COLUMNAR_ELEM_COL_TYPE];
+
+  if (writer->run_len == 0) {
+    return;
+  }
+  // space was reserved by add_elem
+  codec_put_u8(b, writer->run_type);
+  codec_put_varint(b, writer->run_len);
+  writer->run_len = 0;
+}
+
+static int add_elem(bgpstream_columnar_writer_t *writer,
+                    bgpstream_record_t *record, bgpstream_elem_t *elem)
+{
+  codec_buf_t *cols = writer->elem_cols;
+  const bgpstream_community_t *comm;
+  uint32_t peer_id, path_id, origin;
+  int comms_cnt = 0;
+  int i;
+
+  for (i = 0; i < COLUMNAR_ELEM_COL_CNT; i++) {
+    if (codec_reserve(&cols[i], ELEM_COLS_MAX_LEN) != 0) {
+      return -1;
+    }
+  }
+  if (get_peer_id(writer, elem, &peer_id) != 0) {
+    return -1;
+  }
+
+  if (writer->run_len > 0 && writer->run_type != elem->type) {
+    flush_type_run(writer);
+  }
+  writer->run_type = elem->type;
+  writer->run_len++;
+  writer->elem_types |= 1 << elem->type;
+
+  codec_put_varint(&cols[COLUMNAR_ELEM_COL_PEER], peer_id);
+  codec_put_zigzag(&cols[COLUMNAR_ELEM_COL_TIME],
+                   (int64_t)elem->orig_time_sec - record->time_sec);
+  codec_put_varint(&cols[COLUMNAR_ELEM_COL_TIME], elem->orig_time_usec);
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    comms_cnt = bgpstream_community_set_size(elem->communities);
+    if (get_path_id(writer, elem, &path_id) != 0 ||
+        codec_reserve(&cols[COLUMNAR_ELEM_COL_COMMS], comms_cnt * 4) != 0) {
+      return -1;
+    }
+    if (bgpstream_as_path_get_origin_val(elem->as_path, &origin) == 0 &&
+        bgpstream_id_set_insert(writer->origins, origin) < 0) {
+      return -1;
+    }
+    codec_put_pfx(&cols[COLUMNAR_ELEM_COL_PFX], &elem->prefix);
+    update_pfx_stats(writer, &elem->prefix);
+    codec_put_addr(&cols[COLUMNAR_ELEM_COL_NEXTHOP], &elem->nexthop);
+    codec_put_varint(&cols[COLUMNAR_ELEM_COL_PATH], path_id);
+    codec_put_varint(&cols[COLUMNAR_ELEM_COL_COMMS], comms_cnt);
+    for (i = 0; i < comms_cnt; i++) {
+      comm = bgpstream_community_set_get(elem->communities, i);
+      codec_put_u8(&cols[COLUMNAR_ELEM_COL_COMMS], comm->asn >> 8);
+      codec_put_u8(&cols[COLUMNAR_ELEM_COL_COMMS], comm->asn & 0xff);
+      codec_put_u8(&cols[COLUMNAR_ELEM_COL_COMMS], comm->value >> 8);
+      codec_put_u8(&cols[COLUMNAR_ELEM_COL_COMMS], comm->value & 0xff);
+    }
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    codec_put_pfx(&cols[COLUMNAR_ELEM_COL_PFX], &elem->prefix);
+    update_pfx_stats(writer, &elem->prefix);
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    codec_put_u8(&cols[COLUMNAR_ELEM_COL_STATE], elem->old_state);
+    codec_put_u8(&cols[COLUMNAR_ELEM_COL_STATE], elem->new_state);
+    break;
+
+  default:
+    break;
+  }
+
+  writer->elems_cnt++;
+  return 0;
+}
+
+static void put_str(codec_buf_t *b, const char *str)
+{
+  size_t len = strlen(str);
+  codec_put_varint(b, len);
+  codec_put_bytes(b, str, len);
+}
+
+static int encode_stats(bgpstream_columnar_writer_t *writer)
+{
+  codec_buf_t *b = &writer->stats;
+  uint32_t bits = COLUMNAR_BLOOM_MIN_BITS;
+  uint32_t origins_cnt = bgpstream_id_set_size(writer->origins);
+  source_t *src;
+  uint32_t *asn;
+  int i;
+
+  while (bits < COLUMNAR_BLOOM_MAX_BITS && bits < origins_cnt * 8) {
+    bits *= 2;
+  }
+
+  b->len = 0;
+  if (codec_reserve(b, CODEC_VARINT_MAX_LEN * 6 + 3 + 2 * (4 + 16) +
+                         writer->sources_cnt *
+                           (3 * (CODEC_VARINT_MAX_LEN +
+                                 BGPSTREAM_UTILS_STR_NAME_LEN) +
+                            CODEC_ADDR_MAX_LEN) +
+                         writer->peers_cnt *
+                           (CODEC_ADDR_MAX_LEN + CODEC_VARINT_MAX_LEN) +
+                         bits / 8) != 0) {
+    return -1;
+  }
+
+  codec_put_varint(b, writer->recs_cnt);
+  codec_put_varint(b, writer->elems_cnt);
+  codec_put_varint(b, writer->min_time);
+  codec_put_varint(b, writer->max_time - writer->min_time);
+  codec_put_u8(b, writer->rec_types);
+  codec_put_u8(b, writer->elem_types);
+  codec_put_u8(b, writer->versions);
+  if (writer->versions & COLUMNAR_VERSION_IPV4) {
+    codec_put_bytes(b, writer->v4_first, sizeof(writer->v4_first));
+    codec_put_bytes(b, writer->v4_last, sizeof(writer->v4_last));
+  }
+  if (writer->versions & COLUMNAR_VERSION_IPV6) {
+    codec_put_bytes(b, writer->v6_first, sizeof(writer->v6_first));
+    codec_put_bytes(b, writer->v6_last, sizeof(writer->v6_last));
+  }
+
+  codec_put_varint(b, writer->sources_cnt);
+  for (i = 0; i < writer->sources_cnt; i++) {
+    src = &writer->sources[i];
+    put_str(b, src->project);
+    put_str(b, src->collector);
+    put_str(b, src->router);
+    codec_put_addr(b, &src->router_ip);
+  }
+
+  codec_put_varint(b, writer->peers_cnt);
+  for (i = 0; i < writer->peers_cnt; i++) {
+    codec_put_addr(b, &writer->peers[i].ip);
+    codec_put_varint(b, writer->peers[i].asn);
+  }
+
+  if (origins_cnt == 0) {
+    codec_put_varint(b, 0);
+    return 0;
+  }
+  codec_put_varint(b, bits);
+  memset(b->data + b->len, 0, bits / 8);
+  bgpstream_id_set_rewind(writer->origins);
+  while ((asn = bgpstream_id_set_next(writer->origins)) != NULL) {
+    columnar_bloom_add(b->data + b->len, bits, *asn);
+  }
+  b->len += bits / 8;
+  return 0;
+}
+
+static int encode_path_dict(bgpstream_columnar_writer_t *writer)
+{
+  codec_buf_t *b = &writer->path_dict;
+  bgpstream_as_path_iter_t iter;
+  bgpstream_as_path_seg_t *seg;
+  uint8_t *data;
+  uint32_t i;
+  int j;
+
+  b->len = 0;
+  if (codec_reserve(b, CODEC_VARINT_MAX_LEN) != 0) {
+    return -1;
+  }
+  codec_put_varint(b, writer->paths_cnt);
+
+  for (i = 0; i < writer->paths_cnt; i++) {
+    // varints are never longer than the (4 byte) raw ASNs plus a varint for
+    // the segment count
+    if (codec_reserve(b, CODEC_VARINT_MAX_LEN +
+                           bgpstream_as_path_get_data(writer->paths[i],
+                                                      &data) * 2) != 0) {
+      return -1;
+    }
+    codec_put_varint(b, bgpstream_as_path_get_len(writer->paths[i]));
+    bgpstream_as_path_iter_reset(&iter);
+    while ((seg = bgpstream_as_path_get_next_seg(writer->paths[i], &iter)) !=
+           NULL) {
+      codec_put_u8(b, seg->type);
+      if (seg->type == BGPSTREAM_AS_PATH_SEG_ASN) {
+        codec_put_varint(b, seg->asn.asn);
+        continue;
+      }
+      codec_put_varint(b, seg->set.asn_cnt);
+      for (j = 0; j < seg->set.asn_cnt; j++) {
+        codec_put_varint(b, seg->set.asn[j]);
+      }
+    }
+  }
+  return 0;
+}
+
+/* reset the row group state (keeping allocated memory) */
+static void reset_rowgroup(bgpstream_columnar_writer_t *writer)
+{
+  uint32_t i;
+
+  writer->recs_cnt = 0;
+  writer->elems_cnt = 0;
+  writer->rec_types = 0;
+  writer->elem_types = 0;
+  writer->versions = 0;
+  bgpstream_id_set_clear(writer->origins);
+  writer->sources_cnt = 0;
+  writer->last_source = 0;
+  kh_clear(peerid, writer->peer_ids);
+  writer->peers_cnt = 0;
+  kh_clear(pathid, writer->path_ids);
+  for (i = 0; i < writer->paths_cnt; i++) {
+    bgpstream_as_path_destroy(writer->paths[i]);
+  }
+  writer->paths_cnt = 0;
+  for (i = 0; i < COLUMNAR_REC_COL_CNT; i++) {
+    writer->rec_cols[i].len = 0;
+  }
+  for (i = 0; i < COLUMNAR_ELEM_COL_CNT; i++) {
+    writer->elem_cols[i].len = 0;
+  }
+  writer->run_len = 0;
+}
+
+/* compress a block: its length, followed by the compressed data (or by the
+ * data itself, if it does not compress) */
+static int compress_block(bgpstream_columnar_writer_t *writer,
+                          codec_buf_t *raw, codec_buf_t *z)
+{
+  size_t bound = raw->len, len = 0;
+
+#ifdef HAVE_LIBZSTD
+  if (writer->codec == BGPSTREAM_COLUMNAR_CODEC_ZSTD) {
+    bound = ZSTD_compressBound(raw->len);
+  }
+#endif
+#ifdef HAVE_LIBLZ4
+  if (writer->codec == BGPSTREAM_COLUMNAR_CODEC_LZ4 &&
+      raw->len <= LZ4_MAX_INPUT_SIZE) {
+    bound = LZ4_compressBound(raw->len);
+  }
+#endif
+
+  z->len = 0;
+  if (codec_reserve(z, CODEC_VARINT_MAX_LEN + bound) != 0) {
+    return -1;
+  }
+  codec_put_varint(z, raw->len);
+  if (raw->len == 0) {
+    return 0;
+  }
+
+  switch (writer->codec) {
+#ifdef HAVE_LIBZSTD
+  case BGPSTREAM_COLUMNAR_CODEC_ZSTD:
+    len = ZSTD_compressCCtx(writer->zstd, z->data + z->len, bound, raw->data,
+                            raw->len, ZSTD_LEVEL);
+    if (ZSTD_isError(len)) {
+      len = 0;
+    }
+    break;
+#endif
+#ifdef HAVE_LIBLZ4
+  case BGPSTREAM_COLUMNAR_CODEC_LZ4:
+    if (raw->len <= LZ4_MAX_INPUT_SIZE) {
+      len = LZ4_compress_default((const char *)raw->data,
+                                 (char *)z->data + z->len, raw->len, bound);
+    }
+    break;
+#endif
+  default:
+    break;
+  }
+
+  // the reader tells the two apart by the length of the stored data
+  if (len == 0 || len >= raw->len) {
+    codec_put_bytes(z, raw->data, raw->len);
+  } else {
+    z->len += len;
+  }
+  return 0;
+}
+
+static size_t section_len(codec_buf_t **blocks, int blocks_cnt)
+{
+  size_t len = 0;
+  int i;
+  for (i = 0; i < blocks_cnt; i++) {
+    len += codec_varint_len(blocks[i]->len) + blocks[i]->len;
+  }
+  return len;
+}
+
+static void put_section(codec_buf_t *b, codec_buf_t **blocks, int blocks_cnt)
+{
+  int i;
+  for (i = 0; i < blocks_cnt; i++) {
+    codec_put_varint(b, blocks[i]->len);
+    codec_put_bytes(b, blocks[i]->data, blocks[i]->len);
+  }
+}
+
+/* encode the current row group and pass it to the callback */
+static int output_rowgroup(bgpstream_columnar_writer_t *writer)
+{
+  codec_buf_t *b = &writer->out;
+  codec_buf_t *blocks[BLOCKS_CNT];
+  codec_buf_t **rec_blocks = blocks;
+  codec_buf_t **dict_block = blocks + COLUMNAR_REC_COL_CNT;
+  codec_buf_t **elem_blocks = blocks + COLUMNAR_REC_COL_CNT + 1;
+  size_t rec_len, elem_len;
+  int i;
+
+  b->len = 0;
+  if (writer->header_written == 0) {
+    if (codec_reserve(b, BGPSTREAM_COLUMNAR_HEADER_LEN) != 0) {
+      return -1;
+    }
+    codec_put_bytes(b, BGPSTREAM_COLUMNAR_MAGIC,
+                    sizeof(BGPSTREAM_COLUMNAR_MAGIC) - 1);
+    codec_put_u8(b, BGPSTREAM_COLUMNAR_VERSION);
+    codec_put_u8(b, writer->codec);
+    codec_put_u8(b, 0);
+  }
+
+  if (writer->recs_cnt > 0) {
+    flush_type_run(writer);
+    if (encode_stats(writer) != 0 || encode_path_dict(writer) != 0) {
+      return -1;
+    }
+    for (i = 0; i < COLUMNAR_REC_COL_CNT; i++) {
+      rec_blocks[i] = &writer->rec_cols[i];
+    }
+    *dict_block = &writer->path_dict;
+    for (i = 0; i < COLUMNAR_ELEM_COL_CNT; i++) {
+      elem_blocks[i] = &writer->elem_cols[i];
+    }
+    if (writer->codec != BGPSTREAM_COLUMNAR_CODEC_NONE) {
+      for (i = 0; i < BLOCKS_CNT; i++) {
+        if (compress_block(writer, blocks[i], &writer->zblocks[i]) != 0) {
+          return -1;
+        }
+        blocks[i] = &writer->zblocks[i];
+      }
+    }
+
+    // an uncompressed AS path dictionary is not length-prefixed
+    rec_len = section_len(rec_blocks, COLUMNAR_REC_COL_CNT);
+    elem_len = section_len(elem_blocks, COLUMNAR_ELEM_COL_CNT) +
+               ((writer->codec == BGPSTREAM_COLUMNAR_CODEC_NONE)
+                  ? (*dict_block)->len
+                  : section_len(dict_block, 1));
+    if (codec_reserve(b, CODEC_VARINT_MAX_LEN * 3 + writer->stats.len +
+                           rec_len + elem_len) != 0) {
+      return -1;
+    }
+    codec_put_varint(b, writer->stats.len);
+    codec_put_bytes(b, writer->stats.data, writer->stats.len);
+    codec_put_varint(b, rec_len);
+    put_section(b, rec_blocks, COLUMNAR_REC_COL_CNT);
+    codec_put_varint(b, elem_len);
+    if (writer->codec == BGPSTREAM_COLUMNAR_CODEC_NONE) {
+      codec_put_bytes(b, (*dict_block)->data, (*dict_block)->len);
+    } else {
+      put_section(b, dict_block, 1);
+    }
+    put_section(b, elem_blocks, COLUMNAR_ELEM_COL_CNT);
+  }
+
+  reset_rowgroup(writer);
+
+  if (b->len == 0) {
+    return 0;
+  }
+  if (writer->cb(b->data, b->len, writer->user) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not output columnar row group");
+    return -1;
+  }
+  writer->header_written = 1;
+  b->len = 0;
+  return 0;
+}
+
+static void save_undo(bgpstream_columnar_writer_t *writer, undo_t *undo)
+{
+  int i;
+  for (i = 0; i < COLUMNAR_REC_COL_CNT; i++) {
+    undo->rec_cols[i] = writer->rec_cols[i].len;
+  }
+  for (i = 0; i < COLUMNAR_ELEM_COL_CNT; i++) {
+    undo->elem_cols[i] = writer->elem_cols[i].len;
+  }
+  undo->elems_cnt = writer->elems_cnt;
+  undo->run_type = writer->run_type;
+  undo->run_len = writer->run_len;
+}
+
+static void restore_undo(bgpstream_columnar_writer_t *writer, undo_t *undo)
+{
+  int i;
+  for (i = 0; i < COLUMNAR_REC_COL_CNT; i++) {
+    writer->rec_cols[i].len = undo->rec_cols[i];
+  }
+  for (i = 0; i < COLUMNAR_ELEM_COL_CNT; i++) {
+    writer->elem_cols[i].len = undo->elem_cols[i];
+  }
+  writer->elems_cnt = undo->elems_cnt;
+  writer->run_type = undo->run_type;
+  writer->run_len = undo->run_len;
+}
+
+/* ==================== PUBLIC FUNCTIONS ==================== */
+
+bgpstream_columnar_writer_t *
+bgpstream_columnar_writer_create(bgpstream_columnar_write_cb_t *cb, void *user,
+                                 uint32_t window)
+{
+  bgpstream_columnar_writer_t *writer;
+
+  if ((writer = malloc_zero(sizeof(bgpstream_columnar_writer_t))) == NULL) {
+    return NULL;
+  }
+  writer->cb = cb;
+  writer->user = user;
+  writer->window = (window == 0) ? BGPSTREAM_COLUMNAR_WINDOW_DEFAULT : window;
+
+  if ((writer->origins = bgpstream_id_set_create()) == NULL ||
+      (writer->peer_ids = kh_init(peerid)) == NULL ||
+      (writer->path_ids = kh_init(pathid)) == NULL) {
+    goto err;
+  }
+
+  return writer;
+
+err:
+  bgpstream_columnar_writer_destroy(writer);
+  return NULL;
+}
+
+int bgpstream_columnar_writer_set_codec(bgpstream_columnar_writer_t *writer,
+                                        bgpstream_columnar_codec_t codec)
+{
+  if (writer->header_written != 0) {
+    return -1;
+  }
+
+  switch (codec) {
+  case BGPSTREAM_COLUMNAR_CODEC_NONE:
+    break;
+#ifdef HAVE_LIBZSTD
+  case BGPSTREAM_COLUMNAR_CODEC_ZSTD:
+    if (writer->zstd == NULL && (writer->zstd = ZSTD_createCCtx()) == NULL) {
+      return -1;
+    }
+    break;
+#endif
+#ifdef HAVE_LIBLZ4
+  case BGPSTREAM_COLUMNAR_CODEC_LZ4:
+    break;
+#endif
+  default:
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Columnar archive codec %d is not supported by this build",
+                  codec);
+    return -1;
+  }
+  writer->codec = codec;
+  return 0;
+}
+
+void bgpstream_columnar_writer_destroy(bgpstream_columnar_writer_t *writer)
+{
+  uint32_t i;
+
+  if (writer == NULL) {
+    return;
+  }
+
+  for (i = 0; i < writer->paths_cnt; i++) {
+    bgpstream_as_path_destroy(writer->paths[i]);
+  }
+  free(writer->paths);
+  if (writer->path_ids != NULL) {
+    kh_destroy(pathid, writer->path_ids);
+  }
+  free(writer->peers);
+  if (writer->peer_ids != NULL) {
+    kh_destroy(peerid, writer->peer_ids);
+  }
+  free(writer->sources);
+  if (writer->origins != NULL) {
+    bgpstream_id_set_destroy(writer->origins);
+  }
+  for (i = 0; i < COLUMNAR_REC_COL_CNT; i++) {
+    free(writer->rec_cols[i].data);
+  }
+  for (i = 0; i < COLUMNAR_ELEM_COL_CNT; i++) {
+    free(writer->elem_cols[i].data);
+  }
+  for (i = 0; i < BLOCKS_CNT; i++) {
+    free(writer->zblocks[i].data);
+  }
+  free(writer->stats.data);
+  free(writer->path_dict.data);
+  free(writer->out.data);
+#ifdef HAVE_LIBZSTD
+  ZSTD_freeCCtx(writer->zstd);
+#endif
+
+  free(writer);
+}
+
+int bgpstream_columnar_writer_add_record(bgpstream_columnar_writer_t *writer,
+                                         bgpstream_record_t *record)
+{
+  codec_buf_t *cols = writer->rec_cols;
+  bgpstream_elem_t *elem;
+  uint32_t source_id;
+  uint64_t elems_cnt;
+  undo_t undo;
+  int rc;
+  int i;
+
+  if (record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+    return 0;
+  }
+
+  // start a new row group when the window changes
+  if (writer->recs_cnt > 0 &&
+      (record->time_sec / writer->window != writer->rg_window ||
+       writer->elems_cnt >= ROWGROUP_MAX_ELEMS) &&
+      output_rowgroup(writer) != 0) {
+    return -1;
+  }
+  if (writer->recs_cnt == 0) {
+    writer->rg_window = record->time_sec / writer->window;
+    writer->min_time = writer->max_time = record->time_sec;
+    writer->last_time = 0;
+  }
+
+  for (i = 0; i < COLUMNAR_REC_COL_CNT; i++) {
+    if (codec_reserve(&cols[i], CODEC_VARINT_MAX_LEN * 2 + 2) != 0) {
+      goto err_nomem;
+    }
+  }
+  if (get_source_id(writer, record, &source_id) != 0) {
+    goto err_nomem;
+  }
+  save_undo(writer, &undo);
+
+  codec_put_zigzag(&cols[COLUMNAR_REC_COL_TIME],
+                   (int64_t)record->time_sec - writer->last_time);
+  codec_put_varint(&cols[COLUMNAR_REC_COL_USEC], record->time_usec);
+  codec_put_u8(&cols[COLUMNAR_REC_COL_INFO], record->type);
+  codec_put_u8(&cols[COLUMNAR_REC_COL_INFO], record->dump_pos);
+  codec_put_varint(&cols[COLUMNAR_REC_COL_INFO], source_id);
+  codec_put_zigzag(&cols[COLUMNAR_REC_COL_INFO],
+                   (int64_t)record->dump_time_sec - record->time_sec);
+
+  elems_cnt = writer->elems_cnt;
+  while ((rc = bgpstream_record_get_next_elem(record, &elem)) > 0) {
+    if (add_elem(writer, record, elem) != 0) {
+      restore_undo(writer, &undo);
+      goto err_nomem;
+    }
+  }
+  if (rc != 0) {
+    restore_undo(writer, &undo);
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not extract elems from record");
+    return -1;
+  }
+  codec_put_varint(&cols[COLUMNAR_REC_COL_ELEMS],
+                   writer->elems_cnt - elems_cnt);
+
+  writer->last_time = record->time_sec;
+  if (record->time_sec < writer->min_time) {
+    writer->min_time = record->time_sec;
+  }
+  if (record->time_sec > writer->max_time) {
+    writer->max_time = record->time_sec;
+  }
+  writer->rec_types |= 1 << record->type;
+  writer->recs_cnt++;
+  return 0;
+
+err_nomem:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add record to columnar archive");
+  return -1;
+}
+
+int bgpstream_columnar_writer_flush(bgpstream_columnar_writer_t *writer)
+{
+  return output_rowgroup(writer);
+}
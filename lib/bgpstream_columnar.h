@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_COLUMNAR_H
+#define __BGPSTREAM_COLUMNAR_H
+
+#include "bgpstream_record.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the bgpstream
+ * columnar elem archive writer.
+ *
+ * A columnar elem archive stores (filtered) records and their elems for
+ * repeated analysis. It can be read back by BGPStream using the "columnar"
+ * resource format (e.g., with the singlefile data interface), and is designed
+ * so that a filtered read only touches the parts of the archive that it
+ * needs.
+ *
+ * An archive starts with an 8 byte header: the magic string "BSCOL", the
+ * format version, the codec used to compress the column blocks (see
+ * bgpstream_columnar_codec_t) and a reserved (zero) byte. It is followed by
+ * row groups, each holding the records of one time window (of a configurable
+ * length). Each row group is made of three sections, each preceded by its
+ * varint length:
+ *
+ * - statistics: the record and elem counts, min and max record times, masks
+ *   of the record types, elem types and prefix address versions in the row
+ *   group, the range of IPv4 and IPv6 addresses covered by the prefixes, the
+ *   dictionary of sources (project, collector, router name and address), the
+ *   dictionary of peers (address and ASN), and a bloom filter of the origin
+ *   ASNs.
+ * - record columns: time, usec, record info (type, dump position, source and
+ *   dump time) and elem count.
+ * - elem columns: the dictionary of AS paths, followed by the type (run-length
+ *   encoded), peer, time, prefix, next-hop, AS path, communities and peer
+ *   state columns.
+ *
+ * Each column is preceded by its varint length, and uses an encoding that
+ * suits its contents: times are zigzag-encoded varint deltas, peers and AS
+ * paths are dictionary IDs, and so on. Varints are unsigned LEB128.
+ *
+ * If the archive is compressed, each column (and the AS path dictionary,
+ * which is then also preceded by its varint length) is compressed on its own:
+ * it is stored as the varint length of the encoded column, followed by the
+ * compressed column (or the encoded column itself, if it did not compress).
+ * The statistics are not compressed, and the lengths of the sections and
+ * columns are those of the stored data, so row groups and elem columns can
+ * still be skipped without reading them. This is unlike an archive that is
+ * compressed as a whole (e.g., with gzip), which has to be read up to the
+ * data that is needed.
+ *
+ * When reading, the statistics are checked against the stream filters. Row
+ * groups that cannot contain any matching record are skipped entirely, and
+ * the elem columns of row groups that cannot contain any matching elem are
+ * skipped (their records are still returned, without elems, exactly as they
+ * would be when reading the original data).
+ *
+ */
+
+/**
+ * @name Public Constants
+ *
+ * @{ */
+
+/** Magic string at the start of a columnar elem archive */
+#define BGPSTREAM_COLUMNAR_MAGIC "BSCOL"
+
+/** Version of the columnar elem archive format */
+#define BGPSTREAM_COLUMNAR_VERSION 1
+
+/** Length of the columnar elem archive header */
+#define BGPSTREAM_COLUMNAR_HEADER_LEN 8
+
+/** Default length of the row group time window (in seconds) */
+#define BGPSTREAM_COLUMNAR_WINDOW_DEFAULT 900
+
+/** @} */
+
+/**
+ * @name Public Enums
+ *
+ * @{ */
+
+/** Codec used to compress the column blocks of an archive */
+typedef enum {
+
+  /** Columns are not compressed */
+  BGPSTREAM_COLUMNAR_CODEC_NONE = 0,
+
+  /** Columns are compressed with zstd */
+  BGPSTREAM_COLUMNAR_CODEC_ZSTD = 1,
+
+  /** Columns are compressed with LZ4 (block format) */
+  BGPSTREAM_COLUMNAR_CODEC_LZ4 = 2,
+
+} bgpstream_columnar_codec_t;
+
+/** @} */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing a columnar elem archive writer instance */
+typedef struct bgpstream_columnar_writer bgpstream_columnar_writer_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** Callback used by a writer to output encoded data
+ *
+ * @param buf           pointer to the encoded data
+ * @param len           number of bytes of encoded data
+ * @param user          user pointer given to bgpstream_columnar_writer_create
+ * @return 0 if all of the data was written, -1 otherwise
+ */
+typedef int(bgpstream_columnar_write_cb_t)(const uint8_t *buf, size_t len,
+                                           void *user);
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new columnar elem archive writer
+ *
+ * @param cb            callback to use to output encoded data
+ * @param user          user pointer to pass to the callback
+ * @param window        length of the row group time window in seconds (0 to
+ *                      use BGPSTREAM_COLUMNAR_WINDOW_DEFAULT)
+ * @return pointer to a new writer if successful, NULL otherwise
+ *
+ * Each row group is buffered in memory, and passed to the callback once it is
+ * complete (i.e., when a record from a later window is added, when the row
+ * group reaches its maximum size, or when the writer is flushed). The archive
+ * header is output along with the first row group.
+ */
+bgpstream_columnar_writer_t *
+bgpstream_columnar_writer_create(bgpstream_columnar_write_cb_t *cb, void *user,
+                                 uint32_t window);
+
+/** Set the codec used to compress the columns of the archive
+ *
+ * @param writer        pointer to the writer
+ * @param codec         codec to use (the default is
+ *                      BGPSTREAM_COLUMNAR_CODEC_NONE)
+ * @return 0 if the codec was set successfully, -1 if the codec is not
+ * supported by this build of libbgpstream, or if the archive header has
+ * already been output
+ */
+int bgpstream_columnar_writer_set_codec(bgpstream_columnar_writer_t *writer,
+                                        bgpstream_columnar_codec_t codec);
+
+/** Destroy the given writer
+ *
+ * @param writer        pointer to the writer to destroy
+ *
+ * The current row group is discarded, so bgpstream_columnar_writer_flush
+ * should be called first.
+ */
+void bgpstream_columnar_writer_destroy(bgpstream_columnar_writer_t *writer);
+
+/** Add the given record, along with all of its elems, to the archive
+ *
+ * @param writer        pointer to the writer
+ * @param record        pointer to the record to add
+ * @return 0 if the record was added successfully, -1 otherwise
+ *
+ * Only valid records are stored. The elems are extracted using
+ * bgpstream_record_get_next_elem, so only the elems that match the stream
+ * filters (and that have not already been extracted) are stored.
+ */
+int bgpstream_columnar_writer_add_record(bgpstream_columnar_writer_t *writer,
+                                         bgpstream_record_t *record);
+
+/** Complete the current row group and output it
+ *
+ * @param writer        pointer to the writer
+ * @return 0 if the data was written successfully, -1 otherwise
+ */
+int bgpstream_columnar_writer_flush(bgpstream_columnar_writer_t *writer);
+
+/** @} */
+
+#endif /* __BGPSTREAM_COLUMNAR_H */
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_COLUMNAR_INT_H
+#define __BGPSTREAM_COLUMNAR_INT_H
+
+#include "bgpstream_columnar.h"
+#include "bgpstream_utils_pfx.h"
+#include <stdint.h>
+#include <string.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the private definitions shared by the
+ * columnar elem archive writer and the "columnar" resource format.
+ *
+ */
+
+/**
+ * @name Private Constants
+ *
+ * @{ */
+
+/** Offset of the column codec in the archive header */
+#define COLUMNAR_HEADER_CODEC 6
+
+/** Bit set in the statistics version mask if there are IPv4 prefixes */
+#define COLUMNAR_VERSION_IPV4 0x01
+
+/** Bit set in the statistics version mask if there are IPv6 prefixes */
+#define COLUMNAR_VERSION_IPV6 0x02
+
+/** Number of hash functions used by the origin ASN bloom filter */
+#define COLUMNAR_BLOOM_HASH_CNT 3
+
+/** Minimum and maximum size of the origin ASN bloom filter (in bits) */
+#define COLUMNAR_BLOOM_MIN_BITS 64
+#define COLUMNAR_BLOOM_MAX_BITS (1 << 20)
+
+/** @} */
+
+/**
+ * @name Private Enums
+ *
+ * @{ */
+
+/** Record columns, in the order in which they are stored */
+typedef enum {
+  COLUMNAR_REC_COL_TIME,
+  COLUMNAR_REC_COL_USEC,
+  COLUMNAR_REC_COL_INFO,
+  COLUMNAR_REC_COL_ELEMS,
+  COLUMNAR_REC_COL_CNT,
+} columnar_rec_col_t;
+
+/** Elem columns, in the order in which they are stored */
+typedef enum {
+  COLUMNAR_ELEM_COL_TYPE,
+  COLUMNAR_ELEM_COL_PEER,
+  COLUMNAR_ELEM_COL_TIME,
+  COLUMNAR_ELEM_COL_PFX,
+  COLUMNAR_ELEM_COL_NEXTHOP,
+  COLUMNAR_ELEM_COL_PATH,
+  COLUMNAR_ELEM_COL_COMMS,
+  COLUMNAR_ELEM_COL_STATE,
+  COLUMNAR_ELEM_COL_CNT,
+} columnar_elem_col_t;
+
+/** @} */
+
+/**
+ * @name Private API Functions
+ *
+ * @{ */
+
+/** Get the bloom filter bit used by the given hash function for an ASN
+ *
+ * @param asn           ASN to hash
+ * @param i             index of the hash function
+ * @param bits          size of the bloom filter (a power of two)
+ * @return the index of the bit
+ */
+static inline uint32_t columnar_bloom_bit(uint32_t asn, int i, uint32_t bits)
+{
+  uint64_t h = (uint64_t)asn * 0x9E3779B97F4A7C15ULL;
+  uint32_t h1 = (uint32_t)(h >> 32);
+  uint32_t h2 = (uint32_t)h | 1;
+  return (h1 + (uint32_t)i * h2) & (bits - 1);
+}
+
+static inline void columnar_bloom_add(uint8_t *bloom, uint32_t bits,
+                                      uint32_t asn)
+{
+  uint32_t b;
+  int i;
+  for (i = 0; i < COLUMNAR_BLOOM_HASH_CNT; i++) {
+    b = columnar_bloom_bit(asn, i, bits);
+    bloom[b / 8] |= 1 << (b % 8);
+  }
+}
+
+static inline int columnar_bloom_test(const uint8_t *bloom, uint32_t bits,
+                                      uint32_t asn)
+{
+  uint32_t b;
+  int i;
+  for (i = 0; i < COLUMNAR_BLOOM_HASH_CNT; i++) {
+    b = columnar_bloom_bit(asn, i, bits);
+    if ((bloom[b / 8] & (1 << (b % 8))) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/** Get the first and last addresses covered by a prefix
+ *
+ * @param pfx           pointer to the prefix
+ * @param first         filled with the first address (network byte order)
+ * @param last          filled with the last address (network byte order)
+ * @return the length of the addresses (4 or 16), or 0 if the prefix has an
+ * unknown address version
+ */
+static inline int columnar_pfx_range(const bgpstream_pfx_t *pfx,
+                                     uint8_t *first, uint8_t *last)
+{
+  int len;
+  int i;
+
+  switch (pfx->address.version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    len = 4;
+    break;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    len = 16;
+    break;
+  default:
+    return 0;
+  }
+  memcpy(first, &pfx->address.addr, len);
+  memcpy(last, &pfx->address.addr, len);
+  for (i = 0; i < len; i++) {
+    if (pfx->mask_len >= (i + 1) * 8) {
+      continue;
+    }
+    if (pfx->mask_len <= i * 8) {
+      first[i] = 0;
+      last[i] = 0xff;
+    } else {
+      uint8_t host = 0xff >> (pfx->mask_len - i * 8);
+      first[i] &= ~host;
+      last[i] |= host;
+    }
+  }
+  return len;
+}
+
+/** @} */
+
+#endif /* __BGPSTREAM_COLUMNAR_INT_H */
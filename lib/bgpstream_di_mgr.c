@@ -58,6 +58,14 @@
 #include "bsdi_broker.h"
 #endif
 
+#ifdef WITH_DATA_INTERFACE_SHM
+#include "bsdi_shm.h"
+#endif
+
+#ifdef WITH_DATA_INTERFACE_DIRECTORY
+#include "bsdi_directory.h"
+#endif
+
 /* After 10 retries, start exponential backoff */
 #define DATA_INTERFACE_BLOCKING_RETRY_CNT 10
 /* Wait at least 20 seconds if the broker has no new data for us */
@@ -136,6 +144,18 @@ static const di_alloc_func_t di_alloc_functions[] = {
   NULL,
 #endif
 
+#ifdef WITH_DATA_INTERFACE_SHM
+  bsdi_shm_alloc,
+#else
+  NULL,
+#endif
+
+#ifdef WITH_DATA_INTERFACE_DIRECTORY
+  bsdi_directory_alloc,
+#else
+  NULL,
+#endif
+
 };
 
 #define GET_DEFAULT_STR_VALUE(var_store, default_value)                        \
@@ -338,6 +358,11 @@ void bgpstream_di_mgr_set_blocking(bgpstream_di_mgr_t *di_mgr)
   di_mgr->blocking = 1;
 }
 
+void bgpstream_di_mgr_set_record_retain(bgpstream_di_mgr_t *di_mgr)
+{
+  bgpstream_resource_mgr_set_record_retain(di_mgr->res_mgr);
+}
+
 int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
                                      bgpstream_record_t **record)
 {
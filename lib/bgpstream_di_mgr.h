@@ -132,6 +132,12 @@ int bgpstream_di_mgr_set_data_interface_option(
  */
 void bgpstream_di_mgr_set_blocking(bgpstream_di_mgr_t *di_mgr);
 
+/** Make the data interface export records that may be retained
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ */
+void bgpstream_di_mgr_set_record_retain(bgpstream_di_mgr_t *di_mgr);
+
 /** Start the data interface
  *
  * @param di_mgr        pointer to a data interface manager instance
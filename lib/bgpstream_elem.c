@@ -28,6 +28,7 @@
 #include "bgpstream_log.h"
 #include "bgpstream_record.h"
 #include "bgpstream_utils.h"
+#include "bgpstream_utils_fmt.h"
 #include "bgpstream_int.h" // for bgpstream_char_snprintf()
 #include "config.h"
 #ifdef WITH_RPKI
@@ -199,33 +200,41 @@ int bgpstream_elem_peerstate_snprintf(char *buf, size_t len,
   return written;
 }
 
-#define B_REMAIN (len > written ? len - written : 0) /* unsigned */
-#define B_FULL (written >= len)
-#define ADD_PIPE                                                               \
-  do {                                                                         \
-    if (len > written + 1) {                                                   \
-      buf_p[0] = '|';                                                          \
-      buf_p[1] = '\0';                                                         \
-    }                                                                          \
-    buf_p++;                                                                   \
-    written++;                                                                 \
-  } while (0)
-
-#define SEEK_STR_END                                                           \
-  do {                                                                         \
-    while (*buf_p != '\0') {                                                   \
-      written++;                                                               \
-      buf_p++;                                                                 \
-    }                                                                          \
-  } while (0)
+/* length of the longest peer state name ("ESTABLISHED") */
+#define PEERSTATE_MAX_LEN 11
+
+/* upper bound on the length of an elem line, excluding the AS path (which is
+   printed twice, as the path and the origin) and the communities */
+#define ELEM_FMT_FIXED_MAX_LEN                                                 \
+  (2 + (BGPSTREAM_FMT_UINT32_MAX_LEN + 1) + (BGPSTREAM_FMT_ADDR_MAX_LEN + 1) + \
+   (BGPSTREAM_FMT_PFX_MAX_LEN + 1) + (BGPSTREAM_FMT_ADDR_MAX_LEN + 1) + 4 +     \
+   (PEERSTATE_MAX_LEN * 2) + 1)
+
+static const char *peerstate_strs[] = {
+  "",            // BGPSTREAM_ELEM_PEERSTATE_UNKNOWN
+  "IDLE",        // BGPSTREAM_ELEM_PEERSTATE_IDLE
+  "CONNECT",     // BGPSTREAM_ELEM_PEERSTATE_CONNECT
+  "ACTIVE",      // BGPSTREAM_ELEM_PEERSTATE_ACTIVE
+  "OPENSENT",    // BGPSTREAM_ELEM_PEERSTATE_OPENSENT
+  "OPENCONFIRM", // BGPSTREAM_ELEM_PEERSTATE_OPENCONFIRM
+  "ESTABLISHED", // BGPSTREAM_ELEM_PEERSTATE_ESTABLISHED
+  "CLEARING",    // BGPSTREAM_ELEM_PEERSTATE_CLEARING
+  "DELETED",     // BGPSTREAM_ELEM_PEERSTATE_DELETED
+};
+
+#define PEERSTATE_STR(state)                                                   \
+  (((unsigned)(state) < ARR_CNT(peerstate_strs)) ? peerstate_strs[(state)] : "")
+
+size_t bgpstream_elem_fmt_max_len(const bgpstream_elem_t *elem)
+{
+  return ELEM_FMT_FIXED_MAX_LEN +
+         (2 * bgpstream_fmt_as_path_max_len(elem->as_path)) +
+         bgpstream_fmt_community_set_max_len(elem->communities);
+}
 
-char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
-                                     bgpstream_elem_t const *elem,
-                                     int print_type)
+char *bgpstream_elem_fmt(char *p, const bgpstream_elem_t *elem, int print_type)
 {
-  size_t written = 0; /* < how many bytes we wanted to write */
-  size_t c = 0;       /* < how many chars were written */
-  char *buf_p = buf;
+  char *end;
   bgpstream_as_path_seg_t *seg;
 
   /* common fields */
@@ -234,31 +243,28 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
 
   if (print_type) {
     /* MESSAGE TYPE */
-    c = bgpstream_elem_type_snprintf(buf_p, B_REMAIN, elem->type);
-    written += c;
-    buf_p += c;
-
-    ADD_PIPE;
+    switch (elem->type) {
+      case BGPSTREAM_ELEM_TYPE_RIB:          *p++ = 'R'; break;
+      case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT: *p++ = 'A'; break;
+      case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:   *p++ = 'W'; break;
+      case BGPSTREAM_ELEM_TYPE_PEERSTATE:    *p++ = 'S'; break;
+      default: break;
+    }
+    *p++ = '|';
   }
 
   /* PEER ASN */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->peer_asn);
-  written += c;
-  buf_p += c;
-  ADD_PIPE;
+  p = bgpstream_fmt_uint32(p, elem->peer_asn);
+  *p++ = '|';
 
   /* PEER IP */
-  /* Note: this can fail in rare cases where the peer address is not
-     present in the elem (old quagga collectors sometimes didn't dump
-     this information for state change and open messages). This will
-     result in an empty peer IP field.  But if it fails due to lack of
-     space, we should fail too. */
-  if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->peer_ip) == NULL &&
-      errno == ENOSPC) {
-    return NULL;
+  /* Note: the peer address may not be present in the elem (old quagga
+     collectors sometimes didn't dump this information for state change and
+     open messages). This results in an empty peer IP field. */
+  if ((end = bgpstream_fmt_addr(p, &elem->peer_ip)) != NULL) {
+    p = end;
   }
-  SEEK_STR_END;
-  ADD_PIPE;
+  *p++ = '|';
 
   /* conditional fields */
   switch (elem->type) {
@@ -266,114 +272,65 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
 
     /* PREFIX */
-    if (bgpstream_pfx_snprintf(buf_p, B_REMAIN, &(elem->prefix)) == NULL) {
-      if (errno != ENOSPC)
-        bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix (R/A)");
+    if ((p = bgpstream_fmt_pfx(p, &elem->prefix)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix (R/A)");
       return NULL;
     }
-    SEEK_STR_END;
-    ADD_PIPE;
+    *p++ = '|';
 
     /* NEXT HOP */
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->nexthop) == NULL &&
-        errno == ENOSPC) {
-      return NULL;
+    if ((end = bgpstream_fmt_addr(p, &elem->nexthop)) != NULL) {
+      p = end;
     }
-    SEEK_STR_END;
-    ADD_PIPE;
+    *p++ = '|';
 
     /* AS PATH */
-    c = bgpstream_as_path_snprintf(buf_p, B_REMAIN, elem->as_path);
-    written += c;
-    buf_p += c;
-
-    ADD_PIPE;
+    p = bgpstream_fmt_as_path(p, elem->as_path);
+    *p++ = '|';
 
     /* ORIGIN AS */
     if ((seg = bgpstream_as_path_get_origin_seg(elem->as_path)) != NULL) {
-      c = bgpstream_as_path_seg_snprintf(buf_p, B_REMAIN, seg);
-      written += c;
-      buf_p += c;
+      p = bgpstream_fmt_as_path_seg(p, seg);
     }
-    ADD_PIPE;
+    *p++ = '|';
 
     /* COMMUNITIES */
-    c = bgpstream_community_set_snprintf(buf_p, B_REMAIN, elem->communities);
-    written += c;
-    buf_p += c;
-
-    ADD_PIPE;
+    p = bgpstream_fmt_community_set(p, elem->communities);
+    *p++ = '|';
 
     /* OLD STATE (empty) */
-    ADD_PIPE;
+    *p++ = '|';
 
     /* NEW STATE (empty) */
-
-#ifdef WITH_RPKI
-    /* RPKI validation */
-    /* If the RPKI parameter was set, the corresponding input was valid and the
-        configure was completely set up -> the elem can be validated by RPKI */
-    if (elem->annotations.rpki_active) {
-      char result[B_REMAIN];
-      if (bgpstream_rpki_validate(elem, result, sizeof(result))) {
-        c = snprintf(buf_p, B_REMAIN, "%s", result);
-        written += c;
-        buf_p += c;
-      }
-    }
-#endif
-
     /* END OF LINE */
     break;
 
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
 
     /* PREFIX */
-    if (bgpstream_pfx_snprintf(buf_p, B_REMAIN, &(elem->prefix)) == NULL) {
-      if (errno != ENOSPC)
-        bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix (W)");
+    if ((p = bgpstream_fmt_pfx(p, &elem->prefix)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed prefix (W)");
       return NULL;
     }
-    SEEK_STR_END;
-    ADD_PIPE;
-    /* NEXT HOP (empty) */
-    ADD_PIPE;
-    /* AS PATH (empty) */
-    ADD_PIPE;
-    /* ORIGIN AS (empty) */
-    ADD_PIPE;
-    /* COMMUNITIES (empty) */
-    ADD_PIPE;
-    /* OLD STATE (empty) */
-    ADD_PIPE;
+    /* NEXT HOP, AS PATH, ORIGIN AS, COMMUNITIES, OLD STATE (empty) */
+    memcpy(p, "|||||", 5);
+    p += 5;
     /* NEW STATE (empty) */
     /* END OF LINE */
     break;
 
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
 
-    /* PREFIX (empty) */
-    ADD_PIPE;
-    /* NEXT HOP (empty) */
-    ADD_PIPE;
-    /* AS PATH (empty) */
-    ADD_PIPE;
-    /* ORIGIN AS (empty) */
-    ADD_PIPE;
-    /* COMMUNITIES (empty) */
-    ADD_PIPE;
+    /* PREFIX, NEXT HOP, AS PATH, ORIGIN AS, COMMUNITIES (empty) */
+    memcpy(p, "|||||", 5);
+    p += 5;
 
     /* OLD STATE */
-    c = bgpstream_elem_peerstate_snprintf(buf_p, B_REMAIN, elem->old_state);
-    written += c;
-    buf_p += c;
-
-    ADD_PIPE;
+    p = bgpstream_fmt_str(p, PEERSTATE_STR(elem->old_state));
+    *p++ = '|';
 
-    /* NEW STATE (empty) */
-    c = bgpstream_elem_peerstate_snprintf(buf_p, B_REMAIN, elem->new_state);
-    written += c;
-    buf_p += c;
+    /* NEW STATE */
+    p = bgpstream_fmt_str(p, PEERSTATE_STR(elem->new_state));
 
     /* END OF LINE */
     break;
@@ -383,7 +340,53 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
     return NULL;
   }
 
-  return B_FULL ? NULL : buf;
+  return p;
+}
+
+size_t bgpstream_elem_annotations_snprintf(char *buf, size_t len,
+                                           const bgpstream_elem_t *elem)
+{
+#ifdef WITH_RPKI
+  /* RPKI validation */
+  /* If the RPKI parameter was set, the corresponding input was valid and the
+      configure was completely set up -> the elem can be validated by RPKI */
+  if ((elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+       elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) &&
+      elem->annotations.rpki_active && len > 0) {
+    char result[len];
+    if (bgpstream_rpki_validate((bgpstream_elem_t *)elem, result,
+                                sizeof(result))) {
+      return snprintf(buf, len, "%s", result);
+    }
+  }
+#endif
+  return 0;
+}
+
+#define B_REMAIN (len > written ? len - written : 0) /* unsigned */
+
+char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
+                                     bgpstream_elem_t const *elem,
+                                     int print_type)
+{
+  bgpstream_fmt_buf_t fb;
+  size_t written; /* < how many bytes we wanted to write */
+  char *p;
+
+  if ((p = bgpstream_fmt_buf_start(&fb, buf, len,
+                                   bgpstream_elem_fmt_max_len(elem))) ==
+      NULL) {
+    return NULL;
+  }
+  p = bgpstream_elem_fmt(p, elem, print_type);
+  written = bgpstream_fmt_buf_finish(&fb, p);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  written += bgpstream_elem_annotations_snprintf(buf + written, B_REMAIN, elem);
+
+  return (written >= len) ? NULL : buf;
 }
 
 char *bgpstream_elem_snprintf(char *buf, size_t len,
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_elem_arena.h"
+#include "bgpstream_log.h"
+#include "bgpstream_utils_as_path_int.h"
+#include "bgpstream_utils_community_int.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Size of each arena chunk (larger copies get a chunk of their own) */
+#define CHUNK_SIZE (1024 * 1024)
+
+/** Alignment of each block in a chunk */
+#define ALIGN(size) (((size) + 7) & ~((size_t)7))
+
+typedef struct chunk {
+
+  /** Next chunk in the list */
+  struct chunk *next;
+
+  /** Number of usable bytes in this chunk */
+  size_t size;
+
+  /** Usable memory (8-byte aligned, since the header is 16 bytes) */
+  uint8_t data[];
+
+} chunk_t;
+
+struct bgpstream_elem_arena {
+
+  /** List of all allocated chunks */
+  chunk_t *chunks;
+
+  /** Chunk that is currently being filled */
+  chunk_t *cur;
+
+  /** Number of bytes used in the current chunk */
+  size_t cur_used;
+
+  /** Number of bytes used in all chunks before the current one */
+  size_t prev_used;
+
+  /** Number of elems copied since the last reset */
+  uint64_t elems_cnt;
+};
+
+static chunk_t *chunk_create(size_t size)
+{
+  chunk_t *chunk;
+
+  if ((chunk = malloc(sizeof(chunk_t) + size)) == NULL) {
+    return NULL;
+  }
+  chunk->next = NULL;
+  chunk->size = size;
+  return chunk;
+}
+
+static void *arena_alloc(bgpstream_elem_arena_t *arena, size_t size)
+{
+  chunk_t *chunk;
+  void *ptr;
+
+  if (arena->cur_used + size > arena->cur->size) {
+    if (arena->cur->next != NULL && arena->cur->next->size >= size) {
+      // reuse the next chunk (left over from before a reset)
+      chunk = arena->cur->next;
+    } else {
+      // insert a new chunk after the current one
+      if ((chunk = chunk_create(size > CHUNK_SIZE ? size : CHUNK_SIZE)) ==
+          NULL) {
+        return NULL;
+      }
+      chunk->next = arena->cur->next;
+      arena->cur->next = chunk;
+    }
+    arena->prev_used += arena->cur_used;
+    arena->cur = chunk;
+    arena->cur_used = 0;
+  }
+
+  ptr = arena->cur->data + arena->cur_used;
+  arena->cur_used += size;
+  return ptr;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpstream_elem_arena_t *bgpstream_elem_arena_create()
+{
+  bgpstream_elem_arena_t *arena;
+
+  if ((arena = malloc_zero(sizeof(bgpstream_elem_arena_t))) == NULL) {
+    return NULL;
+  }
+
+  if ((arena->chunks = chunk_create(CHUNK_SIZE)) == NULL) {
+    free(arena);
+    return NULL;
+  }
+  arena->cur = arena->chunks;
+
+  return arena;
+}
+
+void bgpstream_elem_arena_destroy(bgpstream_elem_arena_t *arena)
+{
+  chunk_t *chunk;
+
+  if (arena == NULL) {
+    return;
+  }
+
+  while ((chunk = arena->chunks) != NULL) {
+    arena->chunks = chunk->next;
+    free(chunk);
+  }
+
+  free(arena);
+}
+
+bgpstream_elem_t *bgpstream_elem_arena_copy(bgpstream_elem_arena_t *arena,
+                                            const bgpstream_elem_t *elem)
+{
+  bgpstream_elem_t *cpy;
+  bgpstream_as_path_t *path;
+  bgpstream_community_set_t *comms;
+  size_t comms_size = sizeof(bgpstream_community_t) *
+                      elem->communities->communities_cnt;
+  uint8_t *ptr;
+
+  // elem | path | community set | communities | path data
+  if ((ptr = arena_alloc(arena,
+                         ALIGN(sizeof(bgpstream_elem_t)) +
+                           ALIGN(sizeof(bgpstream_as_path_t)) +
+                           ALIGN(sizeof(bgpstream_community_set_t)) +
+                           ALIGN(comms_size + elem->as_path->data_len))) ==
+      NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not allocate arena memory");
+    return NULL;
+  }
+
+  cpy = (bgpstream_elem_t *)ptr;
+  ptr += ALIGN(sizeof(bgpstream_elem_t));
+  path = (bgpstream_as_path_t *)ptr;
+  ptr += ALIGN(sizeof(bgpstream_as_path_t));
+  comms = (bgpstream_community_set_t *)ptr;
+  ptr += ALIGN(sizeof(bgpstream_community_set_t));
+
+  memcpy(cpy, elem, sizeof(bgpstream_elem_t));
+  cpy->as_path = path;
+  cpy->communities = comms;
+
+  // communities (alloc cnt < 0 marks the array as externally owned)
+  comms->communities = (bgpstream_community_t *)ptr;
+  comms->communities_cnt = elem->communities->communities_cnt;
+  comms->communities_alloc_cnt = -1;
+  comms->communities_hash = elem->communities->communities_hash;
+  memcpy(ptr, elem->communities->communities, comms_size);
+  ptr += comms_size;
+
+  // as path (alloc len of UINT16_MAX marks the data as externally owned)
+  *path = *elem->as_path;
+  path->data = ptr;
+  path->data_alloc_len = UINT16_MAX;
+  memcpy(ptr, elem->as_path->data, elem->as_path->data_len);
+
+  arena->elems_cnt++;
+  return cpy;
+}
+
+void bgpstream_elem_arena_reset(bgpstream_elem_arena_t *arena)
+{
+  arena->cur = arena->chunks;
+  arena->cur_used = 0;
+  arena->prev_used = 0;
+  arena->elems_cnt = 0;
+}
+
+uint64_t bgpstream_elem_arena_get_elems_cnt(bgpstream_elem_arena_t *arena)
+{
+  return arena->elems_cnt;
+}
+
+size_t bgpstream_elem_arena_get_used_size(bgpstream_elem_arena_t *arena)
+{
+  return arena->prev_used + arena->cur_used;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_ELEM_ARENA_H
+#define __BGPSTREAM_ELEM_ARENA_H
+
+#include "bgpstream_elem.h"
+#include <stddef.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of a bgpstream elem
+ * arena.
+ *
+ * An elem arena holds deep copies of elems that must outlive the record they
+ * were extracted from. Each copy (the elem itself, its AS path data and its
+ * communities) is packed into a single block carved out of a large chunk,
+ * and all copies are freed at once by resetting (or destroying) the arena.
+ *
+ */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing an elem arena instance */
+typedef struct bgpstream_elem_arena bgpstream_elem_arena_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new elem arena
+ *
+ * @return pointer to a new arena if successful, NULL otherwise
+ */
+bgpstream_elem_arena_t *bgpstream_elem_arena_create(void);
+
+/** Destroy the given elem arena, along with all the elems copied into it
+ *
+ * @param arena         pointer to the arena to destroy
+ */
+void bgpstream_elem_arena_destroy(bgpstream_elem_arena_t *arena);
+
+/** Deep-copy the given elem into the arena
+ *
+ * @param arena         pointer to the arena
+ * @param elem          pointer to the elem to copy
+ * @return borrowed pointer to the copy if successful, NULL otherwise
+ *
+ * The copy remains valid until the arena is reset or destroyed. It is
+ * read-only: it must not be passed to bgpstream_elem_destroy,
+ * bgpstream_elem_clear, or used as the destination of bgpstream_elem_copy.
+ */
+bgpstream_elem_t *bgpstream_elem_arena_copy(bgpstream_elem_arena_t *arena,
+                                            const bgpstream_elem_t *elem);
+
+/** Free all the elems in the arena (keeping the allocated memory)
+ *
+ * @param arena         pointer to the arena to reset
+ *
+ * This does not depend on the number of elems in the arena.
+ */
+void bgpstream_elem_arena_reset(bgpstream_elem_arena_t *arena);
+
+/** Get the number of elems currently in the arena
+ *
+ * @param arena         pointer to the arena
+ * @return the number of elems copied since the last reset
+ */
+uint64_t bgpstream_elem_arena_get_elems_cnt(bgpstream_elem_arena_t *arena);
+
+/** Get the amount of memory used by elems in the arena
+ *
+ * @param arena         pointer to the arena
+ * @return the number of bytes used since the last reset
+ */
+size_t bgpstream_elem_arena_get_used_size(bgpstream_elem_arena_t *arena);
+
+/** @} */
+
+#endif /* __BGPSTREAM_ELEM_ARENA_H */
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_elem_batch.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Number of elems allocated when a batch is created */
+#define ELEMS_INIT_ALLOC_CNT 64
+
+/* Grow the given array (of alloc_cnt elements of elem_size bytes) so that it
+ * can hold at least need_cnt elements */
+static int grow(void **arr, uint32_t *alloc_cnt, uint32_t need_cnt,
+                size_t elem_size)
+{
+  uint32_t new_cnt = (*alloc_cnt == 0) ? ELEMS_INIT_ALLOC_CNT : *alloc_cnt;
+  void *tmp;
+
+  if (need_cnt <= *alloc_cnt) {
+    return 0;
+  }
+  while (new_cnt < need_cnt) {
+    new_cnt *= 2;
+  }
+  if ((tmp = realloc(*arr, elem_size * new_cnt)) == NULL) {
+    return -1;
+  }
+  *arr = tmp;
+  *alloc_cnt = new_cnt;
+  return 0;
+}
+
+static int realloc_col(void **col, size_t elem_size, int cnt)
+{
+  void *tmp;
+
+  if ((tmp = realloc(*col, elem_size * cnt)) == NULL) {
+    return -1;
+  }
+  *col = tmp;
+  return 0;
+}
+
+#define REALLOC_COL(col, cnt) realloc_col((void **)&(col), sizeof(*(col)), cnt)
+
+static int grow_elems(bgpstream_elem_batch_t *batch, int need_cnt)
+{
+  int new_cnt = (batch->_elems_alloc_cnt == 0) ? ELEMS_INIT_ALLOC_CNT
+                                               : batch->_elems_alloc_cnt;
+
+  if (need_cnt <= batch->_elems_alloc_cnt) {
+    return 0;
+  }
+  while (new_cnt < need_cnt) {
+    new_cnt *= 2;
+  }
+
+  /* the offset columns have one extra entry */
+  if (REALLOC_COL(batch->time_sec, new_cnt) != 0 ||
+      REALLOC_COL(batch->type, new_cnt) != 0 ||
+      REALLOC_COL(batch->peer_id, new_cnt) != 0 ||
+      REALLOC_COL(batch->peer_asn, new_cnt) != 0 ||
+      REALLOC_COL(batch->prefix, new_cnt) != 0 ||
+      REALLOC_COL(batch->origin_asn, new_cnt) != 0 ||
+      REALLOC_COL(batch->as_path_offset, new_cnt + 1) != 0 ||
+      REALLOC_COL(batch->segs_offset, new_cnt + 1) != 0 ||
+      REALLOC_COL(batch->communities_offset, new_cnt + 1) != 0) {
+    return -1;
+  }
+
+  batch->_elems_alloc_cnt = new_cnt;
+  return 0;
+}
+
+static int grow_segs(bgpstream_elem_batch_t *batch, uint32_t need_cnt)
+{
+  uint32_t alloc_cnt;
+
+  /* the seg_* columns share one allocated count */
+  alloc_cnt = batch->_segs_alloc_cnt;
+  if (grow((void **)&batch->seg_type, &alloc_cnt, need_cnt,
+           sizeof(uint8_t)) != 0) {
+    return -1;
+  }
+  alloc_cnt = batch->_segs_alloc_cnt;
+  if (grow((void **)&batch->seg_asn_offset, &alloc_cnt, need_cnt,
+           sizeof(uint32_t)) != 0) {
+    return -1;
+  }
+  alloc_cnt = batch->_segs_alloc_cnt;
+  if (grow((void **)&batch->seg_asns_cnt, &alloc_cnt, need_cnt,
+           sizeof(uint8_t)) != 0) {
+    return -1;
+  }
+  batch->_segs_alloc_cnt = alloc_cnt;
+  return 0;
+}
+
+static int add_as_path(bgpstream_elem_batch_t *batch, bgpstream_elem_t *elem)
+{
+  bgpstream_as_path_iter_t iter;
+  bgpstream_as_path_seg_t *seg;
+  uint32_t need = 0;
+  uint32_t segs_need = 0;
+  uint32_t j;
+
+  /* first pass to find out how much space we need */
+  bgpstream_as_path_iter_reset(&iter);
+  while ((seg = bgpstream_as_path_get_next_seg(elem->as_path, &iter)) !=
+         NULL) {
+    if (seg->type == BGPSTREAM_AS_PATH_SEG_ASN) {
+      need++;
+    } else {
+      need += seg->set.asn_cnt;
+      segs_need++;
+    }
+  }
+  if (grow((void **)&batch->asns, &batch->_asns_alloc_cnt,
+           batch->asns_cnt + need, sizeof(uint32_t)) != 0 ||
+      grow_segs(batch, batch->segs_cnt + segs_need) != 0) {
+    return -1;
+  }
+
+  bgpstream_as_path_iter_reset(&iter);
+  while ((seg = bgpstream_as_path_get_next_seg(elem->as_path, &iter)) !=
+         NULL) {
+    if (seg->type == BGPSTREAM_AS_PATH_SEG_ASN) {
+      batch->asns[batch->asns_cnt++] = seg->asn.asn;
+    } else {
+      j = batch->segs_cnt++;
+      batch->seg_type[j] = seg->type;
+      batch->seg_asn_offset[j] = batch->asns_cnt;
+      batch->seg_asns_cnt[j] = seg->set.asn_cnt;
+      memcpy(&batch->asns[batch->asns_cnt], seg->set.asn,
+             sizeof(uint32_t) * seg->set.asn_cnt);
+      batch->asns_cnt += seg->set.asn_cnt;
+    }
+  }
+
+  return 0;
+}
+
+static int add_communities(bgpstream_elem_batch_t *batch,
+                           bgpstream_elem_t *elem)
+{
+  int cnt = bgpstream_community_set_size(elem->communities);
+  int i;
+
+  if (grow((void **)&batch->communities, &batch->_communities_alloc_cnt,
+           batch->communities_cnt + cnt, sizeof(bgpstream_community_t)) != 0) {
+    return -1;
+  }
+  for (i = 0; i < cnt; i++) {
+    batch->communities[batch->communities_cnt++] =
+      *bgpstream_community_set_get(elem->communities, i);
+  }
+
+  return 0;
+}
+
+static int add_elem_cb(bgpstream_record_t *record, bgpstream_elem_t *elem,
+                       void *user)
+{
+  return (bgpstream_elem_batch_add_elem(user, record, elem) == 0) ? 0 : -1;
+}
+
+/* ==================== PUBLIC FUNCTIONS ==================== */
+
+bgpstream_elem_batch_t *
+bgpstream_elem_batch_create(bgpstream_peer_sig_map_t *peer_sig_map)
+{
+  bgpstream_elem_batch_t *batch;
+
+  if ((batch = malloc_zero(sizeof(bgpstream_elem_batch_t))) == NULL) {
+    return NULL;
+  }
+  batch->_peer_sig_map = peer_sig_map;
+
+  if (grow_elems(batch, ELEMS_INIT_ALLOC_CNT) != 0) {
+    bgpstream_elem_batch_destroy(batch);
+    return NULL;
+  }
+  batch->as_path_offset[0] = 0;
+  batch->segs_offset[0] = 0;
+  batch->communities_offset[0] = 0;
+
+  return batch;
+}
+
+void bgpstream_elem_batch_destroy(bgpstream_elem_batch_t *batch)
+{
+  if (batch == NULL) {
+    return;
+  }
+
+  free(batch->time_sec);
+  free(batch->type);
+  free(batch->peer_id);
+  free(batch->peer_asn);
+  free(batch->prefix);
+  free(batch->origin_asn);
+  free(batch->as_path_offset);
+  free(batch->asns);
+  free(batch->segs_offset);
+  free(batch->seg_type);
+  free(batch->seg_asn_offset);
+  free(batch->seg_asns_cnt);
+  free(batch->communities_offset);
+  free(batch->communities);
+
+  free(batch);
+}
+
+void bgpstream_elem_batch_clear(bgpstream_elem_batch_t *batch)
+{
+  batch->elems_cnt = 0;
+  batch->asns_cnt = 0;
+  batch->segs_cnt = 0;
+  batch->communities_cnt = 0;
+}
+
+int bgpstream_elem_batch_add_elem(bgpstream_elem_batch_t *batch,
+                                  bgpstream_record_t *record,
+                                  bgpstream_elem_t *elem)
+{
+  int i = batch->elems_cnt;
+
+  if (grow_elems(batch, i + 1) != 0 || add_as_path(batch, elem) != 0 ||
+      add_communities(batch, elem) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not grow elem batch");
+    goto err;
+  }
+
+  batch->peer_id[i] = 0;
+  if (batch->_peer_sig_map != NULL &&
+      (batch->peer_id[i] = bgpstream_peer_sig_map_get_id_cached(
+         batch->_peer_sig_map, &batch->_peer_cache, record->collector_name,
+         &elem->peer_ip, elem->peer_asn)) == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not get peer ID");
+    goto err;
+  }
+
+  batch->time_sec[i] = record->time_sec;
+  batch->type[i] = elem->type;
+  batch->peer_asn[i] = elem->peer_asn;
+  batch->prefix[i] = elem->prefix;
+  if (bgpstream_as_path_get_origin_val(elem->as_path, &batch->origin_asn[i]) !=
+      0) {
+    batch->origin_asn[i] = 0;
+  }
+  batch->as_path_offset[i + 1] = batch->asns_cnt;
+  batch->segs_offset[i + 1] = batch->segs_cnt;
+  batch->communities_offset[i + 1] = batch->communities_cnt;
+  batch->elems_cnt++;
+
+  return 0;
+
+err:
+  /* drop any partially added path/communities */
+  batch->asns_cnt = batch->as_path_offset[i];
+  batch->segs_cnt = batch->segs_offset[i];
+  batch->communities_cnt = batch->communities_offset[i];
+  return -1;
+}
+
+int bgpstream_elem_batch_add_record(bgpstream_elem_batch_t *batch,
+                                    bgpstream_record_t *record)
+{
+  return bgpstream_record_foreach_elem(record, add_elem_cb, batch);
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_ELEM_BATCH_H
+#define __BGPSTREAM_ELEM_BATCH_H
+
+#include "bgpstream_elem.h"
+#include "bgpstream_record.h"
+#include "bgpstream_utils.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of a bgpstream elem
+ * batch.
+ *
+ * An elem batch stores the commonly used fields of many elems in columns
+ * (structure-of-arrays) rather than as one bgpstream_elem_t per elem. Loops
+ * that only look at a few fields (e.g., prefix and origin ASN) then touch
+ * only the memory they need, and AS paths and communities are stored in
+ * shared flat arrays rather than in separately allocated objects.
+ *
+ */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** Columnar batch of elems
+ *
+ * Column arrays are indexed by elem (0 to elems_cnt-1). The AS path of elem i
+ * is asns[as_path_offset[i]] to asns[as_path_offset[i+1]-1], and its
+ * communities are communities[communities_offset[i]] to
+ * communities[communities_offset[i+1]-1].
+ *
+ * AS paths are mostly plain sequences of ASNs, so only their other segments
+ * (AS sets and confederation segments) are listed, in the seg_* columns. The
+ * segments of elem i are segs_offset[i] to segs_offset[i+1]-1, and segment j
+ * holds the seg_asns_cnt[j] ASNs from asns[seg_asn_offset[j]]. ASNs of a path
+ * that are not in any of its segments are AS_SEQUENCE hops.
+ *
+ * All pointers are owned by the batch and may change when elems are added.
+ */
+typedef struct bgpstream_elem_batch {
+
+  /** Number of elems in the batch */
+  int elems_cnt;
+
+  /** Collection time of the record that each elem came from (seconds) */
+  uint32_t *time_sec;
+
+  /** Type of each elem (bgpstream_elem_type_t) */
+  uint8_t *type;
+
+  /** Peer ID of each elem (0 if the batch was created without a peer
+   * signature map) */
+  bgpstream_peer_id_t *peer_id;
+
+  /** Peer ASN of each elem */
+  uint32_t *peer_asn;
+
+  /** Prefix of each elem (unset for peerstate elems) */
+  bgpstream_pfx_t *prefix;
+
+  /** Origin ASN of each elem (0 if the elem has no AS path, or if the origin
+   * segment is an AS set) */
+  uint32_t *origin_asn;
+
+  /** Offset of the first ASN of each elem's AS path in asns (elems_cnt + 1
+   * entries) */
+  uint32_t *as_path_offset;
+
+  /** ASNs of all the AS paths in the batch. AS set and confederation
+   * segments are flattened into their member ASNs, and listed in the seg_*
+   * columns. */
+  uint32_t *asns;
+
+  /** Number of ASNs in asns */
+  uint32_t asns_cnt;
+
+  /** Offset of the first segment of each elem's AS path in the seg_* columns
+   * (elems_cnt + 1 entries) */
+  uint32_t *segs_offset;
+
+  /** Type of each segment (bgpstream_as_path_seg_type_t, never
+   * BGPSTREAM_AS_PATH_SEG_ASN) */
+  uint8_t *seg_type;
+
+  /** Offset of the first ASN of each segment in asns */
+  uint32_t *seg_asn_offset;
+
+  /** Number of ASNs in each segment */
+  uint8_t *seg_asns_cnt;
+
+  /** Number of segments in the seg_* columns */
+  uint32_t segs_cnt;
+
+  /** Offset of the first community of each elem in communities (elems_cnt +
+   * 1 entries) */
+  uint32_t *communities_offset;
+
+  /** Communities of all the elems in the batch */
+  bgpstream_community_t *communities;
+
+  /** Number of communities in communities */
+  uint32_t communities_cnt;
+
+  /* ---------- INTERNAL FIELDS: ---------- */
+
+  /** Number of elems allocated in each column */
+  int _elems_alloc_cnt;
+
+  /** Number of ASNs allocated */
+  uint32_t _asns_alloc_cnt;
+
+  /** Number of segments allocated in each seg_* column */
+  uint32_t _segs_alloc_cnt;
+
+  /** Number of communities allocated */
+  uint32_t _communities_alloc_cnt;
+
+  /** Peer signature map used to assign peer IDs (borrowed, may be NULL) */
+  bgpstream_peer_sig_map_t *_peer_sig_map;
+
+  /** Last-peer cache for the peer signature map */
+  bgpstream_peer_sig_map_cache_t _peer_cache;
+
+} bgpstream_elem_batch_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new elem batch
+ *
+ * @param peer_sig_map  pointer to a peer signature map used to fill the
+ *                      peer_id column, or NULL to leave it unset
+ * @return pointer to a new batch if successful, NULL otherwise
+ *
+ * The peer signature map is borrowed, and must not be destroyed before the
+ * batch.
+ */
+bgpstream_elem_batch_t *
+bgpstream_elem_batch_create(bgpstream_peer_sig_map_t *peer_sig_map);
+
+/** Destroy the given elem batch
+ *
+ * @param batch         pointer to the batch to destroy
+ */
+void bgpstream_elem_batch_destroy(bgpstream_elem_batch_t *batch);
+
+/** Remove all elems from the batch (keeping the allocated memory)
+ *
+ * @param batch         pointer to the batch to clear
+ */
+void bgpstream_elem_batch_clear(bgpstream_elem_batch_t *batch);
+
+/** Add a single elem to the batch
+ *
+ * @param batch         pointer to the batch
+ * @param record        pointer to the record the elem belongs to
+ * @param elem          pointer to the elem to add
+ * @return 0 if the elem was added successfully, -1 otherwise
+ */
+int bgpstream_elem_batch_add_elem(bgpstream_elem_batch_t *batch,
+                                  bgpstream_record_t *record,
+                                  bgpstream_elem_t *elem);
+
+/** Add all the (remaining) elems in the given record to the batch
+ *
+ * @param batch         pointer to the batch
+ * @param record        pointer to the record to extract elems from
+ * @return the number of elems added, or -1 if an error occurred
+ *
+ * The elems are decoded by the format and written straight into the batch
+ * columns, without creating a bgpstream_elem_t copy for each elem. Elems
+ * that do not match the stream filters are skipped, as with
+ * bgpstream_record_get_next_elem.
+ */
+int bgpstream_elem_batch_add_record(bgpstream_elem_batch_t *batch,
+                                    bgpstream_record_t *record);
+
+/** @} */
+
+#endif /* __BGPSTREAM_ELEM_BATCH_H */
@@ -27,6 +27,10 @@
 #include "bgpstream_elem_generator.h"
 #include "utils.h"
 #include <assert.h>
+#include <string.h>
+
+/** Number of elem slots allocated the first time a generator is used */
+#define ELEMS_INIT_ALLOC_CNT 16
 
 struct bgpstream_elem_generator {
 
@@ -104,24 +108,33 @@ bgpstream_elem_t *
 bgpstream_elem_generator_get_new_elem(bgpstream_elem_generator_t *self)
 {
   bgpstream_elem_t *elem = NULL;
+  bgpstream_elem_t **new_elems;
+  int new_alloc_cnt;
 
   /* check if we need to alloc more elems */
-  if (self->elems_cnt + 1 >= self->elems_alloc_cnt) {
-
-    /* alloc more memory */
-    if ((self->elems = realloc(self->elems, sizeof(bgpstream_elem_t *) *
-                                              (self->elems_alloc_cnt + 1))) ==
-        NULL) {
-      return NULL;
-    }
-
-    /* create an elem */
-    if ((self->elems[self->elems_alloc_cnt] = bgpstream_elem_create()) ==
+  if (self->elems_cnt == self->elems_alloc_cnt) {
+
+    /* grow the array geometrically so that populating a generator with n
+       elems only does O(log n) reallocs */
+    new_alloc_cnt = (self->elems_alloc_cnt == 0) ? ELEMS_INIT_ALLOC_CNT
+                                                 : self->elems_alloc_cnt * 2;
+    if ((new_elems = realloc(self->elems,
+                             sizeof(bgpstream_elem_t *) * new_alloc_cnt)) ==
         NULL) {
       return NULL;
     }
+    self->elems = new_elems;
+    memset(&self->elems[self->elems_alloc_cnt], 0,
+           sizeof(bgpstream_elem_t *) *
+             (new_alloc_cnt - self->elems_alloc_cnt));
+    self->elems_alloc_cnt = new_alloc_cnt;
+  }
 
-    self->elems_alloc_cnt++;
+  /* elems are created lazily, and then reused for the life of the
+     generator */
+  if (self->elems[self->elems_cnt] == NULL &&
+      (self->elems[self->elems_cnt] = bgpstream_elem_create()) == NULL) {
+    return NULL;
   }
 
   elem = self->elems[self->elems_cnt];
@@ -55,6 +55,37 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
                                      const bgpstream_elem_t *elem,
                                      int print_type);
 
+/** Get an upper bound on the length of the string representation of the elem
+ *
+ * @param elem          pointer to the elem
+ * @return the maximum number of characters that bgpstream_elem_fmt may write
+ */
+size_t bgpstream_elem_fmt_max_len(const bgpstream_elem_t *elem);
+
+/** Write the string representation of the elem (see bgpstream_utils_fmt.h)
+ *
+ * @param p             pointer to write at, with room for at least
+ *                      bgpstream_elem_fmt_max_len characters
+ * @param elem          pointer to the elem to write
+ * @param print_type    1 to print the elem type, 0 to ignore the elem type
+ * @return pointer to the end of the output, or NULL if the elem is malformed
+ *
+ * This does not include the elem annotations.
+ */
+char *bgpstream_elem_fmt(char *p, const bgpstream_elem_t *elem, int print_type);
+
+/** Write the string representation of the elem annotations (e.g., RPKI
+ * validation results) into the provided buffer
+ *
+ * @param buf           pointer to a char array
+ * @param len           length of the char array
+ * @param elem          pointer to the elem
+ * @return the number of characters that would have been written if len was
+ * large enough (0 if the elem has no annotations)
+ */
+size_t bgpstream_elem_annotations_snprintf(char *buf, size_t len,
+                                           const bgpstream_elem_t *elem);
+
 /** @} */
 
 #endif /* __BGPSTREAM_ELEM_INT_H */
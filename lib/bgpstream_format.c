@@ -32,7 +32,9 @@
 #include "utils.h"
 #include <assert.h>
 
+#include "bs_format_binary.h"
 #include "bs_format_bmp.h"
+#include "bs_format_columnar.h"
 #include "bs_format_mrt.h"
 #include "bs_format_rislive.h"
 
@@ -53,6 +55,10 @@ static const format_create_func_t create_functions[] = {
 
   bs_format_rislive_create,
 
+  bs_format_binary_create,
+
+  bs_format_columnar_create,
+
 };
 
 bgpstream_format_t *bgpstream_format_create(bgpstream_resource_t *res,
@@ -118,6 +124,19 @@ int bgpstream_format_get_next_elem(bgpstream_format_t *format,
   return format->get_next_elem(format, record, elem);
 }
 
+int bgpstream_format_can_fill_elem(bgpstream_format_t *format)
+{
+  return format->fill_next_elem != NULL;
+}
+
+int bgpstream_format_fill_next_elem(bgpstream_format_t *format,
+                                    bgpstream_record_t *record,
+                                    bgpstream_elem_t *elem)
+{
+  assert(record->__int->format == format);
+  return format->fill_next_elem(format, record, elem);
+}
+
 #define DATA(record) ((record)->__int)
 
 int bgpstream_format_init_data(bgpstream_record_t *record)
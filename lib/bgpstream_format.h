@@ -86,6 +86,29 @@ int bgpstream_format_get_next_elem(bgpstream_format_t *format,
                                    bgpstream_record_t *record,
                                    bgpstream_elem_t **elem);
 
+/** Can the given format populate caller-provided elems?
+ *
+ * @param format        pointer to the format object to check
+ * @return 1 if bgpstream_format_fill_next_elem may be used, 0 otherwise
+ */
+int bgpstream_format_can_fill_elem(bgpstream_format_t *format);
+
+/** Populate the given elem with the next elem from the given record
+ *
+ * @param format        pointer to the format object to use
+ * @param record        pointer to the record to use
+ * @param elem          pointer to the elem to populate
+ * @return 1 if the elem was populated, 0 if there are no more elems, -1 if
+ * an error occurred.
+ *
+ * Must only be used if bgpstream_format_can_fill_elem returns 1. The elem may
+ * reference data owned by the record, so it is only valid as long as the
+ * record is.
+ */
+int bgpstream_format_fill_next_elem(bgpstream_format_t *format,
+                                    bgpstream_record_t *record,
+                                    bgpstream_elem_t *elem);
+
 /** Initialize/create the format data in a given record
  *
  * @param record        pointer to the record to init data for
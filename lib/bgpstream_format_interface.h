@@ -100,6 +100,22 @@ struct bgpstream_format {
   int (*get_next_elem)(bgpstream_format_t *format, bgpstream_record_t *record,
                        bgpstream_elem_t **elem);
 
+  /** Populate the given elem with the next elem from the given record
+   * (optional)
+   *
+   * @param format        pointer to the format object to use
+   * @param record        pointer to the record to use
+   * @param elem          pointer to the elem to populate
+   * @return 1 if the elem was populated, 0 if there are no more elems, -1 if
+   * an error occurred.
+   *
+   * Formats that decode each elem independently of the previous ones should
+   * provide this so that bgpstream_record_get_elems can decode straight into
+   * the record's elem pool rather than copying a borrowed elem.
+   */
+  int (*fill_next_elem)(bgpstream_format_t *format, bgpstream_record_t *record,
+                        bgpstream_elem_t *elem);
+
   /** Initialize/create the given format-specific record data
    *
    * @param format      pointer to the format object to use
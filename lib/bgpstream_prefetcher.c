@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_prefetcher.h"
+#include "bgpstream_log.h"
+#include "bs_transport_cache.h"
+#include "khash.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_LEN 1024
+
+enum {
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_DONE,
+};
+
+typedef struct job {
+
+  /** Resource hash (also the key in the jobs table) */
+  char *key;
+
+  /** Our own copy of the resource */
+  bgpstream_resource_t *res;
+
+  /** JOB_QUEUED, JOB_RUNNING or JOB_DONE */
+  int state;
+
+  /** Set if the resource was released while it was being downloaded */
+  int released;
+
+  /** Size of the cache file written by the download */
+  uint64_t bytes;
+
+  /** Next job in the queue */
+  struct job *next;
+
+} job_t;
+
+KHASH_INIT(job, char *, job_t *, 1, kh_str_hash_func, kh_str_hash_equal)
+
+struct bgpstream_prefetcher {
+
+  /** Download threads */
+  pthread_t *threads;
+  int threads_cnt;
+
+  /** Protects everything below */
+  pthread_mutex_t mutex;
+
+  /** Signalled when a job is queued, quota is freed, or we are stopping */
+  pthread_cond_t cond;
+
+  /** All jobs that have not been released, by resource hash */
+  khash_t(job) *jobs;
+
+  /** Jobs waiting for a download thread (oldest first) */
+  job_t *queue_head;
+  job_t *queue_tail;
+
+  /** Disk quota, and the space used by finished, unreleased downloads */
+  uint64_t quota;
+  uint64_t used;
+
+  /** Set when the prefetcher is being destroyed */
+  int shutdown;
+};
+
+static int get_key(char *buf, bgpstream_resource_t *res)
+{
+  if (bgpstream_resource_hash_snprintf(buf, KEY_LEN, res) >= KEY_LEN) {
+    return -1;
+  }
+  return 0;
+}
+
+/* must be called with the mutex held */
+static void job_destroy(bgpstream_prefetcher_t *p, job_t *job)
+{
+  khiter_t k;
+
+  if (job->key != NULL &&
+      (k = kh_get(job, p->jobs, job->key)) != kh_end(p->jobs)) {
+    kh_del(job, p->jobs, k);
+  }
+  free(job->key);
+  if (job->res != NULL) {
+    bgpstream_resource_destroy(job->res);
+  }
+  free(job);
+}
+
+static void *prefetch_thread(void *user)
+{
+  bgpstream_prefetcher_t *p = (bgpstream_prefetcher_t *)user;
+  job_t *job;
+  int64_t rc;
+
+  pthread_mutex_lock(&p->mutex);
+  while (1) {
+    while (p->shutdown == 0 &&
+           (p->queue_head == NULL || p->used >= p->quota)) {
+      pthread_cond_wait(&p->cond, &p->mutex);
+    }
+    if (p->shutdown != 0) {
+      break;
+    }
+
+    job = p->queue_head;
+    if ((p->queue_head = job->next) == NULL) {
+      p->queue_tail = NULL;
+    }
+    job->next = NULL;
+    job->state = JOB_RUNNING;
+    pthread_mutex_unlock(&p->mutex);
+
+    rc = bs_transport_cache_prefetch(job->res, &p->shutdown);
+    if (rc > 0) {
+      bgpstream_log(BGPSTREAM_LOG_FINE, "prefetched %s (%" PRIi64 " bytes)",
+                    job->res->url, rc);
+    }
+
+    pthread_mutex_lock(&p->mutex);
+    if (job->released != 0) {
+      job_destroy(p, job);
+    } else {
+      job->state = JOB_DONE;
+      if (rc > 0) {
+        job->bytes = rc;
+        p->used += rc;
+      }
+    }
+  }
+  pthread_mutex_unlock(&p->mutex);
+
+  return NULL;
+}
+
+/* ========== PUBLIC FUNCTIONS BELOW HERE ========== */
+
+bgpstream_prefetcher_t *bgpstream_prefetcher_create(int threads,
+                                                    uint64_t quota)
+{
+  bgpstream_prefetcher_t *p;
+
+  if ((p = malloc_zero(sizeof(bgpstream_prefetcher_t))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->cond, NULL);
+  p->quota = quota;
+
+  if ((p->jobs = kh_init(job)) == NULL ||
+      (p->threads = malloc(sizeof(pthread_t) * threads)) == NULL) {
+    goto err;
+  }
+
+  for (p->threads_cnt = 0; p->threads_cnt < threads; p->threads_cnt++) {
+    if (pthread_create(&p->threads[p->threads_cnt], NULL, prefetch_thread,
+                       p) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not start prefetch thread");
+      goto err;
+    }
+  }
+
+  return p;
+
+err:
+  bgpstream_prefetcher_destroy(p);
+  return NULL;
+}
+
+int bgpstream_prefetcher_add(bgpstream_prefetcher_t *p,
+                             bgpstream_resource_t *res)
+{
+  char key[KEY_LEN];
+  job_t *job = NULL;
+  khiter_t k;
+  int khret;
+
+  if (get_key(key, res) != 0) {
+    return 0; // can't be cached anyway
+  }
+
+  pthread_mutex_lock(&p->mutex);
+  if (kh_get(job, p->jobs, key) != kh_end(p->jobs)) {
+    pthread_mutex_unlock(&p->mutex);
+    return 0;
+  }
+
+  if ((job = malloc_zero(sizeof(job_t))) == NULL ||
+      (job->key = strdup(key)) == NULL ||
+      (job->res = bgpstream_resource_copy(res)) == NULL) {
+    goto err;
+  }
+  k = kh_put(job, p->jobs, job->key, &khret);
+  if (khret < 0) {
+    goto err;
+  }
+  kh_val(p->jobs, k) = job;
+
+  job->state = JOB_QUEUED;
+  if (p->queue_tail != NULL) {
+    p->queue_tail->next = job;
+  } else {
+    p->queue_head = job;
+  }
+  p->queue_tail = job;
+  pthread_cond_signal(&p->cond);
+  pthread_mutex_unlock(&p->mutex);
+
+  return 1;
+
+err:
+  if (job != NULL) {
+    job_destroy(p, job);
+  }
+  pthread_mutex_unlock(&p->mutex);
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not queue prefetch of %s", res->url);
+  return -1;
+}
+
+void bgpstream_prefetcher_release(bgpstream_prefetcher_t *p,
+                                  bgpstream_resource_t *res)
+{
+  char key[KEY_LEN];
+  job_t *job, *prev;
+  khiter_t k;
+
+  if (get_key(key, res) != 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&p->mutex);
+  if ((k = kh_get(job, p->jobs, key)) == kh_end(p->jobs)) {
+    pthread_mutex_unlock(&p->mutex);
+    return;
+  }
+  job = kh_val(p->jobs, k);
+
+  switch (job->state) {
+  case JOB_QUEUED:
+    // too late to prefetch, the reader will download it itself
+    if (p->queue_head == job) {
+      p->queue_head = job->next;
+      prev = NULL;
+    } else {
+      for (prev = p->queue_head; prev->next != job; prev = prev->next)
+        ;
+      prev->next = job->next;
+    }
+    if (p->queue_tail == job) {
+      p->queue_tail = prev;
+    }
+    job_destroy(p, job);
+    break;
+
+  case JOB_RUNNING:
+    // the download thread cleans up when it is done
+    job->released = 1;
+    break;
+
+  case JOB_DONE:
+    p->used -= job->bytes;
+    job_destroy(p, job);
+    pthread_cond_broadcast(&p->cond);
+    break;
+  }
+
+  pthread_mutex_unlock(&p->mutex);
+}
+
+void bgpstream_prefetcher_destroy(bgpstream_prefetcher_t *p)
+{
+  khiter_t k;
+  int i;
+
+  if (p == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&p->mutex);
+  __atomic_store_n(&p->shutdown, 1, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->mutex);
+
+  for (i = 0; i < p->threads_cnt; i++) {
+    pthread_join(p->threads[i], NULL);
+  }
+  free(p->threads);
+  p->threads = NULL;
+
+  if (p->jobs != NULL) {
+    for (k = kh_begin(p->jobs); k != kh_end(p->jobs); ++k) {
+      if (kh_exist(p->jobs, k)) {
+        job_destroy(p, kh_val(p->jobs, k));
+      }
+    }
+    kh_destroy(job, p->jobs);
+    p->jobs = NULL;
+  }
+
+  pthread_mutex_destroy(&p->mutex);
+  pthread_cond_destroy(&p->cond);
+  free(p);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_PREFETCHER_H
+#define __BGPSTREAM_PREFETCHER_H
+
+#include "bgpstream_resource.h"
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the cache prefetcher, which downloads
+ * resources that will soon be read into the local cache on a pool of
+ * background threads.
+ *
+ * The resource manager adds the (cache transport) resources of the groups
+ * after the batch that it is reading, and releases each resource when it
+ * opens it. Downloads that have finished but whose resources have not yet
+ * been opened are counted against a disk quota, and no new downloads are
+ * started while the quota is used up.
+ */
+
+/** Default number of resource groups to prefetch ahead of the reader */
+#define BGPSTREAM_PREFETCHER_GROUPS_DEFAULT 8
+
+/** Default number of concurrent downloads */
+#define BGPSTREAM_PREFETCHER_THREADS_DEFAULT 4
+
+/** Default disk quota for prefetched files (in bytes) */
+#define BGPSTREAM_PREFETCHER_QUOTA_DEFAULT (1024 * 1024 * 1024)
+
+/** Opaque struct representing a prefetcher */
+typedef struct bgpstream_prefetcher bgpstream_prefetcher_t;
+
+/** Create a prefetcher
+ *
+ * @param threads       number of concurrent downloads
+ * @param quota         maximum number of bytes of prefetched files that have
+ *                      not yet been released
+ * @return pointer to the prefetcher if successful, NULL otherwise
+ */
+bgpstream_prefetcher_t *bgpstream_prefetcher_create(int threads,
+                                                    uint64_t quota);
+
+/** Queue a resource to be downloaded into the local cache
+ *
+ * @param p             pointer to the prefetcher
+ * @param res           borrowed pointer to the resource (it is copied)
+ * @return 1 if the resource was queued, 0 if it is already known to the
+ * prefetcher, -1 if an error occurred
+ */
+int bgpstream_prefetcher_add(bgpstream_prefetcher_t *p,
+                             bgpstream_resource_t *res);
+
+/** Tell the prefetcher that a resource is about to be opened
+ *
+ * @param p             pointer to the prefetcher
+ * @param res           borrowed pointer to the resource
+ *
+ * A queued download of the resource is cancelled, and the space used by a
+ * finished download is returned to the quota.
+ */
+void bgpstream_prefetcher_release(bgpstream_prefetcher_t *p,
+                                  bgpstream_resource_t *res);
+
+/** Stop all downloads and destroy the prefetcher
+ *
+ * @param p             pointer to the prefetcher
+ *
+ * Downloads in progress are abandoned (their temporary files are removed).
+ */
+void bgpstream_prefetcher_destroy(bgpstream_prefetcher_t *p);
+
+#endif /* __BGPSTREAM_PREFETCHER_H */
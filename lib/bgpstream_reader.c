@@ -25,16 +25,24 @@
  */
 
 #include "bgpstream_reader.h"
+#include "bgpstream_format_interface.h"
 #include "bgpstream_record_int.h"
 #include "bgpstream_log.h"
 #include "utils.h"
 #include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #define DUMP_OPEN_MAX_RETRIES 5
 #define DUMP_OPEN_MIN_RETRY_WAIT 10
 
+/* how often the decode worker polls a transport that cannot signal when data
+ * arrives (in msec) */
+#define DECODE_POLL_INTERVAL 100
+
 #define PREFETCH_IDX (reader->rec_buf_prefetch_idx)
 #define EXPORTED_IDX ((reader->rec_buf_prefetch_idx + 1) % 2)
 
@@ -75,8 +83,177 @@ struct bgpstream_reader {
 
   // what is the time of the next record (PREFETCH)
   uint32_t next_time;
+
+  // RECORD POOL (only used when records may be retained)
+
+  // can exported records be retained?
+  int retain;
+
+  // protects the fields below (records may be released from any thread)
+  pthread_mutex_t pool_mutex;
+
+  // list of records that are ready for reuse
+  bgpstream_record_t *pool_free;
+
+  // number of records that the reader has handed off to the user (i.e.,
+  // that are neither in rec_buf nor pool_free)
+  int pool_outstanding;
+
+  // has bgpstream_reader_destroy been called?
+  int destroyed;
+
+  // DECODE WORKER (only used for resources with a decode queue, in which
+  // case the opener thread goes on to decode records, and rec_buf is unused.
+  // all records are then reference counted using the pool.)
+
+  // maximum number of decoded records to queue (0 if the caller decodes)
+  int dq_len;
+
+  // protects the fields below
+  pthread_mutex_t dq_mutex;
+
+  // signalled when a queue slot is freed, or the worker should stop, and
+  // (for non-stream resources) when a record is queued, or the worker is
+  // done. the queue cannot be both full and empty, so only one thread ever
+  // waits.
+  pthread_cond_t dq_cond;
+
+  // ring of decoded records
+  bgpstream_record_t **dq;
+  int dq_head;
+  int dq_cnt;
+
+  // has the worker stopped decoding? (status is set before it does)
+  int dq_done;
+
+  // did the dump end right after the last queued record?
+  int dq_end_pos;
+
+  // should the worker stop?
+  int dq_stop;
+
+  // written to when a record is queued while the queue is empty (or the
+  // worker is done)
+  int dq_pipe[2];
+
+  // written to when the worker should stop
+  int dq_stop_pipe[2];
+
+  // the record most recently given to the caller (we hold a reference until
+  // the next call)
+  bgpstream_record_t *dq_exported;
 };
 
+static int prepopulate_record(bgpstream_record_t *record,
+                              bgpstream_resource_t *res);
+
+static bgpstream_record_t *create_record(bgpstream_reader_t *reader)
+{
+  bgpstream_record_t *record;
+
+  if ((record = bgpstream_record_create(reader->format)) == NULL) {
+    return NULL;
+  }
+  if (prepopulate_record(record, reader->res) != 0) {
+    bgpstream_record_destroy(record);
+    return NULL;
+  }
+  if (reader->retain != 0) {
+    record->__int->reader = reader;
+    record->__int->refcnt = 1;
+  }
+  return record;
+}
+
+// actually free the reader and all of its records
+static void reader_free(bgpstream_reader_t *reader)
+{
+  bgpstream_record_t *record;
+  int i;
+
+  pthread_mutex_destroy(&reader->mutex);
+  pthread_cond_destroy(&reader->dump_ready_cond);
+  pthread_mutex_destroy(&reader->pool_mutex);
+  pthread_mutex_destroy(&reader->dq_mutex);
+  pthread_cond_destroy(&reader->dq_cond);
+
+  free(reader->dq);
+  for (i = 0; i < 2; i++) {
+    if (reader->dq_pipe[i] != -1) {
+      close(reader->dq_pipe[i]);
+    }
+    if (reader->dq_stop_pipe[i] != -1) {
+      close(reader->dq_stop_pipe[i]);
+    }
+  }
+
+  for (i = 0; i < 2; i++) {
+    bgpstream_record_destroy(reader->rec_buf[i]);
+    reader->rec_buf[i] = NULL;
+  }
+
+  while ((record = reader->pool_free) != NULL) {
+    reader->pool_free = record->__int->pool_next;
+    bgpstream_record_destroy(record);
+  }
+
+  // records must be destroyed before the format they belong to
+  bgpstream_format_destroy(reader->format);
+
+  free(reader);
+}
+
+// drop a reference to a record, returning it to the pool if it was the last
+static void record_unref(bgpstream_reader_t *reader,
+                         bgpstream_record_t *record)
+{
+  int free_reader;
+
+  if (__atomic_sub_fetch(&record->__int->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&reader->pool_mutex);
+  record->__int->pool_next = reader->pool_free;
+  reader->pool_free = record;
+  reader->pool_outstanding--;
+  free_reader = (reader->destroyed != 0 && reader->pool_outstanding == 0);
+  pthread_mutex_unlock(&reader->pool_mutex);
+
+  if (free_reader != 0) {
+    reader_free(reader);
+  }
+}
+
+// hand off the record in the given buffer (which the user has retained), and
+// replace it with a free one
+static bgpstream_record_t *swap_record(bgpstream_reader_t *reader, int idx)
+{
+  bgpstream_record_t *record = reader->rec_buf[idx];
+
+  pthread_mutex_lock(&reader->pool_mutex);
+  reader->pool_outstanding++;
+  pthread_mutex_unlock(&reader->pool_mutex);
+  record_unref(reader, record);
+
+  pthread_mutex_lock(&reader->pool_mutex);
+  if ((record = reader->pool_free) != NULL) {
+    reader->pool_free = record->__int->pool_next;
+    record->__int->pool_next = NULL;
+    record->__int->refcnt = 1;
+  }
+  pthread_mutex_unlock(&reader->pool_mutex);
+
+  if (record == NULL && (record = create_record(reader)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create record");
+    reader->rec_buf[idx] = NULL;
+    return NULL;
+  }
+
+  reader->rec_buf[idx] = record;
+  return record;
+}
+
 static int prefetch_record(bgpstream_reader_t *reader)
 {
   bgpstream_record_t *record;
@@ -85,6 +262,13 @@ static int prefetch_record(bgpstream_reader_t *reader)
 
   record = reader->rec_buf[PREFETCH_IDX];
 
+  // if the user is still holding on to this record, use another one
+  if (reader->retain != 0 &&
+      __atomic_load_n(&record->__int->refcnt, __ATOMIC_ACQUIRE) > 1 &&
+      (record = swap_record(reader, PREFETCH_IDX)) == NULL) {
+    return -1;
+  }
+
   // first, clear up our record
   // note that this only destroys the reader struct and resets the elem
   // generator. it does not clear the collector name etc as we reuse that.
@@ -154,6 +338,245 @@ static int prepopulate_record(bgpstream_record_t *record,
   return 0;
 }
 
+/* ========== DECODE WORKER ========== */
+
+static int dq_init(bgpstream_reader_t *reader)
+{
+  const char *len;
+  int i;
+
+  if ((len = bgpstream_resource_get_attr(
+         reader->res, BGPSTREAM_RESOURCE_ATTR_DECODE_QUEUE_LEN)) == NULL ||
+      (reader->dq_len = atoi(len)) <= 0) {
+    reader->dq_len = 0;
+    return 0;
+  }
+
+  if ((reader->dq = malloc(sizeof(bgpstream_record_t *) * reader->dq_len)) ==
+        NULL ||
+      pipe(reader->dq_pipe) != 0 || pipe(reader->dq_stop_pipe) != 0) {
+    return -1;
+  }
+  for (i = 0; i < 2; i++) {
+    if (fcntl(reader->dq_pipe[i], F_SETFL,
+              fcntl(reader->dq_pipe[i], F_GETFL) | O_NONBLOCK) != 0 ||
+        fcntl(reader->dq_stop_pipe[i], F_SETFL,
+              fcntl(reader->dq_stop_pipe[i], F_GETFL) | O_NONBLOCK) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void dq_notify(int fd)
+{
+  // if the pipe is full, a wakeup is already pending
+  if (write(fd, "", 1) < 0) {
+    return;
+  }
+}
+
+static void dq_drain(int fd)
+{
+  char buf[64];
+
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+}
+
+// get a record to decode into, either from the pool, or a new one
+static bgpstream_record_t *dq_get_record(bgpstream_reader_t *reader)
+{
+  bgpstream_record_t *record;
+
+  pthread_mutex_lock(&reader->pool_mutex);
+  if ((record = reader->pool_free) != NULL) {
+    reader->pool_free = record->__int->pool_next;
+    record->__int->pool_next = NULL;
+  }
+  pthread_mutex_unlock(&reader->pool_mutex);
+
+  if (record == NULL && (record = create_record(reader)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create record");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&reader->pool_mutex);
+  reader->pool_outstanding++;
+  pthread_mutex_unlock(&reader->pool_mutex);
+  record->__int->refcnt = 1;
+
+  return record;
+}
+
+// block until the transport may have data, or we are asked to stop
+static void dq_wait_for_data(bgpstream_reader_t *reader)
+{
+  struct pollfd fds[2];
+  int nfds = 0;
+  int fd;
+
+  fds[nfds].fd = reader->dq_stop_pipe[0];
+  fds[nfds++].events = POLLIN;
+  if ((fd = bgpstream_transport_get_fd(reader->format->transport)) >= 0) {
+    fds[nfds].fd = fd;
+    fds[nfds++].events = POLLIN;
+  }
+
+  poll(fds, nfds, (fd >= 0) ? -1 : DECODE_POLL_INTERVAL);
+}
+
+// non-stream resources are not ready until their first record (if any) is
+// decoded, so that the resource manager knows when they start
+static void dq_set_ready(bgpstream_reader_t *reader, bgpstream_record_t *first)
+{
+  pthread_mutex_lock(&reader->mutex);
+  if (reader->dump_ready == 0) {
+    if (first != NULL) {
+      reader->next_time = first->time_sec;
+    }
+    reader->dump_ready = 1;
+    pthread_cond_signal(&reader->dump_ready_cond);
+  }
+  pthread_mutex_unlock(&reader->mutex);
+}
+
+static void dq_worker(bgpstream_reader_t *reader)
+{
+  bgpstream_format_status_t status = BGPSTREAM_FORMAT_OK;
+  bgpstream_record_t *record;
+  int stream = (reader->res->duration == BGPSTREAM_FOREVER);
+  int stop;
+
+  while (1) {
+    // wait for a free slot in the queue
+    pthread_mutex_lock(&reader->dq_mutex);
+    while (reader->dq_cnt == reader->dq_len && reader->dq_stop == 0) {
+      pthread_cond_wait(&reader->dq_cond, &reader->dq_mutex);
+    }
+    stop = reader->dq_stop;
+    pthread_mutex_unlock(&reader->dq_mutex);
+    if (stop != 0) {
+      break;
+    }
+
+    if ((record = dq_get_record(reader)) == NULL) {
+      status = BGPSTREAM_FORMAT_UNKNOWN_ERROR;
+      break;
+    }
+    bgpstream_record_clear(record);
+    status = bgpstream_format_populate_record(reader->format, record);
+
+    // for stream resources, these just mean there is no data yet
+    if (stream != 0 && (status == BGPSTREAM_FORMAT_END_OF_DUMP ||
+                        status == BGPSTREAM_FORMAT_FILTERED_DUMP ||
+                        status == BGPSTREAM_FORMAT_EMPTY_DUMP ||
+                        status == BGPSTREAM_FORMAT_CORRUPTED_DUMP)) {
+      status = BGPSTREAM_FORMAT_OK;
+      record_unref(reader, record);
+      dq_wait_for_data(reader);
+      continue;
+    }
+    if (status == BGPSTREAM_FORMAT_CORRUPTED_MSG ||
+        status == BGPSTREAM_FORMAT_UNSUPPORTED_MSG) {
+      status = BGPSTREAM_FORMAT_OK;
+    }
+
+    // we export a meta record for every status except end of dump
+    if (status == BGPSTREAM_FORMAT_END_OF_DUMP) {
+      reader->dq_end_pos = (record->dump_pos == BGPSTREAM_DUMP_END);
+      record_unref(reader, record);
+      break;
+    }
+
+    // queue the record
+    pthread_mutex_lock(&reader->dq_mutex);
+    reader->dq[(reader->dq_head + reader->dq_cnt) % reader->dq_len] = record;
+    if (++reader->dq_cnt == 1) {
+      dq_notify(reader->dq_pipe[1]);
+      pthread_cond_signal(&reader->dq_cond);
+    }
+    pthread_mutex_unlock(&reader->dq_mutex);
+    dq_set_ready(reader, record);
+
+    if (status != BGPSTREAM_FORMAT_OK) {
+      break;
+    }
+  }
+
+  pthread_mutex_lock(&reader->dq_mutex);
+  reader->status = status;
+  reader->dq_done = 1;
+  dq_notify(reader->dq_pipe[1]);
+  pthread_cond_signal(&reader->dq_cond);
+  pthread_mutex_unlock(&reader->dq_mutex);
+  dq_set_ready(reader, NULL);
+}
+
+static bgpstream_reader_status_t dq_get_next_record(bgpstream_reader_t *reader,
+                                                    bgpstream_record_t **record)
+{
+  int done;
+
+  // the caller is done with the previous record
+  if (reader->dq_exported != NULL) {
+    record_unref(reader, reader->dq_exported);
+    reader->dq_exported = NULL;
+  }
+
+  pthread_mutex_lock(&reader->dq_mutex);
+  if (reader->dq_cnt == 0) {
+    // the worker notifies while holding the mutex, so no wakeup is lost
+    dq_drain(reader->dq_pipe[0]);
+    done = reader->dq_done;
+    pthread_mutex_unlock(&reader->dq_mutex);
+    return (done != 0) ? BGPSTREAM_READER_STATUS_EOS
+                       : BGPSTREAM_READER_STATUS_AGAIN;
+  }
+
+  *record = reader->dq[reader->dq_head];
+  reader->dq_head = (reader->dq_head + 1) % reader->dq_len;
+  reader->dq_cnt--;
+  pthread_cond_signal(&reader->dq_cond);
+
+  // a non-stream resource always knows the time of its next record (like the
+  // prefetch record), so wait for it to be decoded
+  if (reader->res->duration != BGPSTREAM_FOREVER) {
+    while (reader->dq_cnt == 0 && reader->dq_done == 0) {
+      pthread_cond_wait(&reader->dq_cond, &reader->dq_mutex);
+    }
+    if (reader->dq_cnt == 0 && reader->dq_end_pos != 0) {
+      (*record)->dump_pos = BGPSTREAM_DUMP_END;
+    }
+  }
+
+  // the queue is sorted on the time of the next record, if we know it
+  reader->next_time = (reader->dq_cnt > 0)
+                        ? reader->dq[reader->dq_head]->time_sec
+                        : (*record)->time_sec;
+  pthread_mutex_unlock(&reader->dq_mutex);
+
+  reader->dq_exported = *record;
+  return BGPSTREAM_READER_STATUS_OK;
+}
+
+// the status of the reader, which the decode worker (if any) sets
+static bgpstream_format_status_t get_status(bgpstream_reader_t *reader)
+{
+  bgpstream_format_status_t status;
+
+  if (reader->dq_len == 0) {
+    return reader->status;
+  }
+  pthread_mutex_lock(&reader->dq_mutex);
+  status = reader->status;
+  pthread_mutex_unlock(&reader->dq_mutex);
+  return status;
+}
+
+/* ========== OPENER ========== */
+
 static void *threaded_opener(void *user)
 {
   bgpstream_reader_t *reader = (bgpstream_reader_t *)user;
@@ -182,12 +605,10 @@ static void *threaded_opener(void *user)
                   "Could not open dumpfile (%s) after %d attempts. Giving up.",
                   reader->res->url, DUMP_OPEN_MAX_RETRIES);
     reader->status = BGPSTREAM_FORMAT_CANT_OPEN_DUMP;
-  } else {
+  } else if (reader->dq_len == 0) {
     // create the pair of records
     for (i = 0; i < 2; i++) {
-      if ((reader->rec_buf[i] = bgpstream_record_create(reader->format)) ==
-            NULL ||
-          prepopulate_record(reader->rec_buf[i], reader->res) != 0) {
+      if ((reader->rec_buf[i] = create_record(reader)) == NULL) {
         reader->status = BGPSTREAM_FORMAT_CANT_OPEN_DUMP;
         break;
       }
@@ -199,17 +620,27 @@ static void *threaded_opener(void *user)
       prefetch_record(reader);
     }
   }
-  reader->dump_ready = 1;
-  pthread_cond_signal(&reader->dump_ready_cond);
+  // the decode worker decides when a non-stream resource is ready
+  if (reader->dq_len == 0 || reader->res->duration == BGPSTREAM_FOREVER ||
+      reader->status == BGPSTREAM_FORMAT_CANT_OPEN_DUMP) {
+    reader->dump_ready = 1;
+    pthread_cond_signal(&reader->dump_ready_cond);
+  }
   pthread_mutex_unlock(&reader->mutex);
 
+  // stay around to decode records if needed
+  if (reader->dq_len > 0 && reader->status != BGPSTREAM_FORMAT_CANT_OPEN_DUMP) {
+    dq_worker(reader);
+  }
+
   return NULL;
 }
 
 /* ========== PUBLIC FUNCTIONS BELOW ========== */
 
 bgpstream_reader_t *bgpstream_reader_create(bgpstream_resource_t *resource,
-                                            bgpstream_filter_mgr_t *filter_mgr)
+                                            bgpstream_filter_mgr_t *filter_mgr,
+                                            int retain_records)
 {
   bgpstream_reader_t *reader;
 
@@ -220,11 +651,24 @@ bgpstream_reader_t *bgpstream_reader_create(bgpstream_resource_t *resource,
   reader->res = resource;
   reader->filter_mgr = filter_mgr;
   reader->status = BGPSTREAM_FORMAT_OK;
+  reader->retain = retain_records;
+  pthread_mutex_init(&reader->mutex, NULL);
+  pthread_cond_init(&reader->dump_ready_cond, NULL);
+  pthread_mutex_init(&reader->pool_mutex, NULL);
+  pthread_mutex_init(&reader->dq_mutex, NULL);
+  pthread_cond_init(&reader->dq_cond, NULL);
+  reader->dq_pipe[0] = reader->dq_pipe[1] = -1;
+  reader->dq_stop_pipe[0] = reader->dq_stop_pipe[1] = -1;
+
+  if (dq_init(reader) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create decode queue for %s",
+                  resource->url);
+    reader_free(reader);
+    return NULL;
+  }
 
   // initialize and start the thread to open the resource
   // this will also pre-fetch the first record
-  pthread_mutex_init(&reader->mutex, NULL);
-  pthread_cond_init(&reader->dump_ready_cond, NULL);
   reader->dump_ready = 0;
   reader->skip_dump_check = 0;
   pthread_create(&reader->opener_thread, NULL, threaded_opener, reader);
@@ -238,26 +682,93 @@ uint32_t bgpstream_reader_get_next_time(bgpstream_reader_t *reader)
   return reader->next_time;
 }
 
+int bgpstream_reader_get_fd(bgpstream_reader_t *reader)
+{
+  if (bgpstream_reader_open_wait(reader) != 0 ||
+      get_status(reader) != BGPSTREAM_FORMAT_OK) {
+    return -1;
+  }
+  if (reader->dq_len > 0) {
+    return reader->dq_pipe[0];
+  }
+  return bgpstream_transport_get_fd(reader->format->transport);
+}
+
 void bgpstream_reader_destroy(bgpstream_reader_t *reader)
 {
+  bgpstream_record_t *record;
+  int free_reader;
+  int i;
+
   if (reader == NULL) {
     return;
   }
 
+  // stop the decode worker
+  if (reader->dq_len > 0) {
+    pthread_mutex_lock(&reader->dq_mutex);
+    reader->dq_stop = 1;
+    pthread_cond_signal(&reader->dq_cond);
+    pthread_mutex_unlock(&reader->dq_mutex);
+    dq_notify(reader->dq_stop_pipe[1]);
+  }
+
   // Ensure the thread is done
   pthread_join(reader->opener_thread, NULL);
-  pthread_mutex_destroy(&reader->mutex);
-  pthread_cond_destroy(&reader->dump_ready_cond);
 
-  int i;
+  if (reader->retain == 0 && reader->dq_len == 0) {
+    reader_free(reader);
+    return;
+  }
+
+  // hand off our own records too, and hold an extra reference on the reader
+  // until we are done here
+  pthread_mutex_lock(&reader->pool_mutex);
+  reader->destroyed = 1;
+  reader->pool_outstanding++;
   for (i = 0; i < 2; i++) {
-    bgpstream_record_destroy(reader->rec_buf[i]);
-    reader->rec_buf[i] = NULL;
+    if (reader->rec_buf[i] != NULL) {
+      reader->pool_outstanding++;
+    }
   }
+  pthread_mutex_unlock(&reader->pool_mutex);
 
-  bgpstream_format_destroy(reader->format);
+  for (i = 0; i < 2; i++) {
+    if ((record = reader->rec_buf[i]) != NULL) {
+      reader->rec_buf[i] = NULL;
+      record_unref(reader, record);
+    }
+  }
 
-  free(reader);
+  // records owned by the decode queue are already counted as outstanding
+  for (; reader->dq_cnt > 0; reader->dq_cnt--) {
+    record_unref(reader, reader->dq[reader->dq_head]);
+    reader->dq_head = (reader->dq_head + 1) % reader->dq_len;
+  }
+  if (reader->dq_exported != NULL) {
+    record_unref(reader, reader->dq_exported);
+    reader->dq_exported = NULL;
+  }
+
+  pthread_mutex_lock(&reader->pool_mutex);
+  free_reader = (--reader->pool_outstanding == 0);
+  if (free_reader == 0 && reader->format != NULL) {
+    // some records are still retained, so the format must stay around until
+    // they are released, but we are done reading from the resource
+    bgpstream_transport_destroy(reader->format->transport);
+    reader->format->transport = NULL;
+  }
+  pthread_mutex_unlock(&reader->pool_mutex);
+
+  if (free_reader != 0) {
+    reader_free(reader);
+  }
+}
+
+void bgpstream_reader_release_record(bgpstream_reader_t *reader,
+                                     bgpstream_record_t *record)
+{
+  record_unref(reader, record);
 }
 
 int bgpstream_reader_open_wait(bgpstream_reader_t *reader)
@@ -272,7 +783,7 @@ int bgpstream_reader_open_wait(bgpstream_reader_t *reader)
   }
   pthread_mutex_unlock(&reader->mutex);
 
-  if (reader->status == BGPSTREAM_FORMAT_CANT_OPEN_DUMP) {
+  if (get_status(reader) == BGPSTREAM_FORMAT_CANT_OPEN_DUMP) {
     return -1;
   }
 
@@ -285,6 +796,10 @@ int bgpstream_reader_get_next_record(bgpstream_reader_t *reader,
 {
   // DO NOT use the prefetch record before open_wait!
 
+  if (reader->dq_len > 0 && bgpstream_reader_open_wait(reader) == 0) {
+    return dq_get_next_record(reader, record);
+  }
+
   if (bgpstream_reader_open_wait(reader) != 0) {
     // cant even open the dump file
     // we're not going to last long, but we should return the record saying
@@ -50,9 +50,16 @@ typedef enum {
 
 } bgpstream_reader_status_t;
 
-/** Create a new reader for the given resource */
+/** Create a new reader for the given resource
+ *
+ * If retain_records is set, exported records are reference counted and may be
+ * retained by the user beyond the next call to get_next_record. The reader
+ * then keeps a pool of records, and is only fully destroyed once all
+ * retained records have been released.
+ */
 bgpstream_reader_t *bgpstream_reader_create(bgpstream_resource_t *resource,
-                                            bgpstream_filter_mgr_t *filter_mgr);
+                                            bgpstream_filter_mgr_t *filter_mgr,
+                                            int retain_records);
 
 /** Get the time of the next record available in the reader
  *
@@ -64,6 +71,17 @@ uint32_t bgpstream_reader_get_next_time(bgpstream_reader_t *reader);
 /** Block until the resource has opened */
 int bgpstream_reader_open_wait(bgpstream_reader_t *reader);
 
+/** Get a file descriptor that signals when the reader may have more data
+ *
+ * @param reader        pointer to a reader instance
+ * @return a descriptor that becomes readable once a reader that returned
+ * AGAIN may have a record, or -1 if the underlying transport cannot provide
+ * one (in which case the reader must be polled)
+ *
+ * The descriptor is owned by the reader.
+ */
+int bgpstream_reader_get_fd(bgpstream_reader_t *reader);
+
 /** Destroy the given reader */
 void bgpstream_reader_destroy(bgpstream_reader_t *reader);
 
@@ -82,4 +100,8 @@ bgpstream_reader_status_t
 bgpstream_reader_get_next_record(bgpstream_reader_t *reader,
                                  bgpstream_record_t **record);
 
+/** Drop a reference to a record exported by the reader (retain mode only) */
+void bgpstream_reader_release_record(bgpstream_reader_t *reader,
+                                     bgpstream_record_t *record);
+
 #endif /* __BGPSTREAM_READER_H */
@@ -34,6 +34,9 @@
 #include "bgpstream_format_interface.h" // to access filter mgr
 #include "bgpstream_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_reader.h"
+#include "bgpstream_utils_as_path_int.h"
+#include "bgpstream_utils_fmt.h"
 #include "utils.h"
 #include <assert.h>
 #include <inttypes.h>
@@ -67,6 +70,9 @@ void bgpstream_record_destroy(bgpstream_record_t *record)
 
   bgpstream_format_destroy_data(record);
 
+  if (record->__int != NULL) {
+    bgpstream_elem_generator_destroy(record->__int->elem_pool);
+  }
   free(record->__int);
   free(record);
 }
@@ -78,11 +84,37 @@ void bgpstream_record_clear(bgpstream_record_t *record)
 {
   bgpstream_format_clear_data(record);
 
+  // elems returned by get_elems belong to the previous record
+  if (record->__int->elem_pool != NULL) {
+    bgpstream_elem_generator_clear(record->__int->elem_pool);
+  }
+
   // reset the record timestamps
   record->time_sec = 0;
   record->time_usec = 0;
 }
 
+int bgpstream_record_retain(bgpstream_record_t *record)
+{
+  if (record->__int->reader == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Records can only be retained in record retain mode");
+    return -1;
+  }
+
+  __atomic_add_fetch(&record->__int->refcnt, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+void bgpstream_record_release(bgpstream_record_t *record)
+{
+  if (record == NULL || record->__int->reader == NULL) {
+    return;
+  }
+
+  bgpstream_reader_release_record(record->__int->reader, record);
+}
+
 static bgpstream_patricia_walk_cb_result_t pfx_exists(
     const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
     void *data)
@@ -255,22 +287,16 @@ static int elem_check_filters(bgpstream_record_t *record,
   return 1;
 }
 
-int bgpstream_record_get_next_elem(bgpstream_record_t *record,
-                                   bgpstream_elem_t **elemp)
+/* Get the next elem that passes the filters (or end-of-elems/error) */
+static int get_next_filtered_elem(bgpstream_record_t *record,
+                                  bgpstream_elem_t **elemp)
 {
-  int rc;
+  bgpstream_format_t *format = record->__int->format;
   bgpstream_elem_t *elem = NULL;
-  *elemp = NULL;
-
-  if (record == NULL ||
-      record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD ||
-      record->__int->format == NULL) {
-    return 0; // treat as end-of-elems
-  }
+  int rc;
 
   while (elem == NULL) {
-    if ((rc = bgpstream_format_get_next_elem(record->__int->format, record,
-                                             &elem)) <= 0) {
+    if ((rc = bgpstream_format_get_next_elem(format, record, &elem)) <= 0) {
       // either error or end-of-elems
       return rc;
     }
@@ -284,6 +310,124 @@ int bgpstream_record_get_next_elem(bgpstream_record_t *record,
   return 1;
 }
 
+/* Populate the given elem with the next elem that passes the filters (or
+ * end-of-elems/error). Only for formats that can fill caller-provided elems */
+static int fill_next_filtered_elem(bgpstream_record_t *record,
+                                   bgpstream_elem_t *elem)
+{
+  bgpstream_format_t *format = record->__int->format;
+  int rc;
+
+  while ((rc = bgpstream_format_fill_next_elem(format, record, elem)) > 0) {
+    if (elem_check_filters(record, elem) != 0) {
+      return 1;
+    }
+  }
+
+  // either error or end-of-elems
+  return rc;
+}
+
+static int record_has_elems(bgpstream_record_t *record)
+{
+  return record != NULL &&
+         record->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD &&
+         record->__int->format != NULL;
+}
+
+int bgpstream_record_get_next_elem(bgpstream_record_t *record,
+                                   bgpstream_elem_t **elemp)
+{
+  *elemp = NULL;
+
+  if (record_has_elems(record) == 0) {
+    return 0; // treat as end-of-elems
+  }
+
+  return get_next_filtered_elem(record, elemp);
+}
+
+int bgpstream_record_get_elems(bgpstream_record_t *record,
+                               bgpstream_elem_t **elems, int elems_max)
+{
+  bgpstream_elem_generator_t *pool;
+  bgpstream_elem_t *elem;
+  bgpstream_elem_t *copy;
+  int fill;
+  int cnt = 0;
+  int rc;
+
+  if (record_has_elems(record) == 0) {
+    return 0; // treat as end-of-elems
+  }
+
+  if (record->__int->elem_pool == NULL &&
+      (record->__int->elem_pool = bgpstream_elem_generator_create()) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create elem pool");
+    return -1;
+  }
+  pool = record->__int->elem_pool;
+  if (bgpstream_elem_generator_is_populated(pool) == 0) {
+    // first batch for this record
+    bgpstream_elem_generator_empty(pool);
+  }
+
+  fill = bgpstream_format_can_fill_elem(record->__int->format);
+
+  while (cnt < elems_max) {
+    if ((copy = bgpstream_elem_generator_get_new_elem(pool)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not get elem from pool");
+      return -1;
+    }
+
+    if (fill != 0) {
+      // the format decodes each elem on its own, so it can populate the
+      // pooled elem directly. It may point the path at the record, so drop
+      // any copy the pooled elem still owns first
+      bgpstream_as_path_release_data(copy->as_path);
+      rc = fill_next_filtered_elem(record, copy);
+    } else if ((rc = get_next_filtered_elem(record, &elem)) > 0 &&
+               bgpstream_elem_copy(copy, elem) == NULL) {
+      // the format reuses its elem, so we need a copy that lives as long as
+      // the record does
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not copy elem into pool");
+      return -1;
+    }
+    if (rc < 0) {
+      return -1;
+    }
+    if (rc == 0) {
+      break;
+    }
+
+    bgpstream_elem_generator_commit_elem(pool, copy);
+    elems[cnt++] = copy;
+  }
+
+  return cnt;
+}
+
+int bgpstream_record_foreach_elem(bgpstream_record_t *record,
+                                  bgpstream_record_elem_cb_t *cb, void *user)
+{
+  bgpstream_elem_t *elem;
+  int cnt = 0;
+  int rc;
+
+  if (record_has_elems(record) == 0) {
+    return 0;
+  }
+
+  while ((rc = get_next_filtered_elem(record, &elem)) > 0) {
+    cnt++;
+    if ((rc = cb(record, elem, user)) != 0) {
+      return (rc < 0) ? -1 : cnt;
+    }
+  }
+
+  return (rc < 0) ? -1 : cnt;
+}
+
 int bgpstream_record_type_snprintf(char *buf, size_t len,
                                    bgpstream_record_type_t type)
 {
@@ -414,6 +558,12 @@ char *bgpstream_record_snprintf(char *buf, size_t len,
   return B_FULL ? NULL : buf;
 }
 
+/* upper bound on the length of the record part of a record elem line,
+   excluding the project, collector and router names */
+#define RECORD_ELEM_FMT_FIXED_MAX_LEN                                          \
+  (2 + 2 + (BGPSTREAM_FMT_UINT32_MAX_LEN * 2 + 1) + 4 +                        \
+   (BGPSTREAM_FMT_ADDR_MAX_LEN + 1))
+
 char *bgpstream_record_elem_snprintf(char *buf, size_t len,
                                      const bgpstream_record_t *record,
                                      const bgpstream_elem_t *elem)
@@ -421,45 +571,65 @@ char *bgpstream_record_elem_snprintf(char *buf, size_t len,
   assert(record);
   assert(elem);
 
-  size_t written = 0; /* < how many bytes we wanted to write */
-  ssize_t c = 0;      /* < how many chars were written */
-  char *buf_p = buf;
+  bgpstream_fmt_buf_t fb;
+  size_t written; /* < how many bytes we wanted to write */
+  char *p;
 
-  /* Record type */
-  c = bgpstream_record_type_snprintf(buf_p, B_REMAIN, record->type);
-  written += c;
-  buf_p += c;
+  if ((p = bgpstream_fmt_buf_start(
+         &fb, buf, len,
+         RECORD_ELEM_FMT_FIXED_MAX_LEN + strlen(record->project_name) +
+           strlen(record->collector_name) + strlen(record->router_name) +
+           bgpstream_elem_fmt_max_len(elem))) == NULL) {
+    return NULL;
+  }
 
-  ADD_PIPE;
+  /* Record type */
+  switch (record->type) {
+    case BGPSTREAM_RIB:    *p++ = 'R'; break;
+    case BGPSTREAM_UPDATE: *p++ = 'U'; break;
+    default: break;
+  }
+  *p++ = '|';
 
   /* Elem type */
-  c = bgpstream_elem_type_snprintf(buf_p, B_REMAIN, elem->type);
-  written += c;
-  buf_p += c;
-
-  ADD_PIPE;
+  switch (elem->type) {
+    case BGPSTREAM_ELEM_TYPE_RIB:          *p++ = 'R'; break;
+    case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT: *p++ = 'A'; break;
+    case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:   *p++ = 'W'; break;
+    case BGPSTREAM_ELEM_TYPE_PEERSTATE:    *p++ = 'S'; break;
+    default: break;
+  }
+  *p++ = '|';
 
   /* Record timestamp, project, collector, router names */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
-               record->time_sec, record->time_usec, record->project_name,
-               record->collector_name, record->router_name);
-  written += c;
-  buf_p += c;
+  p = bgpstream_fmt_uint32(p, record->time_sec);
+  *p++ = '.';
+  p = bgpstream_fmt_uint32_pad(p, record->time_usec, 6);
+  *p++ = '|';
+  p = bgpstream_fmt_str(p, record->project_name);
+  *p++ = '|';
+  p = bgpstream_fmt_str(p, record->collector_name);
+  *p++ = '|';
+  p = bgpstream_fmt_str(p, record->router_name);
+  *p++ = '|';
 
   /* Router IP */
   if (record->router_ip.version != 0) {
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &record->router_ip) == NULL) {
+    if ((p = bgpstream_fmt_addr(p, &record->router_ip)) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed Router IP address");
+      bgpstream_fmt_buf_finish(&fb, NULL);
       return NULL;
     }
-    SEEK_STR_END;
   }
-  ADD_PIPE;
+  *p++ = '|';
 
-  if (bgpstream_elem_custom_snprintf(buf_p, B_REMAIN, elem, 0) == NULL) {
+  p = bgpstream_elem_fmt(p, elem, 0);
+  written = bgpstream_fmt_buf_finish(&fb, p);
+  if (p == NULL) {
     return NULL;
   }
 
-  // We don't need to check B_FULL because elem_custom_snprintf() did
-  return buf;
+  written += bgpstream_elem_annotations_snprintf(buf + written, B_REMAIN, elem);
+
+  return B_FULL ? NULL : buf;
 }
@@ -227,6 +227,27 @@ typedef struct bgpstream_record {
  *
  * @{ */
 
+/** Take a reference to the given record so that it remains valid after the
+ * next call to bgpstream_get_next_record
+ *
+ * @param record        pointer to the record to retain
+ * @return 0 if the record was retained, -1 if the stream is not in retain mode
+ * (see bgpstream_set_record_retain_mode)
+ *
+ * Each successful call must be matched by a call to bgpstream_record_release.
+ * A record may be retained and released from any thread.
+ */
+int bgpstream_record_retain(bgpstream_record_t *record);
+
+/** Drop a reference to the given record taken by bgpstream_record_retain
+ *
+ * @param record        pointer to the record to release
+ *
+ * Once the last reference has been dropped, the record (and any elems
+ * obtained from it) must not be used again.
+ */
+void bgpstream_record_release(bgpstream_record_t *record);
+
 /** Retrieve the next elem from the record
  *
  * @param record        pointer to the BGP Stream Record to retrieve the elem
@@ -244,6 +265,55 @@ typedef struct bgpstream_record {
 int bgpstream_record_get_next_elem(bgpstream_record_t *record,
                                    bgpstream_elem_t **elem);
 
+/** Retrieve up to elems_max elems from the record in a single call
+ *
+ * @param record        pointer to the BGP Stream Record to retrieve the elems
+ *                      from
+ * @param[out] elems    array of at least elems_max elem pointers to fill with
+ *                      borrowed elem structures
+ * @param elems_max     maximum number of elems to retrieve
+ * @return the number of elems written to elems (0 if there are no more elems),
+ * or -1 if an error occurred
+ *
+ * Unlike bgpstream_record_get_next_elem, every returned elem is a distinct
+ * structure (owned by an elem pool in the record), so all elems from all
+ * batches remain valid until the record is re-used in a subsequent call to
+ * bgpstream_get_next_record, or is destroyed. Calls to this function and to
+ * bgpstream_record_get_next_elem may be mixed; they share the same position in
+ * the record. Formats that decode each elem independently (e.g., the binary
+ * and columnar elem formats) populate the pooled elems in place; for the
+ * others each elem is copied into the pool.
+ */
+int bgpstream_record_get_elems(bgpstream_record_t *record,
+                               bgpstream_elem_t **elems, int elems_max);
+
+/** Callback invoked by bgpstream_record_foreach_elem for each elem
+ *
+ * @param record        pointer to the record the elem belongs to
+ * @param elem          borrowed pointer to the elem (only valid for the
+ *                      duration of the callback)
+ * @param user          user pointer passed to bgpstream_record_foreach_elem
+ * @return 0 to continue, a positive value to stop iterating, or a negative
+ * value to stop iterating and signal an error
+ */
+typedef int(bgpstream_record_elem_cb_t)(bgpstream_record_t *record,
+                                        bgpstream_elem_t *elem, void *user);
+
+/** Invoke the given callback for each (remaining) elem in the record
+ *
+ * @param record        pointer to the BGP Stream Record to retrieve the elems
+ *                      from
+ * @param cb            callback to invoke for each elem
+ * @param user          user pointer to pass to the callback
+ * @return the number of elems passed to the callback, or -1 if an error
+ * occurred (or the callback returned a negative value)
+ *
+ * This avoids both the per-call overhead of bgpstream_record_get_next_elem
+ * and the copy bgpstream_record_get_elems makes for most formats.
+ */
+int bgpstream_record_foreach_elem(bgpstream_record_t *record,
+                                  bgpstream_record_elem_cb_t *cb, void *user);
+
 /** Write the string representation of the record type into the provided buffer
  *
  * @param buf           pointer to a char array
@@ -28,6 +28,7 @@
 #define __BGPSTREAM_RECORD_INT_H
 
 #include "bgpstream_elem.h"
+#include "bgpstream_elem_generator.h"
 #include "bgpstream_format.h"
 #include "bgpstream_record.h"
 #include "bgpstream_utils.h"
@@ -52,6 +53,20 @@ struct bgpstream_record_internal {
 
   /** Private data-structure (optionally) populated by the format module */
   void *data;
+
+  /** Pool of elems returned by bgpstream_record_get_elems (created on first
+   * use) */
+  bgpstream_elem_generator_t *elem_pool;
+
+  /** Reader that owns this record, if the record may be retained (NULL
+   * otherwise) */
+  struct bgpstream_reader *reader;
+
+  /** Number of references to this record (retain mode only) */
+  int refcnt;
+
+  /** Next record in the reader's free list (retain mode only) */
+  bgpstream_record_t *pool_next;
 };
 
 /** @} */
@@ -53,6 +53,9 @@ typedef enum {
   /** Data is streamed via http */
   BGPSTREAM_RESOURCE_TRANSPORT_HTTP = 3,
 
+  /** Data is read from a local shared memory ring (see bgpstream_shm.h) */
+  BGPSTREAM_RESOURCE_TRANSPORT_SHM = 4,
+
 } bgpstream_resource_transport_type_t;
 
 /** Encapsulation/encoding formats supported */
@@ -67,6 +70,12 @@ typedef enum bgpstream_resource_format_type {
   /** RIPE-format data encapsulated in JSON */
   BGPSTREAM_RESOURCE_FORMAT_RISLIVE = 2,
 
+  /** BGPStream binary elem stream (see bgpstream_binary.h) */
+  BGPSTREAM_RESOURCE_FORMAT_BINARY = 3,
+
+  /** BGPStream columnar elem archive (see bgpstream_columnar.h) */
+  BGPSTREAM_RESOURCE_FORMAT_COLUMNAR = 4,
+
 } bgpstream_resource_format_type_t;
 
 /** Set of possible resource attribute types */
@@ -87,6 +96,34 @@ typedef enum bgpstream_resource_attr_type {
   /** The path toward a local cache */
   BGPSTREAM_RESOURCE_ATTR_CACHE_DIR_PATH = 3,
 
+  /* BGPSTREAM_RESOURCE_TRANSPORT_SHM options */
+
+  /** The initial position to read from within the ring ("earliest",
+      "latest") */
+  BGPSTREAM_RESOURCE_ATTR_SHM_INIT_OFFSET = 4,
+
+  /* BGPSTREAM_RESOURCE_TRANSPORT_CACHE options (continued) */
+
+  /** The codec used to write new cache files ("raw", "gzip", "lz4",
+      "zstd") */
+  BGPSTREAM_RESOURCE_ATTR_CACHE_CODEC = 5,
+
+  /** The maximum total size of the cache files (in bytes, "0" for no limit) */
+  BGPSTREAM_RESOURCE_ATTR_CACHE_QUOTA = 6,
+
+  /* Reader options */
+
+  /** Decode records on a worker thread, queueing up to this many records
+      ahead of the reader (unset to decode in the reading thread) */
+  BGPSTREAM_RESOURCE_ATTR_DECODE_QUEUE_LEN = 7,
+
+  /* BGPSTREAM_RESOURCE_TRANSPORT_FILE options */
+
+  /** The byte range of an uncompressed, line-based file to read
+      ("<start>-<end>"). Only the lines that start within the range are read
+      (unset to read the whole file) */
+  BGPSTREAM_RESOURCE_ATTR_FILE_RANGE = 8,
+
   /** INTERNAL: The total number of attribute types in use */
   _BGPSTREAM_RESOURCE_ATTR_CNT,
 
@@ -148,6 +185,10 @@ bgpstream_resource_t *bgpstream_resource_create(
   uint32_t initial_time, uint32_t duration, const char *project,
   const char *collector, bgpstream_record_type_t record_type);
 
+/** Create a copy of the given resource metadata object (including its
+ * attributes) */
+bgpstream_resource_t *bgpstream_resource_copy(bgpstream_resource_t *resource);
+
 /** Destroy the given resource metadata object */
 void bgpstream_resource_destroy(bgpstream_resource_t *resource);
 
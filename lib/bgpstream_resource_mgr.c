@@ -27,10 +27,12 @@
 #include "bgpstream_resource_mgr.h"
 #include "bgpstream_filter.h"
 #include "bgpstream_log.h"
+#include "bgpstream_prefetcher.h"
 #include "bgpstream_reader.h"
 #include "config.h"
 #include "utils.h"
 #include <assert.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -39,9 +41,8 @@
 #define BUFFER_LEN 1024
 
 /** Approximately how frequently should stream resources that return AGAIN be
-    polled? (in msec) */
+    polled if their transport cannot signal when data arrives? (in msec) */
 #define AGAIN_POLL_INTERVAL 500
-#define MSEC_TO_NSEC 1000000
 
 struct res_list_elem {
   /** The resource info */
@@ -53,9 +54,18 @@ struct res_list_elem {
   /** Is the reader open? (i.e. have we waited for it to open) */
   int open;
 
-  /** Time when this resource should next be polled (if 0 then poll
-      immediately) */
-  uint32_t next_poll;
+  /** Time (in msec) when this resource should next be polled (if 0 then
+      poll immediately). Only used if the reader has no descriptor to wait on,
+      otherwise it just marks the resource as waiting for data. */
+  uint64_t next_poll;
+
+  /** Time (in msec) since when this stream resource has had no data (0 if it
+      is not idle) */
+  uint64_t idle_since;
+
+  /** Earliest time this resource is sorted at. Set when an idle stream is
+      moved past the records of other resources. */
+  uint32_t watermark;
 
   /** Previous list elem */
   struct res_list_elem *prev;
@@ -113,6 +123,23 @@ struct bgpstream_resource_mgr {
 
   // borrowed pointer to a filter manager instance
   bgpstream_filter_mgr_t *filter_mgr;
+
+  // should readers export retainable records?
+  int retain_records;
+
+  // cache prefetcher (NULL if prefetching is disabled)
+  bgpstream_prefetcher_t *prefetcher;
+
+  // the number of groups after the open batch to prefetch
+  int prefetch_groups;
+
+  // descriptors of the stream resources that are waiting for data
+  struct pollfd *pollfds;
+  int pollfds_alloc;
+
+  // how long (in msec) idle streams may hold back other resources (0 for
+  // ever)
+  uint32_t max_lateness;
 };
 
 static int open_batch(bgpstream_resource_mgr_t *q, struct res_group *gp);
@@ -165,9 +192,14 @@ static int open_res_list(bgpstream_resource_mgr_t *q, struct res_group *gp,
       el = el->next;
       continue;
     }
+    // a prefetch of this resource is either done, or no longer useful
+    if (q->prefetcher != NULL &&
+        el->res->transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE) {
+      bgpstream_prefetcher_release(q->prefetcher, el->res);
+    }
     // open this resource
-    if ((el->reader = bgpstream_reader_create(el->res, q->filter_mgr)) ==
-        NULL) {
+    if ((el->reader = bgpstream_reader_create(el->res, q->filter_mgr,
+                                              q->retain_records)) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to open resource: %s",
                     el->res->url);
       return -1;
@@ -218,8 +250,11 @@ static void res_group_destroy(struct res_group *g, int destroy_resource)
 
 static uint32_t get_next_time(struct res_list_elem *el)
 {
+  uint32_t time;
+
   if (el->reader != NULL) {
-    return bgpstream_reader_get_next_time(el->reader);
+    time = bgpstream_reader_get_next_time(el->reader);
+    return (time < el->watermark) ? el->watermark : time;
   } else {
     // our best guess
     //
@@ -640,6 +675,138 @@ static int open_batch(bgpstream_resource_mgr_t *q, struct res_group *gp)
   return 0;
 }
 
+// queue the cache resources of the groups that follow the open batch for
+// download. does not modify the queue
+static int prefetch_groups(bgpstream_resource_mgr_t *q)
+{
+  struct res_group *cur = q->head;
+  struct res_list_elem *el;
+  int groups = 0;
+  int i;
+
+  // skip the open batch
+  while (cur != NULL && cur->res_open_cnt != 0) {
+    cur = cur->next;
+  }
+
+  for (; cur != NULL && groups < q->prefetch_groups; cur = cur->next) {
+    for (i = 0; i < _BGPSTREAM_RECORD_TYPE_CNT; i++) {
+      for (el = cur->res_list[i]; el != NULL; el = el->next) {
+        if (el->reader == NULL &&
+            el->res->transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE &&
+            bgpstream_prefetcher_add(q->prefetcher, el->res) < 0) {
+          return -1;
+        }
+      }
+    }
+    groups++;
+  }
+
+  return 0;
+}
+
+// if all the resources in the given list (the head of the queue, all of which
+// have returned AGAIN) have been idle for longer than max_lateness, move them
+// to the next group so that the records there can be read. returns 1 if the
+// queue was changed, 0 if not (and sets max_wait to the number of msec until
+// it can be, or -1), and -1 on error.
+static int pass_idle_streams(bgpstream_resource_mgr_t *q,
+                             struct res_list_elem *list, int *max_wait)
+{
+  struct res_list_elem *el, *el_nxt;
+  uint64_t now = epoch_msec();
+  uint64_t wait = 0;
+
+  *max_wait = -1;
+  if (q->max_lateness == 0 || q->head->next == NULL) {
+    return 0;
+  }
+
+  for (el = list; el != NULL; el = el->next) {
+    if (el->idle_since == 0) {
+      return 0;
+    }
+    if (el->idle_since + q->max_lateness > now &&
+        el->idle_since + q->max_lateness - now > wait) {
+      wait = el->idle_since + q->max_lateness - now;
+    }
+  }
+  if (wait > 0) {
+    *max_wait = wait;
+    return 0;
+  }
+
+  for (el = list; el != NULL; el = el_nxt) {
+    el_nxt = el->next;
+    el->watermark = q->head->next->time;
+    pop_res_el(q, q->head, el);
+    if (insert_resource_elem(q, el) < 0) {
+      return -1;
+    }
+  }
+  reap_groups(q);
+
+  return 1;
+}
+
+// block until one of the resources in the given list (all of which have
+// returned AGAIN) may have data, or for at most max_wait msec (unless -1).
+// resources whose reader can provide a descriptor are woken as soon as data
+// arrives, the others are polled every AGAIN_POLL_INTERVAL msec.
+static int wait_for_data(bgpstream_resource_mgr_t *q,
+                         struct res_list_elem *list, int max_wait)
+{
+  struct res_list_elem *el;
+  struct pollfd *tmp;
+  uint64_t now = epoch_msec();
+  int timeout = -1;
+  int nfds = 0;
+  int cnt = 0;
+  int fd;
+
+  for (el = list; el != NULL; el = el->next) {
+    cnt++;
+  }
+  if (cnt > q->pollfds_alloc) {
+    if ((tmp = realloc(q->pollfds, sizeof(struct pollfd) * cnt)) == NULL) {
+      return -1;
+    }
+    q->pollfds = tmp;
+    q->pollfds_alloc = cnt;
+  }
+
+  for (el = list; el != NULL; el = el->next) {
+    if (el->next_poll == 0) {
+      // hasn't been polled since data may have arrived
+      timeout = 0;
+    } else if ((fd = bgpstream_reader_get_fd(el->reader)) >= 0) {
+      q->pollfds[nfds].fd = fd;
+      q->pollfds[nfds].events = POLLIN;
+      q->pollfds[nfds].revents = 0;
+      nfds++;
+    } else if (el->next_poll <= now) {
+      timeout = 0;
+    } else if (timeout == -1 || el->next_poll - now < (uint64_t)timeout) {
+      timeout = el->next_poll - now;
+    }
+  }
+  if (max_wait >= 0 && (timeout == -1 || max_wait < timeout)) {
+    timeout = max_wait;
+  }
+
+  if (timeout != 0 && poll(q->pollfds, nfds, timeout) < 0) {
+    // interrupted
+    return -1;
+  }
+
+  // we don't know which resources are ready (or whose interval has expired),
+  // so poll them all once more
+  for (el = list; el != NULL; el = el->next) {
+    el->next_poll = 0;
+  }
+  return 0;
+}
+
 // when this is called we are guaranteed to have at least one open resource, and
 // if things have gone right, we should read from the first resource in the
 // queue. once we have read from the resource, we should check the new time of
@@ -651,9 +818,8 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
   bgpstream_reader_status_t rs;
   struct res_list_elem *el = NULL;
   struct res_group *gp = NULL;
-  uint32_t now;
-  uint64_t sleep_nsec;
-  struct timespec rqtp;
+  int max_wait;
+  int rc;
 
   // the resource we want to read from MUST be in the first group (q->head), and
   // will either be the head of the RIBS list if there are any ribs, otherwise
@@ -667,21 +833,18 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
   assert(el->prev == NULL);
   assert(el->open != 0);
 
-  // we assume that if this resource has a poll timer set that has not expired
-  // then since it would have been pushed to the end of the group and as such
-  // all other resources already polled.
+  // we assume that if this resource is waiting for data then since it would
+  // have been pushed to the end of the group, all other resources have
+  // already been polled, so we either move them out of the way of newer
+  // records, or wait for any of them to have data.
   if (el->next_poll > 0) {
-    now = epoch_msec();
-    if (el->next_poll > now) {
-      sleep_nsec = (el->next_poll - now) * MSEC_TO_NSEC;
-      rqtp.tv_sec = sleep_nsec / 1000000000;
-      rqtp.tv_nsec = sleep_nsec % 1000000000;
-      if (nanosleep(&rqtp, NULL) != 0) {
-        // interrupted
-        return -1;
-      }
+    if ((rc = pass_idle_streams(q, el, &max_wait)) != 0) {
+      return (rc < 0) ? BGPSTREAM_READER_STATUS_ERROR
+                      : BGPSTREAM_READER_STATUS_AGAIN;
+    }
+    if (wait_for_data(q, el, max_wait) != 0) {
+      return -1;
     }
-    el->next_poll = 0;
   }
 
   // cache the current time so we can check if we need to remove and re-insert
@@ -725,9 +888,13 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
     // and then tell the caller that while we didn't get anything useful, they
     // should try again soon
     el->next_poll = epoch_msec() + AGAIN_POLL_INTERVAL;
+    if (el->idle_since == 0) {
+      el->idle_since = el->next_poll - AGAIN_POLL_INTERVAL;
+    }
     assert(q->head->res_list[el->res->record_type]->prev == NULL);
     return rs;
   }
+  el->idle_since = 0;
 
   // otherwise we must valid, or EOS
   assert(rs == BGPSTREAM_READER_STATUS_EOS || rs == BGPSTREAM_READER_STATUS_OK);
@@ -818,11 +985,42 @@ bgpstream_resource_mgr_create(bgpstream_filter_mgr_t *filter_mgr)
   return q;
 }
 
+void bgpstream_resource_mgr_set_record_retain(bgpstream_resource_mgr_t *q)
+{
+  q->retain_records = 1;
+}
+
+int bgpstream_resource_mgr_set_prefetch(bgpstream_resource_mgr_t *q,
+                                        int groups, int threads,
+                                        uint64_t quota)
+{
+  bgpstream_prefetcher_destroy(q->prefetcher);
+  q->prefetcher = NULL;
+  q->prefetch_groups = groups;
+
+  if (groups > 0 &&
+      (q->prefetcher = bgpstream_prefetcher_create(threads, quota)) == NULL) {
+    return -1;
+  }
+
+  return 0;
+}
+
+void bgpstream_resource_mgr_set_max_lateness(bgpstream_resource_mgr_t *q,
+                                             uint32_t max_lateness)
+{
+  q->max_lateness = max_lateness;
+}
+
 void bgpstream_resource_mgr_destroy(bgpstream_resource_mgr_t *q)
 {
   if (q == NULL) {
     return;
   }
+
+  // stop downloads before the resources go away
+  bgpstream_prefetcher_destroy(q->prefetcher);
+  q->prefetcher = NULL;
   struct res_group *cur = q->head;
 
   while (cur != NULL) {
@@ -835,6 +1033,9 @@ void bgpstream_resource_mgr_destroy(bgpstream_resource_mgr_t *q)
   // filter manager is a borrowed pointer
   q->filter_mgr = NULL;
 
+  free(q->pollfds);
+  q->pollfds = NULL;
+
   free(q);
 }
 
@@ -929,6 +1130,11 @@ int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
       if ((dirty_cnt = sort_batch(q)) < 0) {
         goto err;
       }
+      // now that we know which resources will be read next, start downloading
+      // the ones after them
+      if (q->prefetcher != NULL && prefetch_groups(q) != 0) {
+        goto err;
+      }
     }
     // its possible that we failed to open all the files, perhaps in that case
     // we shouldn't abort, but instead return EOS and let the caller decide what
@@ -44,6 +44,43 @@ bgpstream_resource_mgr_create(bgpstream_filter_mgr_t *filter_mgr);
 /** Destroy the given resource queue */
 void bgpstream_resource_mgr_destroy(bgpstream_resource_mgr_t *q);
 
+/** Make readers created by this queue export records that may be retained
+ * (see bgpstream_record_retain) */
+void bgpstream_resource_mgr_set_record_retain(bgpstream_resource_mgr_t *q);
+
+/** Download upcoming cache resources into the local cache in the background
+ *
+ * @param q               pointer to the queue
+ * @param groups          number of resource groups after the open batch to
+ *                        download (0 disables prefetching)
+ * @param threads         number of concurrent downloads
+ * @param quota           maximum number of bytes of downloaded files that
+ *                        have not yet been opened
+ * @return 0 if successful, -1 otherwise
+ */
+int bgpstream_resource_mgr_set_prefetch(bgpstream_resource_mgr_t *q,
+                                        int groups, int threads,
+                                        uint64_t quota);
+
+/** Bound how long an idle stream resource may hold back other streams
+ *
+ * @param q               pointer to the queue
+ * @param max_lateness    time (in msec) to wait for a stream resource that
+ *                        has no data before yielding newer records from other
+ *                        resources (0 to always wait)
+ *
+ * Records are yielded in timestamp order across resources, so without a bound
+ * a single idle stream (e.g., a quiet Kafka partition) stalls all others.
+ * Records that such a stream yields once it has been passed by may be older
+ * than records that have already been yielded.
+ *
+ * The bound belongs to the queue, not to a resource: it applies to every
+ * stream resource in the queue, whichever data interface set it, and the
+ * last call wins.
+ */
+void bgpstream_resource_mgr_set_max_lateness(bgpstream_resource_mgr_t *q,
+                                             uint32_t max_lateness);
+
 /** Add a resource item to the queue
  *
  * @param q               pointer to the queue
@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_shm_int.h"
+#include "bgpstream_log.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct bgpstream_shm_publisher {
+
+  /** Name of the shared memory object */
+  char name[BGPSTREAM_UTILS_STR_NAME_LEN];
+
+  /** Mapping of the shared memory object */
+  void *map;
+  size_t map_len;
+
+  /** Control block and data of the ring (both in the mapping) */
+  shm_ring_ctrl_t *ctrl;
+  uint8_t *data;
+
+  /** Size of the data (ctrl->size) */
+  uint64_t size;
+
+  /** Binary elem stream writer that encodes into the ring */
+  bgpstream_binary_writer_t *writer;
+
+  /** Has the stream header been written (to the control block)? */
+  int header_written;
+
+  /** Must a sync point be added before the next record? */
+  int need_sync;
+
+  /** Position of the most recent sync point */
+  uint64_t last_sync_pos;
+
+  /** Number of consumers dropped */
+  uint64_t dropped_cnt;
+
+  /** Was the shared memory object created (and so must be removed)? */
+  int created;
+
+  /** Identity of the shared memory object, so that we do not remove a ring
+      that has since replaced ours under the same name */
+  dev_t dev;
+  ino_t ino;
+};
+
+/* ==================== RING UTILITIES ==================== */
+
+static uint64_t round_up_pow2(uint64_t v)
+{
+  uint64_t p = 1;
+  while (p < v) {
+    p <<= 1;
+  }
+  return p;
+}
+
+/* drop any consumer that would lose data if the ring were written up to
+ * `end` */
+static void drop_slow_consumers(bgpstream_shm_publisher_t *pub, uint64_t end)
+{
+  shm_ring_consumer_t *c;
+  uint32_t state;
+  int i;
+
+  for (i = 0; i < SHM_RING_CONSUMERS_MAX; i++) {
+    c = &pub->ctrl->consumers[i];
+    state = SHM_RING_CONSUMER_ACTIVE;
+    if (__atomic_load_n(&c->state, __ATOMIC_ACQUIRE) != state ||
+        end - __atomic_load_n(&c->pos, __ATOMIC_ACQUIRE) <= pub->size) {
+      continue;
+    }
+    if (__atomic_compare_exchange_n(&c->state, &state,
+                                    SHM_RING_CONSUMER_DROPPED, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      pub->dropped_cnt++;
+      bgpstream_log(BGPSTREAM_LOG_WARN,
+                    "Dropping slow shm consumer (pid %d) from %s", (int)c->pid,
+                    pub->name);
+    }
+  }
+}
+
+/* free the slots of consumers that exited without detaching */
+static void reap_consumers(bgpstream_shm_publisher_t *pub)
+{
+  shm_ring_consumer_t *c;
+  uint32_t state;
+  int i;
+
+  for (i = 0; i < SHM_RING_CONSUMERS_MAX; i++) {
+    c = &pub->ctrl->consumers[i];
+    state = __atomic_load_n(&c->state, __ATOMIC_ACQUIRE);
+    if (state == SHM_RING_CONSUMER_FREE ||
+        kill(c->pid, 0) == 0 || errno != ESRCH) {
+      continue;
+    }
+    __atomic_compare_exchange_n(&c->state, &state, SHM_RING_CONSUMER_FREE, 0,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+  }
+}
+
+/* Writer callback. The writer is flushed after each message, so `buf` always
+ * holds whole messages, which are committed together. */
+static int ring_write(const uint8_t *buf, size_t len, void *user)
+{
+  bgpstream_shm_publisher_t *pub = (bgpstream_shm_publisher_t *)user;
+  shm_ring_ctrl_t *ctrl = pub->ctrl;
+  uint64_t start, end, off;
+  size_t n;
+
+  // the writer's first output is the stream header, which consumers read
+  // from the control block
+  if (pub->header_written == 0) {
+    if (len < BGPSTREAM_BINARY_HEADER_LEN) {
+      return -1;
+    }
+    memcpy(ctrl->stream_hdr, buf, BGPSTREAM_BINARY_HEADER_LEN);
+    pub->header_written = 1;
+    buf += BGPSTREAM_BINARY_HEADER_LEN;
+    len -= BGPSTREAM_BINARY_HEADER_LEN;
+  }
+  if (len == 0) {
+    return 0;
+  }
+
+  if (len > pub->size / 4) {
+    // the dictionary entries in this block are lost along with the record,
+    // so the stream must be restarted from a sync point
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Record too large for shm ring %s (%zu bytes), dropping",
+                  pub->name, len);
+    pub->need_sync = 1;
+    return 0;
+  }
+
+  start = __atomic_load_n(&ctrl->commit_pos, __ATOMIC_RELAXED);
+  end = start + len;
+  drop_slow_consumers(pub, end);
+
+  // announce the overwrite before touching the data, so that a consumer
+  // copying from this part of the ring knows to discard its copy
+  __atomic_store_n(&ctrl->reserve_pos, end, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  off = start & (pub->size - 1);
+  n = (len < pub->size - off) ? len : pub->size - off;
+  memcpy(pub->data + off, buf, n);
+  memcpy(pub->data, buf + n, len - n);
+
+  __atomic_store_n(&ctrl->commit_pos, end, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static int add_sync(bgpstream_shm_publisher_t *pub)
+{
+  shm_ring_ctrl_t *ctrl = pub->ctrl;
+  uint64_t pos, cnt;
+
+  if (bgpstream_binary_writer_flush(pub->writer) != 0) {
+    return -1;
+  }
+  pos = __atomic_load_n(&ctrl->commit_pos, __ATOMIC_RELAXED);
+  if (bgpstream_binary_writer_sync(pub->writer) != 0 ||
+      bgpstream_binary_writer_flush(pub->writer) != 0) {
+    return -1;
+  }
+
+  cnt = __atomic_load_n(&ctrl->syncs_cnt, __ATOMIC_RELAXED);
+  __atomic_store_n(&ctrl->syncs[cnt % SHM_RING_SYNCS_CNT], pos,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&ctrl->syncs_cnt, cnt + 1, __ATOMIC_RELEASE);
+
+  pub->last_sync_pos = pos;
+  pub->need_sync = 0;
+
+  reap_consumers(pub);
+  return 0;
+}
+
+/* does the name of our ring still refer to it? (another publisher may have
+ * replaced it, in which case its consumers must still be able to attach) */
+static int still_named(bgpstream_shm_publisher_t *pub)
+{
+  struct stat st;
+  int fd;
+  int rc;
+
+  if ((fd = shm_open(pub->name, O_RDONLY, 0)) < 0) {
+    return 0;
+  }
+  rc = fstat(fd, &st) == 0 && st.st_dev == pub->dev && st.st_ino == pub->ino;
+  close(fd);
+  return rc;
+}
+
+/* ==================== PUBLIC FUNCTIONS ==================== */
+
+bgpstream_shm_publisher_t *bgpstream_shm_publisher_create(const char *name,
+                                                          size_t size)
+{
+  bgpstream_shm_publisher_t *pub;
+  struct stat st;
+  int fd = -1;
+
+  if ((pub = malloc_zero(sizeof(bgpstream_shm_publisher_t))) == NULL) {
+    return NULL;
+  }
+
+  if (name == NULL) {
+    name = BGPSTREAM_SHM_NAME_DEFAULT;
+  }
+  // shm object names must start with a '/'
+  if (snprintf(pub->name, sizeof(pub->name), "%s%s",
+               (name[0] == '/') ? "" : "/",
+               name) >= (int)sizeof(pub->name)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Shared memory name too long: %s", name);
+    goto err;
+  }
+
+  if (size == 0) {
+    size = BGPSTREAM_SHM_SIZE_DEFAULT;
+  }
+  if (size < BGPSTREAM_SHM_SIZE_MIN) {
+    size = BGPSTREAM_SHM_SIZE_MIN;
+  }
+  pub->size = round_up_pow2(size);
+  pub->map_len = SHM_RING_DATA_OFFSET + pub->size;
+
+  // replace any existing ring (consumers attached to it keep their mapping,
+  // and move to the new ring once they have drained the old one)
+  shm_unlink(pub->name);
+  if ((fd = shm_open(pub->name, O_RDWR | O_CREAT | O_EXCL, 0660)) >= 0 &&
+      fstat(fd, &st) == 0) {
+    pub->created = 1;
+    pub->dev = st.st_dev;
+    pub->ino = st.st_ino;
+  }
+  if (pub->created == 0 || ftruncate(fd, pub->map_len) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create shared memory %s: %s",
+                  pub->name, strerror(errno));
+    goto err;
+  }
+  if ((pub->map = mmap(NULL, pub->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0)) == MAP_FAILED) {
+    pub->map = NULL;
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not map shared memory %s: %s",
+                  pub->name, strerror(errno));
+    goto err;
+  }
+  close(fd);
+  fd = -1;
+
+  pub->ctrl = (shm_ring_ctrl_t *)pub->map;
+  pub->data = (uint8_t *)pub->map + SHM_RING_DATA_OFFSET;
+  pub->ctrl->version = SHM_RING_VERSION;
+  pub->ctrl->pid = getpid();
+  pub->ctrl->size = pub->size;
+
+  // the stream starts with a sync point, so that a consumer can start
+  // anywhere in the ring
+  if ((pub->writer = bgpstream_binary_writer_create(ring_write, pub)) ==
+        NULL ||
+      bgpstream_binary_writer_flush(pub->writer) != 0 ||
+      add_sync(pub) != 0) {
+    goto err;
+  }
+
+  // consumers wait for the magic before using the ring
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(pub->ctrl->magic, SHM_RING_MAGIC, sizeof(pub->ctrl->magic));
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  return pub;
+
+err:
+  if (fd >= 0) {
+    close(fd);
+  }
+  bgpstream_shm_publisher_destroy(pub);
+  return NULL;
+}
+
+void bgpstream_shm_publisher_destroy(bgpstream_shm_publisher_t *pub)
+{
+  int unlink_ring;
+
+  if (pub == NULL) {
+    return;
+  }
+
+  // check before unmapping, while our object (and so its inode number) is
+  // still alive
+  unlink_ring = pub->created != 0 && still_named(pub);
+
+  if (pub->writer != NULL) {
+    bgpstream_binary_writer_flush(pub->writer);
+    bgpstream_binary_writer_destroy(pub->writer);
+  }
+  if (pub->map != NULL) {
+    __atomic_store_n(&pub->ctrl->closed, 1, __ATOMIC_RELEASE);
+    munmap(pub->map, pub->map_len);
+  }
+  if (unlink_ring) {
+    shm_unlink(pub->name);
+  }
+
+  free(pub);
+}
+
+int bgpstream_shm_publisher_add_record(bgpstream_shm_publisher_t *pub,
+                                       bgpstream_record_t *record)
+{
+  uint64_t commit = __atomic_load_n(&pub->ctrl->commit_pos, __ATOMIC_RELAXED);
+
+  if ((pub->need_sync != 0 ||
+       commit - pub->last_sync_pos >= pub->size / SHM_RING_SYNCS_CNT) &&
+      add_sync(pub) != 0) {
+    return -1;
+  }
+
+  // flushing each record keeps latency low, and means that only whole
+  // messages are ever visible to consumers
+  if (bgpstream_binary_writer_add_record(pub->writer, record) != 0 ||
+      bgpstream_binary_writer_flush(pub->writer) != 0) {
+    pub->need_sync = 1;
+    return -1;
+  }
+  return 0;
+}
+
+uint64_t
+bgpstream_shm_publisher_get_dropped_cnt(bgpstream_shm_publisher_t *pub)
+{
+  return pub->dropped_cnt;
+}
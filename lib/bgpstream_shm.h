@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_SHM_H
+#define __BGPSTREAM_SHM_H
+
+#include "bgpstream_record.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the bgpstream
+ * shared memory publisher.
+ *
+ * A publisher writes the records (and elems) of a stream into a POSIX shared
+ * memory ring, so that several local processes can consume a single decoded
+ * stream using the "shm" data interface, rather than each decoding the same
+ * data.
+ *
+ * The ring holds a binary elem stream (see bgpstream_binary.h), with a sync
+ * point at least every 1/16th of the ring so that consumers can start
+ * reading part way through. The publisher never waits for consumers: a
+ * consumer that falls more than the size of the ring behind is dropped, and
+ * rejoins the stream at the most recent sync point (losing the data in
+ * between).
+ *
+ */
+
+/**
+ * @name Public Constants
+ *
+ * @{ */
+
+/** Default name of the shared memory ring */
+#define BGPSTREAM_SHM_NAME_DEFAULT "/bgpstream"
+
+/** Default size of the shared memory ring (in bytes) */
+#define BGPSTREAM_SHM_SIZE_DEFAULT (64 * 1024 * 1024)
+
+/** Minimum size of the shared memory ring (in bytes) */
+#define BGPSTREAM_SHM_SIZE_MIN (1024 * 1024)
+
+/** @} */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing a shared memory publisher instance */
+typedef struct bgpstream_shm_publisher bgpstream_shm_publisher_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new shared memory publisher
+ *
+ * @param name          name of the shared memory object (see shm_open(3)),
+ *                      or NULL to use BGPSTREAM_SHM_NAME_DEFAULT
+ * @param size          size of the ring in bytes (rounded up to a power of
+ *                      two), or 0 to use BGPSTREAM_SHM_SIZE_DEFAULT
+ * @return pointer to a new publisher if successful, NULL otherwise
+ *
+ * Any existing shared memory object with the same name is replaced.
+ * Consumers that were attached to it see the end of its stream, and then
+ * attach to the new one.
+ */
+bgpstream_shm_publisher_t *bgpstream_shm_publisher_create(const char *name,
+                                                          size_t size);
+
+/** Destroy the given publisher
+ *
+ * @param publisher     pointer to the publisher to destroy
+ *
+ * The shared memory object is removed, and the attached consumers see the
+ * end of the stream once they have read all of the published data.
+ */
+void bgpstream_shm_publisher_destroy(bgpstream_shm_publisher_t *publisher);
+
+/** Publish the given record, along with all of its elems
+ *
+ * @param publisher     pointer to the publisher
+ * @param record        pointer to the record to publish
+ * @return 0 if the record was published successfully, -1 otherwise
+ *
+ * The elems are extracted using bgpstream_record_get_next_elem, so only the
+ * elems that match the stream filters (and that have not already been
+ * extracted) are published. The record is visible to consumers as soon as
+ * this function returns.
+ */
+int bgpstream_shm_publisher_add_record(bgpstream_shm_publisher_t *publisher,
+                                       bgpstream_record_t *record);
+
+/** Get the number of consumers that the given publisher has dropped
+ *
+ * @param publisher     pointer to the publisher
+ * @return the number of times a consumer was dropped for being too slow
+ */
+uint64_t
+bgpstream_shm_publisher_get_dropped_cnt(bgpstream_shm_publisher_t *publisher);
+
+/** @} */
+
+#endif /* __BGPSTREAM_SHM_H */
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_SHM_INT_H
+#define __BGPSTREAM_SHM_INT_H
+
+#include "bgpstream_binary.h"
+#include "bgpstream_shm.h"
+#include <stdint.h>
+#include <sys/types.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the layout of the shared memory ring that
+ * is shared by the publisher and the "shm" transport.
+ *
+ * The ring starts with a control block, followed by the data. Positions are
+ * byte offsets in the (unbounded) stream, and position p is stored at offset
+ * p % size of the data.
+ *
+ * The publisher writes the bytes between commit_pos and reserve_pos, and
+ * then moves commit_pos forward, so consumers can read up to commit_pos. It
+ * always commits whole messages. Once a consumer has copied data out of the
+ * ring, it checks that reserve_pos is no more than size past the start of
+ * the data it copied, otherwise the data may have been overwritten while it
+ * was being copied, and the consumer has been lapped.
+ *
+ */
+
+/**
+ * @name Private Constants
+ *
+ * @{ */
+
+/** Magic string at the start of the control block (set once the ring is
+ * ready) */
+#define SHM_RING_MAGIC "BSSHMRNG"
+
+/** Version of the ring layout */
+#define SHM_RING_VERSION 1
+
+/** Maximum number of registered consumers */
+#define SHM_RING_CONSUMERS_MAX 64
+
+/** Number of recent sync points remembered by the ring. The publisher adds a
+ * sync point every size / SHM_RING_SYNCS_CNT bytes. */
+#define SHM_RING_SYNCS_CNT 16
+
+/** Consumer slot states */
+#define SHM_RING_CONSUMER_FREE 0
+#define SHM_RING_CONSUMER_ACTIVE 1
+#define SHM_RING_CONSUMER_DROPPED 2
+
+/** @} */
+
+/**
+ * @name Private Data Structures
+ *
+ * @{ */
+
+/** Consumer slot (on its own cache line, since the consumer updates its
+ * position often) */
+typedef struct shm_ring_consumer {
+
+  /** State of the slot (SHM_RING_CONSUMER_*) */
+  uint32_t state;
+
+  /** Process ID of the consumer */
+  pid_t pid;
+
+  /** Position of the consumer in the stream */
+  uint64_t pos;
+
+} __attribute__((aligned(64))) shm_ring_consumer_t;
+
+/** Control block at the start of the shared memory object */
+typedef struct shm_ring_ctrl {
+
+  /** SHM_RING_MAGIC */
+  char magic[8];
+
+  /** SHM_RING_VERSION */
+  uint32_t version;
+
+  /** Process ID of the publisher */
+  pid_t pid;
+
+  /** Size of the data (a power of two) */
+  uint64_t size;
+
+  /** Header of the binary elem stream held by the ring */
+  uint8_t stream_hdr[BGPSTREAM_BINARY_HEADER_LEN];
+
+  /** Has the publisher finished? */
+  uint32_t closed;
+
+  /** End of the data being written by the publisher */
+  uint64_t reserve_pos __attribute__((aligned(64)));
+
+  /** End of the data that consumers can read */
+  uint64_t commit_pos;
+
+  /** Number of sync points added (the position of sync point i is in
+   * syncs[i % SHM_RING_SYNCS_CNT]) */
+  uint64_t syncs_cnt;
+
+  /** Positions of the most recent sync points */
+  uint64_t syncs[SHM_RING_SYNCS_CNT];
+
+  /** Consumer slots */
+  shm_ring_consumer_t consumers[SHM_RING_CONSUMERS_MAX];
+
+} shm_ring_ctrl_t;
+
+/** Offset of the data from the start of the shared memory object */
+#define SHM_RING_DATA_OFFSET                                                   \
+  ((sizeof(shm_ring_ctrl_t) + 4095) & ~(size_t)4095)
+
+/** @} */
+
+#endif /* __BGPSTREAM_SHM_INT_H */
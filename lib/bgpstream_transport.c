@@ -37,6 +37,7 @@
 #include "bs_transport_cache.h"
 #include "bs_transport_file.h"
 #include "bs_transport_http.h"
+#include "bs_transport_shm.h"
 
 #ifdef WITH_KAFKA
 #include "bs_transport_kafka.h"
@@ -62,6 +63,8 @@ static const transport_create_func_t create_functions[] = {
   bs_transport_cache_create,
 
   bs_transport_http_create,
+
+  bs_transport_shm_create,
 };
 
 bgpstream_transport_t *bgpstream_transport_create(bgpstream_resource_t *res)
@@ -111,6 +114,50 @@ int64_t bgpstream_transport_read(bgpstream_transport_t *transport, void *buffer,
   return transport->read(transport, buffer, len);
 }
 
+int bgpstream_transport_can_borrow(bgpstream_transport_t *transport)
+{
+  return transport->borrow != NULL;
+}
+
+int64_t bgpstream_transport_borrow(bgpstream_transport_t *transport,
+                                   const uint8_t **buffer)
+{
+  return transport->borrow(transport, buffer);
+}
+
+int64_t bgpstream_transport_skip(bgpstream_transport_t *transport, int64_t len)
+{
+  uint8_t buf[16384];
+  int64_t done = 0;
+  int64_t rc;
+
+  if (transport->skip != NULL) {
+    return transport->skip(transport, len);
+  }
+
+  while (done < len) {
+    rc = transport->read(transport, buf,
+                         (len - done < (int64_t)sizeof(buf)) ? len - done
+                                                             : sizeof(buf));
+    if (rc < 0) {
+      return -1;
+    }
+    if (rc == 0) {
+      break;
+    }
+    done += rc;
+  }
+  return done;
+}
+
+int bgpstream_transport_get_fd(bgpstream_transport_t *transport)
+{
+  if (transport->get_fd == NULL) {
+    return -1;
+  }
+  return transport->get_fd(transport);
+}
+
 void bgpstream_transport_destroy(bgpstream_transport_t *transport)
 {
   if (transport == NULL) {
@@ -60,6 +60,51 @@ int64_t bgpstream_transport_read(bgpstream_transport_t *transport, void *buffer,
 int64_t bgpstream_transport_readline(bgpstream_transport_t *transport,
                                      void *buffer, int64_t len);
 
+/** Does the given transport support borrowing data without copying it?
+ *
+ * @param transport     pointer to a transport handler
+ * @return 1 if bgpstream_transport_borrow may be used, 0 otherwise
+ */
+int bgpstream_transport_can_borrow(bgpstream_transport_t *transport);
+
+/** Borrow the next chunk of data from the given transport handler
+ *
+ * @param transport     pointer to a transport handler to read from
+ * @param[out] buffer   set to point to the data
+ * @return the number of bytes available at buffer (0 if there is no data) if
+ * successful, -1 otherwise
+ *
+ * The data is owned by the transport and is only valid until the next read,
+ * readline, skip or borrow call on the transport. This must only be used if
+ * bgpstream_transport_can_borrow returns 1.
+ */
+int64_t bgpstream_transport_borrow(bgpstream_transport_t *transport,
+                                   const uint8_t **buffer);
+
+/** Skip bytes in the given transport handler
+ *
+ * @param transport     pointer to a transport handler to skip data in
+ * @param len           number of bytes to skip
+ * @return the number of bytes skipped (less than len only at the end of the
+ * data) if successful, -1 otherwise
+ *
+ * Transports that support it (e.g., uncompressed local files) seek over the
+ * data, otherwise it is read and discarded.
+ */
+int64_t bgpstream_transport_skip(bgpstream_transport_t *transport, int64_t len);
+
+/** Get a file descriptor that signals when the transport has data
+ *
+ * @param transport     pointer to a transport handler
+ * @return a descriptor that becomes readable once data may be read, or -1 if
+ * the transport does not support readiness notification
+ *
+ * The descriptor is owned by the transport and must not be closed or read
+ * from by the caller. Spurious wakeups are possible, so callers must be
+ * prepared for a read to still return no data.
+ */
+int bgpstream_transport_get_fd(bgpstream_transport_t *transport);
+
 /** Shutdown and destroy the given transport handler
  *
  * @param transport     pointer to a transport handler to destroy
@@ -89,6 +89,43 @@ struct bgpstream_transport {
   int64_t (*readline)(struct bgpstream_transport *t, uint8_t *buffer,
                       int64_t len);
 
+  /** Skip bytes in this transport without reading them (optional)
+   *
+   * @param t           The data transport object to skip data in
+   * @param len         The number of bytes to skip
+   * @return the number of bytes skipped if successful, -1 otherwise
+   *
+   * Transports that cannot do better than reading the data leave this NULL,
+   * and bgpstream_transport_skip reads and discards the data instead.
+   */
+  int64_t (*skip)(struct bgpstream_transport *t, int64_t len);
+
+  /** Borrow the next chunk of data from this transport (optional)
+   *
+   * @param t           The data transport object to read from
+   * @param[out] buffer Set to point to the data
+   * @return the number of bytes available at buffer if successful, -1
+   * otherwise
+   *
+   * The data is owned by the transport and remains valid until the next call
+   * to any of the read methods. Transports that already hold their data in
+   * memory (e.g., Kafka messages) set this so that formats can parse it
+   * without copying.
+   */
+  int64_t (*borrow)(struct bgpstream_transport *t, const uint8_t **buffer);
+
+  /** Get a file descriptor that signals when data may be read (optional)
+   *
+   * @param t           The data transport object to get the descriptor for
+   * @return a descriptor that becomes readable once a read that returned no
+   * data might return some, or -1 if the transport cannot provide one
+   *
+   * Stream transports set this so that the reader can block until any of them
+   * has data rather than polling them at a fixed interval. The descriptor is
+   * owned by the transport.
+   */
+  int (*get_fd)(struct bgpstream_transport *t);
+
   /** Shutdown and free this data transport
    *
    * @param transport   The data transport object to free
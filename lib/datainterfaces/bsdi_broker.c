@@ -42,11 +42,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <wandio.h>
 
+#include "bgpstream_prefetcher.h"
+#include "transports/bs_transport_cache.h"
+
 #if WITH_KAFKA
 #include "transports/bs_transport_kafka.h"
 #endif
@@ -61,6 +65,11 @@ enum {
   OPTION_BROKER_URL,
   OPTION_PARAM,
   OPTION_CACHE_DIR,
+  OPTION_CACHE_CODEC,
+  OPTION_CACHE_QUOTA,
+  OPTION_CACHE_PREFETCH,
+  OPTION_CACHE_PREFETCH_THREADS,
+  OPTION_CACHE_PREFETCH_QUOTA,
 #if WITH_KAFKA
   OPTION_KAFKA_GROUP,
   OPTION_KAFKA_OFFSET,
@@ -90,6 +99,46 @@ static bgpstream_data_interface_option_t options[] = {
     "cache-dir",                                 // name
     "Enable local cache at provided directory.", // description
   },
+  /* Cache codec */
+  {
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_CODEC,              // internal ID
+    "cache-codec",                   // name
+    "Codec for new cache files: raw, gzip, lz4, zstd (default: "
+    BGPSTREAM_TRANSPORT_CACHE_DEFAULT_CODEC ")", // description
+  },
+  /* Cache quota */
+  {
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_QUOTA,              // internal ID
+    "cache-quota",                   // name
+    "Maximum MB of cache files, least recently used files are evicted "
+    "(default: unlimited)", // description
+  },
+  /* Cache prefetch */
+  {
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_PREFETCH,           // internal ID
+    "cache-prefetch",                // name
+    "Download the next N groups of files into the cache in the background "
+    "(default: 0, suggested: " STR(BGPSTREAM_PREFETCHER_GROUPS_DEFAULT)
+    ")", // description
+  },
+  /* Cache prefetch threads */
+  {
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_PREFETCH_THREADS,   // internal ID
+    "cache-prefetch-threads",        // name
+    "Number of concurrent prefetch downloads (default: " STR(
+      BGPSTREAM_PREFETCHER_THREADS_DEFAULT) ")", // description
+  },
+  /* Cache prefetch quota */
+  {
+    BGPSTREAM_DATA_INTERFACE_BROKER, // interface ID
+    OPTION_CACHE_PREFETCH_QUOTA,     // internal ID
+    "cache-prefetch-quota",          // name
+    "Maximum MB of prefetched files not yet read (default: 1024)",
+  },
 #if WITH_KAFKA
   /* Kafka group */
   {
@@ -141,6 +190,21 @@ typedef struct bsdi_broker_state {
   // User-specified location for cache: NULL means cache disabled
   char *cache_dir;
 
+  // User-specified codec for new cache files: NULL means default
+  char *cache_codec;
+
+  // Maximum total size of the cache files (in bytes): NULL means unlimited
+  char *cache_quota;
+
+  // Number of resource groups to prefetch into the cache: 0 means disabled
+  int cache_prefetch;
+
+  // Number of concurrent prefetch downloads
+  int cache_prefetch_threads;
+
+  // Maximum bytes of prefetched files that have not been read
+  uint64_t cache_prefetch_quota;
+
 #if WITH_KAFKA
   // Kafka group name
   char *kafka_group;
@@ -544,6 +608,20 @@ static int process_json(bsdi_t *di, const char *js, jsmntok_t *root_tok,
                                           STATE->cache_dir) != 0) {
             return -1;
           }
+          if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE &&
+              STATE->cache_quota != NULL &&
+              bgpstream_resource_set_attr(res,
+                                          BGPSTREAM_RESOURCE_ATTR_CACHE_QUOTA,
+                                          STATE->cache_quota) != 0) {
+            return -1;
+          }
+          if (transport_type == BGPSTREAM_RESOURCE_TRANSPORT_CACHE &&
+              STATE->cache_codec != NULL &&
+              bgpstream_resource_set_attr(res,
+                                          BGPSTREAM_RESOURCE_ATTR_CACHE_CODEC,
+                                          STATE->cache_codec) != 0) {
+            return -1;
+          }
         }
       }
     }
@@ -783,6 +861,8 @@ int bsdi_broker_init(bsdi_t *di)
   if ((state->broker_url = strdup(BGPSTREAM_DI_BROKER_URL)) == NULL) {
     goto err;
   }
+  state->cache_prefetch_threads = BGPSTREAM_PREFETCHER_THREADS_DEFAULT;
+  state->cache_prefetch_quota = BGPSTREAM_PREFETCHER_QUOTA_DEFAULT;
 
   return 0;
 err:
@@ -792,6 +872,14 @@ err:
 
 int bsdi_broker_start(bsdi_t *di)
 {
+  if (STATE->cache_dir != NULL && STATE->cache_prefetch > 0 &&
+      bgpstream_resource_mgr_set_prefetch(
+        BSDI_GET_RES_MGR(di), STATE->cache_prefetch,
+        STATE->cache_prefetch_threads, STATE->cache_prefetch_quota) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not start cache prefetcher");
+    return -1;
+  }
+
   return update_query_url(di);
 }
 
@@ -799,6 +887,10 @@ int bsdi_broker_set_option(bsdi_t *di,
                            const bgpstream_data_interface_option_t *option_type,
                            const char *option_value)
 {
+  char quota_buf[32];
+  char *end;
+  long val;
+
   switch (option_type->id) {
   case OPTION_BROKER_URL:
     // replaces our current URL
@@ -834,6 +926,55 @@ int bsdi_broker_set_option(bsdi_t *di,
     }
     break;
 
+  case OPTION_CACHE_CODEC:
+    if (strcmp(option_value, "raw") != 0 && strcmp(option_value, "gzip") != 0 &&
+        strcmp(option_value, "lz4") != 0 && strcmp(option_value, "zstd") != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Unknown cache codec %s", option_value);
+      return -1;
+    }
+    free(STATE->cache_codec);
+    if ((STATE->cache_codec = strdup(option_value)) == NULL) {
+      return -1;
+    }
+    break;
+
+  case OPTION_CACHE_QUOTA:
+    errno = 0;
+    val = strtol(option_value, &end, 10);
+    if (errno != 0 || *end != '\0' || val < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid value for %s: %s",
+                    option_type->name, option_value);
+      return -1;
+    }
+    snprintf(quota_buf, sizeof(quota_buf), "%" PRIu64,
+             (uint64_t)val * 1024 * 1024);
+    free(STATE->cache_quota);
+    if ((STATE->cache_quota = strdup(quota_buf)) == NULL) {
+      return -1;
+    }
+    break;
+
+  case OPTION_CACHE_PREFETCH:
+  case OPTION_CACHE_PREFETCH_THREADS:
+  case OPTION_CACHE_PREFETCH_QUOTA:
+    errno = 0;
+    val = strtol(option_value, &end, 10);
+    if (errno != 0 || *end != '\0' || val < 0 ||
+        (val == 0 && option_type->id != OPTION_CACHE_PREFETCH) ||
+        val > INT_MAX) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid value for %s: %s",
+                    option_type->name, option_value);
+      return -1;
+    }
+    if (option_type->id == OPTION_CACHE_PREFETCH) {
+      STATE->cache_prefetch = val;
+    } else if (option_type->id == OPTION_CACHE_PREFETCH_THREADS) {
+      STATE->cache_prefetch_threads = val;
+    } else {
+      STATE->cache_prefetch_quota = (uint64_t)val * 1024 * 1024;
+    }
+    break;
+
 #if WITH_KAFKA
   case OPTION_KAFKA_GROUP:
     // replaces our current group
@@ -886,6 +1027,12 @@ void bsdi_broker_destroy(bsdi_t *di)
   free(STATE->cache_dir);
   STATE->cache_dir = NULL;
 
+  free(STATE->cache_codec);
+  STATE->cache_codec = NULL;
+
+  free(STATE->cache_quota);
+  STATE->cache_quota = NULL;
+
 #if WITH_KAFKA
   free(STATE->kafka_group);
   STATE->kafka_group = NULL;
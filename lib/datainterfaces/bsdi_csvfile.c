@@ -33,6 +33,8 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -41,11 +43,15 @@
 #define STATE (BSDI_GET_STATE(di, csvfile))
 #define TIF filter_mgr->time_interval
 
+// must hold at least one complete row
+#define BUFFER_LEN 65536
+
 /* ---------- START CLASS DEFINITION ---------- */
 
 /* define the internal option ID values */
 enum {
   OPTION_CSV_FILE,
+  OPTION_SORTED_INDEX,
 };
 
 /* define the options this data interface accepts */
@@ -58,6 +64,14 @@ static bgpstream_data_interface_option_t options[] = {
     "csv file listing the mrt data to read (default: " STR(
       BGPSTREAM_DI_CSVFILE_CSV_FILE) ")",
   },
+  /* Sort the rows before pushing them */
+  {
+    BGPSTREAM_DATA_INTERFACE_CSVFILE, // interface ID
+    OPTION_SORTED_INDEX,              // internal ID
+    "sorted-index",                   // name
+    "load the whole csv file into a time-sorted index before pushing the "
+    "files it lists (0/1) (default: 0)",
+  },
 };
 
 /* create the class structure for this data interface */
@@ -66,12 +80,25 @@ BSDI_CREATE_CLASS(csvfile, BGPSTREAM_DATA_INTERFACE_CSVFILE,
 
 /* ---------- END CLASS DEFINITION ---------- */
 
+typedef struct csv_row {
+  // filename, project and collector share one allocation
+  char *filename;
+  char *project;
+  char *collector;
+  bgpstream_record_type_t record_type;
+  uint32_t filetime;
+  uint32_t time_span;
+} csv_row_t;
+
 typedef struct bsdi_csvfile_state {
   /* user-provided options */
 
   // Path to a CSV file to read
   char *csv_file;
 
+  // Should full reads be sorted by filetime before being pushed?
+  int sorted_index;
+
   /* internal state: */
 
   // CSV parser state
@@ -95,6 +122,34 @@ typedef struct bsdi_csvfile_state {
   uint32_t last_processed_ts;
   /* maximum timestamp accepted in the current round */
   uint32_t max_accepted_ts;
+  /* may this round go over rows that were already pushed? */
+  int reread;
+  /* is this round collecting rows for the sorted index? */
+  int collect;
+
+  /* tailing state: */
+
+  // Offset of the first row that has to be read in the next round
+  int64_t offset;
+
+  // Size and identity of the file when it was last read
+  int64_t size;
+  dev_t dev;
+  ino_t ino;
+
+  // Was the current row too recent to be accepted?
+  int row_held;
+
+  // Has a row been left for the next round?
+  int rows_held;
+
+  // Rows that passed the filters during a sorted full read
+  csv_row_t *rows;
+  int rows_cnt;
+  int rows_alloc;
+
+  // Read buffer (the tail of it may be an incomplete row)
+  char buffer[BUFFER_LEN];
 } bsdi_csvfile_state_t;
 
 enum {
@@ -178,6 +233,86 @@ static int filters_match(bsdi_t *di)
   return 1;
 }
 
+static int cmp_row(const void *a, const void *b)
+{
+  const csv_row_t *ra = a;
+  const csv_row_t *rb = b;
+
+  if (ra->filetime != rb->filetime) {
+    return (ra->filetime < rb->filetime) ? -1 : 1;
+  }
+  return 0;
+}
+
+static int add_row(bsdi_t *di)
+{
+  size_t flen = strlen(STATE->filename) + 1;
+  size_t plen = strlen(STATE->project) + 1;
+  size_t clen = strlen(STATE->collector) + 1;
+  csv_row_t *row, *tmp;
+
+  if (STATE->rows_cnt == STATE->rows_alloc) {
+    STATE->rows_alloc = (STATE->rows_alloc == 0) ? 1024 : STATE->rows_alloc * 2;
+    if ((tmp = realloc(STATE->rows, sizeof(csv_row_t) * STATE->rows_alloc)) ==
+        NULL) {
+      return -1;
+    }
+    STATE->rows = tmp;
+  }
+  row = &STATE->rows[STATE->rows_cnt];
+
+  if ((row->filename = malloc(flen + plen + clen)) == NULL) {
+    return -1;
+  }
+  row->project = row->filename + flen;
+  row->collector = row->project + plen;
+  memcpy(row->filename, STATE->filename, flen);
+  memcpy(row->project, STATE->project, plen);
+  memcpy(row->collector, STATE->collector, clen);
+  row->record_type = STATE->record_type;
+  row->filetime = STATE->filetime;
+  row->time_span = STATE->time_span;
+
+  STATE->rows_cnt++;
+  return 0;
+}
+
+static void free_rows(bsdi_t *di)
+{
+  int i;
+
+  for (i = 0; i < STATE->rows_cnt; i++) {
+    free(STATE->rows[i].filename);
+  }
+  free(STATE->rows);
+  STATE->rows = NULL;
+  STATE->rows_cnt = STATE->rows_alloc = 0;
+}
+
+// Push the rows collected by a sorted full read in filetime order, which lets
+// the resource manager append each of them at the tail of its queue
+static int push_rows(bsdi_t *di)
+{
+  csv_row_t *row;
+  int rc = 0;
+
+  qsort(STATE->rows, STATE->rows_cnt, sizeof(csv_row_t), cmp_row);
+
+  for (row = STATE->rows; row < STATE->rows + STATE->rows_cnt; row++) {
+    if (bgpstream_resource_mgr_push(
+          BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
+          BGPSTREAM_RESOURCE_FORMAT_MRT, row->filename, row->filetime,
+          row->time_span, row->project, row->collector, row->record_type,
+          NULL) < 0) {
+      rc = -1;
+      break;
+    }
+  }
+
+  free_rows(di);
+  return rc;
+}
+
 static void parse_field(void *field, size_t i, void *user_data)
 {
 
@@ -237,19 +372,26 @@ static void parse_rowend(int c, void *user_data)
   /* ensure fields read is compliant with the expected file format */
   assert(STATE->current_field == CSVFILE_FIELDCNT);
 
-  /* check if the timestamp is acceptable */
-  if (STATE->timestamp > STATE->last_processed_ts &&
-      STATE->timestamp <= STATE->max_accepted_ts) {
+  /* check if the timestamp is acceptable (rows past the offset are new, unless
+     we are reading the file again or going over rows after a held one) */
+  if (STATE->timestamp > STATE->max_accepted_ts) {
+    STATE->row_held = 1;
+  } else if (STATE->reread == 0 ||
+             STATE->timestamp > STATE->last_processed_ts) {
     /* update max in file timestamp */
     if (STATE->timestamp > STATE->max_ts_infile) {
       STATE->max_ts_infile = STATE->timestamp;
     }
     if (filters_match(di) != 0) {
-      if (bgpstream_resource_mgr_push(
-            BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
-            BGPSTREAM_RESOURCE_FORMAT_MRT, STATE->filename, STATE->filetime,
-            STATE->time_span, STATE->project, STATE->collector,
-            STATE->record_type, NULL) < 0) {
+      if (STATE->collect != 0) {
+        if (add_row(di) != 0) {
+          assert(0);
+        }
+      } else if (bgpstream_resource_mgr_push(
+                   BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
+                   BGPSTREAM_RESOURCE_FORMAT_MRT, STATE->filename,
+                   STATE->filetime, STATE->time_span, STATE->project,
+                   STATE->collector, STATE->record_type, NULL) < 0) {
         assert(0);
       }
     }
@@ -307,6 +449,18 @@ int bsdi_csvfile_set_option(
     if ((STATE->csv_file = strdup(option_value)) == NULL) {
       return -1;
     }
+    // the next round must read the new file from the start
+    STATE->offset = 0;
+    STATE->size = 0;
+    break;
+
+  case OPTION_SORTED_INDEX:
+    if (strcmp(option_value, "0") != 0 && strcmp(option_value, "1") != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid value for %s: %s",
+                    option_type->name, option_value);
+      return -1;
+    }
+    STATE->sorted_index = (option_value[0] == '1');
     break;
 
   default:
@@ -327,47 +481,150 @@ void bsdi_csvfile_destroy(bsdi_t *di)
 
   csv_free(&STATE->parser);
 
+  free_rows(di);
+
   free(STATE);
   BSDI_SET_STATE(di, NULL);
 }
 
+static int parse_rows(bsdi_t *di, const char *buf, size_t len)
+{
+  if (csv_parse(&(STATE->parser), buf, len, parse_field, parse_rowend, di) !=
+      len) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "CSV parsing error %s",
+                  csv_strerror(csv_error(&STATE->parser)));
+    return -1;
+  }
+  return 0;
+}
+
 int bsdi_csvfile_update_resources(bsdi_t *di)
 {
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
   io_t *file_io = NULL;
-#define BUFFER_LEN 1024
-  char buffer[BUFFER_LEN];
-  int read = 0;
+  struct stat st;
+  int have_stat;
+  int64_t pos, hold_pos = -1;
+  size_t fill = 0, len;
+  char *start, *nl;
+  int64_t read = 0;
 
   /* we accept all timestamp earlier than now() - 1 second */
   STATE->max_accepted_ts = epoch_sec() - 1;
 
   STATE->max_ts_infile = 0;
 
+  // only rows appended since the last round need to be parsed, unless the
+  // file was truncated or replaced, in which case we read it again
+  if ((have_stat = (stat(STATE->csv_file, &st) == 0)) == 0) {
+    // not a local file, so we cannot tell whether it changed
+    STATE->offset = 0;
+  } else if (st.st_dev != STATE->dev || st.st_ino != STATE->ino ||
+             (int64_t)st.st_size < STATE->size) {
+    if (STATE->offset != 0) {
+      bgpstream_log(BGPSTREAM_LOG_INFO, "%s was truncated or replaced",
+                    STATE->csv_file);
+    }
+    STATE->offset = 0;
+  } else if ((int64_t)st.st_size == STATE->size && STATE->rows_held == 0) {
+    // nothing was appended
+    return 0;
+  }
+
   if ((file_io = wandio_create(STATE->csv_file)) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "can't open file %s", STATE->csv_file);
     goto err;
   }
+  if (STATE->offset != 0 &&
+      wandio_seek(file_io, STATE->offset, SEEK_SET) < 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "can't seek in %s, reading it again",
+                  STATE->csv_file);
+    wandio_destroy(file_io);
+    STATE->offset = 0;
+    if ((file_io = wandio_create(STATE->csv_file)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't open file %s", STATE->csv_file);
+      goto err;
+    }
+  }
+  STATE->reread = (STATE->offset == 0 || STATE->rows_held != 0);
+  STATE->collect = (STATE->offset == 0 && STATE->sorted_index != 0);
+  pos = STATE->offset;
+
+  // parse complete rows only, so that a row that is still being written is
+  // read again in the next round
+  while ((read = wandio_read(file_io, STATE->buffer + fill,
+                             BUFFER_LEN - fill)) > 0) {
+    fill += read;
+    start = STATE->buffer;
+    while ((nl = memchr(start, '\n', STATE->buffer + fill - start)) != NULL) {
+      len = nl + 1 - start;
+      if (parse_rows(di, start, len) != 0) {
+        goto err;
+      }
+      if (STATE->row_held != 0) {
+        // the row is too recent, so this is where the next round starts
+        if (hold_pos < 0) {
+          hold_pos = pos;
+        }
+        STATE->row_held = 0;
+      }
+      pos += len;
+      start += len;
+    }
+    fill = STATE->buffer + fill - start;
+    if (fill == BUFFER_LEN) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "CSV row too long in %s",
+                    STATE->csv_file);
+      goto err;
+    }
+    memmove(STATE->buffer, start, fill);
+  }
+  if (read < 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't read file %s", STATE->csv_file);
+    goto err;
+  }
 
-  while ((read = wandio_read(file_io, &buffer, BUFFER_LEN)) > 0) {
-    if (csv_parse(&(STATE->parser), buffer, read, parse_field, parse_rowend,
-                  di) != read) {
+  // in live mode the last row may still be growing, otherwise it is just
+  // missing its newline
+  if (fill != 0 && (TIF == NULL || TIF->end_time != BGPSTREAM_FOREVER)) {
+    if (parse_rows(di, STATE->buffer, fill) != 0) {
+      goto err;
+    }
+    if (csv_fini(&(STATE->parser), parse_field, parse_rowend, di) != 0) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "CSV parsing error %s",
                     csv_strerror(csv_error(&STATE->parser)));
       goto err;
     }
+    if (STATE->row_held != 0 && hold_pos < 0) {
+      hold_pos = pos;
+    }
+    STATE->row_held = 0;
+    pos += fill;
   }
 
-  if (csv_fini(&(STATE->parser), parse_field, parse_rowend, di) != 0) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "CSV parsing error %s",
-                  csv_strerror(csv_error(&STATE->parser)));
+  wandio_destroy(file_io);
+  file_io = NULL;
+
+  if (STATE->rows_cnt != 0 && push_rows(di) != 0) {
     goto err;
   }
 
-  wandio_destroy(file_io);
-
-  STATE->last_processed_ts = STATE->max_ts_infile;
+  STATE->rows_held = (hold_pos >= 0);
+  STATE->offset = STATE->rows_held ? hold_pos : pos;
+  if (have_stat != 0) {
+    STATE->size = st.st_size;
+    STATE->dev = st.st_dev;
+    STATE->ino = st.st_ino;
+  }
+  if (STATE->max_ts_infile > STATE->last_processed_ts) {
+    STATE->last_processed_ts = STATE->max_ts_infile;
+  }
   return 0;
 
 err:
+  if (file_io != NULL) {
+    wandio_destroy(file_io);
+  }
+  free_rows(di);
   return -1;
 }
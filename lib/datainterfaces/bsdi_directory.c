@@ -0,0 +1,813 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bsdi_directory.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "khash.h"
+#include "utils.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#define STATE (BSDI_GET_STATE(di, directory))
+#define TIF filter_mgr->time_interval
+
+// time spanned by each kind of dump (RouteViews publishes updates every 15
+// minutes, RIS every 5 minutes)
+#define RV_UPDATES_SPAN (15 * 60)
+#define RIS_UPDATES_SPAN (5 * 60)
+#define RIBS_SPAN 120
+
+// RouteViews serves route-views2 from the bgpdata directory at the root of
+// the archive, every other collector from <collector>/bgpdata
+#define RV_ROOT_COLLECTOR "route-views2"
+#define RV_COLLECTOR_PREFIX "route-views"
+
+#define INDEX_INIT_LEN 1024
+
+// in live mode, files more than a day older than the newest one are assumed
+// to be complete already, so they are neither pushed nor remembered
+#define LIVE_WINDOW (24 * 3600)
+
+/* ---------- START CLASS DEFINITION ---------- */
+
+/* define the internal option ID values */
+enum {
+  OPTION_DIR,
+};
+
+/* define the options this data interface accepts */
+static bgpstream_data_interface_option_t options[] = {
+  /* Archive root directory */
+  {
+    BGPSTREAM_DATA_INTERFACE_DIRECTORY, // interface ID
+    OPTION_DIR,                         // internal ID
+    "dir",                              // name
+    "root of a RouteViews/RIS archive mirror (default: " STR(
+      BGPSTREAM_DI_DIRECTORY_DIR) ")",
+  },
+};
+
+/* create the class structure for this data interface */
+BSDI_CREATE_CLASS(directory, BGPSTREAM_DATA_INTERFACE_DIRECTORY,
+                  "Index a local tree of MRT archives (watched in live mode)",
+                  options)
+
+/* ---------- END CLASS DEFINITION ---------- */
+
+typedef struct dir_file {
+  // Path of the dump file
+  char *path;
+
+  // Project and collector (collector names are owned by the name set)
+  const char *project;
+  const char *collector;
+
+  bgpstream_record_type_t record_type;
+  uint32_t filetime;
+  uint32_t time_span;
+} dir_file_t;
+
+KHASH_INIT(strset, char *, char, 0, kh_str_hash_func, kh_str_hash_equal)
+KHASH_INIT(strtime, char *, uint32_t, 1, kh_str_hash_func, kh_str_hash_equal)
+KHASH_INIT(wdpath, int, char *, 1, kh_int_hash_func, kh_int_hash_equal)
+
+typedef struct bsdi_directory_state {
+  /* user-provided options */
+
+  // Root of the archive tree
+  char *dir;
+
+  /* internal state: */
+
+  // Files found when the stream started, sorted by (filetime, path)
+  dir_file_t *index;
+  int index_cnt;
+  int index_alloc;
+
+  // Has the index been handed to the resource manager yet?
+  int index_pushed;
+
+  // Collector names referenced by files
+  khash_t(strset) *names;
+
+  // Paths (and filetimes) of the files found since the index was built
+  khash_t(strtime) *seen;
+
+  // Newest filetime found, and the one the seen set was last pruned at
+  uint32_t latest;
+  uint32_t pruned;
+
+  // Are we following the tree for new files?
+  int live;
+
+  // inotify instance and the directory each watch refers to
+  int inotify_fd;
+  khash_t(wdpath) *watches;
+} bsdi_directory_state_t;
+
+static int parse_digits(const char *s, int n)
+{
+  int v = 0;
+
+  for (; n > 0; n--, s++) {
+    if (*s < '0' || *s > '9') {
+      return -1;
+    }
+    v = v * 10 + (*s - '0');
+  }
+  return v;
+}
+
+// Parse the "YYYYMMDD.HHMM" part of an archive file name
+static int parse_filetime(const char *s, uint32_t *filetime)
+{
+  int y, m, d, hh, mm;
+  int era, yoe, doy, doe;
+
+  if ((y = parse_digits(s, 4)) < 1970 || (m = parse_digits(s + 4, 2)) < 1 ||
+      m > 12 || (d = parse_digits(s + 6, 2)) < 1 || d > 31 || s[8] != '.' ||
+      (hh = parse_digits(s + 9, 2)) < 0 || hh > 23 ||
+      (mm = parse_digits(s + 11, 2)) < 0 || mm > 59 ||
+      (s[13] != '\0' && s[13] != '.')) {
+    return -1;
+  }
+
+  // days since the epoch in the proleptic Gregorian calendar (this avoids
+  // timegm, which is not portable, and mktime, which depends on TZ)
+  y -= m <= 2;
+  era = y / 400;
+  yoe = y - era * 400;
+  doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  *filetime = (uint32_t)(era * 146097 + doe - 719468) * 86400 + hh * 3600 +
+              mm * 60;
+  return 0;
+}
+
+static const char *intern_name(bsdi_t *di, const char *name, size_t len)
+{
+  char buf[BGPSTREAM_PAR_MAX_LEN];
+  khiter_t k;
+  int khret;
+  char *cpy;
+
+  if (len >= sizeof(buf)) {
+    return NULL;
+  }
+  memcpy(buf, name, len);
+  buf[len] = '\0';
+
+  if ((k = kh_get(strset, STATE->names, buf)) != kh_end(STATE->names)) {
+    return kh_key(STATE->names, k);
+  }
+  if ((cpy = strdup(buf)) == NULL) {
+    return NULL;
+  }
+  kh_put(strset, STATE->names, cpy, &khret);
+  if (khret < 0) {
+    free(cpy);
+    return NULL;
+  }
+  return cpy;
+}
+
+// Fill in the metadata of the dump at the given path from the archive naming
+// conventions. Returns 0 if the file is a dump, 1 if it should be ignored and
+// -1 on error.
+static int parse_path(bsdi_t *di, const char *path, dir_file_t *f)
+{
+  const char *base, *comp, *end, *root;
+  const char *coll = NULL, *prev = NULL;
+  size_t coll_len = 0, prev_len = 0;
+  int ris = 0, unknown = 0;
+
+  base = strrchr(path, '/');
+  base = (base != NULL) ? base + 1 : path;
+
+  if (strncmp(base, "updates.", 8) == 0) {
+    f->record_type = BGPSTREAM_UPDATE;
+    base += 8;
+  } else if (strncmp(base, "rib.", 4) == 0) {
+    f->record_type = BGPSTREAM_RIB;
+    base += 4;
+  } else if (strncmp(base, "bview.", 6) == 0) {
+    f->record_type = BGPSTREAM_RIB;
+    base += 6;
+  } else {
+    return 1;
+  }
+  if (parse_filetime(base, &f->filetime) != 0) {
+    return 1;
+  }
+
+  // the innermost rrcNN (RIS) or bgpdata (RouteViews) directory tells us who
+  // collected the file
+  root = path + strlen(STATE->dir) + 1;
+  for (comp = path; (end = strchr(comp, '/')) != NULL; comp = end + 1) {
+    if (end - comp == 5 && strncmp(comp, "rrc", 3) == 0 &&
+        parse_digits(comp + 3, 2) >= 0) {
+      ris = 1;
+      unknown = 0;
+      coll = comp;
+      coll_len = 5;
+    } else if (end - comp == 7 && strncmp(comp, "bgpdata", 7) == 0) {
+      ris = 0;
+      unknown = 0;
+      if (prev != NULL && prev_len >= strlen(RV_COLLECTOR_PREFIX) &&
+          strncmp(prev, RV_COLLECTOR_PREFIX, strlen(RV_COLLECTOR_PREFIX)) ==
+            0) {
+        coll = prev;
+        coll_len = prev_len;
+      } else if (comp == root) {
+        coll = RV_ROOT_COLLECTOR;
+        coll_len = strlen(RV_ROOT_COLLECTOR);
+      } else {
+        // some other archive that we cannot tell the collector of
+        coll = NULL;
+        unknown = 1;
+      }
+    }
+    prev = comp;
+    prev_len = end - comp;
+  }
+  if (coll == NULL) {
+    if (unknown != 0) {
+      bgpstream_log(BGPSTREAM_LOG_WARN, "Unknown archive layout, skipping %s",
+                    path);
+    }
+    return 1;
+  }
+
+  if ((f->collector = intern_name(di, coll, coll_len)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not store collector name for %s",
+                  path);
+    return -1;
+  }
+  if (ris != 0) {
+    f->project = "ris";
+    f->time_span =
+      (f->record_type == BGPSTREAM_UPDATE) ? RIS_UPDATES_SPAN : RIBS_SPAN;
+  } else {
+    f->project = "routeviews";
+    f->time_span =
+      (f->record_type == BGPSTREAM_UPDATE) ? RV_UPDATES_SPAN : RIBS_SPAN;
+  }
+  return 0;
+}
+
+static int cmp_file(const void *a, const void *b)
+{
+  const dir_file_t *fa = a;
+  const dir_file_t *fb = b;
+
+  if (fa->filetime != fb->filetime) {
+    return (fa->filetime < fb->filetime) ? -1 : 1;
+  }
+  return strcmp(fa->path, fb->path);
+}
+
+static int filters_match(bsdi_t *di, dir_file_t *f)
+{
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+
+  if (filter_mgr->projects != NULL &&
+      bgpstream_str_set_exists(filter_mgr->projects, (char *)f->project) ==
+        0) {
+    return 0;
+  }
+
+  if (filter_mgr->collectors != NULL &&
+      bgpstream_str_set_exists(filter_mgr->collectors, (char *)f->collector) ==
+        0) {
+    return 0;
+  }
+
+  if (filter_mgr->bgp_types != NULL &&
+      bgpstream_str_set_exists(filter_mgr->bgp_types,
+                               (f->record_type == BGPSTREAM_UPDATE)
+                                 ? "updates"
+                                 : "ribs") == 0) {
+    return 0;
+  }
+
+  if (TIF != NULL) {
+    // filetime (we consider 15 mins before to consider routeviews updates
+    // and 120 seconds to have some margins)
+    if (!((int64_t)f->filetime >= (int64_t)TIF->begin_time - (15 * 60) - 120 &&
+          (TIF->end_time == BGPSTREAM_FOREVER ||
+           f->filetime <= TIF->end_time))) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int push_file(bsdi_t *di, dir_file_t *f)
+{
+  if (bgpstream_resource_mgr_push(
+        BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
+        BGPSTREAM_RESOURCE_FORMAT_MRT, f->path, f->filetime, f->time_span,
+        f->project, f->collector, f->record_type, NULL) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static int index_add(bsdi_t *di, const char *path)
+{
+  dir_file_t f;
+  dir_file_t *tmp;
+  int rc;
+
+  if ((rc = parse_path(di, path, &f)) != 0) {
+    return (rc < 0) ? -1 : 0;
+  }
+
+  if (STATE->index_cnt == STATE->index_alloc) {
+    STATE->index_alloc =
+      (STATE->index_alloc == 0) ? INDEX_INIT_LEN : STATE->index_alloc * 2;
+    if ((tmp = realloc(STATE->index, sizeof(dir_file_t) *
+                                       STATE->index_alloc)) == NULL) {
+      return -1;
+    }
+    STATE->index = tmp;
+  }
+  if ((f.path = strdup(path)) == NULL) {
+    return -1;
+  }
+  STATE->index[STATE->index_cnt++] = f;
+  return 0;
+}
+
+// Forget the files that are older than the live window
+static void prune_seen(bsdi_t *di)
+{
+  khiter_t k;
+
+  for (k = kh_begin(STATE->seen); k != kh_end(STATE->seen); k++) {
+    if (kh_exist(STATE->seen, k) &&
+        kh_val(STATE->seen, k) + LIVE_WINDOW < STATE->latest) {
+      free(kh_key(STATE->seen, k));
+      kh_del(strtime, STATE->seen, k);
+    }
+  }
+  STATE->pruned = STATE->latest;
+}
+
+// Push a file that appeared after the index was built
+static int push_new_file(bsdi_t *di, const char *path)
+{
+  dir_file_t f;
+  khiter_t k;
+  int khret;
+  int rc;
+
+  if ((rc = parse_path(di, path, &f)) != 0) {
+    return (rc < 0) ? -1 : 0;
+  }
+
+  // files that old may have been pruned from the seen set, so we could not
+  // tell whether they were pushed already
+  if (f.filetime + LIVE_WINDOW < STATE->latest) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Ignoring late file: %s", path);
+    return 0;
+  }
+
+  // a file may be reported more than once (e.g., it was completed while the
+  // tree was being indexed, or it was rewritten)
+  f.path = (char *)path;
+  if (bsearch(&f, STATE->index, STATE->index_cnt, sizeof(dir_file_t),
+              cmp_file) != NULL ||
+      kh_get(strtime, STATE->seen, f.path) != kh_end(STATE->seen)) {
+    return 0;
+  }
+  if ((f.path = strdup(path)) == NULL) {
+    return -1;
+  }
+  k = kh_put(strtime, STATE->seen, f.path, &khret);
+  if (khret < 0) {
+    free(f.path);
+    return -1;
+  }
+  kh_val(STATE->seen, k) = f.filetime;
+
+  if (f.filetime > STATE->latest) {
+    STATE->latest = f.filetime;
+    if (STATE->latest - STATE->pruned > LIVE_WINDOW) {
+      prune_seen(di);
+    }
+  }
+
+  if (filters_match(di, &f) == 0) {
+    return 0;
+  }
+  bgpstream_log(BGPSTREAM_LOG_INFO, "New file: %s", path);
+  return push_file(di, &f);
+}
+
+static int watch_dir(bsdi_t *di, const char *path)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  khiter_t k;
+  int khret;
+  int wd;
+  char *cpy;
+
+  // files are only considered complete once they are closed or moved in
+  if ((wd = inotify_add_watch(STATE->inotify_fd, path,
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                                IN_ONLYDIR)) < 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not watch %s: %s", path,
+                  strerror(errno));
+    return 0;
+  }
+  if ((cpy = strdup(path)) == NULL) {
+    return -1;
+  }
+  k = kh_put(wdpath, STATE->watches, wd, &khret);
+  if (khret < 0) {
+    free(cpy);
+    return -1;
+  }
+  if (khret == 0) {
+    // we are already watching this directory
+    free(kh_val(STATE->watches, k));
+  }
+  kh_val(STATE->watches, k) = cpy;
+#endif
+  return 0;
+}
+
+// Walk the tree below path, either building the index or pushing the files
+// that are not in it yet
+static int scan_dir(bsdi_t *di, const char *path, int new_files)
+{
+  char child[BGPSTREAM_DUMP_MAX_LEN];
+  struct dirent *ent;
+  struct stat st;
+  DIR *dir;
+  int is_dir;
+
+  if ((dir = opendir(path)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not open directory %s: %s", path,
+                  strerror(errno));
+    return 0;
+  }
+  if (STATE->inotify_fd >= 0 && watch_dir(di, path) != 0) {
+    goto err;
+  }
+
+  while ((ent = readdir(dir)) != NULL) {
+    // skip ".", ".." and hidden files (e.g., rsync temporaries)
+    if (ent->d_name[0] == '.') {
+      continue;
+    }
+    if (snprintf(child, sizeof(child), "%s/%s", path, ent->d_name) >=
+        (int)sizeof(child)) {
+      bgpstream_log(BGPSTREAM_LOG_WARN, "Path too long: %s/%s", path,
+                    ent->d_name);
+      continue;
+    }
+
+#ifdef DT_DIR
+    if (ent->d_type == DT_DIR || ent->d_type == DT_REG) {
+      is_dir = (ent->d_type == DT_DIR);
+    } else
+#endif
+    {
+      if (stat(child, &st) != 0 ||
+          (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))) {
+        continue;
+      }
+      is_dir = S_ISDIR(st.st_mode);
+    }
+
+    if (is_dir) {
+      if (scan_dir(di, child, new_files) != 0) {
+        goto err;
+      }
+    } else if (new_files != 0) {
+      if (push_new_file(di, child) != 0) {
+        goto err;
+      }
+    } else if (index_add(di, child) != 0) {
+      goto err;
+    }
+  }
+
+  closedir(dir);
+  return 0;
+
+err:
+  closedir(dir);
+  return -1;
+}
+
+static int push_index(bsdi_t *di)
+{
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+  int64_t min_time;
+  int lo = 0, hi = STATE->index_cnt, mid;
+  dir_file_t *f;
+
+  if (TIF != NULL) {
+    // binary search for the first file the time filter may accept
+    min_time = (int64_t)TIF->begin_time - (15 * 60) - 120;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if ((int64_t)STATE->index[mid].filetime < min_time) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+  }
+
+  for (f = STATE->index + lo; f < STATE->index + STATE->index_cnt; f++) {
+    if (TIF != NULL && TIF->end_time != BGPSTREAM_FOREVER &&
+        f->filetime > TIF->end_time) {
+      break;
+    }
+    if (filters_match(di, f) != 0 && push_file(di, f) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+// Handle the pending inotify events, waiting at most timeout ms for some
+static int process_events(bsdi_t *di, int timeout)
+{
+  char buf[4096]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+  char path[BGPSTREAM_DUMP_MAX_LEN];
+  const struct inotify_event *ev;
+  struct pollfd pfd;
+  ssize_t len;
+  char *p;
+  khiter_t k;
+
+  pfd.fd = STATE->inotify_fd;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, timeout) < 0) {
+    if (errno != EINTR) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not poll for new files: %s",
+                    strerror(errno));
+    }
+    // otherwise we were interrupted
+    return -1;
+  }
+
+  while ((len = read(STATE->inotify_fd, buf, sizeof(buf))) > 0) {
+    for (p = buf; p < buf + len;
+         p += sizeof(struct inotify_event) + ev->len) {
+      ev = (const struct inotify_event *)p;
+
+      if ((ev->mask & IN_Q_OVERFLOW) != 0) {
+        // events were dropped, so look for what we missed
+        bgpstream_log(BGPSTREAM_LOG_WARN,
+                      "inotify queue overflowed, rescanning %s", STATE->dir);
+        if (scan_dir(di, STATE->dir, 1) != 0) {
+          return -1;
+        }
+        continue;
+      }
+
+      if ((k = kh_get(wdpath, STATE->watches, ev->wd)) ==
+          kh_end(STATE->watches)) {
+        continue;
+      }
+      if ((ev->mask & IN_IGNORED) != 0) {
+        // the directory is gone
+        free(kh_val(STATE->watches, k));
+        kh_del(wdpath, STATE->watches, k);
+        continue;
+      }
+      if (ev->len == 0 || ev->name[0] == '.') {
+        continue;
+      }
+      if (snprintf(path, sizeof(path), "%s/%s", kh_val(STATE->watches, k),
+                   ev->name) >= (int)sizeof(path)) {
+        continue;
+      }
+
+      if ((ev->mask & IN_ISDIR) != 0) {
+        // files may have been completed before we started watching it
+        if (scan_dir(di, path, 1) != 0) {
+          return -1;
+        }
+      } else if ((ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0) {
+        if (push_new_file(di, path) != 0) {
+          return -1;
+        }
+      }
+    }
+  }
+  if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not read inotify events: %s",
+                  strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+#endif
+
+/* ========== PUBLIC METHODS BELOW HERE ========== */
+
+int bsdi_directory_init(bsdi_t *di)
+{
+  bsdi_directory_state_t *state;
+
+  if ((state = malloc_zero(sizeof(bsdi_directory_state_t))) == NULL) {
+    goto err;
+  }
+  BSDI_SET_STATE(di, state);
+
+  /* set default state */
+  STATE->inotify_fd = -1;
+
+  if ((STATE->names = kh_init(strset)) == NULL ||
+      (STATE->seen = kh_init(strtime)) == NULL ||
+      (STATE->watches = kh_init(wdpath)) == NULL) {
+    goto err;
+  }
+
+  return 0;
+err:
+  bsdi_directory_destroy(di);
+  return -1;
+}
+
+int bsdi_directory_start(bsdi_t *di)
+{
+  bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
+  struct stat st;
+
+  if (STATE->dir == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "The 'dir' option must be set");
+    return -1;
+  }
+  if (stat(STATE->dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "%s is not a directory", STATE->dir);
+    return -1;
+  }
+
+  // in live mode, watch the tree before indexing it so that files completed
+  // while we walk it are not missed
+  if (TIF != NULL && TIF->end_time == BGPSTREAM_FOREVER) {
+    STATE->live = 1;
+#ifdef HAVE_SYS_INOTIFY_H
+    if ((STATE->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create inotify instance: %s",
+                    strerror(errno));
+      return -1;
+    }
+#endif
+  }
+
+  if (scan_dir(di, STATE->dir, 0) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not index %s", STATE->dir);
+    return -1;
+  }
+  qsort(STATE->index, STATE->index_cnt, sizeof(dir_file_t), cmp_file);
+  if (STATE->index_cnt > 0) {
+    STATE->latest = STATE->pruned =
+      STATE->index[STATE->index_cnt - 1].filetime;
+  }
+
+  bgpstream_log(BGPSTREAM_LOG_INFO, "Indexed %d files in %s", STATE->index_cnt,
+                STATE->dir);
+  return 0;
+}
+
+int bsdi_directory_set_option(
+  bsdi_t *di, const bgpstream_data_interface_option_t *option_type,
+  const char *option_value)
+{
+  size_t len;
+
+  switch (option_type->id) {
+  case OPTION_DIR:
+    // replaces our current directory
+    free(STATE->dir);
+    if ((STATE->dir = strdup(option_value)) == NULL) {
+      return -1;
+    }
+    // paths are built as <dir>/<name>
+    len = strlen(STATE->dir);
+    while (len > 1 && STATE->dir[len - 1] == '/') {
+      STATE->dir[--len] = '\0';
+    }
+    break;
+
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+void bsdi_directory_destroy(bsdi_t *di)
+{
+  int i;
+
+  if (di == NULL || STATE == NULL) {
+    return;
+  }
+
+  free(STATE->dir);
+  STATE->dir = NULL;
+
+  for (i = 0; i < STATE->index_cnt; i++) {
+    free(STATE->index[i].path);
+  }
+  free(STATE->index);
+  STATE->index = NULL;
+
+  if (STATE->names != NULL) {
+    kh_free(strset, STATE->names, free);
+    kh_destroy(strset, STATE->names);
+  }
+  if (STATE->seen != NULL) {
+    kh_free(strtime, STATE->seen, free);
+    kh_destroy(strtime, STATE->seen);
+  }
+  if (STATE->watches != NULL) {
+    kh_free_vals(wdpath, STATE->watches, free);
+    kh_destroy(wdpath, STATE->watches);
+  }
+  if (STATE->inotify_fd >= 0) {
+    close(STATE->inotify_fd);
+  }
+
+  free(STATE);
+  BSDI_SET_STATE(di, NULL);
+}
+
+int bsdi_directory_update_resources(bsdi_t *di)
+{
+  if (STATE->index_pushed == 0) {
+    STATE->index_pushed = 1;
+    if (push_index(di) != 0) {
+      return -1;
+    }
+  }
+
+  if (STATE->live == 0) {
+    return 0;
+  }
+
+#ifdef HAVE_SYS_INOTIFY_H
+  // rather than leaving the DI manager to sleep when we have nothing to read,
+  // wait for the next file so that it is read as soon as it is complete
+  do {
+    if (process_events(di, bgpstream_resource_mgr_empty(BSDI_GET_RES_MGR(di))
+                             ? -1
+                             : 0) != 0) {
+      return -1;
+    }
+  } while (bgpstream_resource_mgr_empty(BSDI_GET_RES_MGR(di)) != 0);
+  return 0;
+#else
+  // without inotify, walk the tree again looking for new files
+  return scan_dir(di, STATE->dir, 1);
+#endif
+}
@@ -38,6 +38,11 @@
 
 #define DEFAULT_PROJECT ""
 #define DEFAULT_COLLECTOR ""
+#define DEFAULT_CONSUMERS 1
+#define DEFAULT_MAX_LATENESS 1000
+
+// number of records each consumer may decode ahead of the stream
+#define DECODE_QUEUE_LEN "1024"
 
 // mapping from type name to resource format type
 static const char *type_strs[] = {
@@ -63,6 +68,8 @@ enum {
   OPTION_DATA_TYPE,      //
   OPTION_PROJECT,        //
   OPTION_COLLECTOR,      //
+  OPTION_CONSUMERS,      // number of consumers to split partitions across
+  OPTION_MAX_LATENESS,   // how long to wait for an idle consumer
 };
 
 /* define the options this data interface accepts */
@@ -116,6 +123,22 @@ static bgpstream_data_interface_option_t options[] = {
     "collector",                    // name
     "set collector name (default: unset)",
   },
+  /* Consumers */
+  {
+    BGPSTREAM_DATA_INTERFACE_KAFKA, // interface ID
+    OPTION_CONSUMERS,               // internal ID
+    "consumers",                    // name
+    "number of consumers to decode topic partitions in parallel (default: "
+    STR(DEFAULT_CONSUMERS) ")",
+  },
+  /* Max lateness */
+  {
+    BGPSTREAM_DATA_INTERFACE_KAFKA, // interface ID
+    OPTION_MAX_LATENESS,            // internal ID
+    "max-lateness",                 // name
+    "msec to wait for an idle consumer before passing it (0 to always wait) "
+    "(default: " STR(DEFAULT_MAX_LATENESS) ")",
+  },
 };
 
 /* create the class structure for this data interface */
@@ -149,11 +172,60 @@ typedef struct bsdi_kafka_state {
   // Type of the data to be consumed
   bgpstream_resource_format_type_t data_type;
 
+  // Number of consumers (resources) to share the topic partitions between
+  int consumers;
+
+  // How long to wait for an idle consumer (msec)
+  uint32_t max_lateness;
+
   // we only ever yield one resource
   int done;
 
 } bsdi_kafka_state_t;
 
+static int add_consumer(bsdi_t *di)
+{
+  int rc;
+  bgpstream_resource_t *res = NULL;
+
+  // we treat kafka as having data from <recent> to <forever>
+  if ((rc = bgpstream_resource_mgr_push(
+         BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_KAFKA,
+         STATE->data_type, STATE->brokers,
+         0, // indicate we don't know how much historical data there is
+         BGPSTREAM_FOREVER, // indicate that the resource is a "stream"
+         STATE->project, STATE->collector, BGPSTREAM_UPDATE, &res)) <= 0) {
+    return rc;
+  }
+  assert(res != NULL);
+
+  if (bgpstream_resource_set_attr(res, BGPSTREAM_RESOURCE_ATTR_KAFKA_TOPICS,
+                                  STATE->topic_name) != 0) {
+    return -1;
+  }
+
+  if (STATE->group != NULL &&
+      bgpstream_resource_set_attr(
+        res, BGPSTREAM_RESOURCE_ATTR_KAFKA_CONSUMER_GROUP, STATE->group) != 0) {
+    return -1;
+  }
+
+  if (STATE->offset != NULL &&
+      bgpstream_resource_set_attr(
+        res, BGPSTREAM_RESOURCE_ATTR_KAFKA_INIT_OFFSET, STATE->offset) != 0) {
+    return -1;
+  }
+
+  // with several consumers, decode each on its own thread
+  if (STATE->consumers > 1 &&
+      bgpstream_resource_set_attr(res, BGPSTREAM_RESOURCE_ATTR_DECODE_QUEUE_LEN,
+                                  DECODE_QUEUE_LEN) != 0) {
+    return -1;
+  }
+
+  return 1;
+}
+
 /* ========== PUBLIC METHODS BELOW HERE ========== */
 
 int bsdi_kafka_init(bsdi_t *di)
@@ -169,6 +241,8 @@ int bsdi_kafka_init(bsdi_t *di)
   state->data_type = BGPSTREAM_RESOURCE_FORMAT_BMP;
   state->project = strdup(DEFAULT_PROJECT);
   state->collector = strdup(DEFAULT_COLLECTOR);
+  state->consumers = DEFAULT_CONSUMERS;
+  state->max_lateness = DEFAULT_MAX_LATENESS;
 
   return 0;
 err:
@@ -190,6 +264,20 @@ int bsdi_kafka_start(bsdi_t *di)
       "ERROR: The kafka data interface requires the 'topic' option be set\n");
     return -1;
   }
+
+  // consumers only share partitions if they are in the same group
+  if (STATE->consumers > 1 && STATE->group == NULL) {
+    uint64_t ts = epoch_msec();
+    char buf[1024];
+    srand(ts);
+    snprintf(buf, sizeof(buf), "bgpstream-%" PRIx64 "-%x", ts, rand());
+    if ((STATE->group = strdup(buf)) == NULL) {
+      return -1;
+    }
+  }
+
+  bgpstream_resource_mgr_set_max_lateness(BSDI_GET_RES_MGR(di),
+                                          STATE->max_lateness);
   return 0;
 }
 
@@ -269,6 +357,18 @@ int bsdi_kafka_set_option(bsdi_t *di,
     }
     break;
 
+  case OPTION_CONSUMERS:
+    if ((STATE->consumers = atoi(option_value)) < 1) {
+      fprintf(stderr, "ERROR: Invalid number of consumers '%s'\n",
+              option_value);
+      return -1;
+    }
+    break;
+
+  case OPTION_MAX_LATENESS:
+    STATE->max_lateness = strtoul(option_value, NULL, 10);
+    break;
+
   default:
     return -1;
   }
@@ -307,41 +407,22 @@ void bsdi_kafka_destroy(bsdi_t *di)
 int bsdi_kafka_update_resources(bsdi_t *di)
 {
   int rc;
-  bgpstream_resource_t *res = NULL;
+  int i;
 
-  // we only ever yield one resource
+  // we only ever yield one set of resources
   if (STATE->done != 0) {
     return 0;
   }
   STATE->done = 1;
 
-  // we treat kafka as having data from <recent> to <forever>
-  if ((rc = bgpstream_resource_mgr_push(
-         BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_KAFKA,
-         STATE->data_type, STATE->brokers,
-         0, // indicate we don't know how much historical data there is
-         BGPSTREAM_FOREVER, // indicate that the resource is a "stream"
-         STATE->project, STATE->collector, BGPSTREAM_UPDATE, &res)) <= 0) {
-    return rc;
-  }
-  assert(res != NULL);
-
-  if (bgpstream_resource_set_attr(res, BGPSTREAM_RESOURCE_ATTR_KAFKA_TOPICS,
-                                  STATE->topic_name) != 0) {
-    return -1;
-  }
-
-  if (STATE->group != NULL &&
-      bgpstream_resource_set_attr(
-        res, BGPSTREAM_RESOURCE_ATTR_KAFKA_CONSUMER_GROUP, STATE->group) != 0) {
-    return -1;
-  }
-
-  if (STATE->offset != NULL &&
-      bgpstream_resource_set_attr(
-        res, BGPSTREAM_RESOURCE_ATTR_KAFKA_INIT_OFFSET, STATE->offset) != 0) {
-    return -1;
+  // one resource per consumer. since they share a group, kafka assigns each
+  // a subset of the partitions, and the resource manager merges them by time
+  for (i = 0; i < STATE->consumers; i++) {
+    if ((rc = add_consumer(di)) <= 0) {
+      return rc;
+    }
   }
 
   return 0;
 }
+
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bsdi_shm.h"
+#include "bgpstream_log.h"
+#include "bgpstream_shm.h"
+#include "config.h"
+#include "utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STATE (BSDI_GET_STATE(di, shm))
+
+#define DEFAULT_OFFSET "latest"
+
+// allowed offset types
+static const char *offset_strs[] = {
+  "earliest", // start from the oldest data in the ring
+  "latest",   // start from the newest data in the ring
+};
+
+/* ---------- START CLASS DEFINITION ---------- */
+
+/* define the internal option ID values */
+enum {
+  OPTION_NAME,   // stored in res->url
+  OPTION_OFFSET, // stored in shm_init_offset res attribute
+};
+
+/* define the options this data interface accepts */
+static bgpstream_data_interface_option_t options[] = {
+  /* Shared memory name */
+  {
+    BGPSTREAM_DATA_INTERFACE_SHM, // interface ID
+    OPTION_NAME,                  // internal ID
+    "name",                       // name
+    "shared memory ring name (default: " BGPSTREAM_SHM_NAME_DEFAULT ")",
+  },
+  /* Initial offset */
+  {
+    BGPSTREAM_DATA_INTERFACE_SHM, // interface ID
+    OPTION_OFFSET,                // internal ID
+    "offset",                     // name
+    "initial offset (earliest/latest) (default: " DEFAULT_OFFSET ")",
+  },
+};
+
+/* create the class structure for this data interface */
+BSDI_CREATE_CLASS(
+  shm, BGPSTREAM_DATA_INTERFACE_SHM,
+  "Read records published by a local process into a shared memory ring",
+  options)
+
+/* ---------- END CLASS DEFINITION ---------- */
+
+typedef struct bsdi_shm_state {
+  /* user-provided options: */
+
+  // Name of the shared memory ring
+  char *name;
+
+  // Offset
+  char *offset;
+
+  // we only ever yield one resource
+  int done;
+
+} bsdi_shm_state_t;
+
+/* ========== PUBLIC METHODS BELOW HERE ========== */
+
+int bsdi_shm_init(bsdi_t *di)
+{
+  bsdi_shm_state_t *state;
+
+  if ((state = malloc_zero(sizeof(bsdi_shm_state_t))) == NULL) {
+    goto err;
+  }
+  BSDI_SET_STATE(di, state);
+
+  /* set default state */
+  if ((state->name = strdup(BGPSTREAM_SHM_NAME_DEFAULT)) == NULL ||
+      (state->offset = strdup(DEFAULT_OFFSET)) == NULL) {
+    goto err;
+  }
+
+  return 0;
+err:
+  bsdi_shm_destroy(di);
+  return -1;
+}
+
+int bsdi_shm_start(bsdi_t *di)
+{
+  // everything has a default
+  return 0;
+}
+
+int bsdi_shm_set_option(bsdi_t *di,
+                        const bgpstream_data_interface_option_t *option_type,
+                        const char *option_value)
+{
+  int found = 0;
+
+  switch (option_type->id) {
+  case OPTION_NAME:
+    free(STATE->name);
+    if ((STATE->name = strdup(option_value)) == NULL) {
+      return -1;
+    }
+    break;
+
+  case OPTION_OFFSET:
+    for (int i = 0; i < ARR_CNT(offset_strs); i++) {
+      if (strcmp(option_value, offset_strs[i]) == 0) {
+        found = 1;
+        break;
+      }
+    }
+    if (!found) {
+      fprintf(stderr,
+              "ERROR: Unknown offset type '%s'. Allowed options are: "
+              "earliest/latest\n",
+              option_value);
+      return -1;
+    }
+    free(STATE->offset);
+    if ((STATE->offset = strdup(option_value)) == NULL) {
+      return -1;
+    }
+    break;
+
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+void bsdi_shm_destroy(bsdi_t *di)
+{
+  if (di == NULL || STATE == NULL) {
+    return;
+  }
+
+  free(STATE->name);
+  STATE->name = NULL;
+
+  free(STATE->offset);
+  STATE->offset = NULL;
+
+  free(STATE);
+  BSDI_SET_STATE(di, NULL);
+}
+
+int bsdi_shm_update_resources(bsdi_t *di)
+{
+  int rc;
+  bgpstream_resource_t *res = NULL;
+
+  // we only ever yield one resource
+  if (STATE->done != 0) {
+    return 0;
+  }
+  STATE->done = 1;
+
+  // the project and collector names come from the published records, and
+  // like kafka, the ring is treated as a "stream"
+  if ((rc = bgpstream_resource_mgr_push(
+         BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_SHM,
+         BGPSTREAM_RESOURCE_FORMAT_BINARY, STATE->name,
+         0, // indicate we don't know how much historical data there is
+         BGPSTREAM_FOREVER, // indicate that the resource is a "stream"
+         "", "", BGPSTREAM_UPDATE, &res)) <= 0) {
+    return rc;
+  }
+  assert(res != NULL);
+
+  if (bgpstream_resource_set_attr(res, BGPSTREAM_RESOURCE_ATTR_SHM_INIT_OFFSET,
+                                  STATE->offset) != 0) {
+    return -1;
+  }
+
+  return 0;
+}
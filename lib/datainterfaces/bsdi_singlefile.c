@@ -44,6 +44,8 @@ static const char *type_strs[] = {
   "mrt",      // BGPSTREAM_RESOURCE_FORMAT_MRT
   "bmp",      // BGPSTREAM_RESOURCE_FORMAT_BMP
   "ris-live",  // BGPSTREAM_RESOURCE_FORMAT_RISLIVE
+  "binary",   // BGPSTREAM_RESOURCE_FORMAT_BINARY
+  "columnar", // BGPSTREAM_RESOURCE_FORMAT_COLUMNAR
 };
 
 /* ---------- START CLASS DEFINITION ---------- */
@@ -54,6 +56,7 @@ enum {
   OPTION_RIB_TYPE,
   OPTION_UPDATE_FILE,
   OPTION_UPDATE_TYPE,
+  OPTION_UPDATE_WORKERS,
 };
 
 /* define the options this data interface accepts */
@@ -70,7 +73,7 @@ static bgpstream_data_interface_option_t options[] = {
     BGPSTREAM_DATA_INTERFACE_SINGLEFILE, // interface ID
     OPTION_RIB_TYPE,                     // internal ID
     "rib-type",                          // name
-    "rib file type (mrt/bmp) (default: mrt)",
+    "rib file type (mrt/bmp/ris-live/binary/columnar) (default: mrt)",
   },
   /* Update file path */
   {
@@ -85,7 +88,14 @@ static bgpstream_data_interface_option_t options[] = {
     BGPSTREAM_DATA_INTERFACE_SINGLEFILE, // interface ID
     OPTION_UPDATE_TYPE,                  // internal ID
     "upd-type",                          // name
-    "update file type (mrt/bmp/ris-live) (default: mrt)",
+    "update file type (mrt/bmp/ris-live/binary/columnar) (default: mrt)",
+  },
+  /* Update file workers */
+  {
+    BGPSTREAM_DATA_INTERFACE_SINGLEFILE, // interface ID
+    OPTION_UPDATE_WORKERS,               // internal ID
+    "upd-workers",                       // name
+    "threads to decode a ris-live update file with (default: 1)",
   },
 };
 
@@ -104,6 +114,9 @@ BSDI_CREATE_CLASS(singlefile, BGPSTREAM_DATA_INTERFACE_SINGLEFILE,
 /* max number of bytes to read from file header (to detect file changes) */
 #define MAX_HEADER_READ_BYTES 1024
 
+/* number of records each worker may decode ahead of the stream */
+#define DECODE_QUEUE_LEN "1024"
+
 typedef struct bsdi_singlefile_state {
   /* user-provided options: */
 
@@ -119,6 +132,9 @@ typedef struct bsdi_singlefile_state {
   // Type of the given Update file (MRT/BMP)
   bgpstream_resource_format_type_t update_type;
 
+  // Number of threads to decode the update file with
+  int update_workers;
+
   /* internal state: */
 
   // a few bytes from the beginning of the RIB file (used to tell if a symlink
@@ -165,6 +181,74 @@ static int same_header(char *filename, char *prev_hdr)
   return 0; // not the same header
 }
 
+/* get the size of the given file, or -1 if it cannot be split (i.e., it is
+   compressed) */
+static int64_t split_size(char *filename)
+{
+  int64_t size = -1;
+  io_t *io_h;
+
+  if ((io_h = wandio_create(filename)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "can't open file '%s'", filename);
+    return -1;
+  }
+  if (wandio_seek(io_h, 0, SEEK_END) >= 0) {
+    size = wandio_tell(io_h);
+  }
+  wandio_destroy(io_h);
+
+  return size;
+}
+
+/* add the update file, split into newline-aligned chunks that are decoded in
+   parallel, and merged back into time order by the resource manager */
+static int push_update_chunks(bsdi_t *di)
+{
+  bgpstream_resource_t *res = NULL;
+  int64_t size = -1;
+  int chunks = 1;
+  char range[64];
+  int rc;
+  int i;
+
+  if (STATE->update_workers > 1) {
+    size = split_size(STATE->update_file);
+  }
+  if (size > 0) {
+    chunks = STATE->update_workers;
+  } else if (STATE->update_workers > 1) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "Cannot split %s (compressed?), decoding it on one thread",
+                  STATE->update_file);
+  }
+
+  for (i = 0; i < chunks; i++) {
+    if ((rc = bgpstream_resource_mgr_push(
+           BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
+           STATE->update_type, STATE->update_file, STATE->last_update_filetime,
+           UPDATE_FREQUENCY_CHECK, "singlefile", "singlefile",
+           BGPSTREAM_UPDATE, &res)) <= 0) {
+      // the file may have been filtered out
+      return rc;
+    }
+    if (chunks > 1) {
+      snprintf(range, sizeof(range), "%" PRId64 "-%" PRId64,
+               size * i / chunks, size * (i + 1) / chunks);
+      if (bgpstream_resource_set_attr(res, BGPSTREAM_RESOURCE_ATTR_FILE_RANGE,
+                                      range) != 0) {
+        return -1;
+      }
+    }
+    if (bgpstream_resource_set_attr(res,
+                                    BGPSTREAM_RESOURCE_ATTR_DECODE_QUEUE_LEN,
+                                    DECODE_QUEUE_LEN) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
 /* ========== PUBLIC METHODS BELOW HERE ========== */
 
 int bsdi_singlefile_init(bsdi_t *di)
@@ -179,6 +263,7 @@ int bsdi_singlefile_init(bsdi_t *di)
   /* set default state */
   state->rib_type = BGPSTREAM_RESOURCE_FORMAT_MRT;
   state->update_type = BGPSTREAM_RESOURCE_FORMAT_MRT;
+  state->update_workers = 1;
 
   return 0;
 err:
@@ -188,6 +273,12 @@ err:
 
 int bsdi_singlefile_start(bsdi_t *di)
 {
+  if (STATE->update_workers > 1 &&
+      STATE->update_type != BGPSTREAM_RESOURCE_FORMAT_RISLIVE) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "The 'upd-workers' option requires a ris-live update file");
+    return -1;
+  }
   if (STATE->rib_file || STATE->update_file) {
     return 0;
   } else {
@@ -259,6 +350,14 @@ int bsdi_singlefile_set_option(
     }
     break;
 
+  case OPTION_UPDATE_WORKERS:
+    if ((STATE->update_workers = atoi(option_value)) < 1) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid upd-workers specified: '%s'",
+                    option_value);
+      return -1;
+    }
+    break;
+
   default:
     return -1;
   }
@@ -308,11 +407,15 @@ int bsdi_singlefile_update_resources(bsdi_t *di)
       same_header(STATE->update_file, STATE->update_header) == 0) {
     STATE->last_update_filetime = now;
 
-    if (bgpstream_resource_mgr_push(
-          BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
-          STATE->update_type, STATE->update_file, STATE->last_update_filetime,
-          UPDATE_FREQUENCY_CHECK, "singlefile", "singlefile", BGPSTREAM_UPDATE,
-          NULL) < 0) {
+    if (STATE->update_workers > 1) {
+      if (push_update_chunks(di) != 0) {
+        goto err;
+      }
+    } else if (bgpstream_resource_mgr_push(
+                 BSDI_GET_RES_MGR(di), BGPSTREAM_RESOURCE_TRANSPORT_FILE,
+                 STATE->update_type, STATE->update_file,
+                 STATE->last_update_filetime, UPDATE_FREQUENCY_CHECK,
+                 "singlefile", "singlefile", BGPSTREAM_UPDATE, NULL) < 0) {
       goto err;
     }
   }
@@ -185,13 +185,25 @@ static ssize_t refill_buffer(bgpstream_parsebgp_decode_state_t *state,
   size_t len = 0;
   int64_t new_read = 0;
 
+  // if there is no partial message to complete, parse straight from the
+  // transport's data if it lets us
+  if (state->remain == 0 && bgpstream_transport_can_borrow(transport) != 0) {
+    return bgpstream_transport_borrow(transport, &state->ptr);
+  }
+
   if (state->remain > 0) {
+    // a partial message left in borrowed data could be larger than our buffer
+    if (state->remain >= BGPSTREAM_PARSEBGP_BUFLEN) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Partial message too large (%zu bytes)",
+                    state->remain);
+      errno = EMSGSIZE;
+      return -1;
+    }
     // need to move remaining data to start of buffer
-    memmove(state->buffer,
-            state->buffer + BGPSTREAM_PARSEBGP_BUFLEN - state->remain,
-            state->remain);
+    memmove(state->buffer, state->ptr, state->remain);
     len += state->remain;
   }
+  state->ptr = state->buffer;
 
   // try and do a read
   if ((new_read = bgpstream_transport_read(transport, state->buffer + len,
@@ -548,9 +560,8 @@ refill:
       record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
       return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
     }
-    // here we have something new to read
+    // here we have something new to read (refill_buffer has set ptr)
     state->remain = fill_len;
-    state->ptr = state->buffer;
 
     // reset the "force refill" flag
     refill = 0;
@@ -143,8 +143,9 @@ typedef struct bgpstream_parsebgp_decode_state {
   // number of bytes left to read in the buffer
   size_t remain;
 
-  // pointer into buffer
-  uint8_t *ptr;
+  // pointer to the next byte to parse (into buffer, or into data borrowed
+  // from the transport)
+  const uint8_t *ptr;
 
   // the total number of successful (filtered and not) reads
   uint64_t successful_read_cnt;
@@ -203,7 +204,7 @@ typedef bgpstream_parsebgp_check_filter_rc_t(
  * @return 0 if successful, -1 otherwise
  */
 typedef int(bgpstream_parsebgp_prep_buf_cb_t)(bgpstream_format_t *format,
-                                              uint8_t *buf, size_t *len,
+                                              const uint8_t *buf, size_t *len,
                                               bgpstream_record_t *record);
 
 /** Use libparsebgp to decode a message */
@@ -0,0 +1,678 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bs_format_binary.h"
+#include "bgpstream_binary.h"
+#include "bgpstream_codec.h"
+#include "bgpstream_format_interface.h"
+#include "bgpstream_log.h"
+#include "bgpstream_record_int.h"
+#include "bgpstream_utils_community_int.h"
+#include "utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STATE ((state_t *)(format->state))
+#define RDATA ((rec_data_t *)(record->__int->data))
+#define TIF filter_mgr->time_interval
+
+/* Upper bound on the length of a message we are willing to buffer. This is far
+ * more than any real record needs, and stops a corrupted length from turning
+ * into a huge allocation. */
+#define MSG_MAX_LEN (64 * 1024 * 1024)
+
+/* peer dictionary entry */
+typedef struct peer {
+  bgpstream_ip_addr_t ip;
+  uint32_t asn;
+} peer_t;
+
+/* Peer dictionary, indexed by ID. The elems of a record are decoded after the
+ * stream has moved on (the reader prefetches the next record, which may cross
+ * a sync point, and retained records may be decoded on other threads), so each
+ * record keeps a reference to the dictionary that was current when it was
+ * read. A dictionary that is shared with records is never modified: it is
+ * copied first. */
+typedef struct peer_dict {
+  int refcnt;
+  peer_t *peers;
+  uint32_t alloc_cnt;
+} peer_dict_t;
+
+typedef struct rec_data {
+  // reusable elem instance
+  bgpstream_elem_t *elem;
+
+  // encoded elems of the current record (the AS paths of the elems we return
+  // point into this buffer)
+  uint8_t *buf;
+  size_t len;
+  size_t alloc_len;
+
+  // offset of the next elem to decode, and number of elems left
+  size_t off;
+  uint64_t elems_cnt;
+
+  // peer dictionary the elems refer to
+  peer_dict_t *peers;
+
+} rec_data_t;
+
+typedef struct state {
+  // has the stream header been read?
+  int header_read;
+
+  // must AS path segments be byte-swapped?
+  int swap_path;
+
+  // string dictionary, indexed by ID (ID 0 is always the empty string)
+  char (*strs)[BGPSTREAM_UTILS_STR_NAME_LEN];
+  uint32_t strs_alloc_cnt;
+
+  // current peer dictionary (NULL until the first peer is defined)
+  peer_dict_t *peers;
+
+  // time of the previous record in the stream
+  uint32_t last_time_sec;
+
+  // buffer for dictionary messages
+  uint8_t *buf;
+  size_t alloc_len;
+
+} state_t;
+
+/* ======================================================== */
+/* ==================== DECODE UTILITIES ==================== */
+/* ======================================================== */
+
+/* check (and if needed, byte-swap) the AS path segments in the given
+ * buffer */
+static int check_path(uint8_t *data, size_t len, int swap)
+{
+  uint8_t *end = data + len;
+  size_t cnt;
+  uint32_t asn;
+
+  while (data < end) {
+    if (*data == BGPSTREAM_AS_PATH_SEG_ASN) {
+      cnt = 1;
+      data++;
+    } else if (*data >= BGPSTREAM_AS_PATH_SEG_SET &&
+               *data <= BGPSTREAM_AS_PATH_SEG_CONFED_SET && end - data >= 2) {
+      cnt = data[1];
+      data += 2;
+    } else {
+      return -1;
+    }
+    if ((size_t)(end - data) < cnt * sizeof(uint32_t)) {
+      return -1;
+    }
+    for (; swap && cnt > 0; cnt--, data += sizeof(uint32_t)) {
+      memcpy(&asn, data, sizeof(asn));
+      asn = __builtin_bswap32(asn);
+      memcpy(data, &asn, sizeof(asn));
+    }
+    data += cnt * sizeof(uint32_t);
+  }
+  return 0;
+}
+
+/* ======================================================== */
+/* ==================== PEER DICTIONARIES ==================== */
+/* ======================================================== */
+
+static void peer_dict_release(peer_dict_t *dict)
+{
+  if (dict == NULL ||
+      __atomic_sub_fetch(&dict->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+  free(dict->peers);
+  free(dict);
+}
+
+static peer_dict_t *peer_dict_retain(peer_dict_t *dict)
+{
+  if (dict != NULL) {
+    __atomic_add_fetch(&dict->refcnt, 1, __ATOMIC_RELAXED);
+  }
+  return dict;
+}
+
+/* get a dictionary that only the stream refers to, so that it may be
+ * modified */
+static peer_dict_t *peer_dict_unshare(bgpstream_format_t *format)
+{
+  peer_dict_t *old = STATE->peers;
+  peer_dict_t *dict;
+
+  if (old != NULL && __atomic_load_n(&old->refcnt, __ATOMIC_ACQUIRE) == 1) {
+    return old;
+  }
+  if ((dict = malloc_zero(sizeof(peer_dict_t))) == NULL) {
+    return NULL;
+  }
+  dict->refcnt = 1;
+  if (old != NULL && old->alloc_cnt > 0) {
+    if ((dict->peers = malloc(sizeof(peer_t) * old->alloc_cnt)) == NULL) {
+      free(dict);
+      return NULL;
+    }
+    memcpy(dict->peers, old->peers, sizeof(peer_t) * old->alloc_cnt);
+    dict->alloc_cnt = old->alloc_cnt;
+  }
+  peer_dict_release(old);
+  STATE->peers = dict;
+  return dict;
+}
+
+/* ======================================================== */
+/* ==================== STREAM READING ==================== */
+/* ======================================================== */
+
+static int grow(uint8_t **buf, size_t *alloc_len, size_t len)
+{
+  uint8_t *tmp;
+
+  if (len <= *alloc_len) {
+    return 0;
+  }
+  if ((tmp = realloc(*buf, len)) == NULL) {
+    return -1;
+  }
+  *buf = tmp;
+  *alloc_len = len;
+  return 0;
+}
+
+static bgpstream_format_status_t read_header(bgpstream_format_t *format)
+{
+  uint8_t hdr[BGPSTREAM_BINARY_HEADER_LEN];
+  int64_t rc;
+  int big_endian;
+
+  if ((rc = codec_read_full(format->transport, hdr, sizeof(hdr))) == 0) {
+    return BGPSTREAM_FORMAT_EMPTY_DUMP;
+  }
+  if (rc < 0 || memcmp(hdr, BGPSTREAM_BINARY_MAGIC,
+                       sizeof(BGPSTREAM_BINARY_MAGIC) - 1) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "%s is not a binary elem stream",
+                  format->res->url);
+    return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+  }
+  if (hdr[5] != BGPSTREAM_BINARY_VERSION) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Unsupported binary elem stream version (%d) in %s", hdr[5],
+                  format->res->url);
+    return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+  }
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  big_endian = 1;
+#else
+  big_endian = 0;
+#endif
+  STATE->swap_path =
+    ((hdr[6] & BGPSTREAM_BINARY_FLAG_BIG_ENDIAN) != 0) != big_endian;
+  STATE->header_read = 1;
+  return BGPSTREAM_FORMAT_OK;
+}
+
+/* read the type and payload length of the next message. returns 1 if a header
+ * was read, 0 on EOF, -1 on error */
+static int read_msg_header(bgpstream_format_t *format, uint8_t *type,
+                           uint64_t *len)
+{
+  int64_t rc;
+
+  if ((rc = codec_read_full(format->transport, type, 1)) <= 0) {
+    return (int)rc;
+  }
+  return (codec_read_varint(format->transport, len) == 1) ? 1 : -1;
+}
+
+/* Make room for dictionary entry `id`. The writer allocates IDs
+ * sequentially (starting from 1), so an ID well past the end means a corrupted
+ * stream. */
+static int grow_dict(void **arr, uint32_t *alloc_cnt, uint32_t id,
+                     size_t entry_size)
+{
+  uint32_t new_cnt;
+  void *tmp;
+
+  if (id < *alloc_cnt) {
+    return 0;
+  }
+  if (id > *alloc_cnt + 1) {
+    return -1;
+  }
+  new_cnt = (*alloc_cnt == 0) ? 64 : *alloc_cnt * 2;
+  if ((tmp = realloc(*arr, entry_size * new_cnt)) == NULL) {
+    return -1;
+  }
+  memset((uint8_t *)tmp + entry_size * *alloc_cnt, 0,
+         entry_size * (new_cnt - *alloc_cnt));
+  *arr = tmp;
+  *alloc_cnt = new_cnt;
+  return 0;
+}
+
+static int process_str(bgpstream_format_t *format, codec_cursor_t *c)
+{
+  uint32_t id;
+  size_t len;
+
+  if (codec_get_varint32(c, &id) != 0 || id == 0) {
+    return -1;
+  }
+  if (grow_dict((void **)&STATE->strs, &STATE->strs_alloc_cnt, id,
+                sizeof(*STATE->strs)) != 0) {
+    return -1;
+  }
+  len = c->end - c->p;
+  if (len >= BGPSTREAM_UTILS_STR_NAME_LEN) {
+    len = BGPSTREAM_UTILS_STR_NAME_LEN - 1;
+  }
+  memcpy(STATE->strs[id], c->p, len);
+  STATE->strs[id][len] = '\0';
+  return 0;
+}
+
+static int process_peer(bgpstream_format_t *format, codec_cursor_t *c)
+{
+  peer_dict_t *dict;
+  uint32_t id;
+  peer_t peer;
+
+  if (codec_get_varint32(c, &id) != 0 ||
+      codec_get_varint32(c, &peer.asn) != 0 ||
+      codec_get_addr(c, &peer.ip) != 0 || id == 0) {
+    return -1;
+  }
+  if ((dict = peer_dict_unshare(format)) == NULL ||
+      grow_dict((void **)&dict->peers, &dict->alloc_cnt, id,
+                sizeof(peer_t)) != 0) {
+    return -1;
+  }
+  dict->peers[id] = peer;
+  return 0;
+}
+
+/* forget the dictionaries (the writer reassigns IDs after a sync point).
+ * Records that were read before the sync point keep the old peer
+ * dictionary. */
+static void process_sync(bgpstream_format_t *format)
+{
+  if (STATE->strs != NULL) {
+    memset(STATE->strs, 0, sizeof(*STATE->strs) * STATE->strs_alloc_cnt);
+  }
+  peer_dict_release(STATE->peers);
+  STATE->peers = NULL;
+  STATE->last_time_sec = 0;
+}
+
+static int set_str(bgpstream_format_t *format, codec_cursor_t *c, char *dst)
+{
+  uint32_t id;
+
+  if (codec_get_varint32(c, &id) != 0) {
+    return -1;
+  }
+  if (id == 0) {
+    dst[0] = '\0';
+    return 0;
+  }
+  if (id >= STATE->strs_alloc_cnt || STATE->strs[id][0] == '\0') {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Undefined string ID %" PRIu32, id);
+    return -1;
+  }
+  memcpy(dst, STATE->strs[id], BGPSTREAM_UTILS_STR_NAME_LEN);
+  return 0;
+}
+
+/* decode the record header at the start of the record buffer */
+static int process_record(bgpstream_format_t *format,
+                          bgpstream_record_t *record)
+{
+  codec_cursor_t c = {RDATA->buf, RDATA->buf + RDATA->len};
+  uint8_t type, status, dump_pos;
+
+  if (codec_get_delta32(&c, STATE->last_time_sec, &record->time_sec) != 0 ||
+      codec_get_varint32(&c, &record->time_usec) != 0 ||
+      codec_get_u8(&c, &type) != 0 || codec_get_u8(&c, &status) != 0 ||
+      codec_get_u8(&c, &dump_pos) != 0 ||
+      set_str(format, &c, record->project_name) != 0 ||
+      set_str(format, &c, record->collector_name) != 0 ||
+      set_str(format, &c, record->router_name) != 0 ||
+      codec_get_addr(&c, &record->router_ip) != 0 ||
+      codec_get_delta32(&c, record->time_sec, &record->dump_time_sec) != 0 ||
+      codec_get_varint(&c, &RDATA->elems_cnt) != 0) {
+    return -1;
+  }
+  STATE->last_time_sec = record->time_sec;
+  record->type = type;
+  record->status = status;
+  record->dump_pos = dump_pos;
+  RDATA->off = c.p - RDATA->buf;
+  return 0;
+}
+
+/* -------------------- RECORD FILTERING -------------------- */
+
+static int check_filters(bgpstream_record_t *record,
+                         bgpstream_filter_mgr_t *filter_mgr)
+{
+  if (filter_mgr->projects != NULL &&
+      bgpstream_str_set_exists(filter_mgr->projects, record->project_name) ==
+        0) {
+    return 0;
+  }
+
+  if (filter_mgr->collectors != NULL &&
+      bgpstream_str_set_exists(filter_mgr->collectors,
+                               record->collector_name) == 0) {
+    return 0;
+  }
+
+  if (filter_mgr->routers != NULL &&
+      bgpstream_str_set_exists(filter_mgr->routers, record->router_name) ==
+        0) {
+    return 0;
+  }
+
+  if (filter_mgr->bgp_types != NULL &&
+      bgpstream_str_set_exists(filter_mgr->bgp_types,
+                               record->type == BGPSTREAM_RIB ? "ribs"
+                                                             : "updates") ==
+        0) {
+    return 0;
+  }
+
+  if (TIF != NULL &&
+      (record->time_sec < TIF->begin_time ||
+       (TIF->end_time != BGPSTREAM_FOREVER &&
+        record->time_sec > TIF->end_time))) {
+    return 0;
+  }
+
+  return 1;
+}
+
+/* decode the next elem of the record into the given elem. elems are encoded
+ * independently of each other, so this is also the fill_next_elem method */
+static int fill_next_elem(bgpstream_format_t *format,
+                          bgpstream_record_t *record, bgpstream_elem_t *el)
+{
+  codec_cursor_t c;
+  uint8_t type, old_state, new_state;
+  uint32_t peer_ref, peer_id;
+  uint64_t len;
+
+  if (RDATA == NULL || RDATA->elems_cnt == 0) {
+    // end-of-elems
+    return 0;
+  }
+
+  c.p = RDATA->buf + RDATA->off;
+  c.end = RDATA->buf + RDATA->len;
+  bgpstream_elem_clear(el);
+
+  if (codec_get_u8(&c, &type) != 0 || codec_get_varint32(&c, &peer_ref) != 0) {
+    goto corrupted;
+  }
+  // only use the record's own peer dictionary: the stream's one may have been
+  // changed since the record was read
+  peer_id = peer_ref >> 1;
+  if (RDATA->peers == NULL || peer_id == 0 ||
+      peer_id >= RDATA->peers->alloc_cnt ||
+      RDATA->peers->peers[peer_id].ip.version ==
+        BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Undefined peer ID %" PRIu32, peer_id);
+    goto corrupted;
+  }
+  el->peer_ip = RDATA->peers->peers[peer_id].ip;
+  el->peer_asn = RDATA->peers->peers[peer_id].asn;
+  if ((peer_ref & 1) != 0 && codec_get_varint32(&c, &el->peer_asn) != 0) {
+    goto corrupted;
+  }
+  if (codec_get_delta32(&c, record->time_sec, &el->orig_time_sec) != 0 ||
+      codec_get_varint32(&c, &el->orig_time_usec) != 0) {
+    goto corrupted;
+  }
+  el->type = type;
+
+  switch (el->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    if (codec_get_pfx(&c, &el->prefix) != 0 ||
+        codec_get_addr(&c, &el->nexthop) != 0 ||
+        codec_get_varint(&c, &len) != 0 || len > UINT16_MAX ||
+        len > (uint64_t)(c.end - c.p) ||
+        check_path(c.p, len, STATE->swap_path) != 0) {
+      goto corrupted;
+    }
+    // the path points into the record buffer
+    bgpstream_as_path_populate_from_data_zc(el->as_path, c.p, len);
+    c.p += len;
+    if (codec_get_varint(&c, &len) != 0 ||
+        len > (uint64_t)(c.end - c.p) / sizeof(uint32_t) ||
+        bgpstream_community_set_populate(el->communities, c.p,
+                                         len * sizeof(uint32_t)) != 0) {
+      goto corrupted;
+    }
+    c.p += len * sizeof(uint32_t);
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    if (codec_get_pfx(&c, &el->prefix) != 0) {
+      goto corrupted;
+    }
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    if (codec_get_u8(&c, &old_state) != 0 ||
+        codec_get_u8(&c, &new_state) != 0) {
+      goto corrupted;
+    }
+    el->old_state = old_state;
+    el->new_state = new_state;
+    break;
+
+  default:
+    goto corrupted;
+  }
+
+  RDATA->off = c.p - RDATA->buf;
+  RDATA->elems_cnt--;
+  return 1;
+
+corrupted:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Corrupted elem in binary elem stream");
+  RDATA->elems_cnt = 0;
+  return -1;
+}
+
+/* =============================================================== */
+/* ==================== PUBLIC API BELOW HERE ==================== */
+/* =============================================================== */
+
+int bs_format_binary_create(bgpstream_format_t *format,
+                            bgpstream_resource_t *res)
+{
+  BS_FORMAT_SET_METHODS(binary, format);
+  format->fill_next_elem = fill_next_elem;
+
+  if ((format->state = malloc_zero(sizeof(state_t))) == NULL) {
+    return -1;
+  }
+
+  return 0;
+}
+
+bgpstream_format_status_t
+bs_format_binary_populate_record(bgpstream_format_t *format,
+                                 bgpstream_record_t *record)
+{
+  bgpstream_format_status_t status;
+  uint8_t type;
+  uint64_t len;
+  codec_cursor_t c;
+  int rc;
+
+  if (STATE->header_read == 0 &&
+      (status = read_header(format)) != BGPSTREAM_FORMAT_OK) {
+    return status;
+  }
+
+retry:
+  if ((rc = read_msg_header(format, &type, &len)) == 0) {
+    return BGPSTREAM_FORMAT_END_OF_DUMP;
+  }
+  if (rc < 0 || len > MSG_MAX_LEN) {
+    goto corrupted;
+  }
+
+  if (type == BGPSTREAM_BINARY_MSG_RECORD) {
+    if (grow(&RDATA->buf, &RDATA->alloc_len, len) != 0) {
+      return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
+    }
+    if (codec_read_full(format->transport, RDATA->buf, len) != (int64_t)len) {
+      goto corrupted;
+    }
+    RDATA->len = len;
+    if (process_record(format, record) != 0) {
+      goto corrupted;
+    }
+    if (record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD ||
+        check_filters(record, format->filter_mgr) == 0) {
+      // move on to the next record
+      RDATA->len = 0;
+      RDATA->elems_cnt = 0;
+      goto retry;
+    }
+    peer_dict_release(RDATA->peers);
+    RDATA->peers = peer_dict_retain(STATE->peers);
+    return BGPSTREAM_FORMAT_OK;
+  }
+
+  // dictionary entries, sync points and any (future) message types that we
+  // skip
+  if (grow(&STATE->buf, &STATE->alloc_len, len) != 0) {
+    return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
+  }
+  if (codec_read_full(format->transport, STATE->buf, len) != (int64_t)len) {
+    goto corrupted;
+  }
+  c.p = STATE->buf;
+  c.end = STATE->buf + len;
+  if ((type == BGPSTREAM_BINARY_MSG_STR && process_str(format, &c) != 0) ||
+      (type == BGPSTREAM_BINARY_MSG_PEER && process_peer(format, &c) != 0)) {
+    goto corrupted;
+  }
+  if (type == BGPSTREAM_BINARY_MSG_SYNC) {
+    process_sync(format);
+  }
+  goto retry;
+
+corrupted:
+  bgpstream_log(BGPSTREAM_LOG_WARN, "Corrupted binary elem stream in %s",
+                format->res->url);
+  record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
+  return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+}
+
+int bs_format_binary_get_next_elem(bgpstream_format_t *format,
+                                   bgpstream_record_t *record,
+                                   bgpstream_elem_t **elem)
+{
+  int rc;
+
+  if (RDATA == NULL) {
+    // end-of-elems
+    return 0;
+  }
+  if ((rc = fill_next_elem(format, record, RDATA->elem)) <= 0) {
+    return rc;
+  }
+
+  // return a borrowed pointer to the elem we populated
+  *elem = RDATA->elem;
+  return 1;
+}
+
+int bs_format_binary_init_data(bgpstream_format_t *format, void **data)
+{
+  rec_data_t *rd;
+  *data = NULL;
+
+  if ((rd = malloc_zero(sizeof(rec_data_t))) == NULL) {
+    return -1;
+  }
+
+  if ((rd->elem = bgpstream_elem_create()) == NULL) {
+    free(rd);
+    return -1;
+  }
+
+  *data = rd;
+  return 0;
+}
+
+void bs_format_binary_clear_data(bgpstream_format_t *format, void *data)
+{
+  rec_data_t *rd = (rec_data_t *)data;
+  assert(rd != NULL);
+  bgpstream_elem_clear(rd->elem);
+  rd->len = 0;
+  rd->off = 0;
+  rd->elems_cnt = 0;
+  peer_dict_release(rd->peers);
+  rd->peers = NULL;
+}
+
+void bs_format_binary_destroy_data(bgpstream_format_t *format, void *data)
+{
+  rec_data_t *rd = (rec_data_t *)data;
+  if (rd == NULL) {
+    return;
+  }
+  bgpstream_elem_destroy(rd->elem);
+  rd->elem = NULL;
+  free(rd->buf);
+  peer_dict_release(rd->peers);
+  free(data);
+}
+
+void bs_format_binary_destroy(bgpstream_format_t *format)
+{
+  free(STATE->strs);
+  peer_dict_release(STATE->peers);
+  STATE->peers = NULL;
+  free(STATE->buf);
+  free(format->state);
+  format->state = NULL;
+}
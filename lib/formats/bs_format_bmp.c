@@ -159,7 +159,7 @@ static int is_wanted_time(uint32_t record_time,
 #define IS_ROUTER_MSG (flags & 0x80)
 #define IS_ROUTER_IPV6 (flags & 0x40)
 
-static int populate_prep_cb(bgpstream_format_t *format, uint8_t *buf,
+static int populate_prep_cb(bgpstream_format_t *format, const uint8_t *buf,
                             size_t *lenp, bgpstream_record_t *record)
 {
   size_t len = *lenp, nread = 0;
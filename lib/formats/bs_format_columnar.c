@@ -0,0 +1,1148 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bs_format_columnar.h"
+#include "bgpstream_codec.h"
+#include "bgpstream_columnar_int.h"
+#include "bgpstream_format_interface.h"
+#include "bgpstream_log.h"
+#include "bgpstream_record_int.h"
+#include "bgpstream_utils_community_int.h"
+#include "utils.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+
+#define STATE ((state_t *)(format->state))
+#define RDATA ((rec_data_t *)(record->__int->data))
+#define TIF filter_mgr->time_interval
+
+/* Upper bound on the length of a section we are willing to buffer. This stops
+ * a corrupted length from turning into a huge allocation. */
+#define SECTION_MAX_LEN (1024 * 1024 * 1024)
+
+/* peer dictionary entry */
+typedef struct peer {
+  bgpstream_ip_addr_t ip;
+  uint32_t asn;
+} peer_t;
+
+/* source dictionary entry */
+typedef struct source {
+  char project[BGPSTREAM_UTILS_STR_NAME_LEN];
+  char collector[BGPSTREAM_UTILS_STR_NAME_LEN];
+  char router[BGPSTREAM_UTILS_STR_NAME_LEN];
+  bgpstream_ip_addr_t router_ip;
+} source_t;
+
+/* Elem data of a row group. It is shared by all the records of the row group
+ * (which may outlive the row group when records are retained), so it is
+ * reference counted. */
+typedef struct rowgroup {
+  int refcnt;
+
+  // elem section (the elem columns point into this buffer)
+  uint8_t *buf;
+
+  // peer dictionary
+  peer_t *peers;
+  uint32_t peers_cnt;
+
+  // AS path dictionary: host byte order AS path data (the AS paths of the
+  // elems we return point into this buffer), and the offset of each path
+  uint8_t *path_data;
+  uint32_t *path_offs;
+  uint32_t paths_cnt;
+} rowgroup_t;
+
+/* position in the elem columns of a row group */
+typedef struct elem_cursor {
+  codec_cursor_t cols[COLUMNAR_ELEM_COL_CNT];
+
+  // current run of the elem type column
+  uint8_t run_type;
+  uint64_t run_left;
+} elem_cursor_t;
+
+typedef struct rec_data {
+  // reusable elem instance
+  bgpstream_elem_t *elem;
+
+  // row group that holds the elems of the record
+  rowgroup_t *rg;
+
+  // position of the next elem, and number of elems left
+  elem_cursor_t cur;
+  uint64_t elems_cnt;
+
+} rec_data_t;
+
+typedef struct state {
+  // has the archive header been read?
+  int header_read;
+
+  // codec used to compress the columns
+  uint8_t codec;
+
+#ifdef HAVE_LIBZSTD
+  ZSTD_DCtx *zstd;
+#endif
+
+  // compressed section that is being decompressed
+  uint8_t *zbuf;
+  size_t zbuf_alloc_len;
+
+  // statistics of the current row group
+  uint8_t *stats;
+  size_t stats_alloc_len;
+  source_t *sources;
+  uint32_t sources_cnt;
+  uint32_t sources_alloc_cnt;
+
+  // record columns of the current row group, and number of records left
+  uint8_t *recs;
+  size_t recs_alloc_len;
+  codec_cursor_t rec_cols[COLUMNAR_REC_COL_CNT];
+  uint32_t recs_left;
+
+  // time of the previous record in the row group
+  uint32_t last_time_sec;
+
+  // elem data of the current row group (NULL if the elems were skipped), and
+  // position of the elems of the next record
+  rowgroup_t *rg;
+  elem_cursor_t cur;
+
+} state_t;
+
+/* statistics of a row group that are used to skip data */
+typedef struct stats {
+  uint32_t recs_cnt;
+  uint32_t min_time;
+  uint32_t max_time;
+  uint8_t rec_types;
+  uint8_t elem_types;
+  uint8_t versions;
+  uint8_t v4_first[4];
+  uint8_t v4_last[4];
+  uint8_t v6_first[16];
+  uint8_t v6_last[16];
+  uint8_t *bloom;
+  uint32_t bloom_bits;
+} stats_t;
+
+/* ======================================================== */
+/* ==================== ROW GROUPS ==================== */
+/* ======================================================== */
+
+static void rowgroup_release(rowgroup_t *rg)
+{
+  if (rg == NULL ||
+      __atomic_sub_fetch(&rg->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+  free(rg->buf);
+  free(rg->peers);
+  free(rg->path_data);
+  free(rg->path_offs);
+  free(rg);
+}
+
+static rowgroup_t *rowgroup_retain(rowgroup_t *rg)
+{
+  __atomic_add_fetch(&rg->refcnt, 1, __ATOMIC_RELAXED);
+  return rg;
+}
+
+static int grow(uint8_t **buf, size_t *alloc_len, size_t len)
+{
+  uint8_t *tmp;
+
+  if (len <= *alloc_len) {
+    return 0;
+  }
+  if ((tmp = realloc(*buf, len)) == NULL) {
+    return -1;
+  }
+  *buf = tmp;
+  *alloc_len = len;
+  return 0;
+}
+
+/* split a section into its (length-prefixed) columns */
+static int get_columns(codec_cursor_t *c, codec_cursor_t *cols, int cols_cnt)
+{
+  uint64_t len;
+  int i;
+
+  for (i = 0; i < cols_cnt; i++) {
+    if (codec_get_varint(c, &len) != 0 || len > (uint64_t)(c->end - c->p)) {
+      return -1;
+    }
+    cols[i].p = c->p;
+    cols[i].end = c->p + len;
+    c->p += len;
+  }
+  return 0;
+}
+
+static int decompress_block(bgpstream_format_t *format, codec_cursor_t *in,
+                            uint8_t *out, size_t len)
+{
+  size_t in_len = in->end - in->p;
+
+  // a block that did not compress is stored as it is
+  if (in_len == len) {
+    memcpy(out, in->p, len);
+    return 0;
+  }
+
+  switch (STATE->codec) {
+#ifdef HAVE_LIBZSTD
+  case BGPSTREAM_COLUMNAR_CODEC_ZSTD:
+    return (ZSTD_decompressDCtx(STATE->zstd, out, len, in->p, in_len) == len)
+             ? 0
+             : -1;
+#endif
+#ifdef HAVE_LIBLZ4
+  case BGPSTREAM_COLUMNAR_CODEC_LZ4:
+    return (in_len <= INT_MAX && len <= INT_MAX &&
+            LZ4_decompress_safe((const char *)in->p, (char *)out, in_len,
+                                len) == (int)len)
+             ? 0
+             : -1;
+#endif
+  default:
+    return -1;
+  }
+}
+
+/* split a section into its (length-prefixed) blocks. if the archive is
+ * compressed, the blocks are decompressed into buf, otherwise they are used
+ * in place. */
+static int get_blocks(bgpstream_format_t *format, codec_cursor_t *c,
+                      codec_cursor_t *blocks, int blocks_cnt, uint8_t **buf,
+                      size_t *alloc_len)
+{
+  uint64_t lens[COLUMNAR_ELEM_COL_CNT + 1];
+  uint64_t total = 0;
+  uint8_t *p;
+  int i;
+
+  assert(blocks_cnt <= COLUMNAR_ELEM_COL_CNT + 1);
+  if (get_columns(c, blocks, blocks_cnt) != 0) {
+    return -1;
+  }
+  if (STATE->codec == BGPSTREAM_COLUMNAR_CODEC_NONE) {
+    return 0;
+  }
+
+  for (i = 0; i < blocks_cnt; i++) {
+    if (codec_get_varint(&blocks[i], &lens[i]) != 0 ||
+        lens[i] > SECTION_MAX_LEN) {
+      return -1;
+    }
+    total += lens[i];
+  }
+  if (total > SECTION_MAX_LEN ||
+      grow(buf, alloc_len, total > 0 ? total : 1) != 0) {
+    return -1;
+  }
+  for (i = 0, p = *buf; i < blocks_cnt; p += lens[i], i++) {
+    if (decompress_block(format, &blocks[i], p, lens[i]) != 0) {
+      return -1;
+    }
+    blocks[i].p = p;
+    blocks[i].end = p + lens[i];
+  }
+  return 0;
+}
+
+static int get_str(codec_cursor_t *c, char *dst)
+{
+  uint64_t len;
+
+  if (codec_get_varint(c, &len) != 0 ||
+      len >= BGPSTREAM_UTILS_STR_NAME_LEN ||
+      codec_get_bytes(c, dst, len) != 0) {
+    return -1;
+  }
+  dst[len] = '\0';
+  return 0;
+}
+
+static int decode_stats(bgpstream_format_t *format, codec_cursor_t *c,
+                        stats_t *stats, rowgroup_t *rg)
+{
+  uint64_t elems_cnt;
+  uint32_t range, cnt, i;
+  source_t *tmp;
+
+  if (codec_get_varint32(c, &stats->recs_cnt) != 0 ||
+      codec_get_varint(c, &elems_cnt) != 0 ||
+      codec_get_varint32(c, &stats->min_time) != 0 ||
+      codec_get_varint32(c, &range) != 0 ||
+      codec_get_u8(c, &stats->rec_types) != 0 ||
+      codec_get_u8(c, &stats->elem_types) != 0 ||
+      codec_get_u8(c, &stats->versions) != 0) {
+    return -1;
+  }
+  stats->max_time = stats->min_time + range;
+  if (((stats->versions & COLUMNAR_VERSION_IPV4) != 0 &&
+       (codec_get_bytes(c, stats->v4_first, 4) != 0 ||
+        codec_get_bytes(c, stats->v4_last, 4) != 0)) ||
+      ((stats->versions & COLUMNAR_VERSION_IPV6) != 0 &&
+       (codec_get_bytes(c, stats->v6_first, 16) != 0 ||
+        codec_get_bytes(c, stats->v6_last, 16) != 0))) {
+    return -1;
+  }
+
+  // sources
+  if (codec_get_varint32(c, &cnt) != 0 || cnt > (uint32_t)(c->end - c->p)) {
+    return -1;
+  }
+  if (cnt > STATE->sources_alloc_cnt) {
+    if ((tmp = realloc(STATE->sources, sizeof(source_t) * cnt)) == NULL) {
+      return -1;
+    }
+    STATE->sources = tmp;
+    STATE->sources_alloc_cnt = cnt;
+  }
+  for (i = 0; i < cnt; i++) {
+    if (get_str(c, STATE->sources[i].project) != 0 ||
+        get_str(c, STATE->sources[i].collector) != 0 ||
+        get_str(c, STATE->sources[i].router) != 0 ||
+        codec_get_addr(c, &STATE->sources[i].router_ip) != 0) {
+      return -1;
+    }
+  }
+  STATE->sources_cnt = cnt;
+
+  // peers
+  if (codec_get_varint32(c, &cnt) != 0 || cnt > (uint32_t)(c->end - c->p) ||
+      (cnt > 0 && (rg->peers = malloc(sizeof(peer_t) * cnt)) == NULL)) {
+    return -1;
+  }
+  for (i = 0; i < cnt; i++) {
+    if (codec_get_addr(c, &rg->peers[i].ip) != 0 ||
+        codec_get_varint32(c, &rg->peers[i].asn) != 0) {
+      return -1;
+    }
+  }
+  rg->peers_cnt = cnt;
+
+  // origin ASN bloom filter
+  if (codec_get_varint32(c, &stats->bloom_bits) != 0) {
+    return -1;
+  }
+  if (stats->bloom_bits != 0) {
+    if (stats->bloom_bits < COLUMNAR_BLOOM_MIN_BITS ||
+        stats->bloom_bits > COLUMNAR_BLOOM_MAX_BITS ||
+        (stats->bloom_bits & (stats->bloom_bits - 1)) != 0 ||
+        stats->bloom_bits / 8 > (uint32_t)(c->end - c->p)) {
+      return -1;
+    }
+    stats->bloom = c->p;
+    c->p += stats->bloom_bits / 8;
+  }
+  return 0;
+}
+
+static int decode_path_dict(codec_cursor_t *c, rowgroup_t *rg)
+{
+  uint8_t *data = NULL;
+  size_t len = 0, alloc_len = 0, path_len;
+  uint32_t cnt, segs_cnt, asns_cnt, asn, i, j, k;
+  uint8_t type;
+
+  if (codec_get_varint32(c, &cnt) != 0 || cnt > (uint32_t)(c->end - c->p) ||
+      (rg->path_offs = malloc(sizeof(uint32_t) * (cnt + 1))) == NULL) {
+    return -1;
+  }
+
+  for (i = 0; i < cnt; i++) {
+    rg->path_offs[i] = len;
+    if (codec_get_varint32(c, &segs_cnt) != 0 ||
+        segs_cnt > (uint32_t)(c->end - c->p)) {
+      goto err;
+    }
+    for (j = 0; j < segs_cnt; j++) {
+      if (codec_get_u8(c, &type) != 0) {
+        goto err;
+      }
+      if (type == BGPSTREAM_AS_PATH_SEG_ASN) {
+        asns_cnt = 1;
+      } else if (type >= BGPSTREAM_AS_PATH_SEG_SET &&
+                 type <= BGPSTREAM_AS_PATH_SEG_CONFED_SET) {
+        if (codec_get_varint32(c, &asns_cnt) != 0 || asns_cnt > UINT8_MAX) {
+          goto err;
+        }
+      } else {
+        goto err;
+      }
+      if (grow(&data, &alloc_len, len + 2 + asns_cnt * sizeof(uint32_t)) !=
+          0) {
+        goto err;
+      }
+      data[len++] = type;
+      if (type != BGPSTREAM_AS_PATH_SEG_ASN) {
+        data[len++] = asns_cnt;
+      }
+      for (k = 0; k < asns_cnt; k++) {
+        if (codec_get_varint32(c, &asn) != 0) {
+          goto err;
+        }
+        memcpy(data + len, &asn, sizeof(asn));
+        len += sizeof(asn);
+      }
+    }
+    path_len = len - rg->path_offs[i];
+    if (path_len >= UINT16_MAX) {
+      goto err;
+    }
+  }
+  rg->path_offs[cnt] = len;
+  rg->path_data = data;
+  rg->paths_cnt = cnt;
+  return 0;
+
+err:
+  free(data);
+  return -1;
+}
+
+/* -------------------- ROW GROUP FILTERING -------------------- */
+
+static int source_matches(source_t *src, bgpstream_filter_mgr_t *filter_mgr)
+{
+  return (filter_mgr->projects == NULL ||
+          bgpstream_str_set_exists(filter_mgr->projects, src->project)) &&
+         (filter_mgr->collectors == NULL ||
+          bgpstream_str_set_exists(filter_mgr->collectors, src->collector)) &&
+         (filter_mgr->routers == NULL ||
+          bgpstream_str_set_exists(filter_mgr->routers, src->router));
+}
+
+/* can the row group contain records that match the filters? */
+static int rowgroup_has_records(bgpstream_format_t *format, stats_t *stats)
+{
+  bgpstream_filter_mgr_t *filter_mgr = format->filter_mgr;
+  uint8_t types = 0;
+  uint32_t i;
+
+  if (TIF != NULL &&
+      (stats->max_time < TIF->begin_time ||
+       (TIF->end_time != BGPSTREAM_FOREVER &&
+        stats->min_time > TIF->end_time))) {
+    return 0;
+  }
+
+  if (filter_mgr->bgp_types != NULL) {
+    if (bgpstream_str_set_exists(filter_mgr->bgp_types, "ribs")) {
+      types |= 1 << BGPSTREAM_RIB;
+    }
+    if (bgpstream_str_set_exists(filter_mgr->bgp_types, "updates")) {
+      types |= 1 << BGPSTREAM_UPDATE;
+    }
+    if ((stats->rec_types & types) == 0) {
+      return 0;
+    }
+  }
+
+  if (filter_mgr->projects == NULL && filter_mgr->collectors == NULL &&
+      filter_mgr->routers == NULL) {
+    return 1;
+  }
+  for (i = 0; i < STATE->sources_cnt; i++) {
+    if (source_matches(&STATE->sources[i], filter_mgr)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+typedef struct pfx_overlap {
+  stats_t *stats;
+  int found;
+} pfx_overlap_t;
+
+static bgpstream_patricia_walk_cb_result_t
+pfx_overlaps(const bgpstream_patricia_tree_t *pt,
+             const bgpstream_patricia_node_t *node, void *data)
+{
+  pfx_overlap_t *po = (pfx_overlap_t *)data;
+  uint8_t first[16], last[16];
+  uint8_t *min, *max;
+  int len;
+
+  if ((len = columnar_pfx_range(bgpstream_patricia_tree_get_pfx(node), first,
+                                last)) == 0) {
+    return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  }
+  if (len == 4) {
+    if ((po->stats->versions & COLUMNAR_VERSION_IPV4) == 0) {
+      return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+    }
+    min = po->stats->v4_first;
+    max = po->stats->v4_last;
+  } else {
+    if ((po->stats->versions & COLUMNAR_VERSION_IPV6) == 0) {
+      return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+    }
+    min = po->stats->v6_first;
+    max = po->stats->v6_last;
+  }
+  // any match (exact, more or less specific) overlaps the filter prefix
+  if (memcmp(first, max, len) <= 0 && memcmp(last, min, len) >= 0) {
+    po->found = 1;
+    return BGPSTREAM_PATRICIA_WALK_END_ALL;
+  }
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+/* can the row group contain elems that match the filters? */
+static int rowgroup_has_elems(bgpstream_format_t *format, stats_t *stats,
+                              rowgroup_t *rg)
+{
+  bgpstream_filter_mgr_t *filter_mgr = format->filter_mgr;
+  pfx_overlap_t po = {stats, 0};
+  uint32_t *asn;
+  uint8_t version;
+  uint32_t i;
+
+  if (filter_mgr->elemtype_mask != 0 &&
+      (stats->elem_types & (filter_mgr->elemtype_mask << 1)) == 0) {
+    return 0;
+  }
+
+  if (filter_mgr->peer_asns != NULL) {
+    for (i = 0; i < rg->peers_cnt; i++) {
+      if (bgpstream_id_set_exists(filter_mgr->peer_asns, rg->peers[i].asn)) {
+        break;
+      }
+    }
+    if (i == rg->peers_cnt) {
+      return 0;
+    }
+  }
+
+  if (filter_mgr->origin_asns != NULL) {
+    if (stats->bloom == NULL) {
+      return 0;
+    }
+    bgpstream_id_set_rewind(filter_mgr->origin_asns);
+    while ((asn = bgpstream_id_set_next(filter_mgr->origin_asns)) != NULL &&
+           columnar_bloom_test(stats->bloom, stats->bloom_bits, *asn) == 0)
+      ;
+    if (asn == NULL) {
+      return 0;
+    }
+  }
+
+  if (filter_mgr->ipversion != 0) {
+    version = (filter_mgr->ipversion == BGPSTREAM_ADDR_VERSION_IPV4)
+                ? COLUMNAR_VERSION_IPV4
+                : COLUMNAR_VERSION_IPV6;
+    if ((stats->versions & version) == 0) {
+      return 0;
+    }
+  }
+
+  if (filter_mgr->prefixes != NULL) {
+    bgpstream_patricia_tree_walk(filter_mgr->prefixes, pfx_overlaps, &po);
+    if (po.found == 0) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* -------------------- ROW GROUP READING -------------------- */
+
+static bgpstream_format_status_t read_header(bgpstream_format_t *format)
+{
+  uint8_t hdr[BGPSTREAM_COLUMNAR_HEADER_LEN];
+  int64_t rc;
+
+  if ((rc = codec_read_full(format->transport, hdr, sizeof(hdr))) == 0) {
+    return BGPSTREAM_FORMAT_EMPTY_DUMP;
+  }
+  if (rc < 0 || memcmp(hdr, BGPSTREAM_COLUMNAR_MAGIC,
+                       sizeof(BGPSTREAM_COLUMNAR_MAGIC) - 1) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "%s is not a columnar elem archive",
+                  format->res->url);
+    return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+  }
+  if (hdr[5] != BGPSTREAM_COLUMNAR_VERSION) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Unsupported columnar elem archive version (%d) in %s",
+                  hdr[5], format->res->url);
+    return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+  }
+  STATE->codec = hdr[COLUMNAR_HEADER_CODEC];
+  switch (STATE->codec) {
+  case BGPSTREAM_COLUMNAR_CODEC_NONE:
+    break;
+#ifdef HAVE_LIBZSTD
+  case BGPSTREAM_COLUMNAR_CODEC_ZSTD:
+    if ((STATE->zstd = ZSTD_createDCtx()) == NULL) {
+      return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
+    }
+    break;
+#endif
+#ifdef HAVE_LIBLZ4
+  case BGPSTREAM_COLUMNAR_CODEC_LZ4:
+    break;
+#endif
+  default:
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Unsupported columnar elem archive codec (%d) in %s",
+                  STATE->codec, format->res->url);
+    return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+  }
+  STATE->header_read = 1;
+  return BGPSTREAM_FORMAT_OK;
+}
+
+/* read the length of the next section. returns 1 if a length was read, 0 on
+ * EOF, -1 on error */
+static int read_section_len(bgpstream_format_t *format, uint64_t *len)
+{
+  int rc = codec_read_varint(format->transport, len);
+  return (rc == 1 && *len > SECTION_MAX_LEN) ? -1 : rc;
+}
+
+/* read the next section into the given buffer, or, if the archive is
+ * compressed, into the scratch buffer (get_blocks then decompresses its
+ * blocks into the given buffer) */
+static int read_section(bgpstream_format_t *format, codec_cursor_t *c,
+                        uint8_t **buf, size_t *alloc_len)
+{
+  uint64_t len;
+
+  if (STATE->codec != BGPSTREAM_COLUMNAR_CODEC_NONE) {
+    buf = &STATE->zbuf;
+    alloc_len = &STATE->zbuf_alloc_len;
+  }
+  if (read_section_len(format, &len) != 1 ||
+      grow(buf, alloc_len, len > 0 ? len : 1) != 0 ||
+      codec_read_full(format->transport, *buf, len) != (int64_t)len) {
+    return -1;
+  }
+  c->p = *buf;
+  c->end = *buf + len;
+  return 0;
+}
+
+static int skip_section(bgpstream_format_t *format)
+{
+  uint64_t len;
+
+  if (read_section_len(format, &len) != 1 ||
+      bgpstream_transport_skip(format->transport, len) != (int64_t)len) {
+    return -1;
+  }
+  return 0;
+}
+
+/* read the next row group that may contain matching records */
+static bgpstream_format_status_t read_rowgroup(bgpstream_format_t *format)
+{
+  codec_cursor_t blocks[COLUMNAR_ELEM_COL_CNT + 1];
+  rowgroup_t *rg = NULL;
+  size_t rg_alloc_len = 0;
+  stats_t stats;
+  codec_cursor_t c;
+  uint64_t len;
+  int rc;
+
+  rowgroup_release(STATE->rg);
+  STATE->rg = NULL;
+
+  while (1) {
+    if ((rc = read_section_len(format, &len)) == 0) {
+      return BGPSTREAM_FORMAT_END_OF_DUMP;
+    }
+    if (rc < 0 || grow(&STATE->stats, &STATE->stats_alloc_len, len) != 0 ||
+        codec_read_full(format->transport, STATE->stats, len) != (int64_t)len) {
+      goto corrupted;
+    }
+    if ((rg = malloc_zero(sizeof(rowgroup_t))) == NULL) {
+      return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
+    }
+    rg->refcnt = 1;
+    memset(&stats, 0, sizeof(stats));
+    c.p = STATE->stats;
+    c.end = STATE->stats + len;
+    if (decode_stats(format, &c, &stats, rg) != 0) {
+      goto corrupted;
+    }
+
+    if (rowgroup_has_records(format, &stats) != 0) {
+      break;
+    }
+    // skip the record and elem sections
+    if (skip_section(format) != 0 || skip_section(format) != 0) {
+      goto corrupted;
+    }
+    rowgroup_release(rg);
+    rg = NULL;
+  }
+
+  // record section
+  if (read_section(format, &c, &STATE->recs, &STATE->recs_alloc_len) != 0 ||
+      get_blocks(format, &c, STATE->rec_cols, COLUMNAR_REC_COL_CNT,
+                 &STATE->recs, &STATE->recs_alloc_len) != 0) {
+    goto corrupted;
+  }
+  STATE->recs_left = stats.recs_cnt;
+  STATE->last_time_sec = 0;
+
+  // elem section (the records are returned without elems when their elems
+  // cannot match the filters)
+  if (rowgroup_has_elems(format, &stats, rg) == 0) {
+    rowgroup_release(rg);
+    return (skip_section(format) == 0) ? BGPSTREAM_FORMAT_OK
+                                       : BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+  }
+  if (read_section(format, &c, &rg->buf, &rg_alloc_len) != 0) {
+    goto corrupted;
+  }
+  if (STATE->codec == BGPSTREAM_COLUMNAR_CODEC_NONE) {
+    if (decode_path_dict(&c, rg) != 0 ||
+        get_columns(&c, STATE->cur.cols, COLUMNAR_ELEM_COL_CNT) != 0) {
+      goto corrupted;
+    }
+  } else {
+    // the AS path dictionary is a block of its own
+    if (get_blocks(format, &c, blocks, COLUMNAR_ELEM_COL_CNT + 1, &rg->buf,
+                   &rg_alloc_len) != 0 ||
+        decode_path_dict(&blocks[0], rg) != 0) {
+      goto corrupted;
+    }
+    memcpy(STATE->cur.cols, blocks + 1, sizeof(STATE->cur.cols));
+  }
+  STATE->cur.run_left = 0;
+  STATE->rg = rg;
+  return BGPSTREAM_FORMAT_OK;
+
+corrupted:
+  rowgroup_release(rg);
+  STATE->recs_left = 0;
+  return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+}
+
+/* -------------------- ELEM DECODING -------------------- */
+
+/* decode the next elem at the given position */
+static int decode_elem(rowgroup_t *rg, elem_cursor_t *cur, uint32_t time_sec,
+                       bgpstream_elem_t *elem)
+{
+  codec_cursor_t *cols = cur->cols;
+  uint32_t peer_id, path_id;
+  uint8_t old_state, new_state;
+  uint64_t len;
+
+  if (cur->run_left == 0 &&
+      (codec_get_u8(&cols[COLUMNAR_ELEM_COL_TYPE], &cur->run_type) != 0 ||
+       codec_get_varint(&cols[COLUMNAR_ELEM_COL_TYPE], &cur->run_left) != 0 ||
+       cur->run_left == 0)) {
+    return -1;
+  }
+  cur->run_left--;
+
+  if (codec_get_varint32(&cols[COLUMNAR_ELEM_COL_PEER], &peer_id) != 0 ||
+      peer_id >= rg->peers_cnt ||
+      codec_get_delta32(&cols[COLUMNAR_ELEM_COL_TIME], time_sec,
+                        &elem->orig_time_sec) != 0 ||
+      codec_get_varint32(&cols[COLUMNAR_ELEM_COL_TIME],
+                         &elem->orig_time_usec) != 0) {
+    return -1;
+  }
+  elem->type = cur->run_type;
+  elem->peer_ip = rg->peers[peer_id].ip;
+  elem->peer_asn = rg->peers[peer_id].asn;
+
+  switch (cur->run_type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    if (codec_get_pfx(&cols[COLUMNAR_ELEM_COL_PFX], &elem->prefix) != 0 ||
+        codec_get_addr(&cols[COLUMNAR_ELEM_COL_NEXTHOP], &elem->nexthop) !=
+          0 ||
+        codec_get_varint32(&cols[COLUMNAR_ELEM_COL_PATH], &path_id) != 0 ||
+        path_id >= rg->paths_cnt ||
+        codec_get_varint(&cols[COLUMNAR_ELEM_COL_COMMS], &len) != 0 ||
+        len > (uint64_t)(cols[COLUMNAR_ELEM_COL_COMMS].end -
+                         cols[COLUMNAR_ELEM_COL_COMMS].p) /
+                sizeof(uint32_t)) {
+      return -1;
+    }
+    // the path points into the row group path dictionary
+    bgpstream_as_path_populate_from_data_zc(
+      elem->as_path, rg->path_data + rg->path_offs[path_id],
+      rg->path_offs[path_id + 1] - rg->path_offs[path_id]);
+    if (bgpstream_community_set_populate(elem->communities,
+                                         cols[COLUMNAR_ELEM_COL_COMMS].p,
+                                         len * sizeof(uint32_t)) != 0) {
+      return -1;
+    }
+    cols[COLUMNAR_ELEM_COL_COMMS].p += len * sizeof(uint32_t);
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    if (codec_get_pfx(&cols[COLUMNAR_ELEM_COL_PFX], &elem->prefix) != 0) {
+      return -1;
+    }
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    if (codec_get_u8(&cols[COLUMNAR_ELEM_COL_STATE], &old_state) != 0 ||
+        codec_get_u8(&cols[COLUMNAR_ELEM_COL_STATE], &new_state) != 0) {
+      return -1;
+    }
+    elem->old_state = old_state;
+    elem->new_state = new_state;
+    break;
+
+  default:
+    return -1;
+  }
+  return 0;
+}
+
+/* move the given position past cnt elems without decoding them: only the type
+ * runs and the lengths of the variable-size fields are read (the elems are
+ * checked when they are decoded) */
+static int skip_elems(elem_cursor_t *cur, uint64_t cnt)
+{
+  codec_cursor_t *cols = cur->cols;
+  uint64_t routes = 0, withdrawals = 0, states = 0;
+  uint64_t total = cnt, n, len;
+
+  // count the elems of each type
+  while (cnt > 0) {
+    if (cur->run_left == 0 &&
+        (codec_get_u8(&cols[COLUMNAR_ELEM_COL_TYPE], &cur->run_type) != 0 ||
+         codec_get_varint(&cols[COLUMNAR_ELEM_COL_TYPE], &cur->run_left) !=
+           0 ||
+         cur->run_left == 0)) {
+      return -1;
+    }
+    n = (cnt < cur->run_left) ? cnt : cur->run_left;
+    switch (cur->run_type) {
+    case BGPSTREAM_ELEM_TYPE_RIB:
+    case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+      routes += n;
+      break;
+    case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+      withdrawals += n;
+      break;
+    case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+      states += n;
+      break;
+    default:
+      return -1;
+    }
+    cur->run_left -= n;
+    cnt -= n;
+  }
+
+  // every elem has a peer ID, and a time delta and usec
+  if (codec_pass_varints(&cols[COLUMNAR_ELEM_COL_PEER], total) != 0 ||
+      codec_pass_varints(&cols[COLUMNAR_ELEM_COL_TIME], total * 2) != 0 ||
+      codec_pass_varints(&cols[COLUMNAR_ELEM_COL_PATH], routes) != 0 ||
+      codec_pass_bytes(&cols[COLUMNAR_ELEM_COL_STATE], states * 2) != 0) {
+    return -1;
+  }
+  for (n = 0; n < routes + withdrawals; n++) {
+    if (codec_pass_pfx(&cols[COLUMNAR_ELEM_COL_PFX]) != 0) {
+      return -1;
+    }
+  }
+  for (n = 0; n < routes; n++) {
+    if (codec_pass_addr(&cols[COLUMNAR_ELEM_COL_NEXTHOP]) != 0 ||
+        codec_get_varint(&cols[COLUMNAR_ELEM_COL_COMMS], &len) != 0 ||
+        len > UINT64_MAX / sizeof(uint32_t) ||
+        codec_pass_bytes(&cols[COLUMNAR_ELEM_COL_COMMS],
+                         len * sizeof(uint32_t)) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* -------------------- RECORD FILTERING -------------------- */
+
+static int check_filters(bgpstream_record_t *record,
+                         bgpstream_filter_mgr_t *filter_mgr)
+{
+  if (filter_mgr->projects != NULL &&
+      bgpstream_str_set_exists(filter_mgr->projects, record->project_name) ==
+        0) {
+    return 0;
+  }
+
+  if (filter_mgr->collectors != NULL &&
+      bgpstream_str_set_exists(filter_mgr->collectors,
+                               record->collector_name) == 0) {
+    return 0;
+  }
+
+  if (filter_mgr->routers != NULL &&
+      bgpstream_str_set_exists(filter_mgr->routers, record->router_name) ==
+        0) {
+    return 0;
+  }
+
+  if (filter_mgr->bgp_types != NULL &&
+      bgpstream_str_set_exists(filter_mgr->bgp_types,
+                               record->type == BGPSTREAM_RIB ? "ribs"
+                                                             : "updates") ==
+        0) {
+    return 0;
+  }
+
+  if (TIF != NULL &&
+      (record->time_sec < TIF->begin_time ||
+       (TIF->end_time != BGPSTREAM_FOREVER &&
+        record->time_sec > TIF->end_time))) {
+    return 0;
+  }
+
+  return 1;
+}
+
+/* decode the next record of the current row group */
+static int decode_record(bgpstream_format_t *format,
+                         bgpstream_record_t *record)
+{
+  codec_cursor_t *cols = STATE->rec_cols;
+  uint8_t type, dump_pos;
+  uint32_t source_id;
+  uint64_t elems_cnt;
+  source_t *src;
+
+  if (codec_get_delta32(&cols[COLUMNAR_REC_COL_TIME], STATE->last_time_sec,
+                        &record->time_sec) != 0 ||
+      codec_get_varint32(&cols[COLUMNAR_REC_COL_USEC], &record->time_usec) !=
+        0 ||
+      codec_get_u8(&cols[COLUMNAR_REC_COL_INFO], &type) != 0 ||
+      codec_get_u8(&cols[COLUMNAR_REC_COL_INFO], &dump_pos) != 0 ||
+      codec_get_varint32(&cols[COLUMNAR_REC_COL_INFO], &source_id) != 0 ||
+      source_id >= STATE->sources_cnt ||
+      codec_get_delta32(&cols[COLUMNAR_REC_COL_INFO], record->time_sec,
+                        &record->dump_time_sec) != 0 ||
+      codec_get_varint(&cols[COLUMNAR_REC_COL_ELEMS], &elems_cnt) != 0) {
+    return -1;
+  }
+  STATE->last_time_sec = record->time_sec;
+  STATE->recs_left--;
+
+  src = &STATE->sources[source_id];
+  memcpy(record->project_name, src->project, sizeof(src->project));
+  memcpy(record->collector_name, src->collector, sizeof(src->collector));
+  memcpy(record->router_name, src->router, sizeof(src->router));
+  record->router_ip = src->router_ip;
+  record->type = type;
+  record->dump_pos = dump_pos;
+  record->status = BGPSTREAM_RECORD_STATUS_VALID_RECORD;
+
+  if (STATE->rg == NULL) {
+    // the elems of this row group were skipped
+    return 0;
+  }
+
+  // the record decodes its elems from its own copy of the position, so move
+  // the row group position past its elems
+  RDATA->rg = rowgroup_retain(STATE->rg);
+  RDATA->cur = STATE->cur;
+  RDATA->elems_cnt = elems_cnt;
+  return skip_elems(&STATE->cur, elems_cnt);
+}
+
+static void clear_rec_data(rec_data_t *rd)
+{
+  rowgroup_release(rd->rg);
+  rd->rg = NULL;
+  rd->elems_cnt = 0;
+}
+
+/* decode the next elem of the record into the given elem. elems only
+ * reference the (retained) row group, so this is also the fill_next_elem
+ * method */
+static int fill_next_elem(bgpstream_format_t *format,
+                          bgpstream_record_t *record, bgpstream_elem_t *el)
+{
+  if (RDATA == NULL || RDATA->elems_cnt == 0) {
+    // end-of-elems
+    return 0;
+  }
+
+  bgpstream_elem_clear(el);
+  if (decode_elem(RDATA->rg, &RDATA->cur, record->time_sec, el) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Corrupted elem in columnar elem archive");
+    RDATA->elems_cnt = 0;
+    return -1;
+  }
+  RDATA->elems_cnt--;
+  return 1;
+}
+
+/* =============================================================== */
+/* ==================== PUBLIC API BELOW HERE ==================== */
+/* =============================================================== */
+
+int bs_format_columnar_create(bgpstream_format_t *format,
+                              bgpstream_resource_t *res)
+{
+  BS_FORMAT_SET_METHODS(columnar, format);
+  format->fill_next_elem = fill_next_elem;
+
+  if ((format->state = malloc_zero(sizeof(state_t))) == NULL) {
+    return -1;
+  }
+
+  return 0;
+}
+
+bgpstream_format_status_t
+bs_format_columnar_populate_record(bgpstream_format_t *format,
+                                   bgpstream_record_t *record)
+{
+  bgpstream_format_status_t status;
+
+  if (STATE->header_read == 0 &&
+      (status = read_header(format)) != BGPSTREAM_FORMAT_OK) {
+    return status;
+  }
+
+  while (1) {
+    while (STATE->recs_left == 0) {
+      if ((status = read_rowgroup(format)) == BGPSTREAM_FORMAT_CORRUPTED_DUMP) {
+        goto corrupted;
+      }
+      if (status != BGPSTREAM_FORMAT_OK) {
+        return status;
+      }
+    }
+    if (decode_record(format, record) != 0) {
+      clear_rec_data(RDATA);
+      goto corrupted;
+    }
+    if (check_filters(record, format->filter_mgr) != 0) {
+      return BGPSTREAM_FORMAT_OK;
+    }
+    // move on to the next record
+    clear_rec_data(RDATA);
+  }
+
+corrupted:
+  bgpstream_log(BGPSTREAM_LOG_WARN, "Corrupted columnar elem archive in %s",
+                format->res->url);
+  STATE->recs_left = 0;
+  record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
+  return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
+}
+
+int bs_format_columnar_get_next_elem(bgpstream_format_t *format,
+                                     bgpstream_record_t *record,
+                                     bgpstream_elem_t **elem)
+{
+  int rc;
+
+  if (RDATA == NULL) {
+    // end-of-elems
+    return 0;
+  }
+  if ((rc = fill_next_elem(format, record, RDATA->elem)) <= 0) {
+    return rc;
+  }
+
+  // return a borrowed pointer to the elem we populated
+  *elem = RDATA->elem;
+  return 1;
+}
+
+int bs_format_columnar_init_data(bgpstream_format_t *format, void **data)
+{
+  rec_data_t *rd;
+  *data = NULL;
+
+  if ((rd = malloc_zero(sizeof(rec_data_t))) == NULL) {
+    return -1;
+  }
+
+  if ((rd->elem = bgpstream_elem_create()) == NULL) {
+    free(rd);
+    return -1;
+  }
+
+  *data = rd;
+  return 0;
+}
+
+void bs_format_columnar_clear_data(bgpstream_format_t *format, void *data)
+{
+  rec_data_t *rd = (rec_data_t *)data;
+  assert(rd != NULL);
+  bgpstream_elem_clear(rd->elem);
+  clear_rec_data(rd);
+}
+
+void bs_format_columnar_destroy_data(bgpstream_format_t *format, void *data)
+{
+  rec_data_t *rd = (rec_data_t *)data;
+  if (rd == NULL) {
+    return;
+  }
+  bgpstream_elem_destroy(rd->elem);
+  rd->elem = NULL;
+  clear_rec_data(rd);
+  free(data);
+}
+
+void bs_format_columnar_destroy(bgpstream_format_t *format)
+{
+  rowgroup_release(STATE->rg);
+  free(STATE->stats);
+  free(STATE->sources);
+  free(STATE->recs);
+  free(STATE->zbuf);
+#ifdef HAVE_LIBZSTD
+  ZSTD_freeDCtx(STATE->zstd);
+#endif
+  free(format->state);
+  format->state = NULL;
+}
@@ -65,6 +65,10 @@ typedef struct rec_data {
   // state for UPDATE elem extraction
   bgpstream_parsebgp_upd_state_t upd_state;
 
+  // peer index table that was current when the record was read (elems of a
+  // retained record may be extracted while the stream reads on)
+  khash_t(td2_peer) * peer_table;
+
   // reusable parser message structure
   parsebgp_msg_t *msg;
 
@@ -78,6 +82,12 @@ typedef struct state {
   // state to store the "peer index table" when reading TABLE_DUMP_V2 records
   khash_t(td2_peer) * peer_table;
 
+  // peer index tables replaced by a later one in the same dump. records read
+  // before the replacement may still use them, and a table is never modified
+  // once built, so they are kept until the format is destroyed
+  khash_t(td2_peer) * *old_peer_tables;
+  int old_peer_tables_cnt;
+
 } state_t;
 
 static int handle_table_dump(rec_data_t *rd, parsebgp_mrt_msg_t *mrt)
@@ -291,6 +301,19 @@ static int handle_td2_peer_index(bgpstream_format_t *format,
   int khret;
   peer_index_entry_t *bs_pie;
   parsebgp_mrt_table_dump_v2_peer_entry_t *pie;
+  khash_t(td2_peer) * *old;
+
+  // keep the table that this one replaces for the records that use it
+  if (STATE->peer_table != NULL) {
+    if ((old = realloc(STATE->old_peer_tables,
+                       sizeof(khash_t(td2_peer) *) *
+                         (STATE->old_peer_tables_cnt + 1))) == NULL) {
+      return -1;
+    }
+    STATE->old_peer_tables = old;
+    STATE->old_peer_tables[STATE->old_peer_tables_cnt++] = STATE->peer_table;
+    STATE->peer_table = NULL;
+  }
 
   // alloc the table hash
   if ((STATE->peer_table = kh_init(td2_peer)) == NULL) {
@@ -336,6 +359,9 @@ populate_filter_cb(bgpstream_format_t *format, bgpstream_record_t *record,
     return BGPSTREAM_PARSEBGP_SKIP;
   }
 
+  // RIB entries are resolved through the peer index table read before them
+  RDATA->peer_table = STATE->peer_table;
+
   // set record timestamps
   ts_sec = record->time_sec = msg->types.mrt->timestamp_sec;
   record->time_usec = msg->types.mrt->timestamp_usec;
@@ -411,7 +437,7 @@ int bs_format_mrt_get_next_elem(bgpstream_format_t *format,
     break;
 
   case PARSEBGP_MRT_TYPE_TABLE_DUMP_V2:
-    rc = handle_table_dump_v2(RDATA, STATE->peer_table, mrt);
+    rc = handle_table_dump_v2(RDATA, RDATA->peer_table, mrt);
     break;
 
   case PARSEBGP_MRT_TYPE_BGP4MP:
@@ -464,6 +490,7 @@ void bs_format_mrt_clear_data(bgpstream_format_t *format, void *data)
   bgpstream_elem_clear(rd->elem);
   rd->end_of_elems = 0;
   rd->next_re = 0;
+  rd->peer_table = NULL;
   bgpstream_parsebgp_upd_state_reset(&rd->upd_state);
   parsebgp_clear_msg(rd->msg);
 }
@@ -483,10 +510,17 @@ void bs_format_mrt_destroy_data(bgpstream_format_t *format, void *data)
 
 void bs_format_mrt_destroy(bgpstream_format_t *format)
 {
+  int i;
+
   if (STATE->peer_table != NULL) {
     kh_destroy(td2_peer, STATE->peer_table);
     STATE->peer_table = NULL;
   }
+  for (i = 0; i < STATE->old_peer_tables_cnt; i++) {
+    kh_destroy(td2_peer, STATE->old_peer_tables[i]);
+  }
+  free(STATE->old_peer_tables);
+  STATE->old_peer_tables = NULL;
 
   free(format->state);
   format->state = NULL;
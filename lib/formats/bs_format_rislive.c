@@ -32,6 +32,7 @@
 #include "utils.h"
 #include "jsmn_utils.h"
 #include "libjsmn/jsmn.h"
+#include "bs_format_rislive_hex.h"
 #include <assert.h>
 #include <stdio.h>
 
@@ -133,35 +134,6 @@ typedef struct state {
     FIELDPTR(field)[FIELDLEN(field)] = tmp;                                    \
   } while (0)
 
-// convert char array to bytes
-static int hexstr_to_bytes(uint8_t *buf, const char *hexstr, size_t hexstr_len)
-{
-  size_t i;
-  char c;
-  for (i = 0; i < hexstr_len; i++) {
-    c = hexstr[i];
-    // sanity check on input characters
-    if (c < '0' || (c > '9' && c < 'A') || (c > 'F' && c < 'a') || c > 'f') {
-      return -1;
-    }
-    if (c >= 'a') {
-      c -= ('a' - '9' - 1);
-    } else if (c >= 'A') {
-      c -= ('A' - '9' - 1);
-    }
-    c -= '0';
-
-    if ((i & 0x1) == 0) {
-      // high-order
-      *buf = c << 4;
-    } else {
-      // low-order
-      *(buf++) |= c;
-    }
-  }
-  return 0;
-}
-
 // convert bgp message hex string to char (byte) array, with added header marker
 // by @alistairking
 static ssize_t hexstr_to_bgpmsg(uint8_t *buf, size_t buflen, const char *hexstr,
@@ -178,8 +150,7 @@ static ssize_t hexstr_to_bgpmsg(uint8_t *buf, size_t buflen, const char *hexstr,
                   "RIS Live raw BGP message too long (%"PRIu16" bytes)", msg_len);
     return -1;
   }
-  // parse the hex string, one nybble at a time
-  if (hexstr_to_bytes(buf, hexstr, hexstr_len) < 0) {
+  if (bs_rislive_hexstr_to_bytes(buf, hexstr, hexstr_len) < 0) {
     return -1;
   }
   return msg_len;
@@ -357,12 +328,221 @@ static int process_data(bgpstream_format_t *format,
   return 0;
 }
 
-static bgpstream_format_status_t
-bs_format_process_json_fields(bgpstream_format_t *format,
-                              bgpstream_record_t *record)
+/* -------------------- SINGLE-PASS SCANNER -------------------- */
+
+// the scanner only extracts the fields we use, without tokenizing the whole
+// message. it only handles well-formed messages, anything it does not
+// understand is left to jsmn, which knows how to report the problem.
+
+#define SKIP_WS(p, end)                                                        \
+  while ((p) < (end) &&                                                        \
+         (*(p) == ' ' || *(p) == '\t' || *(p) == '\r' || *(p) == '\n'))        \
+  (p)++
+
+// p points to the opening quote, returns a pointer past the closing quote
+static char *scan_string(char *p, char *end)
+{
+  char *q = p + 1;
+  char *b;
+
+  while ((q = memchr(q, '"', end - q)) != NULL) {
+    // the quote is escaped if preceded by an odd number of backslashes
+    for (b = q; *(b - 1) == '\\'; b--)
+      ;
+    if (((q - b) & 0x1) == 0) {
+      return q + 1;
+    }
+    q++;
+  }
+  return NULL;
+}
+
+// scan the value at p, returns a pointer past it. for strings, the value
+// excludes the quotes
+static char *scan_value(char *p, char *end, char **val, size_t *val_len)
+{
+  char *q = p;
+  int depth = 0;
+
+  if (p == end) {
+    return NULL;
+  }
+
+  if (*p == '"') {
+    if ((q = scan_string(p, end)) == NULL) {
+      return NULL;
+    }
+    *val = p + 1;
+    *val_len = q - p - 2;
+    return q;
+  }
+
+  if (*p == '{' || *p == '[') {
+    while (q < end) {
+      switch (*q) {
+      case '"':
+        if ((q = scan_string(q, end)) == NULL) {
+          return NULL;
+        }
+        continue;
+      case '{':
+      case '[':
+        depth++;
+        break;
+      case '}':
+      case ']':
+        if (--depth == 0) {
+          *val = p;
+          *val_len = q + 1 - p;
+          return q + 1;
+        }
+        break;
+      }
+      q++;
+    }
+    return NULL;
+  }
+
+  // number, true, false, or null
+  while (q < end && *q != ',' && *q != '}' && *q != ']' && *q != ' ' &&
+         *q != '\t' && *q != '\r' && *q != '\n') {
+    q++;
+  }
+  if (q == p) {
+    return NULL;
+  }
+  *val = p;
+  *val_len = q - p;
+  return q;
+}
+
+// scan the key of the object member at p, returns a pointer to its value
+static char *scan_key(char *p, char *end, char **key, size_t *key_len)
+{
+  SKIP_WS(p, end);
+  if (p == end || *p != '"' ||
+      (p = scan_value(p, end, key, key_len)) == NULL) {
+    return NULL;
+  }
+  SKIP_WS(p, end);
+  if (p == end || *p != ':') {
+    return NULL;
+  }
+  p++;
+  SKIP_WS(p, end);
+  return p;
+}
+
+// move past the ',' that separates object members, or past the '}' that
+// ends the object (setting *done). returns NULL on error
+static char *scan_next_member(char *p, char *end, int *done)
+{
+  SKIP_WS(p, end);
+  if (p < end && *p == ',') {
+    return p + 1;
+  }
+  if (p < end && *p == '}') {
+    *done = 1;
+    return p + 1;
+  }
+  return NULL;
+}
+
+#define KEYEQ(key, key_len, str)                                               \
+  ((key_len) == sizeof(str) - 1 && memcmp((key), (str), (key_len)) == 0)
+
+#define SCANFIELD(field)                                                       \
+  if (KEYEQ(key, key_len, STR(field))) {                                       \
+    STATE->json_fields.field.ptr = val;                                        \
+    STATE->json_fields.field.len = val_len;                                    \
+  }
+
+// scan the members of the "data" object at p, returns a pointer past it
+static char *scan_data(bgpstream_format_t *format, char *p, char *end)
+{
+  char *key, *val;
+  size_t key_len, val_len;
+  int done = 0;
+
+  if (p == end || *p != '{') {
+    return NULL;
+  }
+  p++;
+
+  do {
+    if ((p = scan_key(p, end, &key, &key_len)) == NULL ||
+        (p = scan_value(p, end, &val, &val_len)) == NULL) {
+      return NULL;
+    }
+    SCANFIELD(raw) //
+    else SCANFIELD(timestamp)  //
+      else SCANFIELD(host)     //
+      else SCANFIELD(peer_asn) //
+      else SCANFIELD(peer)     //
+      else SCANFIELD(type)     //
+      else SCANFIELD(state)    //
+  } while ((p = scan_next_member(p, end, &done)) != NULL && done == 0);
+
+  return p;
+}
+
+// extract the fields of a RIS Live message in a single pass. returns 0 if
+// the message is well-formed (a single object, with a "data" member), -1
+// otherwise.
+static int scan_json_fields(bgpstream_format_t *format)
+{
+  char *p = STATE->json_string_buffer;
+  char *end = p + STATE->json_string_buffer_len;
+  char *key, *val;
+  size_t key_len, val_len;
+  int done = 0, have_data = 0;
+
+  // the line length counts the newline, which readline replaced with a NUL
+  if (end > p && end[-1] == '\0') {
+    end--;
+  }
+
+  SKIP_WS(p, end);
+  if (p == end || *p != '{') {
+    return -1;
+  }
+  p++;
+
+  do {
+    if ((p = scan_key(p, end, &key, &key_len)) == NULL) {
+      return -1;
+    }
+    if (KEYEQ(key, key_len, "data")) {
+      if ((p = scan_data(format, p, end)) == NULL) {
+        return -1;
+      }
+      have_data = 1;
+      continue;
+    }
+    if ((p = scan_value(p, end, &val, &val_len)) == NULL) {
+      return -1;
+    }
+    // outer message envelope type, must be "ris_message"
+    if (KEYEQ(key, key_len, "type") && !KEYEQ(val, val_len, "ris_message")) {
+      return -1;
+    }
+  } while ((p = scan_next_member(p, end, &done)) != NULL && done == 0);
+
+  // the object must be complete, with nothing but whitespace after it
+  if (p == NULL || have_data == 0) {
+    return -1;
+  }
+  SKIP_WS(p, end);
+  return (p == end) ? 0 : -1;
+}
+
+/* -------------------- JSMN PARSER -------------------- */
+
+// extract the fields of a RIS Live message using jsmn. returns 0 on success,
+// -1 if the message is malformed.
+static int parse_json_fields(bgpstream_format_t *format)
 {
   int i, r;
-  bgpstream_format_status_t rc;
   jsmn_parser p;
 
   jsmntok_t *t, *root_tok;
@@ -429,7 +609,7 @@ again:
       NEXT_TOK;
       jsmn_type_assert(t, JSMN_OBJECT);
       // handle data
-      if ((rc = process_data(format, t)) != 0) {
+      if (process_data(format, t) != 0) {
         goto corrupted;
       }
       break; // we have all we need, so no need to keep parsing
@@ -441,6 +621,30 @@ again:
     }
   }
 
+  free(root_tok);
+  return 0;
+
+err:
+corrupted:
+  free(root_tok);
+  return -1;
+}
+
+static bgpstream_format_status_t
+bs_format_process_json_fields(bgpstream_format_t *format,
+                              bgpstream_record_t *record)
+{
+  bgpstream_format_status_t rc;
+
+  // fall back to the full parser for anything the scanner cannot handle
+  memset(&STATE->json_fields, 0, sizeof(STATE->json_fields));
+  if (scan_json_fields(format) != 0) {
+    memset(&STATE->json_fields, 0, sizeof(STATE->json_fields));
+    if (parse_json_fields(format) != 0) {
+      goto corrupted;
+    }
+  }
+
   if (FIELDLEN(type) == 0) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Missing RIS Live message type");
     goto corrupted;
@@ -493,16 +697,12 @@ again:
   }
 
 ok:
-  free(root_tok);
   return BGPSTREAM_FORMAT_OK;
 
-err:
 corrupted:
-  free(root_tok);
   return process_corrupted_message(format, record);
 
 unsupported:
-  free(root_tok);
   return process_unsupported_message(format, record);
 }
 
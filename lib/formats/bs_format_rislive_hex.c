@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bs_format_rislive_hex.h"
+#include <pthread.h>
+
+#ifdef BS_RISLIVE_HEX_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef BS_RISLIVE_HEX_AVX2
+#include <immintrin.h>
+#endif
+
+// nybble value of each hex character, or 0xF0 if the character is not hex
+static uint8_t hex_vals[256];
+
+static void hex_vals_init(void)
+{
+  int c;
+  for (c = 0; c < 256; c++) {
+    if (c >= '0' && c <= '9') {
+      hex_vals[c] = c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+      hex_vals[c] = c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+      hex_vals[c] = c - 'a' + 10;
+    } else {
+      hex_vals[c] = 0xF0;
+    }
+  }
+}
+
+// the kernel used by bs_rislive_hexstr_to_bytes
+static bs_rislive_hex_func_t *hexstr_to_bytes;
+static pthread_once_t hexstr_to_bytes_once = PTHREAD_ONCE_INIT;
+
+// pick the widest vector unit we have
+static void hexstr_to_bytes_init(void)
+{
+  hex_vals_init();
+  hexstr_to_bytes = bs_rislive_hexstr_to_bytes_scalar;
+#ifdef BS_RISLIVE_HEX_SSE2
+  hexstr_to_bytes = bs_rislive_hexstr_to_bytes_sse2;
+#endif
+#ifdef BS_RISLIVE_HEX_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    hexstr_to_bytes = bs_rislive_hexstr_to_bytes_avx2;
+  }
+#endif
+}
+
+int bs_rislive_hexstr_to_bytes_scalar(uint8_t *buf, const char *hexstr,
+                                      size_t hexstr_len)
+{
+  const uint8_t *in = (const uint8_t *)hexstr;
+  uint8_t hi, lo, bad = 0;
+  size_t i;
+
+  pthread_once(&hexstr_to_bytes_once, hexstr_to_bytes_init);
+  for (i = 0; i + 1 < hexstr_len; i += 2) {
+    hi = hex_vals[in[i]];
+    lo = hex_vals[in[i + 1]];
+    bad |= hi | lo;
+    *(buf++) = (hi << 4) | lo;
+  }
+  return ((bad & 0xF0) != 0) ? -1 : 0;
+}
+
+#ifdef BS_RISLIVE_HEX_SSE2
+// convert 16 hex characters to their nybble values, clearing *valid if any of
+// them is not hex
+static inline __m128i hex_nybbles_sse2(__m128i c, int *valid)
+{
+  // c - '0' <= 9 for digits, (c | 0x20) - 'a' <= 5 for letters (unsigned)
+  __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  __m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                           _mm_set1_epi8('a'));
+  __m128i is_d =
+    _mm_cmpeq_epi8(_mm_subs_epu8(d, _mm_set1_epi8(9)), _mm_setzero_si128());
+  __m128i is_l =
+    _mm_cmpeq_epi8(_mm_subs_epu8(l, _mm_set1_epi8(5)), _mm_setzero_si128());
+
+  if (_mm_movemask_epi8(_mm_or_si128(is_d, is_l)) != 0xFFFF) {
+    *valid = 0;
+  }
+  return _mm_or_si128(
+    _mm_and_si128(is_d, d),
+    _mm_and_si128(is_l, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+// combine pairs of nybbles (high first) into the low byte of each 16-bit lane
+static inline __m128i hex_pack_sse2(__m128i n)
+{
+  return _mm_or_si128(
+    _mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0x00FF)), 4),
+    _mm_srli_epi16(n, 8));
+}
+
+int bs_rislive_hexstr_to_bytes_sse2(uint8_t *buf, const char *hexstr,
+                                    size_t hexstr_len)
+{
+  int valid = 1;
+  __m128i a, b;
+
+  for (; hexstr_len >= 32; hexstr_len -= 32, hexstr += 32, buf += 16) {
+    a = hex_nybbles_sse2(_mm_loadu_si128((const __m128i *)hexstr), &valid);
+    b = hex_nybbles_sse2(_mm_loadu_si128((const __m128i *)(hexstr + 16)),
+                         &valid);
+    _mm_storeu_si128((__m128i *)buf,
+                     _mm_packus_epi16(hex_pack_sse2(a), hex_pack_sse2(b)));
+  }
+  if (valid == 0) {
+    return -1;
+  }
+  return bs_rislive_hexstr_to_bytes_scalar(buf, hexstr, hexstr_len);
+}
+#endif
+
+#ifdef BS_RISLIVE_HEX_AVX2
+// as above, with 32 characters per register
+__attribute__((target("avx2"))) static inline __m256i
+hex_nybbles_avx2(__m256i c, int *valid)
+{
+  __m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+  __m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)),
+                              _mm256_set1_epi8('a'));
+  __m256i is_d = _mm256_cmpeq_epi8(_mm256_subs_epu8(d, _mm256_set1_epi8(9)),
+                                   _mm256_setzero_si256());
+  __m256i is_l = _mm256_cmpeq_epi8(_mm256_subs_epu8(l, _mm256_set1_epi8(5)),
+                                   _mm256_setzero_si256());
+
+  if (_mm256_movemask_epi8(_mm256_or_si256(is_d, is_l)) != -1) {
+    *valid = 0;
+  }
+  return _mm256_or_si256(
+    _mm256_and_si256(is_d, d),
+    _mm256_and_si256(is_l, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+hex_pack_avx2(__m256i n)
+{
+  return _mm256_or_si256(
+    _mm256_slli_epi16(_mm256_and_si256(n, _mm256_set1_epi16(0x00FF)), 4),
+    _mm256_srli_epi16(n, 8));
+}
+
+__attribute__((target("avx2"))) int
+bs_rislive_hexstr_to_bytes_avx2(uint8_t *buf, const char *hexstr,
+                                size_t hexstr_len)
+{
+  int valid = 1;
+  __m256i a, b;
+
+  for (; hexstr_len >= 64; hexstr_len -= 64, hexstr += 64, buf += 32) {
+    a = hex_nybbles_avx2(_mm256_loadu_si256((const __m256i *)hexstr), &valid);
+    b = hex_nybbles_avx2(_mm256_loadu_si256((const __m256i *)(hexstr + 32)),
+                         &valid);
+    // packus works within 128-bit lanes, so put the quadwords back in order
+    _mm256_storeu_si256(
+      (__m256i *)buf,
+      _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(hex_pack_avx2(a), hex_pack_avx2(b)), 0xD8));
+  }
+  if (valid == 0) {
+    return -1;
+  }
+  return bs_rislive_hexstr_to_bytes_sse2(buf, hexstr, hexstr_len);
+}
+#endif
+
+int bs_rislive_hex_have_avx2(void)
+{
+  pthread_once(&hexstr_to_bytes_once, hexstr_to_bytes_init);
+#ifdef BS_RISLIVE_HEX_AVX2
+  return hexstr_to_bytes == bs_rislive_hexstr_to_bytes_avx2;
+#else
+  return 0;
+#endif
+}
+
+int bs_rislive_hexstr_to_bytes(uint8_t *buf, const char *hexstr,
+                               size_t hexstr_len)
+{
+  pthread_once(&hexstr_to_bytes_once, hexstr_to_bytes_init);
+  return hexstr_to_bytes(buf, hexstr, hexstr_len);
+}
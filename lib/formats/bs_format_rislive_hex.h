@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BS_FORMAT_RISLIVE_HEX_H
+#define __BS_FORMAT_RISLIVE_HEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the private hex decoding kernels used by
+ * the RIS Live format to convert raw BGP messages.
+ *
+ * Each kernel converts hexstr_len / 2 bytes (an odd trailing character is
+ * ignored), accepting upper and lower case hex digits, and returns -1 if any
+ * of the converted characters is not a hex digit. The vector kernels give
+ * the same results as the scalar one; they are exposed so that they can be
+ * tested and benchmarked against it.
+ *
+ */
+
+#if defined(__SSE2__)
+#define BS_RISLIVE_HEX_SSE2
+#endif
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__SSE2__)
+#define BS_RISLIVE_HEX_AVX2
+#endif
+
+/** Signature of a hex decoding kernel */
+typedef int(bs_rislive_hex_func_t)(uint8_t *buf, const char *hexstr,
+                                   size_t hexstr_len);
+
+/** Convert a hex string to bytes, using the widest kernel that this CPU
+ * supports */
+int bs_rislive_hexstr_to_bytes(uint8_t *buf, const char *hexstr,
+                               size_t hexstr_len);
+
+/** Convert a hex string to bytes, one character at a time */
+int bs_rislive_hexstr_to_bytes_scalar(uint8_t *buf, const char *hexstr,
+                                      size_t hexstr_len);
+
+#ifdef BS_RISLIVE_HEX_SSE2
+/** Convert a hex string to bytes, 32 characters at a time */
+int bs_rislive_hexstr_to_bytes_sse2(uint8_t *buf, const char *hexstr,
+                                    size_t hexstr_len);
+#endif
+
+#ifdef BS_RISLIVE_HEX_AVX2
+/** Convert a hex string to bytes, 64 characters at a time (only call this if
+ * bs_rislive_hex_have_avx2 returns non-zero) */
+int bs_rislive_hexstr_to_bytes_avx2(uint8_t *buf, const char *hexstr,
+                                    size_t hexstr_len);
+#endif
+
+/** Does this CPU support the AVX2 kernel? */
+int bs_rislive_hex_have_avx2(void);
+
+#endif /* __BS_FORMAT_RISLIVE_HEX_H */
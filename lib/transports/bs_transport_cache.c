@@ -31,15 +31,20 @@
 #include "bs_transport_cache.h"
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
+#include "khash.h"
 #include "utils.h"
 #include "wandio.h"
+#include <dirent.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <time.h>
 
 #define STATE ((cache_state_t *)(transport->state))
 
@@ -47,7 +52,90 @@
 #define CACHE_LOCK_FILE_SUFFIX ".lock"
 #define CACHE_TEMP_FILE_SUFFIX ".temp"
 
+/** Size of the chunks that are handed to the cache writer thread */
+#define CACHE_CHUNK_LEN (1024 * 1024)
+
+/** Maximum number of chunks queued for the cache writer thread. The reader
+ * only waits for the writer if it falls this far behind. */
+#define CACHE_CHUNKS_MAX 16
+
+/** Cache codecs */
+static const struct {
+  const char *name;
+  int compress_type;
+  int compress_level;
+} codecs[] = {
+  {"raw", WANDIO_COMPRESS_NONE, 0},
+  {"gzip", WANDIO_COMPRESS_ZLIB, 6},
+  {"lz4", WANDIO_COMPRESS_LZ4, 1},
+  {"zstd", WANDIO_COMPRESS_ZSTD, 3},
+};
+
+/** Magic numbers of the compressed formats that wandio can read. A cache
+ * file that starts with none of these is uncompressed. */
+static const struct {
+  const char *magic;
+  size_t len;
+} compressed_magics[] = {
+  {"\x1f\x8b", 2},                  // gzip
+  {"BZh", 3},                       // bzip2
+  {"\x89LZO", 4},                   // lzo
+  {"\xfd" "7zXZ", 5},               // xz
+  {"\x28\xb5\x2f\xfd", 4},          // zstd
+  {"\x04\x22\x4d\x18", 4},          // lz4
+};
+
+typedef struct cache_chunk {
+  struct cache_chunk *next;
+  size_t len;
+  uint8_t data[CACHE_CHUNK_LEN];
+} cache_chunk_t;
+
+/** Writes the cache file on a separate thread, so that the reader never
+ * waits for compression or disk writes */
+typedef struct cache_writer {
+
+  /** wandio writer for the temporary cache file */
+  iow_t *iow;
+
+  /** writer thread */
+  pthread_t thread;
+
+  /** protects the queue and free list */
+  pthread_mutex_t mutex;
+
+  /** signalled when a chunk is queued or freed */
+  pthread_cond_t cond;
+
+  /** chunks waiting to be written (oldest first) */
+  cache_chunk_t *queue_head;
+  cache_chunk_t *queue_tail;
+
+  /** chunks that have been written, ready for reuse */
+  cache_chunk_t *free;
+
+  /** number of chunks allocated */
+  int chunks_cnt;
+
+  /** chunk being filled by the reader */
+  cache_chunk_t *cur;
+
+  /** set once no more chunks will be queued */
+  int done;
+
+  /** set if a write failed, or the cache was abandoned */
+  int failed;
+
+} cache_writer_t;
+
 typedef struct cache_state {
+  /** borrowed pointer to the cache directory path (NULL if caching is not
+   * possible) */
+  const char *cache_dir;
+
+  /** resource hash, which names the cache files */
+  char *hash;
+
   /** absolute path for the local cache file */
   char *cache_file_path;
 
@@ -63,11 +151,17 @@ typedef struct cache_state {
   /** file descriptor of cache lock file */
   int lock_fd;
 
-  /** content reader, either from local cache or from remote URL */
+  /** content reader, either from local cache or from remote URL (NULL if
+   * reading from a memory-mapped cache file) */
   io_t *reader;
 
+  /** memory-mapped (uncompressed) cache file, and our position in it */
+  uint8_t *map;
+  size_t map_len;
+  size_t map_off;
+
   /** cache content writer, or NULL if we're not writing */
-  iow_t *writer;
+  cache_writer_t *writer;
 
 } cache_state_t;
 
@@ -95,6 +189,800 @@ static int bs_asprintf(char **strp, const char *fmt, ...)
   return len;
 }
 
+/* ==================== LOCKS ==================== */
+
+/* fcntl() locks do not exclude other threads of this process (e.g., the
+ * prefetcher), so the lock files that we hold are also tracked here. The value
+ * is non-zero if the lock is held by a prefetch. */
+KHASH_INIT(cache_lock, char *, int, 1, kh_str_hash_func, kh_str_hash_equal)
+
+static pthread_mutex_t cache_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_locks_cond = PTHREAD_COND_INITIALIZER;
+static khash_t(cache_lock) *cache_locks = NULL;
+
+/* take the in-process lock for the given (borrowed) path. a reader waits for a
+ * prefetch of the same file to finish (so that it can then read the cache)
+ * rather than downloading it again */
+static int cache_lock_acquire(char *path, int prefetch)
+{
+  khiter_t k;
+  int khret;
+
+  pthread_mutex_lock(&cache_locks_mutex);
+  if (cache_locks == NULL && (cache_locks = kh_init(cache_lock)) == NULL) {
+    goto err;
+  }
+  while ((k = kh_get(cache_lock, cache_locks, path)) != kh_end(cache_locks)) {
+    if (prefetch != 0 || kh_val(cache_locks, k) == 0) {
+      goto err;
+    }
+    pthread_cond_wait(&cache_locks_cond, &cache_locks_mutex);
+  }
+  k = kh_put(cache_lock, cache_locks, path, &khret);
+  if (khret < 0) {
+    goto err;
+  }
+  kh_val(cache_locks, k) = prefetch;
+  pthread_mutex_unlock(&cache_locks_mutex);
+  return 0;
+
+err:
+  pthread_mutex_unlock(&cache_locks_mutex);
+  return -1;
+}
+
+static void cache_lock_release(char *path)
+{
+  khiter_t k;
+
+  pthread_mutex_lock(&cache_locks_mutex);
+  if ((k = kh_get(cache_lock, cache_locks, path)) != kh_end(cache_locks)) {
+    kh_del(cache_lock, cache_locks, k);
+  }
+  pthread_cond_broadcast(&cache_locks_cond);
+  pthread_mutex_unlock(&cache_locks_mutex);
+}
+
+/* lock the given (borrowed) lock file path, in this process and on disk.
+ * returns the lock file descriptor, or -1 (with errno set) if the file is
+ * locked by someone else */
+static int lock_file(char *path, int prefetch)
+{
+  // Note: POSIX fcntl(F_SETLK) locks can not synchronize different threads in
+  // the same process.  BSD flock() can, but is not POSIX.  Threads of this
+  // process are synchronized by cache_lock_acquire() instead.
+  struct flock lock;
+  int fd, err;
+
+  if (cache_lock_acquire(path, prefetch) != 0) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  if ((fd = open(path, O_CREAT | O_WRONLY, 0644)) < 0) {
+    goto err;
+  }
+
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = 0;
+  if (fcntl(fd, F_SETLK, &lock) < 0) {
+    err = errno;
+    close(fd);
+    errno = err;
+    goto err;
+  }
+
+  return fd;
+
+err:
+  err = errno;
+  cache_lock_release(path);
+  errno = err;
+  return -1;
+}
+
+static void unlock_file(char *path, int fd)
+{
+  // Note: even if we never explicitly release the lock, it will be released
+  // automatically when the lock_fd closes at program exit (the file will
+  // remain, but it will not be locked).
+  remove(path);
+  close(fd);
+  cache_lock_release(path);
+}
+
+/* ==================== CACHE WRITER ==================== */
+
+static void *cache_writer_thread(void *user)
+{
+  cache_writer_t *w = (cache_writer_t *)user;
+  cache_chunk_t *chunk;
+
+  pthread_mutex_lock(&w->mutex);
+  while (1) {
+    while (w->queue_head == NULL && w->done == 0) {
+      pthread_cond_wait(&w->cond, &w->mutex);
+    }
+    if ((chunk = w->queue_head) == NULL) {
+      break;
+    }
+    if ((w->queue_head = chunk->next) == NULL) {
+      w->queue_tail = NULL;
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    if (__atomic_load_n(&w->failed, __ATOMIC_RELAXED) == 0 &&
+        wandio_wwrite(w->iow, chunk->data, chunk->len) != (int64_t)chunk->len) {
+      __atomic_store_n(&w->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&w->mutex);
+    chunk->next = w->free;
+    w->free = chunk;
+    pthread_cond_signal(&w->cond);
+  }
+  pthread_mutex_unlock(&w->mutex);
+
+  return NULL;
+}
+
+static cache_writer_t *cache_writer_create(const char *path,
+                                           const char *codec)
+{
+  cache_writer_t *w;
+  int i;
+
+  for (i = 0; i < ARR_CNT(codecs); i++) {
+    if (strcmp(codec, codecs[i].name) == 0) {
+      break;
+    }
+  }
+  if (i == ARR_CNT(codecs)) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: Unknown cache codec '%s', using "
+                  BGPSTREAM_TRANSPORT_CACHE_DEFAULT_CODEC, codec);
+    for (i = 0; strcmp(codecs[i].name,
+                       BGPSTREAM_TRANSPORT_CACHE_DEFAULT_CODEC) != 0; i++)
+      ;
+  }
+
+  if ((w = malloc_zero(sizeof(cache_writer_t))) == NULL) {
+    return NULL;
+  }
+
+  if ((w->iow = wandio_wcreate(path, codecs[i].compress_type,
+                               codecs[i].compress_level, O_CREAT)) == NULL &&
+      codecs[i].compress_type != WANDIO_COMPRESS_ZLIB) {
+    // wandio may have been built without support for this codec
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: Could not create %s cache file, using gzip",
+                  codecs[i].name);
+    w->iow = wandio_wcreate(path, WANDIO_COMPRESS_ZLIB, 6, O_CREAT);
+  }
+  if (w->iow == NULL) {
+    free(w);
+    return NULL;
+  }
+
+  pthread_mutex_init(&w->mutex, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  if (pthread_create(&w->thread, NULL, cache_writer_thread, w) != 0) {
+    pthread_mutex_destroy(&w->mutex);
+    pthread_cond_destroy(&w->cond);
+    wandio_wdestroy(w->iow);
+    free(w);
+    return NULL;
+  }
+
+  return w;
+}
+
+static void cache_writer_queue(cache_writer_t *w)
+{
+  pthread_mutex_lock(&w->mutex);
+  if (w->queue_tail != NULL) {
+    w->queue_tail->next = w->cur;
+  } else {
+    w->queue_head = w->cur;
+  }
+  w->queue_tail = w->cur;
+  w->cur = NULL;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+/* copy data for the writer thread. returns 0 if successful, -1 if the cache
+ * can no longer be written */
+static int cache_writer_write(cache_writer_t *w, const uint8_t *buf,
+                              size_t len)
+{
+  size_t n;
+
+  while (len > 0) {
+    if (__atomic_load_n(&w->failed, __ATOMIC_RELAXED) != 0) {
+      return -1;
+    }
+
+    if (w->cur == NULL) {
+      pthread_mutex_lock(&w->mutex);
+      while (w->free == NULL && w->chunks_cnt == CACHE_CHUNKS_MAX) {
+        pthread_cond_wait(&w->cond, &w->mutex);
+      }
+      if ((w->cur = w->free) != NULL) {
+        w->free = w->cur->next;
+      }
+      pthread_mutex_unlock(&w->mutex);
+      if (w->cur == NULL) {
+        if ((w->cur = malloc(sizeof(cache_chunk_t))) == NULL) {
+          return -1;
+        }
+        w->chunks_cnt++;
+      }
+      w->cur->next = NULL;
+      w->cur->len = 0;
+    }
+
+    n = CACHE_CHUNK_LEN - w->cur->len;
+    n = (len < n) ? len : n;
+    memcpy(w->cur->data + w->cur->len, buf, n);
+    w->cur->len += n;
+    buf += n;
+    len -= n;
+
+    if (w->cur->len == CACHE_CHUNK_LEN) {
+      cache_writer_queue(w);
+    }
+  }
+
+  return 0;
+}
+
+/* finish writing (or abandon, if `valid` is 0) the cache file. returns 0 if
+ * the whole cache file was written, -1 otherwise */
+static int cache_writer_destroy(cache_writer_t *w, int valid)
+{
+  cache_chunk_t *chunk;
+  int failed;
+
+  if (valid == 0) {
+    __atomic_store_n(&w->failed, 1, __ATOMIC_RELAXED);
+  }
+  if (w->cur != NULL && w->cur->len > 0) {
+    cache_writer_queue(w);
+  }
+
+  pthread_mutex_lock(&w->mutex);
+  w->done = 1;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+  pthread_join(w->thread, NULL);
+
+  wandio_wdestroy(w->iow);
+  failed = w->failed;
+
+  free(w->cur);
+  while ((chunk = w->free) != NULL) {
+    w->free = chunk->next;
+    free(chunk);
+  }
+  pthread_mutex_destroy(&w->mutex);
+  pthread_cond_destroy(&w->cond);
+  free(w);
+
+  return (failed != 0) ? -1 : 0;
+}
+
+/* ==================== CACHE INDEX ==================== */
+
+/* The cache index is a log in the cache directory, with a line for each cache
+ * file that is added ("+ <hash> <size> <time> <url>"), read from
+ * ("@ <hash> <time>") or evicted ("- <hash>"). Lines are appended while
+ * holding the index lock, and the log is rewritten once it has grown well
+ * beyond the number of cache files. A rewritten log starts with a
+ * "# <size>" line giving its size, so that a read (which does not load the
+ * index) can tell how much the log has grown from its current size alone.
+ * When a cache file is added and the directory is over quota, the least
+ * recently used files are evicted. */
+
+#define CACHE_INDEX_FILE "bgpstream-cache.index"
+#define CACHE_INDEX_LOCK_FILE CACHE_INDEX_FILE ".lock"
+
+/** Rewrite the index once it has this many more lines than entries */
+#define CACHE_INDEX_SLACK 1024
+
+typedef struct cache_entry {
+  /** resource hash (also the key in the index table) */
+  char *hash;
+
+  /** size of the cache file */
+  uint64_t size;
+
+  /** time the cache file was last written or read */
+  uint32_t last_access;
+
+  /** URL of the resource */
+  char *url;
+} cache_entry_t;
+
+KHASH_INIT(cache_entry, char *, cache_entry_t *, 1, kh_str_hash_func,
+           kh_str_hash_equal)
+
+typedef struct cache_index {
+  /** borrowed pointer to the cache directory */
+  const char *dir;
+
+  /** entries, by resource hash */
+  khash_t(cache_entry) *entries;
+
+  /** sum of the sizes of all entries */
+  uint64_t total_size;
+
+  /** number of lines in the index file */
+  int lines_cnt;
+} cache_index_t;
+
+/* excludes other threads of this process while the index is locked */
+static pthread_mutex_t cache_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* cache counters (for all streams of this process) */
+static uint64_t cache_hits = 0;
+static uint64_t cache_misses = 0;
+static uint64_t cache_evictions = 0;
+
+static int index_lock(const char *dir)
+{
+  struct flock lock;
+  char *path;
+  int fd;
+
+  pthread_mutex_lock(&cache_index_mutex);
+  if (bs_asprintf(&path, "%s/%s", dir, CACHE_INDEX_LOCK_FILE) < 0) {
+    goto err;
+  }
+  fd = open(path, O_CREAT | O_WRONLY, 0644);
+  free(path);
+  if (fd < 0) {
+    goto err;
+  }
+
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = 0;
+  while (fcntl(fd, F_SETLKW, &lock) < 0) {
+    if (errno != EINTR) {
+      close(fd);
+      goto err;
+    }
+  }
+  return fd;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: can't lock cache index in %s: %s",
+                dir, strerror(errno));
+  pthread_mutex_unlock(&cache_index_mutex);
+  return -1;
+}
+
+static void index_unlock(int fd)
+{
+  close(fd);
+  pthread_mutex_unlock(&cache_index_mutex);
+}
+
+/* append a line to the index (the index must be locked), and return its
+ * length */
+#ifdef __GNUC__
+__attribute__((format(printf, 2, 3)))
+#endif
+static int index_append(const char *dir, const char *fmt, ...)
+{
+  char *path = NULL, *line = NULL;
+  va_list ap;
+  int fd = -1, len, ret = -1;
+
+  va_start(ap, fmt);
+  len = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+  if (len < 0 || (line = malloc(len + 1)) == NULL) {
+    goto done;
+  }
+  va_start(ap, fmt);
+  vsnprintf(line, len + 1, fmt, ap);
+  va_end(ap);
+
+  if (bs_asprintf(&path, "%s/%s", dir, CACHE_INDEX_FILE) < 0 ||
+      (fd = open(path, O_CREAT | O_WRONLY | O_APPEND, 0644)) < 0 ||
+      write(fd, line, len) != len) {
+    goto done;
+  }
+  ret = len;
+
+done:
+  if (fd >= 0) {
+    close(fd);
+  }
+  free(path);
+  free(line);
+  return ret;
+}
+
+static void index_entry_destroy(cache_entry_t *e)
+{
+  free(e->hash);
+  free(e->url);
+  free(e);
+}
+
+static void index_remove(cache_index_t *idx, const char *hash)
+{
+  khiter_t k;
+  cache_entry_t *e;
+
+  if ((k = kh_get(cache_entry, idx->entries, (char *)hash)) ==
+      kh_end(idx->entries)) {
+    return;
+  }
+  e = kh_val(idx->entries, k);
+  kh_del(cache_entry, idx->entries, k);
+  idx->total_size -= e->size;
+  index_entry_destroy(e);
+}
+
+static int index_put(cache_index_t *idx, const char *hash, uint64_t size,
+                     uint32_t last_access, const char *url)
+{
+  cache_entry_t *e;
+  khiter_t k;
+  int khret;
+
+  index_remove(idx, hash);
+  if ((e = malloc_zero(sizeof(cache_entry_t))) == NULL ||
+      (e->hash = strdup(hash)) == NULL || (e->url = strdup(url)) == NULL) {
+    goto err;
+  }
+  e->size = size;
+  e->last_access = last_access;
+  k = kh_put(cache_entry, idx->entries, e->hash, &khret);
+  if (khret < 0) {
+    goto err;
+  }
+  kh_val(idx->entries, k) = e;
+  idx->total_size += size;
+  return 0;
+
+err:
+  if (e != NULL) {
+    index_entry_destroy(e);
+  }
+  return -1;
+}
+
+static void index_destroy(cache_index_t *idx)
+{
+  khiter_t k;
+
+  if (idx->entries == NULL) {
+    return;
+  }
+  for (k = kh_begin(idx->entries); k != kh_end(idx->entries); ++k) {
+    if (kh_exist(idx->entries, k)) {
+      index_entry_destroy(kh_val(idx->entries, k));
+    }
+  }
+  kh_destroy(cache_entry, idx->entries);
+  idx->entries = NULL;
+}
+
+/* add the cache files that are not in the index (e.g., files written before
+ * there was an index) */
+static int index_scan(cache_index_t *idx)
+{
+  size_t suffix_len = strlen(CACHE_FILE_SUFFIX);
+  char hash[1024];
+  struct dirent *ent;
+  struct stat st;
+  char *path;
+  size_t len;
+  DIR *dir;
+  int rc;
+
+  if ((dir = opendir(idx->dir)) == NULL) {
+    return -1;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    len = strlen(ent->d_name);
+    if (len <= suffix_len || len - suffix_len >= sizeof(hash) ||
+        strcmp(ent->d_name + len - suffix_len, CACHE_FILE_SUFFIX) != 0) {
+      continue;
+    }
+    memcpy(hash, ent->d_name, len - suffix_len);
+    hash[len - suffix_len] = '\0';
+    if (kh_get(cache_entry, idx->entries, hash) != kh_end(idx->entries)) {
+      continue;
+    }
+    if (bs_asprintf(&path, "%s/%s", idx->dir, ent->d_name) < 0) {
+      break;
+    }
+    rc = stat(path, &st);
+    free(path);
+    if (rc == 0 && index_put(idx, hash, st.st_size, st.st_atime, "") != 0) {
+      break;
+    }
+  }
+  closedir(dir);
+  return (ent == NULL) ? 0 : -1;
+}
+
+/* read the index (which must be locked) into memory */
+static int index_load(cache_index_t *idx, const char *dir)
+{
+  char hash[1024];
+  char *path = NULL, *line = NULL;
+  size_t line_len = 0;
+  ssize_t len;
+  uint64_t size;
+  uint32_t last_access;
+  khiter_t k;
+  FILE *f;
+  int n;
+
+  memset(idx, 0, sizeof(cache_index_t));
+  idx->dir = dir;
+  if ((idx->entries = kh_init(cache_entry)) == NULL ||
+      bs_asprintf(&path, "%s/%s", dir, CACHE_INDEX_FILE) < 0) {
+    goto err;
+  }
+
+  if ((f = fopen(path, "r")) == NULL) {
+    free(path);
+    // no index yet, so build one from the files that are already there
+    return index_scan(idx);
+  }
+  free(path);
+
+  while ((len = getline(&line, &line_len, f)) > 0) {
+    idx->lines_cnt++;
+    if (line[len - 1] == '\n') {
+      line[len - 1] = '\0';
+    }
+    if (sscanf(line, "+ %1023s %" SCNu64 " %" SCNu32 " %n", hash, &size,
+               &last_access, &n) == 3) {
+      if (index_put(idx, hash, size, last_access, line + n) != 0) {
+        fclose(f);
+        goto err;
+      }
+    } else if (sscanf(line, "@ %1023s %" SCNu32, hash, &last_access) == 2) {
+      if ((k = kh_get(cache_entry, idx->entries, hash)) !=
+          kh_end(idx->entries)) {
+        kh_val(idx->entries, k)->last_access = last_access;
+      }
+    } else if (sscanf(line, "- %1023s", hash) == 1) {
+      index_remove(idx, hash);
+    }
+  }
+  fclose(f);
+  free(line);
+  return 0;
+
+err:
+  free(line);
+  index_destroy(idx);
+  return -1;
+}
+
+/* has the index (which must be locked) grown by more than CACHE_INDEX_SLACK
+ * lines of the given length since it was last rewritten? */
+static int index_grown(const char *dir, int line_len)
+{
+  char header[64];
+  char *path;
+  uint64_t size = 0;
+  struct stat st;
+  ssize_t len;
+  int fd, grown = 0;
+
+  if (bs_asprintf(&path, "%s/%s", dir, CACHE_INDEX_FILE) < 0) {
+    return 0;
+  }
+  fd = open(path, O_RDONLY);
+  free(path);
+  if (fd < 0) {
+    return 0;
+  }
+  if (fstat(fd, &st) == 0) {
+    // an index that was never rewritten has no header, and counts from 0
+    if ((len = pread(fd, header, sizeof(header) - 1, 0)) > 0) {
+      header[len] = '\0';
+      sscanf(header, "# %" SCNu64, &size);
+    }
+    grown = (uint64_t)st.st_size >
+            size + (uint64_t)CACHE_INDEX_SLACK * line_len;
+  }
+  close(fd);
+  return grown;
+}
+
+/* replace the index file with one that only has the current entries */
+static int index_rewrite(cache_index_t *idx)
+{
+  char *path = NULL, *temp_path = NULL;
+  cache_entry_t *e;
+  khiter_t k;
+  FILE *f = NULL;
+  long size;
+
+  // the header is fixed width, so that it can be filled in at the end
+  if (bs_asprintf(&path, "%s/%s", idx->dir, CACHE_INDEX_FILE) < 0 ||
+      bs_asprintf(&temp_path, "%s%s", path, CACHE_TEMP_FILE_SUFFIX) < 0 ||
+      (f = fopen(temp_path, "w")) == NULL ||
+      fprintf(f, "# %020" PRIu64 "\n", (uint64_t)0) < 0) {
+    goto err;
+  }
+  for (k = kh_begin(idx->entries); k != kh_end(idx->entries); ++k) {
+    if (!kh_exist(idx->entries, k)) {
+      continue;
+    }
+    e = kh_val(idx->entries, k);
+    if (fprintf(f, "+ %s %" PRIu64 " %" PRIu32 " %s\n", e->hash, e->size,
+                e->last_access, e->url) < 0) {
+      goto err;
+    }
+  }
+  if ((size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0 ||
+      fprintf(f, "# %020" PRIu64 "\n", (uint64_t)size) < 0) {
+    goto err;
+  }
+  if (fclose(f) != 0) {
+    f = NULL;
+    goto err;
+  }
+  f = NULL;
+  if (rename(temp_path, path) != 0) {
+    goto err;
+  }
+  idx->lines_cnt = kh_size(idx->entries) + 1;
+  free(path);
+  free(temp_path);
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: could not rewrite cache index "
+                "in %s", idx->dir);
+  if (f != NULL) {
+    fclose(f);
+  }
+  if (temp_path != NULL) {
+    remove(temp_path);
+  }
+  free(path);
+  free(temp_path);
+  return -1;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+  const cache_entry_t *ea = *(cache_entry_t * const *)a;
+  const cache_entry_t *eb = *(cache_entry_t * const *)b;
+
+  return (ea->last_access > eb->last_access) -
+         (ea->last_access < eb->last_access);
+}
+
+/* evict least recently used files (other than `keep`) until the index is
+ * within quota. a file is only removed while holding its lock, so it can't be
+ * removed while it is being written; readers that already have it open are
+ * not affected, and readers that don't will download it again. */
+static int index_evict(cache_index_t *idx, uint64_t quota, const char *keep)
+{
+  cache_entry_t **lru = NULL;
+  char *cache_path, *lock_path;
+  int i, cnt = 0, fd;
+  int evicted = 0;
+  khiter_t k;
+
+  if (idx->total_size <= quota) {
+    return 0;
+  }
+
+  if ((lru = malloc(sizeof(cache_entry_t *) * kh_size(idx->entries))) ==
+      NULL) {
+    return -1;
+  }
+  for (k = kh_begin(idx->entries); k != kh_end(idx->entries); ++k) {
+    if (kh_exist(idx->entries, k)) {
+      lru[cnt++] = kh_val(idx->entries, k);
+    }
+  }
+  qsort(lru, cnt, sizeof(cache_entry_t *), entry_cmp);
+
+  for (i = 0; i < cnt && idx->total_size > quota; i++) {
+    if (strcmp(lru[i]->hash, keep) == 0 ||
+        bs_asprintf(&cache_path, "%s/%s%s", idx->dir, lru[i]->hash,
+                    CACHE_FILE_SUFFIX) < 0) {
+      continue;
+    }
+    if (bs_asprintf(&lock_path, "%s%s", cache_path,
+                    CACHE_LOCK_FILE_SUFFIX) < 0) {
+      free(cache_path);
+      continue;
+    }
+    if ((fd = lock_file(lock_path, 1)) >= 0) {
+      if (remove(cache_path) == 0 || errno == ENOENT) {
+        bgpstream_log(BGPSTREAM_LOG_FINE, "evicted cache %s", cache_path);
+        index_append(idx->dir, "- %s\n", lru[i]->hash);
+        idx->lines_cnt++;
+        index_remove(idx, lru[i]->hash);
+        __atomic_add_fetch(&cache_evictions, 1, __ATOMIC_RELAXED);
+        evicted++;
+      }
+      unlock_file(lock_path, fd);
+    }
+    free(cache_path);
+    free(lock_path);
+  }
+
+  free(lru);
+  return evicted;
+}
+
+/* record a read of the given cache file, and rewrite the index if reads have
+ * made it grow too much (there may be no more cache files added to do so) */
+static void index_access(const char *dir, const char *hash)
+{
+  cache_index_t idx;
+  int fd, len;
+
+  if ((fd = index_lock(dir)) < 0) {
+    return;
+  }
+  len = index_append(dir, "@ %s %" PRIu32 "\n", hash, (uint32_t)time(NULL));
+  if (len > 0 && index_grown(dir, len) != 0 && index_load(&idx, dir) == 0) {
+    index_rewrite(&idx);
+    index_destroy(&idx);
+  }
+  index_unlock(fd);
+}
+
+/* add a new cache file to the index, and evict old files if the cache is over
+ * quota (0 means no quota) */
+static void index_add(const char *dir, const char *hash, uint64_t size,
+                      const char *url, uint64_t quota)
+{
+  cache_index_t idx;
+  int fd, scanned;
+
+  if ((fd = index_lock(dir)) < 0) {
+    return;
+  }
+  if (index_load(&idx, dir) != 0) {
+    index_unlock(fd);
+    return;
+  }
+  // a missing index was built from a scan of the directory
+  scanned = (idx.lines_cnt == 0 && kh_size(idx.entries) > 0);
+
+  if (index_put(&idx, hash, size, time(NULL), url) == 0) {
+    index_append(dir, "+ %s %" PRIu64 " %" PRIu32 " %s\n", hash, size,
+                 (uint32_t)time(NULL), url);
+    idx.lines_cnt++;
+  }
+  if (quota > 0) {
+    index_evict(&idx, quota, hash);
+  }
+  if (scanned != 0 ||
+      idx.lines_cnt > (int)kh_size(idx.entries) + CACHE_INDEX_SLACK) {
+    index_rewrite(&idx);
+  }
+
+  index_destroy(&idx);
+  index_unlock(fd);
+}
+
+/* ==================== CACHE FILES ==================== */
+
 /**
    Initialize the cache_state_t data structure;
 */
@@ -133,7 +1021,8 @@ static int init_state(bgpstream_transport_t *transport)
 
   // set cache file paths (lock_file is last so if that's set we'll know all
   // three are set)
-  if (bs_asprintf(&STATE->cache_file_path, "%s/%s%s",
+  if ((STATE->hash = strdup(resource_hash)) == NULL ||
+    bs_asprintf(&STATE->cache_file_path, "%s/%s%s",
                   cache_dir_path, resource_hash, CACHE_FILE_SUFFIX) < 0 ||
     bs_asprintf(&STATE->temp_file_path, "%s%s",
                 STATE->cache_file_path, CACHE_TEMP_FILE_SUFFIX) < 0 ||
@@ -144,34 +1033,22 @@ static int init_state(bgpstream_transport_t *transport)
                   "WARNING: Could not set cache file names.");
     return 0; // not fatal; we can't use cache, but can still read remote
   }
+  STATE->cache_dir = cache_dir_path;
 
   return 0;
 }
 
-static int bs_transport_cache_lock(bgpstream_transport_t *transport)
+static int bs_transport_cache_lock(bgpstream_transport_t *transport,
+                                   int prefetch)
 {
-  // Note: POSIX fcntl(F_SETLK) locks can not synchronize different threads in
-  // the same process.  BSD flock() can, but is not POSIX.
-  struct flock lock;
-
   if (!STATE->lock_file_path)
     return -1;
 
-  if ((STATE->lock_fd = open(STATE->lock_file_path, O_CREAT | O_WRONLY, 0644)) < 0) {
-    bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: can't open lock file %s: %s",
-        STATE->lock_file_path, strerror(errno));
-    return -1;
-  }
-
-  lock.l_type = F_WRLCK;
-  lock.l_whence = SEEK_SET;
-  lock.l_start = 0;
-  lock.l_len = 0;
-  if (fcntl(STATE->lock_fd, F_SETLK, &lock) < 0) {
-    bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: can't lock file %s: %s",
-        STATE->lock_file_path, strerror(errno));
-    close(STATE->lock_fd);
-    STATE->lock_fd = -1;
+  if ((STATE->lock_fd = lock_file(STATE->lock_file_path, prefetch)) < 0) {
+    // a prefetch just leaves the file to whoever has it
+    bgpstream_log(prefetch ? BGPSTREAM_LOG_FINE : BGPSTREAM_LOG_WARN,
+                  "WARNING: can't lock file %s: %s", STATE->lock_file_path,
+                  strerror(errno));
     return -1;
   }
 
@@ -180,20 +1057,64 @@ static int bs_transport_cache_lock(bgpstream_transport_t *transport)
 
 static void bs_transport_cache_unlock(bgpstream_transport_t *transport)
 {
-  // Note: even if we never explicitly release the lock, it will be released
-  // automatically when the lock_fd closes at program exit (the file will
-  // remain, but it will not be locked).
-  remove(STATE->lock_file_path);
-  close(STATE->lock_fd);
+  unlock_file(STATE->lock_file_path, STATE->lock_fd);
   STATE->lock_fd = -1;
 }
 
+/* Map the cache file into memory if it is uncompressed. Returns 1 if mapped,
+ * 0 if the file must be read with wandio, -1 on error. */
+static int map_cache_file(bgpstream_transport_t *transport)
+{
+  uint8_t magic[8];
+  struct stat st;
+  ssize_t magic_len;
+  void *map;
+  int fd, i;
+
+  if ((fd = open(STATE->cache_file_path, O_RDONLY)) < 0) {
+    return -1;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size == 0 ||
+      (magic_len = pread(fd, magic, sizeof(magic), 0)) < 0) {
+    close(fd);
+    return 0;
+  }
+  for (i = 0; i < ARR_CNT(compressed_magics); i++) {
+    if (magic_len >= compressed_magics[i].len &&
+        memcmp(magic, compressed_magics[i].magic, compressed_magics[i].len) ==
+          0) {
+      close(fd);
+      return 0;
+    }
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return 0;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  STATE->map = map;
+  STATE->map_len = st.st_size;
+  STATE->map_off = 0;
+  transport->skip = bs_transport_cache_skip;
+  transport->borrow = bs_transport_cache_borrow;
+  return 1;
+}
+
 static int open_cache_reader(bgpstream_transport_t *transport)
 {
   // Create reader that reads from existing local cache file.
   STATE->reader_name = STATE->cache_file_path;
-  if ((STATE->reader = wandio_create(STATE->reader_name))) {
+  if (map_cache_file(transport) == 1) {
+    bgpstream_log(BGPSTREAM_LOG_FINE, "mapped cache %s", STATE->reader_name);
+  } else if ((STATE->reader = wandio_create(STATE->reader_name))) {
     bgpstream_log(BGPSTREAM_LOG_FINE, "reading cache %s", STATE->reader_name);
+  }
+  if (STATE->map != NULL || STATE->reader != NULL) {
+    __atomic_add_fetch(&cache_hits, 1, __ATOMIC_RELAXED);
+    index_access(STATE->cache_dir, STATE->hash);
     return 0; // success
   }
   bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: Could not read cache %s",
@@ -201,6 +1122,28 @@ static int open_cache_reader(bgpstream_transport_t *transport)
   return -1;
 }
 
+static int open_cache_writer(bgpstream_transport_t *transport)
+{
+  const char *codec;
+
+  // Create cache file writer, which compresses and writes on its own thread.
+  if ((codec = bgpstream_resource_get_attr(
+         transport->res, BGPSTREAM_RESOURCE_ATTR_CACHE_CODEC)) == NULL) {
+    codec = BGPSTREAM_TRANSPORT_CACHE_DEFAULT_CODEC;
+  }
+  if ((STATE->writer = cache_writer_create(STATE->temp_file_path, codec)) ==
+      NULL) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: Could not open %s for local caching: %s",
+                  STATE->temp_file_path, strerror(errno));
+    bs_transport_cache_unlock(transport);
+    return -1;
+  }
+  bgpstream_log(BGPSTREAM_LOG_FINE, "writing temp cache %s (%s)",
+      STATE->temp_file_path, codec);
+  return 0;
+}
+
 int bs_transport_cache_create(bgpstream_transport_t *transport)
 {
   // reset transport method
@@ -218,7 +1161,7 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
       return 0; // reading from local cache
   }
 
-  if (bs_transport_cache_lock(transport) == 0) {
+  if (bs_transport_cache_lock(transport, 0) == 0) {
     // We own the lock.
     // Check cache access again to avoid a race where another process finished
     // writing a cache between our first access() and our getting the lock.
@@ -246,24 +1189,14 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
     return -1;
   }
   bgpstream_log(BGPSTREAM_LOG_FINE, "reading remote %s", STATE->reader_name);
+  if (STATE->cache_dir != NULL) {
+    __atomic_add_fetch(&cache_misses, 1, __ATOMIC_RELAXED);
+  }
 
   if (STATE->lock_fd >= 0) {
     // We own the lock.
-    // Create cache file writer using wandio with compression enabled at
-    // default compression level ZLib default compression level is 6:
-    // https://zlib.net/manual.html
-    STATE->writer = wandio_wcreate(STATE->temp_file_path,
-                                   WANDIO_COMPRESS_ZLIB, 6, O_CREAT);
-    if (STATE->writer == NULL) {
-      bgpstream_log(BGPSTREAM_LOG_WARN,
-                    "WARNING: Could not open %s for local caching: %s",
-                    STATE->temp_file_path, strerror(errno));
-      // failing to create the cache is not fatal
-      bs_transport_cache_unlock(transport);
-      return 0; // reading from remote file
-    }
-    bgpstream_log(BGPSTREAM_LOG_FINE, "writing temp cache %s",
-        STATE->temp_file_path);
+    // Failing to create the cache is not fatal.
+    open_cache_writer(transport);
   }
 
   return 0; // reading from remote file
@@ -279,10 +1212,17 @@ int64_t bs_transport_cache_readline(bgpstream_transport_t *transport,
 
 static void close_cache_writer(bgpstream_transport_t *transport, int valid)
 {
+  const char *quota;
+  struct stat st;
+
   if (!STATE->writer)
     return;
 
-  wandio_wdestroy(STATE->writer);
+  if (cache_writer_destroy(STATE->writer, valid) != 0 && valid) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: error writing to cache %s.",
+                  STATE->temp_file_path);
+    valid = 0;
+  }
   STATE->writer = NULL;
 
   if (valid) {
@@ -290,6 +1230,13 @@ static void close_cache_writer(bgpstream_transport_t *transport, int valid)
     if (rename(STATE->temp_file_path, STATE->cache_file_path) != 0) {
       bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: failed to rename %s: %s",
                     STATE->temp_file_path, strerror(errno));
+    } else if (stat(STATE->cache_file_path, &st) == 0) {
+      // add it to the index (while we still hold its lock)
+      quota = bgpstream_resource_get_attr(transport->res,
+                                          BGPSTREAM_RESOURCE_ATTR_CACHE_QUOTA);
+      index_add(STATE->cache_dir, STATE->hash, st.st_size,
+                transport->res->url,
+                (quota != NULL) ? strtoull(quota, NULL, 10) : 0);
     }
 
   } else {
@@ -306,8 +1253,19 @@ static void close_cache_writer(bgpstream_transport_t *transport, int valid)
 int64_t bs_transport_cache_read(bgpstream_transport_t *transport,
                                 uint8_t *buffer, int64_t len)
 {
+  int64_t ret;
+
+  // an uncompressed cache file is served straight from memory
+  if (STATE->map != NULL) {
+    ret = STATE->map_len - STATE->map_off;
+    ret = (len < ret) ? len : ret;
+    memcpy(buffer, STATE->map + STATE->map_off, ret);
+    STATE->map_off += ret;
+    return ret;
+  }
+
   // read content
-  int64_t ret = wandio_read(STATE->reader, buffer, len);
+  ret = wandio_read(STATE->reader, buffer, len);
 
   if (ret < 0) {
     // reader encountered an error
@@ -321,11 +1279,10 @@ int64_t bs_transport_cache_read(bgpstream_transport_t *transport,
     close_cache_writer(transport, 1);
 
   } else if (STATE->writer) {
-    // reader has read content, and caching is enabled
-    int64_t wret = wandio_wwrite(STATE->writer, buffer, ret);
-    if (wret != ret) {
-      bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: %s to cache %s.",
-                    wret < 0 ? "error writing" : "incomplete write",
+    // reader has read content, and caching is enabled (the writer thread
+    // compresses and writes it)
+    if (cache_writer_write(STATE->writer, buffer, ret) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: error writing to cache %s.",
                     STATE->temp_file_path);
       close_cache_writer(transport, 0);
       // caching is now disabled, but we can keep reading
@@ -335,12 +1292,55 @@ int64_t bs_transport_cache_read(bgpstream_transport_t *transport,
   return ret;
 }
 
+int64_t bs_transport_cache_skip(bgpstream_transport_t *transport, int64_t len)
+{
+  int64_t n = STATE->map_len - STATE->map_off;
+
+  n = (len < n) ? len : n;
+  STATE->map_off += n;
+  return n;
+}
+
+int64_t bs_transport_cache_borrow(bgpstream_transport_t *transport,
+                                  const uint8_t **buffer)
+{
+  int64_t n = STATE->map_len - STATE->map_off;
+
+  // the whole file is mapped until we are destroyed, so lend out the rest
+  *buffer = STATE->map + STATE->map_off;
+  STATE->map_off = STATE->map_len;
+  return n;
+}
+
+static void destroy_state(bgpstream_transport_t *transport)
+{
+  // close reader
+  if (STATE->reader != NULL) {
+    wandio_destroy(STATE->reader);
+    STATE->reader = NULL;
+  }
+  if (STATE->map != NULL) {
+    munmap(STATE->map, STATE->map_len);
+    STATE->map = NULL;
+  }
+
+  // free up file path variables' memory space
+  free(STATE->hash);
+  free(STATE->cache_file_path);
+  free(STATE->temp_file_path);
+  free(STATE->lock_file_path);
+
+  // free up the cache_state_t's memory space
+  free(transport->state);
+  transport->state = NULL;
+}
+
 void bs_transport_cache_destroy(bgpstream_transport_t *transport)
 {
-  bgpstream_log(BGPSTREAM_LOG_FINE, "destroy reader %s", STATE->reader_name);
   if (transport->state == NULL) {
     return;
   }
+  bgpstream_log(BGPSTREAM_LOG_FINE, "destroy reader %s", STATE->reader_name);
 
   // close writer
   while (STATE->writer) {
@@ -348,21 +1348,84 @@ void bs_transport_cache_destroy(bgpstream_transport_t *transport)
     // cache.  (The other option would be to delete the cache.)
     // bs_transport_cache_read() will eventually get EOF or error, and close
     // the cache writer.
-    uint8_t buf[4096];
+    uint8_t buf[65536];
     bs_transport_cache_read(transport, buf, sizeof(buf));
   }
 
-  // close reader
-  if (STATE->reader != NULL) {
-    wandio_destroy(STATE->reader);
-    STATE->reader = NULL;
+  destroy_state(transport);
+}
+
+int64_t bs_transport_cache_prefetch(bgpstream_resource_t *res,
+                                    const int *stop)
+{
+  bgpstream_transport_t tmp;
+  bgpstream_transport_t *transport = &tmp;
+  uint8_t *buf = NULL;
+  struct stat st;
+  int64_t ret = 0;
+
+  memset(&tmp, 0, sizeof(tmp));
+  tmp.res = res;
+  if (init_state(transport) != 0) {
+    return -1;
   }
 
-  // free up file path variables' memory space
-  free(STATE->cache_file_path);
-  free(STATE->temp_file_path);
+  // do nothing if the file can't be cached, is already cached, or is being
+  // written by someone else
+  if (STATE->lock_file_path == NULL ||
+      access(STATE->cache_file_path, R_OK) == 0 ||
+      bs_transport_cache_lock(transport, 1) != 0) {
+    goto done;
+  }
+  if (access(STATE->cache_file_path, R_OK) == 0) {
+    bs_transport_cache_unlock(transport);
+    goto done;
+  }
 
-  // free up the cache_state_t's memory space
-  free(transport->state);
-  transport->state = NULL;
+  STATE->reader_name = res->url;
+  if ((STATE->reader = wandio_create(STATE->reader_name)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: Could not prefetch %s",
+                  STATE->reader_name);
+    bs_transport_cache_unlock(transport);
+    ret = -1;
+    goto done;
+  }
+  bgpstream_log(BGPSTREAM_LOG_FINE, "prefetching remote %s",
+                STATE->reader_name);
+
+  if (open_cache_writer(transport) != 0 ||
+      (buf = malloc(CACHE_CHUNK_LEN)) == NULL) {
+    close_cache_writer(transport, 0);
+    ret = -1;
+    goto done;
+  }
+
+  // bs_transport_cache_read() copies everything to the cache, and closes the
+  // writer at EOF or on error
+  while (STATE->writer != NULL) {
+    if (__atomic_load_n(stop, __ATOMIC_RELAXED) != 0) {
+      close_cache_writer(transport, 0);
+      goto done;
+    }
+    if (bs_transport_cache_read(transport, buf, CACHE_CHUNK_LEN) < 0) {
+      ret = -1;
+    }
+  }
+
+  if (ret == 0 && stat(STATE->cache_file_path, &st) == 0) {
+    ret = st.st_size;
+  }
+
+done:
+  free(buf);
+  destroy_state(transport);
+  return ret;
+}
+
+void bs_transport_cache_get_stats(uint64_t *hits, uint64_t *misses,
+                                  uint64_t *evictions)
+{
+  *hits = __atomic_load_n(&cache_hits, __ATOMIC_RELAXED);
+  *misses = __atomic_load_n(&cache_misses, __ATOMIC_RELAXED);
+  *evictions = __atomic_load_n(&cache_evictions, __ATOMIC_RELAXED);
 }
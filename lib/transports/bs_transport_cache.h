@@ -32,6 +32,42 @@
 
 #include "bgpstream_transport_interface.h"
 
+/** Codec used for new cache files (one of "raw", "gzip", "lz4" or "zstd").
+ * Cache files written with any codec can always be read. */
+#define BGPSTREAM_TRANSPORT_CACHE_DEFAULT_CODEC "lz4"
+
 BS_TRANSPORT_GENERATE_PROTOS(cache)
 
+/** Skip len bytes of an uncompressed (memory-mapped) cache file */
+int64_t bs_transport_cache_skip(bgpstream_transport_t *transport, int64_t len);
+
+/** Borrow the rest of an uncompressed (memory-mapped) cache file */
+int64_t bs_transport_cache_borrow(bgpstream_transport_t *transport,
+                                  const uint8_t **buffer);
+
+/** Download the given resource into the local cache, without reading it
+ *
+ * @param res           pointer to the (cache transport) resource to download
+ * @param stop          pointer to a flag that aborts the download when set
+ * @return the size of the cache file written, 0 if nothing was written (the
+ * resource is already cached, is being cached by another reader, or the
+ * download was aborted), or -1 if an error occurred
+ *
+ * This follows the same lock/temp-file protocol as reading the resource. A
+ * reader in this process that opens the resource while it is being prefetched
+ * waits for the download to finish, and then reads the cache.
+ */
+int64_t bs_transport_cache_prefetch(bgpstream_resource_t *res,
+                                    const int *stop);
+
+/** Get the cache counters for all streams of this process
+ *
+ * @param[out] hits       set to the number of resources read from the cache
+ * @param[out] misses     set to the number of resources read from the remote
+ *                        source instead of the cache
+ * @param[out] evictions  set to the number of files evicted from the cache
+ */
+void bs_transport_cache_get_stats(uint64_t *hits, uint64_t *misses,
+                                  uint64_t *evictions);
+
 #endif /* __BS_TRANSPORT_CACHE_H */
@@ -27,21 +27,90 @@
 #include "bs_transport_file.h"
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
+#include "utils.h"
 #include "wandio.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+#define STATE ((state_t *)(transport->state))
+
+typedef struct state {
+
+  // the file
+  io_t *fh;
+
+  // our offset in the file (only tracked when reading a range)
+  int64_t pos;
+
+  // offset at which to stop reading (or -1 to read the whole file)
+  int64_t end;
+
+} state_t;
+
+// move to the first line that starts at or after the given offset
+static int seek_line(bgpstream_transport_t *transport, int64_t start)
+{
+  char buf[4096];
+  int64_t rc;
+
+  if (start == 0) {
+    STATE->pos = 0;
+    return 0;
+  }
+
+  // the line starting at start is ours only if the byte before it ends a line
+  if (wandio_seek(STATE->fh, start - 1, SEEK_SET) < 0) {
+    return -1;
+  }
+  STATE->pos = start - 1;
+  do {
+    if ((rc = wandio_fgets(STATE->fh, buf, sizeof(buf), 0)) < 0) {
+      return -1;
+    }
+    STATE->pos += rc;
+  } while (rc == sizeof(buf) - 1 && buf[rc - 1] != '\n');
+
+  return 0;
+}
 
 int bs_transport_file_create(bgpstream_transport_t *transport)
 {
-  io_t *fh = NULL;
+  const char *range;
+  int64_t start;
 
   BS_TRANSPORT_SET_METHODS(file, transport);
 
-  if ((fh = wandio_create(transport->res->url)) == NULL) {
+  if ((transport->state = malloc_zero(sizeof(state_t))) == NULL) {
+    return -1;
+  }
+  STATE->end = -1;
+
+  if ((STATE->fh = wandio_create(transport->res->url)) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading",
                   transport->res->url);
     return -1;
   }
 
-  transport->state = fh;
+  // wandio can only seek in uncompressed files. nothing has been read yet, so
+  // a failed probe leaves the reader untouched.
+  if (wandio_seek(STATE->fh, 0, SEEK_CUR) >= 0) {
+    transport->skip = bs_transport_file_skip;
+  }
+
+  if ((range = bgpstream_resource_get_attr(
+         transport->res, BGPSTREAM_RESOURCE_ATTR_FILE_RANGE)) != NULL) {
+    if (sscanf(range, "%" SCNd64 "-%" SCNd64, &start, &STATE->end) != 2 ||
+        start < 0 || STATE->end < start) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid file range '%s' for %s",
+                    range, transport->res->url);
+      return -1;
+    }
+    if (transport->skip == NULL || seek_line(transport, start) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not seek to %" PRId64 " in %s",
+                    start, transport->res->url);
+      return -1;
+    }
+  }
 
   return 0;
 }
@@ -49,19 +118,67 @@ int bs_transport_file_create(bgpstream_transport_t *transport)
 int64_t bs_transport_file_read(bgpstream_transport_t *transport,
                                uint8_t *buffer, int64_t len)
 {
-  return wandio_read((io_t *)transport->state, buffer, len);
+  int64_t rc;
+
+  if (STATE->end < 0) {
+    return wandio_read(STATE->fh, buffer, len);
+  }
+
+  if (len > STATE->end - STATE->pos) {
+    len = STATE->end - STATE->pos;
+  }
+  if (len <= 0) {
+    return 0;
+  }
+  if ((rc = wandio_read(STATE->fh, buffer, len)) > 0) {
+    STATE->pos += rc;
+  }
+  return rc;
 }
 
 int64_t bs_transport_file_readline(bgpstream_transport_t *transport,
                                    uint8_t *buffer, int64_t len)
 {
-  return wandio_fgets((io_t *)transport->state, buffer, len, 1);
+  int64_t rc;
+
+  if (STATE->end < 0) {
+    return wandio_fgets(STATE->fh, buffer, len, 1);
+  }
+
+  // we own every line that starts before the end of the range
+  if (STATE->pos >= STATE->end) {
+    return 0;
+  }
+  // keep the newline so we know how far we have read
+  if ((rc = wandio_fgets(STATE->fh, buffer, len, 0)) <= 0) {
+    return rc;
+  }
+  STATE->pos += rc;
+  // chomp it, but (like wandio_fgets) count it, so that a blank line is not
+  // mistaken for the end of the range
+  if (buffer[rc - 1] == '\n') {
+    buffer[rc - 1] = '\0';
+  }
+  return rc;
+}
+
+int64_t bs_transport_file_skip(bgpstream_transport_t *transport, int64_t len)
+{
+  if (wandio_seek(STATE->fh, len, SEEK_CUR) < 0) {
+    return -1;
+  }
+  STATE->pos += len;
+  return len;
 }
 
 void bs_transport_file_destroy(bgpstream_transport_t *transport)
 {
-  if (transport->state != NULL) {
-    wandio_destroy((io_t *)transport->state);
-    transport->state = NULL;
+  if (transport->state == NULL) {
+    return;
+  }
+  if (STATE->fh != NULL) {
+    wandio_destroy(STATE->fh);
   }
+  free(transport->state);
+  transport->state = NULL;
 }
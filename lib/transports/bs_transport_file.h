@@ -31,4 +31,7 @@
 
 BS_TRANSPORT_GENERATE_PROTOS(file)
 
+/** Skip len bytes by seeking (only used for uncompressed files) */
+int64_t bs_transport_file_skip(bgpstream_transport_t *transport, int64_t len);
+
 #endif /* __BS_TRANSPORT_FILE_H */
@@ -28,15 +28,19 @@
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
 #include "utils.h"
-#include <assert.h>
+#include <fcntl.h>
 #include <librdkafka/rdkafka.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define STATE ((state_t *)(transport->state))
 
 #define POLL_TIMEOUT_MSEC 0
 
+/* maximum number of messages to consume from the queue at once */
+#define BATCH_SIZE 256
+
 typedef struct state {
 
   // convenience local copies of attrs
@@ -56,6 +60,26 @@ typedef struct state {
   // has a fatal error occured?
   int fatal_error;
 
+  // consumer queue, and a pipe that rdkafka writes to when messages are added
+  // to it
+  rd_kafka_queue_t *queue;
+  int wakeup_pipe[2];
+
+  // did the last read find the queue empty? (if so, the pipe may have been
+  // written to and must be drained before the next poll)
+  int drain;
+
+  // the current batch of messages. messages before batch_idx have been read
+  // and are destroyed on the next call to a read method (data lent out by
+  // borrow must stay valid until then)
+  rd_kafka_message_t *batch[BATCH_SIZE];
+  int batch_cnt;
+  int batch_idx;
+  int batch_released;
+
+  // offset of the first unread byte of batch[batch_idx]
+  size_t msg_off;
+
 } state_t;
 
 static int parse_attrs(bgpstream_transport_t *transport)
@@ -217,16 +241,53 @@ static int init_topic(bgpstream_transport_t *transport)
   return 0;
 }
 
+static int init_wakeup(bgpstream_transport_t *transport)
+{
+  int i;
+
+  if (pipe(STATE->wakeup_pipe) != 0) {
+    STATE->wakeup_pipe[0] = STATE->wakeup_pipe[1] = -1;
+    return -1;
+  }
+  // rdkafka must never block writing to the pipe, and we must never block
+  // draining it
+  for (i = 0; i < 2; i++) {
+    if (fcntl(STATE->wakeup_pipe[i], F_SETFL,
+              fcntl(STATE->wakeup_pipe[i], F_GETFL) | O_NONBLOCK) != 0) {
+      return -1;
+    }
+  }
+
+  if ((STATE->queue = rd_kafka_queue_get_consumer(STATE->rk)) == NULL) {
+    return -1;
+  }
+  rd_kafka_queue_io_event_enable(STATE->queue, STATE->wakeup_pipe[1], "1", 1);
+
+  return 0;
+}
+
+static void drain_wakeup(bgpstream_transport_t *transport)
+{
+  char buf[64];
+
+  while (read(STATE->wakeup_pipe[0], buf, sizeof(buf)) > 0)
+    ;
+  STATE->drain = 0;
+}
+
 int bs_transport_kafka_create(bgpstream_transport_t *transport)
 {
   rd_kafka_conf_t *conf;
   char errstr[512];
 
   BS_TRANSPORT_SET_METHODS(kafka, transport);
+  transport->borrow = bs_transport_kafka_borrow;
+  transport->get_fd = bs_transport_kafka_get_fd;
 
   if ((transport->state = malloc_zero(sizeof(state_t))) == NULL) {
     return -1;
   }
+  STATE->wakeup_pipe[0] = STATE->wakeup_pipe[1] = -1;
 
   if (parse_attrs(transport) != 0) {
     return -1;
@@ -271,6 +332,12 @@ int bs_transport_kafka_create(bgpstream_transport_t *transport)
   // switch to consumer poll mode
   rd_kafka_poll_set_consumer(STATE->rk);
 
+  // and ask to be notified when the consumer queue has messages
+  if (init_wakeup(transport) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not set up Kafka wakeup pipe");
+    return -1;
+  }
+
   bgpstream_log(BGPSTREAM_LOG_FINE, "Kafka connected!");
   return 0;
 }
@@ -279,29 +346,109 @@ static int handle_err_msg(bgpstream_transport_t *transport,
                           rd_kafka_message_t *rk_msg)
 {
   if (rk_msg->err == RD_KAFKA_RESP_ERR__PARTITION_EOF) {
-    rd_kafka_message_destroy(rk_msg);
     return 0; // EOS
   }
 
   bgpstream_log(BGPSTREAM_LOG_ERR, "Unhandled Kafka error: %s: %s",
                 rd_kafka_err2str(rk_msg->err), rd_kafka_message_errstr(rk_msg));
-
-  rd_kafka_message_destroy(rk_msg);
   return -1;
 }
 
+static void release_msgs(bgpstream_transport_t *transport)
+{
+  while (STATE->batch_released < STATE->batch_idx) {
+    rd_kafka_message_destroy(STATE->batch[STATE->batch_released++]);
+  }
+}
+
+/* make batch[batch_idx] the next message with unread data, consuming a new
+ * batch from the queue if needed. returns 1 if there is a message, 0 if there
+ * is no data, and -1 on error */
+static int next_msg(bgpstream_transport_t *transport)
+{
+  rd_kafka_message_t *rk_msg;
+  ssize_t cnt;
+
+  release_msgs(transport);
+
+  while (1) {
+    if (STATE->batch_idx == STATE->batch_cnt) {
+      release_msgs(transport);
+      STATE->batch_cnt = STATE->batch_idx = STATE->batch_released = 0;
+      STATE->msg_off = 0;
+
+      // the queue was empty last time, so the caller may have been woken by
+      // the pipe. drain it *before* polling so that a message that arrives
+      // after the poll below leaves the pipe readable.
+      if (STATE->drain != 0) {
+        drain_wakeup(transport);
+      }
+
+      // POLL_TIMEOUT_MSEC is set very low (0) since the transport should be
+      // non-blocking
+      if ((cnt = rd_kafka_consume_batch_queue(STATE->queue, POLL_TIMEOUT_MSEC,
+                                              STATE->batch, BATCH_SIZE)) < 0) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Could not consume from Kafka: %s",
+                      rd_kafka_err2str(rd_kafka_last_error()));
+        return -1;
+      }
+      if (cnt == 0) {
+        STATE->drain = 1;
+        return 0;
+      }
+      STATE->batch_cnt = cnt;
+    }
+
+    rk_msg = STATE->batch[STATE->batch_idx];
+    if (rk_msg->err != 0) {
+      STATE->batch_idx++;
+      if (handle_err_msg(transport, rk_msg) != 0) {
+        return -1;
+      }
+      continue;
+    }
+    if (STATE->msg_off < rk_msg->len) {
+      return 1;
+    }
+    // this message has been read, move on to the next one
+    STATE->batch_idx++;
+    STATE->msg_off = 0;
+  }
+}
+
 int64_t bs_transport_kafka_readline(bgpstream_transport_t *transport,
                                     uint8_t *buffer, int64_t len)
 {
-  int rc = bs_transport_kafka_read(transport, buffer, len - 1);
+  rd_kafka_message_t *rk_msg;
+  const uint8_t *line, *nl;
+  size_t line_len;
+  int64_t n;
+  int rc;
+
+  while ((rc = next_msg(transport)) > 0) {
+    rk_msg = STATE->batch[STATE->batch_idx];
+    line = (const uint8_t *)rk_msg->payload + STATE->msg_off;
+    line_len = rk_msg->len - STATE->msg_off;
+    if ((nl = memchr(line, '\n', line_len)) != NULL) {
+      line_len = nl - line;
+    }
 
-  if (rc <= 0) {
-    return rc;
-  }
+    // a message may hold several newline-separated lines
+    if (line_len == 0) {
+      STATE->msg_off++;
+      continue;
+    }
 
-  buffer[rc] = '\0';
-  // NOTE: we assume there is only one line per kafka message
-  assert(strchr((char *)buffer, '\n') == NULL);
+    // like fgets, a line that does not fit is returned in pieces
+    n = ((int64_t)line_len < len - 1) ? (int64_t)line_len : len - 1;
+    memcpy(buffer, line, n);
+    buffer[n] = '\0';
+    STATE->msg_off += n;
+    if (n == (int64_t)line_len && nl != NULL) {
+      STATE->msg_off++;
+    }
+    return n;
+  }
 
   return rc;
 }
@@ -310,40 +457,71 @@ int64_t bs_transport_kafka_read(bgpstream_transport_t *transport,
                                 uint8_t *buffer, int64_t len)
 {
   rd_kafka_message_t *rk_msg;
+  int64_t n;
+  int rc;
+
+  if ((rc = next_msg(transport)) <= 0) {
+    return rc;
+  }
+  rk_msg = STATE->batch[STATE->batch_idx];
 
-  // see if there is a message waiting for us
-  // POLL_TIMEOUT_MSEC is set very low (0) since the transport should be
-  // non-blocking
-  if ((rk_msg = rd_kafka_consumer_poll(STATE->rk, POLL_TIMEOUT_MSEC)) == NULL) {
-    return 0;
+  // messages larger than the caller's buffer (e.g., batches of MRT/BMP
+  // messages produced into a single Kafka message) are split across reads
+  n = rk_msg->len - STATE->msg_off;
+  if (n > len) {
+    n = len;
   }
-  if (rk_msg->err != 0) {
-    return handle_err_msg(transport, rk_msg);
+  memcpy(buffer, (uint8_t *)rk_msg->payload + STATE->msg_off, n);
+  STATE->msg_off += n;
+
+  return n;
+}
+
+int64_t bs_transport_kafka_borrow(bgpstream_transport_t *transport,
+                                  const uint8_t **buffer)
+{
+  rd_kafka_message_t *rk_msg;
+  int64_t n;
+  int rc;
+
+  if ((rc = next_msg(transport)) <= 0) {
+    return rc;
   }
+  rk_msg = STATE->batch[STATE->batch_idx];
 
-  // is the message too long?
-  // if this is really a problem (e.g., batches of MRT/BMP messages
-  // produced into a single Kafka message, then we can use a local
-  // buffer and split them up for the caller, but really the caller
-  // should have a large enough buffer.. so for now:
-  assert(rk_msg->len <= len);
+  // lend out the rest of the message, it will be destroyed once the caller
+  // asks for more data
+  *buffer = (const uint8_t *)rk_msg->payload + STATE->msg_off;
+  n = rk_msg->len - STATE->msg_off;
+  STATE->msg_off = rk_msg->len;
 
-  // copy the message into the provided buffer
-  memcpy(buffer, rk_msg->payload, rk_msg->len);
-  len = rk_msg->len;
-  rd_kafka_message_destroy(rk_msg);
+  return n;
+}
 
-  return len;
+int bs_transport_kafka_get_fd(bgpstream_transport_t *transport)
+{
+  return STATE->wakeup_pipe[0];
 }
 
 void bs_transport_kafka_destroy(bgpstream_transport_t *transport)
 {
   rd_kafka_resp_err_t err;
+  int i;
 
   if (transport->state == NULL) {
     return;
   }
 
+  // messages must be destroyed before the consumer
+  STATE->batch_idx = STATE->batch_cnt;
+  release_msgs(transport);
+
+  if (STATE->queue != NULL) {
+    rd_kafka_queue_io_event_enable(STATE->queue, -1, NULL, 0);
+    rd_kafka_queue_destroy(STATE->queue);
+    STATE->queue = NULL;
+  }
+
   if (STATE->rk != NULL) {
     // shut down consumer
     if ((err = rd_kafka_consumer_close(STATE->rk)) != 0) {
@@ -359,6 +537,12 @@ void bs_transport_kafka_destroy(bgpstream_transport_t *transport)
     STATE->rk = NULL;
   }
 
+  for (i = 0; i < 2; i++) {
+    if (STATE->wakeup_pipe[i] != -1) {
+      close(STATE->wakeup_pipe[i]);
+    }
+  }
+
   free(STATE->topic);
   free(STATE->group);
   free(STATE->offset);
@@ -31,6 +31,13 @@
 
 BS_TRANSPORT_GENERATE_PROTOS(kafka)
 
+/** Borrow the unread part of the current message without copying it */
+int64_t bs_transport_kafka_borrow(bgpstream_transport_t *transport,
+                                  const uint8_t **buffer);
+
+/** Get the read end of the pipe that is written to when messages arrive */
+int bs_transport_kafka_get_fd(bgpstream_transport_t *transport);
+
 #define BGPSTREAM_TRANSPORT_KAFKA_DEFAULT_OFFSET "latest"
 
 #endif /* __BS_TRANSPORT_KAFKA_H */
@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bs_transport_shm.h"
+#include "bgpstream_log.h"
+#include "bgpstream_shm_int.h"
+#include "bgpstream_transport_interface.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STATE ((state_t *)(transport->state))
+
+typedef struct state {
+
+  // mapping of the ring
+  void *map;
+  size_t map_len;
+  shm_ring_ctrl_t *ctrl;
+  uint8_t *data;
+  uint64_t size;
+
+  // inode of the ring (to tell when it has been replaced)
+  ino_t ino;
+
+  // our consumer slot
+  shm_ring_consumer_t *slot;
+
+  // our position in the stream
+  uint64_t pos;
+
+  // number of bytes of the stream header that have been read
+  int hdr_read;
+
+  // should we start at the oldest data in the ring?
+  int earliest;
+
+} state_t;
+
+/* position of the most recent sync point */
+static uint64_t latest_sync(state_t *state)
+{
+  uint64_t cnt = __atomic_load_n(&state->ctrl->syncs_cnt, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&state->ctrl->syncs[(cnt - 1) % SHM_RING_SYNCS_CNT],
+                         __ATOMIC_RELAXED);
+}
+
+/* position of the oldest sync point that has not been overwritten */
+static uint64_t earliest_sync(state_t *state)
+{
+  uint64_t cnt = __atomic_load_n(&state->ctrl->syncs_cnt, __ATOMIC_ACQUIRE);
+  uint64_t reserve =
+    __atomic_load_n(&state->ctrl->reserve_pos, __ATOMIC_ACQUIRE);
+  uint64_t i, pos;
+
+  for (i = (cnt > SHM_RING_SYNCS_CNT) ? cnt - SHM_RING_SYNCS_CNT : 0; i < cnt;
+       i++) {
+    pos = __atomic_load_n(&state->ctrl->syncs[i % SHM_RING_SYNCS_CNT],
+                          __ATOMIC_RELAXED);
+    if (reserve - pos <= state->size) {
+      return pos;
+    }
+  }
+  return latest_sync(state);
+}
+
+/* (re)start reading from the given position. the slot is marked as dropped
+ * while its position is updated so that the publisher ignores it. */
+static void set_pos(state_t *state, uint64_t pos)
+{
+  __atomic_store_n(&state->slot->state, SHM_RING_CONSUMER_DROPPED,
+                   __ATOMIC_RELEASE);
+  state->pos = pos;
+  __atomic_store_n(&state->slot->pos, pos, __ATOMIC_RELEASE);
+  __atomic_store_n(&state->slot->state, SHM_RING_CONSUMER_ACTIVE,
+                   __ATOMIC_SEQ_CST);
+}
+
+static shm_ring_consumer_t *get_slot(shm_ring_ctrl_t *ctrl)
+{
+  shm_ring_consumer_t *c;
+  uint32_t state;
+  int i, pass;
+
+  // look for a free slot, and failing that, for one whose consumer has
+  // exited without detaching
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < SHM_RING_CONSUMERS_MAX; i++) {
+      c = &ctrl->consumers[i];
+      state = __atomic_load_n(&c->state, __ATOMIC_ACQUIRE);
+      if ((pass == 0 && state != SHM_RING_CONSUMER_FREE) ||
+          (pass == 1 && (state == SHM_RING_CONSUMER_FREE ||
+                         kill(c->pid, 0) == 0 || errno != ESRCH))) {
+        continue;
+      }
+      if (__atomic_compare_exchange_n(&c->state, &state,
+                                      SHM_RING_CONSUMER_DROPPED, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        c->pid = getpid();
+        return c;
+      }
+    }
+  }
+  return NULL;
+}
+
+static void detach(state_t *state)
+{
+  if (state->slot != NULL) {
+    __atomic_store_n(&state->slot->state, SHM_RING_CONSUMER_FREE,
+                     __ATOMIC_RELEASE);
+    state->slot = NULL;
+  }
+  if (state->map != NULL) {
+    munmap(state->map, state->map_len);
+    state->map = NULL;
+  }
+}
+
+/* attach to the ring with the given name. returns 1 if attached, 0 if there
+ * is no (new) ring to attach to, and -1 on error */
+static int attach(state_t *state, const char *name)
+{
+  struct stat st;
+  shm_ring_ctrl_t *ctrl;
+  void *map;
+  int fd;
+
+  if ((fd = shm_open(name, O_RDWR, 0)) < 0) {
+    return (errno == ENOENT) ? 0 : -1;
+  }
+  if (fstat(fd, &st) != 0 || (state->map != NULL && st.st_ino == state->ino) ||
+      (size_t)st.st_size < SHM_RING_DATA_OFFSET) {
+    close(fd);
+    return 0;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+
+  // the publisher sets the magic once the ring is ready
+  ctrl = (shm_ring_ctrl_t *)map;
+  if (memcmp(ctrl->magic, SHM_RING_MAGIC, sizeof(ctrl->magic)) != 0) {
+    munmap(map, st.st_size);
+    return 0;
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (ctrl->version != SHM_RING_VERSION ||
+      SHM_RING_DATA_OFFSET + ctrl->size != (uint64_t)st.st_size ||
+      (state->map != NULL &&
+       memcmp(ctrl->stream_hdr, state->ctrl->stream_hdr,
+              BGPSTREAM_BINARY_HEADER_LEN) != 0)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Incompatible shared memory ring %s",
+                  name);
+    munmap(map, st.st_size);
+    return -1;
+  }
+
+  detach(state);
+  state->map = map;
+  state->map_len = st.st_size;
+  state->ctrl = ctrl;
+  state->data = (uint8_t *)map + SHM_RING_DATA_OFFSET;
+  state->size = ctrl->size;
+  state->ino = st.st_ino;
+
+  if ((state->slot = get_slot(ctrl)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Too many consumers attached to shared memory ring %s",
+                  name);
+    return -1;
+  }
+  set_pos(state, (state->earliest != 0) ? earliest_sync(state)
+                                        : latest_sync(state));
+  return 1;
+}
+
+/* ==================== PUBLIC FUNCTIONS ==================== */
+
+int bs_transport_shm_create(bgpstream_transport_t *transport)
+{
+  const char *offset;
+  int rc;
+
+  BS_TRANSPORT_SET_METHODS(shm, transport);
+
+  if ((transport->state = malloc_zero(sizeof(state_t))) == NULL) {
+    return -1;
+  }
+
+  if ((offset = bgpstream_resource_get_attr(
+         transport->res, BGPSTREAM_RESOURCE_ATTR_SHM_INIT_OFFSET)) != NULL &&
+      strcmp(offset, "earliest") == 0) {
+    STATE->earliest = 1;
+  }
+
+  if ((rc = attach(STATE, transport->res->url)) != 1) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not attach to shared memory %s%s",
+                  transport->res->url,
+                  (rc == 0) ? " (is the publisher running?)" : "");
+    bs_transport_shm_destroy(transport);
+    return -1;
+  }
+
+  // the publisher does not wait for us, so if it gets ahead it may overwrite
+  // anything but the newest data
+  STATE->earliest = 1;
+
+  return 0;
+}
+
+int64_t bs_transport_shm_read(bgpstream_transport_t *transport,
+                              uint8_t *buffer, int64_t len)
+{
+  shm_ring_ctrl_t *ctrl = STATE->ctrl;
+  uint64_t commit, reserve, off;
+  int64_t n, first;
+
+  // the stream header lives in the control block
+  if (STATE->hdr_read < BGPSTREAM_BINARY_HEADER_LEN) {
+    n = BGPSTREAM_BINARY_HEADER_LEN - STATE->hdr_read;
+    n = (len < n) ? len : n;
+    memcpy(buffer, ctrl->stream_hdr + STATE->hdr_read, n);
+    STATE->hdr_read += n;
+    return n;
+  }
+
+  if (__atomic_load_n(&STATE->slot->state, __ATOMIC_ACQUIRE) ==
+      SHM_RING_CONSUMER_DROPPED) {
+    goto lost;
+  }
+
+  commit = __atomic_load_n(&ctrl->commit_pos, __ATOMIC_ACQUIRE);
+  if (commit == STATE->pos) {
+    // once the publisher has finished, follow it to its replacement (which
+    // starts with a sync point, so the stream carries on seamlessly)
+    if (__atomic_load_n(&ctrl->closed, __ATOMIC_ACQUIRE) != 0 &&
+        __atomic_load_n(&ctrl->commit_pos, __ATOMIC_ACQUIRE) == STATE->pos &&
+        attach(STATE, transport->res->url) == 1) {
+      return bs_transport_shm_read(transport, buffer, len);
+    }
+    return 0;
+  }
+
+  n = ((uint64_t)len < commit - STATE->pos) ? len : commit - STATE->pos;
+  off = STATE->pos & (STATE->size - 1);
+  first = ((uint64_t)n < STATE->size - off) ? n : (int64_t)(STATE->size - off);
+  memcpy(buffer, STATE->data + off, first);
+  memcpy(buffer + first, STATE->data, n - first);
+
+  // if the publisher started overwriting what we copied, our copy may be
+  // garbage
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  reserve = __atomic_load_n(&ctrl->reserve_pos, __ATOMIC_RELAXED);
+  if (reserve - STATE->pos > STATE->size) {
+    goto lost;
+  }
+
+  STATE->pos += n;
+  __atomic_store_n(&STATE->slot->pos, STATE->pos, __ATOMIC_RELEASE);
+  return n;
+
+lost:
+  // we fell too far behind, so skip to the newest data. the error makes the
+  // format drop whatever it was reading, and the next read starts at a sync
+  // point.
+  bgpstream_log(BGPSTREAM_LOG_WARN,
+                "Fell behind the shm publisher on %s, skipping %" PRIu64
+                " bytes",
+                transport->res->url, latest_sync(STATE) - STATE->pos);
+  set_pos(STATE, latest_sync(STATE));
+  return -1;
+}
+
+int64_t bs_transport_shm_readline(bgpstream_transport_t *transport,
+                                  uint8_t *buffer, int64_t len)
+{
+  bgpstream_log(BGPSTREAM_LOG_ERR,
+                "The shm transport does not support line-based formats");
+  return -1;
+}
+
+void bs_transport_shm_destroy(bgpstream_transport_t *transport)
+{
+  if (transport->state == NULL) {
+    return;
+  }
+  detach(STATE);
+  free(transport->state);
+  transport->state = NULL;
+}
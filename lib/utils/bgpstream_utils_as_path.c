@@ -32,6 +32,7 @@
 
 #include "bgpstream_utils_as_path_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_fmt.h"
 #include "config.h"
 #include "khash.h"
 #include "utils.h"
@@ -88,14 +89,6 @@ seg_set_dup(const bgpstream_as_path_seg_set_t *src)
 
 /* AS HOP FUNCTIONS */
 
-#define ADD_CHAR(chr)                                                          \
-  do {                                                                         \
-    if (written < len) {                                                       \
-      buf[written] = chr;                                                      \
-    }                                                                          \
-    written++;                                                                 \
-  } while (0)
-
 /*
  * WARNING: The output format of this function is documented in both
  * bgpstream_utils_as_path.h and _pybgpstream_bgpelem.c. Ensure both places are
@@ -105,8 +98,8 @@ seg_set_dup(const bgpstream_as_path_seg_set_t *src)
 int bgpstream_as_path_seg_snprintf(char *buf, size_t len,
                                    const bgpstream_as_path_seg_t *seg)
 {
-  size_t written = 0;
-  const char *chars;
+  bgpstream_fmt_buf_t fb;
+  char *p;
 
   if (seg == NULL) {
     if (len > 0) {
@@ -115,47 +108,15 @@ int bgpstream_as_path_seg_snprintf(char *buf, size_t len,
     return 0;
   }
 
-  switch (seg->type) {
-  case BGPSTREAM_AS_PATH_SEG_ASN:
-    return snprintf(buf, len, "%" PRIu32, seg->asn.asn);
-
-  case BGPSTREAM_AS_PATH_SEG_SET:
-    /* {A,B,C} */
-    chars = "{,}";
-    break;
-
-  case BGPSTREAM_AS_PATH_SEG_CONFED_SEQ:
-    /* (A B C) */
-    chars = "( )";
-    break;
-
-  case BGPSTREAM_AS_PATH_SEG_CONFED_SET:
-    /* [A,B,C] */
-    chars = "[,]";
-    break;
-
-  default:
-    /* <A B C> */
-    chars = "< >";
-    break;
-  }
-
-  ADD_CHAR(chars[0]);
-  for (int i = 0; i < seg->set.asn_cnt; i++) {
-    if (i > 0) {
-      ADD_CHAR(chars[1]);
-    }
-    size_t remain = (len <= written) ? 0 : len - written;
-    written += snprintf(buf + written, remain, "%" PRIu32, seg->set.asn[i]);
-  }
-  ADD_CHAR(chars[2]);
-  if (written < len) {
-    buf[written] = '\0';
-  } else if (len > 0) {
-    buf[len - 1] = '\0';
+  if ((p = bgpstream_fmt_buf_start(
+         &fb, buf, len,
+         (seg->type == BGPSTREAM_AS_PATH_SEG_ASN)
+           ? BGPSTREAM_FMT_UINT32_MAX_LEN
+           : 2 + (BGPSTREAM_FMT_UINT32_MAX_LEN + 1) * seg->set.asn_cnt)) ==
+      NULL) {
+    return 0;
   }
-
-  return written;
+  return bgpstream_fmt_buf_finish(&fb, bgpstream_fmt_as_path_seg(p, seg));
 }
 
 bgpstream_as_path_seg_t *bgpstream_as_path_seg_dup(
@@ -213,29 +174,15 @@ int bgpstream_as_path_seg_equal(const bgpstream_as_path_seg_t *seg1,
 int bgpstream_as_path_snprintf(char *buf, size_t len,
                                const bgpstream_as_path_t *path)
 {
-  bgpstream_as_path_iter_t iter;
-  size_t written = 0;
-  bgpstream_as_path_seg_t *seg;
-  int need_sep = 0;
+  bgpstream_fmt_buf_t fb;
+  char *p;
 
-  /* iterate through the path and print each segment */
-  bgpstream_as_path_iter_reset(&iter);
-  while ((seg = bgpstream_as_path_get_next_seg(path, &iter)) != NULL) {
-    if (need_sep != 0) {
-      ADD_CHAR(' ');
-    }
-    need_sep = 1;
-    size_t remain = (len <= written) ? 0 : len - written;
-    written += bgpstream_as_path_seg_snprintf(buf + written, remain, seg);
-  }
-  if (len > 0) {
-    if (written == 0) {
-      buf[0] = '\0';
-    } else if (written >= len) {
-      buf[len - 1] = '\0';
-    }
+  if ((p = bgpstream_fmt_buf_start(&fb, buf, len,
+                                   bgpstream_fmt_as_path_max_len(path))) ==
+      NULL) {
+    return 0;
   }
-  return written;
+  return bgpstream_fmt_buf_finish(&fb, bgpstream_fmt_as_path(p, path));
 }
 
 bgpstream_as_path_t *bgpstream_as_path_create()
@@ -258,7 +205,7 @@ void bgpstream_as_path_clear(bgpstream_as_path_t *path)
   path->origin_offset = UINT16_MAX;
 }
 
-void bgpstream_as_path_destroy(bgpstream_as_path_t *path)
+void bgpstream_as_path_release_data(bgpstream_as_path_t *path)
 {
   if (path->data_alloc_len != UINT16_MAX) {
     free(path->data);
@@ -266,6 +213,11 @@ void bgpstream_as_path_destroy(bgpstream_as_path_t *path)
   path->data = NULL;
   path->data_alloc_len = 0;
   bgpstream_as_path_clear(path);
+}
+
+void bgpstream_as_path_destroy(bgpstream_as_path_t *path)
+{
+  bgpstream_as_path_release_data(path);
   free(path);
 }
 
@@ -275,6 +227,7 @@ int bgpstream_as_path_copy(bgpstream_as_path_t *dst,
   if (dst->data_alloc_len == UINT16_MAX) {
     /* no longer points to external memory */
     dst->data_alloc_len = 0;
+    dst->data = NULL;
   }
   if (dst->data_alloc_len < src->data_len) {
     if ((dst->data = realloc(dst->data, src->data_len)) == NULL) {
@@ -370,6 +370,8 @@ int bgpstream_as_path_populate_from_data(bgpstream_as_path_t *path,
  *
  * @note this function **does not** copy the data into the path. The path is
  * only valid as long as the data array passed to this function is valid.
+ * Any data the path already owned (e.g., from bgpstream_as_path_copy) is not
+ * freed, so it must only be used on paths that hold no data of their own.
  */
 int bgpstream_as_path_populate_from_data_zc(bgpstream_as_path_t *path,
                                             uint8_t *data, uint16_t data_len);
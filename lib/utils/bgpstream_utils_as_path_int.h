@@ -106,6 +106,16 @@ int bgpstream_as_path_append(bgpstream_as_path_t *path,
  */
 void bgpstream_as_path_update_fields(bgpstream_as_path_t *path);
 
+/** Free the data owned by the given AS Path (if any) and clear it
+ *
+ * @param path          pointer to the AS Path to release the data of
+ *
+ * The path can then be populated again with either
+ * bgpstream_as_path_populate_from_data or
+ * bgpstream_as_path_populate_from_data_zc.
+ */
+void bgpstream_as_path_release_data(bgpstream_as_path_t *path);
+
 /** @} */
 
 #endif /* __BGPSTREAM_UTILS_AS_PATH_INT_H */
@@ -27,8 +27,14 @@
 #include "config.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "khash.h"
 #include "utils.h"
@@ -38,6 +44,59 @@
 
 #include "bgpstream_utils_as_path_store.h"
 
+/** Size of the chunks that path data is allocated from */
+#define ARENA_CHUNK_SIZE (1 << 20)
+
+/** Store paths are kept in fixed-size blocks so that pointers to them stay
+ * valid as the store grows */
+#define PATH_BLOCK_BITS 16
+#define PATH_BLOCK_SIZE (1 << PATH_BLOCK_BITS)
+#define PATH_BLOCK_CNT (1 << (32 - PATH_BLOCK_BITS))
+
+/** Number of shards used by a concurrent store (must be a power of 2) */
+#define CONCURRENT_SHARD_BITS 6
+
+/** Marks the end of a hash chain */
+#define CHAIN_END UINT32_MAX
+
+/** Magic number that starts a store dictionary file */
+#define DICT_MAGIC "BGPSAPS1"
+
+/** Version of the store dictionary file format */
+#define DICT_VERSION 1
+
+/** Used to detect dictionaries written on a host with a different byte
+ * order */
+#define DICT_BYTE_ORDER 0x01020304
+
+/** Header of a store dictionary file.
+ *
+ * The header is followed by one record per path, in path index order. Each
+ * record is the is_core flag (1 byte), the length of the path data (2 bytes)
+ * and the path data itself. All values are in host byte order.
+ */
+typedef struct dict_hdr {
+
+  /** DICT_MAGIC */
+  char magic[8];
+
+  /** DICT_VERSION */
+  uint32_t version;
+
+  /** DICT_BYTE_ORDER */
+  uint32_t byte_order;
+
+  /** Number of path records in the file */
+  uint32_t paths_cnt;
+
+  /** Unused, must be 0 */
+  uint32_t reserved;
+
+  /** Offset of the end of the last path record */
+  uint64_t data_end;
+
+} dict_hdr_t;
+
 /* wrapper around an AS path */
 struct bgpstream_as_path_store_path {
 
@@ -47,141 +106,268 @@ struct bgpstream_as_path_store_path {
   /** Internal index of this path within the store */
   uint32_t idx;
 
-  /** Underlying AS Path structure */
+  /** Underlying AS Path structure (data is owned by the store arena) */
   bgpstream_as_path_t path;
+
+  /** Hash of the path (is_core flag included) */
+  uint32_t hash;
+
+  /** Position of this path in the chain of paths with the same hash */
+  uint16_t hash_pos;
+
+  /** Index of the next path with the same hash */
+  uint32_t next;
 };
 
-/** A per-origin set of AS Paths */
-typedef struct pathset {
+/** Chunk of an append-only arena that holds path data */
+typedef struct arena_chunk {
 
-  /** Array of AS Paths in the set */
-  bgpstream_as_path_store_path_t *paths;
+  /** Next (older) chunk */
+  struct arena_chunk *next;
 
-  /** Number of AS paths in the set */
-  uint16_t paths_cnt;
+  /** Number of bytes used in this chunk */
+  size_t used;
 
-} __attribute__((packed)) pathset_t;
+  /** Chunk data */
+  uint8_t data[];
 
-KHASH_INIT(pathset, uint32_t, pathset_t, 1, kh_int_hash_func,
+} arena_chunk_t;
+
+/** Maps a path hash to the index of the first path with that hash */
+KHASH_INIT(pathidx, uint32_t, uint32_t, 1, kh_int_hash_func,
            kh_int_hash_equal)
 
+/** A subset of the store, selected by the top bits of the path hash */
+typedef struct pathshard {
+
+  /** Index of the paths in this shard */
+  khash_t(pathidx) * path_idx;
+
+  /** Arena holding the data of the paths in this shard */
+  arena_chunk_t *arena;
+
+  /** Protects the shard (only used by concurrent stores) */
+  pthread_mutex_t mutex;
+
+} pathshard_t;
+
 struct bgpstream_as_path_store {
 
-  khash_t(pathset) * path_set;
+  /** Array of shards */
+  pathshard_t *shards;
+
+  /** Number of shards */
+  int shards_cnt;
+
+  /** Shift to apply to a path hash to find its shard */
+  int shard_shift;
+
+  /** Is this store shared between threads? */
+  int concurrent;
+
+  /** Protects paths_cnt and path_blocks (only used by concurrent stores) */
+  pthread_mutex_t paths_mutex;
+
+  /** Directory of blocks of store paths (indexed by path idx) */
+  bgpstream_as_path_store_path_t **path_blocks;
 
   /** The total number of paths in the store */
   uint32_t paths_cnt;
 
-  /** The currently iterated pathset */
-  khiter_t cur_pathset;
+  /** The index of the currently iterated path */
+  uint32_t cur_path;
+
+  /** Dictionary file mapped by bgpstream_as_path_store_load (if any) */
+  void *map;
 
-  /** The current path within the current pathset */
-  int cur_path;
+  /** Length of the mapped dictionary */
+  size_t map_len;
 };
 
-static void store_path_destroy(bgpstream_as_path_store_path_t *spath)
+#define STORE_PATH(store, i)                                                   \
+  (&(store)->path_blocks[(i) >> PATH_BLOCK_BITS][(i) & (PATH_BLOCK_SIZE - 1)])
+
+#define SHARD(store, hash)                                                     \
+  (&(store)->shards[(uint32_t)((uint64_t)(hash) >> (store)->shard_shift)])
+
+#define SHARD_LOCK(store, shard)                                               \
+  do {                                                                         \
+    if ((store)->concurrent) {                                                 \
+      pthread_mutex_lock(&(shard)->mutex);                                     \
+    }                                                                          \
+  } while (0)
+
+#define SHARD_UNLOCK(store, shard)                                             \
+  do {                                                                         \
+    if ((store)->concurrent) {                                                 \
+      pthread_mutex_unlock(&(shard)->mutex);                                   \
+    }                                                                          \
+  } while (0)
+
+/* FNV-1a over the path data, followed by the murmur3 finalizer since khash
+ * uses the low bits of the key and shards use the high bits */
+static uint32_t store_path_hash(const bgpstream_as_path_store_path_t *spath)
 {
-  if (spath == NULL) {
-    return;
+  uint32_t h = 2166136261U ^ spath->is_core;
+  uint16_t i;
+
+  for (i = 0; i < spath->path.data_len; i++) {
+    h = (h ^ spath->path.data[i]) * 16777619U;
   }
 
-  /* destroy the path's data */
-  assert(spath->path.data_alloc_len != UINT16_MAX);
-  free(spath->path.data);
-  spath->path.data = NULL;
-  spath->path.data_alloc_len = 0;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
 }
 
-static int store_path_dup(bgpstream_as_path_store_path_t *dst,
-                   bgpstream_as_path_store_path_t *src)
+static inline int store_path_equal(const bgpstream_as_path_store_path_t *sp1,
+                                   const bgpstream_as_path_store_path_t *sp2)
 {
-  *dst = *src;
+  return (sp1->is_core == sp2->is_core) &&
+         (sp1->path.data_len == sp2->path.data_len) &&
+         memcmp(sp1->path.data, sp2->path.data, sp1->path.data_len) == 0;
+}
 
-  /* copy the path data */
-  dst->path.data_alloc_len = 0;
-  if ((dst->path.data = malloc(src->path.data_len)) == NULL) {
-    goto err;
-  }
-  dst->path.data_alloc_len = src->path.data_len;
-  dst->path.data_len = src->path.data_len;
-  memcpy(dst->path.data, src->path.data, src->path.data_len);
+static uint8_t *arena_alloc(pathshard_t *shard, uint16_t len)
+{
+  arena_chunk_t *chunk = shard->arena;
+  uint8_t *ptr;
 
-  return 0;
+  if (chunk == NULL || ARENA_CHUNK_SIZE - chunk->used < len) {
+    if ((chunk = malloc(sizeof(arena_chunk_t) + ARENA_CHUNK_SIZE)) == NULL) {
+      return NULL;
+    }
+    chunk->used = 0;
+    chunk->next = shard->arena;
+    shard->arena = chunk;
+  }
 
-err:
-  store_path_destroy(dst);
-  return -1;
+  ptr = chunk->data + chunk->used;
+  chunk->used += len;
+  return ptr;
 }
 
-static inline int store_path_equal(bgpstream_as_path_store_path_t *sp1,
-                                   bgpstream_as_path_store_path_t *sp2)
+static void arena_destroy(pathshard_t *shard)
 {
-  return (sp1->is_core == sp2->is_core) &&
-         bgpstream_as_path_equal(&sp1->path, &sp2->path);
+  arena_chunk_t *chunk;
+
+  while ((chunk = shard->arena) != NULL) {
+    shard->arena = chunk->next;
+    free(chunk);
+  }
 }
 
-static void pathset_destroy(pathset_t ps)
+/* Reserve the next path slot, returning its index (or CHAIN_END) */
+static uint32_t store_path_alloc(bgpstream_as_path_store_t *store)
 {
-  int i;
+  uint32_t idx = CHAIN_END;
+  uint32_t block;
+
+  if (store->concurrent) {
+    pthread_mutex_lock(&store->paths_mutex);
+  }
 
-  /* destroy each store path */
-  for (i = 0; i < ps.paths_cnt; i++) {
-    store_path_destroy(&ps.paths[i]);
+  if (store->paths_cnt == CHAIN_END) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "AS Path Store is full");
+    goto done;
   }
 
-  /* destroy the array of paths */
-  free(ps.paths);
-  ps.paths = NULL;
-  ps.paths_cnt = 0;
+  block = store->paths_cnt >> PATH_BLOCK_BITS;
+  if (store->path_blocks[block] == NULL &&
+      (store->path_blocks[block] = malloc(
+         sizeof(bgpstream_as_path_store_path_t) * PATH_BLOCK_SIZE)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not malloc path block");
+    goto done;
+  }
+  idx = store->paths_cnt++;
+
+done:
+  if (store->concurrent) {
+    pthread_mutex_unlock(&store->paths_mutex);
+  }
+  return idx;
 }
 
-static uint16_t pathset_get_path_id(bgpstream_as_path_store_t *store,
-                                    pathset_t *ps,
-                                    bgpstream_as_path_store_path_t *findme)
+/* Add the given path to the store, copying the path data unless it is
+ * borrowed from a mapped dictionary. Must be called with the shard lock
+ * held. */
+static uint32_t store_path_add(bgpstream_as_path_store_t *store,
+                               pathshard_t *shard,
+                               const bgpstream_as_path_store_path_t *src,
+                               int borrow, uint32_t hash, uint16_t hash_pos)
 {
-  int i;
-  uint32_t path_id;
+  bgpstream_as_path_store_path_t *spath;
+  uint8_t *data = NULL;
+  uint32_t idx;
 
-  /* check if it is already in the set */
-  for (i = 0; i < ps->paths_cnt; i++) {
-    if (store_path_equal(&ps->paths[i], findme) != 0) {
-      return i;
-    }
+  if (borrow != 0) {
+    data = src->path.data;
+  } else if (src->path.data_len > 0 &&
+      (data = arena_alloc(shard, src->path.data_len)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not allocate path data");
+    return CHAIN_END;
   }
 
-  findme->idx = store->paths_cnt++;
-
-  /* need to append this path */
-  if ((ps->paths = realloc(ps->paths, sizeof(bgpstream_as_path_store_path_t) *
-                                        (ps->paths_cnt + 1))) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not realloc paths");
-    return UINT16_MAX;
+  if ((idx = store_path_alloc(store)) == CHAIN_END) {
+    return CHAIN_END;
   }
-  if (store_path_dup(&ps->paths[ps->paths_cnt], findme) != 0) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create store path");
-    return UINT16_MAX;
+
+  spath = STORE_PATH(store, idx);
+  *spath = *src;
+  spath->idx = idx;
+  spath->hash = hash;
+  spath->hash_pos = hash_pos;
+  spath->next = CHAIN_END;
+  if (data != NULL && borrow == 0) {
+    memcpy(data, src->path.data, src->path.data_len);
   }
-  path_id = ps->paths_cnt++;
-  assert(ps->paths_cnt <= UINT16_MAX);
+  spath->path.data = data;
+  /* the data is owned by the arena */
+  spath->path.data_alloc_len = UINT16_MAX;
 
-  return path_id;
+  return idx;
 }
 
-/* ==================== PUBLIC FUNCTIONS ==================== */
-
-bgpstream_as_path_store_t *bgpstream_as_path_store_create()
+static bgpstream_as_path_store_t *store_create(int shard_bits, int concurrent)
 {
   bgpstream_as_path_store_t *store;
+  int i;
 
   if ((store = malloc_zero(sizeof(bgpstream_as_path_store_t))) == NULL) {
     return NULL;
   }
 
-  if ((store->path_set = kh_init(pathset)) == NULL) {
+  store->concurrent = concurrent;
+  if (concurrent) {
+    pthread_mutex_init(&store->paths_mutex, NULL);
+  }
+
+  if ((store->path_blocks = malloc_zero(
+         sizeof(bgpstream_as_path_store_path_t *) * PATH_BLOCK_CNT)) ==
+      NULL) {
     goto err;
   }
-  /* pre-allocate to minimize resize events */
-  kh_resize(pathset, store->path_set, 1 << 24); /* 2^24 = 16.8M buckets */
+
+  store->shards_cnt = 1 << shard_bits;
+  store->shard_shift = 32 - shard_bits;
+  if ((store->shards = malloc_zero(sizeof(pathshard_t) * store->shards_cnt)) ==
+      NULL) {
+    goto err;
+  }
+  for (i = 0; i < store->shards_cnt; i++) {
+    if ((store->shards[i].path_idx = kh_init(pathidx)) == NULL) {
+      goto err;
+    }
+    /* pre-allocate to minimize resize events */
+    kh_resize(pathidx, store->shards[i].path_idx,
+              (1 << 24) >> shard_bits); /* 2^24 = 16.8M buckets */
+    if (concurrent) {
+      pthread_mutex_init(&store->shards[i].mutex, NULL);
+    }
+  }
 
   return store;
 
@@ -190,16 +376,56 @@ err:
   return NULL;
 }
 
+/* ==================== PUBLIC FUNCTIONS ==================== */
+
+bgpstream_as_path_store_t *bgpstream_as_path_store_create()
+{
+  return store_create(0, 0);
+}
+
+bgpstream_as_path_store_t *bgpstream_as_path_store_create_concurrent()
+{
+  return store_create(CONCURRENT_SHARD_BITS, 1);
+}
+
 void bgpstream_as_path_store_destroy(bgpstream_as_path_store_t *store)
 {
+  int i;
+
   if (store == NULL) {
     return;
   }
 
-  if (store->path_set != NULL) {
-    kh_free_vals(pathset, store->path_set, pathset_destroy);
-    kh_destroy(pathset, store->path_set);
-    store->path_set = NULL;
+  if (store->shards != NULL) {
+    for (i = 0; i < store->shards_cnt; i++) {
+      if (store->shards[i].path_idx != NULL) {
+        kh_destroy(pathidx, store->shards[i].path_idx);
+        store->shards[i].path_idx = NULL;
+      }
+      arena_destroy(&store->shards[i]);
+      if (store->concurrent) {
+        pthread_mutex_destroy(&store->shards[i].mutex);
+      }
+    }
+    free(store->shards);
+    store->shards = NULL;
+  }
+
+  if (store->path_blocks != NULL) {
+    for (i = 0; i < PATH_BLOCK_CNT; i++) {
+      free(store->path_blocks[i]);
+    }
+    free(store->path_blocks);
+    store->path_blocks = NULL;
+  }
+
+  if (store->concurrent) {
+    pthread_mutex_destroy(&store->paths_mutex);
+  }
+
+  if (store->map != NULL) {
+    munmap(store->map, store->map_len);
+    store->map = NULL;
   }
 
   free(store);
@@ -210,36 +436,72 @@ uint32_t bgpstream_as_path_store_get_size(bgpstream_as_path_store_t *store)
   return store->paths_cnt;
 }
 
+/* Find the given path in the store, adding it if it is not already present.
+ * If added is non-NULL, it is set to 1 if the path was added. */
 static int get_path_id(bgpstream_as_path_store_t *store,
-                       bgpstream_as_path_store_path_t *findme,
-                       bgpstream_as_path_store_path_id_t *id)
+                       bgpstream_as_path_store_path_t *findme, int borrow,
+                       bgpstream_as_path_store_path_id_t *id, int *added)
 {
+  uint32_t hash = store_path_hash(findme);
+  pathshard_t *shard = SHARD(store, hash);
+  bgpstream_as_path_store_path_t *spath = NULL;
+  uint32_t idx = CHAIN_END;
+  uint16_t pos = 0;
   khiter_t k;
   int khret;
 
-  id->path_hash = bgpstream_as_path_hash(&findme->path);
+  SHARD_LOCK(store, shard);
+
+  /* check if it is already in the store */
+  if ((k = kh_get(pathidx, shard->path_idx, hash)) !=
+      kh_end(shard->path_idx)) {
+    for (idx = kh_val(shard->path_idx, k); idx != CHAIN_END;
+         idx = spath->next) {
+      spath = STORE_PATH(store, idx);
+      if (store_path_equal(spath, findme) != 0) {
+        if (added != NULL) {
+          *added = 0;
+        }
+        goto done;
+      }
+    }
+    /* need to append this path to the end of the chain */
+    if (spath->hash_pos == UINT16_MAX - 1) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Too many paths with the same hash");
+      goto err;
+    }
+    pos = spath->hash_pos + 1;
+  }
 
-  k = kh_put(pathset, store->path_set, id->path_hash, &khret);
-  if (khret == 1) {
-    /* just added this pathset */
-    /* clear the pathset fields */
-    kh_val(store->path_set, k).paths = NULL;
-    kh_val(store->path_set, k).paths_cnt = 0;
-  } else if (khret != 0) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add path set to the store");
+  if ((idx = store_path_add(store, shard, findme, borrow, hash, pos)) ==
+      CHAIN_END) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add path to the store");
     goto err;
   }
 
-  /* now get the path id from the origin set */
-  if ((id->path_id = pathset_get_path_id(store, &kh_val(store->path_set, k),
-                                         findme)) == UINT16_MAX) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add path to origin set");
-    goto err;
+  if (spath != NULL) {
+    spath->next = idx;
+  } else {
+    k = kh_put(pathidx, shard->path_idx, hash, &khret);
+    if (khret < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add path to the index");
+      goto err;
+    }
+    kh_val(shard->path_idx, k) = idx;
+  }
+  spath = STORE_PATH(store, idx);
+  if (added != NULL) {
+    *added = 1;
   }
 
+done:
+  SHARD_UNLOCK(store, shard);
+  id->path_hash = hash;
+  id->path_id = spath->hash_pos;
   return 0;
 
 err:
+  SHARD_UNLOCK(store, shard);
   return -1;
 }
 
@@ -284,7 +546,7 @@ int bgpstream_as_path_store_get_path_id(bgpstream_as_path_store_t *store,
     findme.is_core = 0;
   }
 
-  return get_path_id(store, &findme, id);
+  return get_path_id(store, &findme, 0, id, NULL);
 }
 
 int bgpstream_as_path_store_insert_path(bgpstream_as_path_store_t *store,
@@ -292,65 +554,46 @@ int bgpstream_as_path_store_insert_path(bgpstream_as_path_store_t *store,
                                         int is_core,
                                         bgpstream_as_path_store_path_id_t *id)
 {
-  bgpstream_as_path_store_path_t findme;
+  bgpstream_as_path_store_path_t findme = {0};
   findme.is_core = is_core;
 
   bgpstream_as_path_populate_from_data_zc(&findme.path, path_data, path_len);
 
-  return get_path_id(store, &findme, id);
+  return get_path_id(store, &findme, 0, id, NULL);
 }
 
 void bgpstream_as_path_store_iter_first_path(bgpstream_as_path_store_t *store)
 {
-  store->cur_pathset = kh_begin(store->path_set);
-
-  while (!kh_exist(store->path_set, store->cur_pathset) &&
-         store->cur_pathset < kh_end(store->path_set)) {
-    store->cur_pathset++;
-  }
-
   store->cur_path = 0;
 }
 
 void bgpstream_as_path_store_iter_next_path(bgpstream_as_path_store_t *store)
 {
-  pathset_t *pathset;
-
-  if (store->cur_pathset >= kh_end(store->path_set)) {
-    return;
-  }
-
-  pathset = &kh_val(store->path_set, store->cur_pathset);
-  if (store->cur_path >= pathset->paths_cnt) {
-    /* move to the next pathset */
-    do {
-      store->cur_pathset++;
-    } while (store->cur_pathset < kh_end(store->path_set) &&
-             !kh_exist(store->path_set, store->cur_pathset));
-    store->cur_path = 0;
-  }
+  /* paths are stored contiguously, so
+   * bgpstream_as_path_store_iter_get_path is enough to advance */
 }
 
 int bgpstream_as_path_store_iter_has_more_path(bgpstream_as_path_store_t *store)
 {
-  return (store->cur_pathset < kh_end(store->path_set)) &&
-         (store->cur_path <
-          kh_val(store->path_set, store->cur_pathset).paths_cnt);
+  return store->cur_path < store->paths_cnt;
 }
 
 bgpstream_as_path_store_path_t *
 bgpstream_as_path_store_iter_get_path(bgpstream_as_path_store_t *store)
 {
-  return &kh_val(store->path_set, store->cur_pathset).paths[store->cur_path++];
+  bgpstream_as_path_store_path_t *spath = STORE_PATH(store, store->cur_path);
+  store->cur_path++;
+  return spath;
 }
 
 bgpstream_as_path_store_path_id_t
 bgpstream_as_path_store_iter_get_path_id(bgpstream_as_path_store_t *store)
 {
   bgpstream_as_path_store_path_id_t id;
+  bgpstream_as_path_store_path_t *spath = STORE_PATH(store, store->cur_path);
 
-  id.path_hash = kh_key(store->path_set, store->cur_pathset);
-  id.path_id = store->cur_path;
+  id.path_hash = spath->hash;
+  id.path_id = spath->hash_pos;
 
   return id;
 }
@@ -359,6 +602,9 @@ bgpstream_as_path_store_path_t *
 bgpstream_as_path_store_get_store_path(bgpstream_as_path_store_t *store,
                                        bgpstream_as_path_store_path_id_t id)
 {
+  pathshard_t *shard;
+  bgpstream_as_path_store_path_t *spath = NULL;
+  uint32_t idx;
   khiter_t k;
 
   /* special case for NULL path */
@@ -366,16 +612,296 @@ bgpstream_as_path_store_get_store_path(bgpstream_as_path_store_t *store,
     return NULL;
   }
 
-  if ((k = kh_get(pathset, store->path_set, id.path_hash)) ==
-      kh_end(store->path_set)) {
+  shard = SHARD(store, id.path_hash);
+  SHARD_LOCK(store, shard);
+
+  if ((k = kh_get(pathidx, shard->path_idx, id.path_hash)) ==
+      kh_end(shard->path_idx)) {
+    goto done;
+  }
+
+  for (idx = kh_val(shard->path_idx, k); idx != CHAIN_END;
+       idx = spath->next) {
+    spath = STORE_PATH(store, idx);
+    if (spath->hash_pos == id.path_id) {
+      goto done;
+    }
+  }
+  spath = NULL;
+
+done:
+  SHARD_UNLOCK(store, shard);
+  return spath;
+}
+
+static void dict_hdr_init(dict_hdr_t *hdr)
+{
+  memset(hdr, 0, sizeof(dict_hdr_t));
+  memcpy(hdr->magic, DICT_MAGIC, sizeof(hdr->magic));
+  hdr->version = DICT_VERSION;
+  hdr->byte_order = DICT_BYTE_ORDER;
+  hdr->data_end = sizeof(dict_hdr_t);
+}
+
+static int dict_hdr_check(const dict_hdr_t *hdr, const char *filename)
+{
+  if (memcmp(hdr->magic, DICT_MAGIC, sizeof(hdr->magic)) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "%s is not an AS Path Store dictionary",
+                  filename);
+    return -1;
+  }
+  if (hdr->version != DICT_VERSION) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Unsupported AS Path Store dictionary version %" PRIu32
+                  " in %s",
+                  hdr->version, filename);
+    return -1;
+  }
+  if (hdr->byte_order != DICT_BYTE_ORDER) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "AS Path Store dictionary %s was written on a host with a "
+                  "different byte order",
+                  filename);
+    return -1;
+  }
+  if (hdr->data_end < sizeof(dict_hdr_t)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Corrupt AS Path Store dictionary header in %s", filename);
+    return -1;
+  }
+  return 0;
+}
+
+/* Write the records for paths [first, paths_cnt) at the current position of
+ * the file and update the header accordingly */
+static int dict_write_paths(bgpstream_as_path_store_t *store, FILE *fh,
+                            dict_hdr_t *hdr)
+{
+  bgpstream_as_path_store_path_t *spath;
+  uint32_t idx;
+
+  for (idx = hdr->paths_cnt; idx < store->paths_cnt; idx++) {
+    spath = STORE_PATH(store, idx);
+    if (fwrite(&spath->is_core, sizeof(spath->is_core), 1, fh) != 1 ||
+        fwrite(&spath->path.data_len, sizeof(spath->path.data_len), 1, fh) !=
+          1 ||
+        (spath->path.data_len > 0 &&
+         fwrite(spath->path.data, spath->path.data_len, 1, fh) != 1)) {
+      return -1;
+    }
+    hdr->data_end += bgpstream_as_path_store_path_get_size(spath);
+  }
+  hdr->paths_cnt = store->paths_cnt;
+
+  return 0;
+}
+
+/* Rewrite the header and flush the file to disk */
+static int dict_write_hdr(FILE *fh, const dict_hdr_t *hdr)
+{
+  if (fflush(fh) != 0 || fsync(fileno(fh)) != 0 ||
+      fseeko(fh, 0, SEEK_SET) != 0 ||
+      fwrite(hdr, sizeof(dict_hdr_t), 1, fh) != 1 || fflush(fh) != 0 ||
+      fsync(fileno(fh)) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int bgpstream_as_path_store_save(bgpstream_as_path_store_t *store,
+                                 const char *filename)
+{
+  dict_hdr_t hdr;
+  FILE *fh = NULL;
+  char *tmpname;
+  size_t len = strlen(filename) + sizeof(".tmp");
+
+  if ((tmpname = malloc(len)) == NULL) {
+    return -1;
+  }
+  snprintf(tmpname, len, "%s.tmp", filename);
+
+  if ((fh = fopen(tmpname, "wb")) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for writing: %s",
+                  tmpname, strerror(errno));
+    goto err;
+  }
+
+  /* write a header with no paths first, so that the file is consistent if
+     we are interrupted */
+  dict_hdr_init(&hdr);
+  if (fwrite(&hdr, sizeof(hdr), 1, fh) != 1 ||
+      dict_write_paths(store, fh, &hdr) != 0 || dict_write_hdr(fh, &hdr) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not write %s: %s", tmpname,
+                  strerror(errno));
+    goto err;
+  }
+
+  if (fclose(fh) != 0) {
+    fh = NULL;
+    goto err;
+  }
+  fh = NULL;
+
+  if (rename(tmpname, filename) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not rename %s to %s: %s", tmpname,
+                  filename, strerror(errno));
+    goto err;
+  }
+
+  free(tmpname);
+  return 0;
+
+err:
+  if (fh != NULL) {
+    fclose(fh);
+  }
+  unlink(tmpname);
+  free(tmpname);
+  return -1;
+}
+
+int bgpstream_as_path_store_append(bgpstream_as_path_store_t *store,
+                                   const char *filename)
+{
+  dict_hdr_t hdr;
+  FILE *fh;
+
+  if ((fh = fopen(filename, "r+b")) == NULL) {
+    if (errno == ENOENT) {
+      return bgpstream_as_path_store_save(store, filename);
+    }
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s: %s", filename,
+                  strerror(errno));
+    return -1;
+  }
+
+  if (fread(&hdr, sizeof(hdr), 1, fh) != 1) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "Could not read AS Path Store dictionary header from %s",
+                  filename);
+    goto err;
+  }
+  if (dict_hdr_check(&hdr, filename) != 0) {
+    goto err;
+  }
+  if (hdr.paths_cnt > store->paths_cnt) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "AS Path Store dictionary %s has more paths than the store",
+                  filename);
+    goto err;
+  }
+  if (hdr.paths_cnt == store->paths_cnt) {
+    /* nothing new */
+    fclose(fh);
+    return 0;
+  }
+
+  /* drop anything written after the last complete append */
+  if (fflush(fh) != 0 || ftruncate(fileno(fh), hdr.data_end) != 0 ||
+      fseeko(fh, hdr.data_end, SEEK_SET) != 0 ||
+      dict_write_paths(store, fh, &hdr) != 0 || dict_write_hdr(fh, &hdr) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not append to %s: %s", filename,
+                  strerror(errno));
+    goto err;
+  }
+
+  if (fclose(fh) != 0) {
+    return -1;
+  }
+  return 0;
+
+err:
+  fclose(fh);
+  return -1;
+}
+
+bgpstream_as_path_store_t *bgpstream_as_path_store_load(const char *filename)
+{
+  bgpstream_as_path_store_t *store = NULL;
+  bgpstream_as_path_store_path_t findme = {0};
+  bgpstream_as_path_store_path_id_t id;
+  const dict_hdr_t *hdr;
+  struct stat st;
+  uint8_t *ptr, *end;
+  uint16_t len;
+  uint32_t i;
+  void *map;
+  int added;
+  int fd;
+
+  if ((fd = open(filename, O_RDONLY)) < 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s: %s", filename,
+                  strerror(errno));
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(dict_hdr_t)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "%s is too short to be an AS Path Store dictionary",
+                  filename);
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not mmap %s: %s", filename,
+                  strerror(errno));
     return NULL;
   }
 
-  if (id.path_id > kh_val(store->path_set, k).paths_cnt - 1) {
+  if ((store = bgpstream_as_path_store_create()) == NULL) {
+    munmap(map, st.st_size);
     return NULL;
   }
+  store->map = map;
+  store->map_len = st.st_size;
+
+  hdr = map;
+  if (dict_hdr_check(hdr, filename) != 0) {
+    goto err;
+  }
+  if (hdr->data_end > (uint64_t)st.st_size) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "AS Path Store dictionary %s is truncated",
+                  filename);
+    goto err;
+  }
 
-  return &kh_val(store->path_set, k).paths[id.path_id];
+  /* paths are added in the order they were written, so they get back the
+     same index and ID */
+  ptr = (uint8_t *)map + sizeof(dict_hdr_t);
+  end = (uint8_t *)map + hdr->data_end;
+  for (i = 0; i < hdr->paths_cnt; i++) {
+    if (end - ptr < (ptrdiff_t)(sizeof(uint8_t) + sizeof(uint16_t))) {
+      goto corrupt;
+    }
+    findme.is_core = *ptr;
+    memcpy(&len, ptr + sizeof(uint8_t), sizeof(len));
+    ptr += sizeof(uint8_t) + sizeof(uint16_t);
+    if (end - ptr < len) {
+      goto corrupt;
+    }
+    bgpstream_as_path_populate_from_data_zc(&findme.path, ptr, len);
+    if (get_path_id(store, &findme, 1, &id, &added) != 0) {
+      goto err;
+    }
+    if (added == 0) {
+      goto corrupt;
+    }
+    ptr += len;
+  }
+  if (ptr != end) {
+    goto corrupt;
+  }
+
+  return store;
+
+corrupt:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Corrupt AS Path Store dictionary %s",
+                filename);
+err:
+  bgpstream_as_path_store_destroy(store);
+  return NULL;
 }
 
 bgpstream_as_path_t *bgpstream_as_path_store_path_get_path(
@@ -76,10 +76,10 @@ typedef struct bgpstream_as_path_store_path bgpstream_as_path_store_path_t;
  */
 typedef struct bgpstream_as_path_store_path_id {
 
-  /** An internal hash of the origin ASN segment of the path */
+  /** An internal hash of the path */
   uint32_t path_hash;
 
-  /** ID of the path within the origin pathset */
+  /** ID of the path among the paths that share the same hash */
   uint16_t path_id;
 
 } __attribute__((packed)) bgpstream_as_path_store_path_id_t;
@@ -111,6 +111,19 @@ typedef struct bgpstream_as_path_store_path_iter {
  */
 bgpstream_as_path_store_t *bgpstream_as_path_store_create(void);
 
+/** Create a new AS Path Store that can be shared between threads
+ *
+ * @return pointer to the created store if successful, NULL otherwise
+ *
+ * The store is split into shards, each protected by its own lock, so that
+ * bgpstream_as_path_store_get_path_id, bgpstream_as_path_store_insert_path
+ * and bgpstream_as_path_store_get_store_path may be called concurrently from
+ * several threads. Store path pointers remain valid until the store is
+ * destroyed. Iterating over the store is not safe while other threads are
+ * inserting paths.
+ */
+bgpstream_as_path_store_t *bgpstream_as_path_store_create_concurrent(void);
+
 /** Destroy the given AS Path Store
  *
  * @param store         pointer to the store to destroy
@@ -124,6 +137,52 @@ void bgpstream_as_path_store_destroy(bgpstream_as_path_store_t *store);
  */
 uint32_t bgpstream_as_path_store_get_size(bgpstream_as_path_store_t *store);
 
+/** Write all the paths in the store to a dictionary file
+ *
+ * @param store         pointer to the store
+ * @param filename      name of the dictionary file to write
+ * @return 0 if the dictionary was written successfully, -1 otherwise
+ *
+ * The dictionary is written to a temporary file which then replaces
+ * filename, so an existing dictionary is never left half-written. The
+ * dictionary uses the host byte order and can only be loaded on hosts with
+ * the same byte order. The store must not be modified while it is being
+ * saved.
+ */
+int bgpstream_as_path_store_save(bgpstream_as_path_store_t *store,
+                                 const char *filename);
+
+/** Append the paths added to the store since it was last saved
+ *
+ * @param store         pointer to the store
+ * @param filename      name of the dictionary file to append to
+ * @return 0 if the dictionary was updated successfully, -1 otherwise
+ *
+ * The dictionary must have been written from this store (or loaded into it),
+ * and only paths with an index greater than those already in the file are
+ * written. If the file does not exist, this is the same as
+ * bgpstream_as_path_store_save. If the process is interrupted while
+ * appending, the dictionary still holds the paths from the previous
+ * append.
+ */
+int bgpstream_as_path_store_append(bgpstream_as_path_store_t *store,
+                                   const char *filename);
+
+/** Create a new AS Path Store from a dictionary file
+ *
+ * @param filename      name of the dictionary file to load
+ * @return pointer to the created store if successful, NULL otherwise
+ *
+ * The dictionary is mapped into memory and the paths refer directly to the
+ * mapped data, so the file must not be modified while the store exists
+ * (bgpstream_as_path_store_append only writes past the data already in the
+ * file and is safe). Every path gets the same index (see
+ * bgpstream_as_path_store_path_get_idx) and path ID that it had when the
+ * dictionary was written. New paths may be added to the loaded store as
+ * usual.
+ */
+bgpstream_as_path_store_t *bgpstream_as_path_store_load(const char *filename);
+
 /** Directly add the given path to the store and return the path ID
  *
  * @param store         pointer to the store
@@ -25,6 +25,7 @@
  */
 
 #include "bgpstream_utils_community_int.h"
+#include "bgpstream_utils_fmt.h"
 #include "bgpstream_utils_private.h"
 #include "config.h"
 #include "khash.h"
@@ -37,23 +38,6 @@
 
 #define COMMUNITY_MAX_STR_LEN 16
 
-/** Set of community values */
-struct bgpstream_community_set {
-
-  /** Array of community values */
-  bgpstream_community_t *communities;
-
-  /** Number of communities in the set */
-  int communities_cnt;
-
-  /** Number of communities allocated in the set */
-  int communities_alloc_cnt;
-
-  /** Communities hash (OR between
-   *  all communities in the set) */
-  bgpstream_community_t communities_hash;
-};
-
 /* ========== PUBLIC FUNCTIONS ========== */
 
 int bgpstream_community_snprintf(char *buf, size_t len,
@@ -146,23 +130,14 @@ int bgpstream_community_equal_value(bgpstream_community_t comm1,
 int bgpstream_community_set_snprintf(char *buf, size_t len,
                                      const bgpstream_community_set_t *set)
 {
-  size_t written = 0;
-  int i;
+  bgpstream_fmt_buf_t fb;
+  char *p;
 
-  for (i = 0; i < bgpstream_community_set_size(set); i++) {
-    if (i > 0) {
-      if (written < len) {
-        buf[written] = ' ';
-      }
-      written++;
-    }
-    written += bgpstream_community_snprintf(
-      buf + written, len > written ? len - written : 0,
-      bgpstream_community_set_get(set, i));
+  if ((p = bgpstream_fmt_buf_start(
+         &fb, buf, len, bgpstream_fmt_community_set_max_len(set))) == NULL) {
+    return 0;
   }
-
-  buf[(written < len) ? written : len - 1] = '\0';
-  return written;
+  return bgpstream_fmt_buf_finish(&fb, bgpstream_fmt_community_set(p, set));
 }
 
 bgpstream_community_set_t *bgpstream_community_set_create()
@@ -298,7 +273,7 @@ int bgpstream_community_set_equal(const bgpstream_community_set_t *set1,
   return (set1->communities_hash.ui32 == set2->communities_hash.ui32) &&
          (set1->communities_cnt == set2->communities_cnt) &&
          memcmp(set1->communities, set2->communities,
-              sizeof(bgpstream_community_t) * set1->communities_cnt);
+              sizeof(bgpstream_community_t) * set1->communities_cnt) == 0;
 }
 
 /* ========== PROTECTED FUNCTIONS ========== */
@@ -65,6 +65,23 @@
  *
  * @{ */
 
+/** Set of community values */
+struct bgpstream_community_set {
+
+  /** Array of community values */
+  bgpstream_community_t *communities;
+
+  /** Number of communities in the set */
+  int communities_cnt;
+
+  /** Number of communities allocated in the set */
+  int communities_alloc_cnt;
+
+  /** Communities hash (OR between
+   *  all communities in the set) */
+  bgpstream_community_t communities_hash;
+};
+
 /** @} */
 
 /**
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_utils_fmt.h"
+#include "bgpstream_log.h"
+#include "bgpstream_utils_as_path_int.h"
+#include "bgpstream_utils_community_int.h"
+#include "bgpstream_utils_private.h"
+#include <stdlib.h>
+
+/* length of a formatted community ("65535:65535") plus a separator */
+#define COMMUNITY_MAX_LEN 12
+
+static char *fmt_ipv4(char *p, const uint8_t *bytes)
+{
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    if (i > 0) {
+      *p++ = '.';
+    }
+    p = bgpstream_fmt_uint32(p, bytes[i]);
+  }
+  return p;
+}
+
+static char *fmt_hex16(char *p, uint16_t v)
+{
+  static const char hex[] = "0123456789abcdef";
+  int shift = 12;
+
+  // no leading zeros
+  while (shift > 0 && ((v >> shift) & 0xf) == 0) {
+    shift -= 4;
+  }
+  for (; shift >= 0; shift -= 4) {
+    *p++ = hex[(v >> shift) & 0xf];
+  }
+  return p;
+}
+
+/* This follows the inet_ntop6 implementation shared by glibc and the BSDs:
+ * the longest run (the first, if there is a tie) of two or more zero words is
+ * replaced by "::", and IPv4-compatible and IPv4-mapped addresses end with
+ * the IPv4 address in dotted-quad notation. */
+static char *fmt_ipv6(char *p, const uint8_t *bytes)
+{
+  uint16_t words[8];
+  int best_base = -1, best_len = 0;
+  int cur_base = -1, cur_len = 0;
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    words[i] = nptohs(bytes + (i * 2));
+    if (words[i] == 0) {
+      if (cur_base == -1) {
+        cur_base = i;
+        cur_len = 1;
+      } else {
+        cur_len++;
+      }
+    } else if (cur_base != -1) {
+      if (best_base == -1 || cur_len > best_len) {
+        best_base = cur_base;
+        best_len = cur_len;
+      }
+      cur_base = -1;
+    }
+  }
+  if (cur_base != -1 && (best_base == -1 || cur_len > best_len)) {
+    best_base = cur_base;
+    best_len = cur_len;
+  }
+  if (best_base != -1 && best_len < 2) {
+    best_base = -1;
+  }
+
+  for (i = 0; i < 8; i++) {
+    if (best_base != -1 && i >= best_base && i < best_base + best_len) {
+      if (i == best_base) {
+        *p++ = ':';
+      }
+      continue;
+    }
+    if (i != 0) {
+      *p++ = ':';
+    }
+    if (i == 6 && best_base == 0 &&
+        (best_len == 6 || (best_len == 5 && words[5] == 0xffff))) {
+      return fmt_ipv4(p, bytes + 12);
+    }
+    p = fmt_hex16(p, words[i]);
+  }
+  if (best_base != -1 && best_base + best_len == 8) {
+    *p++ = ':';
+  }
+  return p;
+}
+
+/* ========== PROTECTED FUNCTIONS ========== */
+
+char *bgpstream_fmt_buf_start(bgpstream_fmt_buf_t *fb, char *buf, size_t len,
+                              size_t max_len)
+{
+  fb->buf = buf;
+  fb->len = len;
+
+  if (len > max_len) {
+    fb->out = buf;
+  } else if (max_len < sizeof(fb->scratch)) {
+    fb->out = fb->scratch;
+  } else if ((fb->out = malloc(max_len + 1)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not allocate format buffer");
+    return NULL;
+  }
+
+  return fb->out;
+}
+
+size_t bgpstream_fmt_buf_finish(bgpstream_fmt_buf_t *fb, char *end)
+{
+  size_t written = (end != NULL) ? (size_t)(end - fb->out) : 0;
+
+  if (fb->out == fb->buf) {
+    if (fb->len > 0) {
+      fb->buf[written] = '\0';
+    }
+    return written;
+  }
+
+  // copy as much as fits into the user's buffer
+  if (fb->len > 0) {
+    size_t cpy = (written < fb->len) ? written : fb->len - 1;
+    memcpy(fb->buf, fb->out, cpy);
+    fb->buf[cpy] = '\0';
+  }
+  if (fb->out != fb->scratch) {
+    free(fb->out);
+  }
+  fb->out = NULL;
+
+  return written;
+}
+
+char *bgpstream_fmt_uint32_pad(char *p, uint32_t v, int width)
+{
+  char tmp[BGPSTREAM_FMT_UINT32_MAX_LEN];
+  int len = bgpstream_fmt_uint32(tmp, v) - tmp;
+
+  while (len < width) {
+    *p++ = '0';
+    width--;
+  }
+  memcpy(p, tmp, len);
+  return p + len;
+}
+
+char *bgpstream_fmt_addr(char *p, const bgpstream_ip_addr_t *addr)
+{
+  switch (addr->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    return fmt_ipv4(p, (const uint8_t *)&addr->bs_ipv4.addr);
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    return fmt_ipv6(p, (const uint8_t *)&addr->bs_ipv6.addr);
+
+  default:
+    return NULL;
+  }
+}
+
+char *bgpstream_fmt_pfx(char *p, const bgpstream_pfx_t *pfx)
+{
+  if ((p = bgpstream_fmt_addr(p, &pfx->address)) == NULL) {
+    return NULL;
+  }
+  *p++ = '/';
+  return bgpstream_fmt_uint32(p, pfx->mask_len);
+}
+
+size_t bgpstream_fmt_as_path_max_len(const bgpstream_as_path_t *path)
+{
+  /* A simple segment takes 5 bytes and is written as at most 10 digits and a
+     separator; a set takes 2 bytes plus 4 per ASN, and is written as two
+     brackets, at most 11 characters per ASN, and a separator. Neither output
+     can be more than 3 times the size of the segment. */
+  return (size_t)path->data_len * 3;
+}
+
+char *bgpstream_fmt_as_path_seg(char *p, const bgpstream_as_path_seg_t *seg)
+{
+  const char *chars;
+  int i;
+
+  switch (seg->type) {
+  case BGPSTREAM_AS_PATH_SEG_ASN:
+    return bgpstream_fmt_uint32(p, seg->asn.asn);
+
+  case BGPSTREAM_AS_PATH_SEG_SET:
+    chars = "{,}";
+    break;
+
+  case BGPSTREAM_AS_PATH_SEG_CONFED_SEQ:
+    chars = "( )";
+    break;
+
+  case BGPSTREAM_AS_PATH_SEG_CONFED_SET:
+    chars = "[,]";
+    break;
+
+  default:
+    chars = "< >";
+    break;
+  }
+
+  *p++ = chars[0];
+  for (i = 0; i < seg->set.asn_cnt; i++) {
+    if (i > 0) {
+      *p++ = chars[1];
+    }
+    p = bgpstream_fmt_uint32(p, seg->set.asn[i]);
+  }
+  *p++ = chars[2];
+  return p;
+}
+
+char *bgpstream_fmt_as_path(char *p, const bgpstream_as_path_t *path)
+{
+  const uint8_t *data = path->data;
+  const uint8_t *end = data + path->data_len;
+  const bgpstream_as_path_seg_t *seg;
+
+  // walk the raw segment bytes rather than using the path iterator
+  while (data < end) {
+    if (data != path->data) {
+      *p++ = ' ';
+    }
+    seg = (const bgpstream_as_path_seg_t *)data;
+    if (seg->type == BGPSTREAM_AS_PATH_SEG_ASN) {
+      p = bgpstream_fmt_uint32(p, seg->asn.asn);
+      data += sizeof(bgpstream_as_path_seg_asn_t);
+    } else {
+      p = bgpstream_fmt_as_path_seg(p, seg);
+      data += sizeof(bgpstream_as_path_seg_set_t) +
+              sizeof(uint32_t) * seg->set.asn_cnt;
+    }
+  }
+  return p;
+}
+
+size_t bgpstream_fmt_community_set_max_len(const bgpstream_community_set_t *set)
+{
+  return (size_t)set->communities_cnt * COMMUNITY_MAX_LEN;
+}
+
+char *bgpstream_fmt_community_set(char *p, const bgpstream_community_set_t *set)
+{
+  int i;
+
+  for (i = 0; i < set->communities_cnt; i++) {
+    if (i > 0) {
+      *p++ = ' ';
+    }
+    p = bgpstream_fmt_uint32(p, set->communities[i].asn);
+    *p++ = ':';
+    p = bgpstream_fmt_uint32(p, set->communities[i].value);
+  }
+  return p;
+}
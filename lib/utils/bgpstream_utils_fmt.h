@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_FMT_H
+#define __BGPSTREAM_UTILS_FMT_H
+
+#include "bgpstream_utils_addr.h"
+#include "bgpstream_utils_as_path.h"
+#include "bgpstream_utils_community.h"
+#include "bgpstream_utils_pfx.h"
+#include <stdint.h>
+#include <string.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the private string formatting functions
+ * used by the various *_snprintf functions.
+ *
+ * Each bgpstream_fmt_* writer appends the string representation of a value at
+ * the given position and returns a pointer to the end of what it wrote (the
+ * output is not nul-terminated). The writers do not check the capacity of the
+ * buffer; instead, the caller computes an upper bound for the length of the
+ * whole line (using the *_MAX_LEN constants and *_max_len functions), and
+ * uses bgpstream_fmt_buf_start/finish to get a buffer that is guaranteed to
+ * be large enough.
+ *
+ */
+
+/**
+ * @name Private Constants
+ *
+ * @{ */
+
+/** Maximum length of a formatted 32 bit unsigned integer */
+#define BGPSTREAM_FMT_UINT32_MAX_LEN 10
+
+/** Maximum length of a formatted IP address (same as INET6_ADDRSTRLEN - 1) */
+#define BGPSTREAM_FMT_ADDR_MAX_LEN 45
+
+/** Maximum length of a formatted prefix */
+#define BGPSTREAM_FMT_PFX_MAX_LEN (BGPSTREAM_FMT_ADDR_MAX_LEN + 4)
+
+/** Size of the on-stack scratch buffer used for short output buffers */
+#define BGPSTREAM_FMT_SCRATCH_LEN 4096
+
+/** @} */
+
+/**
+ * @name Private Data Structures
+ *
+ * @{ */
+
+/** State for writing a line of unknown (but bounded) length into a buffer */
+typedef struct bgpstream_fmt_buf {
+
+  /** The user's buffer */
+  char *buf;
+
+  /** Length of the user's buffer */
+  size_t len;
+
+  /** Where the line is actually written (buf, scratch, or a heap buffer) */
+  char *out;
+
+  /** Scratch space used when the user's buffer may be too short */
+  char scratch[BGPSTREAM_FMT_SCRATCH_LEN];
+
+} bgpstream_fmt_buf_t;
+
+/** @} */
+
+/**
+ * @name Private API Functions
+ *
+ * @{ */
+
+/** Start writing a line of at most max_len characters into the given buffer
+ *
+ * @param fb            pointer to the formatting state to initialize
+ * @param buf           pointer to the user's buffer
+ * @param len           length of the user's buffer
+ * @param max_len       upper bound on the length of the line (not including
+ *                      the nul terminator)
+ * @return pointer to write the line at, or NULL if an error occurred
+ *
+ * If the user's buffer is large enough the line is written directly into it,
+ * otherwise it is written to a temporary buffer and truncated by
+ * bgpstream_fmt_buf_finish.
+ */
+char *bgpstream_fmt_buf_start(bgpstream_fmt_buf_t *fb, char *buf, size_t len,
+                              size_t max_len);
+
+/** Finish writing a line started with bgpstream_fmt_buf_start
+ *
+ * @param fb            pointer to the formatting state
+ * @param end           pointer to the end of the line, or NULL to abort
+ * @return the length of the complete line (which may be greater than or equal
+ * to the length of the user's buffer, as with snprintf)
+ *
+ * The user's buffer is always nul-terminated (if its length is not zero).
+ */
+size_t bgpstream_fmt_buf_finish(bgpstream_fmt_buf_t *fb, char *end);
+
+/** Write a 32 bit unsigned integer in decimal
+ *
+ * @param p             pointer to write at
+ * @param v             value to write
+ * @return pointer to the end of the output
+ */
+static inline char *bgpstream_fmt_uint32(char *p, uint32_t v)
+{
+  static const char digits[] = "00010203040506070809"
+                               "10111213141516171819"
+                               "20212223242526272829"
+                               "30313233343536373839"
+                               "40414243444546474849"
+                               "50515253545556575859"
+                               "60616263646566676869"
+                               "70717273747576777879"
+                               "80818283848586878889"
+                               "90919293949596979899";
+  char tmp[BGPSTREAM_FMT_UINT32_MAX_LEN];
+  char *t = tmp + sizeof(tmp);
+  uint32_t i;
+
+  while (v >= 100) {
+    i = (v % 100) * 2;
+    v /= 100;
+    *--t = digits[i + 1];
+    *--t = digits[i];
+  }
+  if (v >= 10) {
+    *--t = digits[v * 2 + 1];
+    *--t = digits[v * 2];
+  } else {
+    *--t = '0' + v;
+  }
+
+  memcpy(p, t, tmp + sizeof(tmp) - t);
+  return p + (tmp + sizeof(tmp) - t);
+}
+
+/** Write a 32 bit unsigned integer in decimal, zero-padded to the given width
+ *
+ * @param p             pointer to write at
+ * @param v             value to write
+ * @param width         minimum number of digits to write (at most
+ *                      BGPSTREAM_FMT_UINT32_MAX_LEN)
+ * @return pointer to the end of the output
+ */
+char *bgpstream_fmt_uint32_pad(char *p, uint32_t v, int width);
+
+/** Write a string
+ *
+ * @param p             pointer to write at
+ * @param str           nul-terminated string to write
+ * @return pointer to the end of the output
+ */
+static inline char *bgpstream_fmt_str(char *p, const char *str)
+{
+  size_t len = strlen(str);
+  memcpy(p, str, len);
+  return p + len;
+}
+
+/** Write an IP address, in the same format as inet_ntop
+ *
+ * @param p             pointer to write at
+ * @param addr          pointer to the address to write
+ * @return pointer to the end of the output, or NULL if the address version is
+ * not valid (in which case nothing is written)
+ */
+char *bgpstream_fmt_addr(char *p, const bgpstream_ip_addr_t *addr);
+
+/** Write a prefix, in the same format as bgpstream_pfx_snprintf
+ *
+ * @param p             pointer to write at
+ * @param pfx           pointer to the prefix to write
+ * @return pointer to the end of the output, or NULL if the address version is
+ * not valid (in which case nothing is written)
+ */
+char *bgpstream_fmt_pfx(char *p, const bgpstream_pfx_t *pfx);
+
+/** Get an upper bound on the length of the given AS path when formatted
+ *
+ * @param path          pointer to the AS path
+ * @return the maximum number of characters that bgpstream_fmt_as_path (or
+ * bgpstream_fmt_as_path_seg for any segment of the path) may write
+ */
+size_t bgpstream_fmt_as_path_max_len(const bgpstream_as_path_t *path);
+
+/** Write an AS path segment, in the same format as
+ * bgpstream_as_path_seg_snprintf
+ *
+ * @param p             pointer to write at
+ * @param seg           pointer to the segment to write
+ * @return pointer to the end of the output
+ */
+char *bgpstream_fmt_as_path_seg(char *p, const bgpstream_as_path_seg_t *seg);
+
+/** Write an AS path, in the same format as bgpstream_as_path_snprintf
+ *
+ * @param p             pointer to write at
+ * @param path          pointer to the path to write
+ * @return pointer to the end of the output
+ */
+char *bgpstream_fmt_as_path(char *p, const bgpstream_as_path_t *path);
+
+/** Get an upper bound on the length of the given community set when
+ * formatted
+ *
+ * @param set           pointer to the community set
+ * @return the maximum number of characters that bgpstream_fmt_community_set
+ * may write
+ */
+size_t bgpstream_fmt_community_set_max_len(const bgpstream_community_set_t *set);
+
+/** Write a community set, in the same format as
+ * bgpstream_community_set_snprintf
+ *
+ * @param p             pointer to write at
+ * @param set           pointer to the community set to write
+ * @return pointer to the end of the output
+ */
+char *bgpstream_fmt_community_set(char *p, const bgpstream_community_set_t *set);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_FMT_H */
@@ -33,12 +33,18 @@
 #include <stdio.h>
 #include <string.h>
 
-/* static char buffer[INET6_ADDRSTRLEN]; */
+/* Number of pending intervals below which they are merged into the sorted
+ * array one at a time (binary search + memmove) rather than by re-sorting the
+ * whole array */
+#define IPC_INSERT_THRESHOLD 16
+
+/* Minimum number of pending intervals that are buffered before they are
+ * merged into the sorted array (if no query forces the merge earlier) */
+#define IPC_MIN_PENDING 4096
 
 typedef struct struct_v4pfx_int_t {
   uint32_t start;
   uint32_t end;
-  struct struct_v4pfx_int_t *next;
 } v4pfx_int_t;
 
 typedef struct struct_v6pfx_int_t {
@@ -46,252 +52,344 @@ typedef struct struct_v6pfx_int_t {
   uint64_t start_ls;
   uint64_t end_ms;
   uint64_t end_ls;
-  struct struct_v6pfx_int_t *next;
 } v6pfx_int_t;
 
-/* IP Counter Linked List */
+/* IP Counter
+ *
+ * Each address family is stored as an array of intervals: the first
+ * `*_sorted` elements are disjoint and sorted by start address, the remaining
+ * ones (up to `*_cnt`) have been added but not yet merged. Pending intervals
+ * are merged in before any query, so that queries can binary search the
+ * sorted array. */
 struct bgpstream_ip_counter {
-  v4pfx_int_t *v4list;
-  v6pfx_int_t *v6list;
+  v4pfx_int_t *v4;
+  size_t v4_cnt;
+  size_t v4_sorted;
+  size_t v4_alloc;
+
+  v6pfx_int_t *v6;
+  size_t v6_cnt;
+  size_t v6_sorted;
+  size_t v6_alloc;
 };
 
-/* static void */
-/* print_pfx_int_list(bgpstream_ip_counter_t *ipc) */
-/*  {  */
-/*    v4pfx_int_t *current4 = ipc->v4list; */
-/*    bgpstream_ipv4_addr_t ip4; */
-
-/*    ip4.version = BGPSTREAM_ADDR_VERSION_IPV4;  */
-/*    while(current4 != NULL)  */
-/*      {  */
-/*        ip4.addr.s_addr = htonl(current4->start);  */
-/*        bgpstream_addr_ntop(buffer, INET_ADDRSTRLEN, &ip4);  */
-/*        printf("IP space:\t%s\t", buffer);  */
-/*        ip4.addr.s_addr = htonl(current4->end);  */
-/*        bgpstream_addr_ntop(buffer, INET_ADDRSTRLEN, &ip4);  */
-/*        printf("%s\n", buffer);  */
-/*        current4 = current4->next;  */
-/*      } */
-
-/*    v6pfx_int_t *current6 = ipc->v6list;  */
-/*    bgpstream_ipv6_addr_t ip6; */
-/*    uint64_t tmp; */
-/*    ip6.version = BGPSTREAM_ADDR_VERSION_IPV6; */
-
-/*    while(current6 != NULL)  */
-/*      { */
-/*        tmp = htonll(current6->start_ms); */
-/*        memcpy(&ip6.addr.s6_addr[0], &tmp, sizeof(uint64_t)); */
-/*        tmp = htonll(current6->start_ls); */
-/*        memcpy(&ip6.addr.s6_addr[8], &tmp, sizeof(uint64_t)); */
-/*        bgpstream_addr_ntop(buffer, INET6_ADDRSTRLEN, &ip6);  */
-/*        printf("IP space:\t%s\t", buffer); */
-/*        tmp = htonll(current6->end_ms); */
-/*        memcpy(&ip6.addr.s6_addr[0], &tmp, sizeof(uint64_t)); */
-/*        tmp = htonll(current6->end_ls); */
-/*        memcpy(&ip6.addr.s6_addr[8],&tmp, sizeof(uint64_t)); */
-/*        bgpstream_addr_ntop(buffer, INET6_ADDRSTRLEN, &ip6);  */
-/*        printf("%s\n", buffer); */
-/*        current6 = current6->next;  */
-/*      } */
-/*  }  */
-
-static void one_step_merge4(v4pfx_int_t *pil)
+/* 128 bit comparisons of (ms, ls) pairs */
+#define V6_LT(a_ms, a_ls, b_ms, b_ls)                                          \
+  ((a_ms) < (b_ms) || ((a_ms) == (b_ms) && (a_ls) < (b_ls)))
+#define V6_GT(a_ms, a_ls, b_ms, b_ls) V6_LT(b_ms, b_ls, a_ms, a_ls)
+
+static void pfx_to_interval4(const bgpstream_ipv4_pfx_t *pfx, uint32_t *start,
+                             uint32_t *end)
 {
-  v4pfx_int_t *current = pil;
-  v4pfx_int_t *previous = pil;
-  if (current->next == NULL) {
-    return;
+  uint32_t mask = ~(((uint64_t)1 << (32 - pfx->mask_len)) - 1);
+  *start = ntohl(pfx->address.addr.s_addr) & mask;
+  *end = *start | (~mask);
+}
+
+static void pfx_to_interval6(const bgpstream_ipv6_pfx_t *pfx, v6pfx_int_t *i)
+{
+  uint64_t mask_ms;
+  uint64_t mask_ls;
+
+  if (pfx->mask_len > 64) {
+    mask_ms = ~((uint64_t)0);
+    mask_ls = ~(((uint64_t)1 << (64 - (pfx->mask_len - 64))) - 1);
+  } else {
+    mask_ms = ~(((uint64_t)1 << (64 - pfx->mask_len)) - 1);
+    mask_ls = 0;
   }
-  current = current->next;
 
-  while (current != NULL) {
-    if (current->start <= previous->end) {
-      if (current->end > previous->end) {
-        previous->end = current->end;
-      }
-      previous->next = current->next;
-      free(current);
-      current = previous->next;
+  /* most significant */
+  i->start_ms = nptohll(&pfx->address.addr.s6_addr[0]) & mask_ms;
+  i->end_ms = i->start_ms | (~mask_ms);
+
+  /* least significant */
+  i->start_ls = nptohll(&pfx->address.addr.s6_addr[8]) & mask_ls;
+  i->end_ls = i->start_ls | (~mask_ls);
+}
+
+static int cmp_interval4(const void *a, const void *b)
+{
+  const v4pfx_int_t *ia = a;
+  const v4pfx_int_t *ib = b;
+  return (ia->start > ib->start) - (ia->start < ib->start);
+}
+
+static int cmp_interval6(const void *a, const void *b)
+{
+  const v6pfx_int_t *ia = a;
+  const v6pfx_int_t *ib = b;
+  return V6_GT(ia->start_ms, ia->start_ls, ib->start_ms, ib->start_ls) -
+         V6_LT(ia->start_ms, ia->start_ls, ib->start_ms, ib->start_ls);
+}
+
+/* Find the first sorted interval whose end is >= (start) */
+static size_t lower_bound4(const bgpstream_ip_counter_t *ipc, uint32_t start)
+{
+  size_t lo = 0;
+  size_t hi = ipc->v4_sorted;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (ipc->v4[mid].end < start) {
+      lo = mid + 1;
     } else {
-      break;
+      hi = mid;
     }
   }
+  return lo;
 }
 
-static void one_step_merge6(v6pfx_int_t *pil)
+static size_t lower_bound6(const bgpstream_ip_counter_t *ipc,
+                           uint64_t start_ms, uint64_t start_ls)
 {
-  v6pfx_int_t *current = pil;
-  v6pfx_int_t *previous = pil;
-  if (current->next == NULL) {
-    return;
-  }
-  current = current->next;
-
-  while (current != NULL) {
-
-    /* current->start <= previous->end */
-    if (current->start_ms < previous->end_ms ||
-        (current->start_ms == previous->end_ms &&
-         current->start_ls <= previous->end_ls)) {
-      /* current->end > previous->end */
-      if (current->end_ms > previous->end_ms ||
-          (current->end_ms == previous->end_ms &&
-           current->end_ls > previous->end_ls)) {
-        previous->end_ms = current->end_ms;
-        previous->end_ls = current->end_ls;
-      }
-      previous->next = current->next;
-      free(current);
-      current = previous->next;
+  size_t lo = 0;
+  size_t hi = ipc->v6_sorted;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (V6_LT(ipc->v6[mid].end_ms, ipc->v6[mid].end_ls, start_ms, start_ls)) {
+      lo = mid + 1;
     } else {
-      break;
+      hi = mid;
     }
   }
+  return lo;
 }
 
-static int merge_in_sorted_queue4(v4pfx_int_t **pil, uint32_t start,
-                                  uint32_t end)
+/* Merge a single interval into the sorted array. There must be room for at
+ * least one more element after the sorted ones. */
+static void insert_sorted4(bgpstream_ip_counter_t *ipc, v4pfx_int_t i)
 {
-  // create new v4pfx_int_t
-  v4pfx_int_t *p = NULL;
-  v4pfx_int_t *previous = *pil;
-  v4pfx_int_t *current = *pil;
-
-  while (current != NULL) {
-    if (start > current->end) {
-      previous = current;
-      current = current->next;
-      continue;
+  size_t lo = lower_bound4(ipc, i.start);
+  size_t hi = lo;
+
+  /* all the intervals in [lo, hi) overlap with i */
+  while (hi < ipc->v4_sorted && ipc->v4[hi].start <= i.end) {
+    hi++;
+  }
+  if (hi > lo) {
+    if (ipc->v4[lo].start < i.start) {
+      i.start = ipc->v4[lo].start;
     }
-    if (end < current->start) {
-      /* found a position where to insert  */
-      if ((p = (v4pfx_int_t *)malloc_zero(sizeof(v4pfx_int_t))) == NULL) {
-        bgpstream_log(BGPSTREAM_LOG_ERR,
-                      "can't malloc v4pfx_int_t structure");
-        return -1;
-      }
-      p->start = start;
-      p->end = end;
-      p->next = NULL;
-      if (previous != current) {
-        previous->next = p;
-      } else {
-        *pil = p;
-      }
-      p->next = current;
-      return 0;
+    if (ipc->v4[hi - 1].end > i.end) {
+      i.end = ipc->v4[hi - 1].end;
     }
-    /* At this point S <= cE and E >= cS
-     * so we can merge them */
-    if (current->start > start) {
-      current->start = start;
+  }
+  /* replace [lo, hi) with the (merged) interval */
+  memmove(&ipc->v4[lo + 1], &ipc->v4[hi],
+          sizeof(v4pfx_int_t) * (ipc->v4_sorted - hi));
+  ipc->v4[lo] = i;
+  ipc->v4_sorted = ipc->v4_sorted - (hi - lo) + 1;
+}
+
+static void insert_sorted6(bgpstream_ip_counter_t *ipc, v6pfx_int_t i)
+{
+  size_t lo = lower_bound6(ipc, i.start_ms, i.start_ls);
+  size_t hi = lo;
+
+  /* all the intervals in [lo, hi) overlap with i */
+  while (hi < ipc->v6_sorted &&
+         !V6_GT(ipc->v6[hi].start_ms, ipc->v6[hi].start_ls, i.end_ms,
+                i.end_ls)) {
+    hi++;
+  }
+  if (hi > lo) {
+    if (V6_LT(ipc->v6[lo].start_ms, ipc->v6[lo].start_ls, i.start_ms,
+              i.start_ls)) {
+      i.start_ms = ipc->v6[lo].start_ms;
+      i.start_ls = ipc->v6[lo].start_ls;
     }
-    if (current->end < end) {
-      current->end = end;
+    if (V6_GT(ipc->v6[hi - 1].end_ms, ipc->v6[hi - 1].end_ls, i.end_ms,
+              i.end_ls)) {
+      i.end_ms = ipc->v6[hi - 1].end_ms;
+      i.end_ls = ipc->v6[hi - 1].end_ls;
     }
-    /* Now check from here on if there are other things
-     * to merge */
-    one_step_merge4(current);
-    return 0;
   }
+  /* replace [lo, hi) with the (merged) interval */
+  memmove(&ipc->v6[lo + 1], &ipc->v6[hi],
+          sizeof(v6pfx_int_t) * (ipc->v6_sorted - hi));
+  ipc->v6[lo] = i;
+  ipc->v6_sorted = ipc->v6_sorted - (hi - lo) + 1;
+}
 
-  /*   if here we didn't find a place where to insert the
-   * interval, it is either the first position or the last */
-  if ((p = (v4pfx_int_t *)malloc_zero(sizeof(v4pfx_int_t))) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "can't malloc v4pfx_int_t structure");
-    return -1;
+/* Merge all pending intervals into the sorted array */
+static int normalize4(bgpstream_ip_counter_t *ipc)
+{
+  size_t pending = ipc->v4_cnt - ipc->v4_sorted;
+  v4pfx_int_t *tmp;
+  size_t i, j, k;
+
+  if (pending == 0) {
+    return 0;
   }
-  p->start = start;
-  p->end = end;
-  p->next = NULL;
-  /* adding at the beginning of the queue */
-  if (previous == current) {
-    *pil = p;
+
+  if (pending <= IPC_INSERT_THRESHOLD) {
+    v4pfx_int_t buf[IPC_INSERT_THRESHOLD];
+    memcpy(buf, &ipc->v4[ipc->v4_sorted], sizeof(v4pfx_int_t) * pending);
+    for (i = 0; i < pending; i++) {
+      insert_sorted4(ipc, buf[i]);
+    }
+    ipc->v4_cnt = ipc->v4_sorted;
     return 0;
   }
-  // adding at the end of the queue
-  previous->next = p;
+
+  /* sort the pending intervals and merge them (from the back) with the
+   * sorted ones */
+  qsort(&ipc->v4[ipc->v4_sorted], pending, sizeof(v4pfx_int_t),
+        cmp_interval4);
+  if (ipc->v4_sorted > 0) {
+    if ((tmp = malloc(sizeof(v4pfx_int_t) * pending)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't malloc v4pfx_int_t array");
+      return -1;
+    }
+    memcpy(tmp, &ipc->v4[ipc->v4_sorted], sizeof(v4pfx_int_t) * pending);
+    i = ipc->v4_sorted;
+    j = pending;
+    k = ipc->v4_cnt;
+    while (j > 0) {
+      if (i > 0 && ipc->v4[i - 1].start > tmp[j - 1].start) {
+        ipc->v4[--k] = ipc->v4[--i];
+      } else {
+        ipc->v4[--k] = tmp[--j];
+      }
+    }
+    free(tmp);
+  }
+
+  /* coalesce overlapping intervals */
+  for (i = 0, j = 1; j < ipc->v4_cnt; j++) {
+    if (ipc->v4[j].start <= ipc->v4[i].end) {
+      if (ipc->v4[j].end > ipc->v4[i].end) {
+        ipc->v4[i].end = ipc->v4[j].end;
+      }
+    } else {
+      ipc->v4[++i] = ipc->v4[j];
+    }
+  }
+  ipc->v4_cnt = ipc->v4_sorted = i + 1;
   return 0;
 }
 
-static int merge_in_sorted_queue6(v6pfx_int_t **pil, uint64_t start_ms,
-                                  uint64_t start_ls, uint64_t end_ms,
-                                  uint64_t end_ls)
+static int normalize6(bgpstream_ip_counter_t *ipc)
 {
-  // create new v4pfx_int_t
-  v6pfx_int_t *p = NULL;
-  v6pfx_int_t *previous = *pil;
-  v6pfx_int_t *current = *pil;
-
-  while (current != NULL) {
-    /* start > current->end */
-    if (start_ms > current->end_ms ||
-        (start_ms == current->end_ms && start_ls > current->end_ls)) {
-      previous = current;
-      current = current->next;
-      continue;
+  size_t pending = ipc->v6_cnt - ipc->v6_sorted;
+  v6pfx_int_t *tmp;
+  size_t i, j, k;
+
+  if (pending == 0) {
+    return 0;
+  }
+
+  if (pending <= IPC_INSERT_THRESHOLD) {
+    v6pfx_int_t buf[IPC_INSERT_THRESHOLD];
+    memcpy(buf, &ipc->v6[ipc->v6_sorted], sizeof(v6pfx_int_t) * pending);
+    for (i = 0; i < pending; i++) {
+      insert_sorted6(ipc, buf[i]);
     }
-    /* end < current->start */
-    if (end_ms < current->start_ms ||
-        (end_ms == current->start_ms && end_ls < current->start_ls)) {
-      /* found a position where to insert  */
-      if ((p = (v6pfx_int_t *)malloc_zero(sizeof(v6pfx_int_t))) == NULL) {
-        bgpstream_log(BGPSTREAM_LOG_ERR,
-                      "can't malloc v6pfx_int_t structure");
-        return -1;
-      }
-      p->start_ms = start_ms;
-      p->start_ls = start_ls;
-      p->end_ms = end_ms;
-      p->end_ls = end_ls;
-      p->next = NULL;
-      if (previous != current) {
-        previous->next = p;
+    ipc->v6_cnt = ipc->v6_sorted;
+    return 0;
+  }
+
+  /* sort the pending intervals and merge them (from the back) with the
+   * sorted ones */
+  qsort(&ipc->v6[ipc->v6_sorted], pending, sizeof(v6pfx_int_t),
+        cmp_interval6);
+  if (ipc->v6_sorted > 0) {
+    if ((tmp = malloc(sizeof(v6pfx_int_t) * pending)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't malloc v6pfx_int_t array");
+      return -1;
+    }
+    memcpy(tmp, &ipc->v6[ipc->v6_sorted], sizeof(v6pfx_int_t) * pending);
+    i = ipc->v6_sorted;
+    j = pending;
+    k = ipc->v6_cnt;
+    while (j > 0) {
+      if (i > 0 && cmp_interval6(&ipc->v6[i - 1], &tmp[j - 1]) > 0) {
+        ipc->v6[--k] = ipc->v6[--i];
       } else {
-        *pil = p;
+        ipc->v6[--k] = tmp[--j];
       }
-      p->next = current;
-      return 0;
     }
-    /* At this point S <= cE and E >= cS
-     * so we can merge them */
-    /* current->start > start */
-    if (current->start_ms > start_ms ||
-        (current->start_ms == start_ms && current->start_ls > start_ls)) {
-      current->start_ms = start_ms;
-      current->start_ls = start_ls;
+    free(tmp);
+  }
+
+  /* coalesce overlapping intervals */
+  for (i = 0, j = 1; j < ipc->v6_cnt; j++) {
+    if (!V6_GT(ipc->v6[j].start_ms, ipc->v6[j].start_ls, ipc->v6[i].end_ms,
+               ipc->v6[i].end_ls)) {
+      if (V6_GT(ipc->v6[j].end_ms, ipc->v6[j].end_ls, ipc->v6[i].end_ms,
+                ipc->v6[i].end_ls)) {
+        ipc->v6[i].end_ms = ipc->v6[j].end_ms;
+        ipc->v6[i].end_ls = ipc->v6[j].end_ls;
+      }
+    } else {
+      ipc->v6[++i] = ipc->v6[j];
+    }
+  }
+  ipc->v6_cnt = ipc->v6_sorted = i + 1;
+  return 0;
+}
+
+/* Make sure there is room for at least cnt more intervals of each family */
+static int reserve(bgpstream_ip_counter_t *ipc, size_t v4_cnt, size_t v6_cnt)
+{
+  size_t new_alloc;
+  void *tmp;
+
+  if (ipc->v4_cnt + v4_cnt > ipc->v4_alloc) {
+    new_alloc = ipc->v4_alloc == 0 ? 64 : ipc->v4_alloc;
+    while (new_alloc < ipc->v4_cnt + v4_cnt) {
+      new_alloc *= 2;
     }
-    /* current->end < end */
-    if (current->end_ms < end_ms ||
-        (current->end_ms == end_ms && current->end_ls < end_ls)) {
-      current->end_ms = end_ms;
-      current->end_ls = end_ls;
+    if ((tmp = realloc(ipc->v4, sizeof(v4pfx_int_t) * new_alloc)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't realloc v4pfx_int_t array");
+      return -1;
     }
-    /* Now check from here on if there are other things
-     * to merge */
-    one_step_merge6(current);
-    return 0;
+    ipc->v4 = tmp;
+    ipc->v4_alloc = new_alloc;
+  }
+
+  if (ipc->v6_cnt + v6_cnt > ipc->v6_alloc) {
+    new_alloc = ipc->v6_alloc == 0 ? 64 : ipc->v6_alloc;
+    while (new_alloc < ipc->v6_cnt + v6_cnt) {
+      new_alloc *= 2;
+    }
+    if ((tmp = realloc(ipc->v6, sizeof(v6pfx_int_t) * new_alloc)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't realloc v6pfx_int_t array");
+      return -1;
+    }
+    ipc->v6 = tmp;
+    ipc->v6_alloc = new_alloc;
   }
 
-  /*   if here we didn't find a place where to insert the
-   * interval, it is either the first position or the last */
-  if ((p = (v6pfx_int_t *)malloc_zero(sizeof(v6pfx_int_t))) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "can't malloc v6pfx_int_t structure");
+  return 0;
+}
+
+/* Append an interval to the pending ones. Capacity must have been reserved. */
+static void add_pending(bgpstream_ip_counter_t *ipc,
+                        const bgpstream_pfx_t *pfx)
+{
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    v4pfx_int_t *i = &ipc->v4[ipc->v4_cnt++];
+    pfx_to_interval4(&pfx->bs_ipv4, &i->start, &i->end);
+  } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    pfx_to_interval6(&pfx->bs_ipv6, &ipc->v6[ipc->v6_cnt++]);
+  }
+}
+
+/* Merge the pending intervals once there are enough of them to amortize the
+ * cost of sorting the whole array */
+static int maybe_normalize(bgpstream_ip_counter_t *ipc)
+{
+  if (ipc->v4_cnt - ipc->v4_sorted >= IPC_MIN_PENDING &&
+      ipc->v4_cnt - ipc->v4_sorted >= ipc->v4_sorted &&
+      normalize4(ipc) != 0) {
     return -1;
   }
-  p->start_ms = start_ms;
-  p->start_ls = start_ls;
-  p->end_ms = end_ms;
-  p->end_ls = end_ls;
-  p->next = NULL;
-  /* adding at the beginning of the queue */
-  if (previous == current) {
-    *pil = p;
-    return 0;
+  if (ipc->v6_cnt - ipc->v6_sorted >= IPC_MIN_PENDING &&
+      ipc->v6_cnt - ipc->v6_sorted >= ipc->v6_sorted &&
+      normalize6(ipc) != 0) {
+    return -1;
   }
-  // adding at the end of the queue
-  previous->next = p;
   return 0;
 }
 
@@ -304,68 +402,35 @@ bgpstream_ip_counter_t *bgpstream_ip_counter_create()
                   "can't malloc bgpstream_ip_counter_t structure");
     return NULL;
   }
-  ipc->v4list = NULL;
-  ipc->v6list = NULL;
   return ipc;
 }
 
 int bgpstream_ip_counter_add(bgpstream_ip_counter_t *ipc, bgpstream_pfx_t *pfx)
 {
-  uint32_t start;
-  uint32_t end;
-  uint32_t mask;
-  unsigned char *tmp;
-  uint64_t start_ms = 0;
-  uint64_t start_ls = 0;
-  uint64_t end_ms = 0;
-  uint64_t end_ls = 0;
-  uint64_t mask_ms;
-  uint64_t mask_ls;
-
-  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
-    mask = ~(((uint64_t)1 << (32 - pfx->mask_len)) - 1);
-    start = ntohl(pfx->address.bs_ipv4.addr.s_addr);
-    start = start & mask;
-    end = start | (~mask);
-    return merge_in_sorted_queue4(&ipc->v4list, start, end);
-  } else {
-    if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
-      tmp = &pfx->address.bs_ipv6.addr.s6_addr[0];
-      start_ms = nptohll(tmp);
-      tmp = &pfx->address.bs_ipv6.addr.s6_addr[8];
-      start_ls = nptohll(tmp);
-      /* printf("+++++++++  %"PRIu64" %"PRIu64"\n", start_ms, start_ls); */
-      if (pfx->mask_len > 64) {
-        /* len_ms = 0 */
-        mask_ms = ~((uint64_t)0);
-        /* len_ls = 64 - (pfx->mask_len - 64); */
-        mask_ls = ~(((uint64_t)1 << (64 - (pfx->mask_len - 64))) - 1);
-      } else {
-        /* len_ms = 64 - pfx->mask_len; */
-        mask_ms = ~(((uint64_t)1 << (64 - pfx->mask_len)) - 1);
-        /* len_ls = 64; */
-        /* mask_ls = ~( ((uint64_t)1 << 64) - 1); */
-        mask_ls = 0;
-      }
-
-      /* printf("MASKS:  %"PRIu64" %"PRIu64"\n", mask_ms, mask_ls); */
-
-      /* most significant */
-      start_ms = start_ms & mask_ms;
-      end_ms = start_ms | (~mask_ms);
-      /* printf("MS:  %"PRIu64" %"PRIu64"\n", start_ms, end_ms); */
-
-      /* least significant */
-      start_ls = start_ls & mask_ls;
-      end_ls = start_ls | (~mask_ls);
-      /* printf("LS:  %"PRIu64" %"PRIu64"\n", start_ls, end_ls); */
+  return bgpstream_ip_counter_add_many(ipc, pfx, 1);
+}
 
-      return merge_in_sorted_queue6(&ipc->v6list, start_ms, start_ls, end_ms,
-                                    end_ls);
+int bgpstream_ip_counter_add_many(bgpstream_ip_counter_t *ipc,
+                                  bgpstream_pfx_t *pfxs, int pfxs_cnt)
+{
+  size_t v4_cnt = 0;
+  size_t v6_cnt = 0;
+  int i;
+
+  for (i = 0; i < pfxs_cnt; i++) {
+    if (pfxs[i].address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      v4_cnt++;
+    } else if (pfxs[i].address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+      v6_cnt++;
     }
   }
-  /* print_pfx_int_list(ipc); */
-  return 0;
+  if (reserve(ipc, v4_cnt, v6_cnt) != 0) {
+    return -1;
+  }
+  for (i = 0; i < pfxs_cnt; i++) {
+    add_pending(ipc, &pfxs[i]);
+  }
+  return maybe_normalize(ipc);
 }
 
 static uint32_t bgpstream_ip_counter_is_overlapping4(
@@ -373,47 +438,32 @@ static uint32_t bgpstream_ip_counter_is_overlapping4(
     bgpstream_ipv4_pfx_t *pfx,
     uint8_t *more_specific)
 {
-  v4pfx_int_t *current = ipc->v4list;
-  uint32_t start = 0;
-  uint32_t end = 0;
-  uint32_t len = 0;
+  uint32_t start;
+  uint32_t end;
   uint32_t pfx_size;
   uint32_t overlap_count = 0;
-  *more_specific = 0;
-  len = 32 - pfx->mask_len;
-  start = ntohl(pfx->address.addr.s_addr);
-  start = (start >> len) << len;
-  end = 0;
-  end = ~end;
-  end = (end >> len) << len;
-  end = start | (~end);
-  pfx_size = end - start + 1;
   /* intersection endpoints */
   uint32_t int_start;
   uint32_t int_end;
-  while (current != NULL) {
-    if (current->start > end) {
-      break;
-    }
-    if (current->end < start) {
-      current = current->next;
-      continue;
-    }
+  size_t i;
+
+  if (normalize4(ipc) != 0) {
+    return 0;
+  }
+
+  pfx_to_interval4(pfx, &start, &end);
+  pfx_size = end - start + 1;
+
+  for (i = lower_bound4(ipc, start);
+       i < ipc->v4_sorted && ipc->v4[i].start <= end; i++) {
     /* there is some overlap
      * max(start) and min(end) */
-    int_start = current->start;
-    int_end = current->end;
-    if (current->start < start) {
-      int_start = start;
-    }
-    if (current->end > end) {
-      int_end = end;
-    }
+    int_start = ipc->v4[i].start < start ? start : ipc->v4[i].start;
+    int_end = ipc->v4[i].end > end ? end : ipc->v4[i].end;
     if ((int_end - int_start + 1) == pfx_size) {
       *more_specific = 1;
     }
     overlap_count += int_end - int_start + 1;
-    current = current->next;
   }
   return overlap_count;
 }
@@ -423,105 +473,47 @@ static uint64_t bgpstream_ip_counter_is_overlapping6(
     bgpstream_ipv6_pfx_t *pfx,
     uint8_t *more_specific)
 {
-  v6pfx_int_t *current = ipc->v6list;
-  v6pfx_int_t *previous = ipc->v6list;
-
-  uint64_t start_ms = 0;
-  uint64_t start_ls = 0;
-  uint64_t end_ms = 0;
-  uint64_t end_ls = 0;
-  uint64_t mask_ms;
-  uint64_t mask_ls;
-  unsigned char *tmp;
+  v6pfx_int_t p;
+  const v6pfx_int_t *current;
+  const v6pfx_int_t *previous;
   uint64_t overlap_count = 0;
   uint64_t pfx_size;
-  *more_specific = 0;
-
-  tmp = &(pfx->address.addr.s6_addr[0]);
-  start_ms = nptohll(tmp);
-  tmp = &(pfx->address.addr.s6_addr[8]);
-  start_ls = nptohll(tmp);
-
-  /* printf("+++++++++  %"PRIu64" %"PRIu64"\n", start_ms, start_ls); */
-  if (pfx->mask_len > 64) {
-    /* len_ms = 0 */
-    mask_ms = ~((uint64_t)0);
-    /* len_ls = 64 - (pfx->mask_len - 64); */
-    mask_ls = ~(((uint64_t)1 << (64 - (pfx->mask_len - 64))) - 1);
-  } else {
-    /* len_ms = 64 - pfx->mask_len; */
-    mask_ms = ~(((uint64_t)1 << (64 - pfx->mask_len)) - 1);
-    /* len_ls = 64; */
-    /* mask_ls = ~( ((uint64_t)1 << 64) - 1); */
-    mask_ls = 0;
-  }
-
-  /* printf("MASKS:  %"PRIu64" %"PRIu64"\n", mask_ms, mask_ls); */
-
-  /* most significant */
-  start_ms = start_ms & mask_ms;
-  end_ms = start_ms | (~mask_ms);
-  /* printf("MS:  %"PRIu64" %"PRIu64"\n", start_ms, end_ms); */
-
-  /* least significant */
-  start_ls = start_ls & mask_ls;
-  end_ls = start_ls | (~mask_ls);
-  /* printf("LS:  %"PRIu64" %"PRIu64"\n", start_ls, end_ls); */
-
-  pfx_size = end_ms - start_ms + 1;
-
   /* intersection endpoints
    * (only most significant)*/
   uint64_t int_start_ms;
   uint64_t int_end_ms;
+  size_t i;
+
+  if (normalize6(ipc) != 0) {
+    return 0;
+  }
+
+  pfx_to_interval6(pfx, &p);
+  pfx_size = p.end_ms - p.start_ms + 1;
 
-  while (current != NULL) {
+  i = lower_bound6(ipc, p.start_ms, p.start_ls);
+  previous = (i > 0) ? &ipc->v6[i - 1] : NULL;
+  for (; i < ipc->v6_sorted; i++) {
+    current = &ipc->v6[i];
     /* current->start > end */
-    if (current->start_ms > end_ms ||
-        (current->start_ms == end_ms && current->start_ls > end_ls)) {
+    if (V6_GT(current->start_ms, current->start_ls, p.end_ms, p.end_ls)) {
       break;
     }
-    /* current->end < start */
-    if (current->end_ms < start_ms ||
-        (current->end_ms == start_ms && current->end_ms < start_ls)) {
-      previous = current;
-      current = current->next;
-      continue;
-    }
     /* there is some overlap
      * max(start) and min(end) */
-    int_start_ms = current->start_ms;
-    int_end_ms = current->end_ms;
-    /* int_start_ls = current->start_ls; */
-    /* int_end_ls = current->end_ls; */
-    /* current->start < start */
-    if (current->start_ms < start_ms ||
-        (current->start_ms == start_ms && current->start_ms < start_ls)) {
-      int_start_ms = start_ms;
-      /* int_start_ls = start_ls; */
-    }
-    /* current->end > end */
-    if (current->end_ms > end_ms ||
-        (current->end_ms == end_ms && current->end_ls > end_ls)) {
-      int_end_ms = end_ms;
-      /* int_end_ls = end_ls; */
-    }
-    if (previous != current) {
-      if (current->start_ms != previous->start_ms ||
-          current->end_ms != previous->end_ms) {
-        if ((int_end_ms - int_start_ms + 1) == pfx_size) {
-          *more_specific = 1;
-        }
-        overlap_count += int_end_ms - int_start_ms + 1;
-      }
-    } else {
+    int_start_ms = current->start_ms < p.start_ms ? p.start_ms :
+                                                    current->start_ms;
+    int_end_ms = current->end_ms > p.end_ms ? p.end_ms : current->end_ms;
+    /* intervals are counted in /64s, so skip an interval that falls in the
+     * same /64(s) as the previous one */
+    if (previous == NULL || current->start_ms != previous->start_ms ||
+        current->end_ms != previous->end_ms) {
       if ((int_end_ms - int_start_ms + 1) == pfx_size) {
         *more_specific = 1;
       }
       overlap_count += int_end_ms - int_start_ms + 1;
     }
     previous = current;
-    current = current->next;
   }
   return overlap_count;
 }
@@ -547,32 +539,27 @@ uint64_t bgpstream_ip_counter_get_ipcount(bgpstream_ip_counter_t *ipc,
                                           bgpstream_addr_version_t v)
 {
   uint64_t ip_count = 0;
-
-  v4pfx_int_t *current4 = ipc->v4list;
-  v6pfx_int_t *current6 = ipc->v6list;
-  v6pfx_int_t *previous6 = ipc->v6list;
+  size_t i;
 
   if (v == BGPSTREAM_ADDR_VERSION_IPV4) {
-    while (current4 != NULL) {
-      ip_count += (current4->end - current4->start) + 1;
-      current4 = current4->next;
+    if (normalize4(ipc) != 0) {
+      return 0;
+    }
+    for (i = 0; i < ipc->v4_sorted; i++) {
+      ip_count += (ipc->v4[i].end - ipc->v4[i].start) + 1;
     }
   } else {
     if (v == BGPSTREAM_ADDR_VERSION_IPV6) {
-      while (current6 != NULL) {
-
-        if (previous6 != current6) {
-          /* add a new /64 to the count if the previous one
-           * was different (it could have been a /64+ */
-          if (current6->start_ms != previous6->start_ms ||
-              current6->end_ms != previous6->end_ms) {
-            ip_count += (current6->end_ms - current6->start_ms) + 1;
-          }
-        } else { /* if it is the first interval, than we always add it */
-          ip_count += (current6->end_ms - current6->start_ms) + 1;
+      if (normalize6(ipc) != 0) {
+        return 0;
+      }
+      for (i = 0; i < ipc->v6_sorted; i++) {
+        /* add a new /64 to the count if the previous one
+         * was different (it could have been a /64+ */
+        if (i == 0 || ipc->v6[i].start_ms != ipc->v6[i - 1].start_ms ||
+            ipc->v6[i].end_ms != ipc->v6[i - 1].end_ms) {
+          ip_count += (ipc->v6[i].end_ms - ipc->v6[i].start_ms) + 1;
         }
-        previous6 = current6;
-        current6 = current6->next;
       }
     }
   }
@@ -581,28 +568,16 @@ uint64_t bgpstream_ip_counter_get_ipcount(bgpstream_ip_counter_t *ipc,
 
 void bgpstream_ip_counter_clear(bgpstream_ip_counter_t *ipc)
 {
-  v4pfx_int_t *current4 = ipc->v4list;
-  v4pfx_int_t *tmp4 = ipc->v4list;
-  v6pfx_int_t *current6 = ipc->v6list;
-  v6pfx_int_t *tmp6 = ipc->v6list;
-
-  while (tmp4 != NULL) {
-    current4 = tmp4;
-    tmp4 = tmp4->next;
-    free(current4);
-  }
-  ipc->v4list = NULL;
-
-  while (tmp6 != NULL) {
-    current6 = tmp6;
-    tmp6 = tmp6->next;
-    free(current6);
-  }
-  ipc->v6list = NULL;
+  ipc->v4_cnt = ipc->v4_sorted = 0;
+  ipc->v6_cnt = ipc->v6_sorted = 0;
 }
 
 void bgpstream_ip_counter_destroy(bgpstream_ip_counter_t *ipc)
 {
-  bgpstream_ip_counter_clear(ipc);
+  if (ipc == NULL) {
+    return;
+  }
+  free(ipc->v4);
+  free(ipc->v6);
   free(ipc);
 }
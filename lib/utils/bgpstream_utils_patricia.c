@@ -133,6 +133,13 @@ struct bgpstream_patricia_tree_result_set {
   int _alloc_size;
 };
 
+/** Types of walk performed by a bgpstream_patricia_tree_iter_t */
+enum {
+  BPT_ITER_MORE_SPECIFICS,
+  BPT_ITER_LESS_SPECIFICS,
+  BPT_ITER_MIN_COVERAGE
+};
+
 /* ======================= UTILITY FUNCTIONS ======================= */
 
 static inline const unsigned char *bgpstream_pfx_get_first_byte(
@@ -405,6 +412,57 @@ static bgpstream_patricia_walk_cb_result_t bpt_walk_parents(
   return BGPSTREAM_PATRICIA_WALK_CONTINUE;
 }
 
+/* Return the node following node in a pre-order walk of the subtree rooted at
+ * root (or of the whole tree if root is NULL). If descend is 0, the children
+ * of node are skipped. */
+static const bgpstream_patricia_node_t *
+bpt_preorder_next(const bgpstream_patricia_node_t *node,
+                  const bgpstream_patricia_node_t *root, int descend)
+{
+  if (descend) {
+    if (node->l != NULL) {
+      return node->l;
+    }
+    if (node->r != NULL) {
+      return node->r;
+    }
+  }
+  /* climb until we find an unvisited right sibling */
+  while (node != root && node->parent != NULL) {
+    if (node == node->parent->l && node->parent->r != NULL) {
+      return node->parent->r;
+    }
+    node = node->parent;
+  }
+  return NULL;
+}
+
+/* Advance from node (inclusive) to the first node that contains an actual
+ * prefix */
+static const bgpstream_patricia_node_t *
+bpt_iter_seek(const bgpstream_patricia_tree_iter_t *it,
+              const bgpstream_patricia_node_t *node)
+{
+  while (node != NULL && !node->actual) {
+    if (it->_type == BPT_ITER_LESS_SPECIFICS) {
+      node = node->parent;
+    } else {
+      /* glue nodes are always descended, even for minimum coverage */
+      node = bpt_preorder_next(node, it->_root, 1);
+    }
+  }
+  return node;
+}
+
+static void bpt_iter_init(bgpstream_patricia_tree_iter_t *it, uint8_t type,
+                          const bgpstream_patricia_node_t *root,
+                          const bgpstream_patricia_node_t *first)
+{
+  it->_type = type;
+  it->_root = root;
+  it->_cursor = bpt_iter_seek(it, first);
+}
+
 static void bgpstream_patricia_tree_print_tree(
     const bgpstream_patricia_node_t *node)
 {
@@ -1136,6 +1194,166 @@ int bgpstream_patricia_tree_get_minimum_coverage(
   return bgpstream_patricia_tree_add_more_specifics(results, head, 1);
 }
 
+void bgpstream_patricia_tree_iter_init_more_specifics(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_node_t *node)
+{
+  assert(it);
+  /* we do not return the node itself */
+  bpt_iter_init(it, BPT_ITER_MORE_SPECIFICS, node,
+                node != NULL ? bpt_preorder_next(node, node, 1) : NULL);
+}
+
+void bgpstream_patricia_tree_iter_init_less_specifics(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_node_t *node)
+{
+  assert(it);
+  /* we do not return the node itself (that's why we pass the parent node) */
+  bpt_iter_init(it, BPT_ITER_LESS_SPECIFICS, NULL,
+                node != NULL ? node->parent : NULL);
+}
+
+void bgpstream_patricia_tree_iter_init_pfx_more_specifics(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_tree_t *pt,
+  const bgpstream_pfx_t *pfx)
+{
+  assert(it);
+  assert(pt);
+  assert(pfx);
+  const bgpstream_patricia_node_t *node_it =
+    bgpstream_patricia_get_head(pt, pfx->address.version);
+  int relation;
+  uint8_t differ_bit; // unused
+
+  if (node_it != NULL) {
+    node_it = bpt_find_insert_point_const(node_it, pfx, &relation, &differ_bit);
+    if (relation == BGPSTREAM_PATRICIA_SELF) {
+      /* skip the exact match */
+      bpt_iter_init(it, BPT_ITER_MORE_SPECIFICS, node_it,
+                    bpt_preorder_next(node_it, node_it, 1));
+      return;
+    }
+    if (relation == BGPSTREAM_PATRICIA_CHILD) {
+      /* pfx would be a parent of node_it: the whole subtree is more specific */
+      bpt_iter_init(it, BPT_ITER_MORE_SPECIFICS, node_it, node_it);
+      return;
+    }
+  }
+  bpt_iter_init(it, BPT_ITER_MORE_SPECIFICS, NULL, NULL);
+}
+
+void bgpstream_patricia_tree_iter_init_pfx_less_specifics(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_tree_t *pt,
+  const bgpstream_pfx_t *pfx)
+{
+  assert(it);
+  assert(pt);
+  assert(pfx);
+  const bgpstream_patricia_node_t *node_it =
+    bgpstream_patricia_get_head(pt, pfx->address.version);
+  int relation;
+  uint8_t differ_bit; // unused
+
+  if (node_it != NULL) {
+    node_it = bpt_find_insert_point_const(node_it, pfx, &relation, &differ_bit);
+    if (relation != BGPSTREAM_PATRICIA_PARENT) {
+      /* node_it is either an exact match, a more specific or a sibling */
+      node_it = node_it->parent;
+    }
+  }
+  bpt_iter_init(it, BPT_ITER_LESS_SPECIFICS, NULL, node_it);
+}
+
+void bgpstream_patricia_tree_iter_init_minimum_coverage(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_tree_t *pt,
+  bgpstream_addr_version_t v)
+{
+  assert(it);
+  assert(pt);
+  bpt_iter_init(it, BPT_ITER_MIN_COVERAGE, NULL,
+                bgpstream_patricia_get_head(pt, v));
+}
+
+bgpstream_patricia_node_t *
+bgpstream_patricia_tree_iter_next(bgpstream_patricia_tree_iter_t *it)
+{
+  const bgpstream_patricia_node_t *node = it->_cursor;
+  const bgpstream_patricia_node_t *next;
+
+  if (node == NULL) {
+    return NULL;
+  }
+
+  switch (it->_type) {
+  case BPT_ITER_LESS_SPECIFICS:
+    next = node->parent;
+    break;
+  case BPT_ITER_MIN_COVERAGE:
+    /* everything below node is covered by node */
+    next = bpt_preorder_next(node, it->_root, 0);
+    break;
+  default:
+    next = bpt_preorder_next(node, it->_root, 1);
+    break;
+  }
+  it->_cursor = bpt_iter_seek(it, next);
+
+  return bgpstream_nonconst_node(node);
+}
+
+uint64_t bgpstream_patricia_tree_count_more_specifics(
+  const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node)
+{
+  bgpstream_patricia_tree_iter_t it;
+  uint64_t cnt = 0;
+
+  bgpstream_patricia_tree_iter_init_more_specifics(&it, node);
+  while (bgpstream_patricia_tree_iter_next(&it) != NULL) {
+    cnt++;
+  }
+  return cnt;
+}
+
+uint64_t bgpstream_patricia_tree_count_less_specifics(
+  const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node)
+{
+  uint64_t cnt = 0;
+
+  if (node == NULL) {
+    return 0;
+  }
+  for (node = node->parent; node != NULL; node = node->parent) {
+    if (node->actual) {
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+void bgpstream_patricia_tree_walk_more_specifics(
+  const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
+  bgpstream_patricia_tree_process_node_t *fun, void *data)
+{
+  bgpstream_patricia_tree_iter_t it;
+  const bgpstream_patricia_node_t *n;
+
+  bgpstream_patricia_tree_iter_init_more_specifics(&it, node);
+  while ((n = bgpstream_patricia_tree_iter_next(&it)) != NULL) {
+    if (fun(pt, n, data) != BGPSTREAM_PATRICIA_WALK_CONTINUE) {
+      return;
+    }
+  }
+}
+
+void bgpstream_patricia_tree_walk_less_specifics(
+  const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
+  bgpstream_patricia_tree_process_node_t *fun, void *data)
+{
+  if (node == NULL) {
+    return;
+  }
+  bpt_walk_parents(pt, node->parent, fun, data);
+}
+
 uint8_t
 bgpstream_patricia_tree_get_node_overlap_info(
     const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node)
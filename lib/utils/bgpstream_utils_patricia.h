@@ -96,6 +96,27 @@ typedef bgpstream_patricia_walk_cb_result_t
                                          const bgpstream_patricia_node_t *node,
                                          void *data);
 
+/** Allocation-free iterator over a set of Patricia Tree nodes
+ *
+ * The iterator is intended to be allocated on the stack by the caller and
+ * initialized using one of the bgpstream_patricia_tree_iter_init_* functions.
+ * Since the tree nodes keep a pointer to their parent, no auxiliary storage is
+ * needed to walk the tree. The tree must not be modified while an iterator is
+ * in use.
+ */
+typedef struct bgpstream_patricia_tree_iter {
+
+  /** @private Node the walk is confined to (NULL for the whole tree) */
+  const bgpstream_patricia_node_t *_root;
+
+  /** @private Next node to be returned (NULL when the walk is complete) */
+  const bgpstream_patricia_node_t *_cursor;
+
+  /** @private Type of walk being performed */
+  uint8_t _type;
+
+} bgpstream_patricia_tree_iter_t;
+
 /** @} */
 
 /** @private Convert a const node* to a node* (while otherwise maintaining
@@ -329,6 +350,120 @@ int bgpstream_patricia_tree_get_minimum_coverage(
   bgpstream_patricia_tree_t *pt, bgpstream_addr_version_t v,
   bgpstream_patricia_tree_result_set_t *results);
 
+/** Initialize an iterator over the more specific prefixes of a node
+ *
+ * @param it           pointer to the iterator to initialize
+ * @param node         pointer to the node (not returned by the iterator)
+ *
+ * Nodes are returned in the same (pre-order) order used by
+ * bgpstream_patricia_tree_get_more_specifics.
+ */
+void bgpstream_patricia_tree_iter_init_more_specifics(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_node_t *node);
+
+/** Initialize an iterator over the less specific prefixes of a node
+ *
+ * @param it           pointer to the iterator to initialize
+ * @param node         pointer to the node (not returned by the iterator)
+ *
+ * Nodes are returned starting from the smallest less specific prefix, i.e.,
+ * in the same order used by bgpstream_patricia_tree_get_less_specifics.
+ */
+void bgpstream_patricia_tree_iter_init_less_specifics(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_node_t *node);
+
+/** Initialize an iterator over the prefixes of the tree that are more specific
+ * than the given prefix
+ *
+ * @param it           pointer to the iterator to initialize
+ * @param pt           pointer to the patricia tree
+ * @param pfx          pointer to the prefix (need not be in the tree)
+ *
+ * An exact match of pfx is not returned by the iterator.
+ */
+void bgpstream_patricia_tree_iter_init_pfx_more_specifics(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_tree_t *pt,
+  const bgpstream_pfx_t *pfx);
+
+/** Initialize an iterator over the prefixes of the tree that are less specific
+ * than the given prefix
+ *
+ * @param it           pointer to the iterator to initialize
+ * @param pt           pointer to the patricia tree
+ * @param pfx          pointer to the prefix (need not be in the tree)
+ *
+ * An exact match of pfx is not returned by the iterator.
+ */
+void bgpstream_patricia_tree_iter_init_pfx_less_specifics(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_tree_t *pt,
+  const bgpstream_pfx_t *pfx);
+
+/** Initialize an iterator over the minimum coverage of the tree
+ *
+ * @param it           pointer to the iterator to initialize
+ * @param pt           pointer to the patricia tree
+ * @param v            IP version
+ *
+ * Returns the same nodes as bgpstream_patricia_tree_get_minimum_coverage.
+ */
+void bgpstream_patricia_tree_iter_init_minimum_coverage(
+  bgpstream_patricia_tree_iter_t *it, const bgpstream_patricia_tree_t *pt,
+  bgpstream_addr_version_t v);
+
+/** Get the next node from the iterator
+ *
+ * @param it           pointer to an initialized iterator
+ * @return a pointer to the next node, or NULL if there are no more nodes
+ */
+bgpstream_patricia_node_t *
+bgpstream_patricia_tree_iter_next(bgpstream_patricia_tree_iter_t *it);
+
+/** Count the more specific prefixes of a node
+ *
+ * @param pt           pointer to the patricia tree
+ * @param node         pointer to the node
+ * @return the number of prefixes in the tree that are more specific than node
+ */
+uint64_t bgpstream_patricia_tree_count_more_specifics(
+  const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node);
+
+/** Count the less specific prefixes of a node
+ *
+ * @param pt           pointer to the patricia tree
+ * @param node         pointer to the node
+ * @return the number of prefixes in the tree that are less specific than node
+ */
+uint64_t bgpstream_patricia_tree_count_less_specifics(
+  const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node);
+
+/** Process the more specific prefixes of a node
+ *
+ * @param pt           pointer to the patricia tree
+ * @param node         pointer to the node (not passed to the callback)
+ * @param fun          callback function for nodes with prefixes
+ * @param data         pointer to data that can be used by the callback
+ *
+ * The walk stops as soon as the callback returns anything other than
+ * BGPSTREAM_PATRICIA_WALK_CONTINUE.
+ */
+void bgpstream_patricia_tree_walk_more_specifics(
+  const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
+  bgpstream_patricia_tree_process_node_t *fun, void *data);
+
+/** Process the less specific prefixes of a node
+ *
+ * @param pt           pointer to the patricia tree
+ * @param node         pointer to the node (not passed to the callback)
+ * @param fun          callback function for nodes with prefixes
+ * @param data         pointer to data that can be used by the callback
+ *
+ * The walk stops as soon as the callback returns anything other than
+ * BGPSTREAM_PATRICIA_WALK_CONTINUE.
+ */
+void bgpstream_patricia_tree_walk_less_specifics(
+  const bgpstream_patricia_tree_t *pt, const bgpstream_patricia_node_t *node,
+  bgpstream_patricia_tree_process_node_t *fun, void *data);
+
 /** Check whether a node overlaps with other prefixes in the tree
  *
  * @param pt           pointer to the patricia tree
@@ -24,151 +24,364 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 
-#include "khash.h"
 #include "utils.h"
 
 #include "bgpstream_utils_peer_sig_map.h"
 
-#define IPV4_ID_OFFSET 1
-#define IPV6_ID_OFFSET 1
+/** Peer and collector IDs are stored in chunks so that entries never move */
+#define CHUNK_BITS 8
+#define CHUNK_SIZE (1 << CHUNK_BITS)
+#define CHUNK_CNT ((UINT16_MAX >> CHUNK_BITS) + 1)
 
-/** Hash a peer signature into a 64bit number
- *
- * @param ps            the peer signature to hash
- * @return 64bit hash of the given peer signature
- */
-khint64_t bgpstream_peer_sig_hash(bgpstream_peer_sig_t *ps);
+/** Initial number of slots in the hash tables of a (non-concurrent) map */
+#define TABLE_INIT_SIZE 256
 
-/** Check if two peer signatures are equal
- *
- * @param ps1           pointer to the first peer signature
- * @param ps2           pointer to the second peer signature
- * @return 0 if the signatures are not equal, non-zero if they are equal
- */
-int bgpstream_peer_sig_equal(bgpstream_peer_sig_t *ps1,
-                             bgpstream_peer_sig_t *ps2);
+/** Number of slots in the hash tables of a concurrent map. This is large
+ * enough for every possible ID, so the tables never need to be resized. */
+#define TABLE_MAX_SIZE (1 << 17)
 
-/** Set the peer ID for the given collector/peer
- *
- * @param map           peer sig map to set peer ID for
- * @param peer_id       peer id to set
- * @param collector_str name of the collector the peer is associated with
- * @param peer_ip_addr  pointer to the peer IP address
- * @param peer_asnumber  AS number of the peer
- * @return 0 if the ID was associated successfully, -1 otherwise
- *
- * @note the peer sig map expects to be able to allocate IDs internally. This
- * function must be used with care.
- */
-int bgpstream_peer_sig_map_set(bgpstream_peer_sig_map_t *map,
-                               bgpstream_peer_id_t peer_id, char *collector_str,
-                               bgpstream_ip_addr_t *peer_ip_addr,
-                               uint32_t peer_asnumber);
+/** Collector names longer than this are truncated */
+#define COLLECTOR_LEN (BGPSTREAM_UTILS_STR_NAME_LEN - 1)
+
+/** Open-addressing hash table of IDs (0 marks an empty slot) */
+typedef struct idtable {
+
+  /** Array of slots */
+  uint16_t *slots;
+
+  /** Number of slots - 1 */
+  uint32_t mask;
+
+} idtable_t;
+
+/** Internal representation of a peer */
+typedef struct peer {
+
+  /** Public peer signature */
+  bgpstream_peer_sig_t sig;
+
+  /** ID of the collector (used instead of the collector name to compare
+   * peers) */
+  uint16_t collector_id;
 
-/** Map from peer signature to peer ID */
-KHASH_INIT(bgpstream_peer_sig_id_map, bgpstream_peer_sig_t *,
-           bgpstream_peer_id_t, 1, bgpstream_peer_sig_hash,
-           bgpstream_peer_sig_equal)
+  /** Hash of the collector ID and peer address */
+  uint32_t hash;
 
-/** Map from peer ID to signature */
-KHASH_INIT(bgpstream_peer_id_sig_map, bgpstream_peer_id_t,
-           bgpstream_peer_sig_t *, 1, kh_int_hash_func, kh_int_hash_equal)
+} peer_t;
+
+/** Internal representation of a collector */
+typedef struct collector {
+
+  /** Collector name */
+  char name[BGPSTREAM_UTILS_STR_NAME_LEN];
+
+  /** Hash of the collector name */
+  uint32_t hash;
+
+} collector_t;
 
 /** Structure representing an instance of a Peer Signature Map */
 struct bgpstream_peer_sig_map {
-  khash_t(bgpstream_peer_sig_id_map) * ps_id;
-  khash_t(bgpstream_peer_id_sig_map) * id_ps;
-  bgpstream_peer_id_t v4_next_id;
-  bgpstream_peer_id_t v6_next_id;
+
+  /** Is this map shared between threads? */
+  int concurrent;
+
+  /** Serializes inserts (only used by concurrent maps) */
+  pthread_mutex_t mutex;
+
+  /** Changes every time the map is cleared, to invalidate caches */
+  uint32_t generation;
+
+  /** Peer ID table */
+  idtable_t peer_ids;
+
+  /** Chunks of peers, indexed by peer ID */
+  peer_t *peers[CHUNK_CNT];
+
+  /** Number of peers in the map (IDs are 1..peers_cnt) */
+  uint16_t peers_cnt;
+
+  /** Collector ID table */
+  idtable_t collector_ids;
+
+  /** Chunks of collectors, indexed by collector ID */
+  collector_t *collectors[CHUNK_CNT];
+
+  /** Number of collectors in the map (IDs are 1..collectors_cnt) */
+  uint16_t collectors_cnt;
+
+  /** Cache used by bgpstream_peer_sig_map_get_id for non-concurrent maps */
+  bgpstream_peer_sig_map_cache_t cache;
 };
 
+#define PEER(map, id)                                                          \
+  (&(map)->peers[(id) >> CHUNK_BITS][(id) & (CHUNK_SIZE - 1)])
+
+#define COLLECTOR(map, id)                                                     \
+  (&(map)->collectors[(id) >> CHUNK_BITS][(id) & (CHUNK_SIZE - 1)])
+
 /* PRIVATE FUNCTIONS (static) */
 
-static void sig_free(bgpstream_peer_sig_t *sig)
+static uint32_t collector_hash(const char *name)
+{
+  uint32_t h = 2166136261U;
+  int i;
+
+  for (i = 0; i < COLLECTOR_LEN && name[i] != '\0'; i++) {
+    h = (h ^ (uint8_t)name[i]) * 16777619U;
+  }
+  return h;
+}
+
+static uint32_t peer_hash(uint16_t collector_id, bgpstream_ip_addr_t *addr)
 {
-  free(sig);
+  /* murmur3 64bit finalizer */
+  uint64_t h = bgpstream_addr_hash(addr) ^ ((uint64_t)collector_id << 48);
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return (uint32_t)h;
+}
+
+static int idtable_init(idtable_t *table, uint32_t size)
+{
+  if ((table->slots = malloc_zero(sizeof(uint16_t) * size)) == NULL) {
+    return -1;
+  }
+  table->mask = size - 1;
+  return 0;
+}
+
+/* Store an ID in the first free slot for the given hash */
+static void idtable_insert(idtable_t *table, uint32_t hash, uint16_t id)
+{
+  uint32_t i;
+
+  for (i = hash & table->mask; table->slots[i] != 0;
+       i = (i + 1) & table->mask)
+    ;
+  /* publish the ID only once the entry it refers to is complete */
+  __atomic_store_n(&table->slots[i], id, __ATOMIC_RELEASE);
 }
 
-static bgpstream_peer_id_t
-bgpstream_peer_sig_map_set_and_get_ps(bgpstream_peer_sig_map_t *map,
-                                      bgpstream_peer_sig_t *ps)
+/* Make sure there is room for one more ID in the given table of the map. Only
+ * needed by non-concurrent maps, since concurrent maps start at the maximum
+ * size. */
+static int idtable_reserve(bgpstream_peer_sig_map_t *map, idtable_t *table,
+                           uint16_t cnt)
 {
-  khiter_t k;
-  int khret;
-  bgpstream_peer_id_t new_id;
+  idtable_t new_table;
+  uint32_t hash;
+  uint32_t id;
 
-  if ((k = kh_get(bgpstream_peer_sig_id_map, map->ps_id, ps)) ==
-      kh_end(map->ps_id)) {
-    /* was not already in the map */
-    /* what ID should we use? */
-    if (map->v4_next_id >= IPV6_ID_OFFSET) {
-      /* v4 peers are in v6 range */
-      /* regardless of the version, use the v6 id */
-      new_id = map->v6_next_id++;
-    } else if (ps->peer_ip_addr.version == BGPSTREAM_ADDR_VERSION_IPV6) {
-      assert(map->v4_next_id < IPV6_ID_OFFSET);
-      new_id = map->v6_next_id++;
-    } else {
-      new_id = map->v4_next_id++;
+  if (((uint32_t)cnt + 1) * 2 <= table->mask + 1) {
+    return 0;
+  }
+
+  if (idtable_init(&new_table, (table->mask + 1) * 2) != 0) {
+    return -1;
+  }
+  for (id = 1; id <= cnt; id++) {
+    hash = (table == &map->peer_ids) ? PEER(map, id)->hash
+                                     : COLLECTOR(map, id)->hash;
+    idtable_insert(&new_table, hash, id);
+  }
+  free(table->slots);
+  *table = new_table;
+
+  return 0;
+}
+
+static uint16_t collector_find(bgpstream_peer_sig_map_t *map, const char *name,
+                               uint32_t hash)
+{
+  idtable_t *table = &map->collector_ids;
+  collector_t *c;
+  uint32_t i;
+  uint16_t id;
+
+  for (i = hash & table->mask;
+       (id = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE)) != 0;
+       i = (i + 1) & table->mask) {
+    c = COLLECTOR(map, id);
+    if (c->hash == hash && strncmp(c->name, name, COLLECTOR_LEN) == 0) {
+      return id;
     }
+  }
+  return 0;
+}
 
-    /* insert into both maps */
-    k = kh_put(bgpstream_peer_sig_id_map, map->ps_id, ps, &khret);
-    kh_value(map->ps_id, k) = new_id;
-    k = kh_put(bgpstream_peer_id_sig_map, map->id_ps, new_id, &khret);
-    kh_value(map->id_ps, k) = ps;
+/* Must be called with the map locked */
+static uint16_t collector_add(bgpstream_peer_sig_map_t *map, const char *name,
+                              uint32_t hash)
+{
+  collector_t *c;
+  uint16_t id;
 
-    return new_id;
-  } else {
-    /* already exists... */
-    free(ps); /* it was mallocd for us...*/
-    return kh_value(map->ps_id, k);
+  if (map->collectors_cnt == UINT16_MAX) {
+    return 0;
+  }
+  if (map->concurrent == 0 &&
+      idtable_reserve(map, &map->collector_ids, map->collectors_cnt) != 0) {
+    return 0;
   }
+
+  id = map->collectors_cnt + 1;
+  if (map->collectors[id >> CHUNK_BITS] == NULL &&
+      (map->collectors[id >> CHUNK_BITS] =
+         malloc(sizeof(collector_t) * CHUNK_SIZE)) == NULL) {
+    return 0;
+  }
+  c = COLLECTOR(map, id);
+  strncpy(c->name, name, COLLECTOR_LEN);
+  c->name[COLLECTOR_LEN] = '\0';
+  c->hash = hash;
+
+  idtable_insert(&map->collector_ids, hash, id);
+  __atomic_store_n(&map->collectors_cnt, id, __ATOMIC_RELEASE);
+  return id;
 }
 
-/* PROTECTED FUNCTIONS (_int.h) */
+static bgpstream_peer_id_t peer_find(bgpstream_peer_sig_map_t *map,
+                                     uint16_t collector_id,
+                                     bgpstream_ip_addr_t *addr, uint32_t hash)
+{
+  idtable_t *table = &map->peer_ids;
+  peer_t *p;
+  uint32_t i;
+  uint16_t id;
+
+  for (i = hash & table->mask;
+       (id = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE)) != 0;
+       i = (i + 1) & table->mask) {
+    p = PEER(map, id);
+    if (p->hash == hash && p->collector_id == collector_id &&
+        bgpstream_addr_equal(&p->sig.peer_ip_addr, addr)) {
+      return id;
+    }
+  }
+  return 0;
+}
 
-khint64_t bgpstream_peer_sig_hash(bgpstream_peer_sig_t *ps)
+/* Must be called with the map locked */
+static bgpstream_peer_id_t peer_add(bgpstream_peer_sig_map_t *map,
+                                    uint16_t collector_id,
+                                    bgpstream_ip_addr_t *addr,
+                                    uint32_t peer_asnumber, uint32_t hash)
 {
-  /* assuming that the number of peers that have the same ip and belong to two
-   * different collectors is low (in this specific case there will be a
-   * collision in terms of hash). */
-  return bgpstream_addr_hash(&ps->peer_ip_addr);
+  peer_t *p;
+  uint16_t id;
+
+  if (map->peers_cnt == UINT16_MAX) {
+    return 0;
+  }
+  if (map->concurrent == 0 &&
+      idtable_reserve(map, &map->peer_ids, map->peers_cnt) != 0) {
+    return 0;
+  }
+
+  id = map->peers_cnt + 1;
+  if (map->peers[id >> CHUNK_BITS] == NULL &&
+      (map->peers[id >> CHUNK_BITS] = malloc(sizeof(peer_t) * CHUNK_SIZE)) ==
+        NULL) {
+    return 0;
+  }
+  p = PEER(map, id);
+  memcpy(p->sig.collector_str, COLLECTOR(map, collector_id)->name,
+         sizeof(p->sig.collector_str));
+  bgpstream_addr_copy(&p->sig.peer_ip_addr, addr);
+  p->sig.peer_asnumber = peer_asnumber;
+  p->collector_id = collector_id;
+  p->hash = hash;
+
+  idtable_insert(&map->peer_ids, hash, id);
+  __atomic_store_n(&map->peers_cnt, id, __ATOMIC_RELEASE);
+  return id;
 }
 
-/** @note we do not need to take into account the peer AS number
- *  to check whether a peer differs or not */
-int bgpstream_peer_sig_equal(bgpstream_peer_sig_t *ps1,
-                             bgpstream_peer_sig_t *ps2)
+static void map_lock(bgpstream_peer_sig_map_t *map)
 {
-  return (
-    bgpstream_addr_equal(&ps1->peer_ip_addr, &ps2->peer_ip_addr) &&
-    (strcmp(ps1->collector_str, ps2->collector_str) == 0));
+  if (map->concurrent != 0) {
+    pthread_mutex_lock(&map->mutex);
+  }
 }
 
-/* PUBLIC FUNCTIONS */
+static void map_unlock(bgpstream_peer_sig_map_t *map)
+{
+  if (map->concurrent != 0) {
+    pthread_mutex_unlock(&map->mutex);
+  }
+}
 
-bgpstream_peer_sig_map_t *bgpstream_peer_sig_map_create()
+static uint16_t collector_get_id(bgpstream_peer_sig_map_t *map,
+                                 const char *name)
+{
+  uint32_t hash = collector_hash(name);
+  uint16_t id;
+
+  if ((id = collector_find(map, name, hash)) != 0) {
+    return id;
+  }
+
+  map_lock(map);
+  /* another thread may have added it in the meantime */
+  if ((id = collector_find(map, name, hash)) == 0) {
+    id = collector_add(map, name, hash);
+  }
+  map_unlock(map);
+  return id;
+}
+
+static bgpstream_peer_id_t peer_get_id(bgpstream_peer_sig_map_t *map,
+                                       uint16_t collector_id,
+                                       bgpstream_ip_addr_t *addr,
+                                       uint32_t peer_asnumber)
+{
+  uint32_t hash = peer_hash(collector_id, addr);
+  bgpstream_peer_id_t id;
+
+  if ((id = peer_find(map, collector_id, addr, hash)) != 0) {
+    return id;
+  }
+
+  map_lock(map);
+  if ((id = peer_find(map, collector_id, addr, hash)) == 0) {
+    id = peer_add(map, collector_id, addr, peer_asnumber, hash);
+  }
+  map_unlock(map);
+  return id;
+}
+
+static bgpstream_peer_sig_map_t *map_create(int concurrent)
 {
   bgpstream_peer_sig_map_t *map = NULL;
+  uint32_t size = concurrent ? TABLE_MAX_SIZE : TABLE_INIT_SIZE;
+
   if ((map = (bgpstream_peer_sig_map_t *)malloc_zero(
          sizeof(bgpstream_peer_sig_map_t))) == NULL) {
     return NULL;
   }
 
-  if ((map->ps_id = kh_init(bgpstream_peer_sig_id_map)) == NULL) {
-    goto err;
+  map->concurrent = concurrent;
+  if (concurrent) {
+    pthread_mutex_init(&map->mutex, NULL);
   }
 
-  if ((map->id_ps = kh_init(bgpstream_peer_id_sig_map)) == NULL) {
+  if (idtable_init(&map->peer_ids, size) != 0 ||
+      idtable_init(&map->collector_ids, size) != 0) {
     goto err;
   }
 
-  map->v4_next_id = IPV4_ID_OFFSET;
-  map->v6_next_id = IPV6_ID_OFFSET;
+  /* a zeroed cache must never match */
+  map->generation = 1;
 
   return map;
 
@@ -177,62 +390,119 @@ err:
   return NULL;
 }
 
+/* PUBLIC FUNCTIONS */
+
+bgpstream_peer_sig_map_t *bgpstream_peer_sig_map_create()
+{
+  return map_create(0);
+}
+
+bgpstream_peer_sig_map_t *bgpstream_peer_sig_map_create_concurrent()
+{
+  return map_create(1);
+}
+
+bgpstream_peer_id_t bgpstream_peer_sig_map_get_id_cached(
+  bgpstream_peer_sig_map_t *map, bgpstream_peer_sig_map_cache_t *cache,
+  const char *collector_str, bgpstream_ip_addr_t *peer_ip_addr,
+  uint32_t peer_asnumber)
+{
+  uint32_t generation = __atomic_load_n(&map->generation, __ATOMIC_ACQUIRE);
+  bgpstream_peer_id_t id;
+
+  if (cache->generation != generation || cache->collector_id == 0 ||
+      strncmp(cache->collector_str, collector_str, COLLECTOR_LEN) != 0) {
+    /* different collector */
+    if ((cache->collector_id = collector_get_id(map, collector_str)) == 0) {
+      cache->generation = 0;
+      return 0;
+    }
+    strncpy(cache->collector_str, collector_str, COLLECTOR_LEN);
+    cache->collector_str[COLLECTOR_LEN] = '\0';
+    cache->generation = generation;
+    cache->peer_id = 0;
+  } else if (cache->peer_id != 0 &&
+             bgpstream_addr_equal(&cache->peer_ip_addr, peer_ip_addr)) {
+    /* same peer as last time */
+    return cache->peer_id;
+  }
+
+  id = peer_get_id(map, cache->collector_id, peer_ip_addr, peer_asnumber);
+  if (id != 0) {
+    bgpstream_addr_copy(&cache->peer_ip_addr, peer_ip_addr);
+  }
+  cache->peer_id = id;
+  return id;
+}
+
 bgpstream_peer_id_t bgpstream_peer_sig_map_get_id(
   bgpstream_peer_sig_map_t *map, const char *collector_str,
   bgpstream_ip_addr_t *peer_ip_addr, uint32_t peer_asnumber)
 {
-  bgpstream_peer_sig_t *new_ps;
-  if ((new_ps = malloc(sizeof(bgpstream_peer_sig_t))) == NULL) {
-    return -1;
-  }
+  bgpstream_peer_sig_map_cache_t cache;
 
-  bgpstream_addr_copy(&new_ps->peer_ip_addr, peer_ip_addr);
-  strcpy(new_ps->collector_str, collector_str);
-  new_ps->peer_asnumber = peer_asnumber;
+  if (map->concurrent == 0) {
+    return bgpstream_peer_sig_map_get_id_cached(
+      map, &map->cache, collector_str, peer_ip_addr, peer_asnumber);
+  }
 
-  return bgpstream_peer_sig_map_set_and_get_ps(map, new_ps);
+  /* the map cache cannot be shared between threads */
+  cache.generation = 0;
+  return bgpstream_peer_sig_map_get_id_cached(map, &cache, collector_str,
+                                              peer_ip_addr, peer_asnumber);
 }
 
 bgpstream_peer_sig_t *
 bgpstream_peer_sig_map_get_sig(bgpstream_peer_sig_map_t *map,
                                bgpstream_peer_id_t id)
 {
-  bgpstream_peer_sig_t *ps = NULL;
-  khiter_t k;
-  if ((k = kh_get(bgpstream_peer_id_sig_map, map->id_ps, id)) !=
-      kh_end(map->id_ps)) {
-    ps = kh_value(map->id_ps, k);
+  if (id == 0 || id > __atomic_load_n(&map->peers_cnt, __ATOMIC_ACQUIRE)) {
+    return NULL;
   }
-  return ps;
+  return &PEER(map, id)->sig;
 }
 
 int bgpstream_peer_sig_map_get_size(bgpstream_peer_sig_map_t *map)
 {
-  assert(kh_size(map->id_ps) == kh_size(map->ps_id));
-  return kh_size(map->id_ps);
+  return __atomic_load_n(&map->peers_cnt, __ATOMIC_ACQUIRE);
 }
 
 void bgpstream_peer_sig_map_destroy(bgpstream_peer_sig_map_t *map)
 {
-  if (map != NULL) {
-    if (map->ps_id != NULL) {
-      kh_destroy(bgpstream_peer_sig_id_map, map->ps_id);
-      map->ps_id = NULL;
-    }
-    if (map->id_ps != NULL) {
-      /* only call free vals on ONE map, they are shared */
-      kh_free_vals(bgpstream_peer_id_sig_map, map->id_ps, sig_free);
-      kh_destroy(bgpstream_peer_id_sig_map, map->id_ps);
-      map->id_ps = NULL;
-    }
-    free(map);
+  int i;
+
+  if (map == NULL) {
+    return;
+  }
+
+  for (i = 0; i < CHUNK_CNT; i++) {
+    free(map->peers[i]);
+    free(map->collectors[i]);
+  }
+  free(map->peer_ids.slots);
+  free(map->collector_ids.slots);
+  if (map->concurrent) {
+    pthread_mutex_destroy(&map->mutex);
   }
+  free(map);
 }
 
 void bgpstream_peer_sig_map_clear(bgpstream_peer_sig_map_t *map)
 {
-  /* only call free vals on ONE map, they are shared */
-  kh_free_vals(bgpstream_peer_id_sig_map, map->id_ps, sig_free);
-  kh_clear(bgpstream_peer_id_sig_map, map->id_ps);
-  kh_clear(bgpstream_peer_sig_id_map, map->ps_id);
+  map_lock(map);
+
+  /* keep the chunks and tables for reuse */
+  memset(map->peer_ids.slots, 0,
+         sizeof(uint16_t) * (map->peer_ids.mask + 1));
+  memset(map->collector_ids.slots, 0,
+         sizeof(uint16_t) * (map->collector_ids.mask + 1));
+  map->peers_cnt = 0;
+  map->collectors_cnt = 0;
+
+  /* invalidate any caches (skipping the zero generation) */
+  __atomic_store_n(&map->generation,
+                   (map->generation == UINT32_MAX) ? 1 : map->generation + 1,
+                   __ATOMIC_RELEASE);
+
+  map_unlock(map);
 }
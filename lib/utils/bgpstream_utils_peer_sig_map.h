@@ -71,6 +71,33 @@ typedef struct struct_bgpstream_peer_sig_t {
 
 } bgpstream_peer_sig_t;
 
+/** Cache of the last peer looked up in a peer signature map.
+ *
+ * Consecutive elems very often come from the same peer, so a reader (or
+ * worker thread) can keep one of these and pass it to
+ * bgpstream_peer_sig_map_get_id_cached to skip the hash table lookup. A
+ * cache must be zeroed before first use, and must only be used by one thread
+ * at a time. Fields are private.
+ */
+typedef struct bgpstream_peer_sig_map_cache {
+
+  /** Generation of the map when the cache was filled */
+  uint32_t generation;
+
+  /** Interned ID of the cached collector */
+  uint16_t collector_id;
+
+  /** Name of the cached collector */
+  char collector_str[BGPSTREAM_UTILS_STR_NAME_LEN];
+
+  /** IP address of the cached peer */
+  bgpstream_ip_addr_t peer_ip_addr;
+
+  /** ID of the cached peer (0 if none) */
+  bgpstream_peer_id_t peer_id;
+
+} bgpstream_peer_sig_map_cache_t;
+
 /** @} */
 
 /**
@@ -84,6 +111,18 @@ typedef struct struct_bgpstream_peer_sig_t {
  */
 bgpstream_peer_sig_map_t *bgpstream_peer_sig_map_create(void);
 
+/** Create a new peer signature map that can be shared between threads
+ *
+ * @return a pointer to the created peer sig map if successful, NULL otherwise.
+ *
+ * Lookups (bgpstream_peer_sig_map_get_id, bgpstream_peer_sig_map_get_id_cached
+ * and bgpstream_peer_sig_map_get_sig) do not take any locks and may be made
+ * from several threads at once; only the insertion of a new peer is
+ * serialized. Clearing or destroying the map while other threads are using it
+ * is not safe.
+ */
+bgpstream_peer_sig_map_t *bgpstream_peer_sig_map_create_concurrent(void);
+
 /** Get (or set and get) the peer ID for the given peer signature
  *
  * @param map            pointer to the peer sig map to query
@@ -92,11 +131,34 @@ bgpstream_peer_sig_map_t *bgpstream_peer_sig_map_create(void);
  * @param peer_asnumber  AS number of the peer
  * @return the peer ID for this peer signature, 0 if an error occurred
  *
+ * Peers are identified by their collector and IP address. Peer IDs are
+ * assigned sequentially starting from 1, so they may be used to index a
+ * dense array. Collector names longer than BGPSTREAM_UTILS_STR_NAME_LEN-1
+ * characters are truncated.
  */
 bgpstream_peer_id_t bgpstream_peer_sig_map_get_id(
   bgpstream_peer_sig_map_t *map, const char *collector_str,
   bgpstream_ip_addr_t *peer_ip_addr, uint32_t peer_asnumber);
 
+/** Get (or set and get) the peer ID for the given peer signature, using (and
+ * updating) the given last-peer cache
+ *
+ * @param map            pointer to the peer sig map to query
+ * @param cache          pointer to a cache owned by the caller
+ * @param collector_str  string name of the collector
+ * @param peer_ip_addr   pointer to the IP address of the peer
+ * @param peer_asnumber  AS number of the peer
+ * @return the peer ID for this peer signature, 0 if an error occurred
+ *
+ * This is the same as bgpstream_peer_sig_map_get_id, but is faster when
+ * consecutive calls are for the same peer. Each thread using a concurrent map
+ * should have its own cache.
+ */
+bgpstream_peer_id_t bgpstream_peer_sig_map_get_id_cached(
+  bgpstream_peer_sig_map_t *map, bgpstream_peer_sig_map_cache_t *cache,
+  const char *collector_str, bgpstream_ip_addr_t *peer_ip_addr,
+  uint32_t peer_asnumber);
+
 /** Get the peer signature for the given peer ID
  *
  * @param map           pointer to the peer sig map to query
@@ -124,6 +186,9 @@ void bgpstream_peer_sig_map_destroy(bgpstream_peer_sig_map_t *map);
 /** Empty the given peer signature map
  *
  * @param map           peer sig map
+ *
+ * Peer IDs are reassigned from 1 after the map is cleared, and all caches
+ * used with the map are invalidated.
  */
 void bgpstream_peer_sig_map_clear(bgpstream_peer_sig_map_t *map);
 
@@ -36,24 +36,27 @@
 
 #include "khash.h"
 
+#include "bgpstream_utils_fmt.h"
 #include "bgpstream_utils_pfx.h"
 
 char *bgpstream_pfx_snprintf(char *buf, size_t len, const bgpstream_pfx_t *pfx)
 {
-  /* print the address */
-  if (bgpstream_addr_ntop(buf, len, &(pfx->address)) == NULL) {
+  char tmp[BGPSTREAM_FMT_PFX_MAX_LEN];
+  char *end;
+  size_t written;
+
+  if ((end = bgpstream_fmt_pfx(tmp, pfx)) == NULL) {
+    errno = EAFNOSUPPORT;
     return NULL;
   }
 
-  size_t written = strlen(buf);
-
-  /* print the mask length */
-  written += snprintf(buf + written, len - written, "/%" PRIu8, pfx->mask_len);
-
+  written = end - tmp;
   if (written >= len) {
     errno = ENOSPC;
     return NULL;
   }
+  memcpy(buf, tmp, written);
+  buf[written] = '\0';
   return buf;
 }
 
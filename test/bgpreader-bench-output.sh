@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Copyright (C) 2026 The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+#    this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+
+# Benchmark bgpreader's elem output (run with "make bench"): read each test
+# dump with the output formatted on the reading thread (--output-threads 0)
+# and with the output pipeline, and report elems/s. The output goes to a file,
+# so the times include writing it out.
+
+srcdir=${srcdir:-.}
+BGPREADER=${top_builddir:-..}/tools/bgpreader
+DUMPS="ris.rrc06.updates.1427846400.gz
+routeviews.route-views.jinx.updates.1427846400.bz2"
+THREADS="0 1 2 4"
+
+tmp=$(mktemp -d bgpreader-bench-output.XXXXXX) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+# time in seconds (whole seconds where date has no %N, which awk then reads
+# as the number before the dot)
+now() {
+  date +%s.%N
+}
+
+for dump in $DUMPS; do
+  echo "$dump:"
+  for threads in $THREADS; do
+    start=$(now)
+    if ! "$BGPREADER" -d singlefile -o upd-file="$srcdir/$dump" \
+         --output-threads $threads > "$tmp/out" 2> "$tmp/err"; then
+      sed 's/^/# /' "$tmp/err"
+      exit 1
+    fi
+    end=$(now)
+    elems=$(wc -l < "$tmp/out")
+    awk -v t="$threads" -v n="$elems" -v s="$start" -v e="$end" 'BEGIN {
+      d = e - s; if (d <= 0) d = 1e-9;
+      printf "  %d output threads: %d elems, %.3fs, %.0f elems/s\n",
+             t, n, d, n / d }'
+  done
+done
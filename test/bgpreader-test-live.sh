@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# Copyright (C) 2026 The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+#    this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+
+# Check that, in live mode, bgpreader's output threads write a record out even
+# though no more records follow it. The stream is a single MRT record read
+# through the singlefile data interface, which then waits for the file to
+# change, so bgpreader never reaches the end of the stream.
+
+srcdir=${srcdir:-.}
+BGPREADER=${top_builddir:-..}/tools/bgpreader
+UPDATES=$srcdir/ris.rrc06.updates.1427846400.gz
+
+# how long (sec) to wait for the record to be written
+TIMEOUT=10
+
+tmp=$(mktemp -d bgpreader-test-live.XXXXXX) || exit 99
+trap 'kill $pid 2>/dev/null; rm -rf "$tmp"' EXIT
+
+echo "# Checking section: bgpreader live output threads..."
+
+# the first record of the dump: a 12 byte MRT header holding the length of
+# the record body in its last 4 bytes (network order)
+gzip -dc "$UPDATES" | head -c 12 > "$tmp/header"
+len=$(od -An -tu1 "$tmp/header" |
+      awk '{ print ((($9 * 256) + $10) * 256 + $11) * 256 + $12 }')
+gzip -dc "$UPDATES" | head -c $((12 + len)) > "$tmp/one.mrt"
+
+if [ "$(wc -c < "$tmp/one.mrt")" -eq $((12 + len)) ]; then
+  echo "ok     1 - extract a single record"
+else
+  echo "not ok 1 - extract a single record"
+  echo "1..1"
+  exit 99
+fi
+
+"$BGPREADER" -l -d singlefile -o upd-file="$tmp/one.mrt" -r \
+             --output-threads 2 > "$tmp/out" 2> "$tmp/err" &
+pid=$!
+
+i=0
+while [ ! -s "$tmp/out" ] && [ $i -lt $((TIMEOUT * 10)) ] &&
+      kill -0 $pid 2>/dev/null; do
+  sleep 0.1
+  i=$((i + 1))
+done
+
+if [ "$(wc -l < "$tmp/out")" -eq 1 ]; then
+  echo "ok     2 - single live record written"
+  status=0
+else
+  echo "not ok 2 - single live record written"
+  sed 's/^/# /' "$tmp/err"
+  status=99
+fi
+
+if kill -0 $pid 2>/dev/null; then
+  echo "ok     3 - bgpreader still waiting for data"
+else
+  echo "not ok 3 - bgpreader still waiting for data"
+  status=99
+fi
+
+echo "1..3"
+exit $status
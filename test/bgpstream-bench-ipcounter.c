@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2026 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/* Benchmark the IP Counter on a synthetic full IPv4 table (run with "make
+ * bench"): BENCH_PFXS_CNT random unicast prefixes, 60% of them /24s, 39%
+ * /16 to /23 and 1% /8 to /15. The table is loaded with
+ * bgpstream_ip_counter_add and with bgpstream_ip_counter_add_many, and then
+ * every prefix of the table is checked with
+ * bgpstream_ip_counter_is_overlapping. */
+
+#define BENCH_PFXS_CNT 900000
+
+static bgpstream_pfx_t pfxs[BENCH_PFXS_CNT];
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int make_table()
+{
+  char buf[32];
+  uint32_t addr;
+  int i, r, len;
+
+  for (i = 0; i < BENCH_PFXS_CNT; i++) {
+    r = rand() % 100;
+    len = (r < 60) ? 24 : (r < 99) ? 16 + rand() % 8 : 8 + rand() % 8;
+    // 1.0.0.0 to 223.255.255.255
+    addr = (1 + rand() % 223) << 24 | (rand() & 0xffffff);
+    addr &= ~(uint32_t)0 << (32 - len);
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u/%d", addr >> 24,
+             (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff, len);
+    if (bgpstream_str2pfx(buf, &pfxs[i]) == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void report(const char *name, double elapsed)
+{
+  printf("  %-22s %.3fs, %.0f prefixes/s\n", name, elapsed,
+         BENCH_PFXS_CNT / (elapsed > 0 ? elapsed : 1e-9));
+}
+
+int main()
+{
+  bgpstream_ip_counter_t *ipc = NULL;
+  uint64_t add_cnt, add_many_cnt, overlap_cnt = 0;
+  uint8_t more_specific;
+  double start;
+  int i;
+
+  srand(1);
+  if (make_table() != 0 || (ipc = bgpstream_ip_counter_create()) == NULL) {
+    fprintf(stderr, "ERROR: could not prepare the IP Counter benchmark\n");
+    return -1;
+  }
+
+  printf("IP Counter (%d IPv4 prefixes):\n", BENCH_PFXS_CNT);
+
+  start = now();
+  for (i = 0; i < BENCH_PFXS_CNT; i++) {
+    if (bgpstream_ip_counter_add(ipc, &pfxs[i]) != 0) {
+      goto err;
+    }
+  }
+  add_cnt = bgpstream_ip_counter_get_ipcount(ipc, BGPSTREAM_ADDR_VERSION_IPV4);
+  report("add", now() - start);
+
+  bgpstream_ip_counter_clear(ipc);
+  start = now();
+  if (bgpstream_ip_counter_add_many(ipc, pfxs, BENCH_PFXS_CNT) != 0) {
+    goto err;
+  }
+  add_many_cnt =
+    bgpstream_ip_counter_get_ipcount(ipc, BGPSTREAM_ADDR_VERSION_IPV4);
+  report("add_many", now() - start);
+
+  start = now();
+  for (i = 0; i < BENCH_PFXS_CNT; i++) {
+    overlap_cnt +=
+      bgpstream_ip_counter_is_overlapping(ipc, &pfxs[i], &more_specific);
+  }
+  report("is_overlapping", now() - start);
+
+  if (add_cnt != add_many_cnt) {
+    fprintf(stderr, "ERROR: add and add_many counted different IPs\n");
+    goto err;
+  }
+  printf("  %" PRIu64 " IPs covered, %" PRIu64 " overlapping IPs found\n",
+         add_cnt, overlap_cnt);
+
+  bgpstream_ip_counter_destroy(ipc);
+  return 0;
+
+err:
+  bgpstream_ip_counter_destroy(ipc);
+  return -1;
+}
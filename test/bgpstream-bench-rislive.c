@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream.h"
+#include "bs_format_rislive_hex.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* Benchmark RIS Live decoding (run with "make bench"):
+ *
+ * - each hex decoding kernel on a 2 KB payload (the largest BGP messages are
+ *   4 KB), in GB/s of hex characters
+ * - the "ris-live" format, reading a file made of the messages of
+ *   ris-live-stream.json repeated many times, in messages/s (this includes
+ *   the JSON field extraction, the hex decoding and the BGP parsing) */
+
+#define BENCH_HEX_LEN 4096
+#define BENCH_HEX_SEC 0.5
+#define BENCH_MSGS_CNT 200000
+#define BENCH_INPUT_FILE "ris-live-stream.json"
+#define BENCH_TEMP_FILE "bgpstream-bench-rislive.json"
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void bench_hex_kernel(const char *name, bs_rislive_hex_func_t *func,
+                             const char *hex)
+{
+  static uint8_t buf[BENCH_HEX_LEN / 2];
+  double start = now(), elapsed;
+  uint64_t iters = 0;
+  int i;
+
+  do {
+    for (i = 0; i < 1000; i++) {
+      func(buf, hex, BENCH_HEX_LEN);
+    }
+    iters += 1000;
+  } while ((elapsed = now() - start) < BENCH_HEX_SEC);
+
+  printf("  %-10s %6.2f GB/s\n", name,
+         (double)iters * BENCH_HEX_LEN / elapsed / 1e9);
+}
+
+static void bench_hex()
+{
+  static const char digits[] = "0123456789ABCDEF";
+  static char hex[BENCH_HEX_LEN];
+  int i;
+
+  for (i = 0; i < BENCH_HEX_LEN; i++) {
+    hex[i] = digits[rand() % 16];
+  }
+
+  printf("hex decoding (%d characters):\n", BENCH_HEX_LEN);
+  bench_hex_kernel("scalar", bs_rislive_hexstr_to_bytes_scalar, hex);
+#ifdef BS_RISLIVE_HEX_SSE2
+  bench_hex_kernel("SSE2", bs_rislive_hexstr_to_bytes_sse2, hex);
+#endif
+#ifdef BS_RISLIVE_HEX_AVX2
+  if (bs_rislive_hex_have_avx2() != 0) {
+    bench_hex_kernel("AVX2", bs_rislive_hexstr_to_bytes_avx2, hex);
+  }
+#endif
+}
+
+/* write the test messages to a temporary file, until it holds at least
+ * BENCH_MSGS_CNT messages */
+static int write_messages()
+{
+  static char msgs[1 << 20];
+  size_t msgs_len, i;
+  int cnt = 0, lines_cnt = 0;
+  FILE *f;
+
+  if ((f = fopen(BENCH_INPUT_FILE, "r")) == NULL) {
+    return -1;
+  }
+  msgs_len = fread(msgs, 1, sizeof(msgs), f);
+  fclose(f);
+  for (i = 0; i < msgs_len; i++) {
+    lines_cnt += (msgs[i] == '\n');
+  }
+  if (lines_cnt == 0 || (f = fopen(BENCH_TEMP_FILE, "w")) == NULL) {
+    return -1;
+  }
+  for (cnt = 0; cnt < BENCH_MSGS_CNT; cnt += lines_cnt) {
+    fwrite(msgs, 1, msgs_len, f);
+  }
+  return (fclose(f) == 0) ? 0 : -1;
+}
+
+static int bench_format()
+{
+  bgpstream_t *bs;
+  bgpstream_data_interface_id_t di_id;
+  bgpstream_data_interface_option_t *option;
+  bgpstream_record_t *rec;
+  bgpstream_elem_t *elem;
+  uint64_t msgs_cnt = 0, elems_cnt = 0;
+  double start, elapsed;
+  int rc = -1;
+
+  if (write_messages() != 0 || (bs = bgpstream_create()) == NULL) {
+    fprintf(stderr, "ERROR: could not prepare the RIS Live benchmark\n");
+    remove(BENCH_TEMP_FILE);
+    return -1;
+  }
+  di_id = bgpstream_get_data_interface_id_by_name(bs, "singlefile");
+  bgpstream_set_data_interface(bs, di_id);
+  if ((option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, "upd-type")) == NULL ||
+      bgpstream_set_data_interface_option(bs, option, "ris-live") != 0 ||
+      (option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, "upd-file")) == NULL ||
+      bgpstream_set_data_interface_option(bs, option, BENCH_TEMP_FILE) != 0 ||
+      bgpstream_start(bs) != 0) {
+    fprintf(stderr, "ERROR: could not start the RIS Live stream\n");
+    goto done;
+  }
+
+  start = now();
+  while ((rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    msgs_cnt++;
+    while (bgpstream_record_get_next_elem(rec, &elem) > 0) {
+      elems_cnt++;
+    }
+  }
+  elapsed = now() - start;
+
+  printf("ris-live format (%" PRIu64 " messages, %" PRIu64 " elems):\n",
+         msgs_cnt, elems_cnt);
+  printf("  %.3fs, %.0f messages/s\n", elapsed,
+         msgs_cnt / (elapsed > 0 ? elapsed : 1e-9));
+
+done:
+  bgpstream_destroy(bs);
+  remove(BENCH_TEMP_FILE);
+  return rc;
+}
+
+int main()
+{
+  srand(1);
+  bench_hex();
+  return (bench_format() == 0) ? 0 : -1;
+}
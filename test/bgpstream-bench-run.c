@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/* Benchmark the push API against the pull API (run with "make bench"): read
+ * each test dump with a bgpstream_get_next_record and
+ * bgpstream_record_get_next_elem loop, and with bgpstream_run, and report
+ * elems/s for each. The elems are only counted, so that the time is spent in
+ * the library rather than in the consumer. Each way of reading is timed
+ * BENCH_RUNS times, and the fastest run is reported. */
+
+#define BENCH_RUNS 3
+
+static const char *files[] = {
+  "ris.rrc06.updates.1427846400.gz",
+  "routeviews.route-views.jinx.updates.1427846400.bz2",
+};
+
+typedef struct counts {
+  uint64_t records_cnt;
+  uint64_t elems_cnt;
+} counts_t;
+
+typedef int(read_func_t)(bgpstream_t *bs, counts_t *c);
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static bgpstream_t *create_stream(const char *file)
+{
+  bgpstream_t *bs;
+  bgpstream_data_interface_id_t di_id;
+  bgpstream_data_interface_option_t *option;
+
+  if ((bs = bgpstream_create()) == NULL) {
+    return NULL;
+  }
+  di_id = bgpstream_get_data_interface_id_by_name(bs, "singlefile");
+  bgpstream_set_data_interface(bs, di_id);
+  if ((option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, "upd-file")) == NULL ||
+      bgpstream_set_data_interface_option(bs, option, file) != 0 ||
+      bgpstream_start(bs) != 0) {
+    bgpstream_destroy(bs);
+    return NULL;
+  }
+  return bs;
+}
+
+static int read_pull(bgpstream_t *bs, counts_t *c)
+{
+  bgpstream_record_t *rec;
+  bgpstream_elem_t *elem;
+  int rc;
+
+  while ((rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    c->records_cnt++;
+    while ((rc = bgpstream_record_get_next_elem(rec, &elem)) > 0) {
+      c->elems_cnt++;
+    }
+    if (rc < 0) {
+      return -1;
+    }
+  }
+  return rc;
+}
+
+static int record_cb(bgpstream_record_t *rec, void *user)
+{
+  ((counts_t *)user)->records_cnt++;
+  return 0;
+}
+
+static int elem_cb(bgpstream_record_t *rec, bgpstream_elem_t *elem,
+                   void *user)
+{
+  ((counts_t *)user)->elems_cnt++;
+  return 0;
+}
+
+static int read_push(bgpstream_t *bs, counts_t *c)
+{
+  return bgpstream_run(bs, record_cb, elem_cb, c);
+}
+
+/* time the fastest of BENCH_RUNS reads of the file (-1 on error) */
+static double bench_read(const char *file, read_func_t *read_func,
+                         counts_t *c)
+{
+  bgpstream_t *bs;
+  double start, elapsed, best = -1;
+  int i;
+
+  for (i = 0; i < BENCH_RUNS; i++) {
+    if ((bs = create_stream(file)) == NULL) {
+      return -1;
+    }
+    c->records_cnt = c->elems_cnt = 0;
+    start = now();
+    if (read_func(bs, c) != 0) {
+      bgpstream_destroy(bs);
+      return -1;
+    }
+    elapsed = now() - start;
+    bgpstream_destroy(bs);
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return (best > 0) ? best : 1e-9;
+}
+
+int main()
+{
+  counts_t pull, push;
+  double pull_time, push_time;
+  int i;
+
+  for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+    if ((pull_time = bench_read(files[i], read_pull, &pull)) < 0 ||
+        (push_time = bench_read(files[i], read_push, &push)) < 0) {
+      fprintf(stderr, "ERROR: could not read %s\n", files[i]);
+      return -1;
+    }
+    if (push.records_cnt != pull.records_cnt ||
+        push.elems_cnt != pull.elems_cnt) {
+      fprintf(stderr, "ERROR: pull and push APIs read different streams\n");
+      return -1;
+    }
+
+    printf("%s (%" PRIu64 " records, %" PRIu64 " elems):\n", files[i],
+           pull.records_cnt, pull.elems_cnt);
+    printf("  pull: %.3fs, %.0f elems/s\n", pull_time,
+           pull.elems_cnt / pull_time);
+    printf("  push: %.3fs, %.0f elems/s (%.2fx)\n", push_time,
+           push.elems_cnt / push_time, pull_time / push_time);
+  }
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream.h"
+#include "bgpstream_test.h"
+#include "bgpstream_test_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Convert an MRT dump to the binary elem stream format, read it back with the
+ * "binary" format, and check that both streams produce the same output. */
+
+#define BINARY_TEST_MRT_FILE "ris.rrc06.updates.1427846400.gz"
+#define BINARY_TEST_BIN_FILE "bgpstream-test-binary.bsbin"
+#define BINARY_TEST_BATCH 64
+
+/* Read every record of the stream, remembering the output lines and
+ * (optionally) writing the records to the binary writer. If batch is set, the
+ * elems are extracted with bgpstream_record_get_elems */
+static int read_stream(bgpstream_t *bs, lines_t *lines,
+                       bgpstream_binary_writer_t *writer, int batch)
+{
+  bgpstream_record_t *rec;
+  bgpstream_elem_t *elems[BINARY_TEST_BATCH];
+  int rc, i;
+
+  while ((rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      continue;
+    }
+    if (writer != NULL) {
+      if (bgpstream_binary_writer_add_record(writer, rec) != 0) {
+        return -1;
+      }
+      continue;
+    }
+    if (batch == 0) {
+      rc = lines_add_record(lines, rec);
+    }
+    while (batch != 0 &&
+           (rc = bgpstream_record_get_elems(rec, elems, BINARY_TEST_BATCH)) >
+             0) {
+      for (i = 0; i < rc; i++) {
+        if (lines_add_elem(lines, rec, elems[i]) != 0) {
+          return -1;
+        }
+      }
+    }
+    if (rc < 0) {
+      return -1;
+    }
+  }
+  return rc;
+}
+
+static int test_binary_roundtrip()
+{
+  bgpstream_t *bs;
+  bgpstream_binary_writer_t *writer;
+  lines_t mrt = {0}, bin = {0}, batch = {0};
+  FILE *f;
+
+  /* collect the elems of the MRT dump */
+  CHECK_MSG("create MRT stream", "Could not read " BINARY_TEST_MRT_FILE,
+            (bs = create_file_stream("mrt", BINARY_TEST_MRT_FILE)) != NULL);
+  CHECK("read MRT stream", read_stream(bs, &mrt, NULL, 0) == 0);
+  bgpstream_destroy(bs);
+  CHECK("MRT stream has elems", mrt.lines_cnt > 0);
+
+  /* convert it to a binary elem stream */
+  CHECK_MSG("open binary file", "Could not create " BINARY_TEST_BIN_FILE,
+            (f = fopen(BINARY_TEST_BIN_FILE, "w")) != NULL);
+  CHECK_MSG("create binary writer", "Could not create binary writer",
+            (writer = bgpstream_binary_writer_create(write_file, f)) != NULL);
+  CHECK_MSG("create MRT stream", "Could not read " BINARY_TEST_MRT_FILE,
+            (bs = create_file_stream("mrt", BINARY_TEST_MRT_FILE)) != NULL);
+  CHECK("write binary stream", read_stream(bs, NULL, writer, 0) == 0);
+  CHECK("flush binary stream", bgpstream_binary_writer_flush(writer) == 0);
+  bgpstream_destroy(bs);
+  bgpstream_binary_writer_destroy(writer);
+  CHECK("close binary file", fclose(f) == 0);
+
+  /* and read it back */
+  CHECK_MSG("create binary stream", "Could not read " BINARY_TEST_BIN_FILE,
+            (bs = create_file_stream("binary", BINARY_TEST_BIN_FILE)) != NULL);
+  CHECK("read binary stream", read_stream(bs, &bin, NULL, 0) == 0);
+  bgpstream_destroy(bs);
+
+  /* the binary format fills the pooled elems in place, so batches must come
+     out the same as the borrowed elems */
+  CHECK_MSG("create binary stream", "Could not read " BINARY_TEST_BIN_FILE,
+            (bs = create_file_stream("binary", BINARY_TEST_BIN_FILE)) != NULL);
+  CHECK("read binary stream (batches)",
+        read_stream(bs, &batch, NULL, 1) == 0);
+  bgpstream_destroy(bs);
+  remove(BINARY_TEST_BIN_FILE);
+
+  CHECK("binary elems match MRT elems",
+        lines_equal(&mrt, "MRT", &bin, "binary"));
+  CHECK("batched elems match borrowed elems",
+        lines_equal(&bin, "next", &batch, "batch"));
+
+  lines_free(&mrt);
+  lines_free(&bin);
+  lines_free(&batch);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("Binary elem stream", test_binary_roundtrip() == 0);
+  ENDTEST;
+  return 0;
+}
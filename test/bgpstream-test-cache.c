@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_test_helpers.h"
+#include "bgpstream_resource.h"
+#include "bgpstream_transport.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+/* Read the test dumps through the cache transport with a tiny quota, and check
+ * that the hit/miss/eviction counters, the cache files, and the cache index
+ * agree: the least recently used files are evicted, the file just written is
+ * kept, cache files written before there was an index are found, and reads
+ * alone do not make the index grow without bound. Also check that the cache
+ * reads back what was written with each codec, that uncompressed cache files
+ * can be skipped through and lent out, and that a cache that can't be
+ * written does not stop the resource from being read. */
+
+#define CACHE_TEST_FILE_RIS "ris.rrc06.updates.1427846400.gz"
+#define CACHE_TEST_FILE_RV "routeviews.route-views.jinx.updates.1427846400.bz2"
+#define CACHE_TEST_INDEX "bgpstream-cache.index"
+#define CACHE_TEST_BUF_LEN 65536
+
+static char cache_dir[] = "cache-test.XXXXXX";
+static char buf[CACHE_TEST_BUF_LEN];
+
+static bgpstream_resource_t *create_resource(const char *url,
+                                             const char *collector)
+{
+  // a single byte: only the file most recently written fits
+  return create_cache_resource(url, collector, cache_dir, "1");
+}
+
+/* read the whole resource through the cache transport */
+static int read_resource(bgpstream_resource_t *res)
+{
+  bgpstream_transport_t *t;
+  int64_t len;
+
+  if ((t = bgpstream_transport_create(res)) == NULL) {
+    return -1;
+  }
+  while ((len = bgpstream_transport_read(t, buf, sizeof(buf))) > 0)
+    ;
+  bgpstream_transport_destroy(t);
+  return (len == 0) ? 0 : -1;
+}
+
+static int index_has_line(const char *prefix, bgpstream_resource_t *res)
+{
+  char hash[1024], path[2048], line[4096];
+  size_t len;
+  FILE *f;
+  int found = 0;
+
+  bgpstream_resource_hash_snprintf(hash, sizeof(hash), res);
+  snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_TEST_INDEX);
+  if ((f = fopen(path, "r")) == NULL) {
+    return 0;
+  }
+  len = strlen(prefix);
+  while (found == 0 && fgets(line, sizeof(line), f) != NULL) {
+    found = strncmp(line, prefix, len) == 0 &&
+            strncmp(line + len, hash, strlen(hash)) == 0 &&
+            (line[len + strlen(hash)] == ' ' ||
+             line[len + strlen(hash)] == '\n');
+  }
+  fclose(f);
+  return found;
+}
+
+static int index_lines()
+{
+  char path[2048], line[4096];
+  FILE *f;
+  int cnt = 0;
+
+  snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_TEST_INDEX);
+  if ((f = fopen(path, "r")) == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    cnt++;
+  }
+  fclose(f);
+  return cnt;
+}
+
+static int test_cache_lru()
+{
+  bgpstream_resource_t *ris, *rv;
+  bgpstream_cache_stats_t before, after;
+
+  CHECK_MSG("create resources", "Could not create resources",
+            (ris = create_resource(CACHE_TEST_FILE_RIS, "rrc06")) != NULL &&
+              (rv = create_resource(CACHE_TEST_FILE_RV, "jinx")) != NULL);
+  bgpstream_get_cache_stats(&before);
+
+  CHECK("read " CACHE_TEST_FILE_RIS, read_resource(ris) == 0);
+  CHECK("cached " CACHE_TEST_FILE_RIS, cached(cache_dir, ris));
+  CHECK("indexed " CACHE_TEST_FILE_RIS, index_has_line("+ ", ris));
+
+  CHECK("read cached " CACHE_TEST_FILE_RIS, read_resource(ris) == 0);
+  CHECK("access indexed", index_has_line("@ ", ris));
+
+  // writing the second file puts the cache over quota
+  CHECK("read " CACHE_TEST_FILE_RV, read_resource(rv) == 0);
+  CHECK("cached " CACHE_TEST_FILE_RV, cached(cache_dir, rv));
+  CHECK("evicted " CACHE_TEST_FILE_RIS, !cached(cache_dir, ris));
+  CHECK("eviction indexed", index_has_line("- ", ris));
+
+  bgpstream_get_cache_stats(&after);
+  CHECK("hit count", after.hits - before.hits == 1);
+  CHECK("miss count", after.misses - before.misses == 2);
+  CHECK("eviction count", after.evictions - before.evictions == 1);
+
+  bgpstream_resource_destroy(ris);
+  bgpstream_resource_destroy(rv);
+  return 0;
+}
+
+static int test_cache_compact()
+{
+  bgpstream_resource_t *rv;
+  char hash[1024], path[2048];
+  FILE *f;
+  int i;
+
+  CHECK_MSG("create resource", "Could not create resource",
+            (rv = create_resource(CACHE_TEST_FILE_RV, "jinx")) != NULL);
+  CHECK("cached " CACHE_TEST_FILE_RV, cached(cache_dir, rv));
+
+  // as if the file had already been read many times
+  bgpstream_resource_hash_snprintf(hash, sizeof(hash), rv);
+  snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_TEST_INDEX);
+  CHECK_MSG("open index", "Could not open index",
+            (f = fopen(path, "a")) != NULL);
+  for (i = 0; i < 2048; i++) {
+    fprintf(f, "@ %s %d\n", hash, i);
+  }
+  fclose(f);
+  CHECK("index grown", index_lines() > 2048);
+
+  CHECK("read cached " CACHE_TEST_FILE_RV, read_resource(rv) == 0);
+  CHECK("index rewritten", index_lines() > 0 && index_lines() <= 2);
+  CHECK("entry kept", index_has_line("+ ", rv) && !index_has_line("@ ", rv));
+
+  bgpstream_resource_destroy(rv);
+  return 0;
+}
+
+static int test_cache_scan()
+{
+  bgpstream_resource_t *ris, *rv;
+  char path[2048];
+  struct utimbuf old = {1, 1};
+  FILE *f;
+
+  CHECK_MSG("create resources", "Could not create resources",
+            (ris = create_resource(CACHE_TEST_FILE_RIS, "rrc06")) != NULL &&
+              (rv = create_resource(CACHE_TEST_FILE_RV, "jinx")) != NULL);
+
+  // an old cache file that was written before there was an index
+  snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_TEST_INDEX);
+  CHECK("remove index", unlink(path) == 0);
+  cache_path(path, sizeof(path), cache_dir, "test.old.updates.0.300",
+             ".cache");
+  CHECK_MSG("create old cache file", "Could not create old cache file",
+            (f = fopen(path, "w")) != NULL);
+  fputs("old", f);
+  fclose(f);
+  utime(path, &old);
+
+  CHECK("read " CACHE_TEST_FILE_RIS, read_resource(ris) == 0);
+  CHECK("cached " CACHE_TEST_FILE_RIS, cached(cache_dir, ris));
+  CHECK("evicted old file", access(path, F_OK) != 0);
+  CHECK("evicted " CACHE_TEST_FILE_RV, !cached(cache_dir, rv));
+  CHECK("index rewritten",
+        index_has_line("+ ", ris) && !index_has_line("+ ", rv));
+
+  CHECK("read " CACHE_TEST_FILE_RV, read_resource(rv) == 0);
+  CHECK("evicted " CACHE_TEST_FILE_RIS, !cached(cache_dir, ris));
+
+  cache_res_path(path, sizeof(path), cache_dir, rv, ".cache");
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_TEST_INDEX);
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/%s.lock", cache_dir, CACHE_TEST_INDEX);
+  unlink(path);
+
+  bgpstream_resource_destroy(ris);
+  bgpstream_resource_destroy(rv);
+  return 0;
+}
+
+/* The content of the RIS dump, as read through the file transport */
+#define CACHE_TEST_DATA_LEN (1024 * 1024)
+
+static uint8_t want[CACHE_TEST_DATA_LEN];
+static int64_t want_len;
+static uint8_t got[CACHE_TEST_DATA_LEN];
+
+/* read the whole resource into the given buffer, and return its length (or
+ * -1) */
+static int64_t read_all(bgpstream_resource_t *res, uint8_t *data,
+                        int64_t data_len)
+{
+  bgpstream_transport_t *t;
+  int64_t len, total = 0;
+
+  if ((t = bgpstream_transport_create(res)) == NULL) {
+    return -1;
+  }
+  while ((len = bgpstream_transport_read(t, data + total, data_len - total)) >
+         0) {
+    total += len;
+  }
+  bgpstream_transport_destroy(t);
+  return (len == 0) ? total : -1;
+}
+
+static int read_want()
+{
+  bgpstream_resource_t *res;
+
+  if ((res = bgpstream_resource_create(
+         BGPSTREAM_RESOURCE_TRANSPORT_FILE, BGPSTREAM_RESOURCE_FORMAT_MRT,
+         CACHE_TEST_FILE_RIS, 1427846400, 300, "test", "rrc06",
+         BGPSTREAM_UPDATE)) == NULL) {
+    return -1;
+  }
+  want_len = read_all(res, want, sizeof(want));
+  bgpstream_resource_destroy(res);
+  return (want_len > 0 && want_len < (int64_t)sizeof(want)) ? 0 : -1;
+}
+
+/* does the content read match the dump? */
+static int got_want(int64_t got_len)
+{
+  return got_len == want_len && memcmp(got, want, want_len) == 0;
+}
+
+/* remove the cache file of the given resource, and the index */
+static void clean_cache(bgpstream_resource_t *res)
+{
+  char path[2048];
+
+  cache_res_path(path, sizeof(path), cache_dir, res, ".cache");
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_TEST_INDEX);
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/%s.lock", cache_dir, CACHE_TEST_INDEX);
+  unlink(path);
+}
+
+/* does the cache file of the given resource start with the given bytes? */
+static int cache_file_starts_with(bgpstream_resource_t *res,
+                                  const uint8_t *magic, size_t len)
+{
+  char path[2048];
+  uint8_t head[16];
+  FILE *f;
+  size_t n;
+
+  cache_res_path(path, sizeof(path), cache_dir, res, ".cache");
+  if ((f = fopen(path, "r")) == NULL) {
+    return 0;
+  }
+  n = fread(head, 1, len, f);
+  fclose(f);
+  return n == len && memcmp(head, magic, len) == 0;
+}
+
+static const struct {
+  const char *codec;
+  const char *magic;
+  size_t len;
+} cache_codecs[] = {
+  {"raw", NULL, 0}, // the dump itself
+  {"gzip", "\x1f\x8b", 2},
+  {"lz4", "\x04\x22\x4d\x18", 4},
+  {"zstd", "\x28\xb5\x2f\xfd", 4},
+};
+
+/* write the cache with each codec, and read it back */
+static int test_cache_codecs()
+{
+  bgpstream_resource_t *res;
+  const uint8_t *magic;
+  size_t magic_len;
+  char name[256];
+  int i;
+
+  for (i = 0; i < ARR_CNT(cache_codecs); i++) {
+    CHECK_MSG("create resource", "Could not create resource",
+              (res = create_cache_resource(CACHE_TEST_FILE_RIS, "rrc06",
+                                           cache_dir, NULL)) != NULL &&
+                bgpstream_resource_set_attr(
+                  res, BGPSTREAM_RESOURCE_ATTR_CACHE_CODEC,
+                  cache_codecs[i].codec) == 0);
+
+    snprintf(name, sizeof(name), "%s cache written", cache_codecs[i].codec);
+    CHECK(name, got_want(read_all(res, got, sizeof(got))) &&
+                  cached(cache_dir, res));
+
+    // wandio knows each codec by its magic number, and takes anything else
+    // to be uncompressed
+    magic = (const uint8_t *)cache_codecs[i].magic;
+    magic_len = cache_codecs[i].len;
+    if (magic == NULL) {
+      magic = want;
+      magic_len = 16;
+    }
+    snprintf(name, sizeof(name), "%s cache file magic", cache_codecs[i].codec);
+    if (i > 1 && cache_file_starts_with(res, (const uint8_t *)"\x1f\x8b", 2)) {
+      // wandio was built without this codec
+      printf("# %s is not supported by wandio, the cache fell back to gzip\n",
+             cache_codecs[i].codec);
+    } else {
+      CHECK(name, cache_file_starts_with(res, magic, magic_len));
+    }
+
+    snprintf(name, sizeof(name), "%s cache read", cache_codecs[i].codec);
+    CHECK(name, got_want(read_all(res, got, sizeof(got))));
+
+    clean_cache(res);
+    bgpstream_resource_destroy(res);
+  }
+
+  return 0;
+}
+
+/* an uncompressed cache file is mapped, so it can be skipped through and
+ * lent out */
+static int test_cache_map()
+{
+  bgpstream_resource_t *res;
+  bgpstream_transport_t *t;
+  const uint8_t *data;
+  int64_t len, total;
+
+  CHECK_MSG("create resource", "Could not create resource",
+            (res = create_cache_resource(CACHE_TEST_FILE_RIS, "rrc06",
+                                         cache_dir, NULL)) != NULL &&
+              bgpstream_resource_set_attr(
+                res, BGPSTREAM_RESOURCE_ATTR_CACHE_CODEC, "raw") == 0);
+  CHECK("raw cache written", got_want(read_all(res, got, sizeof(got))));
+
+  // read the start, skip most of the middle, and read the end
+  CHECK_MSG("mapped cache transport", "Could not create transport",
+            (t = bgpstream_transport_create(res)) != NULL);
+  memset(got, 0, sizeof(got));
+  total = bgpstream_transport_read(t, got, 100);
+  total += bgpstream_transport_skip(t, want_len - 200);
+  while ((len = bgpstream_transport_read(t, got + total,
+                                         sizeof(got) - total)) > 0) {
+    total += len;
+  }
+  CHECK("mapped cache read and skip",
+        len == 0 && total == want_len && memcmp(got, want, 100) == 0 &&
+          memcmp(got + want_len - 100, want + want_len - 100, 100) == 0);
+  bgpstream_transport_destroy(t);
+
+  CHECK_MSG("mapped cache transport", "Could not create transport",
+            (t = bgpstream_transport_create(res)) != NULL);
+  CHECK("mapped cache can lend data", bgpstream_transport_can_borrow(t));
+  CHECK("mapped cache borrow",
+        bgpstream_transport_read(t, got, 100) == 100 &&
+          (len = bgpstream_transport_borrow(t, &data)) == want_len - 100 &&
+          memcmp(data, want + 100, len) == 0);
+  CHECK("mapped cache end", bgpstream_transport_borrow(t, &data) == 0 &&
+                              bgpstream_transport_read(t, got, 100) == 0);
+  bgpstream_transport_destroy(t);
+  clean_cache(res);
+
+  // a compressed cache file is read with wandio
+  CHECK_MSG("set codec", "Could not set codec",
+            bgpstream_resource_set_attr(
+              res, BGPSTREAM_RESOURCE_ATTR_CACHE_CODEC, "gzip") == 0);
+  CHECK("gzip cache written", got_want(read_all(res, got, sizeof(got))));
+  CHECK_MSG("gzip cache transport", "Could not create transport",
+            (t = bgpstream_transport_create(res)) != NULL);
+  CHECK("gzip cache can't lend data", !bgpstream_transport_can_borrow(t));
+  bgpstream_transport_destroy(t);
+
+  clean_cache(res);
+  bgpstream_resource_destroy(res);
+  return 0;
+}
+
+/* if the cache file can't be written, the resource is still read, but not
+ * cached */
+static int test_cache_writer_failure()
+{
+  bgpstream_resource_t *res;
+  char path[2048];
+
+  CHECK_MSG("create resource", "Could not create resource",
+            (res = create_cache_resource(CACHE_TEST_FILE_RIS, "rrc06",
+                                         cache_dir, NULL)) != NULL);
+
+  // the writer can't create its temporary file
+  cache_res_path(path, sizeof(path), cache_dir, res, ".cache.temp");
+  CHECK_MSG("block temporary file", "Could not create directory",
+            mkdir(path, 0755) == 0);
+
+  CHECK("read without cache", got_want(read_all(res, got, sizeof(got))));
+  CHECK("not cached", !cached(cache_dir, res));
+  CHECK("temporary file left alone", rmdir(path) == 0);
+  cache_res_path(path, sizeof(path), cache_dir, res, ".cache.lock");
+  CHECK("lock released", access(path, F_OK) != 0);
+
+  clean_cache(res);
+  bgpstream_resource_destroy(res);
+  return 0;
+}
+
+int main()
+{
+  CHECK_MSG("create cache directory", "Could not create cache directory",
+            mkdtemp(cache_dir) != NULL);
+
+  CHECK_SECTION("Cache LRU eviction", test_cache_lru() == 0);
+  CHECK_SECTION("Cache index compaction", test_cache_compact() == 0);
+  CHECK_SECTION("Cache index rebuild", test_cache_scan() == 0);
+
+  CHECK_MSG("read test data", "Could not read " CACHE_TEST_FILE_RIS,
+            read_want() == 0);
+  CHECK_SECTION("Cache codecs", test_cache_codecs() == 0);
+  CHECK_SECTION("Cache mapped file", test_cache_map() == 0);
+  CHECK_SECTION("Cache writer failure", test_cache_writer_failure() == 0);
+
+  CHECK("cache directory cleaned up", rmdir(cache_dir) == 0);
+  ENDTEST;
+}
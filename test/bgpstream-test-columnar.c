@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream.h"
+#include "bgpstream_test.h"
+#include "bgpstream_test_helpers.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Convert an MRT dump to a columnar elem archive (uncompressed, and with each
+ * codec that this build supports), read it back with the "columnar" format
+ * (with and without filters, so that row groups are skipped), and check that
+ * it produces the same output as the MRT dump. */
+
+#define COLUMNAR_TEST_MRT_FILE "ris.rrc06.updates.1427846400.gz"
+#define COLUMNAR_TEST_COL_FILE "bgpstream-test-columnar.bscol"
+
+/* use short windows, so that the archive has several row groups */
+#define COLUMNAR_TEST_WINDOW 60
+
+typedef struct filter {
+  const char *filter;
+  uint32_t begin_time;
+  uint32_t end_time;
+} filter_t;
+
+static filter_t filters[] = {
+  {NULL, 0, BGPSTREAM_FOREVER},
+  {NULL, 1427846400 + 60, 1427846400 + 180},
+  {"peer 25152", 0, BGPSTREAM_FOREVER},
+  {"origin 15169", 0, BGPSTREAM_FOREVER},
+  {"prefix more 192.0.0.0/8", 0, BGPSTREAM_FOREVER},
+  {"ipversion 6", 0, BGPSTREAM_FOREVER},
+  {"elemtype withdrawals", 0, BGPSTREAM_FOREVER},
+  {"type ribs", 0, BGPSTREAM_FOREVER},
+};
+
+/* Create and start a stream that reads a single file of the given format,
+ * with the given filters */
+static bgpstream_t *create_filtered_stream(const char *type, const char *file,
+                                           filter_t *filter)
+{
+  const char *opts[] = {"upd-type", type, "upd-file", file, NULL};
+  return create_stream("singlefile", opts, filter->filter, filter->begin_time,
+                       filter->end_time);
+}
+
+/* Read every record of the stream, remembering the output lines and
+ * (optionally) writing the records to the columnar writer */
+static int read_stream(bgpstream_t *bs, lines_t *lines,
+                       bgpstream_columnar_writer_t *writer)
+{
+  bgpstream_record_t *rec;
+  int rc;
+
+  while ((rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      continue;
+    }
+    if (writer != NULL) {
+      if (bgpstream_columnar_writer_add_record(writer, rec) != 0) {
+        return -1;
+      }
+      continue;
+    }
+    if (lines_add_record(lines, rec) < 0) {
+      return -1;
+    }
+  }
+  return rc;
+}
+
+static int test_columnar_roundtrip(bgpstream_columnar_codec_t codec)
+{
+  bgpstream_t *bs;
+  bgpstream_columnar_writer_t *writer;
+  lines_t mrt = {0}, col = {0};
+  FILE *f;
+  int i, same;
+
+  /* convert the MRT dump to a columnar elem archive */
+  CHECK_MSG("open columnar file", "Could not create " COLUMNAR_TEST_COL_FILE,
+            (f = fopen(COLUMNAR_TEST_COL_FILE, "w")) != NULL);
+  CHECK_MSG("create columnar writer", "Could not create columnar writer",
+            (writer = bgpstream_columnar_writer_create(
+               write_file, f, COLUMNAR_TEST_WINDOW)) != NULL);
+  if (bgpstream_columnar_writer_set_codec(writer, codec) != 0) {
+    printf("# codec %d not supported by this build, skipping\n", codec);
+    bgpstream_columnar_writer_destroy(writer);
+    fclose(f);
+    remove(COLUMNAR_TEST_COL_FILE);
+    return 0;
+  }
+  CHECK_MSG("create MRT stream", "Could not read " COLUMNAR_TEST_MRT_FILE,
+            (bs = create_file_stream("mrt", COLUMNAR_TEST_MRT_FILE)) != NULL);
+  CHECK("write columnar archive", read_stream(bs, NULL, writer) == 0);
+  CHECK("flush columnar archive", bgpstream_columnar_writer_flush(writer) == 0);
+  bgpstream_destroy(bs);
+  bgpstream_columnar_writer_destroy(writer);
+  CHECK("close columnar file", fclose(f) == 0);
+
+  /* read both back with each set of filters, and compare the elems */
+  same = 1;
+  for (i = 0; i < (int)(sizeof(filters) / sizeof(filters[0])); i++) {
+    CHECK_MSG("create MRT stream", "Could not read " COLUMNAR_TEST_MRT_FILE,
+              (bs = create_filtered_stream("mrt", COLUMNAR_TEST_MRT_FILE,
+                                           &filters[i])) != NULL);
+    CHECK("read MRT stream", read_stream(bs, &mrt, NULL) == 0);
+    bgpstream_destroy(bs);
+    if (i == 0) {
+      CHECK("MRT stream has elems", mrt.lines_cnt > 0);
+    }
+
+    CHECK_MSG("create columnar stream",
+              "Could not read " COLUMNAR_TEST_COL_FILE,
+              (bs = create_filtered_stream("columnar", COLUMNAR_TEST_COL_FILE,
+                                           &filters[i])) != NULL);
+    CHECK("read columnar stream", read_stream(bs, &col, NULL) == 0);
+    bgpstream_destroy(bs);
+
+    if (lines_equal(&mrt, "MRT", &col, "columnar") == 0) {
+      printf("# with filter '%s' (interval %" PRIu32 "-%" PRIu32 ")\n",
+             filters[i].filter != NULL ? filters[i].filter : "",
+             filters[i].begin_time, filters[i].end_time);
+      same = 0;
+    }
+    lines_free(&mrt);
+    lines_free(&col);
+  }
+  remove(COLUMNAR_TEST_COL_FILE);
+  CHECK("columnar elems match MRT elems", same);
+
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("Columnar elem archive",
+                test_columnar_roundtrip(BGPSTREAM_COLUMNAR_CODEC_NONE) == 0);
+  CHECK_SECTION("Columnar elem archive (zstd)",
+                test_columnar_roundtrip(BGPSTREAM_COLUMNAR_CODEC_ZSTD) == 0);
+  CHECK_SECTION("Columnar elem archive (lz4)",
+                test_columnar_roundtrip(BGPSTREAM_COLUMNAR_CODEC_LZ4) == 0);
+  ENDTEST;
+  return 0;
+}
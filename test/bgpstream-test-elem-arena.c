@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_utils_as_path_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_TEST_ELEMS_CNT 50000
+#define ARENA_TEST_ASNS_CNT 8
+#define ARENA_TEST_COMMS_CNT 4
+
+static void populate_elem(bgpstream_elem_t *elem, uint32_t i)
+{
+  uint32_t asns[ARENA_TEST_ASNS_CNT];
+  bgpstream_community_t comms[ARENA_TEST_COMMS_CNT];
+  int j;
+
+  bgpstream_elem_clear(elem);
+  elem->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  elem->peer_asn = i;
+  bgpstream_str2pfx("192.0.2.0/24", &elem->prefix);
+
+  // vary the path and community lengths with i
+  for (j = 0; j < ARENA_TEST_ASNS_CNT; j++) {
+    asns[j] = i + j;
+  }
+  bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN, asns,
+                           1 + (i % ARENA_TEST_ASNS_CNT));
+  for (j = 0; j < ARENA_TEST_COMMS_CNT; j++) {
+    comms[j].asn = i & 0xffff;
+    comms[j].value = j;
+  }
+  bgpstream_community_set_populate_from_array(elem->communities, comms,
+                                              i % (ARENA_TEST_COMMS_CNT + 1));
+}
+
+static int elem_equal(bgpstream_elem_t *a, bgpstream_elem_t *b)
+{
+  return a->type == b->type && a->peer_asn == b->peer_asn &&
+         bgpstream_pfx_equal(&a->prefix, &b->prefix) &&
+         bgpstream_as_path_equal(a->as_path, b->as_path) &&
+         bgpstream_community_set_equal(a->communities, b->communities);
+}
+
+static int test_elem_arena()
+{
+  bgpstream_elem_arena_t *arena;
+  bgpstream_elem_t *elem, *expect;
+  bgpstream_elem_t **copies;
+  void *first;
+  uint32_t i;
+  int ok;
+
+  CHECK("Create elem arena", (arena = bgpstream_elem_arena_create()) != NULL);
+  CHECK("Create elems", (elem = bgpstream_elem_create()) != NULL &&
+                          (expect = bgpstream_elem_create()) != NULL);
+  CHECK("Allocate copy array",
+        (copies = malloc(sizeof(*copies) * ARENA_TEST_ELEMS_CNT)) != NULL);
+
+  // the source elem is reused for every copy, as when reading records
+  ok = 1;
+  for (i = 0; i < ARENA_TEST_ELEMS_CNT; i++) {
+    populate_elem(elem, i);
+    if ((copies[i] = bgpstream_elem_arena_copy(arena, elem)) == NULL) {
+      ok = 0;
+      break;
+    }
+  }
+  CHECK("Elem arena copy", ok);
+  CHECK("Elem arena count",
+        bgpstream_elem_arena_get_elems_cnt(arena) == ARENA_TEST_ELEMS_CNT);
+
+  ok = 1;
+  for (i = 0; i < ARENA_TEST_ELEMS_CNT; i++) {
+    populate_elem(expect, i);
+    if (!elem_equal(copies[i], expect) ||
+        bgpstream_community_set_size(copies[i]->communities) !=
+          (int)(i % (ARENA_TEST_COMMS_CNT + 1))) {
+      ok = 0;
+      break;
+    }
+  }
+  CHECK("Elem arena copies unchanged", ok);
+
+  first = copies[0];
+  bgpstream_elem_arena_reset(arena);
+  CHECK("Elem arena reset",
+        bgpstream_elem_arena_get_elems_cnt(arena) == 0 &&
+          bgpstream_elem_arena_get_used_size(arena) == 0);
+
+  populate_elem(elem, 1);
+  CHECK("Elem arena copy after reset",
+        (copies[0] = bgpstream_elem_arena_copy(arena, elem)) == first &&
+          elem_equal(copies[0], elem));
+
+  bgpstream_elem_destroy(elem);
+  bgpstream_elem_destroy(expect);
+  free(copies);
+  bgpstream_elem_arena_destroy(arena);
+
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("Elem Arena", test_elem_arena() == 0);
+  ENDTEST;
+  return 0;
+}
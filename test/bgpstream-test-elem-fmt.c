@@ -0,0 +1,556 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_utils_as_path_int.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Check that the formatting functions produce exactly the same output as
+ * straightforward reference implementations built on snprintf and inet_ntop
+ * (i.e., the way they used to be implemented). */
+
+#define FMT_TEST_ELEMS_CNT 20000
+#define FMT_TEST_BUF_LEN 8192
+
+typedef struct ref_buf {
+  char buf[FMT_TEST_BUF_LEN];
+  size_t len;
+} ref_buf_t;
+
+static void ref_reset(ref_buf_t *ref)
+{
+  ref->len = 0;
+  ref->buf[0] = '\0';
+}
+
+static void ref_printf(ref_buf_t *ref, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  ref->len += vsnprintf(ref->buf + ref->len, sizeof(ref->buf) - ref->len, fmt,
+                        ap);
+  va_end(ap);
+}
+
+/* returns 0 if the address could not be converted */
+static int ref_addr(ref_buf_t *ref, const bgpstream_ip_addr_t *addr)
+{
+  char tmp[INET6_ADDRSTRLEN];
+
+  if (inet_ntop(addr->version, &addr->addr, tmp, sizeof(tmp)) == NULL) {
+    return 0;
+  }
+  ref_printf(ref, "%s", tmp);
+  return 1;
+}
+
+static int ref_pfx(ref_buf_t *ref, const bgpstream_pfx_t *pfx)
+{
+  if (ref_addr(ref, &pfx->address) == 0) {
+    return 0;
+  }
+  ref_printf(ref, "/%" PRIu8, pfx->mask_len);
+  return 1;
+}
+
+static void ref_seg(ref_buf_t *ref, const bgpstream_as_path_seg_t *seg)
+{
+  const char *chars;
+  int i;
+
+  switch (seg->type) {
+  case BGPSTREAM_AS_PATH_SEG_ASN:
+    ref_printf(ref, "%" PRIu32, seg->asn.asn);
+    return;
+  case BGPSTREAM_AS_PATH_SEG_SET:
+    chars = "{,}";
+    break;
+  case BGPSTREAM_AS_PATH_SEG_CONFED_SEQ:
+    chars = "( )";
+    break;
+  case BGPSTREAM_AS_PATH_SEG_CONFED_SET:
+    chars = "[,]";
+    break;
+  default:
+    chars = "< >";
+    break;
+  }
+  ref_printf(ref, "%c", chars[0]);
+  for (i = 0; i < seg->set.asn_cnt; i++) {
+    if (i > 0) {
+      ref_printf(ref, "%c", chars[1]);
+    }
+    ref_printf(ref, "%" PRIu32, seg->set.asn[i]);
+  }
+  ref_printf(ref, "%c", chars[2]);
+}
+
+static void ref_path(ref_buf_t *ref, bgpstream_as_path_t *path)
+{
+  bgpstream_as_path_iter_t iter;
+  bgpstream_as_path_seg_t *seg;
+  int first = 1;
+
+  bgpstream_as_path_iter_reset(&iter);
+  while ((seg = bgpstream_as_path_get_next_seg(path, &iter)) != NULL) {
+    if (first == 0) {
+      ref_printf(ref, " ");
+    }
+    first = 0;
+    ref_seg(ref, seg);
+  }
+}
+
+static void ref_comms(ref_buf_t *ref, const bgpstream_community_set_t *set)
+{
+  const bgpstream_community_t *c;
+  int i;
+
+  for (i = 0; i < bgpstream_community_set_size(set); i++) {
+    c = bgpstream_community_set_get(set, i);
+    ref_printf(ref, "%s%" PRIu16 ":%" PRIu16, (i > 0) ? " " : "", c->asn,
+               c->value);
+  }
+}
+
+static const char *ref_state(bgpstream_elem_peerstate_t state)
+{
+  static const char *names[] = {"",         "IDLE",        "CONNECT",
+                                "ACTIVE",   "OPENSENT",    "OPENCONFIRM",
+                                "ESTABLISHED", "CLEARING", "DELETED"};
+  return ((unsigned)state < 9) ? names[state] : "";
+}
+
+static const char *ref_elem_type(bgpstream_elem_type_t type)
+{
+  switch (type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+    return "R";
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    return "A";
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    return "W";
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    return "S";
+  default:
+    return "";
+  }
+}
+
+/* returns 0 if the elem is malformed */
+static int ref_elem(ref_buf_t *ref, bgpstream_elem_t *elem)
+{
+  bgpstream_as_path_seg_t *seg;
+
+  ref_printf(ref, "%" PRIu32 "|", elem->peer_asn);
+  ref_addr(ref, &elem->peer_ip);
+  ref_printf(ref, "|");
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    if (ref_pfx(ref, &elem->prefix) == 0) {
+      return 0;
+    }
+    ref_printf(ref, "|");
+    ref_addr(ref, &elem->nexthop);
+    ref_printf(ref, "|");
+    ref_path(ref, elem->as_path);
+    ref_printf(ref, "|");
+    if ((seg = bgpstream_as_path_get_origin_seg(elem->as_path)) != NULL) {
+      ref_seg(ref, seg);
+    }
+    ref_printf(ref, "|");
+    ref_comms(ref, elem->communities);
+    ref_printf(ref, "||");
+    return 1;
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    if (ref_pfx(ref, &elem->prefix) == 0) {
+      return 0;
+    }
+    ref_printf(ref, "|||||");
+    return 1;
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    ref_printf(ref, "|||||%s|%s", ref_state(elem->old_state),
+               ref_state(elem->new_state));
+    return 1;
+
+  default:
+    return 0;
+  }
+}
+
+static int ref_bgpdump(ref_buf_t *ref, bgpstream_record_t *record,
+                       bgpstream_elem_t *elem)
+{
+  static const char *origins[] = {"IGP", "EGP", "INCOMPLETE"};
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+    ref_printf(ref, "TABLE_DUMP2|%" PRIu32 "|B|", record->time_sec);
+    break;
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    ref_printf(ref, "BGP4MP|%" PRIu32 "|A|", record->time_sec);
+    break;
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    ref_printf(ref, "BGP4MP|%" PRIu32 "|W|", record->time_sec);
+    break;
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    ref_printf(ref, "BGP4MP|%" PRIu32 "|STATE|", record->time_sec);
+    break;
+  default:
+    ref_printf(ref, "||");
+    break;
+  }
+  if (ref_addr(ref, &elem->peer_ip) == 0) {
+    return 0;
+  }
+  ref_printf(ref, "|%" PRIu32 "|", elem->peer_asn);
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    if (ref_pfx(ref, &elem->prefix) == 0) {
+      return 0;
+    }
+    ref_printf(ref, "|");
+    ref_path(ref, elem->as_path);
+    ref_printf(ref, "|%s|",
+               ((unsigned)elem->origin < 3) ? origins[elem->origin] : "");
+    if (ref_addr(ref, &elem->nexthop) == 0) {
+      return 0;
+    }
+    ref_printf(ref, "|%" PRIu32 "|%" PRIu32 "|", elem->local_pref, elem->med);
+    ref_comms(ref, elem->communities);
+    ref_printf(ref, "|%s|", (elem->atomic_aggregate == 1) ? "AG" : "NAG");
+    if (elem->aggregator.has_aggregator > 0) {
+      ref_printf(ref, "%" PRIu32 " ", elem->aggregator.aggregator_asn);
+      if (ref_addr(ref, &elem->aggregator.aggregator_addr) == 0) {
+        return 0;
+      }
+    }
+    ref_printf(ref, "|");
+    break;
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    if (ref_pfx(ref, &elem->prefix) == 0) {
+      return 0;
+    }
+    break;
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    ref_printf(ref, "%u|%u", elem->old_state, elem->new_state);
+    break;
+  default:
+    break;
+  }
+  return 1;
+}
+
+/* ---------- random test data ---------- */
+
+static uint32_t rand_u32()
+{
+  // favor edge values, and short numbers
+  switch (rand() % 8) {
+  case 0:
+    return 0;
+  case 1:
+    return UINT32_MAX;
+  case 2:
+    return rand() % 10;
+  case 3:
+    return rand() % 100000;
+  default:
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+  }
+}
+
+static void rand_addr(bgpstream_ip_addr_t *addr)
+{
+  uint8_t *bytes;
+  int i;
+
+  switch (rand() % 10) {
+  case 0:
+    // missing address
+    memset(addr, 0, sizeof(*addr));
+    return;
+
+  case 1:
+  case 2:
+  case 3:
+  case 4:
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV4;
+    bytes = (uint8_t *)&addr->bs_ipv4.addr;
+    for (i = 0; i < 4; i++) {
+      bytes[i] = (rand() % 4 == 0) ? 0 : rand();
+    }
+    return;
+
+  default:
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV6;
+    bytes = (uint8_t *)&addr->bs_ipv6.addr;
+    // lots of zero words, to exercise "::" compression
+    for (i = 0; i < 16; i += 2) {
+      if (rand() % 2 == 0) {
+        bytes[i] = bytes[i + 1] = 0;
+      } else {
+        bytes[i] = (rand() % 3 == 0) ? 0 : rand();
+        bytes[i + 1] = rand();
+      }
+    }
+    switch (rand() % 6) {
+    case 0:
+      // IPv4-mapped
+      memset(bytes, 0, 10);
+      bytes[10] = bytes[11] = 0xff;
+      break;
+    case 1:
+      // IPv4-compatible
+      memset(bytes, 0, 12);
+      break;
+    case 2:
+      // all zero
+      memset(bytes, 0, 16);
+      break;
+    }
+    return;
+  }
+}
+
+static void rand_elem(bgpstream_elem_t *elem)
+{
+  uint32_t asns[8];
+  bgpstream_community_t comms[6];
+  int segs_cnt, cnt, i, j;
+
+  bgpstream_elem_clear(elem);
+
+  // mostly valid types, and the occasional invalid one
+  elem->type = (rand() % 64 == 0) ? 5 : 1 + rand() % 4;
+  elem->peer_asn = rand_u32();
+  rand_addr(&elem->peer_ip);
+  do {
+    rand_addr(&elem->prefix.address);
+  } while (rand() % 8 != 0 && elem->prefix.address.version == 0);
+  elem->prefix.mask_len = rand() % 129;
+  rand_addr(&elem->nexthop);
+
+  segs_cnt = rand() % 8;
+  for (i = 0; i < segs_cnt; i++) {
+    cnt = 1 + rand() % 8;
+    for (j = 0; j < cnt; j++) {
+      asns[j] = rand_u32();
+    }
+    bgpstream_as_path_append(elem->as_path,
+                             (rand() % 4 == 0) ? 2 + rand() % 3
+                                               : BGPSTREAM_AS_PATH_SEG_ASN,
+                             asns, cnt);
+  }
+
+  cnt = rand() % 6;
+  for (i = 0; i < cnt; i++) {
+    comms[i].asn = rand_u32();
+    comms[i].value = rand_u32();
+  }
+  bgpstream_community_set_populate_from_array(elem->communities, comms, cnt);
+
+  elem->old_state = rand() % 10;
+  elem->new_state = rand() % 10;
+  elem->origin = rand() % 4;
+  elem->med = rand_u32();
+  elem->local_pref = rand_u32();
+  elem->atomic_aggregate = rand() % 2;
+  elem->aggregator.has_aggregator = rand() % 2;
+  elem->aggregator.aggregator_asn = rand_u32();
+  rand_addr(&elem->aggregator.aggregator_addr);
+}
+
+static void rand_record(bgpstream_record_t *record)
+{
+  record->type = rand() % 3;
+  record->time_sec = rand_u32();
+  record->time_usec = (rand() % 8 == 0) ? rand_u32() : rand() % 1000000;
+  snprintf(record->project_name, sizeof(record->project_name), "%s",
+           (rand() % 2) ? "routeviews" : "ris");
+  snprintf(record->collector_name, sizeof(record->collector_name), "rrc%02d",
+           rand() % 30);
+  snprintf(record->router_name, sizeof(record->router_name), "%s",
+           (rand() % 2) ? "" : "router");
+  do {
+    rand_addr(&record->router_ip);
+  } while (rand() % 8 != 0 && record->router_ip.version == 0);
+}
+
+/* ---------- tests ---------- */
+
+/* check that fmt matches the reference, and that it is correctly truncated
+   (and reports the truncation) for all shorter buffers */
+#define CHECK_FMT_TRUNC(call, ref_ok, ref)                                     \
+  do {                                                                         \
+    size_t _len;                                                               \
+    char *_ret;                                                                \
+    _ret = (call(buf, sizeof(buf)));                                           \
+    if ((_ret == NULL) != ((ref_ok) == 0) ||                                   \
+        (_ret != NULL && strcmp(buf, (ref)->buf) != 0)) {                      \
+      fprintf(stderr, "# got '%s'\n# exp '%s'\n", _ret ? buf : "(null)",      \
+              (ref_ok) ? (ref)->buf : "(null)");                               \
+      ok = 0;                                                                  \
+      break;                                                                   \
+    }                                                                          \
+    for (_len = 1; (ref_ok) && trunc && _len <= (ref)->len + 1; _len++) {     \
+      _ret = call(buf, _len);                                                  \
+      if ((_len <= (ref)->len) != (_ret == NULL) ||                            \
+          strncmp(buf, (ref)->buf, _len - 1) != 0 ||                           \
+          strlen(buf) != ((_len <= (ref)->len) ? _len - 1 : (ref)->len)) {     \
+        ok = 0;                                                                \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+static int test_elem_fmt()
+{
+  bgpstream_elem_t *elem;
+  bgpstream_record_t record;
+  char buf[FMT_TEST_BUF_LEN];
+  ref_buf_t ref;
+  int ref_ok, trunc, i;
+  int ok = 1;
+
+  srand(42);
+  memset(&record, 0, sizeof(record));
+  CHECK("Create elem", (elem = bgpstream_elem_create()) != NULL);
+
+#define ELEM_SNPRINTF(b, l) bgpstream_elem_snprintf(b, l, elem)
+#define RECORD_ELEM_SNPRINTF(b, l)                                             \
+  bgpstream_record_elem_snprintf(b, l, &record, elem)
+#define BGPDUMP_SNPRINTF(b, l)                                                 \
+  bgpstream_record_elem_bgpdump_snprintf(b, l, &record, elem)
+
+  for (i = 0; ok && i < FMT_TEST_ELEMS_CNT; i++) {
+    rand_elem(elem);
+    rand_record(&record);
+    // truncation is slow to check, so only do it for some elems
+    trunc = (i % 50 == 0);
+
+    /* elem */
+    ref_reset(&ref);
+    ref_printf(&ref, "%s|", ref_elem_type(elem->type));
+    ref_ok = ref_elem(&ref, elem);
+    CHECK_FMT_TRUNC(ELEM_SNPRINTF, ref_ok, &ref);
+
+    /* record elem */
+    ref_reset(&ref);
+    ref_printf(&ref, "%s|%s|%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
+               (record.type == BGPSTREAM_RIB)
+                 ? "R"
+                 : (record.type == BGPSTREAM_UPDATE) ? "U" : "",
+               ref_elem_type(elem->type), record.time_sec, record.time_usec,
+               record.project_name, record.collector_name, record.router_name);
+    ref_ok = 1;
+    if (record.router_ip.version != 0) {
+      ref_ok = ref_addr(&ref, &record.router_ip);
+    }
+    ref_printf(&ref, "|");
+    ref_ok = ref_ok && ref_elem(&ref, elem);
+    CHECK_FMT_TRUNC(RECORD_ELEM_SNPRINTF, ref_ok, &ref);
+
+    /* bgpdump */
+    ref_reset(&ref);
+    ref_ok = ref_bgpdump(&ref, &record, elem);
+    CHECK_FMT_TRUNC(BGPDUMP_SNPRINTF, ref_ok, &ref);
+  }
+  CHECK("Elem formatting matches reference", ok);
+
+  bgpstream_elem_destroy(elem);
+  return 0;
+}
+
+static int test_utils_fmt()
+{
+  bgpstream_elem_t *elem;
+  char buf[FMT_TEST_BUF_LEN];
+  ref_buf_t ref;
+  size_t len;
+  int i, ret;
+  int ok = 1;
+
+  srand(4242);
+  CHECK("Create elem", (elem = bgpstream_elem_create()) != NULL);
+
+  for (i = 0; ok && i < FMT_TEST_ELEMS_CNT; i++) {
+    rand_elem(elem);
+
+    /* prefix */
+    ref_reset(&ref);
+    if (ref_pfx(&ref, &elem->prefix) !=
+          (bgpstream_pfx_snprintf(buf, sizeof(buf), &elem->prefix) != NULL) ||
+        (ref.len > 0 && strcmp(buf, ref.buf) != 0)) {
+      ok = 0;
+    }
+
+    /* as path, with all buffer lengths */
+    ref_reset(&ref);
+    ref_path(&ref, elem->as_path);
+    for (len = 0; ok && len <= ref.len + 1; len++) {
+      ret = bgpstream_as_path_snprintf(buf, len, elem->as_path);
+      if (ret != (int)ref.len ||
+          (len > 0 && (strncmp(buf, ref.buf, len - 1) != 0 ||
+                       strlen(buf) != ((len <= ref.len) ? len - 1 : ref.len)))) {
+        ok = 0;
+      }
+    }
+
+    /* communities */
+    ref_reset(&ref);
+    ref_comms(&ref, elem->communities);
+    if (bgpstream_community_set_snprintf(buf, sizeof(buf),
+                                         elem->communities) != (int)ref.len ||
+        strcmp(buf, ref.buf) != 0) {
+      ok = 0;
+    }
+  }
+  CHECK("Utils formatting matches reference", ok);
+
+  bgpstream_elem_destroy(elem);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("Utils formatting", test_utils_fmt() == 0);
+  CHECK_SECTION("Elem formatting", test_elem_fmt() == 0);
+  ENDTEST;
+  return 0;
+}
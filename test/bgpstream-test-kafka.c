@@ -0,0 +1,493 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream.h"
+#include "bgpstream_test.h"
+#include "bgpstream_test_helpers.h"
+#include "bgpstream_test_kafka_mock.h"
+#include "bgpstream_resource.h"
+#include "bgpstream_transport.h"
+#include "utils.h"
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Read from Kafka consumers backed by the in-memory queues of the mock. Check
+ * that messages consumed in batches are split into lines, read, and lent out
+ * correctly, and that the descriptor the transport gives the resource manager
+ * becomes readable whenever data arrives, so that a waiting stream wakes up at
+ * once rather than on its next poll. Also check that the records of several
+ * consumers are merged in time order, and that an idle consumer only holds
+ * back the others for max-lateness. */
+
+#define KAFKA_TEST_RISLIVE_FILE "ris-live-stream.json"
+#define KAFKA_TEST_RISLIVE_CNT 7
+
+/* more messages than the transport consumes in one batch */
+#define KAFKA_TEST_MSG_CNT 1000
+
+/* how long (msec) the producer waits before adding data */
+#define KAFKA_TEST_DELAY 700
+
+/* how long (msec) a woken stream may take to return the new data. streams
+ * that are not woken are polled every 500 msec, so would take at least
+ * 1000 - KAFKA_TEST_DELAY */
+#define KAFKA_TEST_MAX_LATENCY 200
+
+/* how long (msec) an idle consumer may hold back the other one */
+#define KAFKA_TEST_MAX_LATENESS 300
+
+/* the time of the first record of the merge test */
+#define KAFKA_TEST_MERGE_TIME 1553627987
+
+/* a stream that never gets the data it expects would hang rather than fail */
+#define KAFKA_TEST_TIMEOUT 300
+
+static char buf[65536];
+
+static bgpstream_transport_t *create_transport(bgpstream_resource_t **res)
+{
+  bgpstream_transport_t *t;
+
+  if ((*res = bgpstream_resource_create(
+         BGPSTREAM_RESOURCE_TRANSPORT_KAFKA, BGPSTREAM_RESOURCE_FORMAT_RISLIVE,
+         "mock:9092", 0, BGPSTREAM_FOREVER, "test", "test",
+         BGPSTREAM_UPDATE)) == NULL) {
+    return NULL;
+  }
+  if (bgpstream_resource_set_attr(*res, BGPSTREAM_RESOURCE_ATTR_KAFKA_TOPICS,
+                                  "test") != 0 ||
+      (t = bgpstream_transport_create(*res)) == NULL) {
+    bgpstream_resource_destroy(*res);
+    return NULL;
+  }
+  return t;
+}
+
+/* Is the descriptor readable within timeout msec? */
+static int readable(int fd, int timeout)
+{
+  struct pollfd pfd = {fd, POLLIN, 0};
+  return poll(&pfd, 1, timeout) == 1 && (pfd.revents & POLLIN) != 0;
+}
+
+/* Does the next readline return the given line? */
+static int next_line_is(bgpstream_transport_t *t, int64_t len,
+                        const char *expected)
+{
+  int64_t n = bgpstream_transport_readline(t, buf, len);
+
+  if (n != (int64_t)strlen(expected) || strcmp(buf, expected) != 0) {
+    printf("# got line %" PRId64 " '%s', expected '%s'\n", n,
+           (n > 0) ? (char *)buf : "", expected);
+    return 0;
+  }
+  return 1;
+}
+
+static int test_kafka_batches()
+{
+  bgpstream_resource_t *res;
+  bgpstream_transport_t *t;
+  const uint8_t *lent, *lent2;
+  char line[64];
+  int destroyed;
+  int consumed;
+  int i;
+
+  mock_kafka_reset();
+  CHECK("Kafka transport create", (t = create_transport(&res)) != NULL);
+
+  // a message may hold several lines, and ends the line it finishes in
+  mock_kafka_produce_str(0, "one\ntwo\n\nthree");
+  mock_kafka_produce_str(0, "four\n");
+  mock_kafka_produce_str(0, "five");
+  CHECK("Kafka lines split across messages",
+        next_line_is(t, sizeof(buf), "one") &&
+          next_line_is(t, sizeof(buf), "two") &&
+          next_line_is(t, sizeof(buf), "three") &&
+          next_line_is(t, sizeof(buf), "four") &&
+          next_line_is(t, sizeof(buf), "five") &&
+          bgpstream_transport_readline(t, buf, sizeof(buf)) == 0);
+
+  // like fgets, lines longer than the buffer are returned in pieces
+  mock_kafka_produce_str(0, "abcdefghij\nk");
+  CHECK("Kafka long lines",
+        next_line_is(t, 4, "abc") && next_line_is(t, 4, "def") &&
+          next_line_is(t, 4, "ghi") && next_line_is(t, 4, "j") &&
+          next_line_is(t, 4, "k"));
+
+  // partition EOF events are skipped, wherever they are in the batch
+  mock_kafka_produce_str(0, "x\n");
+  mock_kafka_produce(0, NULL, 0, RD_KAFKA_RESP_ERR__PARTITION_EOF);
+  mock_kafka_produce_str(0, "y\n");
+  mock_kafka_produce(0, NULL, 0, RD_KAFKA_RESP_ERR__PARTITION_EOF);
+  CHECK("Kafka partition EOF in batch",
+        next_line_is(t, sizeof(buf), "x") &&
+          next_line_is(t, sizeof(buf), "y") &&
+          bgpstream_transport_readline(t, buf, sizeof(buf)) == 0);
+  mock_kafka_produce(0, NULL, 0, RD_KAFKA_RESP_ERR__PARTITION_EOF);
+  CHECK("Kafka partition EOF alone",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 0);
+
+  // reads are split at message boundaries
+  mock_kafka_produce_str(0, "0123456789");
+  mock_kafka_produce_str(0, "abc");
+  CHECK("Kafka read",
+        bgpstream_transport_read(t, buf, 4) == 4 &&
+          memcmp(buf, "0123", 4) == 0 &&
+          bgpstream_transport_read(t, buf, sizeof(buf)) == 6 &&
+          memcmp(buf, "456789", 6) == 0 &&
+          bgpstream_transport_read(t, buf, sizeof(buf)) == 3 &&
+          memcmp(buf, "abc", 3) == 0 &&
+          bgpstream_transport_read(t, buf, sizeof(buf)) == 0);
+
+  // borrowed data stays valid until the next call, and is then released
+  // (messages that have been read are released on a later call)
+  CHECK("Kafka transport can borrow", bgpstream_transport_can_borrow(t));
+  mock_kafka_produce_str(0, "0123456789");
+  mock_kafka_produce_str(0, "first");
+  mock_kafka_produce_str(0, "second");
+  destroyed = mock_kafka_destroyed_cnt(0);
+  CHECK("Kafka borrow after read",
+        bgpstream_transport_read(t, buf, 4) == 4 &&
+          bgpstream_transport_borrow(t, &lent) == 6 &&
+          memcmp(lent, "456789", 6) == 0 &&
+          mock_kafka_destroyed_cnt(0) == destroyed);
+  CHECK("Kafka borrow",
+        bgpstream_transport_borrow(t, &lent) == 5 &&
+          memcmp(lent, "first", 5) == 0 &&
+          mock_kafka_destroyed_cnt(0) <= destroyed + 1);
+  CHECK("Kafka borrow keeps the borrowed message",
+        bgpstream_transport_borrow(t, &lent2) == 6 &&
+          memcmp(lent2, "second", 6) == 0 &&
+          mock_kafka_destroyed_cnt(0) <= destroyed + 2);
+  CHECK("Kafka borrowed messages released",
+        bgpstream_transport_borrow(t, &lent) == 0 &&
+          mock_kafka_destroyed_cnt(0) == destroyed + 3);
+
+  // many more messages than fit in one batch
+  for (i = 0; i < KAFKA_TEST_MSG_CNT; i++) {
+    snprintf(line, sizeof(line), "message %d\n", i);
+    mock_kafka_produce_str(0, line);
+  }
+  consumed = mock_kafka_consume_cnt(0);
+  for (i = 0; i < KAFKA_TEST_MSG_CNT; i++) {
+    snprintf(line, sizeof(line), "message %d", i);
+    if (!next_line_is(t, sizeof(buf), line)) {
+      break;
+    }
+  }
+  CHECK("Kafka many messages", i == KAFKA_TEST_MSG_CNT);
+  CHECK("Kafka messages consumed in batches",
+        mock_kafka_consume_cnt(0) - consumed < KAFKA_TEST_MSG_CNT / 100);
+  CHECK("Kafka messages released",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 0 &&
+          mock_kafka_destroyed_cnt(0) == mock_kafka_created_cnt(0));
+
+  // other errors fail the read, even after data in the same batch
+  mock_kafka_produce_str(0, "z\n");
+  mock_kafka_produce(0, NULL, 0, RD_KAFKA_RESP_ERR__FAIL);
+  mock_kafka_produce_str(0, "unread\n");
+  CHECK("Kafka error in batch",
+        next_line_is(t, sizeof(buf), "z") &&
+          bgpstream_transport_readline(t, buf, sizeof(buf)) < 0);
+
+  bgpstream_transport_destroy(t);
+  bgpstream_resource_destroy(res);
+  CHECK("Kafka messages released on destroy",
+        mock_kafka_destroyed_cnt(0) == mock_kafka_created_cnt(0));
+  return 0;
+}
+
+static void *produce_line_thread(void *user)
+{
+  usleep(KAFKA_TEST_DELAY * 1000);
+  mock_kafka_produce_str(0, "hello\n");
+  return NULL;
+}
+
+static int test_kafka_wakeup()
+{
+  bgpstream_resource_t *res;
+  bgpstream_transport_t *t;
+  pthread_t thread;
+  int fd;
+
+  mock_kafka_reset();
+  CHECK("Kafka transport create", (t = create_transport(&res)) != NULL);
+  CHECK("Kafka transport wakeup descriptor",
+        (fd = bgpstream_transport_get_fd(t)) >= 0);
+
+  CHECK("Kafka transport empty",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 0 &&
+          !readable(fd, 0));
+
+  // wait for data from another thread
+  CHECK("Kafka producer thread",
+        pthread_create(&thread, NULL, produce_line_thread, NULL) == 0);
+  CHECK("Kafka transport woken by data", readable(fd, KAFKA_TEST_DELAY * 10));
+  pthread_join(thread, NULL);
+  CHECK("Kafka transport data after wakeup",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 5 &&
+          strcmp(buf, "hello") == 0);
+
+  // once the queue has been found empty the pipe is drained, so that the
+  // next wait blocks
+  CHECK("Kafka transport empty after data",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 0);
+  CHECK("Kafka transport spurious wakeups cleared",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 0 &&
+          !readable(fd, 0));
+
+  // data that arrives after any empty read must wake the reader, even if
+  // some of it was already read
+  mock_kafka_produce_str(0, "a\nb\n");
+  CHECK("Kafka transport woken by queued data", readable(fd, 0));
+  CHECK("Kafka transport first queued line",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 1 &&
+          strcmp(buf, "a") == 0);
+  mock_kafka_produce_str(0, "c");
+  CHECK("Kafka transport remaining lines",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 1 &&
+          strcmp(buf, "b") == 0 &&
+          bgpstream_transport_readline(t, buf, sizeof(buf)) == 1 &&
+          strcmp(buf, "c") == 0 &&
+          bgpstream_transport_readline(t, buf, sizeof(buf)) == 0);
+  mock_kafka_produce_str(0, "d");
+  CHECK("Kafka transport woken after reading everything", readable(fd, 0));
+  CHECK("Kafka transport data after second wakeup",
+        bgpstream_transport_readline(t, buf, sizeof(buf)) == 1 &&
+          strcmp(buf, "d") == 0);
+
+  bgpstream_transport_destroy(t);
+  bgpstream_resource_destroy(res);
+  return 0;
+}
+
+#ifdef WITH_DATA_INTERFACE_KAFKA
+
+/* when the producer thread added its data */
+static uint64_t produced_at = 0;
+
+static void *produce_rislive_thread(void *user)
+{
+  FILE *f;
+
+  usleep(KAFKA_TEST_DELAY * 1000);
+  if ((f = fopen(KAFKA_TEST_RISLIVE_FILE, "r")) == NULL) {
+    return NULL;
+  }
+  produced_at = epoch_msec();
+  while (fgets(buf, sizeof(buf), f) != NULL) {
+    mock_kafka_produce_str(0, buf);
+  }
+  fclose(f);
+  return NULL;
+}
+
+static int test_kafka_stream_wakeup()
+{
+  const char *opts[] = {"brokers",   "mock:9092", "topic",   "test",
+                        "data-type", "ris-live",  "project", "singlefile",
+                        NULL};
+  bgpstream_t *bs;
+  bgpstream_record_t *rec;
+  lines_t file = {0}, kafka = {0};
+  pthread_t thread;
+  uint64_t latency = 0;
+  int rec_cnt = 0;
+  int rc = 0;
+
+  // what the stream should produce
+  CHECK("RIS Live file stream",
+        (bs = create_file_stream("ris-live", KAFKA_TEST_RISLIVE_FILE)) != NULL);
+  while ((rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD &&
+        lines_add_record(&file, rec) < 0) {
+      rc = -1;
+      break;
+    }
+  }
+  bgpstream_destroy(bs);
+  CHECK("RIS Live file stream read", rc == 0);
+
+  mock_kafka_reset();
+  CHECK("Kafka stream",
+        (bs = create_stream("kafka", opts, NULL, 0, 0)) != NULL);
+  CHECK("Kafka producer thread",
+        pthread_create(&thread, NULL, produce_rislive_thread, NULL) == 0);
+
+  // the stream blocks until the producer adds the data
+  while (rec_cnt < KAFKA_TEST_RISLIVE_CNT &&
+         (rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec_cnt++ == 0) {
+      latency = epoch_msec() - produced_at;
+    }
+    if (rec->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD &&
+        lines_add_record(&kafka, rec) < 0) {
+      rc = -1;
+      break;
+    }
+  }
+  pthread_join(thread, NULL);
+  CHECK("Kafka stream read", rc > 0 && rec_cnt == KAFKA_TEST_RISLIVE_CNT);
+  CHECK("Kafka stream elems", lines_equal(&file, "file", &kafka, "kafka"));
+  printf("# Kafka stream latency: %" PRIu64 " msec\n", latency);
+  CHECK("Kafka stream woken by data", latency < KAFKA_TEST_MAX_LATENCY);
+
+  bgpstream_destroy(bs);
+  lines_free(&file);
+  lines_free(&kafka);
+  return 0;
+}
+
+/* the first message of the test stream, with the given timestamp */
+static int rislive_msg(char *msg, size_t len, uint32_t time)
+{
+  const char *key = "\"timestamp\":";
+  char *ts, *end;
+  FILE *f;
+
+  if ((f = fopen(KAFKA_TEST_RISLIVE_FILE, "r")) == NULL) {
+    return -1;
+  }
+  if (fgets(buf, sizeof(buf), f) == NULL ||
+      (ts = strstr(buf, key)) == NULL) {
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  ts += strlen(key);
+  end = ts + strspn(ts, "0123456789.");
+  *ts = '\0';
+  snprintf(msg, len, "%s%" PRIu32 "%s", buf, time, end);
+  return 0;
+}
+
+/* produce messages with the given timestamps (offsets from
+ * KAFKA_TEST_MERGE_TIME) to the given consumer */
+static int produce_times(int consumer, const int *offsets, int cnt)
+{
+  char msg[4096];
+  int i;
+
+  for (i = 0; i < cnt; i++) {
+    if (rislive_msg(msg, sizeof(msg), KAFKA_TEST_MERGE_TIME + offsets[i]) !=
+          0 ||
+        mock_kafka_produce_str(consumer, msg) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* read the next valid record, and return its time offset (or -1) */
+static int next_offset(bgpstream_t *bs)
+{
+  bgpstream_record_t *rec;
+  int rc;
+
+  while ((rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      return rec->time_sec - KAFKA_TEST_MERGE_TIME;
+    }
+  }
+  return -1;
+}
+
+static int test_kafka_consumers_merge()
+{
+  const char *opts[] = {"brokers",   "mock:9092", "topic",     "test",
+                        "data-type", "ris-live",  "consumers", "2",
+                        "max-lateness", STR(KAFKA_TEST_MAX_LATENESS), NULL};
+  const int times0[] = {0, 2, 4};
+  const int times1[] = {1, 3, 5};
+  const int late_time1[] = {10};
+  const int late_time0[] = {6};
+  bgpstream_t *bs;
+  uint64_t idle_start = 0, idle_wait;
+  int offset, i;
+
+  // two partitions, each in time order, interleaved with the other
+  mock_kafka_reset();
+  CHECK("Kafka consumers data", produce_times(0, times0, 3) == 0 &&
+                                  produce_times(1, times1, 3) == 0);
+  CHECK("Kafka consumers stream",
+        (bs = create_stream("kafka", opts, NULL, 0, 0)) != NULL);
+
+  // records are merged in time order. the first consumer runs out of data
+  // after 4, so the last record is only yielded once it has been idle for
+  // max-lateness
+  for (i = 0; i < 6; i++) {
+    if (i == 5) {
+      idle_start = epoch_msec();
+    }
+    if ((offset = next_offset(bs)) != i) {
+      printf("# record %d has time offset %d\n", i, offset);
+      break;
+    }
+  }
+  idle_wait = epoch_msec() - idle_start;
+  CHECK("Kafka consumers merged in time order", i == 6);
+  printf("# Kafka idle consumer passed after %" PRIu64 " msec\n", idle_wait);
+  CHECK("Kafka idle consumer passed after max-lateness",
+        idle_wait >= KAFKA_TEST_MAX_LATENESS / 2 &&
+          idle_wait < KAFKA_TEST_MAX_LATENESS * 4);
+
+  // the idle consumer no longer holds back the other one, and its records
+  // are still yielded once it has data again, even though they are late
+  CHECK("Kafka consumers more data", produce_times(1, late_time1, 1) == 0);
+  CHECK("Kafka record after idle consumer", next_offset(bs) == 10);
+  CHECK("Kafka late data", produce_times(0, late_time0, 1) == 0);
+  CHECK("Kafka late record from passed consumer", next_offset(bs) == 6);
+
+  bgpstream_destroy(bs);
+  return 0;
+}
+
+#endif
+
+int main()
+{
+  alarm(KAFKA_TEST_TIMEOUT);
+
+  CHECK_SECTION("Kafka batches", test_kafka_batches() == 0);
+  CHECK_SECTION("Kafka wakeup pipe", test_kafka_wakeup() == 0);
+#ifdef WITH_DATA_INTERFACE_KAFKA
+  CHECK_SECTION("Kafka stream wakeup", test_kafka_stream_wakeup() == 0);
+  CHECK_SECTION("Kafka consumers merge", test_kafka_consumers_merge() == 0);
+#else
+  SKIPPED_SECTION("Kafka stream wakeup");
+  SKIPPED_SECTION("Kafka consumers merge");
+#endif
+  ENDTEST;
+  return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_test_helpers.h"
+#include "bgpstream_prefetcher.h"
+#include "bgpstream_resource.h"
+#include "bgpstream_transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Prefetch the test dumps (the local files stand in for a remote server) into
+ * a cache directory, and check that the cache transport then reads the same
+ * bytes from the cache. Then check that the disk quota holds back downloads
+ * until prefetched files are released. */
+
+#define PREFETCH_TEST_FILE_RIS "ris.rrc06.updates.1427846400.gz"
+#define PREFETCH_TEST_FILE_RV "routeviews.route-views.jinx.updates.1427846400.bz2"
+#define PREFETCH_TEST_BUF_LEN 65536
+
+/* how long to wait for a download (in 10ms steps) */
+#define PREFETCH_TEST_TIMEOUT 3000
+
+static char cache_dir[] = "prefetch-test.XXXXXX";
+static char buf[PREFETCH_TEST_BUF_LEN];
+static char buf2[PREFETCH_TEST_BUF_LEN];
+
+static bgpstream_resource_t *create_resource(const char *url,
+                                             const char *collector)
+{
+  return create_cache_resource(url, collector, cache_dir, NULL);
+}
+
+static int wait_cached(bgpstream_resource_t *res)
+{
+  int i;
+
+  for (i = 0; i < PREFETCH_TEST_TIMEOUT && !cached(cache_dir, res); i++) {
+    usleep(10000);
+  }
+  return cached(cache_dir, res);
+}
+
+static void remove_cache(bgpstream_resource_t *res)
+{
+  char path[2048];
+
+  cache_res_path(path, sizeof(path), cache_dir, res, ".cache");
+  unlink(path);
+}
+
+/* read the resource through the cache transport, and compare with reading the
+ * file directly */
+static int same_content(bgpstream_resource_t *res)
+{
+  bgpstream_resource_t *file_res = NULL;
+  bgpstream_transport_t *t = NULL, *file_t = NULL;
+  int64_t len, got, rc;
+  int same = 0;
+
+  if ((file_res = bgpstream_resource_copy(res)) == NULL) {
+    return 0;
+  }
+  file_res->transport_type = BGPSTREAM_RESOURCE_TRANSPORT_FILE;
+  if ((t = bgpstream_transport_create(res)) == NULL ||
+      (file_t = bgpstream_transport_create(file_res)) == NULL) {
+    goto done;
+  }
+  do {
+    if ((len = bgpstream_transport_read(t, buf, sizeof(buf))) < 0) {
+      goto done;
+    }
+    // the file transport may return less at a time
+    for (got = 0; got < len; got += rc) {
+      if ((rc = bgpstream_transport_read(file_t, buf2 + got, len - got)) <=
+          0) {
+        goto done;
+      }
+    }
+    if (memcmp(buf, buf2, len) != 0) {
+      goto done;
+    }
+  } while (len > 0);
+  same = (bgpstream_transport_read(file_t, buf2, 1) == 0);
+
+done:
+  bgpstream_transport_destroy(t);
+  bgpstream_transport_destroy(file_t);
+  bgpstream_resource_destroy(file_res);
+  return same;
+}
+
+static int test_prefetch()
+{
+  bgpstream_prefetcher_t *p;
+  bgpstream_resource_t *ris, *rv;
+  char path[2048];
+
+  CHECK_MSG("create resources", "Could not create resources",
+            (ris = create_resource(PREFETCH_TEST_FILE_RIS, "rrc06")) != NULL &&
+              (rv = create_resource(PREFETCH_TEST_FILE_RV, "jinx")) != NULL);
+
+  CHECK_MSG("create prefetcher", "Could not create prefetcher",
+            (p = bgpstream_prefetcher_create(2, UINT64_MAX)) != NULL);
+
+  CHECK("add resource", bgpstream_prefetcher_add(p, ris) == 1);
+  CHECK("add resource", bgpstream_prefetcher_add(p, rv) == 1);
+  CHECK("add duplicate resource", bgpstream_prefetcher_add(p, rv) == 0);
+
+  CHECK("prefetch " PREFETCH_TEST_FILE_RIS, wait_cached(ris));
+  CHECK("prefetch " PREFETCH_TEST_FILE_RV, wait_cached(rv));
+
+  bgpstream_prefetcher_release(p, ris);
+  bgpstream_prefetcher_release(p, rv);
+  bgpstream_prefetcher_destroy(p);
+
+  cache_res_path(path, sizeof(path), cache_dir, ris, ".cache.temp");
+  CHECK("temporary file removed", access(path, F_OK) != 0);
+  cache_res_path(path, sizeof(path), cache_dir, ris, ".cache.lock");
+  CHECK("lock file removed", access(path, F_OK) != 0);
+
+  CHECK("read prefetched " PREFETCH_TEST_FILE_RIS, same_content(ris));
+  CHECK("read prefetched " PREFETCH_TEST_FILE_RV, same_content(rv));
+
+  remove_cache(ris);
+  remove_cache(rv);
+  bgpstream_resource_destroy(ris);
+  bgpstream_resource_destroy(rv);
+  return 0;
+}
+
+static int test_prefetch_quota()
+{
+  bgpstream_prefetcher_t *p;
+  bgpstream_resource_t *ris, *rv;
+
+  CHECK_MSG("create resources", "Could not create resources",
+            (ris = create_resource(PREFETCH_TEST_FILE_RIS, "rrc06")) != NULL &&
+              (rv = create_resource(PREFETCH_TEST_FILE_RV, "jinx")) != NULL);
+
+  // a single byte of quota lets one download through at a time
+  CHECK_MSG("create prefetcher", "Could not create prefetcher",
+            (p = bgpstream_prefetcher_create(1, 1)) != NULL);
+
+  CHECK("add resource", bgpstream_prefetcher_add(p, ris) == 1);
+  CHECK("add resource", bgpstream_prefetcher_add(p, rv) == 1);
+
+  CHECK("prefetch within quota", wait_cached(ris));
+  usleep(200000);
+  CHECK("no prefetch over quota", !cached(cache_dir, rv));
+
+  // opening the first file frees its quota
+  bgpstream_prefetcher_release(p, ris);
+  CHECK("prefetch after release", wait_cached(rv));
+
+  bgpstream_prefetcher_release(p, rv);
+  bgpstream_prefetcher_destroy(p);
+
+  remove_cache(ris);
+  remove_cache(rv);
+  bgpstream_resource_destroy(ris);
+  bgpstream_resource_destroy(rv);
+  return 0;
+}
+
+int main()
+{
+  CHECK_MSG("create cache directory", "Could not create cache directory",
+            mkdtemp(cache_dir) != NULL);
+
+  CHECK_SECTION("Cache prefetch", test_prefetch() == 0);
+  CHECK_SECTION("Cache prefetch quota", test_prefetch_quota() == 0);
+
+  rmdir(cache_dir);
+  ENDTEST;
+}
@@ -26,9 +26,12 @@
 
 #include "bgpstream.h"
 #include "bgpstream_test.h"
+#include "bs_format_rislive_hex.h"
 #include "utils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define SETUP                                                                  \
   do {                                                                         \
@@ -164,9 +167,220 @@ err:
   return -1;
 }
 
+/*
+ * The same stream, split between several decode threads. Records are merged
+ * by time rather than read in file order, so only count them by status.
+ */
+static int count_rislive_records(const char *file, const char *workers,
+                                 int *valid, int *unsupported, int *corrupted)
+{
+  int rrc = 0;
+  bgpstream_t *bs;
+  bgpstream_record_t *rec = NULL;
+  static bgpstream_data_interface_id_t di_id = 0;
+  bgpstream_data_interface_option_t *option;
+
+  *valid = *unsupported = *corrupted = 0;
+
+  SETUP;
+  CHECK_SET_INTERFACE(singlefile);
+
+  if ((option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, "upd-type")) == NULL ||
+      bgpstream_set_data_interface_option(bs, option, "ris-live") != 0) {
+    return -1;
+  }
+  if ((option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, "upd-file")) == NULL ||
+      bgpstream_set_data_interface_option(bs, option, file) != 0) {
+    return -1;
+  }
+  if ((option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, "upd-workers")) == NULL ||
+      bgpstream_set_data_interface_option(bs, option, workers) != 0) {
+    return -1;
+  }
+
+  if (bgpstream_start(bs) < 0) {
+    return -1;
+  }
+
+  while ((rrc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    switch (rec->status) {
+    case BGPSTREAM_RECORD_STATUS_VALID_RECORD:
+      (*valid)++;
+      break;
+    case BGPSTREAM_RECORD_STATUS_UNSUPPORTED_RECORD:
+      (*unsupported)++;
+      break;
+    case BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD:
+      (*corrupted)++;
+      break;
+    default:
+      rrc = -1;
+      break;
+    }
+  }
+  bgpstream_destroy(bs);
+
+  return rrc;
+}
+
+/* Copy the test stream with a blank line after every message */
+#define BLANK_LINES_FILE "ris-live-stream-blank.json"
+
+static int write_blank_lines_file()
+{
+  FILE *in, *out;
+  int rc = 0;
+
+  if ((in = fopen("ris-live-stream.json", "r")) == NULL) {
+    return -1;
+  }
+  if ((out = fopen(BLANK_LINES_FILE, "w")) == NULL) {
+    fclose(in);
+    return -1;
+  }
+  while (fgets(buf, sizeof(buf), in) != NULL) {
+    if (fputs(buf, out) == EOF || fputs("\n", out) == EOF) {
+      rc = -1;
+      break;
+    }
+  }
+  fclose(in);
+  if (fclose(out) != 0) {
+    rc = -1;
+  }
+  return rc;
+}
+
+static int test_bgpstream_rislive_workers()
+{
+  int rc, valid, unsupported, corrupted;
+
+  rc = count_rislive_records("ris-live-stream.json", "3", &valid,
+                             &unsupported, &corrupted);
+  CHECK("RIS Live records decoded by workers",
+        rc == 0 && valid == 5 && unsupported == 1 && corrupted == 1);
+
+  // a blank line is a corrupted message, not the end of a worker's range
+  CHECK("RIS Live blank lines file", write_blank_lines_file() == 0);
+  rc = count_rislive_records(BLANK_LINES_FILE, "3", &valid, &unsupported,
+                             &corrupted);
+  unlink(BLANK_LINES_FILE);
+  CHECK("RIS Live blank lines decoded by workers",
+        rc == 0 && valid == 5 && unsupported == 1 && corrupted == 8);
+
+  return 0;
+}
+
+/*
+ * The vector hex decoding kernels must agree with the scalar one: on every
+ * length around their block sizes (including odd lengths), on upper and lower
+ * case digits, and with an invalid character in every position, and so in
+ * every vector lane.
+ */
+#define HEX_TEST_MAX_LEN 200
+
+typedef struct hex_kernel {
+  const char *name;
+  bs_rislive_hex_func_t *func;
+} hex_kernel_t;
+
+static int hex_kernels_agree(hex_kernel_t *kernels, int kernels_cnt,
+                             const char *hex, size_t len)
+{
+  uint8_t want[HEX_TEST_MAX_LEN / 2], got[HEX_TEST_MAX_LEN / 2];
+  int want_rc, i;
+
+  want_rc = bs_rislive_hexstr_to_bytes_scalar(want, hex, len);
+  for (i = 0; i < kernels_cnt; i++) {
+    memset(got, 0, sizeof(got));
+    if (kernels[i].func(got, hex, len) != want_rc ||
+        (want_rc == 0 && memcmp(got, want, len / 2) != 0)) {
+      printf("# %s kernel differs from the scalar one on %zu characters\n",
+             kernels[i].name, len);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int test_rislive_hex()
+{
+  static const char digits[] = "0123456789abcdefABCDEF";
+  // the characters either side of each range of hex digits, and characters
+  // that are negative as signed chars
+  static const char invalid[] = {'/', ':', '@', 'G', '`', 'g', ' ', '\0',
+                                 (char)0x80, (char)0xB0, (char)0xFF};
+  static const char mixed[] = "00aAbBcCdDeEfF0123456789abcdefABCDEF";
+  static const uint8_t mixed_bytes[] = {0x00, 0xaa, 0xbb, 0xcc, 0xdd, 0xee,
+                                        0xff, 0x01, 0x23, 0x45, 0x67, 0x89,
+                                        0xab, 0xcd, 0xef, 0xab, 0xcd, 0xef};
+  hex_kernel_t kernels[3];
+  int kernels_cnt = 0;
+  char hex[HEX_TEST_MAX_LEN];
+  uint8_t bytes[sizeof(mixed_bytes)];
+  int valid_ok = 1, invalid_ok = 1;
+  size_t len, i, j;
+  char saved;
+
+  kernels[kernels_cnt].name = "dispatched";
+  kernels[kernels_cnt++].func = bs_rislive_hexstr_to_bytes;
+#ifdef BS_RISLIVE_HEX_SSE2
+  kernels[kernels_cnt].name = "SSE2";
+  kernels[kernels_cnt++].func = bs_rislive_hexstr_to_bytes_sse2;
+#endif
+#ifdef BS_RISLIVE_HEX_AVX2
+  if (bs_rislive_hex_have_avx2() != 0) {
+    kernels[kernels_cnt].name = "AVX2";
+    kernels[kernels_cnt++].func = bs_rislive_hexstr_to_bytes_avx2;
+  }
+#endif
+  for (i = 0; i < (size_t)kernels_cnt; i++) {
+    printf("# checking the %s kernel\n", kernels[i].name);
+  }
+
+  CHECK("upper and lower case digits",
+        bs_rislive_hexstr_to_bytes(bytes, mixed, sizeof(mixed) - 1) == 0 &&
+          memcmp(bytes, mixed_bytes, sizeof(bytes)) == 0);
+
+  srand(1);
+  for (len = 0; len <= HEX_TEST_MAX_LEN; len++) {
+    for (i = 0; i < len; i++) {
+      hex[i] = digits[rand() % (sizeof(digits) - 1)];
+    }
+    if (hex_kernels_agree(kernels, kernels_cnt, hex, len) == 0) {
+      valid_ok = 0;
+    }
+
+    for (i = 0; i < len; i++) {
+      saved = hex[i];
+      for (j = 0; j < sizeof(invalid); j++) {
+        hex[i] = invalid[j];
+        if (hex_kernels_agree(kernels, kernels_cnt, hex, len) == 0) {
+          printf("# with 0x%02x at position %zu\n", (uint8_t)invalid[j], i);
+          invalid_ok = 0;
+        }
+      }
+      hex[i] = saved;
+    }
+  }
+  CHECK("vector kernels match the scalar kernel", valid_ok);
+  CHECK("vector kernels reject invalid characters", invalid_ok);
+
+  return 0;
+}
+
 int main()
 {
   int rc = test_bgpstream_rislive();
+  if (rc == 0) {
+    rc = test_bgpstream_rislive_workers();
+  }
+  if (rc == 0) {
+    rc = test_rislive_hex();
+  }
   ENDTEST;
   return rc;
 }
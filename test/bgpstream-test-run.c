@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream.h"
+#include "bgpstream_test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Read the test dumps with both the pull API (bgpstream_get_next_record and
+ * bgpstream_record_get_next_elem) and the push API (bgpstream_run), and check
+ * that they produce the same output. bgpstream-bench-run compares their
+ * throughput. */
+
+#define RUN_TEST_BUF_LEN 65536
+
+/* number of elems (or records) after which the early-stop tests stop the
+ * stream */
+#define RUN_TEST_STOP_CNT 100
+
+static const char *files[] = {
+  "ris.rrc06.updates.1427846400.gz",
+  "routeviews.route-views.jinx.updates.1427846400.bz2",
+};
+
+typedef struct digest {
+  int records_cnt;
+  int elems_cnt;
+  uint64_t hash;
+} digest_t;
+
+static char buf[RUN_TEST_BUF_LEN];
+
+/* FNV-1a, so that the outputs can be compared without storing them */
+static void digest_add(digest_t *d, const char *str)
+{
+  if (d->hash == 0) {
+    d->hash = 14695981039346656037ULL;
+  }
+  for (; *str != '\0'; str++) {
+    d->hash = (d->hash ^ (uint8_t)*str) * 1099511628211ULL;
+  }
+}
+
+static bgpstream_t *create_stream(const char *file)
+{
+  bgpstream_t *bs;
+  bgpstream_data_interface_id_t di_id;
+  bgpstream_data_interface_option_t *option;
+
+  if ((bs = bgpstream_create()) == NULL) {
+    return NULL;
+  }
+  di_id = bgpstream_get_data_interface_id_by_name(bs, "singlefile");
+  bgpstream_set_data_interface(bs, di_id);
+  if ((option = bgpstream_get_data_interface_option_by_name(
+         bs, di_id, "upd-file")) == NULL ||
+      bgpstream_set_data_interface_option(bs, option, file) != 0 ||
+      bgpstream_start(bs) != 0) {
+    bgpstream_destroy(bs);
+    return NULL;
+  }
+  return bs;
+}
+
+static int read_pull(bgpstream_t *bs, digest_t *d)
+{
+  bgpstream_record_t *rec;
+  bgpstream_elem_t *elem;
+  int rc;
+
+  while ((rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    d->records_cnt++;
+    while ((rc = bgpstream_record_get_next_elem(rec, &elem)) > 0) {
+      if (bgpstream_record_elem_snprintf(buf, sizeof(buf), rec, elem) ==
+          NULL) {
+        return -1;
+      }
+      digest_add(d, buf);
+      d->elems_cnt++;
+    }
+    if (rc < 0) {
+      return -1;
+    }
+  }
+  return rc;
+}
+
+static int record_cb(bgpstream_record_t *rec, void *user)
+{
+  ((digest_t *)user)->records_cnt++;
+  return 0;
+}
+
+static int elem_cb(bgpstream_record_t *rec, bgpstream_elem_t *elem,
+                   void *user)
+{
+  digest_t *d = (digest_t *)user;
+
+  if (bgpstream_record_elem_snprintf(buf, sizeof(buf), rec, elem) == NULL) {
+    return -1;
+  }
+  digest_add(d, buf);
+  d->elems_cnt++;
+  return 0;
+}
+
+static int stop_record_cb(bgpstream_record_t *rec, void *user)
+{
+  digest_t *d = (digest_t *)user;
+  return (++d->records_cnt == RUN_TEST_STOP_CNT) ? 1 : 0;
+}
+
+static int stop_elem_cb(bgpstream_record_t *rec, bgpstream_elem_t *elem,
+                        void *user)
+{
+  digest_t *d = (digest_t *)user;
+  return (++d->elems_cnt == RUN_TEST_STOP_CNT) ? 2 : 0;
+}
+
+static int test_run_file(const char *file)
+{
+  bgpstream_t *bs;
+  digest_t pull = {0}, push = {0}, stop = {0}, rstop = {0};
+
+  CHECK_MSG("create pull stream", file,
+            (bs = create_stream(file)) != NULL);
+  CHECK("read with pull API", read_pull(bs, &pull) == 0);
+  bgpstream_destroy(bs);
+
+  CHECK_MSG("create push stream", file, (bs = create_stream(file)) != NULL);
+  CHECK("read with push API",
+        bgpstream_run(bs, record_cb, elem_cb, &push) == 0);
+  bgpstream_destroy(bs);
+
+  CHECK("push record count", push.records_cnt == pull.records_cnt);
+  CHECK("push elem count", push.elems_cnt == pull.elems_cnt);
+  CHECK("push output matches pull output", push.hash == pull.hash);
+
+  printf("# %s: %d records, %d elems\n", file, pull.records_cnt,
+         pull.elems_cnt);
+
+  /* a callback can stop the stream */
+  CHECK_MSG("create push stream", file, (bs = create_stream(file)) != NULL);
+  CHECK("stop from elem callback",
+        bgpstream_run(bs, NULL, stop_elem_cb, &stop) == 2);
+  CHECK("stopped at the right elem", stop.elems_cnt == RUN_TEST_STOP_CNT);
+  bgpstream_destroy(bs);
+
+  /* and then be read further */
+  CHECK_MSG("create push stream", file, (bs = create_stream(file)) != NULL);
+  CHECK("stop from record callback",
+        bgpstream_run(bs, stop_record_cb, NULL, &rstop) == 1);
+  CHECK("stopped at the right record", rstop.records_cnt == RUN_TEST_STOP_CNT);
+  CHECK("resume after stop", bgpstream_run(bs, record_cb, NULL, &rstop) == 0);
+  CHECK("resumed record count", rstop.records_cnt == pull.records_cnt);
+  bgpstream_destroy(bs);
+
+  return 0;
+}
+
+int main()
+{
+  int i;
+
+  for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+    CHECK_SECTION("Push API", test_run_file(files[i]) == 0);
+  }
+  ENDTEST;
+  return 0;
+}
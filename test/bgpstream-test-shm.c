@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream.h"
+#include "bgpstream_test.h"
+#include "bgpstream_test_helpers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Publish the records of an MRT dump to a shared memory ring, read them back
+ * with the "shm" data interface, and check that both streams produce the same
+ * output. Then check that a consumer that falls behind is dropped, and
+ * carries on from a later point in the stream, and that a publisher that has
+ * been replaced leaves the new ring in place when it exits. */
+
+#define SHM_TEST_MRT_FILE "ris.rrc06.updates.1427846400.gz"
+
+/* number of times to publish the dump to overrun the (smallest) ring */
+#define SHM_TEST_OVERRUN_CNT 64
+
+/* delay between records (in usec) when the consumer should keep up */
+#define SHM_TEST_SLOW_DELAY 100
+
+/* the ring never ends, so a test that does not get the data it expects would
+ * hang rather than fail */
+#define SHM_TEST_TIMEOUT 300
+
+static char shm_name[64];
+static int consumer_done = 0;
+
+static bgpstream_t *create_mrt_stream()
+{
+  return create_file_stream("mrt", SHM_TEST_MRT_FILE);
+}
+
+static bgpstream_t *create_shm_stream()
+{
+  const char *opts[] = {"name", shm_name, "offset", "earliest", NULL};
+  return create_stream("shm", opts, NULL, 0, 0);
+}
+
+/* Publish every record of the MRT dump (waiting `delay` usec after each) */
+static int publish_mrt(bgpstream_shm_publisher_t *pub, int delay)
+{
+  bgpstream_t *bs;
+  bgpstream_record_t *rec;
+  int rc;
+
+  if ((bs = create_mrt_stream()) == NULL) {
+    return -1;
+  }
+  while ((rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD &&
+        bgpstream_shm_publisher_add_record(pub, rec) != 0) {
+      rc = -1;
+      break;
+    }
+    if (delay > 0) {
+      usleep(delay);
+    }
+  }
+  bgpstream_destroy(bs);
+  return rc;
+}
+
+/* Read the output lines of the stream, until `max_cnt` lines have been read
+ * (or the stream ends, for a stream that does end) */
+static int read_lines(bgpstream_t *bs, lines_t *lines, int max_cnt)
+{
+  bgpstream_record_t *rec;
+  int rc = 0;
+
+  while (lines->lines_cnt < max_cnt &&
+         (rc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      continue;
+    }
+    if ((rc = lines_add_record(lines, rec)) < 0) {
+      return -1;
+    }
+  }
+  return (lines->lines_cnt < max_cnt && rc < 0) ? -1 : 0;
+}
+
+/* Does `lines` (from `start`) follow on from some line of the repeated MRT
+ * dump? */
+static int lines_follow_mrt(lines_t *lines, int start, lines_t *mrt)
+{
+  int i, j;
+
+  for (i = 0; i < mrt->lines_cnt; i++) {
+    for (j = start; j < lines->lines_cnt; j++) {
+      if (strcmp(lines->lines[j],
+                 mrt->lines[(i + j - start) % mrt->lines_cnt]) != 0) {
+        break;
+      }
+    }
+    if (j == lines->lines_cnt) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int test_shm_roundtrip()
+{
+  bgpstream_t *bs;
+  bgpstream_shm_publisher_t *pub;
+  lines_t mrt = {0}, shm = {0};
+
+  /* collect the elems of the MRT dump */
+  CHECK_MSG("create MRT stream", "Could not read " SHM_TEST_MRT_FILE,
+            (bs = create_mrt_stream()) != NULL);
+  CHECK("read MRT stream", read_lines(bs, &mrt, 1 << 30) == 0);
+  bgpstream_destroy(bs);
+  CHECK("MRT stream has elems", mrt.lines_cnt > 0);
+
+  /* publish it */
+  CHECK_MSG("create shm publisher", "Could not create shared memory ring",
+            (pub = bgpstream_shm_publisher_create(shm_name, 0)) != NULL);
+  CHECK("publish MRT records", publish_mrt(pub, 0) == 0);
+
+  /* and read it back (the ring never ends, so stop after the last elem) */
+  CHECK_MSG("create shm stream", "Could not attach to shared memory ring",
+            (bs = create_shm_stream()) != NULL);
+  CHECK("read shm stream", read_lines(bs, &shm, mrt.lines_cnt) == 0);
+  bgpstream_destroy(bs);
+  bgpstream_shm_publisher_destroy(pub);
+
+  CHECK("shm elems match MRT elems",
+        lines_equal(&mrt, "MRT", &shm, "shm"));
+
+  lines_free(&mrt);
+  lines_free(&shm);
+  return 0;
+}
+
+/* Publish the MRT dump once, slowly enough for the consumer to keep up */
+static void *publish_once_thread(void *user)
+{
+  publish_mrt((bgpstream_shm_publisher_t *)user, SHM_TEST_SLOW_DELAY);
+  return NULL;
+}
+
+/* The dump is many times larger than the interval between sync points of the
+ * smallest ring, so the consumer crosses a sync point (after which the writer
+ * reassigns dictionary IDs) many times, with the record just before each one
+ * still to be decoded when the next one has been read. */
+static int test_shm_sync_points()
+{
+  bgpstream_t *bs;
+  bgpstream_shm_publisher_t *pub;
+  pthread_t thread;
+  lines_t mrt = {0}, shm = {0};
+
+  CHECK_MSG("create MRT stream", "Could not read " SHM_TEST_MRT_FILE,
+            (bs = create_mrt_stream()) != NULL);
+  CHECK("read MRT stream", read_lines(bs, &mrt, 1 << 30) == 0);
+  bgpstream_destroy(bs);
+
+  CHECK_MSG("create small shm publisher", "Could not create shared memory ring",
+            (pub = bgpstream_shm_publisher_create(
+               shm_name, BGPSTREAM_SHM_SIZE_MIN)) != NULL);
+  CHECK_MSG("create shm stream", "Could not attach to shared memory ring",
+            (bs = create_shm_stream()) != NULL);
+  CHECK("start publisher thread",
+        pthread_create(&thread, NULL, publish_once_thread, pub) == 0);
+  CHECK("read shm stream", read_lines(bs, &shm, mrt.lines_cnt) == 0);
+  pthread_join(thread, NULL);
+  CHECK("consumer kept up", bgpstream_shm_publisher_get_dropped_cnt(pub) == 0);
+  bgpstream_destroy(bs);
+  bgpstream_shm_publisher_destroy(pub);
+
+  CHECK("shm elems match MRT elems across sync points",
+        lines_equal(&mrt, "MRT", &shm, "shm"));
+
+  lines_free(&mrt);
+  lines_free(&shm);
+  return 0;
+}
+
+/* Keep publishing the MRT dump (slowly, so that the consumer keeps up) until
+ * the consumer is done */
+static void *publish_thread(void *user)
+{
+  bgpstream_shm_publisher_t *pub = (bgpstream_shm_publisher_t *)user;
+
+  while (__atomic_load_n(&consumer_done, __ATOMIC_ACQUIRE) == 0) {
+    if (publish_mrt(pub, SHM_TEST_SLOW_DELAY) != 0) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+static int test_shm_slow_consumer()
+{
+  bgpstream_t *bs;
+  bgpstream_shm_publisher_t *pub;
+  pthread_t thread;
+  lines_t mrt = {0}, shm = {0};
+  int i, before, same;
+
+  CHECK_MSG("create MRT stream", "Could not read " SHM_TEST_MRT_FILE,
+            (bs = create_mrt_stream()) != NULL);
+  CHECK("read MRT stream", read_lines(bs, &mrt, 1 << 30) == 0);
+  bgpstream_destroy(bs);
+
+  CHECK_MSG("create small shm publisher", "Could not create shared memory ring",
+            (pub = bgpstream_shm_publisher_create(
+               shm_name, BGPSTREAM_SHM_SIZE_MIN)) != NULL);
+  CHECK("publish MRT records", publish_mrt(pub, 0) == 0);
+
+  /* start reading */
+  CHECK_MSG("create shm stream", "Could not attach to shared memory ring",
+            (bs = create_shm_stream()) != NULL);
+  CHECK("read start of shm stream", read_lines(bs, &shm, 10) == 0);
+  before = shm.lines_cnt;
+  same = 1;
+  for (i = 0; i < before; i++) {
+    same = same && strcmp(shm.lines[i], mrt.lines[i]) == 0;
+  }
+  CHECK("start of shm stream matches MRT elems", same);
+
+  /* and then fall behind */
+  for (i = 0; i < SHM_TEST_OVERRUN_CNT; i++) {
+    CHECK("publish MRT records again", publish_mrt(pub, 0) == 0);
+  }
+  CHECK("slow consumer dropped",
+        bgpstream_shm_publisher_get_dropped_cnt(pub) == 1);
+
+  /* the consumer carries on from a later sync point */
+  CHECK("start publisher thread",
+        pthread_create(&thread, NULL, publish_thread, pub) == 0);
+  CHECK("read rest of shm stream",
+        read_lines(bs, &shm, before + 2 * mrt.lines_cnt) == 0);
+  __atomic_store_n(&consumer_done, 1, __ATOMIC_RELEASE);
+  pthread_join(thread, NULL);
+  CHECK("shm stream resumes in order",
+        lines_follow_mrt(&shm, shm.lines_cnt - mrt.lines_cnt, &mrt));
+  CHECK("slow consumer not dropped again",
+        bgpstream_shm_publisher_get_dropped_cnt(pub) == 1);
+
+  bgpstream_destroy(bs);
+  bgpstream_shm_publisher_destroy(pub);
+  lines_free(&mrt);
+  lines_free(&shm);
+  return 0;
+}
+
+/* Does a shared memory object with our name exist? */
+static int shm_exists()
+{
+  int fd;
+
+  if ((fd = shm_open(shm_name, O_RDONLY, 0)) < 0) {
+    return (errno == ENOENT) ? 0 : -1;
+  }
+  close(fd);
+  return 1;
+}
+
+static int test_shm_replace()
+{
+  bgpstream_t *bs;
+  bgpstream_shm_publisher_t *old_pub, *pub;
+  lines_t mrt = {0}, shm = {0};
+
+  CHECK_MSG("create MRT stream", "Could not read " SHM_TEST_MRT_FILE,
+            (bs = create_mrt_stream()) != NULL);
+  CHECK("read MRT stream", read_lines(bs, &mrt, 1 << 30) == 0);
+  bgpstream_destroy(bs);
+
+  /* a second publisher replaces the first, which then exits */
+  CHECK_MSG("create shm publisher", "Could not create shared memory ring",
+            (old_pub = bgpstream_shm_publisher_create(shm_name, 0)) != NULL);
+  CHECK_MSG("create replacement shm publisher",
+            "Could not create shared memory ring",
+            (pub = bgpstream_shm_publisher_create(shm_name, 0)) != NULL);
+  bgpstream_shm_publisher_destroy(old_pub);
+  CHECK("replaced publisher leaves the new ring", shm_exists() == 1);
+
+  /* consumers can still attach to the new ring, and read from it */
+  CHECK("publish MRT records", publish_mrt(pub, 0) == 0);
+  CHECK_MSG("create shm stream", "Could not attach to shared memory ring",
+            (bs = create_shm_stream()) != NULL);
+  CHECK("read shm stream", read_lines(bs, &shm, mrt.lines_cnt) == 0);
+  bgpstream_destroy(bs);
+  CHECK("shm elems match MRT elems after replacement",
+        lines_equal(&mrt, "MRT", &shm, "shm"));
+
+  /* the last publisher removes the ring */
+  bgpstream_shm_publisher_destroy(pub);
+  CHECK("last publisher removes the ring", shm_exists() == 0);
+
+  lines_free(&mrt);
+  lines_free(&shm);
+  return 0;
+}
+
+int main()
+{
+  // don't clash with other runs of this test
+  snprintf(shm_name, sizeof(shm_name), "/bgpstream-test-shm-%d", (int)getpid());
+  alarm(SHM_TEST_TIMEOUT);
+
+  CHECK_SECTION("Shared memory ring", test_shm_roundtrip() == 0);
+  CHECK_SECTION("Shared memory ring sync points",
+                test_shm_sync_points() == 0);
+  CHECK_SECTION("Shared memory ring slow consumer",
+                test_shm_slow_consumer() == 0);
+  CHECK_SECTION("Shared memory ring replacement", test_shm_replace() == 0);
+  ENDTEST;
+  return 0;
+}
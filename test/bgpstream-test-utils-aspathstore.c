@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2015 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bgpstream_utils_as_path_int.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PATHS_CNT 20000
+#define THREADS_CNT 4
+#define DICT_FILE "bgpstream-test-utils-aspathstore.dict"
+
+static int make_path(bgpstream_as_path_t *path, uint32_t peer, uint32_t i)
+{
+  uint32_t asns[3] = {peer, 1000 + (i % 97), 100000 + i};
+  bgpstream_as_path_clear(path);
+  return bgpstream_as_path_append(path, BGPSTREAM_AS_PATH_SEG_ASN, asns, 3);
+}
+
+static int check_paths(bgpstream_as_path_store_t *store, uint32_t peer)
+{
+  bgpstream_as_path_t *path = bgpstream_as_path_create();
+  bgpstream_as_path_store_path_t *spath;
+  bgpstream_as_path_store_path_id_t id;
+  uint32_t i;
+  int ret = -1;
+
+  for (i = 0; i < PATHS_CNT; i++) {
+    if (make_path(path, peer, i) != 0 ||
+        bgpstream_as_path_store_get_path_id(store, path, peer, &id) != 0 ||
+        (spath = bgpstream_as_path_store_get_store_path(store, id)) == NULL ||
+        bgpstream_as_path_store_path_is_core(spath) != 1 ||
+        bgpstream_as_path_get_len(
+          bgpstream_as_path_store_path_get_int_path(spath)) != 2) {
+      goto done;
+    }
+  }
+  ret = 0;
+
+done:
+  bgpstream_as_path_destroy(path);
+  return ret;
+}
+
+/* check that every path in store1 has the same index and ID in store2 */
+static int compare_stores(bgpstream_as_path_store_t *store1,
+                          bgpstream_as_path_store_t *store2)
+{
+  bgpstream_as_path_store_path_t *spath1, *spath2;
+  bgpstream_as_path_store_path_id_t id;
+
+  bgpstream_as_path_store_iter_first_path(store1);
+  while (bgpstream_as_path_store_iter_has_more_path(store1)) {
+    id = bgpstream_as_path_store_iter_get_path_id(store1);
+    spath1 = bgpstream_as_path_store_iter_get_path(store1);
+    if ((spath2 = bgpstream_as_path_store_get_store_path(store2, id)) == NULL ||
+        bgpstream_as_path_store_path_get_idx(spath1) !=
+          bgpstream_as_path_store_path_get_idx(spath2) ||
+        bgpstream_as_path_store_path_is_core(spath1) !=
+          bgpstream_as_path_store_path_is_core(spath2) ||
+        !bgpstream_as_path_equal(
+          bgpstream_as_path_store_path_get_int_path(spath1),
+          bgpstream_as_path_store_path_get_int_path(spath2))) {
+      return -1;
+    }
+    bgpstream_as_path_store_iter_next_path(store1);
+  }
+  return 0;
+}
+
+static int test_as_path_store_persist()
+{
+  bgpstream_as_path_store_t *store, *loaded;
+  bgpstream_as_path_store_path_id_t id;
+  bgpstream_as_path_t *path = bgpstream_as_path_create();
+  uint32_t i;
+
+  unlink(DICT_FILE);
+
+  CHECK("AS Path Store dictionary save",
+        (store = bgpstream_as_path_store_create()) != NULL &&
+        make_path(path, 1, 1) == 0 &&
+        bgpstream_as_path_store_get_path_id(store, path, 2, &id) == 0 &&
+        check_paths(store, 65001) == 0 &&
+        bgpstream_as_path_store_save(store, DICT_FILE) == 0);
+
+  CHECK("AS Path Store dictionary load",
+        (loaded = bgpstream_as_path_store_load(DICT_FILE)) != NULL &&
+        bgpstream_as_path_store_get_size(loaded) ==
+          bgpstream_as_path_store_get_size(store) &&
+        compare_stores(store, loaded) == 0);
+
+  /* add new (non-core) paths to the loaded store and append them */
+  for (i = 0; i < PATHS_CNT; i++) {
+    if (make_path(path, 3, i) != 0 ||
+        bgpstream_as_path_store_get_path_id(loaded, path, 0, &id) != 0) {
+      break;
+    }
+  }
+  CHECK("AS Path Store dictionary append",
+        bgpstream_as_path_store_get_size(loaded) == PATHS_CNT * 2 + 1 &&
+        bgpstream_as_path_store_append(loaded, DICT_FILE) == 0);
+  bgpstream_as_path_store_destroy(store);
+
+  CHECK("AS Path Store dictionary reload",
+        (store = bgpstream_as_path_store_load(DICT_FILE)) != NULL &&
+        bgpstream_as_path_store_get_size(store) == PATHS_CNT * 2 + 1 &&
+        compare_stores(loaded, store) == 0);
+
+  bgpstream_as_path_store_destroy(store);
+  bgpstream_as_path_store_destroy(loaded);
+  bgpstream_as_path_destroy(path);
+  unlink(DICT_FILE);
+
+  return 0;
+}
+
+static void *insert_thread(void *user)
+{
+  return (void *)(intptr_t)check_paths(user, 65000);
+}
+
+static int test_as_path_store()
+{
+  bgpstream_as_path_store_t *store;
+  bgpstream_as_path_store_path_t *spath;
+  bgpstream_as_path_store_path_id_t id1, id2, id3;
+  bgpstream_as_path_t *path = bgpstream_as_path_create();
+  bgpstream_as_path_t *full = NULL;
+  pthread_t threads[THREADS_CNT];
+  uint32_t cnt;
+  void *tret;
+  int i, ok;
+
+  CHECK("AS Path Store create",
+        path != NULL && (store = bgpstream_as_path_store_create()) != NULL);
+
+  /* the same core path seen from two peers is stored once */
+  CHECK("AS Path Store insert core path",
+        make_path(path, 65001, 1) == 0 &&
+        bgpstream_as_path_store_get_path_id(store, path, 65001, &id1) == 0 &&
+        make_path(path, 65002, 1) == 0 &&
+        bgpstream_as_path_store_get_path_id(store, path, 65002, &id2) == 0 &&
+        memcmp(&id1, &id2, sizeof(id1)) == 0 &&
+        bgpstream_as_path_store_get_size(store) == 1);
+
+  /* a path without the peer prepended is not a core path */
+  CHECK("AS Path Store insert non-core path",
+        bgpstream_as_path_store_get_path_id(store, path, 1, &id3) == 0 &&
+        memcmp(&id1, &id3, sizeof(id1)) != 0 &&
+        bgpstream_as_path_store_get_size(store) == 2);
+
+  CHECK("AS Path Store lookup",
+        (spath = bgpstream_as_path_store_get_store_path(store, id1)) != NULL &&
+        bgpstream_as_path_store_path_is_core(spath) == 1 &&
+        bgpstream_as_path_store_path_get_idx(spath) == 0 &&
+        (full = bgpstream_as_path_store_path_get_path(spath, 65002)) != NULL &&
+        bgpstream_as_path_equal(full, path));
+  bgpstream_as_path_destroy(full);
+
+  CHECK("AS Path Store NULL path",
+        bgpstream_as_path_store_get_path_id(store, NULL, 0, &id3) == 0 &&
+        bgpstream_as_path_store_get_store_path(store, id3) == NULL);
+
+  CHECK("AS Path Store many paths",
+        check_paths(store, 65001) == 0 && check_paths(store, 65002) == 0 &&
+        bgpstream_as_path_store_get_size(store) == PATHS_CNT + 1);
+
+  cnt = 0;
+  ok = 1;
+  bgpstream_as_path_store_iter_first_path(store);
+  while (bgpstream_as_path_store_iter_has_more_path(store)) {
+    id1 = bgpstream_as_path_store_iter_get_path_id(store);
+    spath = bgpstream_as_path_store_iter_get_path(store);
+    if (bgpstream_as_path_store_path_get_idx(spath) != cnt ||
+        bgpstream_as_path_store_get_store_path(store, id1) != spath) {
+      ok = 0;
+    }
+    cnt++;
+    bgpstream_as_path_store_iter_next_path(store);
+  }
+  CHECK("AS Path Store iterate",
+        ok && cnt == bgpstream_as_path_store_get_size(store));
+
+  bgpstream_as_path_store_destroy(store);
+
+  /* concurrent inserts of the same paths are deduplicated */
+  CHECK("AS Path Store create concurrent",
+        (store = bgpstream_as_path_store_create_concurrent()) != NULL);
+  ok = 1;
+  for (i = 0; i < THREADS_CNT; i++) {
+    ok &= pthread_create(&threads[i], NULL, insert_thread, store) == 0;
+  }
+  for (i = 0; i < THREADS_CNT; i++) {
+    ok &= pthread_join(threads[i], &tret) == 0 && tret == NULL;
+  }
+  CHECK("AS Path Store concurrent insert",
+        ok && bgpstream_as_path_store_get_size(store) == PATHS_CNT);
+
+  bgpstream_as_path_store_destroy(store);
+  bgpstream_as_path_destroy(path);
+
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("AS Path Store", test_as_path_store() == 0);
+  CHECK_SECTION("AS Path Store Dictionary", test_as_path_store_persist() == 0);
+  ENDTEST;
+  return 0;
+}
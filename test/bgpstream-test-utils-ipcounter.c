@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2015 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IPV4_TEST_PFX_A "192.0.43.0/24"
+#define IPV4_TEST_PFX_B "130.217.0.0/16"
+#define IPV4_TEST_PFX_B_CHILD "130.217.250.0/24"
+#define IPV4_TEST_PFX_B_PARENT "130.216.0.0/15"
+#define IPV4_TEST_PFX_C "130.218.0.0/16"
+
+#define IPV6_TEST_PFX_A "2001:500:88::/48"
+#define IPV6_TEST_PFX_A_CHILD "2001:500:88:beef::/64"
+#define IPV6_TEST_PFX_B "2001:48d0:101:501::/64"
+#define IPV6_TEST_PFX_B_CHILD "2001:48d0:101:501:beef::/96"
+
+static int test_ip_counter()
+{
+  bgpstream_ip_counter_t *ipc;
+  bgpstream_pfx_t pfx;
+  bgpstream_pfx_t pfxs[4];
+  uint8_t more_specific;
+
+#define s2p(str) bgpstream_str2pfx((str), &pfx)
+#define IPCNT(v)                                                               \
+  bgpstream_ip_counter_get_ipcount(ipc, BGPSTREAM_ADDR_VERSION_IPV##v)
+#define OVERLAP(str) bgpstream_ip_counter_is_overlapping(ipc, s2p(str),       \
+                                                         &more_specific)
+
+  CHECK("Create IP Counter", (ipc = bgpstream_ip_counter_create()) != NULL);
+
+  /* IPv4 */
+  CHECK("IP Counter v4 add",
+        bgpstream_ip_counter_add(ipc, s2p(IPV4_TEST_PFX_A)) == 0 &&
+        bgpstream_ip_counter_add(ipc, s2p(IPV4_TEST_PFX_B_CHILD)) == 0 &&
+        IPCNT(4) == 512);
+  CHECK("IP Counter v4 add (covering)",
+        bgpstream_ip_counter_add(ipc, s2p(IPV4_TEST_PFX_B)) == 0 &&
+        IPCNT(4) == 256 + 65536);
+  CHECK("IP Counter v4 add (duplicate)",
+        bgpstream_ip_counter_add(ipc, s2p(IPV4_TEST_PFX_B_CHILD)) == 0 &&
+        IPCNT(4) == 256 + 65536);
+
+  CHECK("IP Counter v4 overlap (more specific)",
+        OVERLAP(IPV4_TEST_PFX_B_CHILD) == 256 && more_specific == 1);
+  CHECK("IP Counter v4 overlap (less specific)",
+        OVERLAP(IPV4_TEST_PFX_B_PARENT) == 65536 && more_specific == 0);
+  CHECK("IP Counter v4 overlap (none)",
+        OVERLAP(IPV4_TEST_PFX_C) == 0 && more_specific == 0);
+
+  /* IPv6 (counted in /64s) */
+  CHECK("IP Counter v6 add",
+        bgpstream_ip_counter_add(ipc, s2p(IPV6_TEST_PFX_A_CHILD)) == 0 &&
+        bgpstream_ip_counter_add(ipc, s2p(IPV6_TEST_PFX_B_CHILD)) == 0 &&
+        IPCNT(6) == 2);
+  CHECK("IP Counter v6 add (covering)",
+        bgpstream_ip_counter_add(ipc, s2p(IPV6_TEST_PFX_A)) == 0 &&
+        bgpstream_ip_counter_add(ipc, s2p(IPV6_TEST_PFX_B)) == 0 &&
+        IPCNT(6) == 65536 + 1);
+  CHECK("IP Counter v6 overlap (more specific)",
+        OVERLAP(IPV6_TEST_PFX_A_CHILD) == 1 && more_specific == 1);
+
+  /* Clear */
+  bgpstream_ip_counter_clear(ipc);
+  CHECK("IP Counter clear", IPCNT(4) == 0 && IPCNT(6) == 0);
+
+  /* Bulk add */
+  bgpstream_str2pfx(IPV4_TEST_PFX_B_CHILD, &pfxs[0]);
+  bgpstream_str2pfx(IPV6_TEST_PFX_B, &pfxs[1]);
+  bgpstream_str2pfx(IPV4_TEST_PFX_A, &pfxs[2]);
+  bgpstream_str2pfx(IPV4_TEST_PFX_B, &pfxs[3]);
+  CHECK("IP Counter add many",
+        bgpstream_ip_counter_add_many(ipc, pfxs, 4) == 0 &&
+        IPCNT(4) == 256 + 65536 && IPCNT(6) == 1);
+
+  bgpstream_ip_counter_destroy(ipc);
+
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("IP Counter", test_ip_counter() == 0);
+  ENDTEST;
+  return 0;
+}
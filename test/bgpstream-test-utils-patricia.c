@@ -52,6 +52,7 @@ static int test_patricia()
 {
   bgpstream_patricia_tree_t *pt;
   bgpstream_patricia_tree_result_set_t *res;
+  bgpstream_patricia_tree_iter_t it;
   bgpstream_patricia_node_t *node;
   bgpstream_pfx_t pfx;
   const bgpstream_pfx_t *pfxp;
@@ -68,6 +69,7 @@ static int test_patricia()
 #define BPT_get_pfx              bgpstream_patricia_tree_get_pfx
 #define BPT_get_mincovering_pfx  bgpstream_patricia_tree_get_mincovering_prefix
 #define BPT_pfx_count            bgpstream_patricia_prefix_count
+#define BPT_iter_next            bgpstream_patricia_tree_iter_next
 
 #define INSERT(ipv, str, count) \
   do { \
@@ -146,6 +148,51 @@ static int test_patricia()
         (pfxp = BPT_get_pfx(node)) != NULL &&
         bgpstream_pfx_equal(pfxp, s2p(IPV4_TEST_PFX_B)) != 0);
 
+  /* Iterators */
+  CHECK("Patricia Tree v4 more specifics iterator",
+        (node = BPT_search_exact(pt, s2p(IPV4_TEST_PFX_B))) != NULL &&
+        (bgpstream_patricia_tree_iter_init_more_specifics(&it, node), 1) &&
+        (node = BPT_iter_next(&it)) != NULL &&
+        (pfxp = BPT_get_pfx(node)) != NULL &&
+        bgpstream_pfx_equal(pfxp, s2p(IPV4_TEST_PFX_B_CHILD)) != 0 &&
+        BPT_iter_next(&it) == NULL);
+  CHECK("Patricia Tree v4 less specifics iterator",
+        (node = BPT_search_exact(pt, s2p(IPV4_TEST_PFX_B_CHILD))) != NULL &&
+        (bgpstream_patricia_tree_iter_init_less_specifics(&it, node), 1) &&
+        (node = BPT_iter_next(&it)) != NULL &&
+        (pfxp = BPT_get_pfx(node)) != NULL &&
+        bgpstream_pfx_equal(pfxp, s2p(IPV4_TEST_PFX_B)) != 0 &&
+        BPT_iter_next(&it) == NULL);
+  CHECK("Patricia Tree v4 pfx more specifics iterator",
+        (bgpstream_patricia_tree_iter_init_pfx_more_specifics(
+           &it, pt, s2p(IPV4_TEST_PFX_OVERLAP)), 1) &&
+        (node = BPT_iter_next(&it)) != NULL &&
+        (pfxp = BPT_get_pfx(node)) != NULL &&
+        bgpstream_pfx_equal(pfxp, s2p(IPV4_TEST_PFX_B_CHILD)) != 0 &&
+        BPT_iter_next(&it) == NULL);
+  CHECK("Patricia Tree v4 pfx less specifics iterator",
+        (bgpstream_patricia_tree_iter_init_pfx_less_specifics(
+           &it, pt, s2p(IPV4_TEST_PFX_OVERLAP)), 1) &&
+        (node = BPT_iter_next(&it)) != NULL &&
+        (pfxp = BPT_get_pfx(node)) != NULL &&
+        bgpstream_pfx_equal(pfxp, s2p(IPV4_TEST_PFX_B)) != 0 &&
+        BPT_iter_next(&it) == NULL);
+  CHECK("Patricia Tree v6 minimum coverage iterator",
+        BPT_get_minimum_coverage(pt, BGPSTREAM_ADDR_VERSION_IPV6, res) == 0 &&
+        (bgpstream_patricia_tree_iter_init_minimum_coverage(
+           &it, pt, BGPSTREAM_ADDR_VERSION_IPV6), 1) &&
+        BPT_iter_next(&it) == bgpstream_patricia_tree_result_set_next(res) &&
+        BPT_iter_next(&it) == bgpstream_patricia_tree_result_set_next(res) &&
+        BPT_iter_next(&it) == NULL);
+
+  /* Count-only queries */
+  CHECK("Patricia Tree v6 count more specifics",
+        (node = BPT_search_exact(pt, s2p(IPV6_TEST_PFX_A))) != NULL &&
+        bgpstream_patricia_tree_count_more_specifics(pt, node) == 1);
+  CHECK("Patricia Tree v6 count less specifics",
+        (node = BPT_search_exact(pt, s2p(IPV6_TEST_PFX_B_CHILD))) != NULL &&
+        bgpstream_patricia_tree_count_less_specifics(pt, node) == 1);
+
   bgpstream_patricia_tree_destroy(pt);
   bgpstream_patricia_tree_result_set_destroy(&res);
 
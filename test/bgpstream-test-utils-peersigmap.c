@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2015 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PEERS_CNT 2000
+#define THREADS_CNT 4
+
+static const char *collectors[] = {"rrc00", "rrc01", "route-views2"};
+
+static void make_addr(bgpstream_ip_addr_t *addr, int i)
+{
+  char buf[INET6_ADDRSTRLEN];
+  if (i % 2 == 0) {
+    snprintf(buf, sizeof(buf), "10.0.%d.%d", (i >> 8) & 0xff, i & 0xff);
+  } else {
+    snprintf(buf, sizeof(buf), "2001:db8::%x", i);
+  }
+  bgpstream_str2addr(buf, addr);
+}
+
+/* resolve every peer, and check that the IDs are dense and consistent */
+static int resolve_all(bgpstream_peer_sig_map_t *map)
+{
+  bgpstream_peer_sig_map_cache_t cache;
+  bgpstream_ip_addr_t addr;
+  bgpstream_peer_id_t id, id2;
+  bgpstream_peer_sig_t *sig;
+  int i, c;
+
+  memset(&cache, 0, sizeof(cache));
+  for (i = 0; i < PEERS_CNT; i++) {
+    make_addr(&addr, i);
+    for (c = 0; c < 3; c++) {
+      id = bgpstream_peer_sig_map_get_id_cached(map, &cache, collectors[c],
+                                                &addr, 65000 + i);
+      id2 = bgpstream_peer_sig_map_get_id(map, collectors[c], &addr, 1);
+      if (id == 0 || id != id2 || id > PEERS_CNT * 3 ||
+          (sig = bgpstream_peer_sig_map_get_sig(map, id)) == NULL ||
+          strcmp(sig->collector_str, collectors[c]) != 0 ||
+          !bgpstream_addr_equal(&sig->peer_ip_addr, &addr)) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void *resolve_thread(void *user)
+{
+  return (void *)(intptr_t)resolve_all(user);
+}
+
+static int test_peer_sig_map()
+{
+  bgpstream_peer_sig_map_t *map;
+  bgpstream_peer_sig_map_cache_t cache;
+  bgpstream_ip_addr_t addr1, addr2;
+  bgpstream_peer_id_t id1, id2;
+  bgpstream_peer_sig_t *sig;
+  pthread_t threads[THREADS_CNT];
+  void *tret;
+  int i, ok;
+
+  CHECK("Peer sig map create", (map = bgpstream_peer_sig_map_create()) != NULL);
+
+  make_addr(&addr1, 0);
+  make_addr(&addr2, 1);
+  id1 = bgpstream_peer_sig_map_get_id(map, "rrc00", &addr1, 65001);
+  id2 = bgpstream_peer_sig_map_get_id(map, "rrc00", &addr2, 65002);
+  CHECK("Peer sig map get ID", id1 == 1 && id2 == 2);
+  CHECK("Peer sig map get ID (existing)",
+        bgpstream_peer_sig_map_get_id(map, "rrc00", &addr1, 65001) == id1 &&
+        bgpstream_peer_sig_map_get_id(map, "rrc01", &addr1, 65001) == 3 &&
+        bgpstream_peer_sig_map_get_size(map) == 3);
+  CHECK("Peer sig map get sig",
+        (sig = bgpstream_peer_sig_map_get_sig(map, id2)) != NULL &&
+        strcmp(sig->collector_str, "rrc00") == 0 &&
+        bgpstream_addr_equal(&sig->peer_ip_addr, &addr2) &&
+        sig->peer_asnumber == 65002 &&
+        bgpstream_peer_sig_map_get_sig(map, 0) == NULL &&
+        bgpstream_peer_sig_map_get_sig(map, 4) == NULL);
+
+  /* the cache must not return stale IDs after a clear */
+  memset(&cache, 0, sizeof(cache));
+  CHECK("Peer sig map cached get ID",
+        bgpstream_peer_sig_map_get_id_cached(map, &cache, "rrc01", &addr1,
+                                             65001) == 3 &&
+        bgpstream_peer_sig_map_get_id_cached(map, &cache, "rrc01", &addr1,
+                                             65001) == 3);
+  bgpstream_peer_sig_map_clear(map);
+  CHECK("Peer sig map clear",
+        bgpstream_peer_sig_map_get_size(map) == 0 &&
+        bgpstream_peer_sig_map_get_sig(map, 1) == NULL &&
+        bgpstream_peer_sig_map_get_id_cached(map, &cache, "rrc01", &addr1,
+                                             65001) == 1 &&
+        bgpstream_peer_sig_map_get_size(map) == 1);
+  bgpstream_peer_sig_map_clear(map);
+
+  CHECK("Peer sig map many peers",
+        resolve_all(map) == 0 && resolve_all(map) == 0 &&
+        bgpstream_peer_sig_map_get_size(map) == PEERS_CNT * 3);
+  bgpstream_peer_sig_map_destroy(map);
+
+  CHECK("Peer sig map create concurrent",
+        (map = bgpstream_peer_sig_map_create_concurrent()) != NULL);
+  ok = 1;
+  for (i = 0; i < THREADS_CNT; i++) {
+    ok &= pthread_create(&threads[i], NULL, resolve_thread, map) == 0;
+  }
+  for (i = 0; i < THREADS_CNT; i++) {
+    ok &= pthread_join(threads[i], &tret) == 0 && tret == NULL;
+  }
+  CHECK("Peer sig map concurrent get ID",
+        ok && bgpstream_peer_sig_map_get_size(map) == PEERS_CNT * 3);
+  bgpstream_peer_sig_map_destroy(map);
+
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("Peer Signature Map", test_peer_sig_map() == 0);
+  ENDTEST;
+  return 0;
+}
@@ -26,16 +26,28 @@
 
 #include "bgpstream_test.h"
 
+#include "bgpstream_di_mgr.h"
+#include "bgpstream_filter.h"
+#include "bgpstream_utils_as_path_int.h"
 #include "utils.h"
 
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <wandio.h>
 
 #define singlefile_RECORDS 537347
 #define csvfile_RECORDS 559424
 #define sqlite_RECORDS 538308
 #define broker_RECORDS 2153
+#define directory_RECORDS 537347
 
 static bgpstream_t *bs;
 static bgpstream_record_t *rec;
@@ -112,6 +124,217 @@ static int test_singlefile()
 }
 #endif
 
+#ifdef WITH_DATA_INTERFACE_SINGLEFILE
+#define ELEMS_BATCH 64
+
+enum { ELEMS_NEXT, ELEMS_BATCH_COPY, ELEMS_FOREACH, ELEMS_COLUMNS };
+
+static int count_elem(bgpstream_record_t *record, bgpstream_elem_t *elem,
+                      void *user)
+{
+  return 0;
+}
+
+/* count the elems in the updates file using the given API */
+static int count_elems(int api, uint64_t *elem_cnt)
+{
+  bgpstream_elem_t *elems[ELEMS_BATCH];
+  bgpstream_elem_t *elem;
+  bgpstream_elem_batch_t *batch = NULL;
+  int ret, cnt, i;
+  int ok = 1;
+
+  SETUP;
+  if (api == ELEMS_COLUMNS) {
+    CHECK("elem batch create", (batch = bgpstream_elem_batch_create(NULL)));
+  }
+  CHECK_SET_INTERFACE(singlefile);
+  option = bgpstream_get_data_interface_option_by_name(bs, di_id, "upd-file");
+  bgpstream_set_data_interface_option(bs, option,
+                                      "ris.rrc06.updates.1427846400.gz");
+  CHECK("stream start (elems)", bgpstream_start(bs) == 0);
+
+  *elem_cnt = 0;
+  while ((ret = bgpstream_get_next_record(bs, &rec)) > 0) {
+    switch (api) {
+    case ELEMS_NEXT:
+      while ((cnt = bgpstream_record_get_next_elem(rec, &elem)) > 0) {
+        (*elem_cnt)++;
+      }
+      break;
+
+    case ELEMS_BATCH_COPY:
+      while ((cnt = bgpstream_record_get_elems(rec, elems, ELEMS_BATCH)) > 0) {
+        for (i = 0; i < cnt; i++) {
+          /* every elem in a batch must be distinct */
+          if (i > 0 && elems[i] == elems[i - 1]) {
+            ok = 0;
+          }
+        }
+        *elem_cnt += cnt;
+      }
+      break;
+
+    case ELEMS_FOREACH:
+      if ((cnt = bgpstream_record_foreach_elem(rec, count_elem, NULL)) > 0) {
+        *elem_cnt += cnt;
+      }
+      break;
+
+    case ELEMS_COLUMNS:
+      cnt = bgpstream_elem_batch_add_record(batch, rec);
+      break;
+    }
+    if (cnt < 0) {
+      ok = 0;
+    }
+  }
+  CHECK("final return code (elems)", ret == 0);
+  CHECK("read elems", ok);
+
+  if (batch != NULL) {
+    *elem_cnt = batch->elems_cnt;
+    bgpstream_elem_batch_destroy(batch);
+  }
+
+  TEARDOWN;
+  return 0;
+}
+
+static int test_singlefile_elems()
+{
+  uint64_t next_cnt, batch_cnt, foreach_cnt, columns_cnt;
+
+  CHECK("count elems (get_next_elem)",
+        count_elems(ELEMS_NEXT, &next_cnt) == 0 && next_cnt > 0);
+  CHECK("count elems (get_elems)",
+        count_elems(ELEMS_BATCH_COPY, &batch_cnt) == 0 &&
+        batch_cnt == next_cnt);
+  CHECK("count elems (foreach_elem)",
+        count_elems(ELEMS_FOREACH, &foreach_cnt) == 0 &&
+        foreach_cnt == next_cnt);
+  CHECK("count elems (elem_batch)",
+        count_elems(ELEMS_COLUMNS, &columns_cnt) == 0 &&
+        columns_cnt == next_cnt);
+
+  return 0;
+}
+#endif
+
+/* AS sets and confederation segments are flattened into the asns column, and
+ * listed in the seg_* columns */
+static int test_elem_batch_segs()
+{
+  bgpstream_record_t record;
+  bgpstream_elem_t *elem;
+  bgpstream_elem_batch_t *batch;
+  uint32_t first[] = {65001};
+  uint32_t set[] = {65002, 65003};
+  uint32_t confed[] = {65004, 65005};
+  uint32_t last[] = {65006};
+  uint32_t plain[] = {1, 2};
+  uint32_t asns[] = {65001, 65002, 65003, 65004, 65005, 65006, 1, 2};
+
+  memset(&record, 0, sizeof(record));
+  CHECK_MSG("elem batch segs setup", "could not create the elem and batch",
+            (elem = bgpstream_elem_create()) != NULL &&
+              (batch = bgpstream_elem_batch_create(NULL)) != NULL);
+
+  CHECK("add elem with segments",
+        bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN,
+                                 first, 1) == 0 &&
+          bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_SET,
+                                   set, 2) == 0 &&
+          bgpstream_as_path_append(elem->as_path,
+                                   BGPSTREAM_AS_PATH_SEG_CONFED_SEQ, confed,
+                                   2) == 0 &&
+          bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN,
+                                   last, 1) == 0 &&
+          bgpstream_elem_batch_add_elem(batch, &record, elem) == 0);
+
+  bgpstream_as_path_clear(elem->as_path);
+  CHECK("add elem without segments",
+        bgpstream_as_path_append(elem->as_path, BGPSTREAM_AS_PATH_SEG_ASN,
+                                 plain, 2) == 0 &&
+          bgpstream_elem_batch_add_elem(batch, &record, elem) == 0);
+
+  CHECK("batch asns",
+        batch->asns_cnt == ARR_CNT(asns) &&
+          memcmp(batch->asns, asns, sizeof(asns)) == 0 &&
+          batch->as_path_offset[1] == 6 && batch->as_path_offset[2] == 8);
+  CHECK("batch segments",
+        batch->segs_cnt == 2 && batch->segs_offset[0] == 0 &&
+          batch->segs_offset[1] == 2 && batch->segs_offset[2] == 2 &&
+          batch->seg_type[0] == BGPSTREAM_AS_PATH_SEG_SET &&
+          batch->seg_asn_offset[0] == 1 && batch->seg_asns_cnt[0] == 2 &&
+          batch->seg_type[1] == BGPSTREAM_AS_PATH_SEG_CONFED_SEQ &&
+          batch->seg_asn_offset[1] == 3 && batch->seg_asns_cnt[1] == 2);
+
+  bgpstream_elem_batch_clear(batch);
+  CHECK("batch clear", batch->elems_cnt == 0 && batch->segs_cnt == 0);
+
+  bgpstream_elem_batch_destroy(batch);
+  bgpstream_elem_destroy(elem);
+  return 0;
+}
+
+#ifdef WITH_DATA_INTERFACE_SINGLEFILE
+#define RETAIN_RECORDS 16
+
+static int test_singlefile_retain()
+{
+  bgpstream_record_t *retained[RETAIN_RECORDS];
+  uint32_t times[RETAIN_RECORDS];
+  int elem_cnts[RETAIN_RECORDS];
+  bgpstream_elem_t *elem;
+  int retained_cnt = 0;
+  int ret, i, cnt;
+  int ok = 1;
+
+  SETUP;
+  bgpstream_set_record_retain_mode(bs);
+  CHECK_SET_INTERFACE(singlefile);
+  option = bgpstream_get_data_interface_option_by_name(bs, di_id, "upd-file");
+  bgpstream_set_data_interface_option(bs, option,
+                                      "ris.rrc06.updates.1427846400.gz");
+  CHECK("stream start (retain)", bgpstream_start(bs) == 0);
+
+  /* retain the first few valid records, and count their elems later */
+  while ((ret = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (retained_cnt == RETAIN_RECORDS ||
+        rec->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      continue;
+    }
+    if (bgpstream_record_retain(rec) != 0) {
+      ok = 0;
+      break;
+    }
+    times[retained_cnt] = rec->time_sec;
+    elem_cnts[retained_cnt] = bgpstream_record_foreach_elem(rec, count_elem,
+                                                            NULL);
+    retained[retained_cnt++] = rec;
+  }
+  CHECK("final return code (retain)", ret == 0);
+  CHECK("retain records", ok && retained_cnt == RETAIN_RECORDS);
+
+  for (i = 0; i < retained_cnt; i++) {
+    cnt = 0;
+    while (bgpstream_record_get_next_elem(retained[i], &elem) > 0) {
+      cnt++;
+    }
+    if (retained[i]->time_sec != times[i] || cnt != elem_cnts[i] ||
+        (i > 0 && retained[i] == retained[i - 1])) {
+      ok = 0;
+    }
+    bgpstream_record_release(retained[i]);
+  }
+  CHECK("retained records unchanged", ok);
+
+  TEARDOWN;
+  return 0;
+}
+#endif
+
 #ifdef WITH_DATA_INTERFACE_CSVFILE
 static int test_csvfile()
 {
@@ -131,6 +354,268 @@ static int test_csvfile()
   TEARDOWN;
   return 0;
 }
+
+/* The tailing tests drive the csvfile interface through a data interface
+ * manager that is not in blocking mode, so that each poll is one call to
+ * update_resources followed by the records of the rows it pushed. Every row
+ * lists the same single-record dump, under a collector name of its own, so a
+ * poll yields one record for each row that was pushed. */
+
+#define CSV_TAIL_FILE "csvfile_tail.csv"
+#define CSV_TAIL_DUMP "csvfile_tail.mrt"
+#define CSV_TAIL_TIME 1427846400
+#define CSV_ROW_LEN 256
+
+static bgpstream_filter_mgr_t *csv_filter_mgr;
+static bgpstream_di_mgr_t *csv_di_mgr;
+
+// copy the first record of the test updates dump to its own (uncompressed)
+// file
+static int csv_tail_dump()
+{
+  uint8_t buf[65536];
+  io_t *in;
+  FILE *out;
+  uint32_t len;
+  int rc = -1;
+
+  if ((in = wandio_create("ris.rrc06.updates.1427846400.gz")) == NULL) {
+    return -1;
+  }
+  // the last 4 bytes of the MRT header hold the length of the record body
+  if (wandio_read(in, buf, 12) == 12) {
+    len = ((uint32_t)buf[8] << 24) | ((uint32_t)buf[9] << 16) |
+          ((uint32_t)buf[10] << 8) | buf[11];
+    if (len <= sizeof(buf) - 12 && wandio_read(in, buf + 12, len) == len &&
+        (out = fopen(CSV_TAIL_DUMP, "w")) != NULL) {
+      rc = (fwrite(buf, 1, 12 + len, out) == 12 + len) ? 0 : -1;
+      if (fclose(out) != 0) {
+        rc = -1;
+      }
+    }
+  }
+  wandio_destroy(in);
+  return rc;
+}
+
+static int csv_tail_start(int live, uint32_t rib_period, const char *sorted)
+{
+  bgpstream_data_interface_id_t id;
+  bgpstream_data_interface_option_t *opts;
+  int opts_cnt, i;
+
+  if ((csv_filter_mgr = bgpstream_filter_mgr_create()) == NULL ||
+      (csv_di_mgr = bgpstream_di_mgr_create(csv_filter_mgr)) == NULL) {
+    return -1;
+  }
+  // an open-ended interval puts the interface in live mode, without making
+  // the manager block
+  if ((live &&
+       bgpstream_filter_mgr_interval_filter_add(
+         csv_filter_mgr, CSV_TAIL_TIME, BGPSTREAM_FOREVER) != 0) ||
+      (rib_period != 0 && bgpstream_filter_mgr_rib_period_filter_add(
+                            csv_filter_mgr, rib_period) != 0) ||
+      bgpstream_filter_mgr_validate(csv_filter_mgr) != 0) {
+    return -1;
+  }
+
+  if ((id = bgpstream_di_mgr_get_data_interface_id_by_name(csv_di_mgr,
+                                                           "csvfile")) == 0 ||
+      bgpstream_di_mgr_set_data_interface(csv_di_mgr, id) != 0) {
+    return -1;
+  }
+  opts_cnt = bgpstream_di_mgr_get_data_interface_options(csv_di_mgr, id, &opts);
+  for (i = 0; i < opts_cnt; i++) {
+    if ((strcmp(opts[i].name, "csv-file") == 0 &&
+         bgpstream_di_mgr_set_data_interface_option(csv_di_mgr, &opts[i],
+                                                    CSV_TAIL_FILE) != 0) ||
+        (strcmp(opts[i].name, "sorted-index") == 0 &&
+         bgpstream_di_mgr_set_data_interface_option(csv_di_mgr, &opts[i],
+                                                    sorted) != 0)) {
+      return -1;
+    }
+  }
+
+  return bgpstream_di_mgr_start(csv_di_mgr);
+}
+
+static void csv_tail_stop()
+{
+  bgpstream_di_mgr_destroy(csv_di_mgr);
+  csv_di_mgr = NULL;
+  bgpstream_filter_mgr_destroy(csv_filter_mgr);
+  csv_filter_mgr = NULL;
+}
+
+static void csv_row(char *row, const char *collector, const char *type,
+                    uint32_t filetime, uint32_t timestamp)
+{
+  snprintf(row, CSV_ROW_LEN,
+           CSV_TAIL_DUMP ",ris,%s,%s,%" PRIu32 ",300,%" PRIu32 "\n", type,
+           collector, filetime, timestamp);
+}
+
+// write len bytes of the given row at offset off of the CSV file (or append
+// them if off is negative)
+static int csv_write(const char *mode, long off, const char *row, size_t len)
+{
+  FILE *f;
+  int rc;
+
+  if ((f = fopen(CSV_TAIL_FILE, mode)) == NULL) {
+    return -1;
+  }
+  rc = ((off < 0 || fseek(f, off, SEEK_SET) == 0) &&
+        fwrite(row, 1, len, f) == len)
+         ? 0
+         : -1;
+  if (fclose(f) != 0) {
+    rc = -1;
+  }
+  return rc;
+}
+
+static int csv_append(const char *collector, uint32_t timestamp)
+{
+  char row[CSV_ROW_LEN];
+
+  csv_row(row, collector, "updates", CSV_TAIL_TIME, timestamp);
+  return csv_write("a", -1, row, strlen(row));
+}
+
+static int cmp_char(const void *a, const void *b)
+{
+  return *(const char *)a - *(const char *)b;
+}
+
+// poll the interface once, and list the (single letter) collectors of the
+// records read, in alphabetical order since records with the same time may be
+// read in any order
+static int csv_poll(char *out, size_t len)
+{
+  bgpstream_record_t *record;
+  size_t cnt = 0;
+  int rc;
+
+  while ((rc = bgpstream_di_mgr_get_next_record(csv_di_mgr, &record)) > 0) {
+    if (record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD ||
+        cnt == len - 1) {
+      return -1;
+    }
+    out[cnt++] = record->collector_name[0];
+  }
+  qsort(out, cnt, 1, cmp_char);
+  out[cnt] = '\0';
+  return rc;
+}
+
+#define CSV_POLL(name, expected)                                               \
+  do {                                                                         \
+    CHECK(name, csv_poll(polled, sizeof(polled)) == 0 &&                       \
+                  strcmp(polled, expected) == 0);                              \
+  } while (0)
+
+static int test_csvfile_tail()
+{
+  char polled[CSV_ROW_LEN];
+  char row[CSV_ROW_LEN];
+  uint32_t now = epoch_sec();
+  struct stat st;
+  long held;
+
+  CHECK_MSG("csvfile tail setup", "could not write the test files",
+            csv_tail_dump() == 0 && csv_write("w", -1, "", 0) == 0 &&
+              csv_append("a", now - 60) == 0 &&
+              csv_append("b", now - 60) == 0);
+  CHECK_MSG("csvfile tail start", "could not start the csvfile interface",
+            csv_tail_start(1, 0, "0") == 0);
+
+  CSV_POLL("csvfile first poll", "ab");
+  CSV_POLL("csvfile unchanged", "");
+
+  // rows appended between two polls are pushed, but the earlier ones are not
+  // pushed again (even though their timestamps are the same)
+  CHECK("append rows", csv_append("c", now - 60) == 0 &&
+                         csv_append("d", now - 60) == 0);
+  CSV_POLL("csvfile appended rows", "cd");
+
+  // in live mode, a row without its newline may still be growing, so it is
+  // only read once it is complete
+  csv_row(row, "e", "updates", CSV_TAIL_TIME, now - 60);
+  CHECK("write a half row", csv_append("f", now - 60) == 0 &&
+                              csv_write("a", -1, row, 20) == 0);
+  CSV_POLL("csvfile half-written row", "f");
+  CHECK("complete the half row",
+        csv_write("a", -1, row + 20, strlen(row) - 20) == 0);
+  CSV_POLL("csvfile completed row", "e");
+
+  // a row that is too recent is held over to the next poll, which reads it
+  // again (along with the rows after it, which are not pushed twice)
+  CHECK("stat csv file", stat(CSV_TAIL_FILE, &st) == 0);
+  held = (long)st.st_size;
+  CHECK("append a recent row", csv_append("g", now + 3600) == 0 &&
+                                 csv_append("h", now - 60) == 0);
+  CSV_POLL("csvfile recent row held", "h");
+  CSV_POLL("csvfile recent row still held", "");
+  csv_row(row, "g", "updates", CSV_TAIL_TIME, now - 30);
+  CHECK("age the recent row", csv_write("r+", held, row, strlen(row)) == 0);
+  CSV_POLL("csvfile held row pushed", "g");
+
+  // a truncated file is read again from the start
+  CHECK("truncate csv file", csv_write("w", -1, "", 0) == 0 &&
+                               csv_append("i", now - 10) == 0);
+  CSV_POLL("csvfile truncated", "i");
+
+  // and so is a file that is replaced by another one, whose old rows are not
+  // pushed twice
+  CHECK("replace csv file",
+        rename(CSV_TAIL_FILE, CSV_TAIL_FILE ".old") == 0 &&
+          csv_write("w", -1, "", 0) == 0 && csv_append("i", now - 10) == 0 &&
+          csv_append("j", now - 5) == 0 && csv_append("k", now - 5) == 0);
+  CSV_POLL("csvfile replaced", "jk");
+
+  csv_tail_stop();
+  unlink(CSV_TAIL_FILE ".old");
+  unlink(CSV_TAIL_FILE);
+  unlink(CSV_TAIL_DUMP);
+  return 0;
+}
+
+/* With a RIB period, the resource manager keeps the first RIB it is given for
+ * a collector and drops those within the period after it, so the number of
+ * RIBs read shows whether the rows were pushed in filetime order. */
+static int test_csvfile_sorted()
+{
+  char polled[CSV_ROW_LEN];
+  char row[CSV_ROW_LEN];
+  uint32_t now = epoch_sec();
+  uint32_t filetimes[] = {CSV_TAIL_TIME + 1200, CSV_TAIL_TIME,
+                          CSV_TAIL_TIME + 600};
+  int i;
+
+  CHECK_MSG("csvfile sorted setup", "could not write the test files",
+            csv_tail_dump() == 0 && csv_write("w", -1, "", 0) == 0);
+  for (i = 0; i < ARR_CNT(filetimes); i++) {
+    csv_row(row, "a", "ribs", filetimes[i], now - 60);
+    CHECK_MSG("write rib row", "could not write the test files",
+              csv_write("a", -1, row, strlen(row)) == 0);
+  }
+
+  // in file order, the two earlier RIBs fall within the period of the first
+  CHECK_MSG("csvfile unsorted start", "could not start the csvfile interface",
+            csv_tail_start(0, 600, "0") == 0);
+  CSV_POLL("csvfile unsorted ribs", "a");
+  csv_tail_stop();
+
+  CHECK_MSG("csvfile sorted start", "could not start the csvfile interface",
+            csv_tail_start(0, 600, "1") == 0);
+  CSV_POLL("csvfile sorted ribs", "aaa");
+  csv_tail_stop();
+
+  unlink(CSV_TAIL_FILE);
+  unlink(CSV_TAIL_DUMP);
+  return 0;
+}
 #endif
 
 #ifdef WITH_DATA_INTERFACE_SQLITE
@@ -154,6 +639,307 @@ static int test_sqlite()
 }
 #endif
 
+#ifdef WITH_DATA_INTERFACE_DIRECTORY
+// the singlefile test data, laid out like the RouteViews and RIS archives
+#define DIRECTORY_RIB                                                          \
+  "route-views.jinx/bgpdata/2015.04/RIBS/rib.20150401.0000.bz2"
+#define DIRECTORY_UPD "rrc06/2015.04/updates.20150401.0000.gz"
+// a bgpdata directory that is neither at the root nor below a RouteViews
+// collector, whose files cannot be attributed and so are skipped
+#define DIRECTORY_UNKNOWN                                                      \
+  "mirror/bgpdata/2015.04/UPDATES/updates.20150401.0000.bz2"
+
+static char dir_root[] = "directory_test.XXXXXX";
+
+// build the path of dst below root, creating its parent directories
+static int dir_parents(const char *root, const char *dst, char *path,
+                       size_t len)
+{
+  char *p;
+
+  if (snprintf(path, len, "%s/%s", root, dst) >= (int)len) {
+    return -1;
+  }
+  for (p = strchr(path, '/'); p != NULL; p = strchr(p + 1, '/')) {
+    *p = '\0';
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+      return -1;
+    }
+    *p = '/';
+  }
+  return 0;
+}
+
+static int dir_link(const char *root, const char *src, const char *dst)
+{
+  char path[PATH_MAX];
+  char target[PATH_MAX];
+
+  if (dir_parents(root, dst, path, sizeof(path)) != 0 ||
+      realpath(src, target) == NULL) {
+    return -1;
+  }
+  return symlink(target, path);
+}
+
+static void dir_unlink(const char *root, const char *dst)
+{
+  char path[PATH_MAX];
+  char *p;
+
+  snprintf(path, sizeof(path), "%s/%s", root, dst);
+  unlink(path);
+  while ((p = strrchr(path, '/')) != NULL) {
+    *p = '\0';
+    rmdir(path);
+  }
+}
+
+static int test_directory()
+{
+  SETUP;
+
+  CHECK("create archive tree",
+        mkdtemp(dir_root) != NULL &&
+          dir_link(dir_root, "routeviews.route-views.jinx.ribs.1427846400.bz2",
+                   DIRECTORY_RIB) == 0 &&
+          dir_link(dir_root, "ris.rrc06.updates.1427846400.gz",
+                   DIRECTORY_UPD) == 0 &&
+          dir_link(dir_root,
+                   "routeviews.route-views.jinx.updates.1427846400.bz2",
+                   DIRECTORY_UNKNOWN) == 0);
+
+  CHECK_SET_INTERFACE(directory);
+
+  CHECK("get option (dir)",
+        (option = bgpstream_get_data_interface_option_by_name(
+           bs, di_id, "dir")) != NULL);
+  bgpstream_set_data_interface_option(bs, option, dir_root);
+
+  RUN(directory);
+
+  dir_unlink(dir_root, DIRECTORY_RIB);
+  dir_unlink(dir_root, DIRECTORY_UPD);
+  dir_unlink(dir_root, DIRECTORY_UNKNOWN);
+
+  TEARDOWN;
+  return 0;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* The live test drives the directory interface through a data interface
+ * manager that is not in blocking mode, so a call to get_next_record only
+ * waits for new dumps if the interface does. Every dump is a copy of the RIS
+ * updates dump under a collector of its own: rrc06 is indexed at start, rrc07
+ * is written in place and rrc08 moved into place while the interface waits,
+ * and rrc09 is written after the inotify queue has overflowed. */
+
+#define DIRECTORY_LIVE_SRC "ris.rrc06.updates.1427846400.gz"
+#define DIRECTORY_LIVE_UPD(coll) coll "/2015.04/updates.20150401.0000.gz"
+#define DIRECTORY_LIVE_TIMEOUT 30
+
+static char dir_live_root[] = "directory_live.XXXXXX";
+
+static const char *dir_live_dumps[] = {
+  DIRECTORY_LIVE_UPD("rrc06"),
+  DIRECTORY_LIVE_UPD("rrc07"),
+  DIRECTORY_LIVE_UPD("rrc08"),
+  DIRECTORY_LIVE_UPD("rrc09"),
+};
+
+// copy src to dst below root, writing it under a hidden name first and
+// moving it into place if tmp is set
+static int dir_copy(const char *root, const char *src, const char *dst,
+                    int tmp)
+{
+  char path[PATH_MAX];
+  char tmp_path[PATH_MAX];
+  char buf[4096];
+  const char *base;
+  FILE *in, *out;
+  size_t len;
+  int rc = 0;
+
+  if (dir_parents(root, dst, path, sizeof(path)) != 0) {
+    return -1;
+  }
+  base = strrchr(path, '/') + 1;
+  snprintf(tmp_path, sizeof(tmp_path), "%.*s.%s", (int)(base - path), path,
+           base);
+
+  if ((in = fopen(src, "r")) == NULL) {
+    return -1;
+  }
+  if ((out = fopen(tmp ? tmp_path : path, "w")) == NULL) {
+    fclose(in);
+    return -1;
+  }
+  while ((len = fread(buf, 1, sizeof(buf), in)) > 0) {
+    if (fwrite(buf, 1, len, out) != len) {
+      rc = -1;
+      break;
+    }
+  }
+  fclose(in);
+  if (fclose(out) != 0) {
+    rc = -1;
+  }
+  if (rc == 0 && tmp) {
+    rc = rename(tmp_path, path);
+  }
+  return rc;
+}
+
+// queue more inotify events than the kernel will hold, by creating hidden
+// files (which the interface ignores) in the root of the tree
+static int dir_flood(const char *root)
+{
+  char path[PATH_MAX];
+  long max;
+  FILE *f;
+  int rc;
+  long i;
+
+  if ((f = fopen("/proc/sys/fs/inotify/max_queued_events", "r")) == NULL) {
+    return -1;
+  }
+  rc = fscanf(f, "%ld", &max);
+  fclose(f);
+  if (rc != 1 || max <= 0 || max > (1 << 20)) {
+    return -1;
+  }
+
+  // each file queues a create and a close event
+  for (i = 0; i <= max / 2; i++) {
+    snprintf(path, sizeof(path), "%s/.flood%ld", root, i);
+    if ((f = fopen(path, "w")) == NULL) {
+      return -1;
+    }
+    fclose(f);
+    unlink(path);
+  }
+  return 0;
+}
+
+static void dir_live_alarm(int sig)
+{
+  // only here to interrupt the wait for new files
+}
+
+static int dir_live_start(bgpstream_filter_mgr_t **filter_mgr,
+                          bgpstream_di_mgr_t **di_mgr)
+{
+  bgpstream_data_interface_id_t id;
+  bgpstream_data_interface_option_t *opts;
+  int opts_cnt, i;
+
+  if ((*filter_mgr = bgpstream_filter_mgr_create()) == NULL ||
+      (*di_mgr = bgpstream_di_mgr_create(*filter_mgr)) == NULL ||
+      bgpstream_filter_mgr_interval_filter_add(*filter_mgr, 1427846400,
+                                               BGPSTREAM_FOREVER) != 0 ||
+      bgpstream_filter_mgr_validate(*filter_mgr) != 0) {
+    return -1;
+  }
+
+  if ((id = bgpstream_di_mgr_get_data_interface_id_by_name(
+         *di_mgr, "directory")) == 0 ||
+      bgpstream_di_mgr_set_data_interface(*di_mgr, id) != 0) {
+    return -1;
+  }
+  opts_cnt = bgpstream_di_mgr_get_data_interface_options(*di_mgr, id, &opts);
+  for (i = 0; i < opts_cnt; i++) {
+    if (strcmp(opts[i].name, "dir") == 0 &&
+        bgpstream_di_mgr_set_data_interface_option(*di_mgr, &opts[i],
+                                                   dir_live_root) != 0) {
+      return -1;
+    }
+  }
+
+  return bgpstream_di_mgr_start(*di_mgr);
+}
+
+static int test_directory_live()
+{
+  bgpstream_filter_mgr_t *filter_mgr = NULL;
+  bgpstream_di_mgr_t *di_mgr = NULL;
+  bgpstream_record_t *record;
+  struct sigaction sa;
+  char path[PATH_MAX];
+  unsigned int found = 0, want = 0;
+  int status = -1;
+  pid_t pid;
+  int rc = 0;
+  int i;
+
+  // every dump directory exists at start, so that new dumps are reported by
+  // the watch on their directory
+  CHECK_MSG("create live archive tree", "could not write the test files",
+            mkdtemp(dir_live_root) != NULL &&
+              dir_link(dir_live_root, DIRECTORY_LIVE_SRC,
+                       dir_live_dumps[0]) == 0 &&
+              dir_parents(dir_live_root, dir_live_dumps[1], path,
+                          sizeof(path)) == 0 &&
+              dir_parents(dir_live_root, dir_live_dumps[2], path,
+                          sizeof(path)) == 0 &&
+              dir_parents(dir_live_root, dir_live_dumps[3], path,
+                          sizeof(path)) == 0);
+  CHECK_MSG("directory live start", "could not start the directory interface",
+            dir_live_start(&filter_mgr, &di_mgr) == 0);
+
+  // the event for rrc09 is dropped, so only a rescan can find it
+  CHECK_MSG("overflow inotify queue", "could not flood the inotify queue",
+            dir_flood(dir_live_root) == 0 &&
+              dir_copy(dir_live_root, DIRECTORY_LIVE_SRC, dir_live_dumps[3],
+                       0) == 0);
+
+  // rrc07 and rrc08 are only written once the records we have are read
+  if ((pid = fork()) == 0) {
+    sleep(1);
+    _exit((dir_copy(dir_live_root, DIRECTORY_LIVE_SRC, dir_live_dumps[1],
+                    0) == 0 &&
+           dir_copy(dir_live_root, DIRECTORY_LIVE_SRC, dir_live_dumps[2],
+                    1) == 0)
+            ? 0
+            : 1);
+  }
+  CHECK("fork dump writer", pid > 0);
+
+  // if the interface waits for too long, interrupt it
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = dir_live_alarm;
+  sigaction(SIGALRM, &sa, NULL);
+  alarm(DIRECTORY_LIVE_TIMEOUT);
+
+  for (i = 6; i <= 9; i++) {
+    want |= 1 << i;
+  }
+  while (found != want &&
+         (rc = bgpstream_di_mgr_get_next_record(di_mgr, &record)) > 0) {
+    if (strncmp(record->collector_name, "rrc", 3) == 0) {
+      found |= 1 << atoi(record->collector_name + 3);
+    }
+  }
+  alarm(0);
+  waitpid(pid, &status, 0);
+
+  CHECK("directory live return code", rc > 0);
+  CHECK("directory indexed dump", (found & (1 << 6)) != 0);
+  CHECK("directory dump closed after start", (found & (1 << 7)) != 0);
+  CHECK("directory dump moved in after start", (found & (1 << 8)) != 0);
+  CHECK("directory dump rescanned after overflow", (found & (1 << 9)) != 0);
+  CHECK("dump writer exit status",
+        WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  bgpstream_di_mgr_destroy(di_mgr);
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  for (i = 0; i < ARR_CNT(dir_live_dumps); i++) {
+    dir_unlink(dir_live_root, dir_live_dumps[i]);
+  }
+  return 0;
+}
+#endif
+#endif
+
 #ifdef WITH_DATA_INTERFACE_BROKER
 static int test_broker()
 {
@@ -183,17 +969,26 @@ static int test_broker()
 int main()
 {
   CHECK_SECTION("BGPStream", test_bgpstream() == 0);
+  CHECK_SECTION("elem batch AS path segments", test_elem_batch_segs() == 0);
 
 #ifdef WITH_DATA_INTERFACE_SINGLEFILE
   CHECK_SECTION("singlefile data interface", test_singlefile() == 0);
+  CHECK_SECTION("singlefile elems", test_singlefile_elems() == 0);
+  CHECK_SECTION("singlefile record retain", test_singlefile_retain() == 0);
 #else
   SKIPPED_SECTION("singlefile data interface");
+  SKIPPED_SECTION("singlefile elems");
+  SKIPPED_SECTION("singlefile record retain");
 #endif
 
 #ifdef WITH_DATA_INTERFACE_CSVFILE
   CHECK_SECTION("csvfile data interface", test_csvfile() == 0);
+  CHECK_SECTION("csvfile index tailing", test_csvfile_tail() == 0);
+  CHECK_SECTION("csvfile sorted index", test_csvfile_sorted() == 0);
 #else
   SKIPPED_SECTION("csvfile data interface");
+  SKIPPED_SECTION("csvfile index tailing");
+  SKIPPED_SECTION("csvfile sorted index");
 #endif
 
 #ifdef WITH_DATA_INTERFACE_SQLITE
@@ -202,6 +997,18 @@ int main()
   SKIPPED_SECTION("sqlite data interface");
 #endif
 
+#ifdef WITH_DATA_INTERFACE_DIRECTORY
+  CHECK_SECTION("directory data interface", test_directory() == 0);
+#ifdef HAVE_SYS_INOTIFY_H
+  CHECK_SECTION("directory live mode", test_directory_live() == 0);
+#else
+  SKIPPED_SECTION("directory live mode");
+#endif
+#else
+  SKIPPED_SECTION("directory data interface");
+  SKIPPED_SECTION("directory live mode");
+#endif
+
 #ifdef WITH_DATA_INTERFACE_BROKER
   CHECK_SECTION("broker data interface", test_broker() == 0);
 #else
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_TEST_HELPERS_H
+#define __BGPSTREAM_TEST_HELPERS_H
+
+#include "bgpstream.h"
+#include "bgpstream_resource.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Helpers shared by the tests that compare the output of two streams, and by
+ * the tests of the cache transport. Include after bgpstream_test.h. */
+
+#define TEST_LINE_LEN 65536
+
+/* the output lines of a stream */
+typedef struct lines {
+  char **lines;
+  int lines_cnt;
+  int alloc_cnt;
+} lines_t;
+
+static char test_line_buf[TEST_LINE_LEN] UNUSED;
+
+static int UNUSED lines_add(lines_t *lines, const char *line)
+{
+  char **tmp;
+
+  if (lines->lines_cnt == lines->alloc_cnt) {
+    lines->alloc_cnt = (lines->alloc_cnt == 0) ? 1024 : lines->alloc_cnt * 2;
+    if ((tmp = realloc(lines->lines, sizeof(char *) * lines->alloc_cnt)) ==
+        NULL) {
+      return -1;
+    }
+    lines->lines = tmp;
+  }
+  if ((lines->lines[lines->lines_cnt] = strdup(line)) == NULL) {
+    return -1;
+  }
+  lines->lines_cnt++;
+  return 0;
+}
+
+static void UNUSED lines_free(lines_t *lines)
+{
+  int i;
+
+  for (i = 0; i < lines->lines_cnt; i++) {
+    free(lines->lines[i]);
+  }
+  free(lines->lines);
+  memset(lines, 0, sizeof(*lines));
+}
+
+/* Add the output line of the given elem */
+static int UNUSED lines_add_elem(lines_t *lines, bgpstream_record_t *rec,
+                                 bgpstream_elem_t *elem)
+{
+  if (bgpstream_record_elem_snprintf(test_line_buf, sizeof(test_line_buf), rec,
+                                     elem) == NULL) {
+    return -1;
+  }
+  return lines_add(lines, test_line_buf);
+}
+
+/* Add the output lines of the (remaining) elems of the given record */
+static int UNUSED lines_add_record(lines_t *lines, bgpstream_record_t *rec)
+{
+  bgpstream_elem_t *elem;
+  int rc;
+
+  while ((rc = bgpstream_record_get_next_elem(rec, &elem)) > 0) {
+    if (lines_add_elem(lines, rec, elem) != 0) {
+      return -1;
+    }
+  }
+  return rc;
+}
+
+/* Are both sets of lines the same? If not, the first difference is printed
+ * (using the given names for the two streams) */
+static int UNUSED lines_equal(lines_t *a, const char *a_name, lines_t *b,
+                              const char *b_name)
+{
+  int i;
+
+  if (a->lines_cnt != b->lines_cnt) {
+    printf("# elem counts differ: %s %d, %s %d\n", a_name, a->lines_cnt,
+           b_name, b->lines_cnt);
+  }
+  for (i = 0; i < a->lines_cnt && i < b->lines_cnt; i++) {
+    if (strcmp(a->lines[i], b->lines[i]) != 0) {
+      printf("# elem %d differs:\n#  %s: %s\n#  %s: %s\n", i, a_name,
+             a->lines[i], b_name, b->lines[i]);
+      return 0;
+    }
+  }
+  return a->lines_cnt == b->lines_cnt;
+}
+
+/* Writer callback that writes to the FILE given as user pointer */
+static int UNUSED write_file(const uint8_t *data, size_t len, void *user)
+{
+  return (fwrite(data, 1, len, user) == len) ? 0 : -1;
+}
+
+/* Create and start a stream using the given data interface, with the given
+ * (NULL-terminated) list of option name/value pairs. The filter string and
+ * interval (if begin_time is not 0) are optional. */
+static bgpstream_t UNUSED *create_stream(const char *di_name,
+                                         const char *const *opts,
+                                         const char *filter,
+                                         uint32_t begin_time,
+                                         uint32_t end_time)
+{
+  bgpstream_t *bs;
+  bgpstream_data_interface_id_t di_id;
+  bgpstream_data_interface_option_t *option;
+
+  if ((bs = bgpstream_create()) == NULL) {
+    return NULL;
+  }
+  di_id = bgpstream_get_data_interface_id_by_name(bs, di_name);
+  bgpstream_set_data_interface(bs, di_id);
+  for (; opts != NULL && opts[0] != NULL; opts += 2) {
+    if ((option = bgpstream_get_data_interface_option_by_name(
+           bs, di_id, opts[0])) == NULL ||
+        bgpstream_set_data_interface_option(bs, option, opts[1]) != 0) {
+      goto err;
+    }
+  }
+  if (filter != NULL && bgpstream_parse_filter_string(bs, filter) == 0) {
+    goto err;
+  }
+  if (begin_time != 0 &&
+      bgpstream_add_interval_filter(bs, begin_time, end_time) != 0) {
+    goto err;
+  }
+  if (bgpstream_start(bs) != 0) {
+    goto err;
+  }
+  return bs;
+
+err:
+  bgpstream_destroy(bs);
+  return NULL;
+}
+
+/* Create and start a stream that reads a single file of the given format */
+static bgpstream_t UNUSED *create_file_stream(const char *type,
+                                              const char *file)
+{
+  const char *opts[] = {"upd-type", type, "upd-file", file, NULL};
+  return create_stream("singlefile", opts, NULL, 0, 0);
+}
+
+/* Create a resource for one of the test dumps, read through the cache
+ * transport into cache_dir (with the given quota, if not NULL) */
+static bgpstream_resource_t UNUSED *
+create_cache_resource(const char *url, const char *collector,
+                      const char *cache_dir, const char *quota)
+{
+  bgpstream_resource_t *res;
+
+  if ((res = bgpstream_resource_create(
+         BGPSTREAM_RESOURCE_TRANSPORT_CACHE, BGPSTREAM_RESOURCE_FORMAT_MRT,
+         url, 1427846400, 300, "test", collector, BGPSTREAM_UPDATE)) == NULL) {
+    return NULL;
+  }
+  if (bgpstream_resource_set_attr(res, BGPSTREAM_RESOURCE_ATTR_CACHE_DIR_PATH,
+                                  cache_dir) != 0 ||
+      (quota != NULL &&
+       bgpstream_resource_set_attr(res, BGPSTREAM_RESOURCE_ATTR_CACHE_QUOTA,
+                                   quota) != 0)) {
+    bgpstream_resource_destroy(res);
+    return NULL;
+  }
+  return res;
+}
+
+/* Path of the cache file with the given name (hash) and suffix */
+static void UNUSED cache_path(char *path, size_t len, const char *cache_dir,
+                              const char *name, const char *suffix)
+{
+  snprintf(path, len, "%s/%s%s", cache_dir, name, suffix);
+}
+
+/* Path of the cache file of the given resource, with the given suffix */
+static void UNUSED cache_res_path(char *path, size_t len,
+                                  const char *cache_dir,
+                                  bgpstream_resource_t *res,
+                                  const char *suffix)
+{
+  char hash[1024];
+
+  bgpstream_resource_hash_snprintf(hash, sizeof(hash), res);
+  cache_path(path, len, cache_dir, hash, suffix);
+}
+
+/* Is the given resource in the cache? */
+static int UNUSED cached(const char *cache_dir, bgpstream_resource_t *res)
+{
+  char path[2048];
+
+  cache_res_path(path, sizeof(path), cache_dir, res, ".cache");
+  return access(path, R_OK) == 0;
+}
+
+#endif /* __BGPSTREAM_TEST_HELPERS_H */
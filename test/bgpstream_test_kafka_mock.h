@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_TEST_KAFKA_MOCK_H
+#define __BGPSTREAM_TEST_KAFKA_MOCK_H
+
+#include <librdkafka/rdkafka.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* An in-memory stand-in for the parts of librdkafka that the Kafka transport
+ * uses. These definitions take the place of the librdkafka ones in the test
+ * program, so every Kafka consumer it creates (directly, or through the
+ * "kafka" data interface) reads from one of the queues below, which the test
+ * fills with mock_kafka_produce. Consumers are numbered in the order they are
+ * created. Include after bgpstream_test.h, in a single source file. */
+
+#define MOCK_KAFKA_CONSUMERS_MAX 16
+
+struct rd_kafka_conf_s {
+  void *opaque;
+};
+
+struct rd_kafka_queue_s {
+  struct rd_kafka_s *rk;
+};
+
+struct rd_kafka_s {
+  // queued messages, linked through their _private pointer
+  rd_kafka_message_t *head;
+  rd_kafka_message_t *tail;
+
+  // where (and what) to write when a message is added to an empty queue
+  int wakeup_fd;
+  const void *wakeup_payload;
+  size_t wakeup_size;
+
+  // counters for the test to check
+  int consume_cnt;
+  int created_cnt;
+  int destroyed_cnt;
+
+  struct rd_kafka_queue_s queue;
+};
+
+/* protects all of the consumers */
+static pthread_mutex_t mock_kafka_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct rd_kafka_s mock_kafka[MOCK_KAFKA_CONSUMERS_MAX];
+static int mock_kafka_cnt = 0;
+
+/* Drop any queued messages and forget about the consumers created so far (all
+ * of which must have been destroyed). Call before creating any consumers. */
+static void UNUSED mock_kafka_reset(void)
+{
+  rd_kafka_message_t *msg;
+  int i;
+
+  pthread_mutex_lock(&mock_kafka_mutex);
+  for (i = 0; i < MOCK_KAFKA_CONSUMERS_MAX; i++) {
+    while ((msg = mock_kafka[i].head) != NULL) {
+      mock_kafka[i].head = msg->_private;
+      free(msg->payload);
+      free(msg);
+    }
+  }
+  memset(mock_kafka, 0, sizeof(mock_kafka));
+  for (i = 0; i < MOCK_KAFKA_CONSUMERS_MAX; i++) {
+    mock_kafka[i].wakeup_fd = -1;
+    mock_kafka[i].queue.rk = &mock_kafka[i];
+  }
+  mock_kafka_cnt = 0;
+  pthread_mutex_unlock(&mock_kafka_mutex);
+}
+
+/* Add a message (or, if err is not 0, an error event, and the payload is
+ * ignored) to the queue of the given consumer, which need not have been created
+ * yet */
+static int UNUSED mock_kafka_produce(int consumer, const void *payload,
+                                     size_t len, rd_kafka_resp_err_t err)
+{
+  struct rd_kafka_s *rk = &mock_kafka[consumer];
+  rd_kafka_message_t *msg;
+
+  if ((msg = calloc(1, sizeof(rd_kafka_message_t))) == NULL) {
+    return -1;
+  }
+  // error events carry no data
+  if (err == 0) {
+    if ((msg->payload = malloc(len + 1)) == NULL) {
+      free(msg);
+      return -1;
+    }
+    memcpy(msg->payload, payload, len);
+    msg->len = len;
+  }
+  msg->err = err;
+
+  pthread_mutex_lock(&mock_kafka_mutex);
+  if (rk->head == NULL) {
+    rk->head = msg;
+    // like rdkafka, only signal the transition from empty to non-empty
+    if (rk->wakeup_fd != -1 &&
+        write(rk->wakeup_fd, rk->wakeup_payload, rk->wakeup_size) < 0) {
+      // the pipe is full, so the reader will wake anyway
+    }
+  } else {
+    rk->tail->_private = msg;
+  }
+  rk->tail = msg;
+  rk->created_cnt++;
+  pthread_mutex_unlock(&mock_kafka_mutex);
+  return 0;
+}
+
+/* Add a string message to the queue of the given consumer */
+static int UNUSED mock_kafka_produce_str(int consumer, const char *str)
+{
+  return mock_kafka_produce(consumer, str, strlen(str), 0);
+}
+
+/* Number of times the given consumer's queue has been consumed from */
+static int UNUSED mock_kafka_consume_cnt(int consumer)
+{
+  int cnt;
+
+  pthread_mutex_lock(&mock_kafka_mutex);
+  cnt = mock_kafka[consumer].consume_cnt;
+  pthread_mutex_unlock(&mock_kafka_mutex);
+  return cnt;
+}
+
+/* Number of messages that have been added to the given consumer's queue */
+static int UNUSED mock_kafka_created_cnt(int consumer)
+{
+  int cnt;
+
+  pthread_mutex_lock(&mock_kafka_mutex);
+  cnt = mock_kafka[consumer].created_cnt;
+  pthread_mutex_unlock(&mock_kafka_mutex);
+  return cnt;
+}
+
+/* Number of the given consumer's messages that have been destroyed */
+static int UNUSED mock_kafka_destroyed_cnt(int consumer)
+{
+  int cnt;
+
+  pthread_mutex_lock(&mock_kafka_mutex);
+  cnt = mock_kafka[consumer].destroyed_cnt;
+  pthread_mutex_unlock(&mock_kafka_mutex);
+  return cnt;
+}
+
+/* ========== LIBRDKAFKA API ========== */
+
+rd_kafka_conf_t *rd_kafka_conf_new(void)
+{
+  return calloc(1, sizeof(rd_kafka_conf_t));
+}
+
+rd_kafka_conf_res_t rd_kafka_conf_set(rd_kafka_conf_t *conf, const char *name,
+                                      const char *value, char *errstr,
+                                      size_t errstr_size)
+{
+  return RD_KAFKA_CONF_OK;
+}
+
+void rd_kafka_conf_set_error_cb(rd_kafka_conf_t *conf,
+                                void (*error_cb)(rd_kafka_t *rk, int err,
+                                                 const char *reason,
+                                                 void *opaque))
+{
+}
+
+void rd_kafka_conf_set_opaque(rd_kafka_conf_t *conf, void *opaque)
+{
+  conf->opaque = opaque;
+}
+
+rd_kafka_t *rd_kafka_new(rd_kafka_type_t type, rd_kafka_conf_t *conf,
+                         char *errstr, size_t errstr_size)
+{
+  rd_kafka_t *rk = NULL;
+
+  pthread_mutex_lock(&mock_kafka_mutex);
+  if (mock_kafka_cnt < MOCK_KAFKA_CONSUMERS_MAX) {
+    rk = &mock_kafka[mock_kafka_cnt++];
+  }
+  pthread_mutex_unlock(&mock_kafka_mutex);
+  if (rk == NULL) {
+    snprintf(errstr, errstr_size, "Too many mock consumers");
+    return NULL;
+  }
+  // the instance owns the config
+  free(conf);
+  return rk;
+}
+
+int rd_kafka_brokers_add(rd_kafka_t *rk, const char *brokerlist)
+{
+  return 1;
+}
+
+rd_kafka_topic_partition_list_t *rd_kafka_topic_partition_list_new(int size)
+{
+  rd_kafka_topic_partition_list_t *list;
+
+  if ((list = calloc(1, sizeof(rd_kafka_topic_partition_list_t))) == NULL ||
+      (list->elems = calloc(size, sizeof(rd_kafka_topic_partition_t))) ==
+        NULL) {
+    free(list);
+    return NULL;
+  }
+  list->size = size;
+  return list;
+}
+
+rd_kafka_topic_partition_t *
+rd_kafka_topic_partition_list_add(rd_kafka_topic_partition_list_t *rktparlist,
+                                  const char *topic, int32_t partition)
+{
+  rd_kafka_topic_partition_t *rktpar;
+
+  if (rktparlist->cnt == rktparlist->size) {
+    return NULL;
+  }
+  rktpar = &rktparlist->elems[rktparlist->cnt++];
+  rktpar->topic = strdup(topic);
+  rktpar->partition = partition;
+  return rktpar;
+}
+
+void rd_kafka_topic_partition_list_destroy(
+  rd_kafka_topic_partition_list_t *rkparlist)
+{
+  int i;
+
+  for (i = 0; i < rkparlist->cnt; i++) {
+    free(rkparlist->elems[i].topic);
+  }
+  free(rkparlist->elems);
+  free(rkparlist);
+}
+
+rd_kafka_resp_err_t
+rd_kafka_subscribe(rd_kafka_t *rk,
+                   const rd_kafka_topic_partition_list_t *topics)
+{
+  return RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
+int rd_kafka_poll(rd_kafka_t *rk, int timeout_ms)
+{
+  return 0;
+}
+
+rd_kafka_resp_err_t rd_kafka_poll_set_consumer(rd_kafka_t *rk)
+{
+  return RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
+rd_kafka_queue_t *rd_kafka_queue_get_consumer(rd_kafka_t *rk)
+{
+  return &rk->queue;
+}
+
+void rd_kafka_queue_io_event_enable(rd_kafka_queue_t *rkqu, int fd,
+                                    const void *payload, size_t size)
+{
+  pthread_mutex_lock(&mock_kafka_mutex);
+  rkqu->rk->wakeup_fd = fd;
+  rkqu->rk->wakeup_payload = payload;
+  rkqu->rk->wakeup_size = size;
+  pthread_mutex_unlock(&mock_kafka_mutex);
+}
+
+void rd_kafka_queue_destroy(rd_kafka_queue_t *rkqu)
+{
+}
+
+ssize_t rd_kafka_consume_batch_queue(rd_kafka_queue_t *rkqu, int timeout_ms,
+                                     rd_kafka_message_t **rkmessages,
+                                     size_t rkmessages_size)
+{
+  struct rd_kafka_s *rk = rkqu->rk;
+  ssize_t cnt = 0;
+
+  pthread_mutex_lock(&mock_kafka_mutex);
+  while (rk->head != NULL && (size_t)cnt < rkmessages_size) {
+    rkmessages[cnt] = rk->head;
+    rk->head = rk->head->_private;
+    // remember which consumer the message came from
+    rkmessages[cnt]->_private = rk;
+    cnt++;
+  }
+  if (rk->head == NULL) {
+    rk->tail = NULL;
+  }
+  rk->consume_cnt++;
+  pthread_mutex_unlock(&mock_kafka_mutex);
+  return cnt;
+}
+
+void rd_kafka_message_destroy(rd_kafka_message_t *rkmessage)
+{
+  struct rd_kafka_s *rk = rkmessage->_private;
+
+  pthread_mutex_lock(&mock_kafka_mutex);
+  rk->destroyed_cnt++;
+  pthread_mutex_unlock(&mock_kafka_mutex);
+  free(rkmessage->payload);
+  free(rkmessage);
+}
+
+const char *rd_kafka_err2str(rd_kafka_resp_err_t err)
+{
+  return (err == RD_KAFKA_RESP_ERR__PARTITION_EOF) ? "Partition EOF"
+                                                   : "Mock Kafka error";
+}
+
+rd_kafka_resp_err_t rd_kafka_last_error(void)
+{
+  return RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
+rd_kafka_resp_err_t rd_kafka_consumer_close(rd_kafka_t *rk)
+{
+  return RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
+void rd_kafka_destroy(rd_kafka_t *rk)
+{
+}
+
+#endif /* __BGPSTREAM_TEST_KAFKA_MOCK_H */
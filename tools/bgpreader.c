@@ -39,6 +39,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/ioctl.h> // for TIOCGWINSZ
 #ifdef WITH_RPKI
 #include "utils/bgpstream_utils_rpki.h"
@@ -77,6 +78,16 @@ enum rpki_options {
   RPKI_OPTION_DEFAULT = 504
 };
 
+enum output_options {
+  OUTPUT_OPTION_THREADS = 600,
+  OUTPUT_OPTION_BUFFER_SIZE = 601,
+  OUTPUT_OPTION_COLUMNAR = 602,
+  OUTPUT_OPTION_COLUMNAR_WINDOW = 603,
+  OUTPUT_OPTION_SHM = 604,
+  OUTPUT_OPTION_SHM_SIZE = 605,
+  OUTPUT_OPTION_COLUMNAR_CODEC = 606
+};
+
 struct bs_options_t {
   struct option option;
   const char *usage;
@@ -156,6 +167,29 @@ static struct bs_options_t bs_opts[] =
    "",
    "print info "
    "for each BGP record in bgpdump -m format"},
+  {{"output-binary", no_argument, 0, 'b'},
+   "",
+   "write each BGP record and its elems as a binary elem stream, which can be "
+   "read back using the singlefile data interface (type 'binary')"},
+  {{"output-columnar", no_argument, 0, OUTPUT_OPTION_COLUMNAR},
+   "",
+   "write each BGP record and its elems to a columnar elem archive, which "
+   "can be read back using the singlefile data interface (type 'columnar')"},
+  {{"columnar-window", required_argument, 0, OUTPUT_OPTION_COLUMNAR_WINDOW},
+   "<sec>",
+   "time window of each columnar archive row group (default: " STR(
+     BGPSTREAM_COLUMNAR_WINDOW_DEFAULT) ")"},
+  {{"columnar-codec", required_argument, 0, OUTPUT_OPTION_COLUMNAR_CODEC},
+   "<codec>",
+   "compress each column of the columnar archive with the given codec (none, "
+   "zstd, lz4), keeping its row groups seekable (default: none)"},
+  {{"output-shm", required_argument, 0, OUTPUT_OPTION_SHM},
+   "<name>",
+   "publish each BGP record and its elems to a shared memory ring, which "
+   "local processes can read using the shm data interface"},
+  {{"shm-size", required_argument, 0, OUTPUT_OPTION_SHM_SIZE},
+   "<size>[k|m]",
+   "size of the shared memory ring (default: 64m)"},
   {{"output-records", no_argument, 0, 'r'},
    "",
    "print info "
@@ -163,6 +197,14 @@ static struct bs_options_t bs_opts[] =
   {{"output-headers", no_argument, 0, 'i'},
    "",
    "print format information before output"},
+  {{"output-threads", required_argument, 0, OUTPUT_OPTION_THREADS},
+   "<threads>",
+   "format output using the given number of threads, while a separate "
+   "thread writes it out in record order (default: 0, format on the "
+   "reading thread)"},
+  {{"output-buffer-size", required_argument, 0, OUTPUT_OPTION_BUFFER_SIZE},
+   "<size>[k|m]",
+   "size of the buffers used by the output threads (default: 1m)"},
   {{"version", no_argument, 0, 'v'},
    "",
    "print the version of bgpreader"},
@@ -197,11 +239,29 @@ static char short_options[OPTIONS_CNT * 2 + 1];
 
 static char buf[65536];
 
+/* default and minimum size of the output thread buffers */
+#define OUTPUT_BUFFER_SIZE_DEFAULT (1 << 20)
+#define OUTPUT_BUFFER_SIZE_MIN (sizeof(buf) * 4)
+#define OUTPUT_THREADS_MAX 64
+
+static size_t output_buffer_size = OUTPUT_BUFFER_SIZE_DEFAULT;
+
 static bgpstream_t *bs;
 static bgpstream_data_interface_id_t di_id_default = 0;
 static bgpstream_data_interface_id_t di_id = 0;
 static bgpstream_data_interface_info_t *di_info = NULL;
 
+static int record_output_on = 0;
+static int record_bgpdump_output_on = 0;
+static int elem_output_on = 0;
+static int binary_output_on = 0;
+static int columnar_output_on = 0;
+static const char *shm_output_name = NULL;
+#ifdef WITH_RPKI
+static rpki_cfg_t *rpki_cfg = NULL;
+static int rpki_active = 0;
+#endif
+
 #define longopt_width  (16)
 #define opt_width      (5 + longopt_width)
 #define optarg_col     (opt_width + 2)
@@ -320,12 +380,36 @@ static void usage()
   fprintf(stderr, "* denotes an option that can be given multiple times\n");
 }
 
+/* parse a size in bytes, with an optional k or m suffix */
+static int parse_size(const char *str, size_t *size)
+{
+  char *endp;
+
+  *size = strtoul(str, &endp, 10);
+  if (*endp == 'k' || *endp == 'K') {
+    *size <<= 10;
+    endp++;
+  } else if (*endp == 'm' || *endp == 'M') {
+    *size <<= 20;
+    endp++;
+  }
+  return (*str == '\0' || *endp != '\0') ? -1 : 0;
+}
+
 // print / utility functions
 
-static int print_record(bgpstream_record_t *record);
-static int print_elem(bgpstream_record_t *record, bgpstream_elem_t *elem);
-static int print_elem_bgpdump(bgpstream_record_t *record,
-                              bgpstream_elem_t *elem);
+typedef struct output_job output_job_t;
+typedef struct output_pipeline output_pipeline_t;
+
+static int output_record(output_job_t *job, bgpstream_record_t *record);
+
+static output_pipeline_t *output_pipeline_create(int threads);
+static int output_pipeline_add_record(output_pipeline_t *pl,
+                                      bgpstream_record_t *record);
+static int output_pipeline_stop(output_pipeline_t *pl, int abort);
+static void output_pipeline_destroy(output_pipeline_t *pl);
+
+static int write_stdout(const uint8_t *buf, size_t len, void *user);
 
 int main(int argc, char *argv[])
 {
@@ -351,9 +435,14 @@ int main(int argc, char *argv[])
   int rib_period = 0;
   int live = 0;
   int output_info = 0;
-  int record_output_on = 0;
-  int record_bgpdump_output_on = 0;
-  int elem_output_on = 0;
+  int output_threads = 0;
+  output_pipeline_t *pipeline = NULL;
+  bgpstream_binary_writer_t *binary_writer = NULL;
+  bgpstream_columnar_writer_t *columnar_writer = NULL;
+  uint32_t columnar_window = 0;
+  bgpstream_columnar_codec_t columnar_codec = BGPSTREAM_COLUMNAR_CODEC_NONE;
+  bgpstream_shm_publisher_t *shm_publisher = NULL;
+  size_t shm_size = 0;
   int exitstatus = -1; // fail, until proven otherwise
 
   int rec_limit = -1;
@@ -494,6 +583,33 @@ int main(int argc, char *argv[])
     case 'e':
       elem_output_on = 1;
       break;
+    case 'b':
+      binary_output_on = 1;
+      break;
+    case OUTPUT_OPTION_COLUMNAR:
+      columnar_output_on = 1;
+      break;
+    case OUTPUT_OPTION_COLUMNAR_WINDOW:
+      columnar_window = strtoul(optarg, &endp, 10);
+      if (*optarg == '\0' || *endp != '\0' || columnar_window == 0) {
+        fprintf(stderr, "ERROR: Columnar window must be a positive number "
+                        "of seconds\n");
+        error_cnt++;
+      }
+      break;
+    case OUTPUT_OPTION_COLUMNAR_CODEC:
+      if (strcmp(optarg, "none") == 0) {
+        columnar_codec = BGPSTREAM_COLUMNAR_CODEC_NONE;
+      } else if (strcmp(optarg, "zstd") == 0) {
+        columnar_codec = BGPSTREAM_COLUMNAR_CODEC_ZSTD;
+      } else if (strcmp(optarg, "lz4") == 0) {
+        columnar_codec = BGPSTREAM_COLUMNAR_CODEC_LZ4;
+      } else {
+        fprintf(stderr, "ERROR: Columnar codec must be one of none, zstd or "
+                        "lz4\n");
+        error_cnt++;
+      }
+      break;
     case 'i':
       output_info = 1;
       break;
@@ -503,6 +619,34 @@ int main(int argc, char *argv[])
     case 'I':
       intervalstring = optarg;
       break;
+    case OUTPUT_OPTION_THREADS:
+      output_threads = strtol(optarg, &endp, 10);
+      if (*optarg == '\0' || *endp != '\0' || output_threads < 0 ||
+          output_threads > OUTPUT_THREADS_MAX) {
+        fprintf(stderr, "ERROR: Output threads must be between 0 and %d\n",
+                OUTPUT_THREADS_MAX);
+        error_cnt++;
+      }
+      break;
+    case OUTPUT_OPTION_BUFFER_SIZE:
+      if (parse_size(optarg, &output_buffer_size) != 0 ||
+          output_buffer_size < OUTPUT_BUFFER_SIZE_MIN) {
+        fprintf(stderr, "ERROR: Output buffer size must be at least %zuk\n",
+                OUTPUT_BUFFER_SIZE_MIN >> 10);
+        error_cnt++;
+      }
+      break;
+    case OUTPUT_OPTION_SHM:
+      shm_output_name = optarg;
+      break;
+    case OUTPUT_OPTION_SHM_SIZE:
+      if (parse_size(optarg, &shm_size) != 0 ||
+          shm_size < BGPSTREAM_SHM_SIZE_MIN) {
+        fprintf(stderr, "ERROR: Shared memory size must be at least %dm\n",
+                BGPSTREAM_SHM_SIZE_MIN >> 20);
+        error_cnt++;
+      }
+      break;
     case 'v':
       fprintf(stderr, "bgpreader version %d.%d.%d\n", BGPSTREAM_MAJOR_VERSION,
               BGPSTREAM_MID_VERSION, BGPSTREAM_MINOR_VERSION);
@@ -574,11 +718,54 @@ int main(int argc, char *argv[])
     error_cnt++;
   }
 
+  // Binary output cannot be mixed with the text formats
+  if (binary_output_on &&
+      (elem_output_on || record_bgpdump_output_on || record_output_on)) {
+    fprintf(stderr, "ERROR: Cannot output in both binary (-b) and text "
+                    "formats (-e, -m, -r).\n");
+    error_cnt++;
+  }
+
+  // Columnar output cannot be mixed with any other format
+  if (columnar_output_on && (binary_output_on || elem_output_on ||
+                             record_bgpdump_output_on || record_output_on)) {
+    fprintf(stderr, "ERROR: Cannot output in both columnar (--output-columnar) "
+                    "and other formats (-b, -e, -m, -r).\n");
+    error_cnt++;
+  }
+
+  // Shared memory output replaces the output on stdout
+  if (shm_output_name != NULL &&
+      (binary_output_on || columnar_output_on || elem_output_on ||
+       record_bgpdump_output_on || record_output_on)) {
+    fprintf(stderr, "ERROR: Cannot output to shared memory (--output-shm) "
+                    "and in other formats (-b, -e, -m, -r, "
+                    "--output-columnar).\n");
+    error_cnt++;
+  }
+
   // if the user did not specify any output format, default to per elem
-  if (!record_output_on && !elem_output_on && !record_bgpdump_output_on) {
+  if (!record_output_on && !elem_output_on && !record_bgpdump_output_on &&
+      !binary_output_on && !columnar_output_on && shm_output_name == NULL) {
     elem_output_on = 1;
   }
 
+  // the binary writers are cheap enough to run on the reading thread
+  if ((binary_output_on || columnar_output_on || shm_output_name != NULL) &&
+      output_threads > 0) {
+    fprintf(stderr, "WARN: Output threads are not used for binary output\n");
+    output_threads = 0;
+  }
+
+#ifdef WITH_RPKI
+  // RPKI validation is not thread-safe, so format on the reading thread
+  if (output_threads > 0 && rpki_input != NULL && rpki_input->rpki_active) {
+    fprintf(stderr, "WARN: Output threads are not supported with RPKI "
+                    "validation, formatting on the reading thread\n");
+    output_threads = 0;
+  }
+#endif
+
   // Parse the filter string
   if (filterstring) {
     if (!bgpstream_parse_filter_string(bs, filterstring)) {
@@ -636,6 +823,11 @@ int main(int argc, char *argv[])
     bgpstream_set_live_mode(bs);
   }
 
+  /* records are handed to the output threads, so they must be retained */
+  if (output_threads > 0) {
+    bgpstream_set_record_retain_mode(bs);
+  }
+
   /* turn on interface */
   if (bgpstream_start(bs) < 0) {
     return -1;
@@ -651,20 +843,55 @@ int main(int argc, char *argv[])
   }
 
   /* use the interface */
-  int rrc = 0, erc = 0, rec_cnt = 0;
-  bgpstream_elem_t *bs_elem;
+  int rrc = 0, rec_cnt = 0;
 
 #ifdef WITH_RPKI
-  rpki_cfg_t *cfg = NULL;
   if (rpki_input != NULL && rpki_input->rpki_active) {
     if (!bgpstream_rpki_parse_interval(rpki_input, interval_start, interval_end)) {
       fprintf(stderr, "ERROR: Could not parse time window for RPKI\n");
       goto done;
     }
-    cfg = bgpstream_rpki_set_cfg(rpki_input);
+    rpki_cfg = bgpstream_rpki_set_cfg(rpki_input);
+    rpki_active = rpki_input->rpki_active;
   }
 #endif
 
+  if (binary_output_on &&
+      (binary_writer = bgpstream_binary_writer_create(write_stdout, NULL)) ==
+        NULL) {
+    fprintf(stderr, "ERROR: Could not create binary writer\n");
+    goto done;
+  }
+
+  if (columnar_output_on &&
+      (columnar_writer = bgpstream_columnar_writer_create(
+         write_stdout, NULL, columnar_window)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create columnar writer\n");
+    goto done;
+  }
+  if (columnar_writer != NULL &&
+      bgpstream_columnar_writer_set_codec(columnar_writer, columnar_codec) !=
+        0) {
+    fprintf(stderr, "ERROR: Columnar codec not supported by this build\n");
+    goto done;
+  }
+
+  if (shm_output_name != NULL &&
+      (shm_publisher = bgpstream_shm_publisher_create(shm_output_name,
+                                                      shm_size)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create shared memory publisher\n");
+    goto done;
+  }
+
+  if (output_threads > 0) {
+    // the writer thread bypasses stdio, so flush the headers first
+    fflush(stdout);
+    if ((pipeline = output_pipeline_create(output_threads)) == NULL) {
+      fprintf(stderr, "ERROR: Could not start output threads\n");
+      goto done;
+    }
+  }
+
   while ((rec_limit < 0 || rec_cnt < rec_limit) &&
          (rrc = bgpstream_get_next_record(bs, &bs_record)) > 0) {
     rec_cnt++;
@@ -673,60 +900,50 @@ int main(int argc, char *argv[])
       continue;
     }
 
-    if (record_output_on && print_record(bs_record) != 0) {
-      goto done;
-    }
-
-    /* check if the record is of type RIB, in case extract the ID */
-    /* print the RIB start line */
-    if (bs_record->type == BGPSTREAM_RIB &&
-        bs_record->dump_pos == BGPSTREAM_DUMP_START &&
-        print_record(bs_record) != 0) {
-      goto done;
-    }
-
-    if (record_bgpdump_output_on || elem_output_on) {
-      while ((erc = bgpstream_record_get_next_elem(bs_record, &bs_elem)) > 0) {
-#ifdef WITH_RPKI
-        if (rpki_input != NULL && rpki_input->rpki_active) {
-          bs_elem->annotations.cfg = cfg;
-          bs_elem->annotations.rpki_active = rpki_input->rpki_active;
-          bs_elem->annotations.timestamp = bs_record->time_sec;
-        }
-#endif
-        // print record following bgpdump format
-        if (record_bgpdump_output_on &&
-            print_elem_bgpdump(bs_record, bs_elem) != 0) {
-          goto done;
-        } else if (elem_output_on && print_elem(bs_record, bs_elem) != 0) {
-          goto done;
-        }
+    if (binary_writer != NULL) {
+      if (bgpstream_binary_writer_add_record(binary_writer, bs_record) != 0) {
+        goto done;
       }
-
-      if (erc != 0) {
-        fprintf(stderr, "ERROR: Failed to get elem from record\n");
+    } else if (columnar_writer != NULL) {
+      if (bgpstream_columnar_writer_add_record(columnar_writer, bs_record) !=
+          0) {
         goto done;
       }
-
-      /* check if end of RIB has been reached */
-      if (bs_record->type == BGPSTREAM_RIB &&
-          bs_record->dump_pos == BGPSTREAM_DUMP_END &&
-          print_record(bs_record) != 0) {
+    } else if (shm_publisher != NULL) {
+      // a record that does not fit in the ring is skipped
+      bgpstream_shm_publisher_add_record(shm_publisher, bs_record);
+    } else if (pipeline != NULL) {
+      if (output_pipeline_add_record(pipeline, bs_record) != 0) {
         goto done;
       }
+    } else if (output_record(NULL, bs_record) != 0) {
+      goto done;
     }
   }
 
   if (rrc < 0) {
     fprintf(stderr, "ERROR: Failed to get record from stream\n");
-  } else {
+  } else if ((pipeline == NULL || output_pipeline_stop(pipeline, 0) == 0) &&
+             (binary_writer == NULL ||
+              bgpstream_binary_writer_flush(binary_writer) == 0) &&
+             (columnar_writer == NULL ||
+              bgpstream_columnar_writer_flush(columnar_writer) == 0)) {
     exitstatus = 0; // success
   }
 
 done:
+  /* all retained records must be released before the stream is destroyed */
+  if (pipeline != NULL) {
+    output_pipeline_stop(pipeline, 1);
+    output_pipeline_destroy(pipeline);
+  }
+  bgpstream_binary_writer_destroy(binary_writer);
+  bgpstream_columnar_writer_destroy(columnar_writer);
+  bgpstream_shm_publisher_destroy(shm_publisher);
+
 #ifdef WITH_RPKI
   if (rpki_input != NULL && rpki_input->rpki_active) {
-    bgpstream_rpki_destroy_cfg(cfg);
+    bgpstream_rpki_destroy_cfg(rpki_cfg);
     bgpstream_rpki_destroy_input(rpki_input);
   }
 #endif
@@ -738,37 +955,509 @@ done:
 
 /* print utility functions */
 
-static int print_record(bgpstream_record_t *record)
+typedef char *(line_snprintf_t)(char *buf, size_t len,
+                                bgpstream_record_t *record,
+                                bgpstream_elem_t *elem);
+
+static char *record_line(char *buf, size_t len, bgpstream_record_t *record,
+                         bgpstream_elem_t *elem)
 {
-  if (bgpstream_record_snprintf(buf, sizeof(buf), record) == NULL) {
-    fprintf(stderr, "ERROR: Could not convert record to string\n");
+  return bgpstream_record_snprintf(buf, len, record);
+}
+
+static char *elem_line(char *buf, size_t len, bgpstream_record_t *record,
+                       bgpstream_elem_t *elem)
+{
+  return bgpstream_record_elem_snprintf(buf, len, record, elem);
+}
+
+static char *elem_bgpdump_line(char *buf, size_t len,
+                               bgpstream_record_t *record,
+                               bgpstream_elem_t *elem)
+{
+  return bgpstream_record_elem_bgpdump_snprintf(buf, len, record, elem);
+}
+
+static int write_stdout(const uint8_t *buf, size_t len, void *user)
+{
+  if (fwrite(buf, 1, len, stdout) != len) {
+    fprintf(stderr, "ERROR: Could not write output: %s\n", strerror(errno));
     return -1;
   }
+  return 0;
+}
+
+/* Threaded output: the reading thread groups records into jobs, formatter
+ * threads render each job into its own buffers, and a writer thread writes the
+ * buffers of finished jobs to stdout in the order the jobs were queued. A job
+ * is queued once it is full, or once its first record has waited
+ * OUTPUT_FLUSH_MSEC, so that a quiet live stream is not held back. */
+
+/** Number of records handed to a formatter thread at a time */
+#define OUTPUT_JOB_RECORDS_CNT 128
+
+/** Number of jobs that may be in flight per formatter thread */
+#define OUTPUT_JOBS_PER_THREAD 4
+
+/** How long (msec) a record may wait in a partly filled job before the job is
+    queued anyway (e.g., in live mode, when the next record may be minutes
+    away) */
+#define OUTPUT_FLUSH_MSEC 100
+
+typedef enum {
+  OUTPUT_JOB_FREE,
+  OUTPUT_JOB_FILLING,
+  OUTPUT_JOB_QUEUED,
+  OUTPUT_JOB_FORMATTING,
+  OUTPUT_JOB_DONE,
+} output_job_state_t;
+
+struct output_job {
+  output_job_state_t state;
+
+  /** Retained records to format */
+  bgpstream_record_t *records[OUTPUT_JOB_RECORDS_CNT];
+  int records_cnt;
+
+  /** Formatted output, split over buffers of output_buffer_size bytes. The
+      buffers are kept for reuse by later jobs. */
+  char **bufs;
+  size_t *bufs_used;
+  int bufs_cnt;
+  int bufs_alloc_cnt;
+};
+
+struct output_pipeline {
+  pthread_mutex_t mutex;
+  pthread_cond_t job_free;
+  pthread_cond_t job_queued;
+  pthread_cond_t job_done;
+
+  output_job_t *jobs;
+  int jobs_cnt;
+
+  /** Job currently being filled by the reading thread, and when its first
+      record was added */
+  output_job_t *filling;
+  struct timespec filling_since;
+
+  /** Sequence numbers of the next job to be queued, formatted and written.
+      Job n lives in jobs[n % jobs_cnt] */
+  uint64_t queue_seq;
+  uint64_t format_seq;
+  uint64_t write_seq;
+
+  /** Set once no more jobs will be queued */
+  int eof;
+
+  /** Set when a thread fails, or when the pipeline is aborted */
+  int error;
+
+  pthread_t *formatters;
+  int formatters_cnt;
+  pthread_t writer;
+  int writer_started;
+  int stopped;
+};
 
-  printf("%s\n", buf);
+/* make a new, empty, buffer the current one for the given job */
+static int output_job_next_buf(output_job_t *job)
+{
+  if (job->bufs_cnt == job->bufs_alloc_cnt) {
+    char **bufs;
+    size_t *used;
+    if ((bufs = realloc(job->bufs, sizeof(char *) * (job->bufs_cnt + 1))) ==
+        NULL) {
+      return -1;
+    }
+    job->bufs = bufs;
+    if ((used = realloc(job->bufs_used,
+                        sizeof(size_t) * (job->bufs_cnt + 1))) == NULL) {
+      return -1;
+    }
+    job->bufs_used = used;
+    if ((job->bufs[job->bufs_cnt] = malloc(output_buffer_size)) == NULL) {
+      return -1;
+    }
+    job->bufs_alloc_cnt++;
+  }
+  job->bufs_used[job->bufs_cnt++] = 0;
   return 0;
 }
 
-static int print_elem(bgpstream_record_t *record, bgpstream_elem_t *elem)
+/* format a line, followed by a newline, to stdout (if job is NULL) or to the
+ * buffers of the given job */
+static int print_line(output_job_t *job, line_snprintf_t *fn,
+                      bgpstream_record_t *record, bgpstream_elem_t *elem)
 {
-  if (bgpstream_record_elem_snprintf(buf, sizeof(buf), record, elem) == NULL) {
+  char *p;
+  size_t len;
+  size_t n;
+
+  if (job == NULL) {
+    if (fn(buf, sizeof(buf), record, elem) == NULL) {
+      goto err;
+    }
+    printf("%s\n", buf);
+    return 0;
+  }
+
+  // start a new buffer unless the current one can hold the longest line we
+  // would print to stdout
+  if (job->bufs_cnt == 0 ||
+      output_buffer_size - job->bufs_used[job->bufs_cnt - 1] < sizeof(buf)) {
+    if (output_job_next_buf(job) != 0) {
+      fprintf(stderr, "ERROR: Could not allocate output buffer\n");
+      return -1;
+    }
+  }
+  p = job->bufs[job->bufs_cnt - 1] + job->bufs_used[job->bufs_cnt - 1];
+  len = output_buffer_size - job->bufs_used[job->bufs_cnt - 1];
+  if (fn(p, len, record, elem) == NULL) {
+    goto err;
+  }
+  // replace the terminating nul (which fit in the buffer) with a newline
+  n = strlen(p);
+  p[n] = '\n';
+  job->bufs_used[job->bufs_cnt - 1] += n + 1;
+  return 0;
+
+err:
+  if (elem == NULL) {
+    fprintf(stderr, "ERROR: Could not convert record to string\n");
+  } else {
     fprintf(stderr, "ERROR: Could not convert record/elem to string\n");
+  }
+  return -1;
+}
+
+/* print the output for a single (valid) record to stdout (if job is NULL) or
+ * to the buffers of the given job */
+static int output_record(output_job_t *job, bgpstream_record_t *record)
+{
+  bgpstream_elem_t *elem;
+  int rc;
+
+  if (record_output_on && print_line(job, record_line, record, NULL) != 0) {
     return -1;
   }
 
-  printf("%s\n", buf);
+  /* check if the record is of type RIB, in case extract the ID */
+  /* print the RIB start line */
+  if (record->type == BGPSTREAM_RIB &&
+      record->dump_pos == BGPSTREAM_DUMP_START &&
+      print_line(job, record_line, record, NULL) != 0) {
+    return -1;
+  }
+
+  if (record_bgpdump_output_on || elem_output_on) {
+    while ((rc = bgpstream_record_get_next_elem(record, &elem)) > 0) {
+#ifdef WITH_RPKI
+      if (rpki_active) {
+        elem->annotations.cfg = rpki_cfg;
+        elem->annotations.rpki_active = rpki_active;
+        elem->annotations.timestamp = record->time_sec;
+      }
+#endif
+      // print record following bgpdump format
+      if (record_bgpdump_output_on &&
+          print_line(job, elem_bgpdump_line, record, elem) != 0) {
+        return -1;
+      } else if (elem_output_on &&
+                 print_line(job, elem_line, record, elem) != 0) {
+        return -1;
+      }
+    }
+
+    if (rc != 0) {
+      fprintf(stderr, "ERROR: Failed to get elem from record\n");
+      return -1;
+    }
+
+    /* check if end of RIB has been reached */
+    if (record->type == BGPSTREAM_RIB &&
+        record->dump_pos == BGPSTREAM_DUMP_END &&
+        print_line(job, record_line, record, NULL) != 0) {
+      return -1;
+    }
+  }
+
   return 0;
 }
 
-static int print_elem_bgpdump(bgpstream_record_t *record,
-                              bgpstream_elem_t *elem)
+/* must be called with the pipeline mutex held */
+static void output_pipeline_fail(output_pipeline_t *pl)
 {
-  if (bgpstream_record_elem_bgpdump_snprintf(buf, sizeof(buf), record, elem) ==
-      NULL) {
-    fprintf(stderr, "ERROR: Could not convert record/elem to string\n");
+  pl->error = 1;
+  pthread_cond_broadcast(&pl->job_free);
+  pthread_cond_broadcast(&pl->job_queued);
+  pthread_cond_broadcast(&pl->job_done);
+}
+
+/* must be called with the pipeline mutex held */
+static void queue_job(output_pipeline_t *pl)
+{
+  pl->filling->state = OUTPUT_JOB_QUEUED;
+  pl->filling = NULL;
+  pl->queue_seq++;
+  pthread_cond_signal(&pl->job_queued);
+}
+
+/* has the job being filled waited long enough to be queued? if not, set
+ * deadline to when it will have. must be called with the pipeline mutex held */
+static int output_pipeline_flush_due(output_pipeline_t *pl,
+                                     struct timespec *deadline)
+{
+  struct timespec now;
+
+  *deadline = pl->filling_since;
+  deadline->tv_nsec += (OUTPUT_FLUSH_MSEC % 1000) * 1000000L;
+  deadline->tv_sec += OUTPUT_FLUSH_MSEC / 1000 + deadline->tv_nsec / 1000000000L;
+  deadline->tv_nsec %= 1000000000L;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec > deadline->tv_sec ||
+         (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static void *output_formatter_thread(void *user)
+{
+  output_pipeline_t *pl = user;
+  struct timespec deadline;
+  output_job_t *job;
+  int rc;
+  int i;
+
+  pthread_mutex_lock(&pl->mutex);
+  for (;;) {
+    while (!pl->error && !pl->eof && pl->format_seq == pl->queue_seq) {
+      if (pl->filling == NULL || pl->filling->records_cnt == 0) {
+        pthread_cond_wait(&pl->job_queued, &pl->mutex);
+      } else if (output_pipeline_flush_due(pl, &deadline)) {
+        // nothing else to do, and the reader may be blocked waiting for data
+        queue_job(pl);
+      } else {
+        pthread_cond_timedwait(&pl->job_queued, &pl->mutex, &deadline);
+      }
+    }
+    if (pl->error || pl->format_seq == pl->queue_seq) {
+      break;
+    }
+    job = &pl->jobs[pl->format_seq++ % pl->jobs_cnt];
+    job->state = OUTPUT_JOB_FORMATTING;
+    pthread_mutex_unlock(&pl->mutex);
+
+    job->bufs_cnt = 0;
+    rc = 0;
+    for (i = 0; i < job->records_cnt; i++) {
+      if (rc == 0) {
+        rc = output_record(job, job->records[i]);
+      }
+      bgpstream_record_release(job->records[i]);
+    }
+    job->records_cnt = 0;
+
+    pthread_mutex_lock(&pl->mutex);
+    job->state = OUTPUT_JOB_DONE;
+    if (rc != 0) {
+      output_pipeline_fail(pl);
+    }
+    pthread_cond_broadcast(&pl->job_done);
+  }
+  pthread_mutex_unlock(&pl->mutex);
+
+  return NULL;
+}
+
+static int write_all(int fd, const char *p, size_t len)
+{
+  ssize_t rc;
+
+  while (len > 0) {
+    if ((rc = write(fd, p, len)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += rc;
+    len -= rc;
+  }
+  return 0;
+}
+
+static void *output_writer_thread(void *user)
+{
+  output_pipeline_t *pl = user;
+  output_job_t *job;
+  int rc;
+  int i;
+
+  pthread_mutex_lock(&pl->mutex);
+  for (;;) {
+    job = &pl->jobs[pl->write_seq % pl->jobs_cnt];
+    while (!pl->error && job->state != OUTPUT_JOB_DONE &&
+           !(pl->eof && pl->write_seq == pl->queue_seq)) {
+      pthread_cond_wait(&pl->job_done, &pl->mutex);
+    }
+    if (pl->error || job->state != OUTPUT_JOB_DONE) {
+      break;
+    }
+    pthread_mutex_unlock(&pl->mutex);
+
+    rc = 0;
+    for (i = 0; rc == 0 && i < job->bufs_cnt; i++) {
+      rc = write_all(STDOUT_FILENO, job->bufs[i], job->bufs_used[i]);
+    }
+    if (rc != 0) {
+      fprintf(stderr, "ERROR: Could not write output: %s\n", strerror(errno));
+    }
+
+    pthread_mutex_lock(&pl->mutex);
+    job->state = OUTPUT_JOB_FREE;
+    pl->write_seq++;
+    if (rc != 0) {
+      output_pipeline_fail(pl);
+    }
+    pthread_cond_broadcast(&pl->job_free);
+  }
+  pthread_mutex_unlock(&pl->mutex);
+
+  return NULL;
+}
+
+static output_pipeline_t *output_pipeline_create(int threads)
+{
+  output_pipeline_t *pl;
+
+  if ((pl = malloc_zero(sizeof(output_pipeline_t))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&pl->mutex, NULL);
+  pthread_cond_init(&pl->job_free, NULL);
+  pthread_cond_init(&pl->job_queued, NULL);
+  pthread_cond_init(&pl->job_done, NULL);
+
+  pl->jobs_cnt = threads * OUTPUT_JOBS_PER_THREAD;
+  if ((pl->jobs = malloc_zero(sizeof(output_job_t) * pl->jobs_cnt)) == NULL ||
+      (pl->formatters = malloc_zero(sizeof(pthread_t) * threads)) == NULL) {
+    goto err;
+  }
+
+  for (; pl->formatters_cnt < threads; pl->formatters_cnt++) {
+    if (pthread_create(&pl->formatters[pl->formatters_cnt], NULL,
+                       output_formatter_thread, pl) != 0) {
+      goto err;
+    }
+  }
+  if (pthread_create(&pl->writer, NULL, output_writer_thread, pl) != 0) {
+    goto err;
+  }
+  pl->writer_started = 1;
+
+  return pl;
+
+err:
+  output_pipeline_stop(pl, 1);
+  output_pipeline_destroy(pl);
+  return NULL;
+}
+
+static int output_pipeline_add_record(output_pipeline_t *pl,
+                                      bgpstream_record_t *record)
+{
+  output_job_t *job;
+
+  if (bgpstream_record_retain(record) != 0) {
     return -1;
   }
 
-  printf("%s\n", buf);
+  pthread_mutex_lock(&pl->mutex);
+  if (pl->filling == NULL) {
+    job = &pl->jobs[pl->queue_seq % pl->jobs_cnt];
+    while (!pl->error && job->state != OUTPUT_JOB_FREE) {
+      pthread_cond_wait(&pl->job_free, &pl->mutex);
+    }
+    if (pl->error) {
+      pthread_mutex_unlock(&pl->mutex);
+      bgpstream_record_release(record);
+      return -1;
+    }
+    job->state = OUTPUT_JOB_FILLING;
+    pl->filling = job;
+  }
+
+  // a formatter thread queues the job itself if no more records arrive soon
+  job = pl->filling;
+  job->records[job->records_cnt++] = record;
+  if (job->records_cnt == OUTPUT_JOB_RECORDS_CNT) {
+    queue_job(pl);
+  } else if (job->records_cnt == 1) {
+    clock_gettime(CLOCK_REALTIME, &pl->filling_since);
+    pthread_cond_signal(&pl->job_queued);
+  }
+  pthread_mutex_unlock(&pl->mutex);
+
   return 0;
 }
+
+/* wait for all queued records to be written (or, if abort is set, for the
+ * threads to give up) and stop the threads */
+static int output_pipeline_stop(output_pipeline_t *pl, int abort)
+{
+  int i;
+
+  if (pl->stopped) {
+    return pl->error ? -1 : 0;
+  }
+
+  pthread_mutex_lock(&pl->mutex);
+  if (abort) {
+    output_pipeline_fail(pl);
+  } else if (pl->filling != NULL) {
+    queue_job(pl);
+  }
+  pl->eof = 1;
+  pthread_cond_broadcast(&pl->job_queued);
+  pthread_cond_broadcast(&pl->job_done);
+  pthread_mutex_unlock(&pl->mutex);
+
+  for (i = 0; i < pl->formatters_cnt; i++) {
+    pthread_join(pl->formatters[i], NULL);
+  }
+  if (pl->writer_started) {
+    pthread_join(pl->writer, NULL);
+  }
+  pl->stopped = 1;
+
+  return (abort || pl->error) ? -1 : 0;
+}
+
+static void output_pipeline_destroy(output_pipeline_t *pl)
+{
+  output_job_t *job;
+  int i, j;
+
+  if (pl->jobs != NULL) {
+    for (i = 0; i < pl->jobs_cnt; i++) {
+      job = &pl->jobs[i];
+      // records of jobs that were never formatted are still retained
+      for (j = 0; j < job->records_cnt; j++) {
+        bgpstream_record_release(job->records[j]);
+      }
+      for (j = 0; j < job->bufs_alloc_cnt; j++) {
+        free(job->bufs[j]);
+      }
+      free(job->bufs);
+      free(job->bufs_used);
+    }
+    free(pl->jobs);
+  }
+  free(pl->formatters);
+
+  pthread_mutex_destroy(&pl->mutex);
+  pthread_cond_destroy(&pl->job_free);
+  pthread_cond_destroy(&pl->job_queued);
+  pthread_cond_destroy(&pl->job_done);
+  free(pl);
+}